@@ -12,6 +12,7 @@ void D3D10Device::clear_drawcall_stats()
 	_draw_call_tracker.reset();
 	_active_depthstencil.reset();
 	_clear_DSV_iter = 1;
+	_clear_DSV_count = 0;
 }
 
 #if RESHADE_DX10_CAPTURE_DEPTH_BUFFERS
@@ -25,6 +26,11 @@ bool D3D10Device::save_depth_texture(ID3D10DepthStencilView *pDepthStencilView,
 
 	if (!runtime->depth_buffer_before_clear)
 		return false;
+
+	// Count every clear, so the count stays comparable between frames whatever the checks below reject
+	if (cleared)
+		this->_clear_DSV_count++;
+
 	if (!cleared && !runtime->extended_depth_buffer_detection)
 		return false;
 
@@ -57,8 +63,12 @@ bool D3D10Device::save_depth_texture(ID3D10DepthStencilView *pDepthStencilView,
 		return false;
 	}
 
+	// Only the clear that is eventually selected needs a copy, and copies of the same shape all go to the same texture, so skip what comes before the clear selected in the last frame.
+	// This compares the clears counted in this frame, since the number of other depth stencil bindings between them can change from frame to frame. If this frame has fewer clears than the last one, no copy is made and the next frame copies everything again.
+	const bool is_before_last_selected = this->_clear_DSV_count < runtime->last_depth_buffer_clear_count;
+
 	// In case the depth texture is retrieved, we make a copy of it and store it in an ordered map to use it later in the final rendering stage.
-	if ((runtime->cleared_depth_buffer_index == 0 && cleared) || (this->_clear_DSV_iter <= runtime->cleared_depth_buffer_index))
+	if (!is_before_last_selected && ((runtime->cleared_depth_buffer_index == 0 && cleared) || (this->_clear_DSV_iter <= runtime->cleared_depth_buffer_index)))
 	{
 		// Select an appropriate destination texture
 		com_ptr<ID3D10Texture2D> depth_texture_save = runtime->select_depth_texture_save(desc);
@@ -73,13 +83,13 @@ bool D3D10Device::save_depth_texture(ID3D10DepthStencilView *pDepthStencilView,
 		this->CopyResource(depth_texture_save.get(), texture.get());
 
 		// Store the saved texture in the ordered map.
-		_draw_call_tracker.track_depth_texture(runtime->depth_buffer_texture_format, this->_clear_DSV_iter, texture.get(), pDepthStencilView, depth_texture_save, cleared);
+		_draw_call_tracker.track_depth_texture(runtime->depth_buffer_texture_format, this->_clear_DSV_iter, this->_clear_DSV_count, texture.get(), pDepthStencilView, depth_texture_save, cleared);
 	}
 	else
 	{
 		// Store a null depth texture in the ordered map in order to display it even if the user chose a previous cleared texture.
 		// This way the texture will still be visible in the depth buffer selection window and the user can choose it.
-		_draw_call_tracker.track_depth_texture(runtime->depth_buffer_texture_format, this->_clear_DSV_iter, texture.get(), pDepthStencilView, nullptr, cleared);
+		_draw_call_tracker.track_depth_texture(runtime->depth_buffer_texture_format, this->_clear_DSV_iter, this->_clear_DSV_count, texture.get(), pDepthStencilView, nullptr, cleared);
 	}
 
 	// TODO: This is unsafe if multiple device contexts are used on multiple threads
@@ -140,4 +140,5 @@ struct D3D10Device : ID3D10Device1
 	com_ptr<ID3D10DepthStencilView> _active_depthstencil;
 	reshade::d3d10::draw_call_tracker _draw_call_tracker;
 	unsigned int _clear_DSV_iter = 1;
+	unsigned int _clear_DSV_count = 0;
 };
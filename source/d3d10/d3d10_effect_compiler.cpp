@@ -5,8 +5,10 @@
 
 #include "d3d10_runtime.hpp"
 #include "d3d10_effect_compiler.hpp"
+#include "effect_reachability.hpp"
+#include "gpu_marker.hpp"
+#include "shader_cache.hpp"
 #include <assert.h>
-#include <iomanip>
 #include <fstream>
 #include <algorithm>
 #include <d3dcompiler.h>
@@ -208,8 +210,10 @@ namespace reshade::d3d10
 #endif
 	}
 
-	bool d3d10_effect_compiler::run()
+	bool d3d10_effect_compiler::compile()
 	{
+		_is_compiled = true;
+
 		_d3dcompiler_module = LoadLibraryW(L"d3dcompiler_47.dll");
 
 		if (_d3dcompiler_module == nullptr)
@@ -219,17 +223,17 @@ namespace reshade::d3d10
 		if (_d3dcompiler_module == nullptr)
 		{
 			_errors += "Unable to load D3DCompiler library. Make sure you have the DirectX end-user runtime (June 2010) installed or a newer version of the library in the application directory.\n";
-			return false;
+			return _success = false;
 		}
 
-		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
-
 		for (auto node : _ast.structs)
 		{
 			visit(_global_code, node);
 		}
 		for (auto uniform : _ast.variables)
 		{
+			const auto code_begin = _global_code.size();
+
 			if (uniform->type.is_texture())
 			{
 				visit_texture(uniform);
@@ -238,6 +242,10 @@ namespace reshade::d3d10
 			{
 				visit_sampler(uniform);
 			}
+			else if (uniform->type.is_storage() || uniform->type.has_qualifier(type_node::qualifier_groupshared))
+			{
+				error(uniform->location, "storage objects and 'groupshared' variables are not supported in Direct3D 10, check '__RENDERER__' to leave them out");
+			}
 			else if (uniform->type.has_qualifier(type_node::qualifier_uniform))
 			{
 				visit_uniform(uniform);
@@ -248,23 +256,95 @@ namespace reshade::d3d10
 
 				_global_code << ";\n";
 			}
+
+			_global_declarations.push_back({ uniform, code_begin, _global_code.size() });
 		}
 		for (auto function : _ast.functions)
 		{
+			const auto code_begin = _global_code.size();
+
 			visit(_global_code, function);
+
+			_global_declarations.push_back({ function, code_begin, _global_code.size() });
 		}
 		for (auto technique : _ast.techniques)
 		{
-			visit_technique(technique);
+			for (auto pass : technique->pass_list)
+			{
+				compile_pass(pass);
+			}
 		}
 
 		if (_constant_buffer_size != 0)
 		{
 			_constant_buffer_size = roundto16(_constant_buffer_size);
-			_runtime->get_uniform_value_storage().resize(_uniform_storage_offset + _constant_buffer_size);
+			_uniform_data.resize(_constant_buffer_size);
+		}
+
+		FreeLibrary(_d3dcompiler_module);
+
+		return _success;
+	}
+	bool d3d10_effect_compiler::run()
+	{
+		if (!_is_compiled)
+		{
+			compile();
+		}
+		if (!_success)
+		{
+			return false;
+		}
+
+		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
 
+		_shader_resources.resize(_shader_resource_count);
+		_shader_resources[0] = _runtime->_backbuffer_texture_srv[0];
+		_shader_resources[1] = _runtime->_backbuffer_texture_srv[1];
+		_shader_resources[2] = _runtime->_depthstencil_texture_srv;
+		_sampler_states.resize(_sampler_descs.size());
+
+		for (auto variable : _ast.variables)
+		{
+			if (variable->type.is_texture())
+			{
+				create_texture(variable);
+			}
+			else if (variable->type.is_sampler())
+			{
+				create_sampler(variable);
+			}
+		}
+
+		if (!_success)
+		{
+			return false;
+		}
+
+		for (auto &obj : _uniforms)
+		{
+			obj.storage_offset += _uniform_storage_offset;
+
+			_runtime->add_uniform(std::move(obj));
+		}
+
+		if (_constant_buffer_size != 0)
+		{
+			auto &uniform_storage = _runtime->get_uniform_value_storage();
+			uniform_storage.resize(_uniform_storage_offset + _constant_buffer_size);
+
+			CopyMemory(uniform_storage.data() + _uniform_storage_offset, _uniform_data.data(), _constant_buffer_size);
+		}
+
+		for (auto technique : _ast.techniques)
+		{
+			visit_technique(technique);
+		}
+
+		if (_constant_buffer_size != 0)
+		{
 			const CD3D10_BUFFER_DESC globals_desc(static_cast<UINT>(_constant_buffer_size), D3D10_BIND_CONSTANT_BUFFER, D3D10_USAGE_DYNAMIC, D3D10_CPU_ACCESS_WRITE);
-			const D3D10_SUBRESOURCE_DATA globals_initial = { _runtime->get_uniform_value_storage().data(), static_cast<UINT>(_constant_buffer_size) };
+			const D3D10_SUBRESOURCE_DATA globals_initial = { _runtime->get_uniform_value_storage().data() + _uniform_storage_offset, static_cast<UINT>(_constant_buffer_size) };
 
 			com_ptr<ID3D10Buffer> constant_buffer;
 			_runtime->_device->CreateBuffer(&globals_desc, &globals_initial, &constant_buffer);
@@ -272,7 +352,9 @@ namespace reshade::d3d10
 			_runtime->_constant_buffers.push_back(std::move(constant_buffer));
 		}
 
-		FreeLibrary(_d3dcompiler_module);
+		// The state block saves and restores as many slots as the largest effect binds
+		_runtime->_effect_shader_resource_count = std::max(_runtime->_effect_shader_resource_count, _shader_resources.size());
+		_runtime->_effect_sampler_count = std::max(_runtime->_effect_sampler_count, _sampler_states.size());
 
 		return _success;
 	}
@@ -288,7 +370,7 @@ namespace reshade::d3d10
 		_errors += location.source + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): warning: " + message + '\n';
 	}
 
-	void d3d10_effect_compiler::visit(std::stringstream &output, const statement_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const statement_node *node)
 	{
 		if (node == nullptr)
 		{
@@ -328,7 +410,7 @@ namespace reshade::d3d10
 				assert(false);
 		}
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const expression_node *node)
 	{
 		assert(node != nullptr);
 
@@ -378,7 +460,7 @@ namespace reshade::d3d10
 		}
 	}
 
-	void d3d10_effect_compiler::visit(std::stringstream &output, const type_node &type, bool with_qualifiers)
+	void d3d10_effect_compiler::visit(code_buffer &output, const type_node &type, bool with_qualifiers)
 	{
 		if (with_qualifiers)
 		{
@@ -442,11 +524,11 @@ namespace reshade::d3d10
 			output << type.rows;
 		}
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const lvalue_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const lvalue_expression_node *node)
 	{
 		output << node->reference->unique_name;
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const literal_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const literal_expression_node *node)
 	{
 		if (!node->type.is_scalar())
 		{
@@ -469,7 +551,7 @@ namespace reshade::d3d10
 					output << node->value_uint[i];
 					break;
 				case type_node::datatype_float:
-					output << std::setprecision(8) << std::fixed << node->value_float[i];
+					output << node->value_float[i];
 					break;
 			}
 
@@ -484,7 +566,7 @@ namespace reshade::d3d10
 			output << ')';
 		}
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const expression_sequence_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const expression_sequence_node *node)
 	{
 		output << '(';
 
@@ -500,7 +582,7 @@ namespace reshade::d3d10
 
 		output << ')';
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const unary_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const unary_expression_node *node)
 	{
 		switch (node->op)
 		{
@@ -540,7 +622,7 @@ namespace reshade::d3d10
 				break;
 		}
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const binary_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const binary_expression_node *node)
 	{
 		std::string part1, part2, part3;
 
@@ -648,7 +730,7 @@ namespace reshade::d3d10
 		visit(output, node->operands[1]);
 		output << part3;
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const intrinsic_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const intrinsic_expression_node *node)
 	{
 		std::string part1, part2, part3, part4, part5;
 
@@ -699,6 +781,10 @@ namespace reshade::d3d10
 				part2 = ", ";
 				part3 = ")";
 				break;
+			case intrinsic_expression_node::barrier:
+			case intrinsic_expression_node::texture_store:
+				error(node->location, "'" + std::string(node->op == intrinsic_expression_node::barrier ? "barrier" : "tex2Dstore") + "' is only supported in compute shaders, which Direct3D 10 does not support");
+				return;
 			case intrinsic_expression_node::ceil:
 				part1 = "ceil(";
 				part2 = ")";
@@ -1039,7 +1125,7 @@ namespace reshade::d3d10
 
 		output << part5;
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const conditional_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const conditional_expression_node *node)
 	{
 		output << '(';
 		visit(output, node->condition);
@@ -1049,7 +1135,7 @@ namespace reshade::d3d10
 		visit(output, node->expression_when_false);
 		output << ')';
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const swizzle_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const swizzle_expression_node *node)
 	{
 		visit(output, node->operand);
 
@@ -1081,7 +1167,7 @@ namespace reshade::d3d10
 			}
 		}
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const field_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const field_expression_node *node)
 	{
 		output << '(';
 
@@ -1089,7 +1175,7 @@ namespace reshade::d3d10
 
 		output << '.' << node->field_reference->unique_name << ')';
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const assignment_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const assignment_expression_node *node)
 	{
 		output << '(';
 		visit(output, node->left);
@@ -1136,7 +1222,7 @@ namespace reshade::d3d10
 		visit(output, node->right);
 		output << ')';
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const call_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const call_expression_node *node)
 	{
 		output << node->callee->unique_name << '(';
 
@@ -1152,7 +1238,7 @@ namespace reshade::d3d10
 
 		output << ')';
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const constructor_expression_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const constructor_expression_node *node)
 	{
 		visit(output, node->type, false);
 
@@ -1170,7 +1256,7 @@ namespace reshade::d3d10
 
 		output << ')';
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const initializer_list_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const initializer_list_node *node)
 	{
 		output << "{ ";
 
@@ -1186,7 +1272,7 @@ namespace reshade::d3d10
 
 		output << " }";
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const compound_statement_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const compound_statement_node *node)
 	{
 		output << "{\n";
 
@@ -1197,7 +1283,7 @@ namespace reshade::d3d10
 
 		output << "}\n";
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const declarator_list_node *node, bool single_statement)
+	void d3d10_effect_compiler::visit(code_buffer &output, const declarator_list_node *node, bool single_statement)
 	{
 		bool with_type = true;
 
@@ -1217,13 +1303,13 @@ namespace reshade::d3d10
 
 		output << ";\n";
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const expression_statement_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const expression_statement_node *node)
 	{
 		visit(output, node->expression);
 
 		output << ";\n";
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const if_statement_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const if_statement_node *node)
 	{
 		for (const auto &attribute : node->attributes)
 		{
@@ -1250,7 +1336,7 @@ namespace reshade::d3d10
 			visit(output, node->statement_when_false);
 		}
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const switch_statement_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const switch_statement_node *node)
 	{
 		for (const auto &attribute : node->attributes)
 		{
@@ -1268,7 +1354,7 @@ namespace reshade::d3d10
 
 		output << "}\n";
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const case_statement_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const case_statement_node *node)
 	{
 		for (auto label : node->labels)
 		{
@@ -1288,7 +1374,7 @@ namespace reshade::d3d10
 
 		visit(output, node->statement_list);
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const for_statement_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const for_statement_node *node)
 	{
 		for (const auto &attribute : node->attributes)
 		{
@@ -1303,7 +1389,7 @@ namespace reshade::d3d10
 			{
 				visit(output, static_cast<declarator_list_node *>(node->init_statement), true);
 
-				output.seekp(-2, std::ios_base::end);
+				output.pop_back(2);
 			}
 			else
 			{
@@ -1336,7 +1422,7 @@ namespace reshade::d3d10
 			output << "\t;";
 		}
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const while_statement_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const while_statement_node *node)
 	{
 		for (const auto &attribute : node->attributes)
 		{
@@ -1372,7 +1458,7 @@ namespace reshade::d3d10
 			}
 		}
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const return_statement_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const return_statement_node *node)
 	{
 		if (node->is_discard)
 		{
@@ -1392,7 +1478,7 @@ namespace reshade::d3d10
 
 		output << ";\n";
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const jump_statement_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const jump_statement_node *node)
 	{
 		if (node->is_break)
 		{
@@ -1403,7 +1489,7 @@ namespace reshade::d3d10
 			output << "continue;\n";
 		}
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const struct_declaration_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const struct_declaration_node *node)
 	{
 		output << "struct " << node->unique_name << "\n{\n";
 
@@ -1421,7 +1507,7 @@ namespace reshade::d3d10
 
 		output << "};\n";
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const variable_declaration_node *node, bool with_type)
+	void d3d10_effect_compiler::visit(code_buffer &output, const variable_declaration_node *node, bool with_type)
 	{
 		if (with_type)
 		{
@@ -1464,7 +1550,7 @@ namespace reshade::d3d10
 			output << ";\n";
 		}
 	}
-	void d3d10_effect_compiler::visit(std::stringstream &output, const function_declaration_node *node)
+	void d3d10_effect_compiler::visit(code_buffer &output, const function_declaration_node *node)
 	{
 		visit(output, node->return_type, false);
 
@@ -1504,139 +1590,32 @@ namespace reshade::d3d10
 	{
 		size_t texture_register_index, texture_register_index_srgb;
 
-		const auto existing_texture = _runtime->find_texture(node->unique_name);
-
-		if (existing_texture != nullptr)
+		if (node->semantic == "COLOR" || node->semantic == "SV_TARGET")
 		{
-			if (node->semantic == "COLOR" || node->semantic == "SV_TARGET")
-			{
-				texture_register_index = 0;
-				texture_register_index_srgb = 1;
-			}
-			else if (node->semantic == "DEPTH" || node->semantic == "SV_DEPTH")
-			{
-				texture_register_index = 2;
-				texture_register_index_srgb = 2;
-			}
-			else if (!node->semantic.empty())
-			{
-				error(node->location, "invalid semantic");
-				return;
-			}
-			else
-			{
-				if (existing_texture->width != node->properties.width ||
-					existing_texture->height != node->properties.height ||
-					existing_texture->levels != node->properties.levels ||
-					existing_texture->format != node->properties.format)
-				{
-					error(node->location, existing_texture->effect_filename + " already created a texture with the same name but different dimensions; textures are shared across all effects, so either rename the variable or adjust the dimensions so they match");
-					return;
-				}
-
-				const auto obj_data = existing_texture->impl->as<d3d10_tex_data>();
-
-				texture_register_index = std::distance(_runtime->_effect_shader_resources.begin(), std::find(_runtime->_effect_shader_resources.begin(), _runtime->_effect_shader_resources.end(), obj_data->srv[0]));
-
-				if (obj_data->srv[1] != nullptr)
-				{
-					texture_register_index_srgb = std::distance(_runtime->_effect_shader_resources.begin(), std::find(_runtime->_effect_shader_resources.begin(), _runtime->_effect_shader_resources.end(), obj_data->srv[1]));
-				}
-				else
-				{
-					texture_register_index_srgb = texture_register_index;
-				}
-			}
+			texture_register_index = 0;
+			texture_register_index_srgb = 1;
+		}
+		else if (node->semantic == "DEPTH" || node->semantic == "SV_DEPTH")
+		{
+			texture_register_index = 2;
+			texture_register_index_srgb = 2;
+		}
+		else if (!node->semantic.empty())
+		{
+			error(node->location, "invalid semantic");
+			return;
 		}
 		else
 		{
-			texture obj;
-			D3D10_TEXTURE2D_DESC texdesc = { };
-			obj.name = node->name;
-			obj.unique_name = node->unique_name;
-			obj.annotations = node->annotation_list;
-			texdesc.Width = obj.width = node->properties.width;
-			texdesc.Height = obj.height = node->properties.height;
-			texdesc.MipLevels = obj.levels = node->properties.levels;
-			texdesc.ArraySize = 1;
-			texdesc.Format = literal_to_format(obj.format = node->properties.format);
-			texdesc.SampleDesc.Count = 1;
-			texdesc.SampleDesc.Quality = 0;
-			texdesc.Usage = D3D10_USAGE_DEFAULT;
-			texdesc.BindFlags = D3D10_BIND_SHADER_RESOURCE | D3D10_BIND_RENDER_TARGET;
-			texdesc.MiscFlags = D3D10_RESOURCE_MISC_GENERATE_MIPS;
-
-			if (node->semantic == "COLOR" || node->semantic == "SV_TARGET")
-			{
-				obj.width = _runtime->frame_width();
-				obj.height = _runtime->frame_height();
-				obj.impl_reference = texture_reference::back_buffer;
-
-				texture_register_index = 0;
-				texture_register_index_srgb = 1;
-			}
-			else if (node->semantic == "DEPTH" || node->semantic == "SV_DEPTH")
-			{
-				obj.width = _runtime->frame_width();
-				obj.height = _runtime->frame_height();
-				obj.impl_reference = texture_reference::depth_buffer;
-
-				texture_register_index = 2;
-				texture_register_index_srgb = 2;
-			}
-			else
-			{
-				obj.impl = std::make_unique<d3d10_tex_data>();
-				const auto obj_data = obj.impl->as<d3d10_tex_data>();
-
-				HRESULT hr = _runtime->_device->CreateTexture2D(&texdesc, nullptr, &obj_data->texture);
-
-				if (FAILED(hr))
-				{
-					error(node->location, "'ID3D10Device::CreateTexture2D' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-					return;
-				}
-
-				D3D10_SHADER_RESOURCE_VIEW_DESC srvdesc = { };
-				srvdesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2D;
-				srvdesc.Texture2D.MipLevels = texdesc.MipLevels;
-				srvdesc.Format = make_format_normal(texdesc.Format);
-
-				hr = _runtime->_device->CreateShaderResourceView(obj_data->texture.get(), &srvdesc, &obj_data->srv[0]);
-
-				if (FAILED(hr))
-				{
-					error(node->location, "'ID3D10Device::CreateShaderResourceView' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-					return;
-				}
-
-				srvdesc.Format = make_format_srgb(texdesc.Format);
-
-				texture_register_index = _runtime->_effect_shader_resources.size();
-				_runtime->_effect_shader_resources.push_back(obj_data->srv[0]);
-
-				if (srvdesc.Format != texdesc.Format)
-				{
-					hr = _runtime->_device->CreateShaderResourceView(obj_data->texture.get(), &srvdesc, &obj_data->srv[1]);
-
-					if (FAILED(hr))
-					{
-						error(node->location, "'ID3D10Device::CreateShaderResourceView' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-						return;
-					}
+			// Whether the texture is created here or shared with an effect loaded before is only known on the render thread, but both have the same views, since the format has to match
+			const DXGI_FORMAT format = literal_to_format(node->properties.format);
 
-					texture_register_index_srgb = _runtime->_effect_shader_resources.size();
-					_runtime->_effect_shader_resources.push_back(obj_data->srv[1]);
-				}
-				else
-				{
-					texture_register_index_srgb = texture_register_index;
-				}
-			}
-
-			_runtime->add_texture(std::move(obj));
+			texture_register_index = _shader_resource_count++;
+			texture_register_index_srgb = make_format_srgb(format) != format ? _shader_resource_count++ : texture_register_index;
 		}
 
+		_texture_registers[node] = { texture_register_index, texture_register_index_srgb };
+
 		_global_code << "Texture2D " <<
 			node->unique_name << " : register(t" << texture_register_index << "), __" <<
 			node->unique_name << "SRGB : register(t" << texture_register_index_srgb << ");\n";
@@ -1654,35 +1633,15 @@ namespace reshade::d3d10
 		desc.MinLOD = node->properties.min_lod;
 		desc.MaxLOD = node->properties.max_lod;
 
-		const auto texture = _runtime->find_texture(node->properties.texture->unique_name);
+		const auto it = std::find_if(_sampler_descs.begin(), _sampler_descs.end(), [&desc](const D3D10_SAMPLER_DESC &existing) { return std::memcmp(&existing, &desc, sizeof(desc)) == 0; });
+		const size_t register_index = std::distance(_sampler_descs.begin(), it);
 
-		if (texture == nullptr)
+		if (it == _sampler_descs.end())
 		{
-			error(node->location, "texture '" + node->properties.texture->name + "' for sampler '" + node->name + "' is missing due to previous error");
-			return;
+			_sampler_descs.push_back(desc);
 		}
 
-		size_t desc_hash = 2166136261;
-		for (size_t i = 0; i < sizeof(desc); ++i)
-			desc_hash = (desc_hash * 16777619) ^ reinterpret_cast<const uint8_t *>(&desc)[i];
-
-		auto it = _runtime->_effect_sampler_descs.find(desc_hash);
-
-		if (it == _runtime->_effect_sampler_descs.end())
-		{
-			com_ptr<ID3D10SamplerState> sampler;
-
-			HRESULT hr = _runtime->_device->CreateSamplerState(&desc, &sampler);
-
-			if (FAILED(hr))
-			{
-				error(node->location, "'ID3D10Device::CreateSamplerState' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-				return;
-			}
-
-			_runtime->_effect_sampler_states.push_back(std::move(sampler));
-			it = _runtime->_effect_sampler_descs.emplace(desc_hash, _runtime->_effect_sampler_states.size() - 1).first;
-		}
+		_sampler_registers[node] = register_index;
 
 		_global_code << "static const __sampler2D " << node->unique_name << " = { ";
 
@@ -1695,7 +1654,7 @@ namespace reshade::d3d10
 			_global_code << node->properties.texture->unique_name;
 		}
 
-		_global_code << ", __SamplerState" << it->second << " };\n";
+		_global_code << ", __SamplerState" << register_index << " };\n";
 	}
 	void d3d10_effect_compiler::visit_uniform(const variable_declaration_node *node)
 	{
@@ -1725,36 +1684,299 @@ namespace reshade::d3d10
 		obj.columns = node->type.cols;
 		obj.elements = node->type.array_length;
 		obj.storage_size = node->type.rows * node->type.cols * std::max(1u, obj.elements) * 4;
-		obj.annotations = node->annotation_list;
+		copy_annotations(node->annotation_list, obj.annotations);
 
 		const UINT alignment = 16 - (_constant_buffer_size % 16);
 		_constant_buffer_size += static_cast<UINT>((obj.storage_size > alignment && (alignment != 16 || obj.storage_size <= 16)) ? obj.storage_size + alignment : obj.storage_size);
-		obj.storage_offset = _uniform_storage_offset + _constant_buffer_size - obj.storage_size;
+		obj.storage_offset = _constant_buffer_size - obj.storage_size;
 
-		auto &uniform_storage = _runtime->get_uniform_value_storage();
+		_uniform_data.resize(_constant_buffer_size);
 
-		if (_uniform_storage_offset + _constant_buffer_size >= uniform_storage.size())
+		if (node->initializer_expression != nullptr && node->initializer_expression->id == nodeid::literal_expression)
 		{
-			uniform_storage.resize(uniform_storage.size() + 128);
+			CopyMemory(_uniform_data.data() + obj.storage_offset, &static_cast<const literal_expression_node *>(node->initializer_expression)->value_float, obj.storage_size);
 		}
 
-		if (node->initializer_expression != nullptr && node->initializer_expression->id == nodeid::literal_expression)
+		_uniforms.push_back(std::move(obj));
+	}
+	void d3d10_effect_compiler::compile_pass(const pass_declaration_node *node)
+	{
+		if (node->compute_shader != nullptr)
+		{
+			error(node->location, "compute passes are not supported in Direct3D 10, check '__RENDERER__' to provide a pixel shader pass instead");
+			return;
+		}
+
+		compiled_pass &pass = _compiled_passes[node];
+
+		if (node->vertex_shader != nullptr)
+		{
+			compile_pass_shader(node->vertex_shader, "vs", pass.vs);
+		}
+		if (node->pixel_shader != nullptr)
+		{
+			compile_pass_shader(node->pixel_shader, "ps", pass.ps);
+		}
+	}
+	void d3d10_effect_compiler::compile_pass_shader(const function_declaration_node *node, const std::string &shadertype, std::vector<char> &bytecode)
+	{
+		com_ptr<ID3D10Device1> device1;
+		D3D10_FEATURE_LEVEL1 featurelevel = D3D10_FEATURE_LEVEL_10_0;
+
+		if (SUCCEEDED(_runtime->_device->QueryInterface(&device1)))
+		{
+			featurelevel = device1->GetFeatureLevel();
+		}
+
+		std::string profile = shadertype;
+
+		switch (featurelevel)
+		{
+			case D3D10_FEATURE_LEVEL_10_1:
+				profile += "_4_1";
+				break;
+			default:
+			case D3D10_FEATURE_LEVEL_10_0:
+				profile += "_4_0";
+				break;
+			case D3D10_FEATURE_LEVEL_9_1:
+			case D3D10_FEATURE_LEVEL_9_2:
+				profile += "_4_0_level_9_1";
+				break;
+			case D3D10_FEATURE_LEVEL_9_3:
+				profile += "_4_0_level_9_3";
+				break;
+		}
+
+		std::string source =
+			"#pragma warning(disable: 3571)\n"
+			"struct __sampler2D { Texture2D t; SamplerState s; };\n"
+			"inline float4 __tex2D(__sampler2D s, float2 c) { return s.t.Sample(s.s, c); }\n"
+			"inline float4 __tex2Dfetch(__sampler2D s, int4 c) { return s.t.Load(c.xyw); }\n"
+			"inline float4 __tex2Dgrad(__sampler2D s, float2 c, float2 ddx, float2 ddy) { return s.t.SampleGrad(s.s, c, ddx, ddy); }\n"
+			"inline float4 __tex2Dlod(__sampler2D s, float4 c) { return s.t.SampleLevel(s.s, c.xy, c.w); }\n"
+			"inline float4 __tex2Dlodoffset(__sampler2D s, float4 c, int2 offset) { return s.t.SampleLevel(s.s, c.xy, c.w, offset); }\n"
+			"inline float4 __tex2Doffset(__sampler2D s, float2 c, int2 offset) { return s.t.Sample(s.s, c, offset); }\n"
+			"inline float4 __tex2Dproj(__sampler2D s, float4 c) { return s.t.Sample(s.s, c.xy / c.w); }\n"
+			"inline int2 __tex2Dsize(__sampler2D s, int lod) { uint w, h, l; s.t.GetDimensions(lod, w, h, l); return int2(w, h); }\n";
+
+		if (featurelevel >= D3D10_FEATURE_LEVEL_10_1)
+		{
+			source +=
+				"inline float4 __tex2Dgather0(__sampler2D s, float2 c) { return s.t.Gather(s.s, c); }\n"
+				"inline float4 __tex2Dgather0offset(__sampler2D s, float2 c, int2 offset) { return s.t.Gather(s.s, c, offset); }\n";
+		}
+		else
+		{
+			source +=
+				"inline float4 __tex2Dgather0(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).r, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).r, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).r, s.t.SampleLevel(s.s, c, 0).r); }\n"
+				"inline float4 __tex2Dgather0offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).r, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).r, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).r, s.t.SampleLevel(s.s, c, 0, offset).r); }\n";
+		}
+
+		source +=
+			"inline float4 __tex2Dgather1(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).g, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).g, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).g, s.t.SampleLevel(s.s, c, 0).g); }\n"
+			"inline float4 __tex2Dgather1offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).g, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).g, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).g, s.t.SampleLevel(s.s, c, 0, offset).g); }\n"
+			"inline float4 __tex2Dgather2(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).b, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).b, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).b, s.t.SampleLevel(s.s, c, 0).b); }\n"
+			"inline float4 __tex2Dgather2offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).b, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).b, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).b, s.t.SampleLevel(s.s, c, 0, offset).b); }\n"
+			"inline float4 __tex2Dgather3(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).a, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).a, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).a, s.t.SampleLevel(s.s, c, 0).a); }\n"
+			"inline float4 __tex2Dgather3offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).a, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).a, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).a, s.t.SampleLevel(s.s, c, 0, offset).a); }\n";
+
+		// Make room for the declarations and functions up front, so appending them does not grow the string repeatedly
+		source.reserve(source.size() + _global_uniforms.size() + _global_code.size() + 4096);
+
+		source += "cbuffer __GLOBAL__ : register(b0)\n{\n" + _global_uniforms.str() + "};\n";
+
+		for (size_t i = 0; i < _sampler_descs.size(); i++)
+		{
+			source += "SamplerState __SamplerState" + std::to_string(i) + " : register(s" + std::to_string(i) + ");\n";
+		}
+
+		reachable_declarations reachable;
+		find_reachable_declarations(node, reachable);
+
+		source += reachable_global_code(_global_code.str(), _global_declarations, reachable);
+
+#if RESHADE_DUMP_NATIVE_SHADERS
+		if (!_dumped_shaders.count(node->unique_name))
 		{
-			CopyMemory(uniform_storage.data() + obj.storage_offset, &static_cast<const literal_expression_node *>(node->initializer_expression)->value_float, obj.storage_size);
+			std::ofstream dumpfile(_dump_filename.string(), std::ios::app);
+
+			if (dumpfile.is_open())
+			{
+				dumpfile << "#ifdef RESHADE_SHADER_" << shadertype << "_" << node->unique_name << std::endl << source << "#endif" << std::endl << std::endl;
+
+				_dumped_shaders.insert(node->unique_name);
+			}
+		}
+#endif
+
+		UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
+		com_ptr<ID3DBlob> compiled, errors;
+
+		if (_skip_shader_optimization)
+		{
+			flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
+		}
+
+		const unsigned long long cache_key = shader_cache::compute_key(source, node->unique_name, profile, flags, _d3dcompiler_module);
+
+		// Another game client may be compiling the same shader right now, so wait for it and take its result from the cache instead of compiling it as well
+		shader_cache::compile_lock lock;
+
+		if (!shader_cache::load(cache_key, bytecode) && !(lock.acquire(cache_key) && shader_cache::load(cache_key, bytecode)))
+		{
+			const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3dcompiler_module, "D3DCompile"));
+			const HRESULT hr = D3DCompile(source.c_str(), source.length(), nullptr, nullptr, nullptr, node->unique_name.c_str(), profile.c_str(), flags, 0, &compiled, &errors);
+
+			if (errors != nullptr)
+			{
+				_errors.append(static_cast<const char *>(errors->GetBufferPointer()), errors->GetBufferSize() - 1);
+			}
+
+			if (FAILED(hr))
+			{
+				error(node->location, "internal shader compilation failed");
+				return;
+			}
+
+			shader_cache::save(cache_key, compiled->GetBufferPointer(), compiled->GetBufferSize());
+
+			bytecode.assign(static_cast<const char *>(compiled->GetBufferPointer()), static_cast<const char *>(compiled->GetBufferPointer()) + compiled->GetBufferSize());
+		}
+	}
+	void d3d10_effect_compiler::create_texture(const variable_declaration_node *node)
+	{
+		const size_t texture_register_index = _texture_registers.at(node).first;
+		const size_t texture_register_index_srgb = _texture_registers.at(node).second;
+
+		const auto existing_texture = _runtime->find_texture(node->unique_name);
+
+		if (existing_texture != nullptr)
+		{
+			if (node->semantic.empty())
+			{
+				if (existing_texture->width != node->properties.width ||
+					existing_texture->height != node->properties.height ||
+					existing_texture->levels != node->properties.levels ||
+					existing_texture->format != node->properties.format)
+				{
+					error(node->location, existing_texture->effect_filename + " already created a texture with the same name but different dimensions; textures are shared across all effects, so either rename the variable or adjust the dimensions so they match");
+					return;
+				}
+
+				const auto obj_data = existing_texture->impl->as<d3d10_tex_data>();
+
+				_shader_resources[texture_register_index] = obj_data->srv[0];
+				_shader_resources[texture_register_index_srgb] = obj_data->srv[1] != nullptr ? obj_data->srv[1] : obj_data->srv[0];
+			}
+
+			return;
+		}
+
+		texture obj;
+		D3D10_TEXTURE2D_DESC texdesc = { };
+		obj.name = node->name;
+		obj.unique_name = node->unique_name;
+		copy_annotations(node->annotation_list, obj.annotations);
+		texdesc.Width = obj.width = node->properties.width;
+		texdesc.Height = obj.height = node->properties.height;
+		texdesc.MipLevels = obj.levels = node->properties.levels;
+		texdesc.ArraySize = 1;
+		texdesc.Format = literal_to_format(obj.format = node->properties.format);
+		texdesc.SampleDesc.Count = 1;
+		texdesc.SampleDesc.Quality = 0;
+		texdesc.Usage = D3D10_USAGE_DEFAULT;
+		texdesc.BindFlags = D3D10_BIND_SHADER_RESOURCE | D3D10_BIND_RENDER_TARGET;
+		texdesc.MiscFlags = D3D10_RESOURCE_MISC_GENERATE_MIPS;
+
+		if (node->semantic == "COLOR" || node->semantic == "SV_TARGET")
+		{
+			obj.width = _runtime->frame_width();
+			obj.height = _runtime->frame_height();
+			obj.impl_reference = texture_reference::back_buffer;
+		}
+		else if (node->semantic == "DEPTH" || node->semantic == "SV_DEPTH")
+		{
+			obj.width = _runtime->frame_width();
+			obj.height = _runtime->frame_height();
+			obj.impl_reference = texture_reference::depth_buffer;
 		}
 		else
 		{
-			ZeroMemory(uniform_storage.data() + obj.storage_offset, obj.storage_size);
+			obj.impl = std::make_unique<d3d10_tex_data>();
+			const auto obj_data = obj.impl->as<d3d10_tex_data>();
+
+			HRESULT hr = _runtime->_device->CreateTexture2D(&texdesc, nullptr, &obj_data->texture);
+
+			if (FAILED(hr))
+			{
+				error(node->location, "'ID3D10Device::CreateTexture2D' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+				return;
+			}
+
+			D3D10_SHADER_RESOURCE_VIEW_DESC srvdesc = { };
+			srvdesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2D;
+			srvdesc.Texture2D.MipLevels = texdesc.MipLevels;
+			srvdesc.Format = make_format_normal(texdesc.Format);
+
+			hr = _runtime->_device->CreateShaderResourceView(obj_data->texture.get(), &srvdesc, &obj_data->srv[0]);
+
+			if (FAILED(hr))
+			{
+				error(node->location, "'ID3D10Device::CreateShaderResourceView' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+				return;
+			}
+
+			srvdesc.Format = make_format_srgb(texdesc.Format);
+
+			if (srvdesc.Format != texdesc.Format)
+			{
+				hr = _runtime->_device->CreateShaderResourceView(obj_data->texture.get(), &srvdesc, &obj_data->srv[1]);
+
+				if (FAILED(hr))
+				{
+					error(node->location, "'ID3D10Device::CreateShaderResourceView' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+					return;
+				}
+			}
+
+			_shader_resources[texture_register_index] = obj_data->srv[0];
+			_shader_resources[texture_register_index_srgb] = obj_data->srv[1] != nullptr ? obj_data->srv[1] : obj_data->srv[0];
+		}
+
+		_runtime->add_texture(std::move(obj));
+	}
+	void d3d10_effect_compiler::create_sampler(const variable_declaration_node *node)
+	{
+		if (_runtime->find_texture(node->properties.texture->unique_name) == nullptr)
+		{
+			error(node->location, "texture '" + node->properties.texture->name + "' for sampler '" + node->name + "' is missing due to previous error");
+			return;
+		}
+
+		const size_t register_index = _sampler_registers.at(node);
+
+		if (_sampler_states[register_index] != nullptr)
+		{
+			return;
 		}
 
-		_runtime->add_uniform(std::move(obj));
+		const D3D10_SAMPLER_DESC &desc = _sampler_descs[register_index];
+
+		HRESULT hr = _runtime->_sampler_state_cache.get(desc, _sampler_states[register_index], [this, &desc](ID3D10SamplerState **object) { return _runtime->_device->CreateSamplerState(&desc, object); });
+
+		if (FAILED(hr))
+		{
+			error(node->location, "'ID3D10Device::CreateSamplerState' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+			return;
+		}
 	}
 	void d3d10_effect_compiler::visit_technique(const technique_declaration_node *node)
 	{
 		technique obj;
 		obj.impl = std::make_unique<d3d10_technique_data>();
 		obj.name = node->name;
-		obj.annotations = node->annotation_list;
+		copy_annotations(node->annotation_list, obj.annotations);
 
 		auto obj_data = obj.impl->as<d3d10_technique_data>();
 		D3D10_QUERY_DESC query_desc = { };
@@ -1764,6 +1986,8 @@ namespace reshade::d3d10
 		query_desc.Query = D3D10_QUERY_TIMESTAMP_DISJOINT;
 		_runtime->_device->CreateQuery(&query_desc, &obj_data->timestamp_disjoint);
 
+		obj_data->sampler_states = _sampler_states;
+
 		if (_constant_buffer_size != 0)
 		{
 			obj.uniform_storage_index = _runtime->_constant_buffers.size();
@@ -1773,13 +1997,19 @@ namespace reshade::d3d10
 		for (auto pass : node->pass_list)
 		{
 			obj.passes.emplace_back(std::make_unique<d3d10_pass_data>());
-			visit_pass(pass, *static_cast<d3d10_pass_data *>(obj.passes.back().get()));
+			auto &pass_data = *static_cast<d3d10_pass_data *>(obj.passes.back().get());
+			visit_pass(pass, pass_data);
+			name_unnamed_pass(pass_data.name, obj.passes.size() - 1);
+
+			// Pixel shader passes without a render target draw to the back buffer
+			obj.writes_backbuffer |= pass->compute_shader == nullptr && pass->render_targets[0] == nullptr;
 		}
 
 		_runtime->add_technique(std::move(obj));
 	}
 	void d3d10_effect_compiler::visit_pass(const pass_declaration_node *node, d3d10_pass_data &pass)
 	{
+		pass.name = node->name;
 		pass.stencil_reference = 0;
 		pass.viewport.TopLeftX = pass.viewport.TopLeftY = pass.viewport.Width = pass.viewport.Height = 0;
 		pass.viewport.MinDepth = 0.0f;
@@ -1787,15 +2017,30 @@ namespace reshade::d3d10
 		pass.clear_render_targets = node->clear_render_targets;
 		ZeroMemory(pass.render_targets, sizeof(pass.render_targets));
 		ZeroMemory(pass.render_target_resources, sizeof(pass.render_target_resources));
-		pass.shader_resources = _runtime->_effect_shader_resources;
+		pass.shader_resources = _shader_resources;
+
+		const compiled_pass &compiled = _compiled_passes.at(node);
+		HRESULT hr;
 
 		if (node->vertex_shader != nullptr)
 		{
-			visit_pass_shader(node->vertex_shader, "vs", pass);
+			hr = _runtime->_device->CreateVertexShader(compiled.vs.data(), compiled.vs.size(), &pass.vertex_shader);
+
+			if (FAILED(hr))
+			{
+				error(node->location, "'CreateShader' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+				return;
+			}
 		}
 		if (node->pixel_shader != nullptr)
 		{
-			visit_pass_shader(node->pixel_shader, "ps", pass);
+			hr = _runtime->_device->CreatePixelShader(compiled.ps.data(), compiled.ps.size(), &pass.pixel_shader);
+
+			if (FAILED(hr))
+			{
+				error(node->location, "'CreateShader' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+				return;
+			}
 		}
 
 		const int target_index = node->srgb_write_enable ? 1 : 0;
@@ -1857,7 +2102,9 @@ namespace reshade::d3d10
 			pass.viewport.Height = _runtime->frame_height();
 		}
 
-		D3D10_DEPTH_STENCIL_DESC ddesc = { };
+		// Zeroed completely, since the state object cache compares the padding as well
+		D3D10_DEPTH_STENCIL_DESC ddesc;
+		ZeroMemory(&ddesc, sizeof(ddesc));
 		ddesc.DepthEnable = FALSE;
 		ddesc.DepthWriteMask = D3D10_DEPTH_WRITE_MASK_ZERO;
 		ddesc.DepthFunc = D3D10_COMPARISON_ALWAYS;
@@ -1870,7 +2117,7 @@ namespace reshade::d3d10
 		ddesc.FrontFace.StencilDepthFailOp = ddesc.BackFace.StencilDepthFailOp = literal_to_stencil_op(node->stencil_op_depth_fail);
 		pass.stencil_reference = node->stencil_reference_value;
 
-		HRESULT hr = _runtime->_device->CreateDepthStencilState(&ddesc, &pass.depth_stencil_state);
+		hr = _runtime->_depth_stencil_state_cache.get(ddesc, pass.depth_stencil_state, [this, &ddesc](ID3D10DepthStencilState **object) { return _runtime->_device->CreateDepthStencilState(&ddesc, object); });
 
 		if (FAILED(hr))
 		{
@@ -1894,7 +2141,7 @@ namespace reshade::d3d10
 			bdesc.BlendEnable[i] = bdesc.BlendEnable[0];
 		}
 
-		hr = _runtime->_device->CreateBlendState(&bdesc, &pass.blend_state);
+		hr = _runtime->_blend_state_cache.get(bdesc, pass.blend_state, [this, &bdesc](ID3D10BlendState **object) { return _runtime->_device->CreateBlendState(&bdesc, object); });
 
 		if (FAILED(hr))
 		{
@@ -1929,127 +2176,4 @@ namespace reshade::d3d10
 			}
 		}
 	}
-	void d3d10_effect_compiler::visit_pass_shader(const function_declaration_node *node, const std::string &shadertype, d3d10_pass_data &pass)
-	{
-		com_ptr<ID3D10Device1> device1;
-		D3D10_FEATURE_LEVEL1 featurelevel = D3D10_FEATURE_LEVEL_10_0;
-
-		if (SUCCEEDED(_runtime->_device->QueryInterface(&device1)))
-		{
-			featurelevel = device1->GetFeatureLevel();
-		}
-
-		std::string profile = shadertype;
-
-		switch (featurelevel)
-		{
-			case D3D10_FEATURE_LEVEL_10_1:
-				profile += "_4_1";
-				break;
-			default:
-			case D3D10_FEATURE_LEVEL_10_0:
-				profile += "_4_0";
-				break;
-			case D3D10_FEATURE_LEVEL_9_1:
-			case D3D10_FEATURE_LEVEL_9_2:
-				profile += "_4_0_level_9_1";
-				break;
-			case D3D10_FEATURE_LEVEL_9_3:
-				profile += "_4_0_level_9_3";
-				break;
-		}
-
-		std::string source =
-			"#pragma warning(disable: 3571)\n"
-			"struct __sampler2D { Texture2D t; SamplerState s; };\n"
-			"inline float4 __tex2D(__sampler2D s, float2 c) { return s.t.Sample(s.s, c); }\n"
-			"inline float4 __tex2Dfetch(__sampler2D s, int4 c) { return s.t.Load(c.xyw); }\n"
-			"inline float4 __tex2Dgrad(__sampler2D s, float2 c, float2 ddx, float2 ddy) { return s.t.SampleGrad(s.s, c, ddx, ddy); }\n"
-			"inline float4 __tex2Dlod(__sampler2D s, float4 c) { return s.t.SampleLevel(s.s, c.xy, c.w); }\n"
-			"inline float4 __tex2Dlodoffset(__sampler2D s, float4 c, int2 offset) { return s.t.SampleLevel(s.s, c.xy, c.w, offset); }\n"
-			"inline float4 __tex2Doffset(__sampler2D s, float2 c, int2 offset) { return s.t.Sample(s.s, c, offset); }\n"
-			"inline float4 __tex2Dproj(__sampler2D s, float4 c) { return s.t.Sample(s.s, c.xy / c.w); }\n"
-			"inline int2 __tex2Dsize(__sampler2D s, int lod) { uint w, h, l; s.t.GetDimensions(lod, w, h, l); return int2(w, h); }\n";
-
-		if (featurelevel >= D3D10_FEATURE_LEVEL_10_1)
-		{
-			source +=
-				"inline float4 __tex2Dgather0(__sampler2D s, float2 c) { return s.t.Gather(s.s, c); }\n"
-				"inline float4 __tex2Dgather0offset(__sampler2D s, float2 c, int2 offset) { return s.t.Gather(s.s, c, offset); }\n";
-		}
-		else
-		{
-			source +=
-				"inline float4 __tex2Dgather0(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).r, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).r, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).r, s.t.SampleLevel(s.s, c, 0).r); }\n"
-				"inline float4 __tex2Dgather0offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).r, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).r, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).r, s.t.SampleLevel(s.s, c, 0, offset).r); }\n";
-		}
-
-		source +=
-			"inline float4 __tex2Dgather1(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).g, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).g, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).g, s.t.SampleLevel(s.s, c, 0).g); }\n"
-			"inline float4 __tex2Dgather1offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).g, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).g, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).g, s.t.SampleLevel(s.s, c, 0, offset).g); }\n"
-			"inline float4 __tex2Dgather2(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).b, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).b, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).b, s.t.SampleLevel(s.s, c, 0).b); }\n"
-			"inline float4 __tex2Dgather2offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).b, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).b, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).b, s.t.SampleLevel(s.s, c, 0, offset).b); }\n"
-			"inline float4 __tex2Dgather3(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).a, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).a, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).a, s.t.SampleLevel(s.s, c, 0).a); }\n"
-			"inline float4 __tex2Dgather3offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).a, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).a, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).a, s.t.SampleLevel(s.s, c, 0, offset).a); }\n";
-
-		source += "cbuffer __GLOBAL__ : register(b0)\n{\n" + _global_uniforms.str() + "};\n";
-
-		for (const auto &samplerdesc : _runtime->_effect_sampler_descs)
-		{
-			source += "SamplerState __SamplerState" + std::to_string(samplerdesc.second) + " : register(s" + std::to_string(samplerdesc.second) + ");\n";
-		}
-
-		source += _global_code.str();
-
-#if RESHADE_DUMP_NATIVE_SHADERS
-		if (!_dumped_shaders.count(node->unique_name))
-		{
-			std::ofstream dumpfile(_dump_filename.string(), std::ios::app);
-
-			if (dumpfile.is_open())
-			{
-				dumpfile << "#ifdef RESHADE_SHADER_" << shadertype << "_" << node->unique_name << std::endl << source << "#endif" << std::endl << std::endl;
-
-				_dumped_shaders.insert(node->unique_name);
-			}
-		}
-#endif
-
-		UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
-		com_ptr<ID3DBlob> compiled, errors;
-
-		if (_skip_shader_optimization)
-		{
-			flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-		}
-
-		const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3dcompiler_module, "D3DCompile"));
-		HRESULT hr = D3DCompile(source.c_str(), source.length(), nullptr, nullptr, nullptr, node->unique_name.c_str(), profile.c_str(), flags, 0, &compiled, &errors);
-
-		if (errors != nullptr)
-		{
-			_errors.append(static_cast<const char *>(errors->GetBufferPointer()), errors->GetBufferSize() - 1);
-		}
-
-		if (FAILED(hr))
-		{
-			error(node->location, "internal shader compilation failed");
-			return;
-		}
-
-		if (shadertype == "vs")
-		{
-			hr = _runtime->_device->CreateVertexShader(compiled->GetBufferPointer(), compiled->GetBufferSize(), &pass.vertex_shader);
-		}
-		else if (shadertype == "ps")
-		{
-			hr = _runtime->_device->CreatePixelShader(compiled->GetBufferPointer(), compiled->GetBufferSize(), &pass.pixel_shader);
-		}
-
-		if (FAILED(hr))
-		{
-			error(node->location, "'CreateShader' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-			return;
-		}
-	}
 }
@@ -6,7 +6,10 @@
 #pragma once
 
 #include "effect_syntax_tree.hpp"
-#include <sstream>
+#include "effect_code_buffer.hpp"
+#include "effect_reachability.hpp"
+#include "runtime_objects.hpp"
+#include <unordered_map>
 #include <unordered_set>
 
 namespace reshade::d3d10
@@ -16,59 +19,91 @@ namespace reshade::d3d10
 	class d3d10_runtime;
 	#pragma endregion
 
-	class d3d10_effect_compiler
+	class d3d10_effect_compiler : public base_object
 	{
 	public:
 		d3d10_effect_compiler(d3d10_runtime *runtime, const reshadefx::syntax_tree &ast, std::string &errors, bool skipoptimization = false);
 
+		/// <summary>
+		/// Generate the HLSL code of the effect and compile its shaders. This creates no device objects, so it can run on a compile worker thread.
+		/// </summary>
+		bool compile();
+		/// <summary>
+		/// Create the textures, state objects, shaders and constant buffer of the effect and add it to the runtime on the render thread. Calls <see cref="compile"/> first if that did not happen yet.
+		/// </summary>
 		bool run();
 
 	private:
+		struct compiled_pass
+		{
+			std::vector<char> vs, ps;
+		};
+
 		void error(const reshadefx::location &location, const std::string &message);
 		void warning(const reshadefx::location &location, const std::string &message);
 
-		void visit(std::stringstream &output, const reshadefx::nodes::statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::type_node &type, bool with_qualifiers = true);
-		void visit(std::stringstream &output, const reshadefx::nodes::lvalue_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::literal_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_sequence_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::unary_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::binary_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::intrinsic_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::conditional_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::swizzle_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::field_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::assignment_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::call_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::constructor_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::initializer_list_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::compound_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::declarator_list_node *node, bool single_statement);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::if_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::switch_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::case_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::for_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::while_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::return_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::jump_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::struct_declaration_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::variable_declaration_node *node, bool with_type = true);
-		void visit(std::stringstream &output, const reshadefx::nodes::function_declaration_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::type_node &type, bool with_qualifiers = true);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::lvalue_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::literal_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_sequence_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::unary_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::binary_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::intrinsic_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::conditional_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::swizzle_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::field_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::assignment_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::call_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::constructor_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::initializer_list_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::compound_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::declarator_list_node *node, bool single_statement);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::if_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::switch_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::case_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::for_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::while_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::return_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::jump_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::struct_declaration_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::variable_declaration_node *node, bool with_type = true);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::function_declaration_node *node);
 
 		void visit_texture(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_sampler(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_uniform(const reshadefx::nodes::variable_declaration_node *node);
+		void compile_pass(const reshadefx::nodes::pass_declaration_node *node);
+		void compile_pass_shader(const reshadefx::nodes::function_declaration_node *node, const std::string &shadertype, std::vector<char> &bytecode);
+
+		void create_texture(const reshadefx::nodes::variable_declaration_node *node);
+		void create_sampler(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_technique(const reshadefx::nodes::technique_declaration_node *node);
 		void visit_pass(const reshadefx::nodes::pass_declaration_node *node, d3d10_pass_data &pass);
-		void visit_pass_shader(const reshadefx::nodes::function_declaration_node *node, const std::string &shadertype, d3d10_pass_data &pass);
 
 		d3d10_runtime *_runtime;
-		bool _success = true;
+		bool _success = true, _is_compiled = false;
 		const reshadefx::syntax_tree &_ast;
 		std::string &_errors;
-		std::stringstream _global_code, _global_uniforms;
+		reshadefx::code_buffer _global_code, _global_uniforms;
+		// Parts of the global code that belong to a single variable or function, so each shader can leave out those it does not reference
+		std::vector<reshadefx::global_declaration> _global_declarations;
+		// Shader resource slots of the linear and the sRGB view of every texture, which belong to this effect alone
+		// The first three hold the two views of the back buffer and the depth buffer, the textures follow
+		std::unordered_map<const reshadefx::nodes::variable_declaration_node *, std::pair<size_t, size_t>> _texture_registers;
+		size_t _shader_resource_count = 3;
+		// Sampler slot of every sampler, samplers with the same states share one
+		std::unordered_map<const reshadefx::nodes::variable_declaration_node *, size_t> _sampler_registers;
+		std::vector<D3D10_SAMPLER_DESC> _sampler_descs;
+		// Uniforms with offsets relative to the constant buffer of this effect and its initial contents, added to the runtime storage when the effect is loaded
+		std::vector<uniform> _uniforms;
+		std::vector<unsigned char> _uniform_data;
+		std::unordered_map<const reshadefx::nodes::pass_declaration_node *, compiled_pass> _compiled_passes;
+		// Device objects bound to the slots above, created on the render thread
+		std::vector<com_ptr<ID3D10ShaderResourceView>> _shader_resources;
+		std::vector<com_ptr<ID3D10SamplerState>> _sampler_states;
 		bool _skip_shader_optimization, _is_in_parameter_block = false, _is_in_function_block = false;
 		size_t _uniform_storage_offset = 0, _constant_buffer_size = 0;
 		HMODULE _d3dcompiler_module = nullptr;
@@ -9,8 +9,11 @@
 #include "effect_lexer.hpp"
 #include "input.hpp"
 #include "resource_loading.hpp"
+#include "pixel_conversion.hpp"
+#include "gpu_marker.hpp"
 #include <imgui.h>
 #include <algorithm>
+#include <d3d9.h>
 
 namespace reshade::d3d10
 {
@@ -18,6 +21,31 @@ namespace reshade::d3d10
 	extern DXGI_FORMAT make_format_normal(DXGI_FORMAT format);
 	extern DXGI_FORMAT make_format_typeless(DXGI_FORMAT format);
 
+	/// <summary>
+	/// Labels the commands recorded during its lifetime for PIX and other GPU debuggers, while GPU markers are enabled.
+	/// </summary>
+	class gpu_marker
+	{
+	public:
+		gpu_marker(bool enabled, const std::string &name) : _end_event(enabled ? get_d3d9_event_functions().end_event : nullptr)
+		{
+			if (_end_event != nullptr)
+			{
+				get_d3d9_event_functions().begin_event(D3DCOLOR_XRGB(255, 128, 0), wide_marker_name(name).c_str());
+			}
+		}
+		~gpu_marker()
+		{
+			if (_end_event != nullptr)
+			{
+				_end_event();
+			}
+		}
+
+	private:
+		int (WINAPI *const _end_event)();
+	};
+
 	d3d10_runtime::d3d10_runtime(ID3D10Device1 *device, IDXGISwapChain *swapchain) :
 		runtime(device->GetFeatureLevel()), _device(device), _swapchain(swapchain),
 		_stateblock(device)
@@ -478,6 +506,7 @@ namespace reshade::d3d10
 		_depthstencil_texture_srv.reset();
 
 		_depth_texture_saves.clear();
+		last_depth_buffer_clear_count = 0;
 
 		_default_depthstencil.reset();
 		_copy_vertex_shader.reset();
@@ -498,19 +527,17 @@ namespace reshade::d3d10
 		_imgui_depthstencil_state.reset();
 		_imgui_vertex_buffer_size = 0;
 		_imgui_index_buffer_size = 0;
+		_imgui_vertex_buffer_offset = 0;
+		_imgui_index_buffer_offset = 0;
 	}
 	void d3d10_runtime::on_reset_effect()
 	{
 		runtime::on_reset_effect();
 
-		_effect_sampler_descs.clear();
-		_effect_sampler_states.clear();
 		_constant_buffers.clear();
 
-		_effect_shader_resources.resize(3);
-		_effect_shader_resources[0] = _backbuffer_texture_srv[0];
-		_effect_shader_resources[1] = _backbuffer_texture_srv[1];
-		_effect_shader_resources[2] = _depthstencil_texture_srv;
+		_effect_shader_resource_count = 3;
+		_effect_sampler_count = 0;
 	}
 	void d3d10_runtime::on_present(draw_call_tracker &tracker)
 	{
@@ -520,10 +547,11 @@ namespace reshade::d3d10
 		_vertices = tracker.total_vertices();
 		_drawcalls = tracker.total_drawcalls();
 
-		_current_tracker = tracker;
+		// The tracker of the device is cleared right after this, so it can just take over what the last frame left in here, which keeps the memory of both around
+		std::swap(_current_tracker, tracker);
 
 #if RESHADE_DX10_CAPTURE_DEPTH_BUFFERS
-		detect_depth_source(tracker);
+		detect_depth_source(_current_tracker);
 #endif
 
 		// Evaluate queries
@@ -541,14 +569,22 @@ namespace reshade::d3d10
 					technique_data.timestamp_query_end->GetData(&timestamp1, sizeof(timestamp1), D3D10_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
 				{
 					if (!disjoint.Disjoint)
-						technique.average_gpu_duration.append((timestamp1 - timestamp0) * 1'000'000'000 / disjoint.Frequency);
+					{
+						const uint64_t duration = (timestamp1 - timestamp0) * 1'000'000'000 / disjoint.Frequency;
+
+						if (technique.timings != nullptr)
+						{
+							technique.timings->average_gpu_duration.append(duration);
+							technique.timings->gpu_duration_samples.append(duration * 1e-6f);
+						}
+					}
 					technique_data.query_in_flight = false;
 				}
 			}
 		}
 
 		// Capture device state
-		_stateblock.capture();
+		_stateblock.capture(static_cast<UINT>(_effect_shader_resource_count), static_cast<UINT>(_effect_sampler_count));
 
 		// Disable unused pipeline stages
 		_device->GSSetShader(nullptr);
@@ -574,10 +610,6 @@ namespace reshade::d3d10
 
 			_device->RSSetState(_effect_rasterizer_state.get());
 
-			// Setup samplers
-			_device->VSSetSamplers(0, static_cast<UINT>(_effect_sampler_states.size()), reinterpret_cast<ID3D10SamplerState *const *>(_effect_sampler_states.data()));
-			_device->PSSetSamplers(0, static_cast<UINT>(_effect_sampler_states.size()), reinterpret_cast<ID3D10SamplerState *const *>(_effect_sampler_states.data()));
-
 			on_present_effect();
 		}
 
@@ -672,32 +704,20 @@ namespace reshade::d3d10
 			return;
 		}
 
-		auto mapped_data = static_cast<BYTE *>(mapped.pData);
-		const UINT pitch = texture_desc.Width * 4;
-
-		for (UINT y = 0; y < texture_desc.Height; y++)
-		{
-			CopyMemory(buffer, mapped_data, std::min(pitch, static_cast<UINT>(mapped.RowPitch)));
-			
-			for (UINT x = 0; x < pitch; x += 4)
-			{
-				buffer[x + 3] = 0xFF;
-
-				if (_backbuffer_format == DXGI_FORMAT_B8G8R8A8_UNORM || _backbuffer_format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB)
-				{
-					std::swap(buffer[x + 0], buffer[x + 2]);
-				}
-			}
-								
-			buffer += pitch;
-			mapped_data += mapped.RowPitch;
-		}
+		pixel_conversion::copy_rows_to_rgba(buffer, static_cast<const uint8_t *>(mapped.pData), mapped.RowPitch, texture_desc.Width, texture_desc.Height,
+			_backbuffer_format == DXGI_FORMAT_B8G8R8A8_UNORM || _backbuffer_format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB);
 
 		texture_staging->Unmap(0);
 	}
-	bool d3d10_runtime::load_effect(const reshadefx::syntax_tree &ast, std::string &errors)
+	std::unique_ptr<base_object> d3d10_runtime::compile_effect(const reshadefx::syntax_tree &ast, std::string &errors, bool)
 	{
-		return d3d10_effect_compiler(this, ast, errors, false).run();
+		auto compiler = std::make_unique<d3d10_effect_compiler>(this, ast, errors, false);
+		compiler->compile();
+		return compiler;
+	}
+	bool d3d10_runtime::load_effect(base_object &module)
+	{
+		return module.as<d3d10_effect_compiler>()->run();
 	}
 	bool d3d10_runtime::update_texture(texture &texture, const uint8_t *data)
 	{
@@ -745,8 +765,42 @@ namespace reshade::d3d10
 		return true;
 	}
 
+	bool d3d10_runtime::update_texture_compressed(texture &texture, const uint8_t *data, unsigned int levels)
+	{
+		if (texture.impl_reference != texture_reference::none)
+		{
+			return false;
+		}
+
+		const auto texture_impl = texture.impl->as<d3d10_tex_data>();
+
+		assert(data != nullptr);
+		assert(texture_impl != nullptr);
+
+		const UINT block_size = compressed_block_size(texture.format);
+
+		if (block_size == 0)
+		{
+			return false;
+		}
+
+		for (UINT level = 0; level < std::min(levels, texture.levels); level++)
+		{
+			const UINT row_size = std::max(1u, ((texture.width >> level) + 3) / 4) * block_size;
+			const UINT rows = std::max(1u, ((texture.height >> level) + 3) / 4);
+
+			_device->UpdateSubresource(texture_impl->texture.get(), level, nullptr, data, row_size, row_size * rows);
+
+			data += row_size * rows;
+		}
+
+		return true;
+	}
+
 	void d3d10_runtime::render_technique(const technique &technique)
 	{
+		const gpu_marker technique_marker(_gpu_markers, technique.name);
+
 		d3d10_technique_data &technique_data = *technique.impl->as<d3d10_technique_data>();
 
 		if (!technique_data.query_in_flight)
@@ -765,27 +819,40 @@ namespace reshade::d3d10
 			const auto constant_buffer = _constant_buffers[technique.uniform_storage_index].get();
 
 			constant_buffer->GetDesc(&desc);
-			const HRESULT hr = constant_buffer->Map(D3D10_MAP_WRITE_DISCARD, 0, &data);
 
-			if (SUCCEEDED(hr))
-			{
-				CopyMemory(data, get_uniform_value_storage().data() + technique.uniform_storage_offset, desc.ByteWidth);
+			// Constant buffers keep their contents, so only upload when a uniform changed. Techniques of the same effect share the buffer.
+			size_t dirty_offset, dirty_size;
 
-				constant_buffer->Unmap();
-			}
-			else
+			if (consume_uniform_changes(static_cast<size_t>(technique.uniform_storage_offset), desc.ByteWidth, dirty_offset, dirty_size))
 			{
-				LOG(ERROR) << "Failed to map constant buffer! HRESULT is '" << std::hex << hr << std::dec << "'!";
+				const HRESULT hr = constant_buffer->Map(D3D10_MAP_WRITE_DISCARD, 0, &data);
+
+				if (SUCCEEDED(hr))
+				{
+					CopyMemory(data, get_uniform_value_storage().data() + technique.uniform_storage_offset, desc.ByteWidth);
+
+					constant_buffer->Unmap();
+				}
+				else
+				{
+					LOG(ERROR) << "Failed to map constant buffer! HRESULT is '" << std::hex << hr << std::dec << "'!";
+				}
 			}
 
 			_device->VSSetConstantBuffers(0, 1, &constant_buffer);
 			_device->PSSetConstantBuffers(0, 1, &constant_buffer);
 		}
 
+		// Every effect has its own sampler slots, so they are set for each technique
+		_device->VSSetSamplers(0, static_cast<UINT>(technique_data.sampler_states.size()), reinterpret_cast<ID3D10SamplerState *const *>(technique_data.sampler_states.data()));
+		_device->PSSetSamplers(0, static_cast<UINT>(technique_data.sampler_states.size()), reinterpret_cast<ID3D10SamplerState *const *>(technique_data.sampler_states.data()));
+
 		for (const auto &pass_object : technique.passes)
 		{
 			const d3d10_pass_data &pass = *pass_object->as<d3d10_pass_data>();
 
+			const gpu_marker pass_marker(_gpu_markers, pass.name);
+
 			// Setup states
 			_device->VSSetShader(pass.vertex_shader.get());
 			_device->PSSetShader(pass.pixel_shader.get());
@@ -872,12 +939,13 @@ namespace reshade::d3d10
 	}
 	void d3d10_runtime::render_imgui_draw_data(ImDrawData *draw_data)
 	{
-		// Create and grow vertex/index buffers if needed
+		// Create and grow vertex/index buffers if needed, with room for a few frames so they are only discarded every couple of frames when the ring below wraps around
 		if (_imgui_vertex_buffer == nullptr ||
 			_imgui_vertex_buffer_size < draw_data->TotalVtxCount)
 		{
 			_imgui_vertex_buffer.reset();
-			_imgui_vertex_buffer_size = draw_data->TotalVtxCount + 5000;
+			_imgui_vertex_buffer_size = draw_data->TotalVtxCount * 3 + 5000;
+			_imgui_vertex_buffer_offset = 0;
 
 			D3D10_BUFFER_DESC desc = { };
 			desc.Usage = D3D10_USAGE_DYNAMIC;
@@ -895,7 +963,8 @@ namespace reshade::d3d10
 			_imgui_index_buffer_size < draw_data->TotalIdxCount)
 		{
 			_imgui_index_buffer.reset();
-			_imgui_index_buffer_size = draw_data->TotalIdxCount + 10000;
+			_imgui_index_buffer_size = draw_data->TotalIdxCount * 3 + 10000;
+			_imgui_index_buffer_offset = 0;
 
 			D3D10_BUFFER_DESC desc = { };
 			desc.Usage = D3D10_USAGE_DYNAMIC;
@@ -909,14 +978,32 @@ namespace reshade::d3d10
 			}
 		}
 
+		// Append behind the data of previous frames, which the GPU may still read from, and only start over at the beginning with a discard once that no longer fits
+		D3D10_MAP map_type = D3D10_MAP_WRITE_NO_OVERWRITE;
+
+		if (_imgui_vertex_buffer_offset + draw_data->TotalVtxCount > _imgui_vertex_buffer_size ||
+			_imgui_index_buffer_offset + draw_data->TotalIdxCount > _imgui_index_buffer_size)
+		{
+			map_type = D3D10_MAP_WRITE_DISCARD;
+			_imgui_vertex_buffer_offset = 0;
+			_imgui_index_buffer_offset = 0;
+		}
+
 		ImDrawVert *vtx_dst;
 		ImDrawIdx *idx_dst;
 
-		if (FAILED(_imgui_vertex_buffer->Map(D3D10_MAP_WRITE_DISCARD, 0, reinterpret_cast<void **>(&vtx_dst))) ||
-			FAILED(_imgui_index_buffer->Map(D3D10_MAP_WRITE_DISCARD, 0, reinterpret_cast<void **>(&idx_dst))))
+		if (FAILED(_imgui_vertex_buffer->Map(map_type, 0, reinterpret_cast<void **>(&vtx_dst))))
 		{
 			return;
 		}
+		if (FAILED(_imgui_index_buffer->Map(map_type, 0, reinterpret_cast<void **>(&idx_dst))))
+		{
+			_imgui_vertex_buffer->Unmap();
+			return;
+		}
+
+		vtx_dst += _imgui_vertex_buffer_offset;
+		idx_dst += _imgui_index_buffer_offset;
 
 		for (int n = 0; n < draw_data->CmdListsCount; n++)
 		{
@@ -975,8 +1062,11 @@ namespace reshade::d3d10
 		_device->PSSetShader(_imgui_pixel_shader.get());
 		_device->PSSetSamplers(0, 1, samplers);
 
-		// Render command lists
-		UINT vtx_offset = 0, idx_offset = 0;
+		// Render command lists, starting at where this frame was written to the buffers
+		UINT vtx_offset = _imgui_vertex_buffer_offset, idx_offset = _imgui_index_buffer_offset;
+
+		_imgui_vertex_buffer_offset += draw_data->TotalVtxCount;
+		_imgui_index_buffer_offset += draw_data->TotalIdxCount;
 
 		for (int n = 0; n < draw_data->CmdListsCount; n++)
 		{
@@ -1028,6 +1118,7 @@ namespace reshade::d3d10
 				if (ImGui::Checkbox("Extended depth buffer detection", &extended_depth_buffer_detection))
 				{
 					cleared_depth_buffer_index = 0;
+					last_depth_buffer_clear_count = 0;
 					modified = true;
 				}
 
@@ -1046,6 +1137,8 @@ namespace reshade::d3d10
 					if (bool value = cleared_depth_buffer_index == current_index; ImGui::Checkbox(label, &value))
 					{
 						cleared_depth_buffer_index = value ? current_index : 0;
+						// The new selection may lie before the clear copies were made from so far
+						last_depth_buffer_clear_count = 0;
 						modified = true;
 					}
 
@@ -1162,7 +1255,7 @@ namespace reshade::d3d10
 			// In this case, we cannot use the depth stencil to determine which depth texture is the good one, so we can use the default depth stencil
 			// For the moment, the best we can do is retrieve all the depth textures that has been cleared in the rendering pipeline, then select one of them (by default, the last one)
 			// In the future, maybe we could find a way to retrieve depth texture statistics (number of draw calls and number of vertices), so ReShade could automatically select the best one
-			ID3D10Texture2D *const best_match_texture = tracker.find_best_cleared_depth_buffer_texture(cleared_depth_buffer_index);
+			ID3D10Texture2D *const best_match_texture = tracker.find_best_cleared_depth_buffer_texture(cleared_depth_buffer_index, last_depth_buffer_clear_count);
 
 			if (best_match_texture != nullptr)
 			{
@@ -1173,9 +1266,9 @@ namespace reshade::d3d10
 
 		const auto best_snapshot = tracker.find_best_snapshot(_width, _height);
 
-		if (best_snapshot.depthstencil != nullptr)
+		if (best_snapshot != nullptr && best_snapshot->depthstencil != nullptr)
 		{
-			create_depthstencil_replacement(best_snapshot.depthstencil, best_snapshot.texture.get());
+			create_depthstencil_replacement(best_snapshot->depthstencil, best_snapshot->texture.get());
 		}
 	}
 
@@ -1309,7 +1402,6 @@ namespace reshade::d3d10
 		}
 
 		// Update effect textures
-		_effect_shader_resources[2] = _depthstencil_texture_srv;
 		for (const auto &technique : _techniques)
 			for (const auto &pass : technique.passes)
 				pass->as<d3d10_pass_data>()->shader_resources[2] = _depthstencil_texture_srv;
@@ -1345,8 +1437,14 @@ namespace reshade::d3d10
 			break;
 		}
 
-		// create an unique index based on the dept texture format and dimensions
-		UINT idx = texture_desc.Format * texture_desc.Width * texture_desc.Height;
+		// Create an unique index from everything 'CopyResource' requires to match, so textures of different shape never end up sharing a copy
+		const UINT64 idx =
+			(static_cast<UINT64>(texture_desc.Format & 0xFF) << 56) |
+			(static_cast<UINT64>(texture_desc.SampleDesc.Count & 0xFF) << 48) |
+			(static_cast<UINT64>(texture_desc.MipLevels & 0xFF) << 40) |
+			(static_cast<UINT64>(texture_desc.ArraySize & 0xFF) << 32) |
+			(static_cast<UINT64>(texture_desc.Width & 0xFFFF) << 16) |
+			(static_cast<UINT64>(texture_desc.Height & 0xFFFF));
 
 		const auto it = _depth_texture_saves.find(idx);
 		com_ptr<ID3D10Texture2D> depth_texture_save = nullptr;
@@ -7,6 +7,7 @@
 
 #include <d3d10_1.h>
 #include "runtime.hpp"
+#include "state_object_cache.hpp"
 #include "d3d10_stateblock.hpp"
 #include "draw_call_tracker.hpp"
 
@@ -20,6 +21,8 @@ namespace reshade::d3d10
 	};
 	struct d3d10_pass_data : base_object
 	{
+		// Name of the pass in the effect, or its index for passes without one
+		std::string name;
 		com_ptr<ID3D10VertexShader> vertex_shader;
 		com_ptr<ID3D10PixelShader> pixel_shader;
 		com_ptr<ID3D10BlendState> blend_state;
@@ -37,6 +40,8 @@ namespace reshade::d3d10
 		com_ptr<ID3D10Query> timestamp_disjoint;
 		com_ptr<ID3D10Query> timestamp_query_beg;
 		com_ptr<ID3D10Query> timestamp_query_end;
+		// Sampler states of the effect the technique belongs to, bound to the sampler slots of all its passes
+		std::vector<com_ptr<ID3D10SamplerState>> sampler_states;
 	};
 
 	class d3d10_runtime : public runtime
@@ -51,8 +56,10 @@ namespace reshade::d3d10
 		void on_copy_resource(ID3D10Resource *&dest, ID3D10Resource *&source);
 
 		void capture_frame(uint8_t *buffer) const override;
-		bool load_effect(const reshadefx::syntax_tree &ast, std::string &errors) override;
+		std::unique_ptr<base_object> compile_effect(const reshadefx::syntax_tree &ast, std::string &errors, bool half_precision) override;
+		bool load_effect(base_object &module) override;
 		bool update_texture(texture &texture, const uint8_t *data) override;
+		bool update_texture_compressed(texture &texture, const uint8_t *data, unsigned int levels) override;
 
 		void render_technique(const technique &technique) override;
 		void render_imgui_draw_data(ImDrawData *data) override;
@@ -67,14 +74,19 @@ namespace reshade::d3d10
 		com_ptr<ID3D10Texture2D> _backbuffer_texture;
 		com_ptr<ID3D10RenderTargetView> _backbuffer_rtv[3];
 		com_ptr<ID3D10ShaderResourceView> _backbuffer_texture_srv[2], _depthstencil_texture_srv;
-		std::vector<com_ptr<ID3D10SamplerState>> _effect_sampler_states;
-		std::unordered_map<size_t, size_t> _effect_sampler_descs;
-		std::vector<com_ptr<ID3D10ShaderResourceView>> _effect_shader_resources;
+		// State objects of all effects, kept across reloads, so identical states are only created once and the limit of the driver on the number of state objects is not reached with many effects
+		state_object_cache<ID3D10SamplerState> _sampler_state_cache;
+		state_object_cache<ID3D10BlendState> _blend_state_cache;
+		state_object_cache<ID3D10DepthStencilState> _depth_stencil_state_cache;
+		// Number of shader resource and sampler slots of the effect that binds the most, every effect has its own slots starting at zero
+		size_t _effect_shader_resource_count = 3, _effect_sampler_count = 0;
 		std::vector<com_ptr<ID3D10Buffer>> _constant_buffers;
 
 		bool depth_buffer_before_clear = false;
 		bool extended_depth_buffer_detection = false;
 		unsigned int cleared_depth_buffer_index = 0;
+		// Number of depth stencil clears up to the one the depth texture was taken from in the last frame, copies of earlier clears would only be overwritten again
+		unsigned int last_depth_buffer_clear_count = 0;
 		int depth_buffer_texture_format = 0; // No depth buffer texture format filter by default
 
 	private:
@@ -104,7 +116,7 @@ namespace reshade::d3d10
 		};
 
 		std::map<UINT, depth_texture_save_info> _displayed_depth_textures;
-		std::unordered_map<UINT, com_ptr<ID3D10Texture2D>> _depth_texture_saves;
+		std::unordered_map<UINT64, com_ptr<ID3D10Texture2D>> _depth_texture_saves;
 
 		bool _is_multisampling_enabled = false;
 		DXGI_FORMAT _backbuffer_format = DXGI_FORMAT_UNKNOWN;
@@ -129,6 +141,8 @@ namespace reshade::d3d10
 		com_ptr<ID3D10BlendState> _imgui_blend_state;
 		com_ptr<ID3D10DepthStencilState> _imgui_depthstencil_state;
 		int _imgui_vertex_buffer_size = 0, _imgui_index_buffer_size = 0;
+		// Where the next frame is written to in the vertex/index buffers, which are filled like a ring
+		int _imgui_vertex_buffer_offset = 0, _imgui_index_buffer_offset = 0;
 		draw_call_tracker _current_tracker;
 	};
 }
@@ -4,6 +4,7 @@
  */
 
 #include "d3d10_stateblock.hpp"
+#include <algorithm>
 
 namespace reshade::d3d10
 {
@@ -28,12 +29,16 @@ namespace reshade::d3d10
 		release_all_device_objects();
 	}
 
-	void d3d10_stateblock::capture()
+	void d3d10_stateblock::capture(UINT num_shader_resources, UINT num_samplers)
 	{
+		// The copy and ImGui use the first slot even without any effects loaded
+		_num_shader_resources = std::min(std::max(num_shader_resources, 1u), static_cast<UINT>(ARRAYSIZE(_vs_shader_resources)));
+		_num_samplers = std::min(std::max(num_samplers, 1u), static_cast<UINT>(ARRAYSIZE(_vs_sampler_states)));
+
 		_device->IAGetPrimitiveTopology(&_ia_primitive_topology);
 		_device->IAGetInputLayout(&_ia_input_layout);
 
-		_device->IAGetVertexBuffers(0, ARRAYSIZE(_ia_vertex_buffers), _ia_vertex_buffers, _ia_vertex_strides, _ia_vertex_offsets);
+		_device->IAGetVertexBuffers(0, 1, _ia_vertex_buffers, _ia_vertex_strides, _ia_vertex_offsets);
 		_device->IAGetIndexBuffer(&_ia_index_buffer, &_ia_index_format, &_ia_index_offset);
 
 		_device->RSGetState(&_rs_state);
@@ -43,16 +48,16 @@ namespace reshade::d3d10
 		_device->RSGetScissorRects(&_rs_num_scissor_rects, _rs_scissor_rects);
 
 		_device->VSGetShader(&_vs);
-		_device->VSGetConstantBuffers(0, ARRAYSIZE(_vs_constant_buffers), _vs_constant_buffers);
-		_device->VSGetSamplers(0, ARRAYSIZE(_vs_sampler_states), _vs_sampler_states);
-		_device->VSGetShaderResources(0, ARRAYSIZE(_vs_shader_resources), _vs_shader_resources);
+		_device->VSGetConstantBuffers(0, 1, _vs_constant_buffers);
+		_device->VSGetSamplers(0, _num_samplers, _vs_sampler_states);
+		_device->VSGetShaderResources(0, _num_shader_resources, _vs_shader_resources);
 
 		_device->GSGetShader(&_gs);
 
 		_device->PSGetShader(&_ps);
-		_device->PSGetConstantBuffers(0, ARRAYSIZE(_ps_constant_buffers), _ps_constant_buffers);
-		_device->PSGetSamplers(0, ARRAYSIZE(_ps_sampler_states), _ps_sampler_states);
-		_device->PSGetShaderResources(0, ARRAYSIZE(_ps_shader_resources), _ps_shader_resources);
+		_device->PSGetConstantBuffers(0, 1, _ps_constant_buffers);
+		_device->PSGetSamplers(0, _num_samplers, _ps_sampler_states);
+		_device->PSGetShaderResources(0, _num_shader_resources, _ps_shader_resources);
 
 		_device->OMGetBlendState(&_om_blend_state, _om_blend_factor, &_om_sample_mask);
 		_device->OMGetDepthStencilState(&_om_depth_stencil_state, &_om_stencil_ref);
@@ -63,7 +68,7 @@ namespace reshade::d3d10
 		_device->IASetPrimitiveTopology(_ia_primitive_topology);
 		_device->IASetInputLayout(_ia_input_layout);
 
-		_device->IASetVertexBuffers(0, ARRAYSIZE(_ia_vertex_buffers), _ia_vertex_buffers, _ia_vertex_strides, _ia_vertex_offsets);
+		_device->IASetVertexBuffers(0, 1, _ia_vertex_buffers, _ia_vertex_strides, _ia_vertex_offsets);
 		_device->IASetIndexBuffer(_ia_index_buffer, _ia_index_format, _ia_index_offset);
 
 		_device->RSSetState(_rs_state);
@@ -71,16 +76,16 @@ namespace reshade::d3d10
 		_device->RSSetScissorRects(_rs_num_scissor_rects, _rs_scissor_rects);
 
 		_device->VSSetShader(_vs);
-		_device->VSSetConstantBuffers(0, ARRAYSIZE(_vs_constant_buffers), _vs_constant_buffers);
-		_device->VSSetSamplers(0, ARRAYSIZE(_vs_sampler_states), _vs_sampler_states);
-		_device->VSSetShaderResources(0, ARRAYSIZE(_vs_shader_resources), _vs_shader_resources);
+		_device->VSSetConstantBuffers(0, 1, _vs_constant_buffers);
+		_device->VSSetSamplers(0, _num_samplers, _vs_sampler_states);
+		_device->VSSetShaderResources(0, _num_shader_resources, _vs_shader_resources);
 
 		_device->GSSetShader(_gs);
 
 		_device->PSSetShader(_ps);
-		_device->PSSetConstantBuffers(0, ARRAYSIZE(_ps_constant_buffers), _ps_constant_buffers);
-		_device->PSSetSamplers(0, ARRAYSIZE(_ps_sampler_states), _ps_sampler_states);
-		_device->PSSetShaderResources(0, ARRAYSIZE(_ps_shader_resources), _ps_shader_resources);
+		_device->PSSetConstantBuffers(0, 1, _ps_constant_buffers);
+		_device->PSSetSamplers(0, _num_samplers, _ps_sampler_states);
+		_device->PSSetShaderResources(0, _num_shader_resources, _ps_shader_resources);
 
 		_device->OMSetBlendState(_om_blend_state, _om_blend_factor, _om_sample_mask);
 		_device->OMSetDepthStencilState(_om_depth_stencil_state, _om_stencil_ref);
@@ -16,13 +16,20 @@ namespace reshade::d3d10
 		explicit d3d10_stateblock(ID3D10Device *device);
 		~d3d10_stateblock();
 
-		void capture();
+		/// <summary>
+		/// Save the state the runtime changes while rendering. Vertex buffers and constant buffers are only saved for the first slot and shader resources and samplers only for as many slots as specified, since the runtime binds nothing beyond that.
+		/// </summary>
+		/// <param name="num_shader_resources">The number of shader resource slots the runtime binds.</param>
+		/// <param name="num_samplers">The number of sampler slots the runtime binds.</param>
+		void capture(UINT num_shader_resources, UINT num_samplers);
 		void apply_and_release();
 
 	private:
 		void release_all_device_objects();
 
 		com_ptr<ID3D10Device> _device;
+		UINT _num_shader_resources;
+		UINT _num_samplers;
 		ID3D10InputLayout *_ia_input_layout;
 		D3D10_PRIMITIVE_TOPOLOGY _ia_primitive_topology;
 		ID3D10Buffer *_ia_vertex_buffers[D3D10_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
@@ -12,8 +12,9 @@ namespace reshade::d3d10
 #if RESHADE_DX10_CAPTURE_DEPTH_BUFFERS
 		for (const auto &[depthstencil, snapshot] : source._counters_per_used_depthstencil)
 		{
-			_counters_per_used_depthstencil[depthstencil].stats.vertices += snapshot.stats.vertices;
-			_counters_per_used_depthstencil[depthstencil].stats.drawcalls += snapshot.stats.drawcalls;
+			auto &destination_snapshot = _counters_per_used_depthstencil[depthstencil.get()];
+			destination_snapshot.stats.vertices += snapshot.stats.vertices;
+			destination_snapshot.stats.drawcalls += snapshot.stats.drawcalls;
 		}
 
 		for (auto source_entry : source._cleared_depth_textures)
@@ -29,10 +30,11 @@ namespace reshade::d3d10
 #if RESHADE_DX10_CAPTURE_CONSTANT_BUFFERS
 		for (const auto &[buffer, snapshot] : source._counters_per_constant_buffer)
 		{
-			_counters_per_constant_buffer[buffer].vertices += snapshot.vertices;
-			_counters_per_constant_buffer[buffer].drawcalls += snapshot.drawcalls;
-			_counters_per_constant_buffer[buffer].ps_uses += snapshot.ps_uses;
-			_counters_per_constant_buffer[buffer].vs_uses += snapshot.vs_uses;
+			auto &destination_snapshot = _counters_per_constant_buffer[buffer.get()];
+			destination_snapshot.vertices += snapshot.vertices;
+			destination_snapshot.drawcalls += snapshot.drawcalls;
+			destination_snapshot.ps_uses += snapshot.ps_uses;
+			destination_snapshot.vs_uses += snapshot.vs_uses;
 		}
 #endif
 	}
@@ -82,10 +84,10 @@ namespace reshade::d3d10
 			// This is a draw call with no depth stencil
 			return;
 
-		if (const auto intermediate_snapshot = _counters_per_used_depthstencil.find(depthstencil); intermediate_snapshot != _counters_per_used_depthstencil.end())
+		if (const auto intermediate_snapshot = _counters_per_used_depthstencil.find(depthstencil.get()); intermediate_snapshot != nullptr)
 		{
-			intermediate_snapshot->second.stats.vertices += vertices;
-			intermediate_snapshot->second.stats.drawcalls += 1;
+			intermediate_snapshot->stats.vertices += vertices;
+			intermediate_snapshot->stats.drawcalls += 1;
 
 			// Find the render targets, if they exist, and update their counts
 			for (UINT i = 0; i < D3D10_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
@@ -94,10 +96,10 @@ namespace reshade::d3d10
 				if (targets[i] == nullptr)
 					continue;
 
-				if (const auto it = intermediate_snapshot->second.additional_views.find(targets[i].get()); it != intermediate_snapshot->second.additional_views.end())
+				if (const auto it = intermediate_snapshot->additional_views.find(targets[i].get()); it != nullptr)
 				{
-					it->second.vertices += vertices;
-					it->second.drawcalls += 1;
+					it->vertices += vertices;
+					it->drawcalls += 1;
 				}
 				else
 				{
@@ -117,7 +119,7 @@ namespace reshade::d3d10
 			// Uses the default drawcalls = 0 the first time around.
 			if (vscbuffers[i] != nullptr)
 			{
-				_counters_per_constant_buffer[vscbuffers[i]].vs_uses += 1;
+				_counters_per_constant_buffer[vscbuffers[i].get()].vs_uses += 1;
 			}
 		}
 
@@ -129,7 +131,7 @@ namespace reshade::d3d10
 			// Uses the default drawcalls = 0 the first time around.
 			if (pscbuffers[i] != nullptr)
 			{
-				_counters_per_constant_buffer[pscbuffers[i]].ps_uses += 1;
+				_counters_per_constant_buffer[pscbuffers[i].get()].ps_uses += 1;
 			}
 		}
 #endif
@@ -197,7 +199,7 @@ namespace reshade::d3d10
 	}
 	bool draw_call_tracker::check_depthstencil(ID3D10DepthStencilView *depthstencil) const
 	{
-		return _counters_per_used_depthstencil.find(depthstencil) != _counters_per_used_depthstencil.end();
+		return _counters_per_used_depthstencil.find(depthstencil) != nullptr;
 	}
 
 	void draw_call_tracker::track_rendertargets(int depth_buffer_texture_format, ID3D10DepthStencilView *depthstencil, UINT num_views, ID3D10RenderTargetView *const *views)
@@ -209,16 +211,18 @@ namespace reshade::d3d10
 			return;
 		}
 
-		if (_counters_per_used_depthstencil[depthstencil].depthstencil == nullptr)
-			_counters_per_used_depthstencil[depthstencil].depthstencil = depthstencil;
+		auto &snapshot = _counters_per_used_depthstencil[depthstencil];
+
+		if (snapshot.depthstencil == nullptr)
+			snapshot.depthstencil = depthstencil;
 
 		for (UINT i = 0; i < num_views; i++)
 		{
 			// If the render target isn't being tracked, this will create it
-			_counters_per_used_depthstencil[depthstencil].additional_views[views[i]].drawcalls += 1;
+			snapshot.additional_views[views[i]].drawcalls += 1;
 		}
 	}
-	void draw_call_tracker::track_depth_texture(int depth_buffer_texture_format, UINT index, com_ptr<ID3D10Texture2D> src_texture, com_ptr<ID3D10DepthStencilView> src_depthstencil, com_ptr<ID3D10Texture2D> dest_texture, bool cleared)
+	void draw_call_tracker::track_depth_texture(int depth_buffer_texture_format, UINT index, UINT clear_count, com_ptr<ID3D10Texture2D> src_texture, com_ptr<ID3D10DepthStencilView> src_depthstencil, com_ptr<ID3D10Texture2D> dest_texture, bool cleared)
 	{
 		// Function that keeps track of a cleared depth texture in an ordered map in order to retrieve it at the final rendering stage
 		assert(src_texture != nullptr);
@@ -238,19 +242,19 @@ namespace reshade::d3d10
 		// fill the ordered map with the saved depth texture
 		if (const auto it = _cleared_depth_textures.find(index); it == _cleared_depth_textures.end())
 		{
-			_cleared_depth_textures.emplace(index, depth_texture_save_info{ src_texture, src_depthstencil, src_texture_desc, dest_texture, cleared });
+			_cleared_depth_textures.emplace(index, depth_texture_save_info{ src_texture, src_depthstencil, src_texture_desc, dest_texture, cleared, clear_count });
 		}
 		else
 		{
-			it->second = depth_texture_save_info{ src_texture, src_depthstencil, src_texture_desc, dest_texture, cleared };
+			it->second = depth_texture_save_info{ src_texture, src_depthstencil, src_texture_desc, dest_texture, cleared, clear_count };
 		}
 	}
 
-	draw_call_tracker::intermediate_snapshot_info draw_call_tracker::find_best_snapshot(UINT width, UINT height)
+	draw_call_tracker::intermediate_snapshot_info *draw_call_tracker::find_best_snapshot(UINT width, UINT height)
 	{
 		const float aspect_ratio = float(width) / float(height);
 
-		intermediate_snapshot_info best_snapshot;
+		intermediate_snapshot_info *best_snapshot = nullptr;
 
 		for (auto &[depthstencil, snapshot] : _counters_per_used_depthstencil)
 		{
@@ -286,9 +290,9 @@ namespace reshade::d3d10
 				continue;
 			}
 
-			if (snapshot.stats.drawcalls >= best_snapshot.stats.drawcalls)
+			if (best_snapshot == nullptr || snapshot.stats.drawcalls >= best_snapshot->stats.drawcalls)
 			{
-				best_snapshot = snapshot;
+				best_snapshot = &snapshot;
 			}
 		}
 
@@ -312,10 +316,11 @@ namespace reshade::d3d10
 		}
 	}
 
-	ID3D10Texture2D *draw_call_tracker::find_best_cleared_depth_buffer_texture(UINT depth_buffer_clearing_number)
+	ID3D10Texture2D *draw_call_tracker::find_best_cleared_depth_buffer_texture(UINT depth_buffer_clearing_number, UINT &best_match_clear_count)
 	{
 		// Function that selects the best cleared depth texture according to the clearing number defined in the configuration settings
 		ID3D10Texture2D *best_match = nullptr;
+		best_match_clear_count = 0;
 
 		// Ensure to work only on the depth textures retrieved before the last depth stencil clearance
 		keep_cleared_depth_textures();
@@ -347,6 +352,7 @@ namespace reshade::d3d10
 			// if the user selects a clearing number and the number of cleared depth textures is greater or equal than it, the texture corresponding to this number is retrieved
 			// if the user selects a clearing number and the number of cleared depth textures is lower than it, the last cleared depth texture is retrieved
 			best_match = texture.get();
+			best_match_clear_count = texture_counter_info.clear_count;
 		}
 
 		return best_match;
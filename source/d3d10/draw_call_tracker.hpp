@@ -3,6 +3,7 @@
 #include <d3d10.h>
 #include <map>
 #include "com_ptr.hpp"
+#include "pointer_map.hpp"
 
 #define RESHADE_DX10_CAPTURE_DEPTH_BUFFERS 1
 #define RESHADE_DX10_CAPTURE_CONSTANT_BUFFERS 0
@@ -27,7 +28,15 @@ namespace reshade::d3d10
 			ID3D10DepthStencilView *depthstencil = nullptr; // No need to use a 'com_ptr' here since '_counters_per_used_depthstencil' already keeps a reference
 			draw_stats stats;
 			com_ptr<ID3D10Texture2D> texture;
-			std::map<ID3D10RenderTargetView *, draw_stats> additional_views;
+			pointer_map<ID3D10RenderTargetView *, draw_stats> additional_views;
+
+			void clear()
+			{
+				depthstencil = nullptr;
+				stats = draw_stats();
+				texture.reset();
+				additional_views.clear();
+			}
 		};
 #endif
 
@@ -52,12 +61,12 @@ namespace reshade::d3d10
 		bool check_depth_texture_format(int depth_buffer_texture_format, ID3D10DepthStencilView *pDepthStencilView);
 		bool check_depthstencil(ID3D10DepthStencilView *depthstencil) const;
 		void track_rendertargets(int depth_buffer_texture_format, ID3D10DepthStencilView *depthstencil, UINT num_views, ID3D10RenderTargetView *const *views);
-		void track_depth_texture(int depth_buffer_texture_format, UINT index, com_ptr<ID3D10Texture2D> src_texture, com_ptr<ID3D10DepthStencilView> src_depthstencil, com_ptr<ID3D10Texture2D> dest_texture, bool cleared);
+		void track_depth_texture(int depth_buffer_texture_format, UINT index, UINT clear_count, com_ptr<ID3D10Texture2D> src_texture, com_ptr<ID3D10DepthStencilView> src_depthstencil, com_ptr<ID3D10Texture2D> dest_texture, bool cleared);
 
 		void keep_cleared_depth_textures();
 
-		intermediate_snapshot_info find_best_snapshot(UINT width, UINT height);
-		ID3D10Texture2D *find_best_cleared_depth_buffer_texture(UINT depth_buffer_clearing_number);
+		intermediate_snapshot_info *find_best_snapshot(UINT width, UINT height);
+		ID3D10Texture2D *find_best_cleared_depth_buffer_texture(UINT depth_buffer_clearing_number, UINT &best_match_clear_count);
 #endif
 
 	private:
@@ -68,16 +77,18 @@ namespace reshade::d3d10
 			D3D10_TEXTURE2D_DESC src_texture_desc;
 			com_ptr<ID3D10Texture2D> dest_texture;
 			bool cleared = false;
+			// Number of depth stencil clears in the frame up to and including this one
+			UINT clear_count = 0;
 		};
 
 		draw_stats _global_counter;
 #if RESHADE_DX10_CAPTURE_DEPTH_BUFFERS
-		// Use "std::map" instead of "std::unordered_map" so that the iteration order is guaranteed
-		std::map<com_ptr<ID3D10DepthStencilView>, intermediate_snapshot_info> _counters_per_used_depthstencil;
+		// Updated on every draw call and cleared every frame, which 'pointer_map' does without allocating, it also iterates in a fixed order (the one depth stencils were first used in)
+		pointer_map<com_ptr<ID3D10DepthStencilView>, intermediate_snapshot_info> _counters_per_used_depthstencil;
 		std::map<UINT, depth_texture_save_info> _cleared_depth_textures;
 #endif
 #if RESHADE_DX10_CAPTURE_CONSTANT_BUFFERS
-		std::map<com_ptr<ID3D10Buffer>, draw_stats> _counters_per_constant_buffer;
+		pointer_map<com_ptr<ID3D10Buffer>, draw_stats> _counters_per_constant_buffer;
 #endif
 	};
 }
\ No newline at end of file
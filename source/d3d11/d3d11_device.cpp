@@ -7,47 +7,11 @@
 #include "d3d11_device.hpp"
 #include "d3d11_device_context.hpp"
 #include "../dxgi/dxgi_device.hpp"
-#include "draw_call_tracker.hpp"
-
-void D3D11Device::add_commandlist_trackers(ID3D11CommandList* command_list, const reshade::d3d11::draw_call_tracker &tracker_source)
-{
-	assert(command_list != nullptr);
-
-	const std::lock_guard<std::mutex> lock(_trackers_per_commandlist_mutex);
-
-	// Merges the counters in counters_source in the counters_per_commandlist for the command list specified
-	const auto it = _trackers_per_commandlist.find(command_list);
-
-	if (it == _trackers_per_commandlist.end())
-	{
-		_trackers_per_commandlist.emplace(command_list, tracker_source);
-	}
-	else
-	{
-		it->second.merge(tracker_source);
-	}
-}
-void D3D11Device::merge_commandlist_trackers(ID3D11CommandList* command_list, reshade::d3d11::draw_call_tracker &tracker_destination)
-{
-	assert(command_list != nullptr);
-
-	const std::lock_guard<std::mutex> lock(_trackers_per_commandlist_mutex);
-
-	// Merges the counters logged for the specified command list in the counters destination tracker specified
-	const auto it = _trackers_per_commandlist.find(command_list);
-
-	if (it != _trackers_per_commandlist.end())
-	{
-		tracker_destination.merge(it->second);
-	}
-}
 
 void D3D11Device::clear_drawcall_stats()
 {
-	const std::lock_guard<std::mutex> lock(_trackers_per_commandlist_mutex);
-
-	_trackers_per_commandlist.clear();
 	_clear_DSV_iter = 1;
+	_clear_DSV_count = 0;
 }
 
 // ID3D11Device
@@ -238,7 +202,14 @@ HRESULT STDMETHODCALLTYPE D3D11Device::CreateInputLayout(const D3D11_INPUT_ELEME
 }
 HRESULT STDMETHODCALLTYPE D3D11Device::CreateVertexShader(const void *pShaderBytecode, SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage, ID3D11VertexShader **ppVertexShader)
 {
-	return _orig->CreateVertexShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppVertexShader);
+	const HRESULT hr = _orig->CreateVertexShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppVertexShader);
+
+	if (SUCCEEDED(hr) && ppVertexShader != nullptr)
+	{
+		_redirect->OnCreateVertexShader(pShaderBytecode, BytecodeLength, *ppVertexShader);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE D3D11Device::CreateGeometryShader(const void *pShaderBytecode, SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage, ID3D11GeometryShader **ppGeometryShader)
 {
@@ -250,7 +221,8 @@ HRESULT STDMETHODCALLTYPE D3D11Device::CreateGeometryShaderWithStreamOutput(cons
 }
 HRESULT STDMETHODCALLTYPE D3D11Device::CreatePixelShader(const void *pShaderBytecode, SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage, ID3D11PixelShader **ppPixelShader)
 {
-	return _orig->CreatePixelShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppPixelShader);
+	// The hook creates the shader itself, since it may replace the bytecode with a patched version
+	return _redirect->CreatePixelShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppPixelShader);
 }
 HRESULT STDMETHODCALLTYPE D3D11Device::CreateHullShader(const void *pShaderBytecode, SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage, ID3D11HullShader **ppHullShader)
 {
@@ -7,20 +7,25 @@
 
 #include "d3d11.hpp"
 #include "draw_call_tracker.hpp"
+#include "../gw2/hook_gw2_d3d11.hpp"
 
 struct D3D11Device : ID3D11Device3
 {
 	explicit D3D11Device(ID3D11Device  *original) :
 		_orig(original),
+		_redirect(new hook_gw2_d3d11(this)),
 		_interface_version(0) { }
 	explicit D3D11Device(ID3D11Device1 *original) :
 		_orig(original),
+		_redirect(new hook_gw2_d3d11(this)),
 		_interface_version(1) { }
 	explicit D3D11Device(ID3D11Device2 *original) :
 		_orig(original),
+		_redirect(new hook_gw2_d3d11(this)),
 		_interface_version(2) { }
 	explicit D3D11Device(ID3D11Device3 *original) :
 		_orig(original),
+		_redirect(new hook_gw2_d3d11(this)),
 		_interface_version(3) { }
 
 	D3D11Device(const D3D11Device &) = delete;
@@ -102,18 +107,15 @@ struct D3D11Device : ID3D11Device3
 	virtual void STDMETHODCALLTYPE ReadFromSubresource(void *pDstData, UINT DstRowPitch, UINT DstDepthPitch, ID3D11Resource *pSrcResource, UINT SrcSubresource, const D3D11_BOX *pSrcBox) override;
 	#pragma endregion
 
-	void add_commandlist_trackers(ID3D11CommandList* command_list, const reshade::d3d11::draw_call_tracker &tracker_source);
-	void merge_commandlist_trackers(ID3D11CommandList* command_list, reshade::d3d11::draw_call_tracker &tracker_destination);
-
 	void clear_drawcall_stats();
 
 	LONG _ref = 1;
 	ID3D11Device *_orig;
+	std::unique_ptr<hook_gw2_d3d11> _redirect;
 	unsigned int _interface_version;
 	struct DXGIDevice *_dxgi_device = nullptr;
 	D3D11DeviceContext *_immediate_context = nullptr;
 	std::vector<std::shared_ptr<reshade::d3d11::d3d11_runtime>> _runtimes;
-	std::unordered_map<ID3D11CommandList *, reshade::d3d11::draw_call_tracker> _trackers_per_commandlist;
-	std::mutex _trackers_per_commandlist_mutex;
 	unsigned int _clear_DSV_iter = 1;
+	unsigned int _clear_DSV_count = 0;
 };
@@ -7,6 +7,74 @@
 #include "d3d11_device.hpp"
 #include "d3d11_device_context.hpp"
 
+// Statistics of a command list, attached to it as private data, so they are released together with it and recording threads never share anything but the pool
+struct __declspec(uuid("6A4C1F0E-93B2-4E57-A1D8-2F7C5B9E3D64")) commandlist_tracker final : IUnknown
+{
+	SLIST_ENTRY pool_entry;
+	LONG ref = 1;
+	reshade::d3d11::draw_call_tracker tracker;
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppvObj) override
+	{
+		if (ppvObj == nullptr)
+		{
+			return E_POINTER;
+		}
+
+		if (riid != __uuidof(IUnknown) && riid != __uuidof(commandlist_tracker))
+		{
+			*ppvObj = nullptr;
+			return E_NOINTERFACE;
+		}
+
+		AddRef();
+		*ppvObj = this;
+
+		return S_OK;
+	}
+	ULONG STDMETHODCALLTYPE AddRef() override
+	{
+		return InterlockedIncrement(&ref);
+	}
+	ULONG STDMETHODCALLTYPE Release() override;
+};
+
+// Trackers are handed back once their command list was destroyed, a lock-free list is enough for that, since entries are only ever pushed and popped whole
+static struct commandlist_tracker_pool
+{
+	commandlist_tracker_pool() { InitializeSListHead(&head); }
+
+	SLIST_HEADER head;
+} s_commandlist_tracker_pool;
+
+ULONG STDMETHODCALLTYPE commandlist_tracker::Release()
+{
+	const ULONG refcount = InterlockedDecrement(&ref);
+
+	if (refcount == 0)
+	{
+		// Keep the memory of the tracker for the next command list
+		tracker.reset();
+
+		InterlockedPushEntrySList(&s_commandlist_tracker_pool.head, &pool_entry);
+	}
+
+	return refcount;
+}
+
+static commandlist_tracker *acquire_commandlist_tracker()
+{
+	if (const auto entry = InterlockedPopEntrySList(&s_commandlist_tracker_pool.head))
+	{
+		commandlist_tracker *const tracker = CONTAINING_RECORD(entry, commandlist_tracker, pool_entry);
+		tracker->ref = 1;
+
+		return tracker;
+	}
+
+	return new commandlist_tracker();
+}
+
 void D3D11DeviceContext::clear_drawcall_stats()
 {
 	_draw_call_tracker.reset();
@@ -23,6 +91,11 @@ bool D3D11DeviceContext::save_depth_texture(ID3D11DepthStencilView *pDepthStenci
 
 	if (!runtime->depth_buffer_before_clear)
 		return false;
+
+	// Count every clear, so the count stays comparable between frames whatever the checks below reject
+	if (cleared)
+		_device->_clear_DSV_count++;
+
 	if (!cleared && !runtime->extended_depth_buffer_detection)
 		return false;
 
@@ -55,8 +128,12 @@ bool D3D11DeviceContext::save_depth_texture(ID3D11DepthStencilView *pDepthStenci
 		return false;
 	}	
 
+	// Only the clear that is eventually selected needs a copy, and copies of the same shape all go to the same texture, so skip what comes before the clear selected in the last frame.
+	// This compares the clears counted in this frame, since the number of other depth stencil bindings between them can change from frame to frame. If this frame has fewer clears than the last one, no copy is made and the next frame copies everything again.
+	const bool is_before_last_selected = _device->_clear_DSV_count < runtime->last_depth_buffer_clear_count;
+
 	// In case the depth texture is retrieved, we make a copy of it and store it in an ordered map to use it later in the final rendering stage.
-	if ((runtime->cleared_depth_buffer_index == 0 && cleared) || (_device->_clear_DSV_iter <= runtime->cleared_depth_buffer_index))
+	if (!is_before_last_selected && ((runtime->cleared_depth_buffer_index == 0 && cleared) || (_device->_clear_DSV_iter <= runtime->cleared_depth_buffer_index)))
 	{
 		// Select an appropriate destination texture
 		com_ptr<ID3D11Texture2D> depth_texture_save = runtime->select_depth_texture_save(desc);
@@ -71,13 +148,13 @@ bool D3D11DeviceContext::save_depth_texture(ID3D11DepthStencilView *pDepthStenci
 		this->CopyResource(depth_texture_save.get(), texture.get());
 
 		// Store the saved texture in the ordered map.
-		_draw_call_tracker.track_depth_texture(runtime->depth_buffer_texture_format, _device->_clear_DSV_iter, texture.get(), pDepthStencilView, depth_texture_save, cleared);
+		_draw_call_tracker.track_depth_texture(runtime->depth_buffer_texture_format, _device->_clear_DSV_iter, _device->_clear_DSV_count, texture.get(), pDepthStencilView, depth_texture_save, cleared);
 	}
 	else
 	{
 		// Store a null depth texture in the ordered map in order to display it even if the user chose a previous cleared texture.
 		// This way the texture will still be visible in the depth buffer selection window and the user can choose it.
-		_draw_call_tracker.track_depth_texture(runtime->depth_buffer_texture_format, _device->_clear_DSV_iter, texture.get(), pDepthStencilView, nullptr, cleared);
+		_draw_call_tracker.track_depth_texture(runtime->depth_buffer_texture_format, _device->_clear_DSV_iter, _device->_clear_DSV_count, texture.get(), pDepthStencilView, nullptr, cleared);
 	}
 
 	// TODO: This is unsafe if multiple device contexts are used on multiple threads
@@ -254,7 +331,15 @@ void STDMETHODCALLTYPE D3D11DeviceContext::PSSetShaderResources(UINT StartSlot,
 }
 void STDMETHODCALLTYPE D3D11DeviceContext::PSSetShader(ID3D11PixelShader *pPixelShader, ID3D11ClassInstance *const *ppClassInstances, UINT NumClassInstances)
 {
+	// Effects are applied before the injection shader is bound, so its draw and everything after it is not affected
+	if (this == _device->_immediate_context)
+	{
+		_device->_redirect->OnSetPixelShader(pPixelShader);
+	}
+
 	_orig->PSSetShader(pPixelShader, ppClassInstances, NumClassInstances);
+
+	_device->_redirect->BindFogConstants(_orig, this == _device->_immediate_context, pPixelShader);
 }
 void STDMETHODCALLTYPE D3D11DeviceContext::PSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState *const *ppSamplers)
 {
@@ -262,6 +347,11 @@ void STDMETHODCALLTYPE D3D11DeviceContext::PSSetSamplers(UINT StartSlot, UINT Nu
 }
 void STDMETHODCALLTYPE D3D11DeviceContext::VSSetShader(ID3D11VertexShader *pVertexShader, ID3D11ClassInstance *const *ppClassInstances, UINT NumClassInstances)
 {
+	if (this == _device->_immediate_context)
+	{
+		_device->_redirect->OnSetVertexShader(pVertexShader);
+	}
+
 	_orig->VSSetShader(pVertexShader, ppClassInstances, NumClassInstances);
 }
 void STDMETHODCALLTYPE D3D11DeviceContext::DrawIndexed(UINT IndexCount, UINT StartIndexLocation, INT BaseVertexLocation)
@@ -289,6 +379,11 @@ void STDMETHODCALLTYPE D3D11DeviceContext::Unmap(ID3D11Resource *pResource, UINT
 void STDMETHODCALLTYPE D3D11DeviceContext::PSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
 {
 	_orig->PSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+
+	if (this == _device->_immediate_context)
+	{
+		_device->_redirect->OnSetPixelShaderConstantBuffers(StartSlot, NumBuffers);
+	}
 }
 void STDMETHODCALLTYPE D3D11DeviceContext::IASetInputLayout(ID3D11InputLayout *pInputLayout)
 {
@@ -472,10 +567,24 @@ void STDMETHODCALLTYPE D3D11DeviceContext::ExecuteCommandList(ID3D11CommandList
 {
 	if (pCommandList != nullptr)
 	{
-		_device->merge_commandlist_trackers(pCommandList, _draw_call_tracker);
+		IUnknown *data = nullptr;
+		UINT data_size = sizeof(data);
+
+		if (SUCCEEDED(pCommandList->GetPrivateData(__uuidof(commandlist_tracker), &data_size, &data)) && data != nullptr)
+		{
+			_draw_call_tracker.merge(static_cast<commandlist_tracker *>(data)->tracker);
+
+			data->Release();
+		}
 	}
 
 	_orig->ExecuteCommandList(pCommandList, RestoreContextState);
+
+	// Executing a command list clears the state of the immediate context unless it is restored afterwards
+	if (!RestoreContextState && this == _device->_immediate_context)
+	{
+		_device->_redirect->InvalidateFogConstants();
+	}
 }
 void STDMETHODCALLTYPE D3D11DeviceContext::HSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView *const *ppShaderResourceViews)
 {
@@ -684,6 +793,11 @@ void STDMETHODCALLTYPE D3D11DeviceContext::CSGetConstantBuffers(UINT StartSlot,
 void STDMETHODCALLTYPE D3D11DeviceContext::ClearState()
 {
 	_orig->ClearState();
+
+	if (this == _device->_immediate_context)
+	{
+		_device->_redirect->InvalidateFogConstants();
+	}
 }
 void STDMETHODCALLTYPE D3D11DeviceContext::Flush()
 {
@@ -699,7 +813,14 @@ HRESULT STDMETHODCALLTYPE D3D11DeviceContext::FinishCommandList(BOOL RestoreDefe
 
 	if (SUCCEEDED(hr) && ppCommandList != nullptr)
 	{
-		_device->add_commandlist_trackers(*ppCommandList, _draw_call_tracker);
+		commandlist_tracker *const tracker = acquire_commandlist_tracker();
+
+		// Hand the recorded statistics over to the command list, this context continues with the empty tracker from the pool
+		std::swap(tracker->tracker, _draw_call_tracker);
+
+		(*ppCommandList)->SetPrivateDataInterface(__uuidof(commandlist_tracker), tracker);
+
+		tracker->Release();
 	}
 
 	_draw_call_tracker.reset();
@@ -765,6 +886,11 @@ void STDMETHODCALLTYPE D3D11DeviceContext::PSSetConstantBuffers1(UINT StartSlot,
 	assert(_interface_version >= 1);
 
 	static_cast<ID3D11DeviceContext1 *>(_orig)->PSSetConstantBuffers1(StartSlot, NumBuffers, ppConstantBuffers, pFirstConstant, pNumConstants);
+
+	if (this == _device->_immediate_context)
+	{
+		_device->_redirect->OnSetPixelShaderConstantBuffers(StartSlot, NumBuffers);
+	}
 }
 void STDMETHODCALLTYPE D3D11DeviceContext::CSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers, const UINT *pFirstConstant, const UINT *pNumConstants)
 {
@@ -5,12 +5,20 @@
 
 #include "d3d11_runtime.hpp"
 #include "d3d11_effect_compiler.hpp"
+#include "effect_precision.hpp"
+#include "effect_reachability.hpp"
+#include "gpu_marker.hpp"
+#include "shader_cache.hpp"
 #include <assert.h>
-#include <iomanip>
 #include <fstream>
 #include <algorithm>
 #include <d3dcompiler.h>
 
+namespace reshadefx
+{
+	void scalar_literal_cast(const nodes::literal_expression_node *from, size_t i, float &to);
+}
+
 namespace reshade::d3d11
 {
 	using namespace reshadefx;
@@ -192,11 +200,12 @@ namespace reshade::d3d11
 		}
 	}
 
-	d3d11_effect_compiler::d3d11_effect_compiler(d3d11_runtime *runtime, const syntax_tree &ast, std::string &errors, bool skipoptimization) :
+	d3d11_effect_compiler::d3d11_effect_compiler(d3d11_runtime *runtime, const syntax_tree &ast, std::string &errors, bool skipoptimization, bool halfprecision) :
 		_runtime(runtime),
 		_ast(ast),
 		_errors(errors),
-		_skip_shader_optimization(skipoptimization)
+		_skip_shader_optimization(skipoptimization),
+		_half_precision(halfprecision)
 	{
 #if RESHADE_DUMP_NATIVE_SHADERS
 		if (_ast.techniques.size() == 0)
@@ -208,28 +217,35 @@ namespace reshade::d3d11
 #endif
 	}
 
-	bool d3d11_effect_compiler::run()
+	bool d3d11_effect_compiler::compile()
 	{
+		_is_compiled = true;
+
 		_d3dcompiler_module = LoadLibraryW(L"d3dcompiler_47.dll");
 
 		if (_d3dcompiler_module == nullptr)
 		{
 			_d3dcompiler_module = LoadLibraryW(L"d3dcompiler_43.dll");
 		}
+		else
+		{
+			// Older versions of the compiler do not know the minimum precision types
+			collect_half_precision_variables();
+		}
 		if (_d3dcompiler_module == nullptr)
 		{
 			_errors += "Unable to load D3DCompiler library. Make sure you have the DirectX end-user runtime (June 2010) installed or a newer version of the library in the application directory.\n";
-			return false;
+			return _success = false;
 		}
 
-		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
-
 		for (auto node : _ast.structs)
 		{
 			visit(_global_code, node);
 		}
 		for (auto uniform : _ast.variables)
 		{
+			const auto code_begin = _global_code.size();
+
 			if (uniform->type.is_texture())
 			{
 				visit_texture(uniform);
@@ -238,6 +254,10 @@ namespace reshade::d3d11
 			{
 				visit_sampler(uniform);
 			}
+			else if (uniform->type.is_storage())
+			{
+				visit_storage(uniform);
+			}
 			else if (uniform->type.has_qualifier(type_node::qualifier_uniform))
 			{
 				visit_uniform(uniform);
@@ -248,21 +268,98 @@ namespace reshade::d3d11
 
 				_global_code << ";\n";
 			}
+
+			_global_declarations.push_back({ uniform, code_begin, _global_code.size() });
 		}
 		for (auto function : _ast.functions)
 		{
+			const auto code_begin = _global_code.size();
+
 			visit(_global_code, function);
+
+			_global_declarations.push_back({ function, code_begin, _global_code.size() });
 		}
 		for (auto technique : _ast.techniques)
 		{
-			visit_technique(technique);
+			for (auto pass : technique->pass_list)
+			{
+				compile_pass(pass);
+			}
 		}
 
 		if (_constant_buffer_size != 0)
 		{
 			_constant_buffer_size = roundto16(_constant_buffer_size);
-			_runtime->get_uniform_value_storage().resize(_uniform_storage_offset + _constant_buffer_size);
+			_uniform_data.resize(_constant_buffer_size);
+		}
+
+		FreeLibrary(_d3dcompiler_module);
+
+		return _success;
+	}
+	bool d3d11_effect_compiler::run()
+	{
+		if (!_is_compiled)
+		{
+			compile();
+		}
+		if (!_success)
+		{
+			return false;
+		}
+
+		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
+
+		_shader_resources.resize(_shader_resource_count);
+		_shader_resources[0] = _runtime->_backbuffer_texture_srv[0];
+		_shader_resources[1] = _runtime->_backbuffer_texture_srv[1];
+		_shader_resources[2] = _runtime->_depthstencil_texture_srv;
+		_sampler_states.resize(_sampler_descs.size());
+		_unordered_access_views.resize(_storage_textures.size());
+
+		for (auto variable : _ast.variables)
+		{
+			if (variable->type.is_texture())
+			{
+				create_texture(variable);
+			}
+			else if (variable->type.is_sampler())
+			{
+				create_sampler(variable);
+			}
+			else if (variable->type.is_storage())
+			{
+				create_storage(variable);
+			}
+		}
+
+		if (!_success)
+		{
+			return false;
+		}
+
+		for (auto &obj : _uniforms)
+		{
+			obj.storage_offset += _uniform_storage_offset;
+
+			_runtime->add_uniform(std::move(obj));
+		}
+
+		if (_constant_buffer_size != 0)
+		{
+			auto &uniform_storage = _runtime->get_uniform_value_storage();
+			uniform_storage.resize(_uniform_storage_offset + _constant_buffer_size);
 
+			CopyMemory(uniform_storage.data() + _uniform_storage_offset, _uniform_data.data(), _constant_buffer_size);
+		}
+
+		for (auto technique : _ast.techniques)
+		{
+			visit_technique(technique);
+		}
+
+		if (_constant_buffer_size != 0)
+		{
 			const CD3D11_BUFFER_DESC globals_desc(static_cast<UINT>(_constant_buffer_size), D3D11_BIND_CONSTANT_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
 			const D3D11_SUBRESOURCE_DATA globals_initial = { _runtime->get_uniform_value_storage().data() + _uniform_storage_offset, static_cast<UINT>(_constant_buffer_size) };
 
@@ -272,11 +369,70 @@ namespace reshade::d3d11
 			_runtime->_constant_buffers.push_back(std::move(constant_buffer));
 		}
 
-		FreeLibrary(_d3dcompiler_module);
+		// The state block saves and restores as many slots as the largest effect binds
+		_runtime->_effect_shader_resource_count = std::max(_runtime->_effect_shader_resource_count, _shader_resources.size());
+		_runtime->_effect_sampler_count = std::max(_runtime->_effect_sampler_count, _sampler_states.size());
 
 		return _success;
 	}
 
+	void d3d11_effect_compiler::collect_half_precision_variables()
+	{
+		D3D11_FEATURE_DATA_SHADER_MIN_PRECISION_SUPPORT precision_support = { };
+
+		// Drivers that do not support 16-bit precision compute everything at full precision anyway, so there is nothing to gain
+		if (FAILED(_runtime->_device->CheckFeatureSupport(D3D11_FEATURE_SHADER_MIN_PRECISION_SUPPORT, &precision_support, sizeof(precision_support))) ||
+			(precision_support.PixelShaderMinPrecision & D3D11_SHADER_MIN_PRECISION_16_BIT) == 0)
+		{
+			return;
+		}
+
+		std::unordered_set<const function_declaration_node *> tolerant, intolerant;
+
+		for (auto technique : _ast.techniques)
+		{
+			bool is_tolerant = _half_precision;
+
+			// Techniques can opt in or out with an annotation, regardless of the global setting
+			if (const auto it = technique->annotation_list.find("half_precision"); it != technique->annotation_list.end())
+			{
+				is_tolerant = it->second.as<bool>();
+			}
+
+			for (auto pass : technique->pass_list)
+			{
+				reachable_declarations reachable;
+
+				// Vertex shaders compute positions and texture coordinates, which are never precise enough at reduced precision
+				if (pass->vertex_shader != nullptr)
+				{
+					find_reachable_declarations(pass->vertex_shader, reachable);
+					intolerant.insert(reachable.functions.begin(), reachable.functions.end());
+					reachable.functions.clear();
+				}
+
+				if (pass->pixel_shader != nullptr)
+				{
+					find_reachable_declarations(pass->pixel_shader, reachable);
+				}
+				if (pass->compute_shader != nullptr)
+				{
+					find_reachable_declarations(pass->compute_shader, reachable);
+				}
+
+				(is_tolerant ? tolerant : intolerant).insert(reachable.functions.begin(), reachable.functions.end());
+			}
+		}
+
+		// Functions are only generated once for all shaders, so a function has to keep full precision if any shader that reaches it does
+		for (auto function : intolerant)
+		{
+			tolerant.erase(function);
+		}
+
+		reshadefx::find_half_precision_variables(_ast, tolerant, _half_precision_variables);
+	}
+
 	void d3d11_effect_compiler::error(const location &location, const std::string &message)
 	{
 		_success = false;
@@ -288,7 +444,7 @@ namespace reshade::d3d11
 		_errors += location.source + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): warning: " + message + '\n';
 	}
 
-	void d3d11_effect_compiler::visit(std::stringstream &output, const statement_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const statement_node *node)
 	{
 		if (node == nullptr)
 		{
@@ -328,7 +484,7 @@ namespace reshade::d3d11
 				assert(false);
 		}
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const expression_node *node)
 	{
 		assert(node != nullptr);
 
@@ -378,7 +534,7 @@ namespace reshade::d3d11
 		}
 	}
 
-	void d3d11_effect_compiler::visit(std::stringstream &output, const type_node &type, bool with_qualifiers)
+	void d3d11_effect_compiler::visit(code_buffer &output, const type_node &type, bool with_qualifiers)
 	{
 		if (with_qualifiers)
 		{
@@ -390,6 +546,8 @@ namespace reshade::d3d11
 				output << "volatile ";
 			if (type.has_qualifier(type_node::qualifier_precise))
 				output << "precise ";
+			if (type.has_qualifier(type_node::qualifier_groupshared))
+				output << "groupshared ";
 			if (type.has_qualifier(type_node::qualifier_linear))
 				output << "linear ";
 			if (type.has_qualifier(type_node::qualifier_noperspective))
@@ -423,11 +581,14 @@ namespace reshade::d3d11
 				output << "uint";
 				break;
 			case type_node::datatype_float:
-				output << "float";
+				output << (_is_half_precision_type ? "min16float" : "float");
 				break;
 			case type_node::datatype_sampler:
 				output << "__sampler2D";
 				break;
+			case type_node::datatype_storage:
+				output << "RWTexture2D<float4>";
+				break;
 			case type_node::datatype_struct:
 				output << type.definition->unique_name;
 				break;
@@ -442,11 +603,11 @@ namespace reshade::d3d11
 			output << type.rows;
 		}
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const lvalue_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const lvalue_expression_node *node)
 	{
 		output << node->reference->unique_name;
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const literal_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const literal_expression_node *node)
 	{
 		if (!node->type.is_scalar())
 		{
@@ -469,7 +630,7 @@ namespace reshade::d3d11
 					output << node->value_uint[i];
 					break;
 				case type_node::datatype_float:
-					output << std::setprecision(8) << std::fixed << node->value_float[i];
+					output << node->value_float[i];
 					break;
 			}
 
@@ -484,7 +645,7 @@ namespace reshade::d3d11
 			output << ')';
 		}
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const expression_sequence_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const expression_sequence_node *node)
 	{
 		output << '(';
 
@@ -500,7 +661,7 @@ namespace reshade::d3d11
 
 		output << ')';
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const unary_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const unary_expression_node *node)
 	{
 		switch (node->op)
 		{
@@ -540,7 +701,7 @@ namespace reshade::d3d11
 				break;
 		}
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const binary_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const binary_expression_node *node)
 	{
 		std::string part1, part2, part3;
 
@@ -648,7 +809,7 @@ namespace reshade::d3d11
 		visit(output, node->operands[1]);
 		output << part3;
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const intrinsic_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const intrinsic_expression_node *node)
 	{
 		std::string part1, part2, part3, part4, part5;
 
@@ -699,6 +860,9 @@ namespace reshade::d3d11
 				part2 = ", ";
 				part3 = ")";
 				break;
+			case intrinsic_expression_node::barrier:
+				part1 = "GroupMemoryBarrierWithGroupSync()";
+				break;
 			case intrinsic_expression_node::ceil:
 				part1 = "ceil(";
 				part2 = ")";
@@ -999,6 +1163,12 @@ namespace reshade::d3d11
 				part2 = ", ";
 				part3 = ")";
 				break;
+			case intrinsic_expression_node::texture_store:
+				part1 = "(";
+				part2 = "[";
+				part3 = "] = ";
+				part4 = ")";
+				break;
 			case intrinsic_expression_node::transpose:
 				part1 = "transpose(";
 				part2 = ")";
@@ -1039,7 +1209,7 @@ namespace reshade::d3d11
 
 		output << part5;
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const conditional_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const conditional_expression_node *node)
 	{
 		output << '(';
 		visit(output, node->condition);
@@ -1049,7 +1219,7 @@ namespace reshade::d3d11
 		visit(output, node->expression_when_false);
 		output << ')';
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const swizzle_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const swizzle_expression_node *node)
 	{
 		visit(output, node->operand);
 
@@ -1081,7 +1251,7 @@ namespace reshade::d3d11
 			}
 		}
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const field_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const field_expression_node *node)
 	{
 		output << '(';
 
@@ -1089,7 +1259,7 @@ namespace reshade::d3d11
 
 		output << '.' << node->field_reference->unique_name << ')';
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const assignment_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const assignment_expression_node *node)
 	{
 		output << '(';
 		visit(output, node->left);
@@ -1136,7 +1306,7 @@ namespace reshade::d3d11
 		visit(output, node->right);
 		output << ')';
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const call_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const call_expression_node *node)
 	{
 		output << node->callee->unique_name << '(';
 
@@ -1152,7 +1322,7 @@ namespace reshade::d3d11
 
 		output << ')';
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const constructor_expression_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const constructor_expression_node *node)
 	{
 		visit(output, node->type, false);
 
@@ -1170,7 +1340,7 @@ namespace reshade::d3d11
 
 		output << ')';
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const initializer_list_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const initializer_list_node *node)
 	{
 		output << "{ ";
 
@@ -1186,7 +1356,7 @@ namespace reshade::d3d11
 
 		output << " }";
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const compound_statement_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const compound_statement_node *node)
 	{
 		output << "{\n";
 
@@ -1197,7 +1367,7 @@ namespace reshade::d3d11
 
 		output << "}\n";
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const declarator_list_node *node, bool single_statement)
+	void d3d11_effect_compiler::visit(code_buffer &output, const declarator_list_node *node, bool single_statement)
 	{
 		bool with_type = true;
 
@@ -1217,14 +1387,34 @@ namespace reshade::d3d11
 
 		output << ";\n";
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const expression_statement_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const expression_statement_node *node)
 	{
 		visit(output, node->expression);
 
 		output << ";\n";
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const if_statement_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const if_statement_node *node)
 	{
+		// Conditions that were folded into a constant, like uniforms baked in performance mode, only need the branch that is taken, so the shader compiler has less code to go through
+		if (node->condition->id == nodeid::literal_expression && node->condition->type.is_scalar())
+		{
+			float condition;
+			scalar_literal_cast(static_cast<const literal_expression_node *>(node->condition), 0, condition);
+
+			const auto statement = condition != 0 ? node->statement_when_true : node->statement_when_false;
+
+			if (statement != nullptr)
+			{
+				visit(output, statement);
+			}
+			else
+			{
+				output << "\t;";
+			}
+
+			return;
+		}
+
 		for (const auto &attribute : node->attributes)
 		{
 			output << '[' << attribute << ']';
@@ -1250,7 +1440,7 @@ namespace reshade::d3d11
 			visit(output, node->statement_when_false);
 		}
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const switch_statement_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const switch_statement_node *node)
 	{
 		for (const auto &attribute : node->attributes)
 		{
@@ -1268,7 +1458,7 @@ namespace reshade::d3d11
 
 		output << "}\n";
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const case_statement_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const case_statement_node *node)
 	{
 		for (auto label : node->labels)
 		{
@@ -1288,7 +1478,7 @@ namespace reshade::d3d11
 
 		visit(output, node->statement_list);
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const for_statement_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const for_statement_node *node)
 	{
 		for (const auto &attribute : node->attributes)
 		{
@@ -1303,7 +1493,7 @@ namespace reshade::d3d11
 			{
 				visit(output, static_cast<declarator_list_node *>(node->init_statement), true);
 
-				output.seekp(-2, std::ios_base::end);
+				output.pop_back(2);
 			}
 			else
 			{
@@ -1336,7 +1526,7 @@ namespace reshade::d3d11
 			output << "\t;";
 		}
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const while_statement_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const while_statement_node *node)
 	{
 		for (const auto &attribute : node->attributes)
 		{
@@ -1372,7 +1562,7 @@ namespace reshade::d3d11
 			}
 		}
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const return_statement_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const return_statement_node *node)
 	{
 		if (node->is_discard)
 		{
@@ -1392,7 +1582,7 @@ namespace reshade::d3d11
 
 		output << ";\n";
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const jump_statement_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const jump_statement_node *node)
 	{
 		if (node->is_break)
 		{
@@ -1403,7 +1593,7 @@ namespace reshade::d3d11
 			output << "continue;\n";
 		}
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const struct_declaration_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const struct_declaration_node *node)
 	{
 		output << "struct " << node->unique_name << "\n{\n";
 
@@ -1421,12 +1611,16 @@ namespace reshade::d3d11
 
 		output << "};\n";
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const variable_declaration_node *node, bool with_type)
+	void d3d11_effect_compiler::visit(code_buffer &output, const variable_declaration_node *node, bool with_type)
 	{
 		if (with_type)
 		{
+			_is_half_precision_type = _half_precision_variables.count(node) != 0;
+
 			visit(output, node->type);
 
+			_is_half_precision_type = false;
+
 			output << ' ';
 		}
 
@@ -1464,7 +1658,7 @@ namespace reshade::d3d11
 			output << ";\n";
 		}
 	}
-	void d3d11_effect_compiler::visit(std::stringstream &output, const function_declaration_node *node)
+	void d3d11_effect_compiler::visit(code_buffer &output, const function_declaration_node *node)
 	{
 		visit(output, node->return_type, false);
 
@@ -1504,144 +1698,32 @@ namespace reshade::d3d11
 	{
 		size_t texture_register_index, texture_register_index_srgb;
 
-		const auto existing_texture = _runtime->find_texture(node->unique_name);
-
-		if (existing_texture != nullptr)
+		if (node->semantic == "COLOR" || node->semantic == "SV_TARGET")
 		{
-			if (node->semantic == "COLOR" || node->semantic == "SV_TARGET")
-			{
-				texture_register_index = 0;
-				texture_register_index_srgb = 1;
-			}
-			else if (node->semantic == "DEPTH" || node->semantic == "SV_DEPTH")
-			{
-				texture_register_index = 2;
-				texture_register_index_srgb = 2;
-			}
-			else if (!node->semantic.empty())
-			{
-				error(node->location, "invalid semantic");
-				return;
-			}
-			else
-			{
-				if (existing_texture->width != node->properties.width ||
-					existing_texture->height != node->properties.height ||
-					existing_texture->levels != node->properties.levels ||
-					existing_texture->format != node->properties.format)
-				{
-					error(node->location, existing_texture->effect_filename + " already created a texture with the same name but different dimensions; textures are shared across all effects, so either rename the variable or adjust the dimensions so they match");
-					return;
-				}
-
-				const auto obj_data = existing_texture->impl->as<d3d11_tex_data>();
-
-				texture_register_index = std::distance(_runtime->_effect_shader_resources.begin(), std::find(_runtime->_effect_shader_resources.begin(), _runtime->_effect_shader_resources.end(), obj_data->srv[0]));
-
-				if (obj_data->srv[1] != nullptr)
-				{
-					texture_register_index_srgb = std::distance(_runtime->_effect_shader_resources.begin(), std::find(_runtime->_effect_shader_resources.begin(), _runtime->_effect_shader_resources.end(), obj_data->srv[1]));
-				}
-				else
-				{
-					texture_register_index_srgb = texture_register_index;
-				}
-			}
+			texture_register_index = 0;
+			texture_register_index_srgb = 1;
+		}
+		else if (node->semantic == "DEPTH" || node->semantic == "SV_DEPTH")
+		{
+			texture_register_index = 2;
+			texture_register_index_srgb = 2;
+		}
+		else if (!node->semantic.empty())
+		{
+			error(node->location, "invalid semantic");
+			return;
 		}
 		else
 		{
-			texture obj;
-			D3D11_TEXTURE2D_DESC texdesc = { };
-			obj.name = node->name;
-			obj.unique_name = node->unique_name;
-			obj.annotations = node->annotation_list;
-			texdesc.Width = obj.width = node->properties.width;
-			texdesc.Height = obj.height = node->properties.height;
-			texdesc.MipLevels = obj.levels = node->properties.levels;
-			texdesc.ArraySize = 1;
-			texdesc.Format = literal_to_format(obj.format = node->properties.format);
-			texdesc.SampleDesc.Count = 1;
-			texdesc.SampleDesc.Quality = 0;
-			texdesc.Usage = D3D11_USAGE_DEFAULT;
-			texdesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
-			texdesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
-
-			if (node->semantic == "COLOR" || node->semantic == "SV_TARGET")
-			{
-				obj.width = _runtime->frame_width();
-				obj.height = _runtime->frame_height();
-				obj.impl_reference = texture_reference::back_buffer;
-
-				texture_register_index = 0;
-				texture_register_index_srgb = 1;
-			}
-			else if (node->semantic == "DEPTH" || node->semantic == "SV_DEPTH")
-			{
-				obj.width = _runtime->frame_width();
-				obj.height = _runtime->frame_height();
-				obj.impl_reference = texture_reference::depth_buffer;
-
-				texture_register_index = 2;
-				texture_register_index_srgb = 2;
-			}
-			else if (!node->semantic.empty())
-			{
-				error(node->location, "invalid semantic");
-				return;
-			}
-			else
-			{
-				obj.impl = std::make_unique<d3d11_tex_data>();
-				const auto obj_data = obj.impl->as<d3d11_tex_data>();
-
-				HRESULT hr = _runtime->_device->CreateTexture2D(&texdesc, nullptr, &obj_data->texture);
-
-				if (FAILED(hr))
-				{
-					error(node->location, "'ID3D11Device::CreateTexture2D' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-					return;
-				}
-
-				D3D11_SHADER_RESOURCE_VIEW_DESC srvdesc = { };
-				srvdesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-				srvdesc.Texture2D.MipLevels = texdesc.MipLevels;
-				srvdesc.Format = make_format_normal(texdesc.Format);
-
-				hr = _runtime->_device->CreateShaderResourceView(obj_data->texture.get(), &srvdesc, &obj_data->srv[0]);
-
-				if (FAILED(hr))
-				{
-					error(node->location, "'ID3D11Device::CreateShaderResourceView' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-					return;
-				}
-
-				srvdesc.Format = make_format_srgb(texdesc.Format);
-
-				texture_register_index = _runtime->_effect_shader_resources.size();
-				_runtime->_effect_shader_resources.push_back(obj_data->srv[0]);
-
-				if (srvdesc.Format != texdesc.Format)
-				{
-					hr = _runtime->_device->CreateShaderResourceView(obj_data->texture.get(), &srvdesc, &obj_data->srv[1]);
-
-					if (FAILED(hr))
-					{
-						error(node->location, "'ID3D11Device::CreateShaderResourceView' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-						return;
-					}
+			// Whether the texture is created here or shared with an effect loaded before is only known on the render thread, but both have the same views, since the format has to match
+			const DXGI_FORMAT format = literal_to_format(node->properties.format);
 
-					texture_register_index_srgb = _runtime->_effect_shader_resources.size();
-					_runtime->_effect_shader_resources.push_back(obj_data->srv[1]);
-				}
-				else
-				{
-					texture_register_index_srgb = texture_register_index;
-				}
-			}
-
-			_runtime->add_texture(std::move(obj));
+			texture_register_index = _shader_resource_count++;
+			texture_register_index_srgb = make_format_srgb(format) != format ? _shader_resource_count++ : texture_register_index;
 		}
 
+		_texture_registers[node] = { texture_register_index, texture_register_index_srgb };
+
 		_global_code << "Texture2D " <<
 			node->unique_name << " : register(t" << texture_register_index << "), __" <<
 			node->unique_name << "SRGB : register(t" << texture_register_index_srgb << ");\n";
@@ -1659,35 +1741,15 @@ namespace reshade::d3d11
 		desc.MinLOD = node->properties.min_lod;
 		desc.MaxLOD = node->properties.max_lod;
 
-		const auto texture = _runtime->find_texture(node->properties.texture->unique_name);
+		const auto it = std::find_if(_sampler_descs.begin(), _sampler_descs.end(), [&desc](const D3D11_SAMPLER_DESC &existing) { return std::memcmp(&existing, &desc, sizeof(desc)) == 0; });
+		const size_t register_index = std::distance(_sampler_descs.begin(), it);
 
-		if (texture == nullptr)
+		if (it == _sampler_descs.end())
 		{
-			error(node->location, "texture '" + node->properties.texture->name + "' for sampler '" + node->name + "' is missing due to previous error");
-			return;
+			_sampler_descs.push_back(desc);
 		}
 
-		size_t desc_hash = 2166136261;
-		for (size_t i = 0; i < sizeof(desc); ++i)
-			desc_hash = (desc_hash * 16777619) ^ reinterpret_cast<const uint8_t *>(&desc)[i];
-
-		auto it = _runtime->_effect_sampler_descs.find(desc_hash);
-
-		if (it == _runtime->_effect_sampler_descs.end())
-		{
-			com_ptr<ID3D11SamplerState> sampler;
-
-			HRESULT hr = _runtime->_device->CreateSamplerState(&desc, &sampler);
-
-			if (FAILED(hr))
-			{
-				error(node->location, "'ID3D11Device::CreateSamplerState' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-				return;
-			}
-
-			_runtime->_effect_sampler_states.push_back(std::move(sampler));
-			it = _runtime->_effect_sampler_descs.emplace(desc_hash, _runtime->_effect_sampler_states.size() - 1).first;
-		}
+		_sampler_registers[node] = register_index;
 
 		_global_code << "static const __sampler2D " << node->unique_name << " = { ";
 
@@ -1700,7 +1762,26 @@ namespace reshade::d3d11
 			_global_code << node->properties.texture->unique_name;
 		}
 
-		_global_code << ", __SamplerState" << it->second << " };\n";
+		_global_code << ", __SamplerState" << register_index << " };\n";
+	}
+	void d3d11_effect_compiler::visit_storage(const variable_declaration_node *node)
+	{
+		// Several storage objects for the same texture share a slot
+		const auto it = std::find(_storage_textures.begin(), _storage_textures.end(), node->properties.texture);
+		const size_t register_index = std::distance(_storage_textures.begin(), it);
+
+		if (it == _storage_textures.end())
+		{
+			if (_storage_textures.size() >= D3D11_PS_CS_UAV_REGISTER_COUNT)
+			{
+				error(node->location, "too many storage textures, an effect can write to at most " + std::to_string(D3D11_PS_CS_UAV_REGISTER_COUNT));
+				return;
+			}
+
+			_storage_textures.push_back(node->properties.texture);
+		}
+
+		_global_code << "RWTexture2D<float4> " << node->unique_name << " : register(u" << register_index << ");\n";
 	}
 	void d3d11_effect_compiler::visit_uniform(const variable_declaration_node *node)
 	{
@@ -1730,77 +1811,486 @@ namespace reshade::d3d11
 		obj.columns = node->type.cols;
 		obj.elements = node->type.array_length;
 		obj.storage_size = node->type.rows * node->type.cols * std::max(1u, obj.elements) * 4;
-		obj.annotations = node->annotation_list;
+		copy_annotations(node->annotation_list, obj.annotations);
 
 		const UINT alignment = 16 - (_constant_buffer_size % 16);
 		_constant_buffer_size += static_cast<UINT>((obj.storage_size > alignment && (alignment != 16 || obj.storage_size <= 16)) ? obj.storage_size + alignment : obj.storage_size);
-		obj.storage_offset = _uniform_storage_offset + _constant_buffer_size - obj.storage_size;
+		obj.storage_offset = _constant_buffer_size - obj.storage_size;
 
-		auto &uniform_storage = _runtime->get_uniform_value_storage();
-
-		if (_uniform_storage_offset + _constant_buffer_size >= uniform_storage.size())
-		{
-			uniform_storage.resize(uniform_storage.size() + 128);
-		}
+		_uniform_data.resize(_constant_buffer_size);
 
 		if (node->initializer_expression != nullptr && node->initializer_expression->id == nodeid::literal_expression)
 		{
-			CopyMemory(uniform_storage.data() + obj.storage_offset, &static_cast<const literal_expression_node *>(node->initializer_expression)->value_float, obj.storage_size);
-		}
-		else
-		{
-			ZeroMemory(uniform_storage.data() + obj.storage_offset, obj.storage_size);
+			CopyMemory(_uniform_data.data() + obj.storage_offset, &static_cast<const literal_expression_node *>(node->initializer_expression)->value_float, obj.storage_size);
 		}
 
-		_runtime->add_uniform(std::move(obj));
+		_uniforms.push_back(std::move(obj));
 	}
-	void d3d11_effect_compiler::visit_technique(const technique_declaration_node *node)
+	void d3d11_effect_compiler::compile_pass(const pass_declaration_node *node)
 	{
-		technique obj;
-		obj.impl = std::make_unique<d3d11_technique_data>();
-		obj.name = node->name;
-		obj.annotations = node->annotation_list;
-
-		auto obj_data = obj.impl->as<d3d11_technique_data>();
-		D3D11_QUERY_DESC query_desc = { };
-		query_desc.Query = D3D11_QUERY_TIMESTAMP;
-		_runtime->_device->CreateQuery(&query_desc, &obj_data->timestamp_query_beg);
-		_runtime->_device->CreateQuery(&query_desc, &obj_data->timestamp_query_end);
-		query_desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
-		_runtime->_device->CreateQuery(&query_desc, &obj_data->timestamp_disjoint);
+		compiled_pass &pass = _compiled_passes[node];
 
-		if (_constant_buffer_size != 0)
+		if (node->compute_shader != nullptr)
 		{
-			obj.uniform_storage_index = _runtime->_constant_buffers.size();
-			obj.uniform_storage_offset = _uniform_storage_offset;
+			if (_runtime->_device->GetFeatureLevel() < D3D_FEATURE_LEVEL_11_0)
+			{
+				error(node->location, "compute passes require a device with feature level 11_0");
+				return;
+			}
+
+			compile_pass_shader(node->compute_shader, "cs", node, pass.cs);
+			return;
 		}
 
-		for (auto pass : node->pass_list)
+		if (node->vertex_shader != nullptr)
 		{
-			obj.passes.emplace_back(std::make_unique<d3d11_pass_data>());
-			visit_pass(pass, *static_cast<d3d11_pass_data *>(obj.passes.back().get()));
+			compile_pass_shader(node->vertex_shader, "vs", node, pass.vs);
+		}
+		if (node->pixel_shader != nullptr)
+		{
+			compile_pass_shader(node->pixel_shader, "ps", node, pass.ps);
 		}
-
-		_runtime->add_technique(std::move(obj));
 	}
-	void d3d11_effect_compiler::visit_pass(const pass_declaration_node *node, d3d11_pass_data &pass)
+	void d3d11_effect_compiler::compile_pass_shader(const function_declaration_node *node, const std::string &shadertype, const pass_declaration_node *pass_node, compiled_shader &shader)
 	{
-		pass.stencil_reference = 0;
-		pass.viewport.TopLeftX = pass.viewport.TopLeftY = pass.viewport.Width = pass.viewport.Height = 0.0f;
-		pass.viewport.MinDepth = 0.0f;
-		pass.viewport.MaxDepth = 1.0f;
-		pass.clear_render_targets = node->clear_render_targets;
+		std::string profile = shadertype;
+		const D3D_FEATURE_LEVEL featurelevel = _runtime->_device->GetFeatureLevel();
+
+		switch (featurelevel)
+		{
+			default:
+			case D3D_FEATURE_LEVEL_11_0:
+				profile += "_5_0";
+				break;
+			case D3D_FEATURE_LEVEL_10_1:
+				profile += "_4_1";
+				break;
+			case D3D_FEATURE_LEVEL_10_0:
+				profile += "_4_0";
+				break;
+			case D3D_FEATURE_LEVEL_9_1:
+			case D3D_FEATURE_LEVEL_9_2:
+				profile += "_4_0_level_9_1";
+				break;
+			case D3D_FEATURE_LEVEL_9_3:
+				profile += "_4_0_level_9_3";
+				break;
+		}
+
+		std::string source =
+			"#pragma warning(disable: 3571)\n"
+			"struct __sampler2D { Texture2D t; SamplerState s; };\n"
+			"inline float4 __tex2D(__sampler2D s, float2 c) { return s.t.Sample(s.s, c); }\n"
+			"inline float4 __tex2Dfetch(__sampler2D s, int4 c) { return s.t.Load(c.xyw); }\n"
+			"inline float4 __tex2Dgrad(__sampler2D s, float2 c, float2 ddx, float2 ddy) { return s.t.SampleGrad(s.s, c, ddx, ddy); }\n"
+			"inline float4 __tex2Dlod(__sampler2D s, float4 c) { return s.t.SampleLevel(s.s, c.xy, c.w); }\n"
+			"inline float4 __tex2Dlodoffset(__sampler2D s, float4 c, int2 offset) { return s.t.SampleLevel(s.s, c.xy, c.w, offset); }\n"
+			"inline float4 __tex2Doffset(__sampler2D s, float2 c, int2 offset) { return s.t.Sample(s.s, c, offset); }\n"
+			"inline float4 __tex2Dproj(__sampler2D s, float4 c) { return s.t.Sample(s.s, c.xy / c.w); }\n"
+			"inline int2 __tex2Dsize(__sampler2D s, int lod) { uint w, h, l; s.t.GetDimensions(lod, w, h, l); return int2(w, h); }\n";
+
+		if (featurelevel >= D3D_FEATURE_LEVEL_10_1)
+		{
+			source +=
+				"inline float4 __tex2Dgather0(__sampler2D s, float2 c) { return s.t.Gather(s.s, c); }\n"
+				"inline float4 __tex2Dgather0offset(__sampler2D s, float2 c, int2 offset) { return s.t.Gather(s.s, c, offset); }\n";
+		}
+		else
+		{
+			source +=
+				"inline float4 __tex2Dgather0(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).r, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).r, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).r, s.t.SampleLevel(s.s, c, 0).r); }\n"
+				"inline float4 __tex2Dgather0offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).r, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).r, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).r, s.t.SampleLevel(s.s, c, 0, offset).r); }\n";
+		}
+
+		if (featurelevel >= D3D_FEATURE_LEVEL_11_0)
+		{
+			source +=
+				"inline float4 __tex2Dgather1(__sampler2D s, float2 c) { return s.t.GatherGreen(s.s, c); }\n"
+				"inline float4 __tex2Dgather1offset(__sampler2D s, float2 c, int2 offset) { return s.t.GatherGreen(s.s, c, offset); }\n"
+				"inline float4 __tex2Dgather2(__sampler2D s, float2 c) { return s.t.GatherBlue(s.s, c); }\n"
+				"inline float4 __tex2Dgather2offset(__sampler2D s, float2 c, int2 offset) { return s.t.GatherBlue(s.s, c, offset); }\n"
+				"inline float4 __tex2Dgather3(__sampler2D s, float2 c) { return s.t.GatherAlpha(s.s, c); }\n"
+				"inline float4 __tex2Dgather3offset(__sampler2D s, float2 c, int2 offset) { return s.t.GatherAlpha(s.s, c, offset); }\n";
+		}
+		else
+		{
+			source +=
+				"inline float4 __tex2Dgather1(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).g, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).g, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).g, s.t.SampleLevel(s.s, c, 0).g); }\n"
+				"inline float4 __tex2Dgather1offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).g, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).g, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).g, s.t.SampleLevel(s.s, c, 0, offset).g); }\n"
+				"inline float4 __tex2Dgather2(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).b, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).b, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).b, s.t.SampleLevel(s.s, c, 0).b); }\n"
+				"inline float4 __tex2Dgather2offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).b, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).b, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).b, s.t.SampleLevel(s.s, c, 0, offset).b); }\n"
+				"inline float4 __tex2Dgather3(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).a, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).a, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).a, s.t.SampleLevel(s.s, c, 0).a); }\n"
+				"inline float4 __tex2Dgather3offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).a, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).a, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).a, s.t.SampleLevel(s.s, c, 0, offset).a); }\n";
+		}
+
+		// Make room for the declarations and functions up front, so appending them does not grow the string repeatedly
+		source.reserve(source.size() + _global_uniforms.size() + _global_code.size() + 4096);
+
+		source += "cbuffer __GLOBAL__ : register(b0)\n{\n" + _global_uniforms.str() + "};\n";
+
+		for (size_t i = 0; i < _sampler_descs.size(); i++)
+		{
+			source += "SamplerState __SamplerState" + std::to_string(i) + " : register(s" + std::to_string(i) + ");\n";
+		}
+
+		reachable_declarations reachable;
+		find_reachable_declarations(node, reachable);
+
+		// The slots of the textures the shader can sample are all it needs bound, which for the full screen vertex shaders of most effects are none at all
+		size_t resource_first = _shader_resource_count, resource_last = 0;
+
+		for (const auto variable : reachable.variables)
+		{
+			if (const auto it = _texture_registers.find(variable); it != _texture_registers.end())
+			{
+				resource_first = std::min({ resource_first, it->second.first, it->second.second });
+				resource_last = std::max({ resource_last, it->second.first + 1, it->second.second + 1 });
+
+				// Only passes whose shaders can actually sample the back buffer need the copy of it updated before they run
+				if (it->second.first < 2 || it->second.second < 2)
+				{
+					shader.samples_backbuffer = true;
+				}
+			}
+		}
+
+		resource_last = std::min(resource_last, _shader_resource_count);
+
+		shader.resource_first = resource_first < resource_last ? static_cast<UINT>(resource_first) : 0;
+		shader.resource_count = resource_first < resource_last ? static_cast<UINT>(resource_last - resource_first) : 0;
+
+		source += reachable_global_code(_global_code.str(), _global_declarations, reachable);
+
+		std::string entry_point = node->unique_name;
+
+		// The thread group size is a pass state in effects, but an attribute of the entry point in HLSL, so the entry point is wrapped in one that has it
+		if (shadertype == "cs")
+		{
+			entry_point = "__main_" + node->unique_name;
+
+			source += "[numthreads(" + std::to_string(pass_node->thread_group_size[0]) + ", " + std::to_string(pass_node->thread_group_size[1]) + ", " + std::to_string(pass_node->thread_group_size[2]) + ")]\nvoid " + entry_point + '(';
+
+			for (size_t i = 0, count = node->parameter_list.size(); i < count; i++)
+			{
+				const auto parameter = node->parameter_list[i];
+
+				code_buffer parameter_code;
+				_is_in_parameter_block = true;
+				visit(parameter_code, parameter);
+				_is_in_parameter_block = false;
+
+				source += parameter_code.str() + (i < count - 1 ? ", " : "");
+			}
+
+			source += ")\n{\n\t" + node->unique_name + '(';
+
+			for (size_t i = 0, count = node->parameter_list.size(); i < count; i++)
+			{
+				source += node->parameter_list[i]->unique_name + (i < count - 1 ? ", " : "");
+			}
+
+			source += ");\n}\n";
+		}
+
+#if RESHADE_DUMP_NATIVE_SHADERS
+		if (!_dumped_shaders.count(node->unique_name))
+		{
+			std::ofstream dumpfile(_dump_filename.string(), std::ios::app);
+
+			if (dumpfile.is_open())
+			{
+				dumpfile << "#ifdef RESHADE_SHADER_" << shadertype << "_" << node->unique_name << std::endl << source << "#endif" << std::endl << std::endl;
+
+				_dumped_shaders.insert(node->unique_name);
+			}
+		}
+#endif
+
+		UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
+		com_ptr<ID3DBlob> compiled, errors;
+
+		if (_skip_shader_optimization)
+		{
+			flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
+		}
+
+		const unsigned long long cache_key = shader_cache::compute_key(source, entry_point, profile, flags, _d3dcompiler_module);
+
+		// Another game client may be compiling the same shader right now, so wait for it and take its result from the cache instead of compiling it as well
+		shader_cache::compile_lock lock;
+
+		if (!shader_cache::load(cache_key, shader.bytecode) && !(lock.acquire(cache_key) && shader_cache::load(cache_key, shader.bytecode)))
+		{
+			const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3dcompiler_module, "D3DCompile"));
+			const auto compile_begin = std::chrono::high_resolution_clock::now();
+			const HRESULT hr = D3DCompile(source.c_str(), source.length(), nullptr, nullptr, nullptr, entry_point.c_str(), profile.c_str(), flags, 0, &compiled, &errors);
+			_compile_duration += std::chrono::high_resolution_clock::now() - compile_begin;
+
+			if (errors != nullptr)
+			{
+				_errors.append(static_cast<const char *>(errors->GetBufferPointer()), errors->GetBufferSize() - 1);
+			}
+
+			if (FAILED(hr))
+			{
+				error(node->location, "internal shader compilation failed");
+				return;
+			}
+
+			shader_cache::save(cache_key, compiled->GetBufferPointer(), compiled->GetBufferSize());
+
+			shader.bytecode.assign(static_cast<const char *>(compiled->GetBufferPointer()), static_cast<const char *>(compiled->GetBufferPointer()) + compiled->GetBufferSize());
+		}
+	}
+
+	void d3d11_effect_compiler::create_texture(const variable_declaration_node *node)
+	{
+		const size_t texture_register_index = _texture_registers.at(node).first;
+		const size_t texture_register_index_srgb = _texture_registers.at(node).second;
+
+		const auto existing_texture = _runtime->find_texture(node->unique_name);
+
+		if (existing_texture != nullptr)
+		{
+			if (node->semantic.empty())
+			{
+				if (existing_texture->width != node->properties.width ||
+					existing_texture->height != node->properties.height ||
+					existing_texture->levels != node->properties.levels ||
+					existing_texture->format != node->properties.format)
+				{
+					error(node->location, existing_texture->effect_filename + " already created a texture with the same name but different dimensions; textures are shared across all effects, so either rename the variable or adjust the dimensions so they match");
+					return;
+				}
+
+				const auto obj_data = existing_texture->impl->as<d3d11_tex_data>();
+
+				_shader_resources[texture_register_index] = obj_data->srv[0];
+				_shader_resources[texture_register_index_srgb] = obj_data->srv[1] != nullptr ? obj_data->srv[1] : obj_data->srv[0];
+			}
+
+			return;
+		}
+
+		texture obj;
+		D3D11_TEXTURE2D_DESC texdesc = { };
+		obj.name = node->name;
+		obj.unique_name = node->unique_name;
+		copy_annotations(node->annotation_list, obj.annotations);
+		texdesc.Width = obj.width = node->properties.width;
+		texdesc.Height = obj.height = node->properties.height;
+		texdesc.MipLevels = obj.levels = node->properties.levels;
+		texdesc.ArraySize = 1;
+		texdesc.Format = literal_to_format(obj.format = node->properties.format);
+		texdesc.SampleDesc.Count = 1;
+		texdesc.SampleDesc.Quality = 0;
+		texdesc.Usage = D3D11_USAGE_DEFAULT;
+		texdesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+		texdesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+		// Unordered access can keep drivers from compressing a texture, so it is only allowed for those a storage object of this effect writes to
+		if (_runtime->_device->GetFeatureLevel() >= D3D_FEATURE_LEVEL_11_0 && std::find(_storage_textures.begin(), _storage_textures.end(), node) != _storage_textures.end())
+		{
+			texdesc.BindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+		}
+
+		if (node->semantic == "COLOR" || node->semantic == "SV_TARGET")
+		{
+			obj.width = _runtime->frame_width();
+			obj.height = _runtime->frame_height();
+			obj.impl_reference = texture_reference::back_buffer;
+		}
+		else if (node->semantic == "DEPTH" || node->semantic == "SV_DEPTH")
+		{
+			obj.width = _runtime->frame_width();
+			obj.height = _runtime->frame_height();
+			obj.impl_reference = texture_reference::depth_buffer;
+		}
+		else
+		{
+			obj.impl = std::make_unique<d3d11_tex_data>();
+			const auto obj_data = obj.impl->as<d3d11_tex_data>();
+
+			HRESULT hr = _runtime->_device->CreateTexture2D(&texdesc, nullptr, &obj_data->texture);
+
+			if (FAILED(hr))
+			{
+				error(node->location, "'ID3D11Device::CreateTexture2D' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+				return;
+			}
+
+			D3D11_SHADER_RESOURCE_VIEW_DESC srvdesc = { };
+			srvdesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+			srvdesc.Texture2D.MipLevels = texdesc.MipLevels;
+			srvdesc.Format = make_format_normal(texdesc.Format);
+
+			hr = _runtime->_device->CreateShaderResourceView(obj_data->texture.get(), &srvdesc, &obj_data->srv[0]);
+
+			if (FAILED(hr))
+			{
+				error(node->location, "'ID3D11Device::CreateShaderResourceView' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+				return;
+			}
+
+			srvdesc.Format = make_format_srgb(texdesc.Format);
+
+			if (srvdesc.Format != texdesc.Format)
+			{
+				hr = _runtime->_device->CreateShaderResourceView(obj_data->texture.get(), &srvdesc, &obj_data->srv[1]);
+
+				if (FAILED(hr))
+				{
+					error(node->location, "'ID3D11Device::CreateShaderResourceView' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+					return;
+				}
+			}
+
+			_shader_resources[texture_register_index] = obj_data->srv[0];
+			_shader_resources[texture_register_index_srgb] = obj_data->srv[1] != nullptr ? obj_data->srv[1] : obj_data->srv[0];
+		}
+
+		_runtime->add_texture(std::move(obj));
+	}
+	void d3d11_effect_compiler::create_sampler(const variable_declaration_node *node)
+	{
+		if (_runtime->find_texture(node->properties.texture->unique_name) == nullptr)
+		{
+			error(node->location, "texture '" + node->properties.texture->name + "' for sampler '" + node->name + "' is missing due to previous error");
+			return;
+		}
+
+		const size_t register_index = _sampler_registers.at(node);
+
+		if (_sampler_states[register_index] != nullptr)
+		{
+			return;
+		}
+
+		const D3D11_SAMPLER_DESC &desc = _sampler_descs[register_index];
+
+		HRESULT hr = _runtime->_sampler_state_cache.get(desc, _sampler_states[register_index], [this, &desc](ID3D11SamplerState **object) { return _runtime->_device->CreateSamplerState(&desc, object); });
+
+		if (FAILED(hr))
+		{
+			error(node->location, "'ID3D11Device::CreateSamplerState' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+			return;
+		}
+	}
+	void d3d11_effect_compiler::create_storage(const variable_declaration_node *node)
+	{
+		const auto texture = _runtime->find_texture(node->properties.texture->unique_name);
+
+		if (texture == nullptr)
+		{
+			error(node->location, "texture '" + node->properties.texture->name + "' for storage '" + node->name + "' is missing due to previous error");
+			return;
+		}
+		if (texture->impl_reference != texture_reference::none)
+		{
+			error(node->location, "storage '" + node->name + "' cannot write to the back buffer or depth buffer, write to a texture and copy it in a pixel shader pass instead");
+			return;
+		}
+
+		const auto texture_impl = texture->impl->as<d3d11_tex_data>();
+
+		if (texture_impl->uav == nullptr)
+		{
+			D3D11_TEXTURE2D_DESC desc;
+			texture_impl->texture->GetDesc(&desc);
+
+			if ((desc.BindFlags & D3D11_BIND_UNORDERED_ACCESS) == 0)
+			{
+				error(node->location, _runtime->_device->GetFeatureLevel() < D3D_FEATURE_LEVEL_11_0 ?
+					"storage objects require a device with feature level 11_0" :
+					texture->effect_filename + " created texture '" + node->properties.texture->name + "' without storage access; declare the storage in the effect that creates the texture");
+				return;
+			}
+
+			D3D11_UNORDERED_ACCESS_VIEW_DESC uavdesc = { };
+			uavdesc.Format = make_format_normal(desc.Format);
+			uavdesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+
+			HRESULT hr = _runtime->_device->CreateUnorderedAccessView(texture_impl->texture.get(), &uavdesc, &texture_impl->uav);
+
+			if (FAILED(hr))
+			{
+				error(node->location, "'ID3D11Device::CreateUnorderedAccessView' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+				return;
+			}
+		}
+
+		const size_t register_index = std::distance(_storage_textures.begin(), std::find(_storage_textures.begin(), _storage_textures.end(), node->properties.texture));
+
+		_unordered_access_views[register_index] = texture_impl->uav;
+	}
+	void d3d11_effect_compiler::visit_technique(const technique_declaration_node *node)
+	{
+		technique obj;
+		obj.impl = std::make_unique<d3d11_technique_data>();
+		obj.name = node->name;
+		copy_annotations(node->annotation_list, obj.annotations);
+
+		auto obj_data = obj.impl->as<d3d11_technique_data>();
+		D3D11_QUERY_DESC query_desc = { };
+		query_desc.Query = D3D11_QUERY_TIMESTAMP;
+		_runtime->_device->CreateQuery(&query_desc, &obj_data->timestamp_query_beg);
+		_runtime->_device->CreateQuery(&query_desc, &obj_data->timestamp_query_end);
+		query_desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+		_runtime->_device->CreateQuery(&query_desc, &obj_data->timestamp_disjoint);
+
+		obj_data->sampler_states = _sampler_states;
+
+		if (_constant_buffer_size != 0)
+		{
+			obj.uniform_storage_index = _runtime->_constant_buffers.size();
+			obj.uniform_storage_offset = _uniform_storage_offset;
+		}
+
+		for (auto pass : node->pass_list)
+		{
+			obj.passes.emplace_back(std::make_unique<d3d11_pass_data>());
+			auto &pass_data = *static_cast<d3d11_pass_data *>(obj.passes.back().get());
+			visit_pass(pass, pass_data);
+			name_unnamed_pass(pass_data.name, obj.passes.size() - 1);
+
+			// Pixel shader passes without a render target draw to the back buffer
+			obj.writes_backbuffer |= pass->compute_shader == nullptr && pass->render_targets[0] == nullptr;
+		}
+
+		_runtime->add_technique(std::move(obj));
+	}
+	void d3d11_effect_compiler::visit_pass(const pass_declaration_node *node, d3d11_pass_data &pass)
+	{
+		pass.name = node->name;
+		pass.stencil_reference = 0;
+		pass.viewport.TopLeftX = pass.viewport.TopLeftY = pass.viewport.Width = pass.viewport.Height = 0.0f;
+		pass.viewport.MinDepth = 0.0f;
+		pass.viewport.MaxDepth = 1.0f;
+		pass.clear_render_targets = node->clear_render_targets;
 		ZeroMemory(pass.render_targets, sizeof(pass.render_targets));
 		ZeroMemory(pass.render_target_resources, sizeof(pass.render_target_resources));
-		pass.shader_resources = _runtime->_effect_shader_resources;
+		pass.shader_resources = _shader_resources;
+		pass.vs_resource_first = pass.vs_resource_count = 0;
+		pass.ps_resource_first = pass.ps_resource_count = 0;
+		pass.render_target_count = 0;
+		pass.samples_backbuffer = false;
+		pass.writes_backbuffer = false;
+
+		if (node->compute_shader != nullptr)
+		{
+			visit_pass_compute(node, pass);
+			return;
+		}
+
+		const compiled_pass &compiled = _compiled_passes.at(node);
 
 		if (node->vertex_shader != nullptr)
 		{
-			visit_pass_shader(node->vertex_shader, "vs", pass);
+			create_pass_shader(node->vertex_shader, "vs", compiled.vs, pass);
 		}
 		if (node->pixel_shader != nullptr)
 		{
-			visit_pass_shader(node->pixel_shader, "ps", pass);
+			create_pass_shader(node->pixel_shader, "ps", compiled.ps, pass);
 		}
 
 		const int target_index = node->srgb_write_enable ? 1 : 0;
@@ -1862,7 +2352,9 @@ namespace reshade::d3d11
 			pass.viewport.Height = static_cast<FLOAT>(_runtime->frame_height());
 		}
 
+		// Zeroed completely, since the state object cache compares the padding as well
 		D3D11_DEPTH_STENCIL_DESC ddesc;
+		ZeroMemory(&ddesc, sizeof(ddesc));
 		ddesc.DepthEnable = FALSE;
 		ddesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
 		ddesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
@@ -1875,7 +2367,7 @@ namespace reshade::d3d11
 		ddesc.FrontFace.StencilDepthFailOp = ddesc.BackFace.StencilDepthFailOp = literal_to_stencil_op(node->stencil_op_depth_fail);
 		pass.stencil_reference = node->stencil_reference_value;
 
-		HRESULT hr = _runtime->_device->CreateDepthStencilState(&ddesc, &pass.depth_stencil_state);
+		HRESULT hr = _runtime->_depth_stencil_state_cache.get(ddesc, pass.depth_stencil_state, [this, &ddesc](ID3D11DepthStencilState **object) { return _runtime->_device->CreateDepthStencilState(&ddesc, object); });
 
 		if (FAILED(hr))
 		{
@@ -1883,6 +2375,7 @@ namespace reshade::d3d11
 		}
 
 		D3D11_BLEND_DESC bdesc;
+		ZeroMemory(&bdesc, sizeof(bdesc));
 		bdesc.AlphaToCoverageEnable = FALSE;
 		bdesc.IndependentBlendEnable = FALSE;
 		bdesc.RenderTarget[0].RenderTargetWriteMask = node->color_write_mask;
@@ -1894,13 +2387,23 @@ namespace reshade::d3d11
 		bdesc.RenderTarget[0].SrcBlendAlpha = literal_to_blend_func(node->src_blend_alpha);
 		bdesc.RenderTarget[0].DestBlendAlpha = literal_to_blend_func(node->dest_blend_alpha);
 
-		hr = _runtime->_device->CreateBlendState(&bdesc, &pass.blend_state);
+		hr = _runtime->_blend_state_cache.get(bdesc, pass.blend_state, [this, &bdesc](ID3D11BlendState **object) { return _runtime->_device->CreateBlendState(&bdesc, object); });
 
 		if (FAILED(hr))
 		{
 			warning(node->location, "'ID3D11Device::CreateBlendState' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
 		}
 
+		pass.render_target_count = 0;
+
+		for (UINT i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+		{
+			if (pass.render_targets[i] != nullptr)
+			{
+				pass.render_target_count = i + 1;
+			}
+		}
+
 		for (auto &srv : pass.shader_resources)
 		{
 			if (srv == nullptr)
@@ -1923,138 +2426,100 @@ namespace reshade::d3d11
 
 				if (res1 == res2)
 				{
-					srv.reset();
+					// An earlier pass may still have the view bound, which has to go before the render target can be
+					pass.render_target_aliases.push_back(std::move(srv));
 					break;
 				}
 			}
 		}
-	}
-	void d3d11_effect_compiler::visit_pass_shader(const function_declaration_node *node, const std::string &shadertype, d3d11_pass_data &pass)
-	{
-		std::string profile = shadertype;
-		const D3D_FEATURE_LEVEL featurelevel = _runtime->_device->GetFeatureLevel();
 
-		switch (featurelevel)
+		for (const auto &rtv : pass.render_targets)
 		{
-			default:
-			case D3D_FEATURE_LEVEL_11_0:
-				profile += "_5_0";
-				break;
-			case D3D_FEATURE_LEVEL_10_1:
-				profile += "_4_1";
-				break;
-			case D3D_FEATURE_LEVEL_10_0:
-				profile += "_4_0";
-				break;
-			case D3D_FEATURE_LEVEL_9_1:
-			case D3D_FEATURE_LEVEL_9_2:
-				profile += "_4_0_level_9_1";
-				break;
-			case D3D_FEATURE_LEVEL_9_3:
-				profile += "_4_0_level_9_3";
+			if (rtv != nullptr && (rtv == _runtime->_backbuffer_rtv[0] || rtv == _runtime->_backbuffer_rtv[1]))
+			{
+				pass.writes_backbuffer = true;
 				break;
+			}
 		}
-
-		std::string source =
-			"#pragma warning(disable: 3571)\n"
-			"struct __sampler2D { Texture2D t; SamplerState s; };\n"
-			"inline float4 __tex2D(__sampler2D s, float2 c) { return s.t.Sample(s.s, c); }\n"
-			"inline float4 __tex2Dfetch(__sampler2D s, int4 c) { return s.t.Load(c.xyw); }\n"
-			"inline float4 __tex2Dgrad(__sampler2D s, float2 c, float2 ddx, float2 ddy) { return s.t.SampleGrad(s.s, c, ddx, ddy); }\n"
-			"inline float4 __tex2Dlod(__sampler2D s, float4 c) { return s.t.SampleLevel(s.s, c.xy, c.w); }\n"
-			"inline float4 __tex2Dlodoffset(__sampler2D s, float4 c, int2 offset) { return s.t.SampleLevel(s.s, c.xy, c.w, offset); }\n"
-			"inline float4 __tex2Doffset(__sampler2D s, float2 c, int2 offset) { return s.t.Sample(s.s, c, offset); }\n"
-			"inline float4 __tex2Dproj(__sampler2D s, float4 c) { return s.t.Sample(s.s, c.xy / c.w); }\n"
-			"inline int2 __tex2Dsize(__sampler2D s, int lod) { uint w, h, l; s.t.GetDimensions(lod, w, h, l); return int2(w, h); }\n";
-
-		if (featurelevel >= D3D_FEATURE_LEVEL_10_1)
-		{
-			source +=
-				"inline float4 __tex2Dgather0(__sampler2D s, float2 c) { return s.t.Gather(s.s, c); }\n"
-				"inline float4 __tex2Dgather0offset(__sampler2D s, float2 c, int2 offset) { return s.t.Gather(s.s, c, offset); }\n";
-		}
-		else
+	}
+	void d3d11_effect_compiler::visit_pass_compute(const pass_declaration_node *node, d3d11_pass_data &pass)
+	{
+		for (unsigned int i = 0; i < 3; i++)
 		{
-			source +=
-				"inline float4 __tex2Dgather0(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).r, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).r, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).r, s.t.SampleLevel(s.s, c, 0).r); }\n"
-				"inline float4 __tex2Dgather0offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).r, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).r, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).r, s.t.SampleLevel(s.s, c, 0, offset).r); }\n";
+			pass.thread_group_size[i] = node->thread_group_size[i];
+			pass.dispatch_size[i] = node->dispatch_size[i];
 		}
 
-		if (featurelevel >= D3D_FEATURE_LEVEL_11_0)
+		// Cover the frame with as many thread groups as it takes, unless the effect asked for a fixed number
+		if (pass.dispatch_size[0] == 0)
 		{
-			source +=
-				"inline float4 __tex2Dgather1(__sampler2D s, float2 c) { return s.t.GatherGreen(s.s, c); }\n"
-				"inline float4 __tex2Dgather1offset(__sampler2D s, float2 c, int2 offset) { return s.t.GatherGreen(s.s, c, offset); }\n"
-				"inline float4 __tex2Dgather2(__sampler2D s, float2 c) { return s.t.GatherBlue(s.s, c); }\n"
-				"inline float4 __tex2Dgather2offset(__sampler2D s, float2 c, int2 offset) { return s.t.GatherBlue(s.s, c, offset); }\n"
-				"inline float4 __tex2Dgather3(__sampler2D s, float2 c) { return s.t.GatherAlpha(s.s, c); }\n"
-				"inline float4 __tex2Dgather3offset(__sampler2D s, float2 c, int2 offset) { return s.t.GatherAlpha(s.s, c, offset); }\n";
+			pass.dispatch_size[0] = (_runtime->frame_width() + pass.thread_group_size[0] - 1) / pass.thread_group_size[0];
 		}
-		else
+		if (pass.dispatch_size[1] == 0)
 		{
-			source +=
-				"inline float4 __tex2Dgather1(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).g, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).g, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).g, s.t.SampleLevel(s.s, c, 0).g); }\n"
-				"inline float4 __tex2Dgather1offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).g, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).g, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).g, s.t.SampleLevel(s.s, c, 0, offset).g); }\n"
-				"inline float4 __tex2Dgather2(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).b, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).b, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).b, s.t.SampleLevel(s.s, c, 0).b); }\n"
-				"inline float4 __tex2Dgather2offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).b, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).b, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).b, s.t.SampleLevel(s.s, c, 0, offset).b); }\n"
-				"inline float4 __tex2Dgather3(__sampler2D s, float2 c) { return float4( s.t.SampleLevel(s.s, c, 0, int2(0, 1)).a, s.t.SampleLevel(s.s, c, 0, int2(1, 1)).a, s.t.SampleLevel(s.s, c, 0, int2(1, 0)).a, s.t.SampleLevel(s.s, c, 0).a); }\n"
-				"inline float4 __tex2Dgather3offset(__sampler2D s, float2 c, int2 offset) { return float4( s.t.SampleLevel(s.s, c, 0, offset + int2(0, 1)).a, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 1)).a, s.t.SampleLevel(s.s, c, 0, offset + int2(1, 0)).a, s.t.SampleLevel(s.s, c, 0, offset).a); }\n";
+			pass.dispatch_size[1] = (_runtime->frame_height() + pass.thread_group_size[1] - 1) / pass.thread_group_size[1];
 		}
 
-		source += "cbuffer __GLOBAL__ : register(b0)\n{\n" + _global_uniforms.str() + "};\n";
+		create_pass_shader(node->compute_shader, "cs", _compiled_passes.at(node).cs, pass);
 
-		for (const auto &samplerdesc : _runtime->_effect_sampler_descs)
-		{
-			source += "SamplerState __SamplerState" + std::to_string(samplerdesc.second) + " : register(s" + std::to_string(samplerdesc.second) + ");\n";
-		}
-
-		source += _global_code.str();
+		pass.unordered_access_views = _unordered_access_views;
 
-#if RESHADE_DUMP_NATIVE_SHADERS
-		if (!_dumped_shaders.count(node->unique_name))
+		// A texture cannot be read and written at the same time, so storage textures are not bound for sampling during the pass, and the views recorded here get their mipmaps regenerated afterwards like render targets do
+		for (size_t i = 0; i < pass.unordered_access_views.size(); i++)
 		{
-			std::ofstream dumpfile(_dump_filename.string(), std::ios::app);
+			com_ptr<ID3D11Resource> res1;
+			pass.unordered_access_views[i]->GetResource(&res1);
 
-			if (dumpfile.is_open())
+			for (auto &srv : pass.shader_resources)
 			{
-				dumpfile << "#ifdef RESHADE_SHADER_" << shadertype << "_" << node->unique_name << std::endl << source << "#endif" << std::endl << std::endl;
-
-				_dumped_shaders.insert(node->unique_name);
-			}
-		}
-#endif
-
-		UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
-		com_ptr<ID3DBlob> compiled, errors;
-
-		if (_skip_shader_optimization)
-		{
-			flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-		}
+				if (srv == nullptr)
+				{
+					continue;
+				}
 
-		const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3dcompiler_module, "D3DCompile"));
-		HRESULT hr = D3DCompile(source.c_str(), source.length(), nullptr, nullptr, nullptr, node->unique_name.c_str(), profile.c_str(), flags, 0, &compiled, &errors);
+				com_ptr<ID3D11Resource> res2;
+				srv->GetResource(&res2);
 
-		if (errors != nullptr)
-		{
-			_errors.append(static_cast<const char *>(errors->GetBufferPointer()), errors->GetBufferSize() - 1);
-		}
+				if (res1 == res2)
+				{
+					if (pass.render_target_resources[i] == nullptr)
+					{
+						pass.render_target_resources[i] = srv;
+					}
 
-		if (FAILED(hr))
-		{
-			error(node->location, "internal shader compilation failed");
-			return;
+					srv.reset();
+				}
+			}
 		}
+	}
+	void d3d11_effect_compiler::create_pass_shader(const function_declaration_node *node, const std::string &shadertype, const compiled_shader &shader, d3d11_pass_data &pass)
+	{
+		HRESULT hr = E_FAIL;
 
 		if (shadertype == "vs")
 		{
-			hr = _runtime->_device->CreateVertexShader(compiled->GetBufferPointer(), compiled->GetBufferSize(), nullptr, &pass.vertex_shader);
+			pass.vs_resource_first = shader.resource_first;
+			pass.vs_resource_count = shader.resource_count;
+
+			hr = _runtime->_device->CreateVertexShader(shader.bytecode.data(), shader.bytecode.size(), nullptr, &pass.vertex_shader);
 		}
-		else if (shadertype == "ps")
+		else
 		{
-			hr = _runtime->_device->CreatePixelShader(compiled->GetBufferPointer(), compiled->GetBufferSize(), nullptr, &pass.pixel_shader);
+			pass.ps_resource_first = shader.resource_first;
+			pass.ps_resource_count = shader.resource_count;
+
+			if (shadertype == "ps")
+			{
+				hr = _runtime->_device->CreatePixelShader(shader.bytecode.data(), shader.bytecode.size(), nullptr, &pass.pixel_shader);
+			}
+			else if (shadertype == "cs")
+			{
+				hr = _runtime->_device->CreateComputeShader(shader.bytecode.data(), shader.bytecode.size(), nullptr, &pass.compute_shader);
+			}
 		}
 
+		pass.samples_backbuffer |= shader.samples_backbuffer;
+
 		if (FAILED(hr))
 		{
 			error(node->location, "'CreateShader' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
@@ -6,7 +6,11 @@
 #pragma once
 
 #include "effect_syntax_tree.hpp"
-#include <sstream>
+#include "effect_code_buffer.hpp"
+#include "effect_reachability.hpp"
+#include "runtime_objects.hpp"
+#include <chrono>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace reshade::d3d11
@@ -16,62 +20,118 @@ namespace reshade::d3d11
 	class d3d11_runtime;
 	#pragma endregion
 
-	class d3d11_effect_compiler
+	class d3d11_effect_compiler : public base_object
 	{
 	public:
-		d3d11_effect_compiler(d3d11_runtime *runtime, const reshadefx::syntax_tree &ast, std::string &errors, bool skipoptimization = false);
+		d3d11_effect_compiler(d3d11_runtime *runtime, const reshadefx::syntax_tree &ast, std::string &errors, bool skipoptimization = false, bool halfprecision = false);
 
+		/// <summary>
+		/// Generate the HLSL code of the effect and compile its shaders. This creates no device objects, so it can run on a compile worker thread.
+		/// </summary>
+		bool compile();
+		/// <summary>
+		/// Create the textures, state objects, shaders and constant buffer of the effect and add it to the runtime on the render thread. Calls <see cref="compile"/> first if that did not happen yet.
+		/// </summary>
 		bool run();
 
+		/// <summary>
+		/// Get the time spent in 'D3DCompile' during <see cref="compile"/>, which excludes shaders that were found in the shader cache.
+		/// </summary>
+		std::chrono::high_resolution_clock::duration compile_duration() const { return _compile_duration; }
+
 	private:
+		// Bytecode of a shader and the range of shader resource slots it reads
+		struct compiled_shader
+		{
+			std::vector<char> bytecode;
+			UINT resource_first = 0, resource_count = 0;
+			bool samples_backbuffer = false;
+		};
+		struct compiled_pass
+		{
+			compiled_shader vs, ps, cs;
+		};
+
 		void error(const reshadefx::location &location, const std::string &message);
 		void warning(const reshadefx::location &location, const std::string &message);
 
-		void visit(std::stringstream &output, const reshadefx::nodes::statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::type_node &type, bool with_qualifiers = true);
-		void visit(std::stringstream &output, const reshadefx::nodes::lvalue_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::literal_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_sequence_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::unary_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::binary_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::intrinsic_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::conditional_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::swizzle_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::field_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::assignment_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::call_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::constructor_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::initializer_list_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::compound_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::declarator_list_node *node, bool single_statement);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::if_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::switch_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::case_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::for_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::while_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::return_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::jump_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::struct_declaration_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::variable_declaration_node *node, bool with_type = true);
-		void visit(std::stringstream &output, const reshadefx::nodes::function_declaration_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::type_node &type, bool with_qualifiers = true);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::lvalue_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::literal_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_sequence_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::unary_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::binary_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::intrinsic_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::conditional_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::swizzle_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::field_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::assignment_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::call_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::constructor_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::initializer_list_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::compound_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::declarator_list_node *node, bool single_statement);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::if_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::switch_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::case_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::for_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::while_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::return_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::jump_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::struct_declaration_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::variable_declaration_node *node, bool with_type = true);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::function_declaration_node *node);
 
 		void visit_texture(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_sampler(const reshadefx::nodes::variable_declaration_node *node);
+		void visit_storage(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_uniform(const reshadefx::nodes::variable_declaration_node *node);
+		void compile_pass(const reshadefx::nodes::pass_declaration_node *node);
+		void compile_pass_shader(const reshadefx::nodes::function_declaration_node *node, const std::string &shadertype, const reshadefx::nodes::pass_declaration_node *pass_node, compiled_shader &shader);
+
+		void create_texture(const reshadefx::nodes::variable_declaration_node *node);
+		void create_sampler(const reshadefx::nodes::variable_declaration_node *node);
+		void create_storage(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_technique(const reshadefx::nodes::technique_declaration_node *node);
 		void visit_pass(const reshadefx::nodes::pass_declaration_node *node, d3d11_pass_data &pass);
-		void visit_pass_shader(const reshadefx::nodes::function_declaration_node *node, const std::string &shadertype, d3d11_pass_data &pass);
+		void visit_pass_compute(const reshadefx::nodes::pass_declaration_node *node, d3d11_pass_data &pass);
+		void create_pass_shader(const reshadefx::nodes::function_declaration_node *node, const std::string &shadertype, const compiled_shader &shader, d3d11_pass_data &pass);
+
+		void collect_half_precision_variables();
 
 		d3d11_runtime *_runtime;
-		bool _success = true;
+		bool _success = true, _is_compiled = false;
 		const reshadefx::syntax_tree &_ast;
 		std::string &_errors;
-		std::stringstream _global_code, _global_uniforms;
-		bool _skip_shader_optimization, _is_in_parameter_block = false, _is_in_function_block = false;
+		reshadefx::code_buffer _global_code, _global_uniforms;
+		// Parts of the global code that belong to a single variable or function, so each shader can leave out those it does not reference
+		std::vector<reshadefx::global_declaration> _global_declarations;
+		// Shader resource slots of the linear and the sRGB view of every texture, so each pass only binds the slots its shaders read
+		// The slots belong to this effect alone, the first three hold the two views of the back buffer and the depth buffer, the textures follow
+		std::unordered_map<const reshadefx::nodes::variable_declaration_node *, std::pair<size_t, size_t>> _texture_registers;
+		size_t _shader_resource_count = 3;
+		// Sampler slot of every sampler, samplers with the same states share one
+		std::unordered_map<const reshadefx::nodes::variable_declaration_node *, size_t> _sampler_registers;
+		std::vector<D3D11_SAMPLER_DESC> _sampler_descs;
+		// Textures the storage of this effect writes to, in the order of their UAV slots
+		std::vector<const reshadefx::nodes::variable_declaration_node *> _storage_textures;
+		// Uniforms with offsets relative to the constant buffer of this effect and its initial contents, added to the runtime storage when the effect is loaded
+		std::vector<uniform> _uniforms;
+		std::vector<unsigned char> _uniform_data;
+		std::unordered_map<const reshadefx::nodes::pass_declaration_node *, compiled_pass> _compiled_passes;
+		// Device objects bound to the slots above, created on the render thread
+		std::vector<com_ptr<ID3D11ShaderResourceView>> _shader_resources;
+		std::vector<com_ptr<ID3D11SamplerState>> _sampler_states;
+		std::vector<com_ptr<ID3D11UnorderedAccessView>> _unordered_access_views;
+		// Local variables that are declared as 'min16float', for techniques that opted into reduced precision
+		std::unordered_set<const reshadefx::nodes::variable_declaration_node *> _half_precision_variables;
+		bool _skip_shader_optimization, _half_precision, _is_in_parameter_block = false, _is_in_function_block = false, _is_half_precision_type = false;
 		size_t _uniform_storage_offset = 0, _constant_buffer_size = 0;
 		HMODULE _d3dcompiler_module = nullptr;
+		std::chrono::high_resolution_clock::duration _compile_duration = { };
 #if RESHADE_DUMP_NATIVE_SHADERS
 		filesystem::path _dump_filename;
 		std::unordered_set<std::string> _dumped_shaders;
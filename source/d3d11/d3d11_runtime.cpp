@@ -9,6 +9,8 @@
 #include "effect_lexer.hpp"
 #include "input.hpp"
 #include "resource_loading.hpp"
+#include "pixel_conversion.hpp"
+#include "gpu_marker.hpp"
 #include <imgui.h>
 #include <algorithm>
 
@@ -18,6 +20,68 @@ namespace reshade::d3d11
 	extern DXGI_FORMAT make_format_normal(DXGI_FORMAT format);
 	extern DXGI_FORMAT make_format_typeless(DXGI_FORMAT format);
 
+	/// <summary>
+	/// Labels the commands recorded during its lifetime for PIX, RenderDoc and other GPU debuggers.
+	/// </summary>
+	class gpu_marker
+	{
+	public:
+		gpu_marker(ID3DUserDefinedAnnotation *annotation, const std::string &name) : _annotation(annotation)
+		{
+			if (_annotation != nullptr)
+			{
+				_annotation->BeginEvent(wide_marker_name(name).c_str());
+			}
+		}
+		~gpu_marker()
+		{
+			if (_annotation != nullptr)
+			{
+				_annotation->EndEvent();
+			}
+		}
+
+	private:
+		ID3DUserDefinedAnnotation *const _annotation;
+	};
+
+	using set_shader_resources_func = void (STDMETHODCALLTYPE ID3D11DeviceContext::*)(UINT, UINT, ID3D11ShaderResourceView *const *);
+
+	static void update_shader_resources(ID3D11DeviceContext *context, set_shader_resources_func set_shader_resources, ID3D11ShaderResourceView **bound, UINT &bound_end, const com_ptr<ID3D11ShaderResourceView> *resources, UINT first, UINT count)
+	{
+		// Only the slots that changed are set, with a single call from the first to the last of them
+		UINT changed_first = first + count, changed_last = first;
+
+		for (UINT i = first; i < first + count; i++)
+		{
+			if (bound[i] != resources[i].get())
+			{
+				bound[i] = resources[i].get();
+				changed_first = std::min(changed_first, i);
+				changed_last = i + 1;
+			}
+		}
+
+		if (changed_first < changed_last)
+		{
+			(context->*set_shader_resources)(changed_first, changed_last - changed_first, bound + changed_first);
+
+			bound_end = std::max(bound_end, changed_last);
+		}
+	}
+	static void unbind_shader_resources(ID3D11DeviceContext *context, set_shader_resources_func set_shader_resources, ID3D11ShaderResourceView **bound, UINT bound_end, const std::vector<com_ptr<ID3D11ShaderResourceView>> &resources)
+	{
+		for (UINT i = 0; i < bound_end; i++)
+		{
+			if (bound[i] != nullptr && std::find(resources.begin(), resources.end(), bound[i]) != resources.end())
+			{
+				bound[i] = nullptr;
+
+				(context->*set_shader_resources)(i, 1, &bound[i]);
+			}
+		}
+	}
+
 	d3d11_runtime::d3d11_runtime(ID3D11Device *device, IDXGISwapChain *swapchain) :
 		runtime(device->GetFeatureLevel()), _device(device), _swapchain(swapchain),
 		_stateblock(device)
@@ -27,6 +91,9 @@ namespace reshade::d3d11
 
 		_device->GetImmediateContext(&_immediate_context);
 
+		// Only available from Direct3D 11.1 on
+		_immediate_context->QueryInterface(&_annotation);
+
 		HRESULT hr;
 		DXGI_ADAPTER_DESC adapter_desc;
 		com_ptr<IDXGIDevice> dxgidevice;
@@ -217,6 +284,28 @@ namespace reshade::d3d11
 			}
 		}
 
+		// Scaling textures on the GPU is optional, image data is resized on the CPU instead if any of this fails
+		{
+			const resources::data_resource ps = resources::load_data_resource(IDR_RCDATA5);
+
+			if (FAILED(_device->CreatePixelShader(ps.data, ps.data_size, nullptr, &_scale_pixel_shader)))
+			{
+				_scale_pixel_shader.reset();
+			}
+
+			const D3D11_SAMPLER_DESC desc = {
+				D3D11_FILTER_MIN_MAG_MIP_LINEAR,
+				D3D11_TEXTURE_ADDRESS_CLAMP,
+				D3D11_TEXTURE_ADDRESS_CLAMP,
+				D3D11_TEXTURE_ADDRESS_CLAMP
+			};
+
+			if (FAILED(_device->CreateSamplerState(&desc, &_scale_sampler)))
+			{
+				_scale_pixel_shader.reset();
+			}
+		}
+
 		return true;
 	}
 	bool d3d11_runtime::init_default_depth_stencil()
@@ -451,6 +540,15 @@ namespace reshade::d3d11
 			return false;
 		}
 
+		// Replaying recorded passes only saves time when the driver supports command lists natively, otherwise the runtime issues every call again. Command lists cannot carry the pass markers, so techniques are rendered directly while those are enabled.
+		D3D11_FEATURE_DATA_THREADING threading_support = { };
+
+		if (SUCCEEDED(_device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading_support, sizeof(threading_support))) && threading_support.DriverCommandLists)
+		{
+			// This fails on devices created single threaded, which are handled by rendering directly as well
+			_device->CreateDeferredContext(0, &_deferred_context);
+		}
+
 		// Clear reference count to make UnrealEngine happy
 		_backbuffer->Release();
 
@@ -484,11 +582,15 @@ namespace reshade::d3d11
 		_depthstencil_texture_srv.reset();
 
 		_depth_texture_saves.clear();
+		last_depth_buffer_clear_count = 0;
 
 		_default_depthstencil.reset();
+		_deferred_context.reset();
 		_copy_vertex_shader.reset();
 		_copy_pixel_shader.reset();
 		_copy_sampler.reset();
+		_scale_pixel_shader.reset();
+		_scale_sampler.reset();
 
 		_effect_rasterizer_state.reset();
 
@@ -504,19 +606,23 @@ namespace reshade::d3d11
 		_imgui_depthstencil_state.reset();
 		_imgui_vertex_buffer_size = 0;
 		_imgui_index_buffer_size = 0;
+		_imgui_vertex_buffer_offset = 0;
+		_imgui_index_buffer_offset = 0;
+
+		for (auto &staging : _screenshot_staging)
+		{
+			staging.reset();
+		}
 	}
 	void d3d11_runtime::on_reset_effect()
 	{
 		runtime::on_reset_effect();
 
-		_effect_sampler_descs.clear();
-		_effect_sampler_states.clear();
 		_constant_buffers.clear();
+		_outdated_mipmaps.clear();
 
-		_effect_shader_resources.resize(3);
-		_effect_shader_resources[0] = _backbuffer_texture_srv[0];
-		_effect_shader_resources[1] = _backbuffer_texture_srv[1];
-		_effect_shader_resources[2] = _depthstencil_texture_srv;
+		_effect_shader_resource_count = 3;
+		_effect_sampler_count = 0;
 	}
 	void d3d11_runtime::on_present(draw_call_tracker &tracker)
 	{
@@ -526,10 +632,11 @@ namespace reshade::d3d11
 		_vertices = tracker.total_vertices();
 		_drawcalls = tracker.total_drawcalls();
 
-		_current_tracker = tracker;
+		// The tracker of the device is cleared right after this, so it can just take over what the last frame left in here, which keeps the memory of both around
+		std::swap(_current_tracker, tracker);
 
 #if RESHADE_DX11_CAPTURE_DEPTH_BUFFERS
-		detect_depth_source(tracker);
+		detect_depth_source(_current_tracker);
 #endif
 
 		// Evaluate queries
@@ -547,14 +654,42 @@ namespace reshade::d3d11
 					_immediate_context->GetData(technique_data.timestamp_query_end.get(), &timestamp1, sizeof(timestamp1), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
 				{
 					if (!disjoint_data.Disjoint)
-						technique.average_gpu_duration.append((timestamp1 - timestamp0) * 1'000'000'000 / disjoint_data.Frequency);
+					{
+						const uint64_t duration = (timestamp1 - timestamp0) * 1'000'000'000 / disjoint_data.Frequency;
+
+						if (technique.timings != nullptr)
+						{
+							technique.timings->average_gpu_duration.append(duration);
+							technique.timings->gpu_duration_samples.append(duration * 1e-6f);
+						}
+
+						// The passes finished before the end of the technique, so their timestamps are available too, unless a query could not be created for every one of them
+						if (_gpu_pass_timing && technique_data.pass_query_count == technique.passes.size())
+						{
+							UINT64 previous_timestamp = timestamp0;
+
+							for (size_t pass_index = 0; pass_index < technique_data.pass_query_count; pass_index++)
+							{
+								UINT64 timestamp;
+
+								if (_immediate_context->GetData(technique_data.timestamp_query_passes[pass_index].get(), &timestamp, sizeof(timestamp), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+								{
+									break;
+								}
+
+								append_pass_gpu_duration(technique, pass_index, technique.passes[pass_index]->as<d3d11_pass_data>()->name, (timestamp - previous_timestamp) * 1'000'000'000 / disjoint_data.Frequency);
+
+								previous_timestamp = timestamp;
+							}
+						}
+					}
 					technique_data.query_in_flight = false;
 				}
 			}
 		}
 
 		// Capture device state
-		_stateblock.capture(_immediate_context.get());
+		_stateblock.capture(_immediate_context.get(), static_cast<UINT>(_effect_shader_resource_count), static_cast<UINT>(_effect_sampler_count));
 
 		// Disable unused pipeline stages
 		_immediate_context->HSSetShader(nullptr, nullptr, 0);
@@ -567,58 +702,132 @@ namespace reshade::d3d11
 			_immediate_context->ResolveSubresource(_backbuffer_resolved.get(), 0, _backbuffer.get(), 0, _backbuffer_format);
 		}
 
-		// Apply post processing
-		if (is_effect_loaded())
+		// Frame contents changed since the back buffer texture was last updated
+		_is_backbuffer_texture_outdated = true;
+
+		// Apply post processing, unless that already happened earlier in the frame or nothing worth post processing is on screen
+		if (!_is_effects_applied && !is_effect_suspended())
 		{
-			// Setup real back buffer
-			const auto rtv = _backbuffer_rtv[0].get();
-			_immediate_context->OMSetRenderTargets(1, &rtv, nullptr);
+			render_effects();
+		}
 
-			// Setup vertex input
-			const uintptr_t null = 0;
-			_immediate_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-			_immediate_context->IASetInputLayout(nullptr);
-			_immediate_context->IASetVertexBuffers(0, 1, reinterpret_cast<ID3D11Buffer *const *>(&null), reinterpret_cast<const UINT *>(&null), reinterpret_cast<const UINT *>(&null));
+		_is_effects_applied = false;
 
-			_immediate_context->RSSetState(_effect_rasterizer_state.get());
+		// Apply presenting
+		runtime::on_present();
 
-			// Setup samplers
-			_immediate_context->VSSetSamplers(0, static_cast<UINT>(_effect_sampler_states.size()), reinterpret_cast<ID3D11SamplerState *const *>(_effect_sampler_states.data()));
-			_immediate_context->PSSetSamplers(0, static_cast<UINT>(_effect_sampler_states.size()), reinterpret_cast<ID3D11SamplerState *const *>(_effect_sampler_states.data()));
+		// Copy to back buffer
+		copy_to_backbuffer();
 
-			on_present_effect();
+		// Apply previous device state
+		_stateblock.apply_and_release();
+	}
+	bool d3d11_runtime::apply_effects()
+	{
+		if (!is_initialized() || !is_effect_loaded() || _is_effects_applied || is_effect_suspended())
+		{
+			return false;
 		}
 
-		// Apply presenting
-		runtime::on_present();
+		// Effects read and write the back buffer, intermediate targets the game composites later are not supported
+		com_ptr<ID3D11RenderTargetView> target;
+		_immediate_context->OMGetRenderTargets(1, &target, nullptr);
 
-		// Copy to back buffer
-		if (_backbuffer_resolved != _backbuffer)
+		if (target == nullptr)
 		{
-			_immediate_context->CopyResource(_backbuffer_texture.get(), _backbuffer_resolved.get());
+			return false;
+		}
 
-			const auto rtv = _backbuffer_rtv[2].get();
-			_immediate_context->OMSetRenderTargets(1, &rtv, nullptr);
+		com_ptr<ID3D11Resource> target_resource;
+		target->GetResource(&target_resource);
 
-			const uintptr_t null = 0;
-			_immediate_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-			_immediate_context->IASetInputLayout(nullptr);
-			_immediate_context->IASetVertexBuffers(0, 1, reinterpret_cast<ID3D11Buffer *const *>(&null), reinterpret_cast<const UINT *>(&null), reinterpret_cast<const UINT *>(&null));
+		if (target_resource.get() != static_cast<ID3D11Resource *>(_backbuffer.get()))
+		{
+			return false;
+		}
 
-			_immediate_context->RSSetState(_effect_rasterizer_state.get());
+		_stateblock.capture(_immediate_context.get(), static_cast<UINT>(_effect_shader_resource_count), static_cast<UINT>(_effect_sampler_count));
 
-			_immediate_context->VSSetShader(_copy_vertex_shader.get(), nullptr, 0);
-			_immediate_context->PSSetShader(_copy_pixel_shader.get(), nullptr, 0);
-			const auto sst = _copy_sampler.get();
-			_immediate_context->PSSetSamplers(0, 1, &sst);
-			const auto srv = _backbuffer_texture_srv[make_format_srgb(_backbuffer_format) == _backbuffer_format].get();
-			_immediate_context->PSSetShaderResources(0, 1, &srv);
+		_immediate_context->HSSetShader(nullptr, nullptr, 0);
+		_immediate_context->DSSetShader(nullptr, nullptr, 0);
+		_immediate_context->GSSetShader(nullptr, nullptr, 0);
 
-			_immediate_context->Draw(3, 0);
+		if (_backbuffer_resolved != _backbuffer)
+		{
+			_immediate_context->ResolveSubresource(_backbuffer_resolved.get(), 0, _backbuffer.get(), 0, _backbuffer_format);
 		}
 
-		// Apply previous device state
+		_is_backbuffer_texture_outdated = true;
+
+		render_effects();
+
+		// The game keeps drawing into the real back buffer, so the result has to be in there and not only in the resolved copy
+		copy_to_backbuffer();
+
 		_stateblock.apply_and_release();
+
+		_is_effects_applied = true;
+
+		return true;
+	}
+	void d3d11_runtime::render_effects()
+	{
+		if (!is_effect_loaded())
+		{
+			return;
+		}
+
+		// Setup real back buffer
+		const auto rtv = _backbuffer_rtv[0].get();
+		_immediate_context->OMSetRenderTargets(1, &rtv, nullptr);
+
+		// Passes only bind the shader resource slots they read and leave them unbound after every technique, so clear what the game left bound once up front
+		ID3D11ShaderResourceView *null_srv[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = { nullptr };
+		const UINT shader_resource_count = static_cast<UINT>(std::min<size_t>(_effect_shader_resource_count, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT));
+		_immediate_context->VSSetShaderResources(0, shader_resource_count, null_srv);
+		_immediate_context->PSSetShaderResources(0, shader_resource_count, null_srv);
+
+		// Setup vertex input
+		const uintptr_t null = 0;
+		_immediate_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		_immediate_context->IASetInputLayout(nullptr);
+		_immediate_context->IASetVertexBuffers(0, 1, reinterpret_cast<ID3D11Buffer *const *>(&null), reinterpret_cast<const UINT *>(&null), reinterpret_cast<const UINT *>(&null));
+
+		_immediate_context->RSSetState(_effect_rasterizer_state.get());
+
+		on_present_effect();
+	}
+	void d3d11_runtime::copy_to_backbuffer()
+	{
+		if (_backbuffer_resolved == _backbuffer)
+		{
+			return;
+		}
+
+		_immediate_context->CopyResource(_backbuffer_texture.get(), _backbuffer_resolved.get());
+
+		const auto rtv = _backbuffer_rtv[2].get();
+		_immediate_context->OMSetRenderTargets(1, &rtv, nullptr);
+
+		const uintptr_t null = 0;
+		_immediate_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		_immediate_context->IASetInputLayout(nullptr);
+		_immediate_context->IASetVertexBuffers(0, 1, reinterpret_cast<ID3D11Buffer *const *>(&null), reinterpret_cast<const UINT *>(&null), reinterpret_cast<const UINT *>(&null));
+
+		_immediate_context->RSSetState(_effect_rasterizer_state.get());
+
+		// Uploading a scaled texture may have changed the viewport since the effects were rendered
+		const D3D11_VIEWPORT viewport = { 0, 0, static_cast<FLOAT>(_width), static_cast<FLOAT>(_height), 0, 1 };
+		_immediate_context->RSSetViewports(1, &viewport);
+
+		_immediate_context->VSSetShader(_copy_vertex_shader.get(), nullptr, 0);
+		_immediate_context->PSSetShader(_copy_pixel_shader.get(), nullptr, 0);
+		const auto sst = _copy_sampler.get();
+		_immediate_context->PSSetSamplers(0, 1, &sst);
+		const auto srv = _backbuffer_texture_srv[make_format_srgb(_backbuffer_format) == _backbuffer_format].get();
+		_immediate_context->PSSetShaderResources(0, 1, &srv);
+
+		_immediate_context->Draw(3, 0);
 	}
 
 	void d3d11_runtime::capture_frame(uint8_t *buffer) const
@@ -632,6 +841,56 @@ namespace reshade::d3d11
 			return;
 		}
 
+		const com_ptr<ID3D11Texture2D> texture_staging = create_staging_texture();
+
+		if (texture_staging == nullptr)
+		{
+			return;
+		}
+
+		_immediate_context->CopyResource(texture_staging.get(), _backbuffer_resolved.get());
+
+		read_staging_texture(texture_staging.get(), 0, buffer);
+	}
+	bool d3d11_runtime::begin_frame_capture(unsigned int slot)
+	{
+		if (_backbuffer_format != DXGI_FORMAT_R8G8B8A8_UNORM &&
+			_backbuffer_format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB &&
+			_backbuffer_format != DXGI_FORMAT_B8G8R8A8_UNORM &&
+			_backbuffer_format != DXGI_FORMAT_B8G8R8A8_UNORM_SRGB)
+		{
+			return false;
+		}
+
+		auto &texture_staging = _screenshot_staging[slot];
+
+		if (texture_staging == nullptr)
+		{
+			texture_staging = create_staging_texture();
+
+			if (texture_staging == nullptr)
+			{
+				return false;
+			}
+		}
+
+		_immediate_context->CopyResource(texture_staging.get(), _backbuffer_resolved.get());
+
+		return true;
+	}
+	bool d3d11_runtime::finish_frame_capture(unsigned int slot, uint8_t *buffer, bool wait)
+	{
+		const auto &texture_staging = _screenshot_staging[slot];
+
+		if (texture_staging == nullptr)
+		{
+			return false;
+		}
+
+		return read_staging_texture(texture_staging.get(), wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, buffer);
+	}
+	com_ptr<ID3D11Texture2D> d3d11_runtime::create_staging_texture() const
+	{
 		D3D11_TEXTURE2D_DESC texture_desc = { };
 		texture_desc.Width = _width;
 		texture_desc.Height = _height;
@@ -644,51 +903,46 @@ namespace reshade::d3d11
 
 		com_ptr<ID3D11Texture2D> texture_staging;
 
-		HRESULT hr = _device->CreateTexture2D(&texture_desc, nullptr, &texture_staging);
+		const HRESULT hr = _device->CreateTexture2D(&texture_desc, nullptr, &texture_staging);
 
 		if (FAILED(hr))
 		{
 			LOG(ERROR) << "Failed to create staging resource for screenshot capture! HRESULT is '" << std::hex << hr << std::dec << "'.";
-			return;
 		}
 
-		_immediate_context->CopyResource(texture_staging.get(), _backbuffer_resolved.get());
-
+		return texture_staging;
+	}
+	bool d3d11_runtime::read_staging_texture(ID3D11Texture2D *staging, UINT map_flags, uint8_t *buffer) const
+	{
 		D3D11_MAPPED_SUBRESOURCE mapped;
-		hr = _immediate_context->Map(texture_staging.get(), 0, D3D11_MAP_READ, 0, &mapped);
+		const HRESULT hr = _immediate_context->Map(staging, 0, D3D11_MAP_READ, map_flags, &mapped);
 
-		if (FAILED(hr))
+		if (hr == DXGI_ERROR_WAS_STILL_DRAWING)
 		{
-			LOG(ERROR) << "Failed to map staging resource with screenshot capture! HRESULT is '" << std::hex << hr << std::dec << "'.";
-			return;
+			return false;
 		}
-
-		auto mapped_data = static_cast<BYTE *>(mapped.pData);
-		const UINT pitch = texture_desc.Width * 4;
-
-		for (UINT y = 0; y < texture_desc.Height; y++)
+		else if (FAILED(hr))
 		{
-			CopyMemory(buffer, mapped_data, std::min(pitch, static_cast<UINT>(mapped.RowPitch)));
-
-			for (UINT x = 0; x < pitch; x += 4)
-			{
-				buffer[x + 3] = 0xFF;
+			LOG(ERROR) << "Failed to map staging resource with screenshot capture! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
 
-				if (texture_desc.Format == DXGI_FORMAT_B8G8R8A8_UNORM || texture_desc.Format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB)
-				{
-					std::swap(buffer[x + 0], buffer[x + 2]);
-				}
-			}
+		pixel_conversion::copy_rows_to_rgba(buffer, static_cast<const uint8_t *>(mapped.pData), mapped.RowPitch, _width, _height,
+			_backbuffer_format == DXGI_FORMAT_B8G8R8A8_UNORM || _backbuffer_format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB);
 
-			buffer += pitch;
-			mapped_data += mapped.RowPitch;
-		}
+		_immediate_context->Unmap(staging, 0);
 
-		_immediate_context->Unmap(texture_staging.get(), 0);
+		return true;
+	}
+	std::unique_ptr<base_object> d3d11_runtime::compile_effect(const reshadefx::syntax_tree &ast, std::string &errors, bool half_precision)
+	{
+		auto compiler = std::make_unique<d3d11_effect_compiler>(this, ast, errors, false, half_precision);
+		compiler->compile();
+		return compiler;
 	}
-	bool d3d11_runtime::load_effect(const reshadefx::syntax_tree &ast, std::string &errors)
+	bool d3d11_runtime::load_effect(base_object &module)
 	{
-		return d3d11_effect_compiler(this, ast, errors, false).run();
+		return module.as<d3d11_effect_compiler>()->run();
 	}
 	bool d3d11_runtime::update_texture(texture &texture, const uint8_t *data)
 	{
@@ -736,105 +990,594 @@ namespace reshade::d3d11
 		return true;
 	}
 
+	bool d3d11_runtime::update_texture_compressed(texture &texture, const uint8_t *data, unsigned int levels)
+	{
+		if (texture.impl_reference != texture_reference::none)
+		{
+			return false;
+		}
+
+		const auto texture_impl = texture.impl->as<d3d11_tex_data>();
+
+		assert(data != nullptr);
+		assert(texture_impl != nullptr);
+
+		const UINT block_size = compressed_block_size(texture.format);
+
+		if (block_size == 0)
+		{
+			return false;
+		}
+
+		for (UINT level = 0; level < std::min(levels, texture.levels); level++)
+		{
+			const UINT row_size = std::max(1u, ((texture.width >> level) + 3) / 4) * block_size;
+			const UINT rows = std::max(1u, ((texture.height >> level) + 3) / 4);
+
+			_immediate_context->UpdateSubresource(texture_impl->texture.get(), level, nullptr, data, row_size, row_size * rows);
+
+			data += row_size * rows;
+		}
+
+		return true;
+	}
+
+	bool d3d11_runtime::supports_texture_scaling(const texture &texture) const
+	{
+		return texture.impl_reference == texture_reference::none && texture.format == texture_format::rgba8 && _scale_pixel_shader != nullptr;
+	}
+	bool d3d11_runtime::update_texture_scaled(texture &texture, const uint8_t *data, unsigned int width, unsigned int height)
+	{
+		if (!supports_texture_scaling(texture))
+		{
+			return false;
+		}
+
+		const auto texture_impl = texture.impl->as<d3d11_tex_data>();
+
+		assert(data != nullptr);
+		assert(texture_impl != nullptr);
+
+		// The image at its full resolution with a mipmap chain, so that it is never scaled down by more than a factor of two in one step
+		D3D11_TEXTURE2D_DESC desc = { };
+		desc.Width = width;
+		desc.Height = height;
+		desc.MipLevels = 0;
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+		com_ptr<ID3D11Texture2D> scale_texture;
+		com_ptr<ID3D11ShaderResourceView> scale_srv, level_srv;
+		HRESULT hr = _device->CreateTexture2D(&desc, nullptr, &scale_texture);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = _device->CreateShaderResourceView(scale_texture.get(), nullptr, &scale_srv);
+		}
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to create texture for scaling texture data! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		// The effect compiler only creates render target views for textures a pass renders to
+		if (texture_impl->rtv[0] == nullptr)
+		{
+			D3D11_TEXTURE2D_DESC texture_desc;
+			texture_impl->texture->GetDesc(&texture_desc);
+
+			D3D11_RENDER_TARGET_VIEW_DESC rtvdesc = { };
+			rtvdesc.Format = make_format_normal(texture_desc.Format);
+			rtvdesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+
+			hr = _device->CreateRenderTargetView(texture_impl->texture.get(), &rtvdesc, &texture_impl->rtv[0]);
+
+			if (FAILED(hr))
+			{
+				LOG(ERROR) << "Failed to create render target for scaling texture data! HRESULT is '" << std::hex << hr << std::dec << "'.";
+				return false;
+			}
+		}
+
+		_immediate_context->UpdateSubresource(scale_texture.get(), 0, nullptr, data, width * 4, width * height * 4);
+		_immediate_context->GenerateMips(scale_srv.get());
+
+		scale_texture->GetDesc(&desc);
+
+		// Scale from the smallest level that is still at least as large as the texture, so the bilinear filter does not skip over any source pixels
+		UINT level = 0;
+
+		while (level + 1 < desc.MipLevels && (width >> (level + 1)) >= texture.width && (height >> (level + 1)) >= texture.height)
+		{
+			level++;
+		}
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvdesc = { };
+		srvdesc.Format = desc.Format;
+		srvdesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvdesc.Texture2D.MostDetailedMip = level;
+		srvdesc.Texture2D.MipLevels = 1;
+
+		hr = _device->CreateShaderResourceView(scale_texture.get(), &srvdesc, &level_srv);
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to create texture for scaling texture data! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		// This is only called while presenting, where the state block restores everything changed here afterwards
+		const auto rtv = texture_impl->rtv[0].get();
+		_immediate_context->OMSetRenderTargets(1, &rtv, nullptr);
+		_immediate_context->OMSetBlendState(nullptr, nullptr, D3D11_DEFAULT_SAMPLE_MASK);
+		_immediate_context->OMSetDepthStencilState(nullptr, 0);
+
+		const uintptr_t null = 0;
+		_immediate_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		_immediate_context->IASetInputLayout(nullptr);
+		_immediate_context->IASetVertexBuffers(0, 1, reinterpret_cast<ID3D11Buffer *const *>(&null), reinterpret_cast<const UINT *>(&null), reinterpret_cast<const UINT *>(&null));
+
+		_immediate_context->RSSetState(_effect_rasterizer_state.get());
+
+		const D3D11_VIEWPORT viewport = { 0, 0, static_cast<FLOAT>(texture.width), static_cast<FLOAT>(texture.height), 0, 1 };
+		_immediate_context->RSSetViewports(1, &viewport);
+
+		_immediate_context->VSSetShader(_copy_vertex_shader.get(), nullptr, 0);
+		_immediate_context->PSSetShader(_scale_pixel_shader.get(), nullptr, 0);
+		const auto sst = _scale_sampler.get();
+		_immediate_context->PSSetSamplers(0, 1, &sst);
+		const auto srv = level_srv.get();
+		_immediate_context->PSSetShaderResources(0, 1, &srv);
+
+		_immediate_context->Draw(3, 0);
+
+		// Unbind the texture again, so generating its mipmaps does not conflict with it being a render target
+		ID3D11ShaderResourceView *const null_srv = nullptr;
+		_immediate_context->OMSetRenderTargets(0, nullptr, nullptr);
+		_immediate_context->PSSetShaderResources(0, 1, &null_srv);
+
+		if (texture.levels > 1)
+		{
+			_immediate_context->GenerateMips(texture_impl->srv[0].get());
+		}
+
+		return true;
+	}
+
 	void d3d11_runtime::render_technique(const technique &technique)
 	{
+		const gpu_marker technique_marker(_gpu_markers ? _annotation.get() : nullptr, technique.name);
+
 		d3d11_technique_data &technique_data = *technique.impl->as<d3d11_technique_data>();
 
+		// Passes can only be timed one by one when they are rendered here and not replayed from the command list
+		const bool issue_pass_queries = !technique_data.query_in_flight && _gpu_pass_timing;
+
 		if (!technique_data.query_in_flight)
 		{
 			_immediate_context->Begin(technique_data.timestamp_disjoint.get());
 			_immediate_context->End(technique_data.timestamp_query_beg.get());
+			technique_data.pass_query_count = 0;
 		}
 
-		bool is_default_depthstencil_cleared = false;
-
 		// Setup shader constants
+		ID3D11Buffer *constant_buffer = nullptr;
+
 		if (technique.uniform_storage_index >= 0)
 		{
-			const auto constant_buffer = _constant_buffers[technique.uniform_storage_index].get();
-			D3D11_MAPPED_SUBRESOURCE mapped;
+			constant_buffer = _constant_buffers[technique.uniform_storage_index].get();
 
-			const HRESULT hr = _immediate_context->Map(constant_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+			D3D11_BUFFER_DESC desc;
+			constant_buffer->GetDesc(&desc);
 
-			if (SUCCEEDED(hr))
+			// Constant buffers keep their contents, so only upload when a uniform changed. Techniques of the same effect share the buffer.
+			size_t dirty_offset, dirty_size;
+
+			if (consume_uniform_changes(static_cast<size_t>(technique.uniform_storage_offset), desc.ByteWidth, dirty_offset, dirty_size))
 			{
-				CopyMemory(mapped.pData, get_uniform_value_storage().data() + technique.uniform_storage_offset, mapped.RowPitch);
+				D3D11_MAPPED_SUBRESOURCE mapped;
+
+				const HRESULT hr = _immediate_context->Map(constant_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
 
-				_immediate_context->Unmap(constant_buffer, 0);
+				if (SUCCEEDED(hr))
+				{
+					CopyMemory(mapped.pData, get_uniform_value_storage().data() + technique.uniform_storage_offset, desc.ByteWidth);
+
+					_immediate_context->Unmap(constant_buffer, 0);
+				}
+				else
+				{
+					LOG(ERROR) << "Failed to map constant buffer! HRESULT is '" << std::hex << hr << std::dec << "'!";
+				}
 			}
-			else
+		}
+
+		if (_deferred_context != nullptr && !_gpu_pass_timing && !_gpu_markers &&
+			((technique_data.command_list != nullptr && technique_data.command_list_generation == _effect_resources_generation) || record_technique(technique, constant_buffer)))
+		{
+			// Only the work that depends on what earlier techniques did this frame happens here, everything else is in the command list
+			if (technique_data.copies_backbuffer_on_entry && _is_backbuffer_texture_outdated)
 			{
-				LOG(ERROR) << "Failed to map constant buffer! HRESULT is '" << std::hex << hr << std::dec << "'!";
+				_immediate_context->CopyResource(_backbuffer_texture.get(), _backbuffer_resolved.get());
+
+				_is_backbuffer_texture_outdated = false;
 			}
 
-			_immediate_context->VSSetConstantBuffers(0, 1, &constant_buffer);
-			_immediate_context->PSSetConstantBuffers(0, 1, &constant_buffer);
-		}
+			for (const auto &resource : technique_data.mipmap_reads_on_entry)
+			{
+				const auto it = std::find_if(_outdated_mipmaps.begin(), _outdated_mipmaps.end(), [&resource](const auto &entry) { return entry.first == resource; });
 
-		for (const auto &pass_object : technique.passes)
-		{
-			const d3d11_pass_data &pass = *pass_object->as<d3d11_pass_data>();
+				if (it != _outdated_mipmaps.end())
+				{
+					_immediate_context->GenerateMips(it->second.get());
 
-			// Setup states
-			_immediate_context->VSSetShader(pass.vertex_shader.get(), nullptr, 0);
-			_immediate_context->PSSetShader(pass.pixel_shader.get(), nullptr, 0);
+					_outdated_mipmaps.erase(it);
+				}
+			}
 
-			_immediate_context->OMSetBlendState(pass.blend_state.get(), nullptr, D3D11_DEFAULT_SAMPLE_MASK);
-			_immediate_context->OMSetDepthStencilState(pass.depth_stencil_state.get(), pass.stencil_reference);
+			// The constant buffer was updated above, which the command list sees, since it only references the buffer
+			_immediate_context->ExecuteCommandList(technique_data.command_list.get(), TRUE);
 
-			// Save back buffer of previous pass
-			_immediate_context->CopyResource(_backbuffer_texture.get(), _backbuffer_resolved.get());
+			_vertices += technique_data.vertices;
+			_drawcalls += technique_data.drawcalls;
 
-			// Setup shader resources
-			_immediate_context->VSSetShaderResources(0, static_cast<UINT>(pass.shader_resources.size()), reinterpret_cast<ID3D11ShaderResourceView *const *>(pass.shader_resources.data()));
-			_immediate_context->PSSetShaderResources(0, static_cast<UINT>(pass.shader_resources.size()), reinterpret_cast<ID3D11ShaderResourceView *const *>(pass.shader_resources.data()));
+			if (technique_data.writes_backbuffer)
+			{
+				_is_backbuffer_texture_outdated = technique_data.leaves_backbuffer_outdated;
+			}
 
-			// Setup render targets
-			if (static_cast<UINT>(pass.viewport.Width) == _width && static_cast<UINT>(pass.viewport.Height) == _height)
+			_outdated_mipmaps.erase(std::remove_if(_outdated_mipmaps.begin(), _outdated_mipmaps.end(),
+				[&technique_data](const auto &entry) { return std::find(technique_data.mipmap_writes.begin(), technique_data.mipmap_writes.end(), entry.first) != technique_data.mipmap_writes.end(); }), _outdated_mipmaps.end());
+			_outdated_mipmaps.insert(_outdated_mipmaps.end(), technique_data.outdated_mipmaps_on_exit.begin(), technique_data.outdated_mipmaps_on_exit.end());
+		}
+		else
+		{
+			if (constant_buffer != nullptr)
 			{
-				_immediate_context->OMSetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, reinterpret_cast<ID3D11RenderTargetView *const *>(pass.render_targets), _default_depthstencil.get());
+				_immediate_context->VSSetConstantBuffers(0, 1, &constant_buffer);
+				_immediate_context->PSSetConstantBuffers(0, 1, &constant_buffer);
+			}
 
-				if (!is_default_depthstencil_cleared)
-				{
-					is_default_depthstencil_cleared = true;
+			// Every effect has its own sampler slots, so they are set for each technique
+			const UINT sampler_count = static_cast<UINT>(technique_data.sampler_states.size());
+			const auto samplers = reinterpret_cast<ID3D11SamplerState *const *>(technique_data.sampler_states.data());
+			_immediate_context->VSSetSamplers(0, sampler_count, samplers);
+			_immediate_context->PSSetSamplers(0, sampler_count, samplers);
 
-					_immediate_context->ClearDepthStencilView(_default_depthstencil.get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
-				}
-			}
-			else
+			if (_device->GetFeatureLevel() >= D3D_FEATURE_LEVEL_11_0)
 			{
-				_immediate_context->OMSetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, reinterpret_cast<ID3D11RenderTargetView *const *>(pass.render_targets), nullptr);
+				_immediate_context->CSSetSamplers(0, sampler_count, samplers);
 			}
 
-			_immediate_context->RSSetViewports(1, &pass.viewport);
+			bool is_default_depthstencil_cleared = false;
+			d3d11_pass_bindings bindings;
 
-			if (pass.clear_render_targets)
+			for (const auto &pass_object : technique.passes)
 			{
-				for (const auto &target : pass.render_targets)
+				const d3d11_pass_data &pass = *pass_object->as<d3d11_pass_data>();
+
+				const gpu_marker pass_marker(_gpu_markers ? _annotation.get() : nullptr, pass.name);
+
+				// Save back buffer of previous pass, but only if this pass reads it and it changed since the last copy
+				if (pass.samples_backbuffer && _is_backbuffer_texture_outdated)
+				{
+					_immediate_context->CopyResource(_backbuffer_texture.get(), _backbuffer_resolved.get());
+
+					_is_backbuffer_texture_outdated = false;
+				}
+
+				// Generate mipmaps of render targets written earlier, but only once a pass can actually read them
+				if (!_outdated_mipmaps.empty())
+				{
+					for (const auto &srv : pass.shader_resources)
+					{
+						if (srv == nullptr)
+						{
+							continue;
+						}
+
+						com_ptr<ID3D11Resource> resource;
+						srv->GetResource(&resource);
+
+						const auto it = std::find_if(_outdated_mipmaps.begin(), _outdated_mipmaps.end(), [&resource](const auto &entry) { return entry.first == resource; });
+
+						if (it != _outdated_mipmaps.end())
+						{
+							// The texture may still be bound from the previous pass
+							reset_pass_bindings(_immediate_context.get(), bindings);
+
+							_immediate_context->GenerateMips(it->second.get());
+
+							_outdated_mipmaps.erase(it);
+						}
+					}
+				}
+
+				render_pass(_immediate_context.get(), pass, constant_buffer, bindings, is_default_depthstencil_cleared);
+
+				if (issue_pass_queries)
+				{
+					issue_pass_timestamp_query(technique_data);
+				}
+
+				if (pass.writes_backbuffer)
+				{
+					_is_backbuffer_texture_outdated = true;
+				}
+
+				// Update shader resources
+				for (const auto &resource : pass.render_target_resources)
 				{
-					if (target != nullptr)
+					if (resource == nullptr)
 					{
-						const float color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-						_immediate_context->ClearRenderTargetView(target.get(), color);
+						continue;
+					}
+
+					D3D11_SHADER_RESOURCE_VIEW_DESC resource_desc;
+					resource->GetDesc(&resource_desc);
+
+					if (resource_desc.Texture2D.MipLevels > 1)
+					{
+						com_ptr<ID3D11Resource> texture;
+						resource->GetResource(&texture);
+
+						if (std::find_if(_outdated_mipmaps.begin(), _outdated_mipmaps.end(), [&texture](const auto &entry) { return entry.first == texture; }) == _outdated_mipmaps.end())
+						{
+							_outdated_mipmaps.emplace_back(std::move(texture), resource);
+						}
 					}
 				}
 			}
 
-			// Draw triangle
-			_immediate_context->Draw(3, 0);
+			reset_pass_bindings(_immediate_context.get(), bindings);
+		}
+
+		if (!technique_data.query_in_flight)
+		{
+			_immediate_context->End(technique_data.timestamp_query_end.get());
+			_immediate_context->End(technique_data.timestamp_disjoint.get());
+			technique_data.query_in_flight = true;
+		}
+	}
+	void d3d11_runtime::issue_pass_timestamp_query(d3d11_technique_data &technique_data)
+	{
+		if (technique_data.pass_query_count == technique_data.timestamp_query_passes.size())
+		{
+			D3D11_QUERY_DESC query_desc = { };
+			query_desc.Query = D3D11_QUERY_TIMESTAMP;
+
+			com_ptr<ID3D11Query> query;
+
+			if (FAILED(_device->CreateQuery(&query_desc, &query)))
+			{
+				return;
+			}
+
+			technique_data.timestamp_query_passes.push_back(std::move(query));
+		}
+
+		_immediate_context->End(technique_data.timestamp_query_passes[technique_data.pass_query_count++].get());
+	}
+	void d3d11_runtime::render_pass(ID3D11DeviceContext *context, const d3d11_pass_data &pass, ID3D11Buffer *constant_buffer, d3d11_pass_bindings &bindings, bool &is_default_depthstencil_cleared)
+	{
+		if (pass.compute_shader != nullptr)
+		{
+			// Storage may be bound as a render target or read by the previous pass, and compute passes are rare enough to simply start from nothing bound
+			reset_pass_bindings(context, bindings);
+
+			context->CSSetShader(pass.compute_shader.get(), nullptr, 0);
+			context->CSSetConstantBuffers(0, 1, &constant_buffer);
+			context->CSSetShaderResources(pass.ps_resource_first, pass.ps_resource_count, reinterpret_cast<ID3D11ShaderResourceView *const *>(pass.shader_resources.data() + pass.ps_resource_first));
+			context->CSSetUnorderedAccessViews(0, static_cast<UINT>(pass.unordered_access_views.size()), reinterpret_cast<ID3D11UnorderedAccessView *const *>(pass.unordered_access_views.data()), nullptr);
+
+			context->Dispatch(pass.dispatch_size[0], pass.dispatch_size[1], pass.dispatch_size[2]);
 
-			_vertices += 3;
 			_drawcalls += 1;
 
-			// Reset render targets
-			_immediate_context->OMSetRenderTargets(0, nullptr, nullptr);
+			// Unbind the storage again, so the next pass can read what this one wrote. That is all the synchronization needed, since Direct3D 11 orders the accesses to a resource between dispatches and draws by itself.
+			ID3D11UnorderedAccessView *null_uav[D3D11_PS_CS_UAV_REGISTER_COUNT] = { nullptr };
+			context->CSSetUnorderedAccessViews(0, static_cast<UINT>(pass.unordered_access_views.size()), null_uav, nullptr);
 
-			// Reset shader resources
 			ID3D11ShaderResourceView *null[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = { nullptr };
-			_immediate_context->VSSetShaderResources(0, static_cast<UINT>(pass.shader_resources.size()), null);
-			_immediate_context->PSSetShaderResources(0, static_cast<UINT>(pass.shader_resources.size()), null);
+			context->CSSetShaderResources(pass.ps_resource_first, pass.ps_resource_count, null);
+			context->CSSetShader(nullptr, nullptr, 0);
+			return;
+		}
+
+		// Setup states
+		context->VSSetShader(pass.vertex_shader.get(), nullptr, 0);
+		context->PSSetShader(pass.pixel_shader.get(), nullptr, 0);
+
+		context->OMSetBlendState(pass.blend_state.get(), nullptr, D3D11_DEFAULT_SAMPLE_MASK);
+		context->OMSetDepthStencilState(pass.depth_stencil_state.get(), pass.stencil_reference);
+
+		// Views an earlier pass left bound to the shader stages have to go before their textures can be render targets, all other views stay bound until a pass needs the slot
+		if (!pass.render_target_aliases.empty())
+		{
+			unbind_shader_resources(context, &ID3D11DeviceContext::VSSetShaderResources, bindings.vs_resources, bindings.vs_resource_end, pass.render_target_aliases);
+			unbind_shader_resources(context, &ID3D11DeviceContext::PSSetShaderResources, bindings.ps_resources, bindings.ps_resource_end, pass.render_target_aliases);
+		}
+
+		// Setup render targets, but only if they differ from those of the previous pass
+		const bool uses_default_depthstencil = static_cast<UINT>(pass.viewport.Width) == _width && static_cast<UINT>(pass.viewport.Height) == _height;
+		ID3D11DepthStencilView *const depth_stencil = uses_default_depthstencil ? _default_depthstencil.get() : nullptr;
+
+		if (bindings.render_targets_unknown || bindings.render_target_count != pass.render_target_count || bindings.depth_stencil != depth_stencil ||
+			!std::equal(pass.render_targets, pass.render_targets + pass.render_target_count, bindings.render_targets, [](const auto &target, auto bound) { return target == bound; }))
+		{
+			context->OMSetRenderTargets(pass.render_target_count, reinterpret_cast<ID3D11RenderTargetView *const *>(pass.render_targets), depth_stencil);
+
+			bindings.render_targets_unknown = false;
+			bindings.render_target_count = pass.render_target_count;
+			bindings.depth_stencil = depth_stencil;
+
+			for (UINT i = 0; i < pass.render_target_count; i++)
+			{
+				bindings.render_targets[i] = pass.render_targets[i].get();
+			}
+		}
+
+		if (uses_default_depthstencil && !is_default_depthstencil_cleared)
+		{
+			is_default_depthstencil_cleared = true;
+
+			context->ClearDepthStencilView(_default_depthstencil.get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+		}
+
+		// Setup shader resources, after the render targets, so no view is bound to a shader stage while its texture is still bound as a render target of the previous pass
+		update_shader_resources(context, &ID3D11DeviceContext::VSSetShaderResources, bindings.vs_resources, bindings.vs_resource_end, pass.shader_resources.data(), pass.vs_resource_first, pass.vs_resource_count);
+		update_shader_resources(context, &ID3D11DeviceContext::PSSetShaderResources, bindings.ps_resources, bindings.ps_resource_end, pass.shader_resources.data(), pass.ps_resource_first, pass.ps_resource_count);
+
+		context->RSSetViewports(1, &pass.viewport);
+
+		if (pass.clear_render_targets)
+		{
+			for (const auto &target : pass.render_targets)
+			{
+				if (target != nullptr)
+				{
+					const float color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+					context->ClearRenderTargetView(target.get(), color);
+				}
+			}
+		}
+
+		// Draw triangle
+		context->Draw(3, 0);
+
+		_vertices += 3;
+		_drawcalls += 1;
+	}
+	void d3d11_runtime::reset_pass_bindings(ID3D11DeviceContext *context, d3d11_pass_bindings &bindings)
+	{
+		if (bindings.render_targets_unknown || bindings.render_target_count != 0 || bindings.depth_stencil != nullptr)
+		{
+			context->OMSetRenderTargets(0, nullptr, nullptr);
+
+			bindings.render_targets_unknown = false;
+			bindings.render_target_count = 0;
+			bindings.depth_stencil = nullptr;
+		}
+
+		ID3D11ShaderResourceView *null[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = { nullptr };
+
+		if (bindings.vs_resource_end != 0)
+		{
+			context->VSSetShaderResources(0, bindings.vs_resource_end, null);
+
+			std::fill_n(bindings.vs_resources, bindings.vs_resource_end, nullptr);
+			bindings.vs_resource_end = 0;
+		}
+		if (bindings.ps_resource_end != 0)
+		{
+			context->PSSetShaderResources(0, bindings.ps_resource_end, null);
+
+			std::fill_n(bindings.ps_resources, bindings.ps_resource_end, nullptr);
+			bindings.ps_resource_end = 0;
+		}
+	}
+	bool d3d11_runtime::record_technique(const technique &technique, ID3D11Buffer *constant_buffer)
+	{
+		d3d11_technique_data &technique_data = *technique.impl->as<d3d11_technique_data>();
+
+		technique_data.command_list.reset();
+		technique_data.mipmap_reads_on_entry.clear();
+		technique_data.mipmap_writes.clear();
+		technique_data.outdated_mipmaps_on_exit.clear();
+		technique_data.copies_backbuffer_on_entry = false;
+		technique_data.writes_backbuffer = false;
+		technique_data.leaves_backbuffer_outdated = false;
+
+		// A deferred context starts out with the default state, so it gets everything 'render_effects' sets up on the immediate context
+		const uintptr_t null = 0;
+		_deferred_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		_deferred_context->IASetInputLayout(nullptr);
+		_deferred_context->IASetVertexBuffers(0, 1, reinterpret_cast<ID3D11Buffer *const *>(&null), reinterpret_cast<const UINT *>(&null), reinterpret_cast<const UINT *>(&null));
+
+		_deferred_context->RSSetState(_effect_rasterizer_state.get());
+
+		const UINT sampler_count = static_cast<UINT>(technique_data.sampler_states.size());
+		const auto samplers = reinterpret_cast<ID3D11SamplerState *const *>(technique_data.sampler_states.data());
+		_deferred_context->VSSetSamplers(0, sampler_count, samplers);
+		_deferred_context->PSSetSamplers(0, sampler_count, samplers);
+
+		if (_device->GetFeatureLevel() >= D3D_FEATURE_LEVEL_11_0)
+		{
+			_deferred_context->CSSetSamplers(0, sampler_count, samplers);
+		}
+
+		if (constant_buffer != nullptr)
+		{
+			_deferred_context->VSSetConstantBuffers(0, 1, &constant_buffer);
+			_deferred_context->PSSetConstantBuffers(0, 1, &constant_buffer);
+		}
+
+		// Follow the back buffer copy and mipmaps the same way 'render_technique' does, but only for what happens inside this technique, the rest is left to when the command list is executed
+		bool is_backbuffer_outdated = false;
+		bool is_default_depthstencil_cleared = false;
+		d3d11_pass_bindings bindings;
+		std::vector<std::pair<com_ptr<ID3D11Resource>, com_ptr<ID3D11ShaderResourceView>>> outdated_mipmaps;
+
+		const unsigned int drawcalls = _drawcalls, vertices = _vertices;
+
+		for (const auto &pass_object : technique.passes)
+		{
+			const d3d11_pass_data &pass = *pass_object->as<d3d11_pass_data>();
+
+			if (pass.samples_backbuffer)
+			{
+				if (!technique_data.writes_backbuffer)
+				{
+					technique_data.copies_backbuffer_on_entry = true;
+				}
+				else if (is_backbuffer_outdated)
+				{
+					_deferred_context->CopyResource(_backbuffer_texture.get(), _backbuffer_resolved.get());
+
+					is_backbuffer_outdated = false;
+				}
+			}
+
+			for (const auto &srv : pass.shader_resources)
+			{
+				if (srv == nullptr)
+				{
+					continue;
+				}
+
+				com_ptr<ID3D11Resource> resource;
+				srv->GetResource(&resource);
+
+				const auto it = std::find_if(outdated_mipmaps.begin(), outdated_mipmaps.end(), [&resource](const auto &entry) { return entry.first == resource; });
+
+				if (it != outdated_mipmaps.end())
+				{
+					reset_pass_bindings(_deferred_context.get(), bindings);
+
+					_deferred_context->GenerateMips(it->second.get());
+
+					outdated_mipmaps.erase(it);
+				}
+				else if (std::find(technique_data.mipmap_writes.begin(), technique_data.mipmap_writes.end(), resource) == technique_data.mipmap_writes.end() &&
+					std::find(technique_data.mipmap_reads_on_entry.begin(), technique_data.mipmap_reads_on_entry.end(), resource) == technique_data.mipmap_reads_on_entry.end())
+				{
+					technique_data.mipmap_reads_on_entry.push_back(std::move(resource));
+				}
+			}
+
+			render_pass(_deferred_context.get(), pass, constant_buffer, bindings, is_default_depthstencil_cleared);
+
+			if (pass.writes_backbuffer)
+			{
+				technique_data.writes_backbuffer = true;
+				is_backbuffer_outdated = true;
+			}
 
-			// Update shader resources
 			for (const auto &resource : pass.render_target_resources)
 			{
 				if (resource == nullptr)
@@ -847,26 +1590,52 @@ namespace reshade::d3d11
 
 				if (resource_desc.Texture2D.MipLevels > 1)
 				{
-					_immediate_context->GenerateMips(resource.get());
+					com_ptr<ID3D11Resource> texture;
+					resource->GetResource(&texture);
+
+					if (std::find(technique_data.mipmap_writes.begin(), technique_data.mipmap_writes.end(), texture) == technique_data.mipmap_writes.end())
+					{
+						technique_data.mipmap_writes.push_back(texture);
+					}
+
+					if (std::find_if(outdated_mipmaps.begin(), outdated_mipmaps.end(), [&texture](const auto &entry) { return entry.first == texture; }) == outdated_mipmaps.end())
+					{
+						outdated_mipmaps.emplace_back(std::move(texture), resource);
+					}
 				}
 			}
 		}
 
-		if (!technique_data.query_in_flight)
+		// The passes were only recorded, so they count once the command list is executed
+		technique_data.drawcalls = _drawcalls - drawcalls;
+		technique_data.vertices = _vertices - vertices;
+		_drawcalls = drawcalls;
+		_vertices = vertices;
+
+		technique_data.leaves_backbuffer_outdated = is_backbuffer_outdated;
+		technique_data.outdated_mipmaps_on_exit = std::move(outdated_mipmaps);
+
+		const HRESULT hr = _deferred_context->FinishCommandList(FALSE, &technique_data.command_list);
+
+		if (FAILED(hr))
 		{
-			_immediate_context->End(technique_data.timestamp_query_end.get());
-			_immediate_context->End(technique_data.timestamp_disjoint.get());
-			technique_data.query_in_flight = true;
+			LOG(ERROR) << "Failed to record command list for technique '" << technique.name << "'! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
 		}
+
+		technique_data.command_list_generation = _effect_resources_generation;
+
+		return true;
 	}
 	void d3d11_runtime::render_imgui_draw_data(ImDrawData *draw_data)
 	{
-		// Create and grow vertex/index buffers if needed
+		// Create and grow vertex/index buffers if needed, with room for a few frames so they are only discarded every couple of frames when the ring below wraps around
 		if (_imgui_vertex_buffer == nullptr ||
 			_imgui_vertex_buffer_size < draw_data->TotalVtxCount)
 		{
 			_imgui_vertex_buffer.reset();
-			_imgui_vertex_buffer_size = draw_data->TotalVtxCount + 5000;
+			_imgui_vertex_buffer_size = draw_data->TotalVtxCount * 3 + 5000;
+			_imgui_vertex_buffer_offset = 0;
 
 			D3D11_BUFFER_DESC desc = { };
 			desc.Usage = D3D11_USAGE_DYNAMIC;
@@ -884,7 +1653,8 @@ namespace reshade::d3d11
 			_imgui_index_buffer_size < draw_data->TotalIdxCount)
 		{
 			_imgui_index_buffer.reset();
-			_imgui_index_buffer_size = draw_data->TotalIdxCount + 10000;
+			_imgui_index_buffer_size = draw_data->TotalIdxCount * 3 + 10000;
+			_imgui_index_buffer_offset = 0;
 
 			D3D11_BUFFER_DESC desc = { };
 			desc.Usage = D3D11_USAGE_DYNAMIC;
@@ -898,16 +1668,31 @@ namespace reshade::d3d11
 			}
 		}
 
+		// Append behind the data of previous frames, which the GPU may still read from, and only start over at the beginning with a discard once that no longer fits
+		D3D11_MAP map_type = D3D11_MAP_WRITE_NO_OVERWRITE;
+
+		if (_imgui_vertex_buffer_offset + draw_data->TotalVtxCount > _imgui_vertex_buffer_size ||
+			_imgui_index_buffer_offset + draw_data->TotalIdxCount > _imgui_index_buffer_size)
+		{
+			map_type = D3D11_MAP_WRITE_DISCARD;
+			_imgui_vertex_buffer_offset = 0;
+			_imgui_index_buffer_offset = 0;
+		}
+
 		D3D11_MAPPED_SUBRESOURCE vtx_resource, idx_resource;
 
-		if (FAILED(_immediate_context->Map(_imgui_vertex_buffer.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &vtx_resource)) ||
-			FAILED(_immediate_context->Map(_imgui_index_buffer.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &idx_resource)))
+		if (FAILED(_immediate_context->Map(_imgui_vertex_buffer.get(), 0, map_type, 0, &vtx_resource)))
 		{
 			return;
 		}
+		if (FAILED(_immediate_context->Map(_imgui_index_buffer.get(), 0, map_type, 0, &idx_resource)))
+		{
+			_immediate_context->Unmap(_imgui_vertex_buffer.get(), 0);
+			return;
+		}
 
-		auto vtx_dst = static_cast<ImDrawVert *>(vtx_resource.pData);
-		auto idx_dst = static_cast<ImDrawIdx *>(idx_resource.pData);
+		auto vtx_dst = static_cast<ImDrawVert *>(vtx_resource.pData) + _imgui_vertex_buffer_offset;
+		auto idx_dst = static_cast<ImDrawIdx *>(idx_resource.pData) + _imgui_index_buffer_offset;
 
 		for (int n = 0; n < draw_data->CmdListsCount; n++)
 		{
@@ -967,8 +1752,11 @@ namespace reshade::d3d11
 		_immediate_context->PSSetShader(_imgui_pixel_shader.get(), nullptr, 0);
 		_immediate_context->PSSetSamplers(0, 1, samplers);
 
-		// Render command lists
-		UINT vtx_offset = 0, idx_offset = 0;
+		// Render command lists, starting at where this frame was written to the buffers
+		UINT vtx_offset = _imgui_vertex_buffer_offset, idx_offset = _imgui_index_buffer_offset;
+
+		_imgui_vertex_buffer_offset += draw_data->TotalVtxCount;
+		_imgui_index_buffer_offset += draw_data->TotalIdxCount;
 
 		for (int n = 0; n < draw_data->CmdListsCount; n++)
 		{
@@ -1020,6 +1808,7 @@ namespace reshade::d3d11
 				if (ImGui::Checkbox("Extended depth buffer detection", &extended_depth_buffer_detection))
 				{
 					cleared_depth_buffer_index = 0;
+					last_depth_buffer_clear_count = 0;
 					modified = true;
 				}
 
@@ -1038,6 +1827,8 @@ namespace reshade::d3d11
 					if (bool value = cleared_depth_buffer_index == current_index; ImGui::Checkbox(label, &value))
 					{
 						cleared_depth_buffer_index = value ? current_index : 0;
+						// The new selection may lie before the clear copies were made from so far
+						last_depth_buffer_clear_count = 0;
 						modified = true;
 					}
 
@@ -1153,7 +1944,7 @@ namespace reshade::d3d11
 			// In this case, we cannot use the depth stencil to determine which depth texture is the good one, so we can use the default depth stencil
 			// For the moment, the best we can do is retrieve all the depth textures that has been cleared in the rendering pipeline, then select one of them (by default, the last one)
 			// In the future, maybe we could find a way to retrieve depth texture statistics (number of draw calls and number of vertices), so ReShade could automatically select the best one
-			ID3D11Texture2D *const best_match_texture = tracker.find_best_cleared_depth_buffer_texture(cleared_depth_buffer_index);
+			ID3D11Texture2D *const best_match_texture = tracker.find_best_cleared_depth_buffer_texture(cleared_depth_buffer_index, last_depth_buffer_clear_count);
 
 			if (best_match_texture != nullptr)
 			{
@@ -1164,9 +1955,9 @@ namespace reshade::d3d11
 
 		const auto best_snapshot = tracker.find_best_snapshot(_width, _height);
 
-		if (best_snapshot.depthstencil != nullptr)
+		if (best_snapshot != nullptr && best_snapshot->depthstencil != nullptr)
 		{
-			create_depthstencil_replacement(best_snapshot.depthstencil, best_snapshot.texture.get());
+			create_depthstencil_replacement(best_snapshot->depthstencil, best_snapshot->texture.get());
 		}
 	}
 
@@ -1300,11 +2091,13 @@ namespace reshade::d3d11
 		}
 
 		// Update effect textures
-		_effect_shader_resources[2] = _depthstencil_texture_srv;
 		for (const auto &technique : _techniques)
 			for (const auto &pass : technique.passes)
 				pass->as<d3d11_pass_data>()->shader_resources[2] = _depthstencil_texture_srv;
 
+		// Recorded passes still bind the previous depth texture
+		_effect_resources_generation++;
+
 		return true;
 	}
 
@@ -1336,8 +2129,14 @@ namespace reshade::d3d11
 			break;
 		}
 
-		// create an unique index based on the dept texture format and dimensions
-		UINT idx = texture_desc.Format * texture_desc.Width * texture_desc.Height;
+		// Create an unique index from everything 'CopyResource' requires to match, so textures of different shape never end up sharing a copy
+		const UINT64 idx =
+			(static_cast<UINT64>(texture_desc.Format & 0xFF) << 56) |
+			(static_cast<UINT64>(texture_desc.SampleDesc.Count & 0xFF) << 48) |
+			(static_cast<UINT64>(texture_desc.MipLevels & 0xFF) << 40) |
+			(static_cast<UINT64>(texture_desc.ArraySize & 0xFF) << 32) |
+			(static_cast<UINT64>(texture_desc.Width & 0xFFFF) << 16) |
+			(static_cast<UINT64>(texture_desc.Height & 0xFFFF));
 
 		const auto it = _depth_texture_saves.find(idx);
 		com_ptr<ID3D11Texture2D> depth_texture_save = nullptr;
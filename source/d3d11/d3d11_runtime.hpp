@@ -8,6 +8,7 @@
 #include <mutex>
 #include <d3d11_3.h>
 #include "runtime.hpp"
+#include "state_object_cache.hpp"
 #include "d3d11_stateblock.hpp"
 #include "draw_call_tracker.hpp"
 
@@ -18,19 +19,46 @@ namespace reshade::d3d11
 		com_ptr<ID3D11Texture2D> texture;
 		com_ptr<ID3D11ShaderResourceView> srv[2];
 		com_ptr<ID3D11RenderTargetView> rtv[2];
+		// Only created for textures that a storage object in an effect writes to
+		com_ptr<ID3D11UnorderedAccessView> uav;
 	};
 	struct d3d11_pass_data : base_object
 	{
+		// Name of the pass in the effect, or its index for passes without one
+		std::string name;
 		com_ptr<ID3D11VertexShader> vertex_shader;
 		com_ptr<ID3D11PixelShader> pixel_shader;
+		// Compute passes dispatch this instead of drawing, writing to the storage of their effect
+		com_ptr<ID3D11ComputeShader> compute_shader;
+		UINT thread_group_size[3], dispatch_size[3];
+		std::vector<com_ptr<ID3D11UnorderedAccessView>> unordered_access_views;
 		com_ptr<ID3D11BlendState> blend_state;
 		com_ptr<ID3D11DepthStencilState> depth_stencil_state;
 		UINT stencil_reference;
 		bool clear_render_targets;
+		bool samples_backbuffer, writes_backbuffer;
 		com_ptr<ID3D11RenderTargetView> render_targets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
 		com_ptr<ID3D11ShaderResourceView> render_target_resources[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+		UINT render_target_count;
 		D3D11_VIEWPORT viewport;
 		std::vector<com_ptr<ID3D11ShaderResourceView>> shader_resources;
+		// Range of the shader resources the vertex and the pixel shader read, compute passes use the pixel shader range for their compute shader
+		UINT vs_resource_first, vs_resource_count, ps_resource_first, ps_resource_count;
+		// Views of the render targets, which have to be unbound from the shader stages before the render targets are bound
+		std::vector<com_ptr<ID3D11ShaderResourceView>> render_target_aliases;
+	};
+	// What the passes of a technique left bound on a context, so each pass only changes the bindings that differ from the previous one
+	struct d3d11_pass_bindings
+	{
+		ID3D11ShaderResourceView *vs_resources[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = { };
+		ID3D11ShaderResourceView *ps_resources[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = { };
+		// Slots past these were never bound by a pass
+		UINT vs_resource_end = 0, ps_resource_end = 0;
+		// Cleared once the render targets below are the ones bound, until then they are whatever was set before the first pass
+		bool render_targets_unknown = true;
+		UINT render_target_count = 0;
+		ID3D11RenderTargetView *render_targets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT] = { };
+		ID3D11DepthStencilView *depth_stencil = nullptr;
 	};
 	struct d3d11_technique_data : base_object
 	{
@@ -38,6 +66,25 @@ namespace reshade::d3d11
 		com_ptr<ID3D11Query> timestamp_disjoint;
 		com_ptr<ID3D11Query> timestamp_query_beg;
 		com_ptr<ID3D11Query> timestamp_query_end;
+		// Issued at the end of every pass while passes are timed, created the first time they are needed
+		std::vector<com_ptr<ID3D11Query>> timestamp_query_passes;
+		size_t pass_query_count = 0;
+		// Sampler states of the effect the technique belongs to, bound to the sampler slots of all its passes
+		std::vector<com_ptr<ID3D11SamplerState>> sampler_states;
+		// The passes recorded into a command list, which is replayed instead of setting them up again every frame, see 'd3d11_runtime::record_technique'
+		com_ptr<ID3D11CommandList> command_list;
+		unsigned int command_list_generation = 0;
+		unsigned int drawcalls = 0, vertices = 0;
+		// Set when a pass reads the back buffer before the technique wrote it, so the copy of it has to be up to date when the command list starts
+		bool copies_backbuffer_on_entry = false;
+		bool writes_backbuffer = false;
+		// Set when the back buffer was written after the technique last copied it
+		bool leaves_backbuffer_outdated = false;
+		// Render targets with mipmaps that are read before the technique writes them, so their mipmaps may still be outdated from an earlier technique
+		std::vector<com_ptr<ID3D11Resource>> mipmap_reads_on_entry;
+		// Render targets with mipmaps the technique writes, and those of them whose mipmaps were not generated again afterwards
+		std::vector<com_ptr<ID3D11Resource>> mipmap_writes;
+		std::vector<std::pair<com_ptr<ID3D11Resource>, com_ptr<ID3D11ShaderResourceView>>> outdated_mipmaps_on_exit;
 	};
 
 	class d3d11_runtime : public runtime
@@ -49,10 +96,22 @@ namespace reshade::d3d11
 		void on_reset();
 		void on_reset_effect() override;
 		void on_present(draw_call_tracker& tracker);
+		/// <summary>
+		/// Apply the post-processing effects in the middle of the frame, so that everything the game draws afterwards (like the UI) is not affected.
+		/// Effects are only applied if the game currently draws to the back buffer.
+		/// </summary>
+		/// <returns>Returns true if effects were applied, in which case they are skipped when presenting this frame.</returns>
+		bool apply_effects();
 
 		void capture_frame(uint8_t *buffer) const override;
-		bool load_effect(const reshadefx::syntax_tree &ast, std::string &errors) override;
+		bool begin_frame_capture(unsigned int slot) override;
+		bool finish_frame_capture(unsigned int slot, uint8_t *buffer, bool wait) override;
+		std::unique_ptr<base_object> compile_effect(const reshadefx::syntax_tree &ast, std::string &errors, bool half_precision) override;
+		bool load_effect(base_object &module) override;
 		bool update_texture(texture &texture, const uint8_t *data) override;
+		bool update_texture_compressed(texture &texture, const uint8_t *data, unsigned int levels) override;
+		bool supports_texture_scaling(const texture &texture) const override;
+		bool update_texture_scaled(texture &texture, const uint8_t *data, unsigned int width, unsigned int height) override;
 
 		void render_technique(const technique &technique) override;
 		void render_imgui_draw_data(ImDrawData *data) override;
@@ -63,20 +122,29 @@ namespace reshade::d3d11
 
 		com_ptr<ID3D11Device> _device;
 		com_ptr<ID3D11DeviceContext> _immediate_context;
+		// Records the passes of techniques into command lists, only created when the driver supports those natively
+		com_ptr<ID3D11DeviceContext> _deferred_context;
+		// Used to label effect passes for GPU debuggers while GPU markers are enabled
+		com_ptr<ID3DUserDefinedAnnotation> _annotation;
 		com_ptr<IDXGISwapChain> _swapchain;
 
 		com_ptr<ID3D11Texture2D> _backbuffer_texture;
 		com_ptr<ID3D11ShaderResourceView> _backbuffer_texture_srv[2];
 		com_ptr<ID3D11RenderTargetView> _backbuffer_rtv[3];
 		com_ptr<ID3D11ShaderResourceView> _depthstencil_texture_srv;
-		std::vector<com_ptr<ID3D11SamplerState>> _effect_sampler_states;
-		std::unordered_map<size_t, size_t> _effect_sampler_descs;
-		std::vector<com_ptr<ID3D11ShaderResourceView>> _effect_shader_resources;
+		// State objects of all effects, kept across reloads, so identical states are only created once and the limit of the driver on the number of state objects is not reached with many effects
+		state_object_cache<ID3D11SamplerState> _sampler_state_cache;
+		state_object_cache<ID3D11BlendState> _blend_state_cache;
+		state_object_cache<ID3D11DepthStencilState> _depth_stencil_state_cache;
+		// Number of shader resource and sampler slots of the effect that binds the most, every effect has its own slots starting at zero
+		size_t _effect_shader_resource_count = 3, _effect_sampler_count = 0;
 		std::vector<com_ptr<ID3D11Buffer>> _constant_buffers;
 
 		bool depth_buffer_before_clear = false;
 		bool extended_depth_buffer_detection = false;
 		unsigned int cleared_depth_buffer_index = 0;
+		// Number of depth stencil clears up to the one the depth texture was taken from in the last frame, copies of earlier clears would only be overwritten again
+		unsigned int last_depth_buffer_clear_count = 0;
 		int depth_buffer_texture_format = 0; // No depth buffer texture format filter by default
 
 	private:
@@ -88,6 +156,16 @@ namespace reshade::d3d11
 
 		void draw_debug_menu();
 
+		void render_effects();
+		void render_pass(ID3D11DeviceContext *context, const d3d11_pass_data &pass, ID3D11Buffer *constant_buffer, d3d11_pass_bindings &bindings, bool &is_default_depthstencil_cleared);
+		void reset_pass_bindings(ID3D11DeviceContext *context, d3d11_pass_bindings &bindings);
+		bool record_technique(const technique &technique, ID3D11Buffer *constant_buffer);
+		void issue_pass_timestamp_query(d3d11_technique_data &technique_data);
+		void copy_to_backbuffer();
+
+		bool read_staging_texture(ID3D11Texture2D *staging, UINT map_flags, uint8_t *buffer) const;
+		com_ptr<ID3D11Texture2D> create_staging_texture() const;
+
 #if RESHADE_DX11_CAPTURE_DEPTH_BUFFERS
 		void detect_depth_source(draw_call_tracker& tracker);
 		bool create_depthstencil_replacement(ID3D11DepthStencilView *depthstencil, ID3D11Texture2D *texture);
@@ -102,12 +180,18 @@ namespace reshade::d3d11
 		};
 
 		std::map<UINT, depth_texture_save_info> _displayed_depth_textures;
-		std::unordered_map<UINT, com_ptr<ID3D11Texture2D>> _depth_texture_saves;
+		std::unordered_map<UINT64, com_ptr<ID3D11Texture2D>> _depth_texture_saves;
 
 		bool _is_multisampling_enabled = false;
 		DXGI_FORMAT _backbuffer_format = DXGI_FORMAT_UNKNOWN;
 		d3d11_stateblock _stateblock;
 		com_ptr<ID3D11Texture2D> _backbuffer, _backbuffer_resolved;
+		bool _is_backbuffer_texture_outdated = true;
+		// Incremented whenever views the passes bind are replaced, which makes all recorded command lists outdated
+		unsigned int _effect_resources_generation = 1;
+		bool _is_effects_applied = false;
+		// Render targets written since their mipmaps were last generated, generation is deferred until a pass binds them for reading
+		std::vector<std::pair<com_ptr<ID3D11Resource>, com_ptr<ID3D11ShaderResourceView>>> _outdated_mipmaps;
 		com_ptr<ID3D11DepthStencilView> _depthstencil, _depthstencil_replacement;
 		ID3D11DepthStencilView *_best_depth_stencil_overwrite = nullptr;
 		com_ptr<ID3D11Texture2D> _depthstencil_texture;
@@ -115,6 +199,9 @@ namespace reshade::d3d11
 		com_ptr<ID3D11VertexShader> _copy_vertex_shader;
 		com_ptr<ID3D11PixelShader> _copy_pixel_shader;
 		com_ptr<ID3D11SamplerState> _copy_sampler;
+		// Used to scale image data of textures to their size, see 'update_texture_scaled'
+		com_ptr<ID3D11PixelShader> _scale_pixel_shader;
+		com_ptr<ID3D11SamplerState> _scale_sampler;
 		std::mutex _mutex;
 		com_ptr<ID3D11RasterizerState> _effect_rasterizer_state;
 
@@ -128,6 +215,11 @@ namespace reshade::d3d11
 		com_ptr<ID3D11BlendState> _imgui_blend_state;
 		com_ptr<ID3D11DepthStencilState> _imgui_depthstencil_state;
 		int _imgui_vertex_buffer_size = 0, _imgui_index_buffer_size = 0;
+		// Where the next frame is written to in the vertex/index buffers, which are filled like a ring
+		int _imgui_vertex_buffer_offset = 0, _imgui_index_buffer_offset = 0;
 		draw_call_tracker _current_tracker;
+
+		// Copies of the back buffer waiting to be mapped for a screenshot, so the readback does not stall on the current frame
+		com_ptr<ID3D11Texture2D> _screenshot_staging[MAX_PENDING_SCREENSHOTS];
 	};
 }
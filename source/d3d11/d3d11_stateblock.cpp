@@ -4,6 +4,7 @@
  */
 
 #include "d3d11_stateblock.hpp"
+#include <algorithm>
 
 namespace reshade::d3d11
 {
@@ -29,21 +30,17 @@ namespace reshade::d3d11
 		release_all_device_objects();
 	}
 
-	void d3d11_stateblock::capture(ID3D11DeviceContext *devicecontext)
+	void d3d11_stateblock::capture(ID3D11DeviceContext *devicecontext, UINT num_shader_resources, UINT num_samplers)
 	{
 		_device_context = devicecontext;
 
+		// The copy and ImGui use the first slot even without any effects loaded
+		_num_shader_resources = std::min(std::max(num_shader_resources, 1u), static_cast<UINT>(ARRAYSIZE(_vs_shader_resources)));
+		_num_samplers = std::min(std::max(num_samplers, 1u), static_cast<UINT>(ARRAYSIZE(_vs_sampler_states)));
+
 		_device_context->IAGetPrimitiveTopology(&_ia_primitive_topology);
 		_device_context->IAGetInputLayout(&_ia_input_layout);
-
-		if (_device_feature_level > D3D_FEATURE_LEVEL_10_0)
-		{
-			_device_context->IAGetVertexBuffers(0, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT, _ia_vertex_buffers, _ia_vertex_strides, _ia_vertex_offsets);
-		}
-		else
-		{
-			_device_context->IAGetVertexBuffers(0, D3D10_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT, _ia_vertex_buffers, _ia_vertex_strides, _ia_vertex_offsets);
-		}
+		_device_context->IAGetVertexBuffers(0, 1, _ia_vertex_buffers, _ia_vertex_strides, _ia_vertex_offsets);
 
 		_device_context->IAGetIndexBuffer(&_ia_index_buffer, &_ia_index_format, &_ia_index_offset);
 
@@ -55,9 +52,9 @@ namespace reshade::d3d11
 
 		_vs_num_class_instances = ARRAYSIZE(_vs_class_instances);
 		_device_context->VSGetShader(&_vs, _vs_class_instances, &_vs_num_class_instances);
-		_device_context->VSGetConstantBuffers(0, ARRAYSIZE(_vs_constant_buffers), _vs_constant_buffers);
-		_device_context->VSGetSamplers(0, ARRAYSIZE(_vs_sampler_states), _vs_sampler_states);
-		_device_context->VSGetShaderResources(0, ARRAYSIZE(_vs_shader_resources), _vs_shader_resources);
+		_device_context->VSGetConstantBuffers(0, 1, _vs_constant_buffers);
+		_device_context->VSGetSamplers(0, _num_samplers, _vs_sampler_states);
+		_device_context->VSGetShaderResources(0, _num_shader_resources, _vs_shader_resources);
 
 		if (_device_feature_level >= D3D_FEATURE_LEVEL_10_0)
 		{
@@ -76,9 +73,19 @@ namespace reshade::d3d11
 
 		_ps_num_class_instances = ARRAYSIZE(_ps_class_instances);
 		_device_context->PSGetShader(&_ps, _ps_class_instances, &_ps_num_class_instances);
-		_device_context->PSGetConstantBuffers(0, ARRAYSIZE(_ps_constant_buffers), _ps_constant_buffers);
-		_device_context->PSGetSamplers(0, ARRAYSIZE(_ps_sampler_states), _ps_sampler_states);
-		_device_context->PSGetShaderResources(0, ARRAYSIZE(_ps_shader_resources), _ps_shader_resources);
+		_device_context->PSGetConstantBuffers(0, 1, _ps_constant_buffers);
+		_device_context->PSGetSamplers(0, _num_samplers, _ps_sampler_states);
+		_device_context->PSGetShaderResources(0, _num_shader_resources, _ps_shader_resources);
+
+		if (_device_feature_level >= D3D_FEATURE_LEVEL_11_0)
+		{
+			_cs_num_class_instances = ARRAYSIZE(_cs_class_instances);
+			_device_context->CSGetShader(&_cs, _cs_class_instances, &_cs_num_class_instances);
+			_device_context->CSGetConstantBuffers(0, 1, _cs_constant_buffers);
+			_device_context->CSGetSamplers(0, _num_samplers, _cs_sampler_states);
+			_device_context->CSGetShaderResources(0, _num_shader_resources, _cs_shader_resources);
+			_device_context->CSGetUnorderedAccessViews(0, ARRAYSIZE(_cs_unordered_access_views), _cs_unordered_access_views);
+		}
 
 		_device_context->OMGetBlendState(&_om_blend_state, _om_blend_factor, &_om_sample_mask);
 		_device_context->OMGetDepthStencilState(&_om_depth_stencil_state, &_om_stencil_ref);
@@ -88,15 +95,7 @@ namespace reshade::d3d11
 	{
 		_device_context->IASetPrimitiveTopology(_ia_primitive_topology);
 		_device_context->IASetInputLayout(_ia_input_layout);
-
-		if (_device_feature_level > D3D_FEATURE_LEVEL_10_0)
-		{
-			_device_context->IASetVertexBuffers(0, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT, _ia_vertex_buffers, _ia_vertex_strides, _ia_vertex_offsets);
-		}
-		else
-		{
-			_device_context->IASetVertexBuffers(0, D3D10_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT, _ia_vertex_buffers, _ia_vertex_strides, _ia_vertex_offsets);
-		}
+		_device_context->IASetVertexBuffers(0, 1, _ia_vertex_buffers, _ia_vertex_strides, _ia_vertex_offsets);
 
 		_device_context->IASetIndexBuffer(_ia_index_buffer, _ia_index_format, _ia_index_offset);
 
@@ -105,9 +104,9 @@ namespace reshade::d3d11
 		_device_context->RSSetScissorRects(_rs_num_scissor_rects, _rs_scissor_rects);
 
 		_device_context->VSSetShader(_vs, _vs_class_instances, _vs_num_class_instances);
-		_device_context->VSSetConstantBuffers(0, ARRAYSIZE(_vs_constant_buffers), _vs_constant_buffers);
-		_device_context->VSSetSamplers(0, ARRAYSIZE(_vs_sampler_states), _vs_sampler_states);
-		_device_context->VSSetShaderResources(0, ARRAYSIZE(_vs_shader_resources), _vs_shader_resources);
+		_device_context->VSSetConstantBuffers(0, 1, _vs_constant_buffers);
+		_device_context->VSSetSamplers(0, _num_samplers, _vs_sampler_states);
+		_device_context->VSSetShaderResources(0, _num_shader_resources, _vs_shader_resources);
 
 		if (_device_feature_level >= D3D_FEATURE_LEVEL_10_0)
 		{
@@ -122,9 +121,21 @@ namespace reshade::d3d11
 		}
 
 		_device_context->PSSetShader(_ps, _ps_class_instances, _ps_num_class_instances);
-		_device_context->PSSetConstantBuffers(0, ARRAYSIZE(_ps_constant_buffers), _ps_constant_buffers);
-		_device_context->PSSetSamplers(0, ARRAYSIZE(_ps_sampler_states), _ps_sampler_states);
-		_device_context->PSSetShaderResources(0, ARRAYSIZE(_ps_shader_resources), _ps_shader_resources);
+		_device_context->PSSetConstantBuffers(0, 1, _ps_constant_buffers);
+		_device_context->PSSetSamplers(0, _num_samplers, _ps_sampler_states);
+		_device_context->PSSetShaderResources(0, _num_shader_resources, _ps_shader_resources);
+
+		if (_device_feature_level >= D3D_FEATURE_LEVEL_11_0)
+		{
+			// An initial count of -1 keeps the hidden counters of append and consume buffers the game bound as they were
+			const UINT initial_counts[ARRAYSIZE(_cs_unordered_access_views)] = { UINT(-1), UINT(-1), UINT(-1), UINT(-1), UINT(-1), UINT(-1), UINT(-1), UINT(-1) };
+
+			_device_context->CSSetShader(_cs, _cs_class_instances, _cs_num_class_instances);
+			_device_context->CSSetConstantBuffers(0, 1, _cs_constant_buffers);
+			_device_context->CSSetSamplers(0, _num_samplers, _cs_sampler_states);
+			_device_context->CSSetShaderResources(0, _num_shader_resources, _cs_shader_resources);
+			_device_context->CSSetUnorderedAccessViews(0, ARRAYSIZE(_cs_unordered_access_views), _cs_unordered_access_views, initial_counts);
+		}
 
 		_device_context->OMSetBlendState(_om_blend_state, _om_blend_factor, _om_sample_mask);
 		_device_context->OMSetDepthStencilState(_om_depth_stencil_state, _om_stencil_ref);
@@ -207,6 +218,29 @@ namespace reshade::d3d11
 			safe_release(shader_resource);
 		}
 
+		safe_release(_cs);
+
+		for (UINT i = 0; i < _cs_num_class_instances; i++)
+		{
+			safe_release(_cs_class_instances[i]);
+		}
+		for (auto &constant_buffer : _cs_constant_buffers)
+		{
+			safe_release(constant_buffer);
+		}
+		for (auto &sampler_state : _cs_sampler_states)
+		{
+			safe_release(sampler_state);
+		}
+		for (auto &shader_resource : _cs_shader_resources)
+		{
+			safe_release(shader_resource);
+		}
+		for (auto &unordered_access_view : _cs_unordered_access_views)
+		{
+			safe_release(unordered_access_view);
+		}
+
 		safe_release(_om_blend_state);
 		safe_release(_om_depth_stencil_state);
 
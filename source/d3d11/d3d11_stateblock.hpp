@@ -16,7 +16,13 @@ namespace reshade::d3d11
 		explicit d3d11_stateblock(ID3D11Device *device);
 		~d3d11_stateblock();
 
-		void capture(ID3D11DeviceContext *devicecontext);
+		/// <summary>
+		/// Save the state the runtime changes while rendering. Vertex buffers and constant buffers are only saved for the first slot and shader resources and samplers only for as many slots as specified, since the runtime binds nothing beyond that. The compute stage is saved too on devices that have one, for effects with compute passes.
+		/// </summary>
+		/// <param name="devicecontext">The device context to save the state of.</param>
+		/// <param name="num_shader_resources">The number of shader resource slots the runtime binds.</param>
+		/// <param name="num_samplers">The number of sampler slots the runtime binds.</param>
+		void capture(ID3D11DeviceContext *devicecontext, UINT num_shader_resources, UINT num_samplers);
 		void apply_and_release();
 
 	private:
@@ -25,6 +31,8 @@ namespace reshade::d3d11
 		D3D_FEATURE_LEVEL _device_feature_level;
 		com_ptr<ID3D11Device> _device;
 		com_ptr<ID3D11DeviceContext> _device_context;
+		UINT _num_shader_resources;
+		UINT _num_samplers;
 		ID3D11InputLayout *_ia_input_layout;
 		D3D11_PRIMITIVE_TOPOLOGY _ia_primitive_topology;
 		ID3D11Buffer *_ia_vertex_buffers[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
@@ -59,6 +67,13 @@ namespace reshade::d3d11
 		ID3D11Buffer *_ps_constant_buffers[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
 		ID3D11SamplerState *_ps_sampler_states[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
 		ID3D11ShaderResourceView *_ps_shader_resources[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+		ID3D11ComputeShader *_cs;
+		UINT _cs_num_class_instances;
+		ID3D11ClassInstance *_cs_class_instances[256];
+		ID3D11Buffer *_cs_constant_buffers[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+		ID3D11SamplerState *_cs_sampler_states[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+		ID3D11ShaderResourceView *_cs_shader_resources[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+		ID3D11UnorderedAccessView *_cs_unordered_access_views[D3D11_PS_CS_UAV_REGISTER_COUNT];
 		ID3D11BlendState *_om_blend_state;
 		FLOAT _om_blend_factor[4];
 		UINT _om_sample_mask;
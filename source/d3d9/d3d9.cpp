@@ -4,6 +4,7 @@
  */
 
 #include "log.hpp"
+#include "ini_file.hpp"
 #include "hook_manager.hpp"
 #include "d3d9_device.hpp"
 #include "d3d9_swapchain.hpp"
@@ -48,6 +49,44 @@ void dump_present_parameters(const D3DPRESENT_PARAMETERS &pp)
 	}
 }
 
+// Direct3D 9Ex devices are never lost and have no managed pool, so resets get cheaper and managed resources are no longer duplicated in system memory, but resources behave slightly different, which is why it is opt-in
+static bool is_direct3d9ex_upgrade_enabled()
+{
+	bool enabled = false;
+	reshade::ini_file(reshade::runtime::s_gw2hook_wrkdir_path + "config.ini").get("D3D9", "UseDirect3D9Ex", enabled);
+
+	return enabled;
+}
+
+// Managed resources are moved to the default pool as dynamic resources on an upgraded device, so that they stay lockable, which fails for a format that rejects dynamic usage
+static bool find_format_without_dynamic_usage(IDirect3D9 *d3d, UINT adapter, D3DDEVTYPE device_type, D3DFORMAT &format)
+{
+	D3DDISPLAYMODE mode = { };
+	d3d->GetAdapterDisplayMode(adapter, &mode);
+
+	const D3DRESOURCETYPE types[] = { D3DRTYPE_TEXTURE, D3DRTYPE_CUBETEXTURE, D3DRTYPE_VOLUMETEXTURE };
+	const D3DFORMAT formats[] = {
+		D3DFMT_DXT1, D3DFMT_DXT2, D3DFMT_DXT3, D3DFMT_DXT4, D3DFMT_DXT5,
+		D3DFMT_A8R8G8B8, D3DFMT_X8R8G8B8, D3DFMT_R5G6B5, D3DFMT_A1R5G5B5, D3DFMT_A4R4G4B4,
+		D3DFMT_L8, D3DFMT_A8L8, D3DFMT_A8, D3DFMT_L16, D3DFMT_G16R16 };
+
+	for (const D3DRESOURCETYPE type : types)
+	{
+		for (const D3DFORMAT candidate : formats)
+		{
+			// Formats the game cannot use at all do not matter
+			if (SUCCEEDED(d3d->CheckDeviceFormat(adapter, device_type, mode.Format, 0, type, candidate)) &&
+				FAILED(d3d->CheckDeviceFormat(adapter, device_type, mode.Format, D3DUSAGE_DYNAMIC, type, candidate)))
+			{
+				format = candidate;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
 // IDirect3D9
 HRESULT STDMETHODCALLTYPE IDirect3D9_CreateDevice(IDirect3D9 *pD3D, UINT Adapter, D3DDEVTYPE DeviceType, HWND hFocusWindow, DWORD BehaviorFlags, D3DPRESENT_PARAMETERS *pPresentationParameters, IDirect3DDevice9 **ppReturnedDeviceInterface)
 {
@@ -65,6 +104,63 @@ HRESULT STDMETHODCALLTYPE IDirect3D9_CreateDevice(IDirect3D9 *pD3D, UINT Adapter
 		return D3DERR_NOTAVAILABLE;
 	}
 
+	// Only devices that get wrapped can be upgraded, since the wrapper has to move managed resources to another pool
+	if ((pPresentationParameters->Flags & D3DPRESENTFLAG_VIDEO) == 0 && DeviceType != D3DDEVTYPE_NULLREF && is_direct3d9ex_upgrade_enabled())
+	{
+		IDirect3D9Ex *d3dex = nullptr;
+
+		// Managed textures are moved to the default pool as dynamic textures, so they stay lockable, which needs hardware support
+		D3DCAPS9 caps = { };
+		pD3D->GetDeviceCaps(Adapter, DeviceType, &caps);
+
+		D3DFORMAT format_without_dynamic_usage = D3DFMT_UNKNOWN;
+
+		if ((caps.Caps2 & D3DCAPS2_DYNAMICTEXTURES) == 0)
+		{
+			LOG(WARNING) << "> Skipping upgrade to 'IDirect3DDevice9Ex' because the device does not support dynamic textures.";
+		}
+		else if (find_format_without_dynamic_usage(pD3D, Adapter, DeviceType, format_without_dynamic_usage))
+		{
+			LOG(WARNING) << "> Skipping upgrade to 'IDirect3DDevice9Ex' because format " << format_without_dynamic_usage << " does not support dynamic textures, so managed textures of it could not be locked.";
+		}
+		else if (SUCCEEDED(pD3D->QueryInterface(IID_PPV_ARGS(&d3dex))))
+		{
+			LOG(INFO) << "> Upgrading device to 'IDirect3DDevice9Ex' ...";
+
+			D3DDISPLAYMODEEX fullscreen_mode = { sizeof(fullscreen_mode) };
+			fullscreen_mode.Width = pPresentationParameters->BackBufferWidth;
+			fullscreen_mode.Height = pPresentationParameters->BackBufferHeight;
+			fullscreen_mode.RefreshRate = pPresentationParameters->FullScreen_RefreshRateInHz;
+			fullscreen_mode.Format = pPresentationParameters->BackBufferFormat;
+			fullscreen_mode.ScanLineOrdering = D3DSCANLINEORDERING_PROGRESSIVE;
+
+			// This goes through 'IDirect3D9Ex_CreateDeviceEx', which wraps the device
+			IDirect3DDevice9Ex *device_ex = nullptr;
+			HRESULT hr = d3dex->CreateDeviceEx(Adapter, DeviceType, hFocusWindow, BehaviorFlags, pPresentationParameters, pPresentationParameters->Windowed ? nullptr : &fullscreen_mode, &device_ex);
+
+			d3dex->Release();
+
+			Direct3DDevice9 *device_proxy = nullptr;
+
+			if (SUCCEEDED(hr) && SUCCEEDED(device_ex->QueryInterface(IID_PPV_ARGS(&device_proxy))))
+			{
+				device_proxy->enable_managed_pool_replacement();
+				device_proxy->Release();
+
+				*ppReturnedDeviceInterface = device_ex;
+
+				return D3D_OK;
+			}
+
+			if (SUCCEEDED(hr))
+			{
+				device_ex->Release();
+			}
+
+			LOG(WARNING) << "> Failed to upgrade device to 'IDirect3DDevice9Ex' with error code " << std::hex << hr << std::dec << ". Falling back to 'IDirect3DDevice9'.";
+		}
+	}
+
 	dump_present_parameters(*pPresentationParameters);
 
 	const bool use_software_rendering = (BehaviorFlags & D3DCREATE_SOFTWARE_VERTEXPROCESSING) != 0;
@@ -130,6 +226,9 @@ HRESULT STDMETHODCALLTYPE IDirect3D9_CreateDevice(IDirect3D9 *pD3D, UINT Adapter
 			device_proxy->SetDepthStencilSurface(device_proxy->_auto_depthstencil.get());
 		}
 
+		device_proxy->_state_tracker.sync(device);
+		runtime->_state_tracker = &device_proxy->_state_tracker;
+
 		// Upgrade to extended interface if available
 		com_ptr<IDirect3DDevice9Ex> deviceex;
 		device_proxy->QueryInterface(IID_PPV_ARGS(&deviceex));
@@ -223,6 +322,9 @@ HRESULT STDMETHODCALLTYPE IDirect3D9Ex_CreateDeviceEx(IDirect3D9Ex *pD3D, UINT A
 			device->GetDepthStencilSurface(&device_proxy->_auto_depthstencil);
 			device_proxy->SetDepthStencilSurface(device_proxy->_auto_depthstencil.get());
 		}
+
+		device_proxy->_state_tracker.sync(device);
+		runtime->_state_tracker = &device_proxy->_state_tracker;
 	}
 
 #if RESHADE_VERBOSE_LOG
@@ -276,6 +378,17 @@ HOOK_EXPORT IDirect3D9 *WINAPI Direct3DCreate9(UINT SDKVersion)
 {
 	LOG(INFO) << "Redirecting '" << "Direct3DCreate9" << "(" << SDKVersion << ")' ...";
 
+	// The extended object is returned through the same interface, so the game does not notice, its 'CreateDevice' then creates an extended device
+	if (IDirect3D9Ex *res_ex = nullptr; is_direct3d9ex_upgrade_enabled() && SUCCEEDED(reshade::hooks::call(&Direct3DCreate9Ex)(SDKVersion, &res_ex)))
+	{
+		LOG(INFO) << "> Upgraded to 'IDirect3D9Ex'.";
+
+		reshade::hooks::install("IDirect3D9::CreateDevice", vtable_from_instance(res_ex), 16, reinterpret_cast<reshade::hook::address>(&IDirect3D9_CreateDevice));
+		reshade::hooks::install("IDirect3D9Ex::CreateDeviceEx", vtable_from_instance(res_ex), 20, reinterpret_cast<reshade::hook::address>(&IDirect3D9Ex_CreateDeviceEx));
+
+		return res_ex;
+	}
+
 	IDirect3D9 *const res = reshade::hooks::call(&Direct3DCreate9)(SDKVersion);
 
 	if (res == nullptr)
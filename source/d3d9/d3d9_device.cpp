@@ -9,6 +9,56 @@
 
 extern void dump_present_parameters(const D3DPRESENT_PARAMETERS &pp);
 
+void Direct3DDevice9::enable_managed_pool_replacement()
+{
+	D3DDISPLAYMODE mode = { };
+	_orig->GetDisplayMode(0, &mode);
+	_orig->GetCreationParameters(&_creation_parameters);
+	_orig->GetDirect3D(&_d3d);
+
+	_adapter_format = mode.Format;
+	_managed_pool_replaced = true;
+}
+void Direct3DDevice9::replace_managed_pool(D3DRESOURCETYPE Type, D3DFORMAT Format, DWORD &Usage, D3DPOOL &Pool)
+{
+	if (!_managed_pool_replaced || Pool != D3DPOOL_MANAGED)
+	{
+		return;
+	}
+
+	Pool = D3DPOOL_DEFAULT;
+
+	// Buffers in the default pool can be locked as they are, but textures only if they are dynamic, which not every format supports
+	if (Type == D3DRTYPE_VERTEXBUFFER || Type == D3DRTYPE_INDEXBUFFER)
+	{
+		return;
+	}
+
+	const unsigned long long key = (static_cast<unsigned long long>(Usage) << 40) | (static_cast<unsigned long long>(Type) << 32) | static_cast<unsigned long long>(Format);
+
+	const std::lock_guard<std::mutex> lock(_dynamic_usage_mutex);
+
+	auto it = _dynamic_usage_support.find(key);
+
+	if (it == _dynamic_usage_support.end())
+	{
+		const bool supported = _d3d != nullptr && SUCCEEDED(_d3d->CheckDeviceFormat(_creation_parameters.AdapterOrdinal, _creation_parameters.DeviceType, _adapter_format, Usage | D3DUSAGE_DYNAMIC, Type, Format));
+
+		// The common formats were checked before upgrading the device already, see 'IDirect3D9_CreateDevice', so this is rare and only reported once per format
+		if (!supported)
+		{
+			LOG(WARNING) << "Format " << Format << " does not support dynamic usage, so a managed resource of it cannot be locked in the default pool.";
+		}
+
+		it = _dynamic_usage_support.emplace(key, supported).first;
+	}
+
+	if (it->second)
+	{
+		Usage |= D3DUSAGE_DYNAMIC;
+	}
+}
+
 // IDirect3DDevice9
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::QueryInterface(REFIID riid, void **ppvObj)
 {
@@ -62,6 +112,7 @@ ULONG STDMETHODCALLTYPE Direct3DDevice9::Release()
 	if (--_ref == 0)
 	{
 		_auto_depthstencil.reset();
+		_state_tracker.release();
 
 		assert(_implicit_swapchain != nullptr);
 
@@ -177,6 +228,8 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateAdditionalSwapChain(D3DPRESENT_
 
 	const auto swapchain_proxy = new Direct3DSwapChain9(this, swapchain, runtime);
 
+	runtime->_state_tracker = &_state_tracker;
+
 	_additional_swapchains.push_back(swapchain_proxy);
 	*ppSwapChain = swapchain_proxy;
 
@@ -243,6 +296,10 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::Reset(D3DPRESENT_PARAMETERS *pPresent
 	runtime->on_reset();
 
 	_auto_depthstencil.reset();
+	_redirect->InvalidateFogConstant();
+
+	// Default pool objects may not be referenced during a reset
+	_state_tracker.release();
 
 	const HRESULT hr = _orig->Reset(pPresentationParameters);
 
@@ -267,6 +324,9 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::Reset(D3DPRESENT_PARAMETERS *pPresent
 		SetDepthStencilSurface(_auto_depthstencil.get());
 	}
 
+	// Reset restored all device state to its defaults
+	_state_tracker.sync(_orig);
+
 	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::Present(const RECT *pSourceRect, const RECT *pDestRect, HWND hDestWindowOverride, const RGNDATA *pDirtyRegion)
@@ -279,6 +339,9 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::Present(const RECT *pSourceRect, cons
 
 	HRESULT hr = _orig->Present(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
 
+	// The overlay may be built on a worker thread while the driver presents, which has to finish before the game continues
+	_implicit_swapchain->_runtime->wait_for_overlay();
+
 	if (FAILED(hr)) {
 		_reset_fail_guard = true;
 	}
@@ -338,14 +401,20 @@ void STDMETHODCALLTYPE Direct3DDevice9::GetGammaRamp(UINT iSwapChain, D3DGAMMARA
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateTexture(UINT Width, UINT Height, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DTexture9 **ppTexture, HANDLE *pSharedHandle)
 {
+	replace_managed_pool(D3DRTYPE_TEXTURE, Format, Usage, Pool);
+
 	return _orig->CreateTexture(Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle);
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateVolumeTexture(UINT Width, UINT Height, UINT Depth, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DVolumeTexture9 **ppVolumeTexture, HANDLE *pSharedHandle)
 {
+	replace_managed_pool(D3DRTYPE_VOLUMETEXTURE, Format, Usage, Pool);
+
 	return _orig->CreateVolumeTexture(Width, Height, Depth, Levels, Usage, Format, Pool, ppVolumeTexture, pSharedHandle);
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateCubeTexture(UINT EdgeLength, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DCubeTexture9 **ppCubeTexture, HANDLE *pSharedHandle)
 {
+	replace_managed_pool(D3DRTYPE_CUBETEXTURE, Format, Usage, Pool);
+
 	return _orig->CreateCubeTexture(EdgeLength, Levels, Usage, Format, Pool, ppCubeTexture, pSharedHandle);
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateVertexBuffer(UINT Length, DWORD Usage, DWORD FVF, D3DPOOL Pool, IDirect3DVertexBuffer9 **ppVertexBuffer, HANDLE *pSharedHandle)
@@ -355,6 +424,8 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateVertexBuffer(UINT Length, DWORD
 		Usage |= D3DUSAGE_SOFTWAREPROCESSING;
 	}
 
+	replace_managed_pool(D3DRTYPE_VERTEXBUFFER, D3DFMT_VERTEXDATA, Usage, Pool);
+
 	return _orig->CreateVertexBuffer(Length, Usage, FVF, Pool, ppVertexBuffer, pSharedHandle);
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateIndexBuffer(UINT Length, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DIndexBuffer9 **ppIndexBuffer, HANDLE *pSharedHandle)
@@ -364,6 +435,8 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateIndexBuffer(UINT Length, DWORD
 		Usage |= D3DUSAGE_SOFTWAREPROCESSING;
 	}
 
+	replace_managed_pool(D3DRTYPE_INDEXBUFFER, Format, Usage, Pool);
+
 	return _orig->CreateIndexBuffer(Length, Usage, Format, Pool, ppIndexBuffer, pSharedHandle);
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateRenderTarget(UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample, DWORD MultisampleQuality, BOOL Lockable, IDirect3DSurface9 **ppSurface, HANDLE *pSharedHandle)
@@ -413,7 +486,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateOffscreenPlainSurface(UINT Widt
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetRenderTarget(DWORD RenderTargetIndex, IDirect3DSurface9 *pRenderTarget)
 {
-	return _redirect->SetRenderTarget(RenderTargetIndex, pRenderTarget);
+	const HRESULT hr = _redirect->SetRenderTarget(RenderTargetIndex, pRenderTarget);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_render_target(RenderTargetIndex, pRenderTarget);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetRenderTarget(DWORD RenderTargetIndex, IDirect3DSurface9 **ppRenderTarget)
 {
@@ -421,22 +501,27 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetRenderTarget(DWORD RenderTargetInd
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetDepthStencilSurface(IDirect3DSurface9 *pNewZStencil)
 {
-	if (pNewZStencil != nullptr)
+	// Runtimes also need to know when the depth stencil is unbound, to stop counting draw calls for it
+	assert(_implicit_swapchain != nullptr);
+	assert(_implicit_swapchain->_runtime != nullptr);
+
+	_implicit_swapchain->_runtime->on_set_depthstencil_surface(pNewZStencil);
+
+	for (auto swapchain : _additional_swapchains)
 	{
-		assert(_implicit_swapchain != nullptr);
-		assert(_implicit_swapchain->_runtime != nullptr);
+		assert(swapchain->_runtime != nullptr);
 
-		_implicit_swapchain->_runtime->on_set_depthstencil_surface(pNewZStencil);
+		swapchain->_runtime->on_set_depthstencil_surface(pNewZStencil);
+	}
 
-		for (auto swapchain : _additional_swapchains)
-		{
-			assert(swapchain->_runtime != nullptr);
+	const HRESULT hr = _orig->SetDepthStencilSurface(pNewZStencil);
 
-			swapchain->_runtime->on_set_depthstencil_surface(pNewZStencil);
-		}
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_depth_stencil_surface(pNewZStencil);
 	}
 
-	return _orig->SetDepthStencilSurface(pNewZStencil);
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetDepthStencilSurface(IDirect3DSurface9 **ppZStencilSurface)
 {
@@ -477,7 +562,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::Clear(DWORD Count, const D3DRECT *pRe
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetTransform(D3DTRANSFORMSTATETYPE State, const D3DMATRIX *pMatrix)
 {
-	return _orig->SetTransform(State, pMatrix);
+	const HRESULT hr = _orig->SetTransform(State, pMatrix);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_transform(State, pMatrix);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetTransform(D3DTRANSFORMSTATETYPE State, D3DMATRIX *pMatrix)
 {
@@ -489,7 +581,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::MultiplyTransform(D3DTRANSFORMSTATETY
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetViewport(const D3DVIEWPORT9 *pViewport)
 {
-	return _orig->SetViewport(pViewport);
+	const HRESULT hr = _orig->SetViewport(pViewport);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_viewport(pViewport);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetViewport(D3DVIEWPORT9 *pViewport)
 {
@@ -529,7 +628,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetClipPlane(DWORD Index, float *pPla
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetRenderState(D3DRENDERSTATETYPE State, DWORD Value)
 {
-	return _orig->SetRenderState(State, Value);
+	const HRESULT hr = _orig->SetRenderState(State, Value);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_render_state(State, Value);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetRenderState(D3DRENDERSTATETYPE State, DWORD *pValue)
 {
@@ -537,14 +643,22 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetRenderState(D3DRENDERSTATETYPE Sta
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateStateBlock(D3DSTATEBLOCKTYPE Type, IDirect3DStateBlock9 **ppSB)
 {
+	// Applying state blocks changes device state without going through this proxy
+	_state_tracker.disable();
+
 	return _orig->CreateStateBlock(Type, ppSB);
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::BeginStateBlock()
 {
+	_state_tracker.disable();
+
 	return _orig->BeginStateBlock();
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::EndStateBlock(IDirect3DStateBlock9 **ppSB)
 {
+	// Constant uploads while recording went into the state block instead of the device
+	_redirect->InvalidateFogConstant();
+
 	return _orig->EndStateBlock(ppSB);
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetClipStatus(const D3DCLIPSTATUS9 *pClipStatus)
@@ -561,7 +675,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetTexture(DWORD Stage, IDirect3DBase
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetTexture(DWORD Stage, IDirect3DBaseTexture9 *pTexture)
 {
-	return _orig->SetTexture(Stage, pTexture);
+	const HRESULT hr = _orig->SetTexture(Stage, pTexture);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_texture(Stage, pTexture);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetTextureStageState(DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD *pValue)
 {
@@ -569,7 +690,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetTextureStageState(DWORD Stage, D3D
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetTextureStageState(DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD Value)
 {
-	return _orig->SetTextureStageState(Stage, Type, Value);
+	const HRESULT hr = _orig->SetTextureStageState(Stage, Type, Value);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_texture_stage_state(Stage, Type, Value);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetSamplerState(DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD *pValue)
 {
@@ -577,7 +705,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetSamplerState(DWORD Sampler, D3DSAM
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetSamplerState(DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD Value)
 {
-	return _orig->SetSamplerState(Sampler, Type, Value);
+	const HRESULT hr = _orig->SetSamplerState(Sampler, Type, Value);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_sampler_state(Sampler, Type, Value);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::ValidateDevice(DWORD *pNumPasses)
 {
@@ -601,7 +736,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetCurrentTexturePalette(UINT *Palett
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetScissorRect(const RECT *pRect)
 {
-	return _orig->SetScissorRect(pRect);
+	const HRESULT hr = _orig->SetScissorRect(pRect);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_scissor_rect(pRect);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetScissorRect(RECT *pRect)
 {
@@ -697,7 +839,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateVertexDeclaration(const D3DVERT
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetVertexDeclaration(IDirect3DVertexDeclaration9 *pDecl)
 {
-	return _orig->SetVertexDeclaration(pDecl);
+	const HRESULT hr = _orig->SetVertexDeclaration(pDecl);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_vertex_declaration(pDecl);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetVertexDeclaration(IDirect3DVertexDeclaration9 **ppDecl)
 {
@@ -705,7 +854,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetVertexDeclaration(IDirect3DVertexD
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetFVF(DWORD FVF)
 {
-	return _orig->SetFVF(FVF);
+	const HRESULT hr = _orig->SetFVF(FVF);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_fvf(FVF);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetFVF(DWORD *pFVF)
 {
@@ -717,7 +873,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreateVertexShader(const DWORD *pFunc
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetVertexShader(IDirect3DVertexShader9 *pShader)
 {
-	return _redirect->SetVertexShader(pShader);
+	const HRESULT hr = _redirect->SetVertexShader(pShader);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_vertex_shader(pShader);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetVertexShader(IDirect3DVertexShader9 **ppShader)
 {
@@ -725,7 +888,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetVertexShader(IDirect3DVertexShader
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetVertexShaderConstantF(UINT StartRegister, const float *pConstantData, UINT Vector4fCount)
 {
-	return _orig->SetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+	const HRESULT hr = _orig->SetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_vertex_shader_constants(StartRegister, pConstantData, Vector4fCount);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetVertexShaderConstantF(UINT StartRegister, float *pConstantData, UINT Vector4fCount)
 {
@@ -749,7 +919,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetVertexShaderConstantB(UINT StartRe
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetStreamSource(UINT StreamNumber, IDirect3DVertexBuffer9 *pStreamData, UINT OffsetInBytes, UINT Stride)
 {
-	return _orig->SetStreamSource(StreamNumber, pStreamData, OffsetInBytes, Stride);
+	const HRESULT hr = _orig->SetStreamSource(StreamNumber, pStreamData, OffsetInBytes, Stride);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_stream_source(StreamNumber, pStreamData, OffsetInBytes, Stride);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetStreamSource(UINT StreamNumber, IDirect3DVertexBuffer9 **ppStreamData, UINT *OffsetInBytes, UINT *pStride)
 {
@@ -765,7 +942,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetStreamSourceFreq(UINT StreamNumber
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetIndices(IDirect3DIndexBuffer9 *pIndexData)
 {
-	return _orig->SetIndices(pIndexData);
+	const HRESULT hr = _orig->SetIndices(pIndexData);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_indices(pIndexData);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetIndices(IDirect3DIndexBuffer9 **ppIndexData)
 {
@@ -777,7 +961,14 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::CreatePixelShader(const DWORD *pFunct
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetPixelShader(IDirect3DPixelShader9 *pShader)
 {
-	return _redirect->SetPixelShader(pShader);
+	const HRESULT hr = _redirect->SetPixelShader(pShader);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_pixel_shader(pShader);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetPixelShader(IDirect3DPixelShader9 **ppShader)
 {
@@ -785,7 +976,16 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetPixelShader(IDirect3DPixelShader9
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::SetPixelShaderConstantF(UINT StartRegister, const float *pConstantData, UINT Vector4fCount)
 {
-	return _orig->SetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+	_redirect->OnSetPixelShaderConstantF(StartRegister, Vector4fCount);
+
+	const HRESULT hr = _orig->SetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+
+	if (SUCCEEDED(hr))
+	{
+		_state_tracker.set_pixel_shader_constants(StartRegister, pConstantData, Vector4fCount);
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetPixelShaderConstantF(UINT StartRegister, float *pConstantData, UINT Vector4fCount)
 {
@@ -845,7 +1045,11 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::PresentEx(const RECT *pSourceRect, co
 
 	_implicit_swapchain->_runtime->on_present();
 
-	return static_cast<IDirect3DDevice9Ex *>(_orig)->PresentEx(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion, dwFlags);
+	const HRESULT hr = static_cast<IDirect3DDevice9Ex *>(_orig)->PresentEx(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion, dwFlags);
+
+	_implicit_swapchain->_runtime->wait_for_overlay();
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetGPUThreadPriority(INT *pPriority)
 {
@@ -935,6 +1139,10 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::ResetEx(D3DPRESENT_PARAMETERS *pPrese
 	runtime->on_reset();
 
 	_auto_depthstencil.reset();
+	_redirect->InvalidateFogConstant();
+
+	// Default pool objects may not be referenced during a reset
+	_state_tracker.release();
 
 	const HRESULT hr = static_cast<IDirect3DDevice9Ex *>(_orig)->ResetEx(pPresentationParameters, pFullscreenDisplayMode);
 
@@ -959,6 +1167,9 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice9::ResetEx(D3DPRESENT_PARAMETERS *pPrese
 		SetDepthStencilSurface(_auto_depthstencil.get());
 	}
 
+	// Reset restored all device state to its defaults
+	_state_tracker.sync(_orig);
+
 	return hr;
 }
 HRESULT STDMETHODCALLTYPE Direct3DDevice9::GetDisplayModeEx(UINT iSwapChain, D3DDISPLAYMODEEX *pMode, D3DDISPLAYROTATION *pRotation)
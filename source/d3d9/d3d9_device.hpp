@@ -6,7 +6,10 @@
 #pragma once
 
 #include "d3d9.hpp"
+#include "d3d9_state_tracker.hpp"
 #include "../gw2/hook_gw2.hpp"
+#include <mutex>
+#include <unordered_map>
 
 struct Direct3DDevice9 : IDirect3DDevice9Ex
 {
@@ -163,6 +166,9 @@ struct Direct3DDevice9 : IDirect3DDevice9Ex
 	virtual HRESULT STDMETHODCALLTYPE GetDisplayModeEx(UINT iSwapChain, D3DDISPLAYMODEEX *pMode, D3DDISPLAYROTATION *pRotation) override;
 	#pragma endregion
 
+	void enable_managed_pool_replacement();
+	void replace_managed_pool(D3DRESOURCETYPE Type, D3DFORMAT Format, DWORD &Usage, D3DPOOL &Pool);
+
 	LONG _ref = 1;
 	IDirect3DDevice9 *_orig;
 	hook_gw2 *_redirect;
@@ -170,6 +176,16 @@ struct Direct3DDevice9 : IDirect3DDevice9Ex
 	Direct3DSwapChain9 *_implicit_swapchain = nullptr;
 	std::vector<Direct3DSwapChain9 *> _additional_swapchains;
 	com_ptr<IDirect3DSurface9> _auto_depthstencil;
+	reshade::d3d9::d3d9_state_tracker _state_tracker;
 	bool _use_software_rendering = false;
 	bool _reset_fail_guard = false;
+	// Set when the game asked for a plain device, but got an extended one, which does not support 'D3DPOOL_MANAGED'
+	bool _managed_pool_replaced = false;
+	// Adapter and display format the device was created with, queried once for the format checks of 'replace_managed_pool'
+	com_ptr<IDirect3D9> _d3d;
+	D3DDEVICE_CREATION_PARAMETERS _creation_parameters = { };
+	D3DFORMAT _adapter_format = D3DFMT_UNKNOWN;
+	// Whether dynamic usage is supported, keyed by usage, resource type and format, since games create lots of resources of the same few kinds, possibly from several threads
+	std::unordered_map<unsigned long long, bool> _dynamic_usage_support;
+	std::mutex _dynamic_usage_mutex;
 };
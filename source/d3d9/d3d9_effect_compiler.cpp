@@ -5,11 +5,12 @@
 
 #include "d3d9_runtime.hpp"
 #include "d3d9_effect_compiler.hpp"
+#include "effect_fusion.hpp"
+#include "effect_reachability.hpp"
+#include "gpu_marker.hpp"
 #include <assert.h>
-#include <iomanip>
 #include <fstream>
 #include <algorithm>
-#include <d3dcompiler.h>
 
 namespace reshadefx
 {
@@ -21,6 +22,23 @@ namespace reshade::d3d9
 	using namespace reshadefx;
 	using namespace reshadefx::nodes;
 
+	// Sampler type and the texture functions the shader model does not provide, which every generated shader starts with
+	static const char s_shader_header[] =
+		"#pragma warning(disable: 3571)\n"
+		"struct __sampler2D { sampler2D s; float2 pixelsize; };\n"
+		"float4 __tex2Dfetch(__sampler2D s, int4 c) { return tex2Dlod(s.s, float4(c.xy * (c.w + 1) * s.pixelsize, 0, 0)); }\n"
+		"float4 __tex2Dlodoffset(__sampler2D s, float4 c, int2 offset) { return tex2Dlod(s.s, c + float4(offset * s.pixelsize, 0, 0)); }\n"
+		"float4 __tex2Doffset(__sampler2D s, float2 c, int2 offset) { return tex2D(s.s, c + offset * s.pixelsize); }\n"
+		"int2 __tex2Dsize(__sampler2D s, int lod) { return int2(1 / s.pixelsize) / exp2(lod); }\n"
+		"float4 __tex2Dgather0(__sampler2D s, float2 c) { return float4(tex2Dlod(s.s, float4(c + float2(0, 1) * s.pixelsize, 0, 0)).r, tex2Dlod(s.s, float4(c + float2(1, 1) * s.pixelsize.xy, 0, 0)).r, tex2Dlod(s.s, float4(c + float2(1, 0) * s.pixelsize.xy, 0, 0)).r, tex2Dlod(s.s, float4(c, 0, 0)).r); }\n"
+		"float4 __tex2Dgather1(__sampler2D s, float2 c) { return float4(tex2Dlod(s.s, float4(c + float2(0, 1) * s.pixelsize, 0, 0)).g, tex2Dlod(s.s, float4(c + float2(1, 1) * s.pixelsize.xy, 0, 0)).g, tex2Dlod(s.s, float4(c + float2(1, 0) * s.pixelsize.xy, 0, 0)).g, tex2Dlod(s.s, float4(c, 0, 0)).g); }\n"
+		"float4 __tex2Dgather2(__sampler2D s, float2 c) { return float4(tex2Dlod(s.s, float4(c + float2(0, 1) * s.pixelsize, 0, 0)).b, tex2Dlod(s.s, float4(c + float2(1, 1) * s.pixelsize.xy, 0, 0)).b, tex2Dlod(s.s, float4(c + float2(1, 0) * s.pixelsize.xy, 0, 0)).b, tex2Dlod(s.s, float4(c, 0, 0)).b); }\n"
+		"float4 __tex2Dgather3(__sampler2D s, float2 c) { return float4(tex2Dlod(s.s, float4(c + float2(0, 1) * s.pixelsize, 0, 0)).a, tex2Dlod(s.s, float4(c + float2(1, 1) * s.pixelsize.xy, 0, 0)).a, tex2Dlod(s.s, float4(c + float2(1, 0) * s.pixelsize.xy, 0, 0)).a, tex2Dlod(s.s, float4(c, 0, 0)).a); }\n"
+		"float4 __tex2Dgather0offset(__sampler2D s, float2 c, int2 offset) { return __tex2Dgather0(s, c + offset * s.pixelsize); }\n"
+		"float4 __tex2Dgather1offset(__sampler2D s, float2 c, int2 offset) { return __tex2Dgather1(s, c + offset * s.pixelsize); }\n"
+		"float4 __tex2Dgather2offset(__sampler2D s, float2 c, int2 offset) { return __tex2Dgather2(s, c + offset * s.pixelsize); }\n"
+		"float4 __tex2Dgather3offset(__sampler2D s, float2 c, int2 offset) { return __tex2Dgather3(s, c + offset * s.pixelsize); }\n";
+
 	static inline bool is_pow2(int x)
 	{
 		return ((x > 0) && ((x & (x - 1)) == 0));
@@ -161,21 +179,9 @@ namespace reshade::d3d9
 #endif
 	}
 
-	bool d3d9_effect_compiler::run()
+	bool d3d9_effect_compiler::compile()
 	{
-		_d3dcompiler_module = LoadLibraryW(L"d3dcompiler_47.dll");
-
-		if (_d3dcompiler_module == nullptr)
-		{
-			_d3dcompiler_module = LoadLibraryW(L"d3dcompiler_43.dll");
-		}
-		if (_d3dcompiler_module == nullptr)
-		{
-			_errors += "Unable to load D3DCompiler library. Make sure you have the DirectX end-user runtime (June 2010) installed or a newer version of the library in the application directory.\n";
-			return false;
-		}
-
-		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
+		_is_compiled = true;
 
 		for (auto node : _ast.structs)
 		{
@@ -184,6 +190,8 @@ namespace reshade::d3d9
 
 		for (auto uniform : _ast.variables)
 		{
+			const auto code_begin = _global_code.size();
+
 			if (uniform->type.is_texture())
 			{
 				visit_texture(uniform);
@@ -192,6 +200,10 @@ namespace reshade::d3d9
 			{
 				visit_sampler(uniform);
 			}
+			else if (uniform->type.is_storage() || uniform->type.has_qualifier(type_node::qualifier_groupshared))
+			{
+				error(uniform->location, "storage objects and 'groupshared' variables are not supported in Direct3D 9, check '__RENDERER__' to leave them out");
+			}
 			else if (uniform->type.has_qualifier(type_node::qualifier_uniform))
 			{
 				visit_uniform(uniform);
@@ -202,11 +214,13 @@ namespace reshade::d3d9
 
 				_global_code << ";\n";
 			}
+
+			_global_declarations.push_back({ uniform, code_begin, _global_code.size() });
 		}
 
 		for (auto function : _ast.functions)
 		{
-			std::stringstream function_code;
+			code_buffer function_code;
 
 			_functions[_current_function = function];
 
@@ -220,7 +234,66 @@ namespace reshade::d3d9
 			visit_technique(technique);
 		}
 
-		FreeLibrary(_d3dcompiler_module);
+		return _success;
+	}
+	bool d3d9_effect_compiler::run()
+	{
+		if (!_is_compiled)
+		{
+			compile();
+		}
+		if (!_success)
+		{
+			return false;
+		}
+
+		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
+
+		for (auto variable : _ast.variables)
+		{
+			if (variable->type.is_texture())
+			{
+				create_texture(variable);
+			}
+		}
+
+		if (!_success)
+		{
+			return false;
+		}
+
+		for (const auto &binding : _sampler_bindings)
+		{
+			const auto texture = _runtime->find_texture(binding.second->properties.texture->unique_name);
+
+			if (texture == nullptr)
+			{
+				error(binding.second->location, "texture not found");
+				return false;
+			}
+
+			binding.first->texture = texture->impl->as<d3d9_tex_data>();
+		}
+
+		for (auto &obj : _uniforms)
+		{
+			obj.storage_offset += _uniform_storage_offset;
+
+			_runtime->add_uniform(std::move(obj));
+		}
+
+		if (!_uniform_data.empty())
+		{
+			auto &uniform_storage = _runtime->get_uniform_value_storage();
+			uniform_storage.resize(_uniform_storage_offset + _uniform_data.size());
+
+			CopyMemory(uniform_storage.data() + _uniform_storage_offset, _uniform_data.data(), _uniform_data.size());
+		}
+
+		for (auto &technique : _techniques)
+		{
+			create_technique(technique);
+		}
 
 		return _success;
 	}
@@ -236,7 +309,7 @@ namespace reshade::d3d9
 		_errors += location.source + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): warning: " + message + '\n';
 	}
 
-	void d3d9_effect_compiler::visit(std::stringstream &output, const statement_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const statement_node *node)
 	{
 		if (node == nullptr)
 		{
@@ -276,7 +349,7 @@ namespace reshade::d3d9
 				assert(false);
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const expression_node *node)
 	{
 		assert(node != nullptr);
 
@@ -326,7 +399,7 @@ namespace reshade::d3d9
 		}
 	}
 
-	void d3d9_effect_compiler::visit(std::stringstream &output, const type_node &type, bool with_qualifiers)
+	void d3d9_effect_compiler::visit(code_buffer &output, const type_node &type, bool with_qualifiers)
 	{
 		if (with_qualifiers)
 		{
@@ -390,7 +463,7 @@ namespace reshade::d3d9
 			output << type.rows;
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const lvalue_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const lvalue_expression_node *node)
 	{
 		output << node->reference->unique_name;
 
@@ -399,7 +472,7 @@ namespace reshade::d3d9
 			_functions.at(_current_function).sampler_dependencies.insert(node->reference);
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const literal_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const literal_expression_node *node)
 	{
 		if (!node->type.is_scalar())
 		{
@@ -422,7 +495,7 @@ namespace reshade::d3d9
 					output << node->value_uint[i];
 					break;
 				case type_node::datatype_float:
-					output << std::setprecision(8) << std::fixed << node->value_float[i];
+					output << node->value_float[i];
 					break;
 			}
 
@@ -437,7 +510,7 @@ namespace reshade::d3d9
 			output << ')';
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const expression_sequence_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const expression_sequence_node *node)
 	{
 		output << '(';
 
@@ -453,7 +526,7 @@ namespace reshade::d3d9
 
 		output << ')';
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const unary_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const unary_expression_node *node)
 	{
 		switch (node->op)
 		{
@@ -494,7 +567,7 @@ namespace reshade::d3d9
 				break;
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const binary_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const binary_expression_node *node)
 	{
 		std::string part1, part2, part3;
 
@@ -611,8 +684,16 @@ namespace reshade::d3d9
 		visit(output, node->operands[1]);
 		output << part3;
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const intrinsic_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const intrinsic_expression_node *node)
 	{
+		// The fusion analysis made sure these are only sampled at the current pixel, which is what the previous fragment returned
+		if (_fused_samplers != nullptr && node->op == intrinsic_expression_node::texture && node->arguments[0]->id == nodeid::lvalue_expression &&
+			_fused_samplers->count(static_cast<const lvalue_expression_node *>(node->arguments[0])->reference) != 0)
+		{
+			output << "__fused_color";
+			return;
+		}
+
 		std::string part1, part2, part3, part4, part5;
 
 		switch (node->op)
@@ -652,6 +733,10 @@ namespace reshade::d3d9
 				part2 = ", ";
 				part3 = ")";
 				break;
+			case intrinsic_expression_node::barrier:
+			case intrinsic_expression_node::texture_store:
+				error(node->location, "'" + std::string(node->op == intrinsic_expression_node::barrier ? "barrier" : "tex2Dstore") + "' is only supported in compute shaders, which Direct3D 9 does not support");
+				return;
 			case intrinsic_expression_node::ceil:
 				part1 = "ceil(";
 				part2 = ")";
@@ -992,7 +1077,7 @@ namespace reshade::d3d9
 
 		output << part5;
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const conditional_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const conditional_expression_node *node)
 	{
 		output << '(';
 		visit(output, node->condition);
@@ -1002,7 +1087,7 @@ namespace reshade::d3d9
 		visit(output, node->expression_when_false);
 		output << ')';
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const swizzle_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const swizzle_expression_node *node)
 	{
 		visit(output, node->operand);
 
@@ -1034,13 +1119,13 @@ namespace reshade::d3d9
 			}
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const field_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const field_expression_node *node)
 	{
 		output << '(';
 		visit(output, node->operand);
 		output << '.' << node->field_reference->unique_name << ')';
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const assignment_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const assignment_expression_node *node)
 	{
 		std::string part1, part2, part3;
 
@@ -1087,7 +1172,7 @@ namespace reshade::d3d9
 		visit(output, node->right);
 		output << part3 << ')';
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const call_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const call_expression_node *node)
 	{
 		output << node->callee->unique_name << '(';
 
@@ -1121,7 +1206,7 @@ namespace reshade::d3d9
 			info.dependencies.push_back(node->callee);
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const constructor_expression_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const constructor_expression_node *node)
 	{
 		visit(output, node->type, false);
 		output << '(';
@@ -1138,7 +1223,7 @@ namespace reshade::d3d9
 
 		output << ')';
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const initializer_list_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const initializer_list_node *node)
 	{
 		output << "{ ";
 
@@ -1154,7 +1239,7 @@ namespace reshade::d3d9
 
 		output << " }";
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const compound_statement_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const compound_statement_node *node)
 	{
 		output << "{\n";
 
@@ -1165,7 +1250,7 @@ namespace reshade::d3d9
 
 		output << "}\n";
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const declarator_list_node *node, bool single_statement)
+	void d3d9_effect_compiler::visit(code_buffer &output, const declarator_list_node *node, bool single_statement)
 	{
 		bool with_type = true;
 
@@ -1185,14 +1270,34 @@ namespace reshade::d3d9
 
 		output << ";\n";
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const expression_statement_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const expression_statement_node *node)
 	{
 		visit(output, node->expression);
 
 		output << ";\n";
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const if_statement_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const if_statement_node *node)
 	{
+		// Conditions that were folded into a constant, like uniforms baked in performance mode, only need the branch that is taken, which also drops the samplers that are only used in the other one
+		if (node->condition->id == nodeid::literal_expression && node->condition->type.is_scalar())
+		{
+			float condition;
+			scalar_literal_cast(static_cast<const literal_expression_node *>(node->condition), 0, condition);
+
+			const auto statement = condition != 0 ? node->statement_when_true : node->statement_when_false;
+
+			if (statement != nullptr)
+			{
+				visit(output, statement);
+			}
+			else
+			{
+				output << "\t;";
+			}
+
+			return;
+		}
+
 		for (const auto &attribute : node->attributes)
 		{
 			output << '[' << attribute << ']';
@@ -1220,7 +1325,7 @@ namespace reshade::d3d9
 			visit(output, node->statement_when_false);
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const switch_statement_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const switch_statement_node *node)
 	{
 		warning(node->location, "switch statements do not currently support fall-through in Direct3D9!");
 
@@ -1245,7 +1350,7 @@ namespace reshade::d3d9
 
 		output << "} while (false);\n";
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const case_statement_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const case_statement_node *node)
 	{
 		output << "if (";
 
@@ -1271,7 +1376,7 @@ namespace reshade::d3d9
 
 		visit(output, node->statement_list);
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const for_statement_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const for_statement_node *node)
 	{
 		for (const auto &attribute : node->attributes)
 		{
@@ -1286,7 +1391,7 @@ namespace reshade::d3d9
 			{
 				visit(output, static_cast<declarator_list_node *>(node->init_statement), true);
 
-				output.seekp(-2, std::ios_base::end);
+				output.pop_back(2);
 			}
 			else
 			{
@@ -1319,7 +1424,7 @@ namespace reshade::d3d9
 			output << "\t;";
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const while_statement_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const while_statement_node *node)
 	{
 		for (const auto &attribute : node->attributes)
 		{
@@ -1359,7 +1464,7 @@ namespace reshade::d3d9
 			}
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const return_statement_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const return_statement_node *node)
 	{
 		if (node->is_discard)
 		{
@@ -1379,7 +1484,7 @@ namespace reshade::d3d9
 
 		output << ";\n";
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const jump_statement_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const jump_statement_node *node)
 	{
 		if (node->is_break)
 		{
@@ -1390,7 +1495,7 @@ namespace reshade::d3d9
 			output << "continue;\n";
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const struct_declaration_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const struct_declaration_node *node)
 	{
 		output << "struct " << node->unique_name << "\n{\n";
 
@@ -1410,7 +1515,7 @@ namespace reshade::d3d9
 
 		output << "};\n";
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const variable_declaration_node *node, bool with_type, bool with_semantic)
+	void d3d9_effect_compiler::visit(code_buffer &output, const variable_declaration_node *node, bool with_type, bool with_semantic)
 	{
 		if (with_type)
 		{
@@ -1444,7 +1549,7 @@ namespace reshade::d3d9
 			visit(output, node->initializer_expression);
 		}
 	}
-	void d3d9_effect_compiler::visit(std::stringstream &output, const function_declaration_node *node)
+	void d3d9_effect_compiler::visit(code_buffer &output, const function_declaration_node *node)
 	{
 		visit(output, node->return_type, false);
 
@@ -1460,12 +1565,28 @@ namespace reshade::d3d9
 			}
 		}
 
+		if (_fused_samplers != nullptr)
+		{
+			output << (node->parameter_list.empty() ? "float4 __fused_color" : ", float4 __fused_color");
+		}
+
 		output << ")\n";
 
 		visit(output, node->definition);
 	}
 
 	void d3d9_effect_compiler::visit_texture(const variable_declaration_node *node)
+	{
+		// The texture itself needs the device, so it is only added by 'create_texture'
+		if (!node->semantic.empty() &&
+			node->semantic != "COLOR" && node->semantic != "SV_TARGET" &&
+			node->semantic != "DEPTH" && node->semantic != "SV_DEPTH" &&
+			node->semantic != "LINEAR_DEPTH" && node->semantic != "COLOR_MIPMAPS")
+		{
+			error(node->location, "invalid semantic");
+		}
+	}
+	void d3d9_effect_compiler::create_texture(const variable_declaration_node *node)
 	{
 		const auto existing_texture = _runtime->find_texture(node->unique_name);
 
@@ -1487,7 +1608,7 @@ namespace reshade::d3d9
 		const auto obj_data = obj.impl->as<d3d9_tex_data>();
 		obj.name = node->name;
 		obj.unique_name = node->unique_name;
-		obj.annotations = node->annotation_list;
+		copy_annotations(node->annotation_list, obj.annotations);
 		UINT width = obj.width = node->properties.width;
 		UINT height = obj.height = node->properties.height;
 		UINT levels = obj.levels = node->properties.levels;
@@ -1501,10 +1622,13 @@ namespace reshade::d3d9
 		{
 			_runtime->update_texture_reference(obj, texture_reference::depth_buffer);
 		}
-		else if (!node->semantic.empty())
+		else if (node->semantic == "LINEAR_DEPTH")
 		{
-			error(node->location, "invalid semantic");
-			return;
+			_runtime->update_texture_reference(obj, texture_reference::linear_depth_buffer);
+		}
+		else if (node->semantic == "COLOR_MIPMAPS")
+		{
+			_runtime->update_texture_reference(obj, texture_reference::back_buffer_mipmaps);
 		}
 		else
 		{
@@ -1532,33 +1656,18 @@ namespace reshade::d3d9
 				usage |= D3DUSAGE_RENDERTARGET;
 			}
 
-			hr = _runtime->_device->CreateTexture(width, height, levels, usage, format, D3DPOOL_DEFAULT, &obj_data->texture, nullptr);
-
-			if (FAILED(hr))
-			{
-				error(node->location, "internal texture creation failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-				return;
-			}
-
-			hr = obj_data->texture->GetSurfaceLevel(0, &obj_data->surface);
-
-			assert(SUCCEEDED(hr));
+			// The texture itself is only created once a technique using it is compiled, see 'd3d9_runtime::update_texture_allocations'
+			obj_data->levels = levels;
+			obj_data->usage = usage;
+			obj_data->format = format;
 		}
 
 		_runtime->add_texture(std::move(obj));
 	}
 	void d3d9_effect_compiler::visit_sampler(const variable_declaration_node *node)
 	{
-		const auto texture = _runtime->find_texture(node->properties.texture->unique_name);
-
-		if (texture == nullptr)
-		{
-			error(node->location, "texture not found");
-			return;
-		}
-
 		d3d9_sampler sampler;
-		sampler.texture = texture->impl->as<d3d9_tex_data>();
+		sampler.texture = nullptr;
 		sampler.states[D3DSAMP_ADDRESSU] = static_cast<D3DTEXTUREADDRESS>(node->properties.address_u);
 		sampler.states[D3DSAMP_ADDRESSV] = static_cast<D3DTEXTUREADDRESS>(node->properties.address_v);
 		sampler.states[D3DSAMP_ADDRESSW] = static_cast<D3DTEXTUREADDRESS>(node->properties.address_w);
@@ -1577,23 +1686,26 @@ namespace reshade::d3d9
 	{
 		auto type = node->type;
 		type.basetype = type_node::datatype_float;
-		visit(_global_code, type);
 
-		_global_code << ' ' << node->unique_name;
+		code_buffer declaration;
+		visit(declaration, type);
+
+		declaration << ' ' << node->unique_name;
 
 		if (node->type.is_array())
 		{
-			_global_code << '[';
+			declaration << '[';
 
 			if (node->type.array_length > 0)
 			{
-				_global_code << node->type.array_length;
+				declaration << node->type.array_length;
 			}
 
-			_global_code << ']';
+			declaration << ']';
 		}
 
-		_global_code << " : register(c" << _constant_register_count << ");\n";
+		_global_code << declaration.str() << " : register(c" << _constant_register_count << ");\n";
+		_uniform_declarations[node] = { declaration.str(), _constant_register_count };
 
 		uniform obj;
 		obj.name = node->name;
@@ -1604,37 +1716,93 @@ namespace reshade::d3d9
 		obj.columns = node->type.cols;
 		obj.elements = node->type.array_length;
 		obj.storage_size = obj.rows * obj.columns * std::max(1u, obj.elements) * 4;
-		obj.annotations = node->annotation_list;
+		copy_annotations(node->annotation_list, obj.annotations);
 
-		obj.storage_offset = _uniform_storage_offset + _constant_register_count * 16;
+		obj.storage_offset = _constant_register_count * 16;
 		_constant_register_count += (obj.storage_size / 4 + 4 - ((obj.storage_size / 4) % 4)) / 4;
 
-		auto &uniform_storage = _runtime->get_uniform_value_storage();
-
-		if (_uniform_storage_offset + _constant_register_count * 16 >= uniform_storage.size())
-		{
-			uniform_storage.resize(uniform_storage.size() + 4096);
-		}
+		_uniform_data.resize(_constant_register_count * 16);
 
 		if (node->initializer_expression != nullptr && node->initializer_expression->id == nodeid::literal_expression)
 		{
 			for (size_t i = 0; i < obj.storage_size / 4; i++)
 			{
-				scalar_literal_cast(static_cast<const literal_expression_node *>(node->initializer_expression), i, reinterpret_cast<float *>(uniform_storage.data() + obj.storage_offset)[i]);
+				scalar_literal_cast(static_cast<const literal_expression_node *>(node->initializer_expression), i, reinterpret_cast<float *>(_uniform_data.data() + obj.storage_offset)[i]);
 			}
 		}
-		else
-		{
-			ZeroMemory(uniform_storage.data() + obj.storage_offset, obj.storage_size);
-		}
 
-		_runtime->add_uniform(std::move(obj));
+		_uniforms.push_back(std::move(obj));
 	}
 	void d3d9_effect_compiler::visit_technique(const technique_declaration_node *node)
 	{
 		technique obj;
+		obj.impl = std::make_unique<d3d9_technique_data>();
 		obj.name = node->name;
-		obj.annotations = node->annotation_list;
+		copy_annotations(node->annotation_list, obj.annotations);
+
+		auto obj_data = obj.impl->as<d3d9_technique_data>();
+
+		for (auto pass : node->pass_list)
+		{
+			obj.passes.emplace_back(std::make_unique<d3d9_pass_data>());
+			auto &pass_data = *static_cast<d3d9_pass_data *>(obj.passes.back().get());
+			visit_pass(pass, pass_data);
+			name_unnamed_pass(pass_data.name, obj.passes.size() - 1);
+
+			// Pixel shader passes without a render target draw to the back buffer
+			obj.writes_backbuffer |= pass->compute_shader == nullptr && pass->render_targets[0] == nullptr;
+		}
+
+		obj_data->skip_shader_optimization = _skip_shader_optimization;
+		obj_data->vertex_shaders_use_uniforms = std::any_of(node->pass_list.begin(), node->pass_list.end(), [](const pass_declaration_node *pass) {
+			if (pass->vertex_shader == nullptr)
+			{
+				return false;
+			}
+
+			reachable_declarations reachable;
+			find_reachable_declarations(pass->vertex_shader, reachable);
+
+			return std::any_of(reachable.variables.begin(), reachable.variables.end(), [](auto variable) { return variable->type.has_qualifier(type_node::qualifier_uniform); });
+		});
+
+		// Single pass techniques may be fused with the techniques rendered right before and after them, see 'd3d9_runtime::render_fused_techniques'
+		if (_success && node->pass_list.size() == 1)
+		{
+			obj_data->fusion = visit_pass_fusion(node->pass_list[0]);
+		}
+
+		// Techniques the preset has no use for are compiled the first time they are enabled
+		const bool has_bytecode = _success && !_runtime->is_technique_deferrable(obj.name, obj.annotations);
+
+		if (has_bytecode && !_runtime->compile_technique_shaders(obj, _errors))
+		{
+			error(node->location, "internal shader compilation failed");
+			return;
+		}
+
+		_techniques.push_back({ node, std::move(obj), has_bytecode });
+	}
+	void d3d9_effect_compiler::create_technique(compiled_technique &compiled)
+	{
+		technique &obj = compiled.obj;
+		const auto obj_data = obj.impl->as<d3d9_technique_data>();
+
+		for (auto &queries : obj_data->queries)
+		{
+			// Timestamp queries are optional, so simply leave all sets empty if the driver does not support them, which disables timing for the technique
+			if (FAILED(_runtime->_device->CreateQuery(D3DQUERYTYPE_TIMESTAMPDISJOINT, &queries.timestamp_disjoint)) ||
+				FAILED(_runtime->_device->CreateQuery(D3DQUERYTYPE_TIMESTAMPFREQ, &queries.timestamp_frequency)) ||
+				FAILED(_runtime->_device->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &queries.timestamp_query_beg)) ||
+				FAILED(_runtime->_device->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &queries.timestamp_query_end)))
+			{
+				for (auto &set : obj_data->queries)
+				{
+					set = d3d9_technique_data::timestamp_queries();
+				}
+				break;
+			}
+		}
 
 		if (_constant_register_count != 0)
 		{
@@ -1642,19 +1810,43 @@ namespace reshade::d3d9
 			obj.uniform_storage_offset = _uniform_storage_offset;
 		}
 
-		for (auto pass : node->pass_list)
+		for (size_t i = 0; i < obj.passes.size(); i++)
 		{
-			obj.passes.emplace_back(std::make_unique<d3d9_pass_data>());
-			visit_pass(pass, *static_cast<d3d9_pass_data *>(obj.passes.back().get()));
+			create_pass(compiled.node->pass_list[i], *obj.passes[i]->as<d3d9_pass_data>());
+		}
+
+		if (!_success)
+		{
+			return;
+		}
+
+		if (compiled.has_bytecode && !_runtime->create_technique_shaders(obj, _errors))
+		{
+			error(compiled.node->location, "internal shader creation failed");
+			return;
 		}
 
 		_runtime->add_technique(std::move(obj));
 	}
 	void d3d9_effect_compiler::visit_pass(const pass_declaration_node *node, d3d9_pass_data & pass)
 	{
-		pass.render_targets[0] = _runtime->_backbuffer_resolved.get();
+		if (node->compute_shader != nullptr)
+		{
+			error(node->location, "compute passes are not supported in Direct3D 9, check '__RENDERER__' to provide a pixel shader pass instead");
+			return;
+		}
+
+		pass.name = node->name;
 		pass.clear_render_targets = node->clear_render_targets;
 
+		if (node->pixel_shader != nullptr)
+		{
+			reachable_declarations reachable;
+			find_reachable_declarations(node->pixel_shader, reachable);
+
+			pass.discards_pixels = reachable.discards;
+		}
+
 		std::string samplers;
 		const char shader_types[2][3] = { "vs", "ps" };
 		const function_declaration_node *shader_functions[2] = { node->vertex_shader, node->pixel_shader };
@@ -1669,6 +1861,7 @@ namespace reshade::d3d9
 			for (auto sampler : _functions.at(shader_functions[i]).sampler_dependencies)
 			{
 				pass.samplers[pass.sampler_count] = _samplers.at(sampler->name);
+				_sampler_bindings.emplace_back(&pass.samplers[pass.sampler_count], sampler);
 				const auto *const texture = sampler->properties.texture;
 
 				samplers += "sampler2D __Sampler";
@@ -1679,16 +1872,21 @@ namespace reshade::d3d9
 				samplers += " = { __Sampler";
 				samplers += sampler->unique_name;
 
-				if (texture->semantic == "COLOR" || texture->semantic == "SV_TARGET" || texture->semantic == "DEPTH" || texture->semantic == "SV_DEPTH")
+				if (texture->semantic == "COLOR" || texture->semantic == "SV_TARGET")
 				{
-					samplers += ", float2(" + std::to_string(1.0f / _runtime->frame_width()) + ", " + std::to_string(1.0f / _runtime->frame_height()) + ")";
+					pass.samples_backbuffer = true;
 				}
-				else
+
+				if (texture->semantic == "LINEAR_DEPTH")
 				{
-					samplers += ", float2(" + std::to_string(1.0f / texture->properties.width) + ", " + std::to_string(1.0f / texture->properties.height) + ")";
+					pass.samples_linear_depth = true;
+				}
+				else if (texture->semantic == "COLOR_MIPMAPS")
+				{
+					pass.samples_backbuffer_mipmaps = true;
 				}
 
-				samplers += " };\n";
+				samplers += ", " + sampler_pixelsize(texture) + " };\n";
 
 				if (pass.sampler_count == 16)
 				{
@@ -1706,73 +1904,67 @@ namespace reshade::d3d9
 			}
 		}
 
-		const auto &device = _runtime->_device;
-		const HRESULT hr = device->BeginStateBlock();
-
-		if (FAILED(hr))
-		{
-			error(node->location, "internal pass stateblock creation failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-			return;
-		}
+		const auto set_render_state = [&pass](D3DRENDERSTATETYPE state, DWORD value) { pass.render_states.emplace_back(state, value); };
+
+		set_render_state(D3DRS_ZENABLE, false);
+		set_render_state(D3DRS_SPECULARENABLE, false);
+		set_render_state(D3DRS_FILLMODE, D3DFILL_SOLID);
+		set_render_state(D3DRS_SHADEMODE, D3DSHADE_GOURAUD);
+		set_render_state(D3DRS_ZWRITEENABLE, true);
+		set_render_state(D3DRS_ALPHATESTENABLE, false);
+		set_render_state(D3DRS_LASTPIXEL, true);
+		set_render_state(D3DRS_SRCBLEND, literal_to_blend_func(node->src_blend));
+		set_render_state(D3DRS_DESTBLEND, literal_to_blend_func(node->dest_blend));
+		set_render_state(D3DRS_ALPHAREF, 0);
+		set_render_state(D3DRS_ALPHAFUNC, D3DCMP_ALWAYS);
+		set_render_state(D3DRS_DITHERENABLE, false);
+		set_render_state(D3DRS_FOGSTART, 0);
+		set_render_state(D3DRS_FOGEND, 1);
+		set_render_state(D3DRS_FOGDENSITY, 1);
+		set_render_state(D3DRS_ALPHABLENDENABLE, node->blend_enable);
+		set_render_state(D3DRS_DEPTHBIAS, 0);
+		set_render_state(D3DRS_STENCILENABLE, node->stencil_enable);
+		set_render_state(D3DRS_STENCILPASS, literal_to_stencil_op(node->stencil_op_pass));
+		set_render_state(D3DRS_STENCILFAIL, literal_to_stencil_op(node->stencil_op_fail));
+		set_render_state(D3DRS_STENCILZFAIL, literal_to_stencil_op(node->stencil_op_depth_fail));
+		set_render_state(D3DRS_STENCILFUNC, static_cast<D3DCMPFUNC>(node->stencil_comparison_func));
+		set_render_state(D3DRS_STENCILREF, node->stencil_reference_value);
+		set_render_state(D3DRS_STENCILMASK, node->stencil_read_mask);
+		set_render_state(D3DRS_STENCILWRITEMASK, node->stencil_write_mask);
+		set_render_state(D3DRS_TEXTUREFACTOR, 0xFFFFFFFF);
+		set_render_state(D3DRS_LOCALVIEWER, true);
+		set_render_state(D3DRS_EMISSIVEMATERIALSOURCE, D3DMCS_MATERIAL);
+		set_render_state(D3DRS_AMBIENTMATERIALSOURCE, D3DMCS_MATERIAL);
+		set_render_state(D3DRS_DIFFUSEMATERIALSOURCE, D3DMCS_COLOR1);
+		set_render_state(D3DRS_SPECULARMATERIALSOURCE, D3DMCS_COLOR2);
+		set_render_state(D3DRS_COLORWRITEENABLE, node->color_write_mask);
+		set_render_state(D3DRS_BLENDOP, static_cast<D3DBLENDOP>(node->blend_op));
+		set_render_state(D3DRS_SCISSORTESTENABLE, false);
+		set_render_state(D3DRS_SLOPESCALEDEPTHBIAS, 0);
+		set_render_state(D3DRS_ANTIALIASEDLINEENABLE, false);
+		set_render_state(D3DRS_TWOSIDEDSTENCILMODE, false);
+		set_render_state(D3DRS_CCW_STENCILFAIL, D3DSTENCILOP_KEEP);
+		set_render_state(D3DRS_CCW_STENCILZFAIL, D3DSTENCILOP_KEEP);
+		set_render_state(D3DRS_CCW_STENCILPASS, D3DSTENCILOP_KEEP);
+		set_render_state(D3DRS_CCW_STENCILFUNC, D3DCMP_ALWAYS);
+		set_render_state(D3DRS_COLORWRITEENABLE1, 0x0000000F);
+		set_render_state(D3DRS_COLORWRITEENABLE2, 0x0000000F);
+		set_render_state(D3DRS_COLORWRITEENABLE3, 0x0000000F);
+		set_render_state(D3DRS_BLENDFACTOR, 0xFFFFFFFF);
+		set_render_state(D3DRS_SRGBWRITEENABLE, node->srgb_write_enable);
+		set_render_state(D3DRS_SEPARATEALPHABLENDENABLE, false);
+		set_render_state(D3DRS_SRCBLENDALPHA, literal_to_blend_func(node->src_blend_alpha));
+		set_render_state(D3DRS_DESTBLENDALPHA, literal_to_blend_func(node->dest_blend_alpha));
+		set_render_state(D3DRS_BLENDOPALPHA, static_cast<D3DBLENDOP>(node->blend_op_alpha));
+		set_render_state(D3DRS_FOGENABLE, false);
+		set_render_state(D3DRS_CULLMODE, D3DCULL_NONE);
+		set_render_state(D3DRS_LIGHTING, false);
+	}
+	void d3d9_effect_compiler::create_pass(const pass_declaration_node *node, d3d9_pass_data &pass)
+	{
+		pass.render_targets[0] = _runtime->_backbuffer_resolved.get();
 
-		device->SetVertexShader(pass.vertex_shader.get());
-		device->SetPixelShader(pass.pixel_shader.get());
-
-		device->SetRenderState(D3DRS_ZENABLE, false);
-		device->SetRenderState(D3DRS_SPECULARENABLE, false);
-		device->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
-		device->SetRenderState(D3DRS_SHADEMODE, D3DSHADE_GOURAUD);
-		device->SetRenderState(D3DRS_ZWRITEENABLE, true);
-		device->SetRenderState(D3DRS_ALPHATESTENABLE, false);
-		device->SetRenderState(D3DRS_LASTPIXEL, true);
-		device->SetRenderState(D3DRS_SRCBLEND, literal_to_blend_func(node->src_blend));
-		device->SetRenderState(D3DRS_DESTBLEND, literal_to_blend_func(node->dest_blend));
-		device->SetRenderState(D3DRS_ALPHAREF, 0);
-		device->SetRenderState(D3DRS_ALPHAFUNC, D3DCMP_ALWAYS);
-		device->SetRenderState(D3DRS_DITHERENABLE, false);
-		device->SetRenderState(D3DRS_FOGSTART, 0);
-		device->SetRenderState(D3DRS_FOGEND, 1);
-		device->SetRenderState(D3DRS_FOGDENSITY, 1);
-		device->SetRenderState(D3DRS_ALPHABLENDENABLE, node->blend_enable);
-		device->SetRenderState(D3DRS_DEPTHBIAS, 0);
-		device->SetRenderState(D3DRS_STENCILENABLE, node->stencil_enable);
-		device->SetRenderState(D3DRS_STENCILPASS, literal_to_stencil_op(node->stencil_op_pass));
-		device->SetRenderState(D3DRS_STENCILFAIL, literal_to_stencil_op(node->stencil_op_fail));
-		device->SetRenderState(D3DRS_STENCILZFAIL, literal_to_stencil_op(node->stencil_op_depth_fail));
-		device->SetRenderState(D3DRS_STENCILFUNC, static_cast<D3DCMPFUNC>(node->stencil_comparison_func));
-		device->SetRenderState(D3DRS_STENCILREF, node->stencil_reference_value);
-		device->SetRenderState(D3DRS_STENCILMASK, node->stencil_read_mask);
-		device->SetRenderState(D3DRS_STENCILWRITEMASK, node->stencil_write_mask);
-		device->SetRenderState(D3DRS_TEXTUREFACTOR, 0xFFFFFFFF);
-		device->SetRenderState(D3DRS_LOCALVIEWER, true);
-		device->SetRenderState(D3DRS_EMISSIVEMATERIALSOURCE, D3DMCS_MATERIAL);
-		device->SetRenderState(D3DRS_AMBIENTMATERIALSOURCE, D3DMCS_MATERIAL);
-		device->SetRenderState(D3DRS_DIFFUSEMATERIALSOURCE, D3DMCS_COLOR1);
-		device->SetRenderState(D3DRS_SPECULARMATERIALSOURCE, D3DMCS_COLOR2);
-		device->SetRenderState(D3DRS_COLORWRITEENABLE, node->color_write_mask);
-		device->SetRenderState(D3DRS_BLENDOP, static_cast<D3DBLENDOP>(node->blend_op));
-		device->SetRenderState(D3DRS_SCISSORTESTENABLE, false);
-		device->SetRenderState(D3DRS_SLOPESCALEDEPTHBIAS, 0);
-		device->SetRenderState(D3DRS_ANTIALIASEDLINEENABLE, false);
-		device->SetRenderState(D3DRS_TWOSIDEDSTENCILMODE, false);
-		device->SetRenderState(D3DRS_CCW_STENCILFAIL, D3DSTENCILOP_KEEP);
-		device->SetRenderState(D3DRS_CCW_STENCILZFAIL, D3DSTENCILOP_KEEP);
-		device->SetRenderState(D3DRS_CCW_STENCILPASS, D3DSTENCILOP_KEEP);
-		device->SetRenderState(D3DRS_CCW_STENCILFUNC, D3DCMP_ALWAYS);
-		device->SetRenderState(D3DRS_COLORWRITEENABLE1, 0x0000000F);
-		device->SetRenderState(D3DRS_COLORWRITEENABLE2, 0x0000000F);
-		device->SetRenderState(D3DRS_COLORWRITEENABLE3, 0x0000000F);
-		device->SetRenderState(D3DRS_BLENDFACTOR, 0xFFFFFFFF);
-		device->SetRenderState(D3DRS_SRGBWRITEENABLE, node->srgb_write_enable);
-		device->SetRenderState(D3DRS_SEPARATEALPHABLENDENABLE, false);
-		device->SetRenderState(D3DRS_SRCBLENDALPHA, literal_to_blend_func(node->src_blend_alpha));
-		device->SetRenderState(D3DRS_DESTBLENDALPHA, literal_to_blend_func(node->dest_blend_alpha));
-		device->SetRenderState(D3DRS_BLENDOPALPHA, static_cast<D3DBLENDOP>(node->blend_op_alpha));
-		device->SetRenderState(D3DRS_FOGENABLE, false);
-		device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
-		device->SetRenderState(D3DRS_LIGHTING, false);
-
-		device->EndStateBlock(&pass.stateblock);
+		const auto &device = _runtime->_device;
 
 		D3DCAPS9 caps;
 		device->GetDeviceCaps(&caps);
@@ -1798,28 +1990,262 @@ namespace reshade::d3d9
 				return;
 			}
 
-			pass.render_targets[i] = texture->impl->as<d3d9_tex_data>()->surface.get();
+			pass.render_target_textures[i] = texture->impl->as<d3d9_tex_data>();
+			pass.render_targets[i] = nullptr;
+		}
+
+		for (const auto target : pass.render_targets)
+		{
+			if (target == _runtime->_backbuffer_resolved)
+			{
+				pass.writes_backbuffer = true;
+			}
+		}
+	}
+	std::unique_ptr<d3d9_fusion_fragment> d3d9_effect_compiler::visit_pass_fusion(const pass_declaration_node *node)
+	{
+		pass_fusion_info info;
+		analyze_pass_fusion(node, info);
+
+		if (!info.replaces_backbuffer)
+		{
+			return nullptr;
+		}
+
+		// A fused pass runs the vertex shader of the first technique, which only gives the same result for the others if it does not depend on the uniforms or textures of an effect
+		reachable_declarations vertex_shader_reachable;
+		find_reachable_declarations(node->vertex_shader, vertex_shader_reachable);
+
+		if (!_functions.at(node->vertex_shader).sampler_dependencies.empty() ||
+			std::any_of(vertex_shader_reachable.variables.begin(), vertex_shader_reachable.variables.end(), [](auto variable) { return variable->type.has_qualifier(type_node::qualifier_uniform); }))
+		{
+			return nullptr;
+		}
+
+		const function_declaration_node *const pixel_shader = node->pixel_shader;
+
+		reachable_declarations reachable;
+		find_reachable_declarations(pixel_shader, reachable);
+
+		auto fragment = std::make_unique<d3d9_fusion_fragment>();
+		fragment->entry_point = pixel_shader->unique_name;
+		fragment->reads_backbuffer_pointwise = info.reads_backbuffer_pointwise;
+
+		// Locals keep their names, so only the global declarations need to be renamed
+		for (auto structure : _ast.structs)
+		{
+			fragment->identifiers.push_back(structure->unique_name);
+		}
+		for (auto function : reachable.functions)
+		{
+			fragment->identifiers.push_back(function->unique_name);
+		}
+		for (auto variable : reachable.variables)
+		{
+			if (std::find(_ast.variables.begin(), _ast.variables.end(), variable) == _ast.variables.end() || variable->type.is_texture())
+			{
+				continue;
+			}
+
+			fragment->identifiers.push_back(variable->unique_name);
+
+			if (const auto it = _uniform_declarations.find(variable); it != _uniform_declarations.end())
+			{
+				fragment->uniforms.push_back({ it->second.first, static_cast<UINT>(it->second.second) });
+			}
+		}
+
+		for (auto sampler : _functions.at(pixel_shader).sampler_dependencies)
+		{
+			fragment->identifiers.push_back("__Sampler" + sampler->unique_name);
+			fragment->samplers.push_back({ sampler->unique_name, sampler_pixelsize(sampler->properties.texture), _samplers.at(sampler->name), info.backbuffer_samplers.count(sampler) != 0 });
+		}
+
+		// Sort everything that was collected from hash sets, so the same effect always results in the same fused source and the shader cache can be used
+		std::sort(fragment->identifiers.begin(), fragment->identifiers.end());
+		std::sort(fragment->uniforms.begin(), fragment->uniforms.end(), [](const auto &lhs, const auto &rhs) { return lhs.register_index < rhs.register_index; });
+		std::sort(fragment->samplers.begin(), fragment->samplers.end(), [](const auto &lhs, const auto &rhs) { return lhs.name < rhs.name; });
+
+		for (auto &sampler : fragment->samplers)
+		{
+			for (auto dependency : _functions.at(pixel_shader).sampler_dependencies)
+			{
+				if (dependency->unique_name == sampler.name)
+				{
+					_sampler_bindings.emplace_back(&sampler.sampler, dependency);
+				}
+			}
+		}
+
+		fragment->code = reachable_global_code(pixel_shader, false);
+
+		for (auto dependency : _functions.at(pixel_shader).dependencies)
+		{
+			fragment->code += _functions.at(dependency).code;
+		}
+
+		fragment->entry_point_code = _functions.at(pixel_shader).code;
+
+		if (info.reads_backbuffer_pointwise)
+		{
+			code_buffer fused_code;
+
+			_fused_samplers = &info.backbuffer_samplers;
+			_current_function = pixel_shader;
+
+			visit(fused_code, pixel_shader);
+
+			_fused_samplers = nullptr;
+
+			fragment->fused_entry_point_code = fused_code.str();
+		}
+
+		code_buffer parameters, signature;
+
+		for (size_t i = 0, count = pixel_shader->parameter_list.size(); i < count; i++)
+		{
+			const auto parameter = pixel_shader->parameter_list[i];
+
+			visit(parameters, parameter->type);
+			visit(signature, parameter->type);
+
+			parameters << ' ' << parameter->name;
+
+			if (parameter->type.is_array())
+			{
+				signature << '[' << parameter->type.array_length << ']';
+				parameters << '[' << parameter->type.array_length << ']';
+			}
+
+			if (!parameter->semantic.empty())
+			{
+				signature << " : " << convert_semantic(parameter->semantic);
+				parameters << " : " << convert_semantic(parameter->semantic);
+			}
+
+			fragment->arguments += parameter->name;
+
+			if (i < count - 1)
+			{
+				signature << ", ";
+				parameters << ", ";
+				fragment->arguments += ", ";
+			}
 		}
+
+		fragment->parameters = parameters.str();
+		fragment->signature = signature.str();
+
+		return fragment;
+	}
+	std::string d3d9_effect_compiler::build_fused_pixel_shader(const d3d9_fusion_fragment *const *fragments, const UINT *uniform_registers, size_t count, D3DFORMAT backbuffer_format)
+	{
+		code_buffer source;
+
+		source << s_shader_header << "#define POSITION VPOS\n";
+
+		for (size_t i = 0, sampler_index = 0; i < count; i++)
+		{
+			const d3d9_fusion_fragment &fragment = *fragments[i];
+			const std::string prefix = "__fused" + std::to_string(i) + '_';
+
+			// Renaming with the preprocessor keeps the generated code of each fragment as it is
+			for (const auto &identifier : fragment.identifiers)
+			{
+				source << "#define " << identifier << ' ' << prefix << identifier << '\n';
+			}
+
+			for (const auto &uniform : fragment.uniforms)
+			{
+				source << uniform.declaration << " : register(c" << uniform_registers[i] + uniform.register_index << ");\n";
+			}
+
+			for (const auto &sampler : fragment.samplers)
+			{
+				// The fragments after the first one take the result of the previous fragment in place of the back buffer
+				if (i != 0 && sampler.is_backbuffer)
+				{
+					continue;
+				}
+
+				source << "sampler2D __Sampler" << sampler.name << " : register(s" << sampler_index++ << ");\n";
+				source << "static const __sampler2D " << sampler.name << " = { __Sampler" << sampler.name << ", " << sampler.pixelsize << " };\n";
+			}
+
+			source << fragment.code << (i == 0 ? fragment.entry_point_code : fragment.fused_entry_point_code);
+
+			for (const auto &identifier : fragment.identifiers)
+			{
+				source << "#undef " << identifier << '\n';
+			}
+		}
+
+		// Round the color between fragments the same way storing it in the back buffer would, so the result matches rendering the techniques one after another
+		std::string quantization;
+
+		switch (backbuffer_format)
+		{
+			case D3DFMT_A8R8G8B8:
+			case D3DFMT_A8B8G8R8:
+				quantization = "__fused_color = round(saturate(__fused_color) * 255.0) / 255.0;\n";
+				break;
+			case D3DFMT_X8R8G8B8:
+			case D3DFMT_X8B8G8R8:
+				quantization = "__fused_color = float4(round(saturate(__fused_color.rgb) * 255.0) / 255.0, 1.0);\n";
+				break;
+			case D3DFMT_A2R10G10B10:
+			case D3DFMT_A2B10G10R10:
+				quantization = "__fused_color = round(saturate(__fused_color) * float4(1023.0, 1023.0, 1023.0, 3.0)) / float4(1023.0, 1023.0, 1023.0, 3.0);\n";
+				break;
+		}
+
+		const d3d9_fusion_fragment &first = *fragments[0];
+
+		source << "float4 __main(" << first.parameters << ") : COLOR\n{\n";
+		source << "float4 __fused_color = __fused0_" << first.entry_point << '(' << first.arguments << ");\n";
+
+		for (size_t i = 1; i < count; i++)
+		{
+			source << quantization;
+			source << "__fused_color = __fused" << i << '_' << fragments[i]->entry_point << '(' << first.arguments << (first.arguments.empty() ? "" : ", ") << "__fused_color);\n";
+		}
+
+		source << "return __fused_color;\n}\n";
+
+		return source.str();
+	}
+	std::string d3d9_effect_compiler::sampler_pixelsize(const variable_declaration_node *texture) const
+	{
+		// All textures bound to a semantic have the size of the frame
+		if (!texture->semantic.empty())
+		{
+			return "float2(" + std::to_string(1.0f / _runtime->frame_width()) + ", " + std::to_string(1.0f / _runtime->frame_height()) + ")";
+		}
+		else
+		{
+			return "float2(" + std::to_string(1.0f / texture->properties.width) + ", " + std::to_string(1.0f / texture->properties.height) + ")";
+		}
+	}
+	std::string d3d9_effect_compiler::reachable_global_code(const function_declaration_node *entry_point, bool with_uniforms) const
+	{
+		reachable_declarations reachable;
+		find_reachable_declarations(entry_point, reachable);
+
+		if (!with_uniforms)
+		{
+			for (const auto &uniform : _uniform_declarations)
+			{
+				reachable.variables.erase(uniform.first);
+			}
+		}
+
+		return reshadefx::reachable_global_code(_global_code.str(), _global_declarations, reachable);
 	}
 	void d3d9_effect_compiler::visit_pass_shader(const function_declaration_node *node, const std::string &shadertype, const std::string &samplers, d3d9_pass_data &pass)
 	{
-		std::stringstream source;
-
-		source <<
-			"#pragma warning(disable: 3571)\n"
-			"struct __sampler2D { sampler2D s; float2 pixelsize; };\n"
-			"float4 __tex2Dfetch(__sampler2D s, int4 c) { return tex2Dlod(s.s, float4(c.xy * (c.w + 1) * s.pixelsize, 0, 0)); }\n"
-			"float4 __tex2Dlodoffset(__sampler2D s, float4 c, int2 offset) { return tex2Dlod(s.s, c + float4(offset * s.pixelsize, 0, 0)); }\n"
-			"float4 __tex2Doffset(__sampler2D s, float2 c, int2 offset) { return tex2D(s.s, c + offset * s.pixelsize); }\n"
-			"int2 __tex2Dsize(__sampler2D s, int lod) { return int2(1 / s.pixelsize) / exp2(lod); }\n"
-			"float4 __tex2Dgather0(__sampler2D s, float2 c) { return float4(tex2Dlod(s.s, float4(c + float2(0, 1) * s.pixelsize, 0, 0)).r, tex2Dlod(s.s, float4(c + float2(1, 1) * s.pixelsize.xy, 0, 0)).r, tex2Dlod(s.s, float4(c + float2(1, 0) * s.pixelsize.xy, 0, 0)).r, tex2Dlod(s.s, float4(c, 0, 0)).r); }\n"
-			"float4 __tex2Dgather1(__sampler2D s, float2 c) { return float4(tex2Dlod(s.s, float4(c + float2(0, 1) * s.pixelsize, 0, 0)).g, tex2Dlod(s.s, float4(c + float2(1, 1) * s.pixelsize.xy, 0, 0)).g, tex2Dlod(s.s, float4(c + float2(1, 0) * s.pixelsize.xy, 0, 0)).g, tex2Dlod(s.s, float4(c, 0, 0)).g); }\n"
-			"float4 __tex2Dgather2(__sampler2D s, float2 c) { return float4(tex2Dlod(s.s, float4(c + float2(0, 1) * s.pixelsize, 0, 0)).b, tex2Dlod(s.s, float4(c + float2(1, 1) * s.pixelsize.xy, 0, 0)).b, tex2Dlod(s.s, float4(c + float2(1, 0) * s.pixelsize.xy, 0, 0)).b, tex2Dlod(s.s, float4(c, 0, 0)).b); }\n"
-			"float4 __tex2Dgather3(__sampler2D s, float2 c) { return float4(tex2Dlod(s.s, float4(c + float2(0, 1) * s.pixelsize, 0, 0)).a, tex2Dlod(s.s, float4(c + float2(1, 1) * s.pixelsize.xy, 0, 0)).a, tex2Dlod(s.s, float4(c + float2(1, 0) * s.pixelsize.xy, 0, 0)).a, tex2Dlod(s.s, float4(c, 0, 0)).a); }\n"
-			"float4 __tex2Dgather0offset(__sampler2D s, float2 c, int2 offset) { return __tex2Dgather0(s, c + offset * s.pixelsize); }\n"
-			"float4 __tex2Dgather1offset(__sampler2D s, float2 c, int2 offset) { return __tex2Dgather1(s, c + offset * s.pixelsize); }\n"
-			"float4 __tex2Dgather2offset(__sampler2D s, float2 c, int2 offset) { return __tex2Dgather2(s, c + offset * s.pixelsize); }\n"
-			"float4 __tex2Dgather3offset(__sampler2D s, float2 c, int2 offset) { return __tex2Dgather3(s, c + offset * s.pixelsize); }\n";
+		code_buffer source(_global_code.size() + 16 * 1024);
+
+		source << s_shader_header;
 
 		if (shadertype == "vs")
 		{
@@ -1831,7 +2257,7 @@ namespace reshade::d3d9
 		}
 
 		source << samplers;
-		source << _global_code.str();
+		source << reachable_global_code(node);
 
 		for (auto dependency : _functions.at(node).dependencies)
 		{
@@ -2044,41 +2470,14 @@ namespace reshade::d3d9
 		}
 #endif
 
-		UINT flags = 0;
-		com_ptr<ID3DBlob> compiled, errors;
-
-		if (_skip_shader_optimization)
-		{
-			flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-		}
-
-		const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3dcompiler_module, "D3DCompile"));
-		HRESULT hr = D3DCompile(source_str.c_str(), source_str.size(), nullptr, nullptr, nullptr, "__main", (shadertype + "_3_0").c_str(), flags, 0, &compiled, &errors);
-
-		if (errors != nullptr)
-		{
-			_errors.append(static_cast<const char *>(errors->GetBufferPointer()), errors->GetBufferSize() - 1);
-		}
-
-		if (FAILED(hr))
-		{
-			error(node->location, "internal shader compilation failed");
-			return;
-		}
-
+		// Compiled together with the other passes once the technique is done, or when it is first enabled
 		if (shadertype == "vs")
 		{
-			hr = _runtime->_device->CreateVertexShader(static_cast<const DWORD *>(compiled->GetBufferPointer()), &pass.vertex_shader);
+			pass.vertex_shader_source = source_str;
 		}
 		else if (shadertype == "ps")
 		{
-			hr = _runtime->_device->CreatePixelShader(static_cast<const DWORD *>(compiled->GetBufferPointer()), &pass.pixel_shader);
-		}
-
-		if (FAILED(hr))
-		{
-			error(node->location, "internal shader creation failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-			return;
+			pass.pixel_shader_source = source_str;
 		}
 	}
 }
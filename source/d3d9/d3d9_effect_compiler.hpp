@@ -6,7 +6,10 @@
 #pragma once
 
 #include "effect_syntax_tree.hpp"
-#include <sstream>
+#include "effect_code_buffer.hpp"
+#include "effect_reachability.hpp"
+#include "runtime_objects.hpp"
+#include <d3d9.h>
 #include <unordered_set>
 
 namespace reshade::d3d9
@@ -14,49 +17,74 @@ namespace reshade::d3d9
 	#pragma region Forward Declarations
 	struct d3d9_sampler;
 	struct d3d9_pass_data;
+	struct d3d9_fusion_fragment;
 	class d3d9_runtime;
 	#pragma endregion
 
-	class d3d9_effect_compiler
+	class d3d9_effect_compiler : public base_object
 	{
 	public:
 		d3d9_effect_compiler(d3d9_runtime *runtime, const reshadefx::syntax_tree &ast, std::string &errors, bool skipoptimization = false);
 
+		/// <summary>
+		/// Generate the HLSL code of the effect and compile the shaders of the techniques that are not deferred. This creates no device objects, so it can run on a compile worker thread.
+		/// </summary>
+		bool compile();
+		/// <summary>
+		/// Create the textures, queries, shaders and stateblocks of the effect and add it to the runtime on the render thread. Calls <see cref="compile"/> first if that did not happen yet.
+		/// </summary>
 		bool run();
 
+		/// <summary>
+		/// Build the source of a pixel shader that runs the pixel shaders of several techniques one after another, handing the color each of them returns on to the next one in place of the back buffer.
+		/// </summary>
+		/// <param name="fragments">The pixel shaders to fuse, in the order the techniques are rendered.</param>
+		/// <param name="uniform_registers">The first constant register of the uniforms of each fragment.</param>
+		/// <param name="count">The number of fragments.</param>
+		/// <param name="backbuffer_format">The format of the back buffer, which the color is rounded to between fragments.</param>
+		static std::string build_fused_pixel_shader(const d3d9_fusion_fragment *const *fragments, const UINT *uniform_registers, size_t count, D3DFORMAT backbuffer_format);
+
 	private:
+		// A technique built by <see cref="compile"/>, which is only added to the runtime by <see cref="run"/>
+		struct compiled_technique
+		{
+			const reshadefx::nodes::technique_declaration_node *node;
+			technique obj;
+			bool has_bytecode = false;
+		};
+
 		void error(const reshadefx::location &location, const std::string &message);
 		void warning(const reshadefx::location &location, const std::string &message);
 
-		void visit(std::stringstream &output, const reshadefx::nodes::statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::type_node &type, bool with_qualifiers = true);
-		void visit(std::stringstream &output, const reshadefx::nodes::lvalue_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::literal_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_sequence_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::unary_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::binary_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::intrinsic_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::conditional_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::swizzle_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::field_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::assignment_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::call_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::constructor_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::initializer_list_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::compound_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::declarator_list_node *node, bool single_statement = false);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::if_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::switch_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::case_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::for_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::while_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::return_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::jump_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::struct_declaration_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::variable_declaration_node *node, bool with_type = true, bool with_semantic = true);
-		void visit(std::stringstream &output, const reshadefx::nodes::function_declaration_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::type_node &type, bool with_qualifiers = true);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::lvalue_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::literal_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_sequence_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::unary_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::binary_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::intrinsic_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::conditional_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::swizzle_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::field_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::assignment_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::call_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::constructor_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::initializer_list_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::compound_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::declarator_list_node *node, bool single_statement = false);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::if_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::switch_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::case_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::for_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::while_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::return_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::jump_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::struct_declaration_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::variable_declaration_node *node, bool with_type = true, bool with_semantic = true);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::function_declaration_node *node);
 
 		void visit_texture(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_sampler(const reshadefx::nodes::variable_declaration_node *node);
@@ -64,6 +92,14 @@ namespace reshade::d3d9
 		void visit_technique(const reshadefx::nodes::technique_declaration_node *node);
 		void visit_pass(const reshadefx::nodes::pass_declaration_node *node, d3d9_pass_data &pass);
 		void visit_pass_shader(const reshadefx::nodes::function_declaration_node *node, const std::string &shadertype, const std::string &samplers, d3d9_pass_data &pass);
+		std::unique_ptr<d3d9_fusion_fragment> visit_pass_fusion(const reshadefx::nodes::pass_declaration_node *node);
+
+		void create_texture(const reshadefx::nodes::variable_declaration_node *node);
+		void create_technique(compiled_technique &compiled);
+		void create_pass(const reshadefx::nodes::pass_declaration_node *node, d3d9_pass_data &pass);
+
+		std::string reachable_global_code(const reshadefx::nodes::function_declaration_node *entry_point, bool with_uniforms = true) const;
+		std::string sampler_pixelsize(const reshadefx::nodes::variable_declaration_node *texture) const;
 
 		struct function
 		{
@@ -73,16 +109,27 @@ namespace reshade::d3d9
 		};
 
 		d3d9_runtime *_runtime;
-		bool _success = true;
+		bool _success = true, _is_compiled = false;
 		const reshadefx::syntax_tree &_ast;
 		std::string &_errors;
 		size_t _uniform_storage_offset = 0, _constant_register_count = 0;
-		std::stringstream _global_code, _global_uniforms;
+		reshadefx::code_buffer _global_code, _global_uniforms;
+		// Parts of the global code that belong to a single variable or function, so each shader can leave out those it does not reference
+		std::vector<reshadefx::global_declaration> _global_declarations;
 		bool _skip_shader_optimization;
 		const reshadefx::nodes::function_declaration_node *_current_function;
 		std::unordered_map<std::string, d3d9_sampler> _samplers;
+		// Every copy of a sampler in the passes and fusion fragments, whose texture is only filled in once the textures exist
+		std::vector<std::pair<d3d9_sampler *, const reshadefx::nodes::variable_declaration_node *>> _sampler_bindings;
+		// Uniforms with offsets relative to the start of the effect, and their initial values, which are added to the runtime storage by <see cref="run"/>
+		std::vector<uniform> _uniforms;
+		std::vector<unsigned char> _uniform_data;
+		std::vector<compiled_technique> _techniques;
 		std::unordered_map<const reshadefx::nodes::function_declaration_node *, function> _functions;
-		HMODULE _d3dcompiler_module = nullptr;
+		// Declaration of each uniform without its register, and the register it starts at, so fused shaders can move it to other registers
+		std::unordered_map<const reshadefx::nodes::variable_declaration_node *, std::pair<std::string, size_t>> _uniform_declarations;
+		// Set while the pixel shader of a fusion fragment is written, the back buffer samplers in it are replaced with the result of the previous fragment
+		const std::unordered_set<const reshadefx::nodes::variable_declaration_node *> *_fused_samplers = nullptr;
 #if RESHADE_DUMP_NATIVE_SHADERS
 		filesystem::path _dump_filename;
 		std::unordered_set<std::string> _dumped_shaders;
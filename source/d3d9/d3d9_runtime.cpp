@@ -8,8 +8,19 @@
 #include "d3d9_effect_compiler.hpp"
 #include "effect_lexer.hpp"
 #include "input.hpp"
+#include "shader_cache.hpp"
+#include "profiler.hpp"
+#include "hook_manager.hpp"
+#include "pixel_conversion.hpp"
+#include "gpu_marker.hpp"
 #include <imgui.h>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
 #include <algorithm>
+#include <unordered_set>
+#include <d3dcompiler.h>
 
 const auto D3DFMT_INTZ = static_cast<D3DFORMAT>(MAKEFOURCC('I', 'N', 'T', 'Z'));
 const auto D3DFMT_DF16 = static_cast<D3DFORMAT>(MAKEFOURCC('D', 'F', '1', '6'));
@@ -17,12 +28,39 @@ const auto D3DFMT_DF24 = static_cast<D3DFORMAT>(MAKEFOURCC('D', 'F', '2', '4'));
 
 namespace reshade::d3d9
 {
+	/// <summary>
+	/// Labels the commands recorded during its lifetime for PIX and other GPU debuggers, while GPU markers are enabled.
+	/// </summary>
+	class gpu_marker
+	{
+	public:
+		gpu_marker(bool enabled, const std::string &name) : _end_event(enabled ? get_d3d9_event_functions().end_event : nullptr)
+		{
+			if (_end_event != nullptr)
+			{
+				get_d3d9_event_functions().begin_event(D3DCOLOR_XRGB(255, 128, 0), wide_marker_name(name).c_str());
+			}
+		}
+		~gpu_marker()
+		{
+			if (_end_event != nullptr)
+			{
+				_end_event();
+			}
+		}
+
+	private:
+		int (WINAPI *const _end_event)();
+	};
+
 	d3d9_runtime::d3d9_runtime(IDirect3DDevice9 *device, IDirect3DSwapChain9 *swapchain) :
 		runtime(0x9300), _device(device), _swapchain(swapchain)
 	{
 		assert(device != nullptr);
 		assert(swapchain != nullptr);
 
+		_is_d3d9 = true;
+
 		_device->GetDirect3D(&_d3d);
 
 		assert(_d3d != nullptr);
@@ -44,11 +82,32 @@ namespace reshade::d3d9
 		subscribe_to_menu("DX9", [this]() { draw_debug_menu(); });
 		subscribe_to_load_config([this](const ini_file& config) {
 			config.get("DX9_BUFFER_DETECTION", "DisableINTZ", _disable_intz);
+			config.get("DX9_BUFFER_DETECTION", "SkipWhenUnused", _skip_unused_depth_detection);
+			config.get("DX9_BUFFER_DETECTION", "LockDetection", _lock_depth_detection);
 		});
 		subscribe_to_save_config([this](ini_file& config) {
 			config.set("DX9_BUFFER_DETECTION", "DisableINTZ", _disable_intz);
+			config.set("DX9_BUFFER_DETECTION", "SkipWhenUnused", _skip_unused_depth_detection);
+			config.set("DX9_BUFFER_DETECTION", "LockDetection", _lock_depth_detection);
 		});
 	}
+	d3d9_runtime::~d3d9_runtime()
+	{
+		if (_optimization_worker.joinable())
+		{
+			{ const std::lock_guard<std::mutex> lock(_optimization_mutex);
+				_optimization_worker_exit = true;
+			}
+
+			_optimization_signal.notify_all();
+			_optimization_worker.join();
+		}
+
+		if (_d3dcompiler_module != nullptr)
+		{
+			FreeLibrary(_d3dcompiler_module);
+		}
+	}
 
 	bool d3d9_runtime::init_backbuffer_texture()
 	{
@@ -241,6 +300,135 @@ namespace reshade::d3d9
 		return true;
 	}
 
+	bool d3d9_runtime::init_linear_depth_texture()
+	{
+		HRESULT hr = _device->CreateTexture(_width, _height, 1, D3DUSAGE_RENDERTARGET, D3DFMT_R32F, D3DPOOL_DEFAULT, &_linear_depth_texture, nullptr);
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to create linear depth texture! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		_linear_depth_texture->GetSurfaceLevel(0, &_linear_depth_surface);
+
+		if (_linear_depth_pixel_shader == nullptr)
+		{
+			// Same linearization as 'ReShade.fxh', so effects can switch to the shared texture without changing their results
+			static const char vertex_shader_source[] =
+				"float4 __TEXEL_SIZE__ : register(c255);\n"
+				"void __main(float id : TEXCOORD0, out float4 position : POSITION, out float2 texcoord : TEXCOORD0)\n"
+				"{\n"
+				"\ttexcoord.x = (id == 2) ? 2.0 : 0.0;\n"
+				"\ttexcoord.y = (id == 1) ? 2.0 : 0.0;\n"
+				"\tposition = float4(texcoord * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);\n"
+				"\tposition.xy += __TEXEL_SIZE__.xy * position.ww;\n"
+				"}\n";
+			static const char pixel_shader_source[] =
+				"sampler2D __DepthSampler : register(s0);\n"
+				"float4 __main(float2 texcoord : TEXCOORD0) : COLOR\n"
+				"{\n"
+				"#if RESHADE_DEPTH_INPUT_IS_UPSIDE_DOWN\n"
+				"\ttexcoord.y = 1.0 - texcoord.y;\n"
+				"#endif\n"
+				"\tfloat depth = tex2Dlod(__DepthSampler, float4(texcoord, 0, 0)).x;\n"
+				"#if RESHADE_DEPTH_INPUT_IS_LOGARITHMIC\n"
+				"\tdepth = (exp(depth * log(0.01 + 1.0)) - 1.0) / 0.01;\n"
+				"#endif\n"
+				"#if RESHADE_DEPTH_INPUT_IS_REVERSED\n"
+				"\tdepth = 1.0 - depth;\n"
+				"#endif\n"
+				"\tdepth /= RESHADE_DEPTH_LINEARIZATION_FAR_PLANE - depth * (RESHADE_DEPTH_LINEARIZATION_FAR_PLANE - 1.0);\n"
+				"\treturn depth;\n"
+				"}\n";
+
+			std::vector<std::string> definitions = preprocessor_definitions();
+			std::vector<D3D_SHADER_MACRO> defines;
+
+			for (auto &definition : definitions)
+			{
+				const size_t equals_index = definition.find('=');
+
+				if (equals_index != std::string::npos)
+				{
+					definition[equals_index] = '\0';
+					defines.push_back({ definition.c_str(), definition.c_str() + equals_index + 1 });
+				}
+				else
+				{
+					defines.push_back({ definition.c_str(), "1" });
+				}
+			}
+
+			defines.push_back({ nullptr, nullptr });
+
+			std::string errors;
+			std::vector<char> bytecode;
+
+			if (!compile_shader(vertex_shader_source, "vs_3_0", defines.data(), 0, bytecode, errors) ||
+				FAILED(_device->CreateVertexShader(reinterpret_cast<const DWORD *>(bytecode.data()), &_linear_depth_vertex_shader)) ||
+				!compile_shader(pixel_shader_source, "ps_3_0", defines.data(), 0, bytecode, errors) ||
+				FAILED(_device->CreatePixelShader(reinterpret_cast<const DWORD *>(bytecode.data()), &_linear_depth_pixel_shader)))
+			{
+				LOG(ERROR) << "Failed to create depth linearization shaders:\n" << errors;
+
+				_linear_depth_vertex_shader.reset();
+				_linear_depth_pixel_shader.reset();
+				return false;
+			}
+		}
+
+		hr = _device->BeginStateBlock();
+
+		if (SUCCEEDED(hr))
+		{
+			_device->SetVertexShader(_linear_depth_vertex_shader.get());
+			_device->SetPixelShader(_linear_depth_pixel_shader.get());
+			_device->SetRenderState(D3DRS_ZENABLE, false);
+			_device->SetRenderState(D3DRS_ZWRITEENABLE, false);
+			_device->SetRenderState(D3DRS_ALPHATESTENABLE, false);
+			_device->SetRenderState(D3DRS_ALPHABLENDENABLE, false);
+			_device->SetRenderState(D3DRS_STENCILENABLE, false);
+			_device->SetRenderState(D3DRS_SCISSORTESTENABLE, false);
+			_device->SetRenderState(D3DRS_FOGENABLE, false);
+			_device->SetRenderState(D3DRS_SRGBWRITEENABLE, false);
+			_device->SetRenderState(D3DRS_COLORWRITEENABLE, 0x0000000F);
+			_device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+			_device->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
+			_device->SetSamplerState(0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+			_device->SetSamplerState(0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+			_device->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_POINT);
+			_device->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_POINT);
+			_device->SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_NONE);
+			_device->SetSamplerState(0, D3DSAMP_SRGBTEXTURE, false);
+
+			hr = _device->EndStateBlock(&_linear_depth_state);
+		}
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to create depth linearization state block! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		return true;
+	}
+	bool d3d9_runtime::init_backbuffer_mipmap_texture()
+	{
+		const HRESULT hr = _device->CreateTexture(_width, _height, 0, D3DUSAGE_RENDERTARGET | D3DUSAGE_AUTOGENMIPMAP, _backbuffer_format, D3DPOOL_DEFAULT, &_backbuffer_mipmap_texture, nullptr);
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to create back buffer mipmap texture! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		_backbuffer_mipmap_texture->SetAutoGenFilterType(D3DTEXF_LINEAR);
+		_backbuffer_mipmap_texture->GetSurfaceLevel(0, &_backbuffer_mipmap_surface);
+
+		return true;
+	}
+
 	bool d3d9_runtime::on_init(const D3DPRESENT_PARAMETERS &pp)
 	{
 		_width = pp.BackBufferWidth;
@@ -262,6 +450,30 @@ namespace reshade::d3d9
 			return false;
 		}
 
+		if (_max_frame_latency != 0)
+		{
+			if (com_ptr<IDirect3DDevice9Ex> device_ex; SUCCEEDED(_device->QueryInterface(IID_PPV_ARGS(&device_ex))))
+			{
+				device_ex->SetMaximumFrameLatency(_max_frame_latency);
+			}
+			else
+			{
+				_frame_latency_queries.resize(_max_frame_latency);
+				_frame_latency_index = 0;
+
+				for (auto &query : _frame_latency_queries)
+				{
+					if (FAILED(_device->CreateQuery(D3DQUERYTYPE_EVENT, &query)))
+					{
+						LOG(WARNING) << "Failed to create event queries for the maximum frame latency of " << _max_frame_latency << ".";
+
+						_frame_latency_queries.clear();
+						break;
+					}
+				}
+			}
+		}
+
 		return runtime::on_init();
 	}
 	void d3d9_runtime::on_reset()
@@ -287,6 +499,20 @@ namespace reshade::d3d9
 
 		_default_depthstencil.reset();
 
+		// Recreated at the new size through 'update_texture_reference', the shaders survive the reset
+		_linear_depth_texture.reset();
+		_linear_depth_surface.reset();
+		_linear_depth_state.reset();
+		_backbuffer_mipmap_texture.reset();
+		_backbuffer_mipmap_surface.reset();
+
+		_depth_copy_state.reset();
+		_replay_pass_queries.clear();
+
+		_frame_latency_queries.clear();
+
+		_fused_passes.clear();
+
 		_effect_triangle_buffer.reset();
 		_effect_triangle_layout.reset();
 
@@ -294,9 +520,18 @@ namespace reshade::d3d9
 		_imgui_index_buffer.reset();
 		_imgui_vertex_buffer_size = 0;
 		_imgui_index_buffer_size = 0;
+		_imgui_vertex_buffer_offset = 0;
+		_imgui_index_buffer_offset = 0;
 
 		_imgui_state.reset();
 
+		for (auto &slot : _screenshot_slots)
+		{
+			slot.copy.reset();
+			slot.readback.reset();
+			slot.copy_finished.reset();
+		}
+
 		// Clear depth source table
 		for (auto &it : _depth_source_table)
 		{
@@ -304,42 +539,91 @@ namespace reshade::d3d9
 		}
 
 		_depth_source_table.clear();
+		_current_depth_source = nullptr;
+
+		// Surfaces are created again after a reset, so detection starts over
+		_is_depth_detection_active = true;
+		_is_depth_source_locked = false;
+		_depth_source_stable_frames = 0;
+	}
+
+	void d3d9_runtime::on_reset_effect()
+	{
+		runtime::on_reset_effect();
+
+		// The techniques pending optimization are gone now
+		{ const std::lock_guard<std::mutex> lock(_optimization_mutex);
+			_optimization_jobs.clear();
+			_optimization_results.clear();
+		}
+
+		// Fused passes reference the techniques, so they are created again for the new ones
+		_fused_passes.clear();
+
+		// The depth linearization depends on the preprocessor definitions, which may have changed before effects are reloaded
+		_linear_depth_texture.reset();
+		_linear_depth_surface.reset();
+		_linear_depth_state.reset();
+		_linear_depth_vertex_shader.reset();
+		_linear_depth_pixel_shader.reset();
+		_backbuffer_mipmap_texture.reset();
+		_backbuffer_mipmap_surface.reset();
 	}
 
 	void d3d9_runtime::apply_effects(IDirect3DSurface9* surface) {
+		RESHADE_PROFILE_SCOPE("d3d9_runtime::apply_effects");
+
+		// Nothing worth post processing is on screen, so leave the GPU to the game
+		if (is_effect_suspended())
+		{
+			return;
+		}
 
 		detect_depth_source();
 
 		// Capture device state
-		_app_state->Capture();
+		saved_app_state app_state;
+		{
+			RESHADE_PROFILE_SCOPE("Capture state");
 
-		BOOL software_rendering_enabled;
-		D3DVIEWPORT9 viewport;
-		com_ptr<IDirect3DSurface9> stateblock_rendertargets[8], stateblock_depthstencil;
+			capture_app_state(app_state);
+		}
 
-		_device->GetViewport(&viewport);
+		// Render straight into the game surface when possible, instead of copying it to the back buffer and back again
+		_effect_target = can_render_effects_to(surface) ? surface : _backbuffer_resolved.get();
 
-		for (DWORD target = 0; target < _num_simultaneous_rendertargets; target++)
+		// Frame contents changed since the back buffer texture was last updated
+		_is_backbuffer_texture_outdated = true;
+		_is_linear_depth_outdated = true;
+		_is_backbuffer_mipmaps_outdated = true;
+
+		// Resolve buffer
+		if (_effect_target != surface)
 		{
-			_device->GetRenderTarget(target, &stateblock_rendertargets[target]);
-		}
+			RESHADE_PROFILE_SCOPE("Resolve");
 
-		_device->GetDepthStencilSurface(&stateblock_depthstencil);
+			_device->StretchRect(surface, nullptr, _backbuffer_resolved.get(), nullptr, D3DTEXF_NONE);
+		}
 
-		if ((_behavior_flags & D3DCREATE_MIXED_VERTEXPROCESSING) != 0)
+		// Save the frame before effects are applied to it, so the replay benchmark can render them on it later
+		if (_replay_capture_requested)
 		{
-			software_rendering_enabled = _device->GetSoftwareVertexProcessing();
+			_replay_capture_requested = false;
 
-			_device->SetSoftwareVertexProcessing(FALSE);
+			save_replay_frame(_effect_target);
 		}
 
-		// Resolve buffer
-		_device->StretchRect(surface, nullptr, _backbuffer_resolved.get(), nullptr, D3DTEXF_NONE);
-
 		// Apply post processing
 		if (is_effect_loaded())
 		{
-			_device->SetRenderTarget(0, _backbuffer_resolved.get());
+			evaluate_timestamp_queries();
+
+			if (_replay_benchmark_requested)
+			{
+				run_replay_benchmark();
+			}
+
+			_device->SetRenderTarget(0, _effect_target);
 			_device->SetDepthStencilSurface(nullptr);
 
 			// Setup vertex input
@@ -350,63 +634,129 @@ namespace reshade::d3d9
 		}
 
 		// Copy to buffer
-		_device->StretchRect(_backbuffer_resolved.get(), nullptr, surface, nullptr, D3DTEXF_NONE);
+		if (_effect_target != surface)
+		{
+			RESHADE_PROFILE_SCOPE("Copy back");
+
+			_device->StretchRect(_backbuffer_resolved.get(), nullptr, surface, nullptr, D3DTEXF_NONE);
+		}
+
+		_effect_target = nullptr;
 
 		// Apply previous device state
-		_app_state->Apply();
+		{
+			RESHADE_PROFILE_SCOPE("Restore state");
 
-		for (DWORD target = 0; target < _num_simultaneous_rendertargets; target++)
+			apply_app_state(app_state);
+		}
+	}
+
+	void d3d9_runtime::capture_app_state(saved_app_state &state)
+	{
+		_num_changed_samplers = 0;
+		_num_changed_constants = 0;
+		_uploaded_uniform_storage_offset = -1;
+		_uploaded_uniform_register_count = 0;
+		_uploaded_vertex_uniform_storage_offset = -1;
+		_uploaded_vertex_uniform_register_count = 0;
+
+		// The application may have changed any sampler since effects were last rendered
+		for (auto &applied : _applied_samplers)
 		{
-			_device->SetRenderTarget(target, stateblock_rendertargets[target].get());
+			applied.is_valid = false;
 		}
 
-		_device->SetDepthStencilSurface(stateblock_depthstencil.get());
+		// The device proxy tracks everything that is changed below, so there is no need to query the device
+		state.is_tracked = _state_tracker != nullptr && _state_tracker->is_valid();
+
+		if (!state.is_tracked)
+		{
+			_app_state->Capture();
+
+			_device->GetViewport(&state.viewport);
+
+			for (DWORD target = 0; target < _num_simultaneous_rendertargets; target++)
+			{
+				_device->GetRenderTarget(target, &state.rendertargets[target]);
+			}
 
-		_device->SetViewport(&viewport);
+			_device->GetDepthStencilSurface(&state.depthstencil);
+		}
 
 		if ((_behavior_flags & D3DCREATE_MIXED_VERTEXPROCESSING) != 0)
 		{
-			_device->SetSoftwareVertexProcessing(software_rendering_enabled);
+			state.software_rendering_enabled = _device->GetSoftwareVertexProcessing();
+
+			_device->SetSoftwareVertexProcessing(FALSE);
 		}
 	}
-
-	void d3d9_runtime::on_present()
+	void d3d9_runtime::apply_app_state(const saved_app_state &state)
 	{
-		if (!is_initialized())
-			return;
+		if (state.is_tracked)
+		{
+			_state_tracker->apply(_device.get(), _num_changed_samplers, _num_changed_constants);
+		}
+		else
+		{
+			_app_state->Apply();
 
-		// Begin post processing
-		if (FAILED(_device->BeginScene()))
-			return;
+			for (DWORD target = 0; target < _num_simultaneous_rendertargets; target++)
+			{
+				_device->SetRenderTarget(target, state.rendertargets[target].get());
+			}
 
-		_app_state->Capture();
+			_device->SetDepthStencilSurface(state.depthstencil.get());
 
-		BOOL software_rendering_enabled;
-		D3DVIEWPORT9 viewport;
-		com_ptr<IDirect3DSurface9> stateblock_rendertargets[8], stateblock_depthstencil;
+			_device->SetViewport(&state.viewport);
+		}
 
-		_device->GetViewport(&viewport);
+		if ((_behavior_flags & D3DCREATE_MIXED_VERTEXPROCESSING) != 0)
+		{
+			_device->SetSoftwareVertexProcessing(state.software_rendering_enabled);
+		}
+	}
 
-		for (DWORD target = 0; target < _num_simultaneous_rendertargets; target++)
+	bool d3d9_runtime::can_render_effects_to(IDirect3DSurface9 *surface) const
+	{
+		if (surface == nullptr)
 		{
-			_device->GetRenderTarget(target, &stateblock_rendertargets[target]);
+			return false;
 		}
 
-		_device->GetDepthStencilSurface(&stateblock_depthstencil);
+		D3DSURFACE_DESC desc;
 
-		if ((_behavior_flags & D3DCREATE_MIXED_VERTEXPROCESSING) != 0)
+		if (FAILED(surface->GetDesc(&desc)))
 		{
-			software_rendering_enabled = _device->GetSoftwareVertexProcessing();
-
-			_device->SetSoftwareVertexProcessing(FALSE);
+			return false;
 		}
 
+		// Needs to be a plain, back buffer sized render target, so viewport sized passes still line up with the default depth stencil
+		// Formats without alpha channel are resolved into the back buffer copy like before, since effects may store data in alpha
+		return (desc.Usage & D3DUSAGE_RENDERTARGET) != 0 && desc.MultiSampleType == D3DMULTISAMPLE_NONE && desc.Width == _width && desc.Height == _height &&
+			desc.Format != D3DFMT_X8R8G8B8 && desc.Format != D3DFMT_X8B8G8R8;
+	}
+
+	void d3d9_runtime::on_present()
+	{
+		if (!is_initialized())
+			return;
+
+		// Begin post processing
+		if (FAILED(_device->BeginScene()))
+			return;
+
+		saved_app_state app_state;
+		capture_app_state(app_state);
+
 		// Resolve back buffer
 		if (_backbuffer_resolved != _backbuffer)
 		{
 			_device->StretchRect(_backbuffer.get(), nullptr, _backbuffer_resolved.get(), nullptr, D3DTEXF_NONE);
 		}
 
+		// Swap in any shaders the optimization worker finished since the last frame
+		apply_optimized_shaders();
+
 		// Apply presenting
 		runtime::on_present();
 
@@ -417,24 +767,29 @@ namespace reshade::d3d9
 		}
 
 		// Apply previous device state
-		_app_state->Apply();
+		apply_app_state(app_state);
 
-		for (DWORD target = 0; target < _num_simultaneous_rendertargets; target++)
+		// End post processing
+		_device->EndScene();
+
+		// Wait for the GPU to finish the frame that was issued '_max_frame_latency' frames ago before queuing up another one
+		if (!_frame_latency_queries.empty())
 		{
-			_device->SetRenderTarget(target, stateblock_rendertargets[target].get());
-		}
+			IDirect3DQuery9 *const query = _frame_latency_queries[_frame_latency_index % _frame_latency_queries.size()].get();
 
-		_device->SetDepthStencilSurface(stateblock_depthstencil.get());
+			// Queries that were never issued yet have nothing to wait for
+			if (_frame_latency_index >= _frame_latency_queries.size())
+			{
+				while (query->GetData(nullptr, 0, D3DGETDATA_FLUSH) == S_FALSE)
+				{
+					std::this_thread::yield();
+				}
+			}
 
-		_device->SetViewport(&viewport);
+			query->Issue(D3DISSUE_END);
 
-		if ((_behavior_flags & D3DCREATE_MIXED_VERTEXPROCESSING) != 0)
-		{
-			_device->SetSoftwareVertexProcessing(software_rendering_enabled);
+			_frame_latency_index++;
 		}
-
-		// End post processing
-		_device->EndScene();
 	}
 	void d3d9_runtime::on_draw_call(D3DPRIMITIVETYPE type, UINT vertices)
 	{
@@ -458,45 +813,47 @@ namespace reshade::d3d9
 		_vertices += vertices;
 		_drawcalls += 1;
 
-		com_ptr<IDirect3DSurface9> depthstencil;
-		_device->GetDepthStencilSurface(&depthstencil);
-
-		if (depthstencil != nullptr)
+		// Entry of the bound depth stencil is looked up once when it is set, instead of on every draw call
+		if (_current_depth_source != nullptr)
 		{
-			if (depthstencil == _depthstencil_replacement)
-			{
-				depthstencil = _depthstencil;
-			}
-
-			const auto it = _depth_source_table.find(depthstencil.get());
-
-			if (it != _depth_source_table.end())
-			{
-				it->second.drawcall_count = _drawcalls;
-				it->second.vertices_count += vertices;
-			}
+			_current_depth_source->drawcall_count = _drawcalls;
+			_current_depth_source->vertices_count += vertices;
 		}
 	}
 	void d3d9_runtime::on_set_depthstencil_surface(IDirect3DSurface9 *&depthstencil)
 	{
-		if (_depth_source_table.find(depthstencil) == _depth_source_table.end())
+		_current_depth_source = nullptr;
+
+		if (depthstencil == nullptr)
 		{
-			D3DSURFACE_DESC desc;
-			depthstencil->GetDesc(&desc);
+			return;
+		}
 
-			// Early rejection
-			if ( desc.MultiSampleType != D3DMULTISAMPLE_NONE ||
-				(desc.Width < _width * 0.95 || desc.Width > _width * 1.05) ||
-				(desc.Height < _height * 0.95 || desc.Height > _height * 1.05))
+		if (_is_depth_detection_active)
+		{
+			auto it = _depth_source_table.find(depthstencil);
+
+			if (it == _depth_source_table.end())
 			{
-				return;
+				D3DSURFACE_DESC desc;
+				depthstencil->GetDesc(&desc);
+
+				// Early rejection
+				if ( desc.MultiSampleType != D3DMULTISAMPLE_NONE ||
+					(desc.Width < _width * 0.95 || desc.Width > _width * 1.05) ||
+					(desc.Height < _height * 0.95 || desc.Height > _height * 1.05))
+				{
+					return;
+				}
+
+				depthstencil->AddRef();
+
+				// Begin tracking
+				const depth_source_info info = { desc.Width, desc.Height };
+				it = _depth_source_table.emplace(depthstencil, info).first;
 			}
-	
-			depthstencil->AddRef();
 
-			// Begin tracking
-			const depth_source_info info = { desc.Width, desc.Height };
-			_depth_source_table.emplace(depthstencil, info);
+			_current_depth_source = &it->second;
 		}
 
 		if (_depthstencil_replacement != nullptr && depthstencil == _depthstencil)
@@ -527,271 +884,2256 @@ namespace reshade::d3d9
 			return;
 		}
 
-		HRESULT hr;
 		com_ptr<IDirect3DSurface9> screenshot_surface;
-		hr = _device->CreateOffscreenPlainSurface(_width, _height, _backbuffer_format, D3DPOOL_SYSTEMMEM, &screenshot_surface, nullptr);
+		const HRESULT hr = _device->CreateOffscreenPlainSurface(_width, _height, _backbuffer_format, D3DPOOL_SYSTEMMEM, &screenshot_surface, nullptr);
 
 		if (FAILED(hr))
 		{
 			return;
 		}
 
-		hr = _device->GetRenderTargetData(_backbuffer_resolved.get(), screenshot_surface.get());
-
-		if (FAILED(hr))
+		read_render_target_data(_backbuffer_resolved.get(), screenshot_surface.get(), buffer);
+	}
+	bool d3d9_runtime::begin_frame_capture(unsigned int index)
+	{
+		if (_backbuffer_format != D3DFMT_X8R8G8B8 &&
+			_backbuffer_format != D3DFMT_X8B8G8R8 &&
+			_backbuffer_format != D3DFMT_A8R8G8B8 &&
+			_backbuffer_format != D3DFMT_A8B8G8R8)
 		{
-			return;
+			return false;
 		}
 
-		D3DLOCKED_RECT mapped_rect;
-		hr = screenshot_surface->LockRect(&mapped_rect, nullptr, D3DLOCK_READONLY);
+		auto &slot = _screenshot_slots[index];
 
-		if (FAILED(hr))
+		if (slot.copy == nullptr)
 		{
-			return;
-		}
+			HRESULT hr = _device->CreateRenderTarget(_width, _height, _backbuffer_format, D3DMULTISAMPLE_NONE, 0, FALSE, &slot.copy, nullptr);
 
-		auto mapped_data = static_cast<BYTE *>(mapped_rect.pBits);
-		const UINT pitch = _width * 4;
-
-		for (UINT y = 0; y < _height; y++)
-		{
-			std::memcpy(buffer, mapped_data, std::min(pitch, static_cast<UINT>(mapped_rect.Pitch)));
+			if (SUCCEEDED(hr))
+			{
+				hr = _device->CreateOffscreenPlainSurface(_width, _height, _backbuffer_format, D3DPOOL_SYSTEMMEM, &slot.readback, nullptr);
+			}
 
-			for (UINT x = 0; x < pitch; x += 4)
+			if (FAILED(hr))
 			{
-				buffer[x + 3] = 0xFF;
+				LOG(ERROR) << "Failed to create readback surfaces for screenshot capture! HRESULT is '" << std::hex << hr << std::dec << "'.";
 
-				if (_backbuffer_format == D3DFMT_A8R8G8B8 || _backbuffer_format == D3DFMT_X8R8G8B8)
-				{
-					std::swap(buffer[x + 0], buffer[x + 2]);
-				}
+				slot.copy.reset();
+				return false;
 			}
 
-			buffer += pitch;
-			mapped_data += mapped_rect.Pitch;
+			// Without event queries the readback simply waits for the copy
+			_device->CreateQuery(D3DQUERYTYPE_EVENT, &slot.copy_finished);
 		}
 
-		screenshot_surface->UnlockRect();
-	}
-	bool d3d9_runtime::load_effect(const reshadefx::syntax_tree &ast, std::string &errors)
-	{
-		return d3d9_effect_compiler(this, ast, errors, false).run();
-	}
-	bool d3d9_runtime::update_texture(texture &texture, const uint8_t *data)
-	{
-		if (texture.impl_reference != texture_reference::none)
+		if (FAILED(_device->StretchRect(_backbuffer_resolved.get(), nullptr, slot.copy.get(), nullptr, D3DTEXF_NONE)))
 		{
 			return false;
 		}
 
-		const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+		if (slot.copy_finished != nullptr)
+		{
+			slot.copy_finished->Issue(D3DISSUE_END);
+		}
 
-		assert(data != nullptr);
-		assert(texture_impl != nullptr);
+		return true;
+	}
+	bool d3d9_runtime::finish_frame_capture(unsigned int index, uint8_t *buffer, bool wait)
+	{
+		const auto &slot = _screenshot_slots[index];
+
+		if (slot.copy == nullptr)
+		{
+			return false;
+		}
+
+		if (!wait && slot.copy_finished != nullptr && slot.copy_finished->GetData(nullptr, 0, D3DGETDATA_FLUSH) == S_FALSE)
+		{
+			return false;
+		}
+
+		return read_render_target_data(slot.copy.get(), slot.readback.get(), buffer);
+	}
+	bool d3d9_runtime::read_render_target_data(IDirect3DSurface9 *source, IDirect3DSurface9 *readback, uint8_t *buffer) const
+	{
+		HRESULT hr = _device->GetRenderTargetData(source, readback);
+
+		if (FAILED(hr))
+		{
+			return false;
+		}
+
+		D3DLOCKED_RECT mapped_rect;
+		hr = readback->LockRect(&mapped_rect, nullptr, D3DLOCK_READONLY);
+
+		if (FAILED(hr))
+		{
+			return false;
+		}
+
+		pixel_conversion::copy_rows_to_rgba(buffer, static_cast<const uint8_t *>(mapped_rect.pBits), mapped_rect.Pitch, _width, _height,
+			_backbuffer_format == D3DFMT_A8R8G8B8 || _backbuffer_format == D3DFMT_X8R8G8B8);
 
+		readback->UnlockRect();
+
+		return true;
+	}
+	// Layout of the file written by the replay capture, it is followed by the color rows and the depth values if there are any
+	struct replay_frame_header
+	{
+		uint32_t magic, version, width, height, format, has_depth;
+	};
+
+	static const uint32_t REPLAY_FRAME_MAGIC = MAKEFOURCC('R', 'S', 'R', 'F');
+	static const uint32_t REPLAY_FRAME_VERSION = 1;
+
+	bool d3d9_runtime::save_replay_frame(IDirect3DSurface9 *source)
+	{
 		D3DSURFACE_DESC desc;
-		texture_impl->texture->GetLevelDesc(0, &desc);
+		source->GetDesc(&desc);
 
-		HRESULT hr;
-		com_ptr<IDirect3DTexture9> mem_texture;
-		hr = _device->CreateTexture(desc.Width, desc.Height, 1, 0, desc.Format, D3DPOOL_SYSTEMMEM, &mem_texture, nullptr);
+		// Only formats with four bytes per pixel, so the file stays a plain array of rows
+		if (desc.Format != D3DFMT_A8R8G8B8 && desc.Format != D3DFMT_X8R8G8B8 &&
+			desc.Format != D3DFMT_A8B8G8R8 && desc.Format != D3DFMT_X8B8G8R8 &&
+			desc.Format != D3DFMT_A2R10G10B10 && desc.Format != D3DFMT_A2B10G10R10)
+		{
+			LOG(ERROR) << "Replay capture is not supported for back buffer format " << desc.Format << ".";
+			return false;
+		}
+
+		com_ptr<IDirect3DSurface9> readback;
+		HRESULT hr = _device->CreateOffscreenPlainSurface(desc.Width, desc.Height, desc.Format, D3DPOOL_SYSTEMMEM, &readback, nullptr);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = _device->GetRenderTargetData(source, readback.get());
+		}
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to read back frame for replay capture! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		std::vector<float> depth;
+		const bool has_depth = desc.Width == _width && desc.Height == _height && read_depth_data(depth);
+
+		const auto path = replay_frame_path();
+		FILE *file = nullptr;
+
+		if (_wfopen_s(&file, path.wstring().c_str(), L"wb") != 0)
+		{
+			LOG(ERROR) << "Failed to open " << path << " for replay capture!";
+			return false;
+		}
+
+		const replay_frame_header header = { REPLAY_FRAME_MAGIC, REPLAY_FRAME_VERSION, desc.Width, desc.Height, static_cast<uint32_t>(desc.Format), has_depth ? 1u : 0u };
+		bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+
+		D3DLOCKED_RECT mapped_rect;
+
+		if (success && SUCCEEDED(readback->LockRect(&mapped_rect, nullptr, D3DLOCK_READONLY)))
+		{
+			const auto mapped_data = static_cast<const BYTE *>(mapped_rect.pBits);
+
+			for (UINT y = 0; success && y < desc.Height; y++)
+			{
+				success = fwrite(mapped_data + y * mapped_rect.Pitch, desc.Width * 4, 1, file) == 1;
+			}
+
+			readback->UnlockRect();
+		}
+		else
+		{
+			success = false;
+		}
+
+		if (success && has_depth)
+		{
+			success = fwrite(depth.data(), depth.size() * sizeof(float), 1, file) == 1;
+		}
+
+		fclose(file);
+
+		if (!success)
+		{
+			LOG(ERROR) << "Failed to write replay capture to " << path << '!';
+			return false;
+		}
+
+		LOG(INFO) << "Saved " << desc.Width << 'x' << desc.Height << " frame " << (has_depth ? "with" : "without") << " depth for replay to " << path << '.';
+
+		return true;
+	}
+	bool d3d9_runtime::read_depth_data(std::vector<float> &data)
+	{
+		if (_depthstencil_texture == nullptr)
+		{
+			return false;
+		}
+
+		// The depth stencil texture cannot be locked, so draw its values into a floating point render target that can be read back
+		if (_depth_copy_pixel_shader == nullptr)
+		{
+			static const char vertex_shader_source[] =
+				"float4 __TEXEL_SIZE__ : register(c255);\n"
+				"void __main(float id : TEXCOORD0, out float4 position : POSITION, out float2 texcoord : TEXCOORD0)\n"
+				"{\n"
+				"\ttexcoord.x = (id == 2) ? 2.0 : 0.0;\n"
+				"\ttexcoord.y = (id == 1) ? 2.0 : 0.0;\n"
+				"\tposition = float4(texcoord * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);\n"
+				"\tposition.xy += __TEXEL_SIZE__.xy * position.ww;\n"
+				"}\n";
+			static const char pixel_shader_source[] =
+				"sampler2D __DepthSampler : register(s0);\n"
+				"float4 __main(float2 texcoord : TEXCOORD0) : COLOR\n"
+				"{\n"
+				"\treturn tex2Dlod(__DepthSampler, float4(texcoord, 0, 0)).x;\n"
+				"}\n";
+
+			std::string errors;
+			std::vector<char> bytecode;
+
+			if (!compile_shader(vertex_shader_source, "vs_3_0", nullptr, 0, bytecode, errors) ||
+				FAILED(_device->CreateVertexShader(reinterpret_cast<const DWORD *>(bytecode.data()), &_depth_copy_vertex_shader)) ||
+				!compile_shader(pixel_shader_source, "ps_3_0", nullptr, 0, bytecode, errors) ||
+				FAILED(_device->CreatePixelShader(reinterpret_cast<const DWORD *>(bytecode.data()), &_depth_copy_pixel_shader)))
+			{
+				LOG(ERROR) << "Failed to create depth copy shaders:\n" << errors;
+
+				_depth_copy_vertex_shader.reset();
+				_depth_copy_pixel_shader.reset();
+				return false;
+			}
+		}
+
+		if (_depth_copy_state == nullptr)
+		{
+			HRESULT hr = _device->BeginStateBlock();
+
+			if (SUCCEEDED(hr))
+			{
+				_device->SetVertexShader(_depth_copy_vertex_shader.get());
+				_device->SetPixelShader(_depth_copy_pixel_shader.get());
+				_device->SetRenderState(D3DRS_ZENABLE, false);
+				_device->SetRenderState(D3DRS_ZWRITEENABLE, false);
+				_device->SetRenderState(D3DRS_ALPHATESTENABLE, false);
+				_device->SetRenderState(D3DRS_ALPHABLENDENABLE, false);
+				_device->SetRenderState(D3DRS_STENCILENABLE, false);
+				_device->SetRenderState(D3DRS_SCISSORTESTENABLE, false);
+				_device->SetRenderState(D3DRS_FOGENABLE, false);
+				_device->SetRenderState(D3DRS_SRGBWRITEENABLE, false);
+				_device->SetRenderState(D3DRS_COLORWRITEENABLE, 0x0000000F);
+				_device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+				_device->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
+				_device->SetSamplerState(0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+				_device->SetSamplerState(0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+				_device->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_POINT);
+				_device->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_POINT);
+				_device->SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_NONE);
+				_device->SetSamplerState(0, D3DSAMP_SRGBTEXTURE, false);
+
+				hr = _device->EndStateBlock(&_depth_copy_state);
+			}
+
+			if (FAILED(hr))
+			{
+				LOG(ERROR) << "Failed to create depth copy state block! HRESULT is '" << std::hex << hr << std::dec << "'.";
+				return false;
+			}
+		}
+
+		com_ptr<IDirect3DSurface9> target, readback;
+		HRESULT hr = _device->CreateRenderTarget(_width, _height, D3DFMT_R32F, D3DMULTISAMPLE_NONE, 0, FALSE, &target, nullptr);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = _device->CreateOffscreenPlainSurface(_width, _height, D3DFMT_R32F, D3DPOOL_SYSTEMMEM, &readback, nullptr);
+		}
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to create depth readback surfaces! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		_device->SetRenderTarget(0, target.get());
+		for (DWORD target_index = 1; target_index < _num_simultaneous_rendertargets; target_index++)
+		{
+			_device->SetRenderTarget(target_index, nullptr);
+		}
+		_device->SetDepthStencilSurface(nullptr);
+
+		_depth_copy_state->Apply();
+
+		_device->SetStreamSource(0, _effect_triangle_buffer.get(), 0, sizeof(float));
+		_device->SetVertexDeclaration(_effect_triangle_layout.get());
+		_device->SetTexture(0, _depthstencil_texture.get());
+
+		// The sampler was changed behind the back of the pass state tracking
+		_applied_samplers[0].is_valid = false;
+		_num_changed_samplers = std::max(_num_changed_samplers, 1u);
+
+		const float texelsize[4] = { -1.0f / _width, 1.0f / _height };
+		_device->SetVertexShaderConstantF(255, texelsize, 1);
+
+		_device->DrawPrimitive(D3DPT_TRIANGLELIST, 0, 1);
+
+		hr = _device->GetRenderTargetData(target.get(), readback.get());
+
+		D3DLOCKED_RECT mapped_rect;
+
+		if (FAILED(hr) || FAILED(readback->LockRect(&mapped_rect, nullptr, D3DLOCK_READONLY)))
+		{
+			return false;
+		}
+
+		data.resize(_width * _height);
+
+		for (UINT y = 0; y < _height; y++)
+		{
+			std::memcpy(data.data() + y * _width, static_cast<const BYTE *>(mapped_rect.pBits) + y * mapped_rect.Pitch, _width * sizeof(float));
+		}
+
+		readback->UnlockRect();
+
+		return true;
+	}
+	void d3d9_runtime::run_replay_benchmark()
+	{
+		_replay_benchmark_requested = false;
+
+		const auto fail = [this](const std::string &message) {
+			LOG(ERROR) << "Replay benchmark failed: " << message;
+			_replay_benchmark_report = "Failed: " + message;
+		};
+
+		// Load the captured frame
+		const auto path = replay_frame_path();
+		FILE *file = nullptr;
+
+		if (_wfopen_s(&file, path.wstring().c_str(), L"rb") != 0)
+		{
+			return fail("No frame was captured yet, press the replay capture key in game first.");
+		}
+
+		replay_frame_header header = {};
+		std::vector<uint8_t> color;
+		std::vector<float> depth;
+
+		bool success = fread(&header, sizeof(header), 1, file) == 1 && header.magic == REPLAY_FRAME_MAGIC && header.version == REPLAY_FRAME_VERSION;
+
+		// Effects are compiled for the current resolution, so only a frame of the same size can be replayed
+		if (success && (header.width != _width || header.height != _height || header.format != static_cast<uint32_t>(_backbuffer_format)))
+		{
+			fclose(file);
+			return fail("The captured frame does not match the current resolution or back buffer format, capture it again.");
+		}
+
+		if (success)
+		{
+			color.resize(header.width * header.height * 4);
+			success = fread(color.data(), color.size(), 1, file) == 1;
+		}
+		if (success && header.has_depth)
+		{
+			depth.resize(header.width * header.height);
+			success = fread(depth.data(), depth.size() * sizeof(float), 1, file) == 1;
+		}
+
+		fclose(file);
+
+		if (!success)
+		{
+			return fail("The file " + path.string() + " is not a valid replay capture.");
+		}
+
+		// Upload the frame once, so every iteration only has to copy it on the GPU
+		com_ptr<IDirect3DSurface9> color_upload, color_source, replay_target;
+		HRESULT hr = _device->CreateOffscreenPlainSurface(_width, _height, _backbuffer_format, D3DPOOL_SYSTEMMEM, &color_upload, nullptr);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = _device->CreateRenderTarget(_width, _height, _backbuffer_format, D3DMULTISAMPLE_NONE, 0, FALSE, &color_source, nullptr);
+		}
+		if (SUCCEEDED(hr))
+		{
+			hr = _device->CreateRenderTarget(_width, _height, _backbuffer_format, D3DMULTISAMPLE_NONE, 0, FALSE, &replay_target, nullptr);
+		}
+
+		D3DLOCKED_RECT mapped_rect;
+
+		if (SUCCEEDED(hr))
+		{
+			hr = color_upload->LockRect(&mapped_rect, nullptr, 0);
+		}
+
+		if (FAILED(hr))
+		{
+			return fail("Failed to create surfaces for the captured frame.");
+		}
+
+		for (UINT y = 0; y < _height; y++)
+		{
+			std::memcpy(static_cast<BYTE *>(mapped_rect.pBits) + y * mapped_rect.Pitch, color.data() + y * _width * 4, _width * 4);
+		}
+
+		color_upload->UnlockRect();
+
+		if (FAILED(_device->UpdateSurface(color_upload.get(), nullptr, color_source.get(), nullptr)))
+		{
+			return fail("Failed to upload the captured frame.");
+		}
+
+		com_ptr<IDirect3DTexture9> depth_texture;
+
+		if (!depth.empty())
+		{
+			com_ptr<IDirect3DTexture9> depth_upload;
+			hr = _device->CreateTexture(_width, _height, 1, 0, D3DFMT_R32F, D3DPOOL_SYSTEMMEM, &depth_upload, nullptr);
+
+			if (SUCCEEDED(hr))
+			{
+				hr = _device->CreateTexture(_width, _height, 1, 0, D3DFMT_R32F, D3DPOOL_DEFAULT, &depth_texture, nullptr);
+			}
+			if (SUCCEEDED(hr))
+			{
+				hr = depth_upload->LockRect(0, &mapped_rect, nullptr, 0);
+			}
+
+			if (FAILED(hr))
+			{
+				return fail("Failed to create the depth texture for the captured frame.");
+			}
+
+			for (UINT y = 0; y < _height; y++)
+			{
+				std::memcpy(static_cast<BYTE *>(mapped_rect.pBits) + y * mapped_rect.Pitch, depth.data() + y * _width, _width * sizeof(float));
+			}
+
+			depth_upload->UnlockRect(0);
+
+			if (FAILED(_device->UpdateTexture(depth_upload.get(), depth_texture.get())))
+			{
+				return fail("Failed to upload the captured depth.");
+			}
+		}
+
+		// Collect the techniques that would render this frame, with the range of pass queries each of them fills
+		struct replay_technique
+		{
+			technique *instance;
+			size_t first_query, pass_count;
+		};
+
+		std::vector<replay_technique> replay_techniques;
+		size_t query_count = 1;
+
+		for (auto &technique : _techniques)
+		{
+			if (technique.enabled && technique.impl->as<d3d9_technique_data>()->is_compiled)
+			{
+				replay_techniques.push_back({ &technique, query_count, technique.passes.size() });
+				query_count += technique.passes.size();
+			}
+		}
+
+		if (replay_techniques.empty())
+		{
+			return fail("No techniques are enabled.");
+		}
+
+		com_ptr<IDirect3DQuery9> disjoint_query, frequency_query;
+		hr = _device->CreateQuery(D3DQUERYTYPE_TIMESTAMPDISJOINT, &disjoint_query);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = _device->CreateQuery(D3DQUERYTYPE_TIMESTAMPFREQ, &frequency_query);
+		}
+
+		_replay_pass_queries.resize(query_count);
+
+		for (size_t i = 0; SUCCEEDED(hr) && i < query_count; i++)
+		{
+			if (_replay_pass_queries[i] == nullptr)
+			{
+				hr = _device->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &_replay_pass_queries[i]);
+			}
+		}
 
 		if (FAILED(hr))
 		{
-			LOG(ERROR) << "Failed to create memory texture for texture updating! HRESULT is '" << std::hex << hr << std::dec << "'.";
-			return false;
+			_replay_pass_queries.clear();
+			return fail("Timestamp queries are not supported by this device.");
+		}
+
+		// Point the effects at the captured depth instead of the one of the current frame
+		const com_ptr<IDirect3DTexture9> saved_depthstencil_texture = _depthstencil_texture;
+		IDirect3DSurface9 *const saved_effect_target = _effect_target;
+
+		const auto update_depth_references = [this]() {
+			for (auto &texture : _textures)
+			{
+				if (texture.impl != nullptr && texture.impl_reference == texture_reference::depth_buffer)
+				{
+					update_texture_reference(texture, texture_reference::depth_buffer);
+				}
+			}
+		};
+
+		if (depth_texture != nullptr)
+		{
+			_depthstencil_texture = depth_texture;
+			update_depth_references();
+		}
+
+		_effect_target = replay_target.get();
+		_is_replaying = true;
+
+		// Times in milliseconds of every pass in every iteration that was not disturbed
+		std::vector<std::vector<double>> pass_samples(query_count);
+		unsigned int discarded_iterations = 0;
+
+		for (unsigned int iteration = 0; iteration < _replay_benchmark_iterations; iteration++)
+		{
+			_device->StretchRect(color_source.get(), nullptr, replay_target.get(), nullptr, D3DTEXF_NONE);
+
+			_is_backbuffer_texture_outdated = true;
+			_is_linear_depth_outdated = true;
+			_is_backbuffer_mipmaps_outdated = true;
+
+			_device->SetStreamSource(0, _effect_triangle_buffer.get(), 0, sizeof(float));
+			_device->SetVertexDeclaration(_effect_triangle_layout.get());
+
+			disjoint_query->Issue(D3DISSUE_BEGIN);
+			_replay_pass_queries[0]->Issue(D3DISSUE_END);
+			_replay_pass_query_index = 1;
+
+			for (const auto &entry : replay_techniques)
+			{
+				render_technique(*entry.instance);
+			}
+
+			disjoint_query->Issue(D3DISSUE_END);
+			frequency_query->Issue(D3DISSUE_END);
+
+			// Waiting for the results keeps iterations from overlapping on the GPU, so every pass is measured on its own
+			BOOL disjoint = TRUE;
+			UINT64 frequency = 0;
+			std::vector<UINT64> timestamps(query_count);
+
+			while (disjoint_query->GetData(&disjoint, sizeof(disjoint), D3DGETDATA_FLUSH) == S_FALSE)
+				continue;
+			while (frequency_query->GetData(&frequency, sizeof(frequency), D3DGETDATA_FLUSH) == S_FALSE)
+				continue;
+
+			for (size_t i = 0; i < _replay_pass_query_index; i++)
+			{
+				while (_replay_pass_queries[i]->GetData(&timestamps[i], sizeof(UINT64), D3DGETDATA_FLUSH) == S_FALSE)
+					continue;
+			}
+
+			if (disjoint || frequency == 0 || _replay_pass_query_index != query_count)
+			{
+				discarded_iterations++;
+				continue;
+			}
+
+			for (size_t i = 1; i < query_count; i++)
+			{
+				pass_samples[i].push_back(static_cast<double>(timestamps[i] - timestamps[i - 1]) * 1000.0 / frequency);
+			}
+		}
+
+		_is_replaying = false;
+		_effect_target = saved_effect_target;
+
+		if (depth_texture != nullptr)
+		{
+			_depthstencil_texture = saved_depthstencil_texture;
+			update_depth_references();
+		}
+
+		// Shared textures were computed from the captured frame, so the real frame has to compute them again
+		_is_backbuffer_texture_outdated = true;
+		_is_linear_depth_outdated = true;
+		_is_backbuffer_mipmaps_outdated = true;
+
+		if (pass_samples[1].empty())
+		{
+			return fail("All iterations were disturbed by a GPU clock change.");
+		}
+
+		const auto median = [](std::vector<double> samples) {
+			std::sort(samples.begin(), samples.end());
+			const size_t middle = samples.size() / 2;
+			return samples.size() % 2 != 0 ? samples[middle] : (samples[middle - 1] + samples[middle]) * 0.5;
+		};
+		const auto minimum = [](const std::vector<double> &samples) {
+			return *std::min_element(samples.begin(), samples.end());
+		};
+
+		std::stringstream report, csv;
+		report << std::fixed << std::setprecision(3);
+		csv << std::fixed << std::setprecision(3);
+
+		report << "Replayed " << _width << 'x' << _height << " frame " << (depth_texture != nullptr ? "with" : "without") << " depth, " << pass_samples[1].size() << " iterations";
+		if (discarded_iterations != 0)
+			report << " (" << discarded_iterations << " discarded)";
+		report << ".\nTimes are median / minimum in milliseconds.\n";
+		csv << "technique,pass,median_ms,min_ms\n";
+
+		std::vector<double> frame_samples(pass_samples[1].size());
+
+		for (const auto &entry : replay_techniques)
+		{
+			std::vector<double> technique_samples(pass_samples[1].size());
+
+			for (size_t pass_index = 0; pass_index < entry.pass_count; pass_index++)
+			{
+				const auto &samples = pass_samples[entry.first_query + pass_index];
+
+				for (size_t i = 0; i < samples.size(); i++)
+				{
+					technique_samples[i] += samples[i];
+				}
+			}
+
+			for (size_t i = 0; i < technique_samples.size(); i++)
+			{
+				frame_samples[i] += technique_samples[i];
+			}
+
+			report << entry.instance->name << ": " << median(technique_samples) << " / " << minimum(technique_samples) << '\n';
+			csv << '\"' << entry.instance->name << "\",," << median(technique_samples) << ',' << minimum(technique_samples) << '\n';
+
+			for (size_t pass_index = 0; pass_index < entry.pass_count; pass_index++)
+			{
+				const auto &samples = pass_samples[entry.first_query + pass_index];
+				const std::string &label = entry.instance->passes[pass_index]->as<d3d9_pass_data>()->name;
+
+				report << "    " << label << ": " << median(samples) << " / " << minimum(samples) << '\n';
+				csv << '\"' << entry.instance->name << "\",\"" << label << "\"," << median(samples) << ',' << minimum(samples) << '\n';
+			}
+		}
+
+		report << "Total: " << median(frame_samples) << " / " << minimum(frame_samples);
+		csv << "\"Total\",," << median(frame_samples) << ',' << minimum(frame_samples) << '\n';
+
+		_replay_benchmark_report = report.str();
+
+		LOG(INFO) << "Replay benchmark results:\n" << _replay_benchmark_report;
+
+		const auto csv_path = path.parent_path() / "ReplayBenchmark.csv";
+		std::ofstream csv_file(csv_path.wstring(), std::ios::out | std::ios::trunc);
+
+		if (csv_file.is_open())
+		{
+			csv_file << csv.str();
+		}
+		else
+		{
+			LOG(ERROR) << "Failed to write replay benchmark results to " << csv_path << '!';
+		}
+	}
+
+	std::unique_ptr<base_object> d3d9_runtime::compile_effect(const reshadefx::syntax_tree &ast, std::string &errors, bool)
+	{
+		auto compiler = std::make_unique<d3d9_effect_compiler>(this, ast, errors, false);
+		compiler->compile();
+		return compiler;
+	}
+	bool d3d9_runtime::load_effect(base_object &module)
+	{
+		const bool success = module.as<d3d9_effect_compiler>()->run();
+
+		// Allocate the textures of the techniques that were compiled right away
+		return update_texture_allocations() && success;
+	}
+	bool d3d9_runtime::update_texture(texture &texture, const uint8_t *data)
+	{
+		if (texture.impl_reference != texture_reference::none)
+		{
+			return false;
+		}
+
+		const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+
+		assert(data != nullptr);
+		assert(texture_impl != nullptr);
+
+		D3DSURFACE_DESC desc;
+		texture_impl->texture->GetLevelDesc(0, &desc);
+
+		HRESULT hr;
+		com_ptr<IDirect3DTexture9> mem_texture;
+		hr = _device->CreateTexture(desc.Width, desc.Height, 1, 0, desc.Format, D3DPOOL_SYSTEMMEM, &mem_texture, nullptr);
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to create memory texture for texture updating! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		D3DLOCKED_RECT mapped_rect;
+		hr = mem_texture->LockRect(0, &mapped_rect, nullptr, 0);
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to lock memory texture for texture updating! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		const UINT size = std::min(texture.width * 4, static_cast<UINT>(mapped_rect.Pitch)) * texture.height;
+		auto mapped_data = static_cast<BYTE *>(mapped_rect.pBits);
+
+		switch (texture.format)
+		{
+			case texture_format::r8:
+				for (UINT i = 0; i < size; i += 4, mapped_data += 4)
+					mapped_data[0] = 0,
+					mapped_data[1] = 0,
+					mapped_data[2] = data[i],
+					mapped_data[3] = 0;
+				break;
+			case texture_format::rg8:
+				for (UINT i = 0; i < size; i += 4, mapped_data += 4)
+					mapped_data[0] = 0,
+					mapped_data[1] = data[i + 1],
+					mapped_data[2] = data[i],
+					mapped_data[3] = 0;
+				break;
+			case texture_format::rgba8:
+				for (UINT i = 0; i < size; i += 4, mapped_data += 4)
+					mapped_data[0] = data[i + 2],
+					mapped_data[1] = data[i + 1],
+					mapped_data[2] = data[i],
+					mapped_data[3] = data[i + 3];
+				break;
+			default:
+				std::memcpy(mapped_data, data, size);
+				break;
+		}
+
+		mem_texture->UnlockRect(0);
+
+		hr = _device->UpdateTexture(mem_texture.get(), texture_impl->texture.get());
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to update texture from memory texture! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		return true;
+	}
+	bool d3d9_runtime::update_texture_compressed(texture &texture, const uint8_t *data, unsigned int levels)
+	{
+		if (texture.impl_reference != texture_reference::none)
+		{
+			return false;
+		}
+
+		const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+
+		assert(data != nullptr);
+		assert(texture_impl != nullptr);
+
+		const UINT block_size = compressed_block_size(texture.format);
+
+		if (block_size == 0)
+		{
+			return false;
+		}
+
+		D3DSURFACE_DESC desc;
+		texture_impl->texture->GetLevelDesc(0, &desc);
+		const DWORD level_count = texture_impl->texture->GetLevelCount();
+
+		HRESULT hr;
+		com_ptr<IDirect3DTexture9> mem_texture;
+		hr = _device->CreateTexture(desc.Width, desc.Height, level_count, 0, desc.Format, D3DPOOL_SYSTEMMEM, &mem_texture, nullptr);
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to create memory texture for texture updating! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		for (UINT level = 0; level < std::min(static_cast<DWORD>(levels), level_count); level++)
+		{
+			const UINT row_size = std::max(1u, ((desc.Width >> level) + 3) / 4) * block_size;
+			const UINT rows = std::max(1u, ((desc.Height >> level) + 3) / 4);
+
+			D3DLOCKED_RECT mapped_rect;
+			hr = mem_texture->LockRect(level, &mapped_rect, nullptr, 0);
+
+			if (FAILED(hr))
+			{
+				LOG(ERROR) << "Failed to lock memory texture for texture updating! HRESULT is '" << std::hex << hr << std::dec << "'.";
+				return false;
+			}
+
+			// Pitch of block-compressed surfaces is per row of blocks
+			auto mapped_data = static_cast<BYTE *>(mapped_rect.pBits);
+
+			for (UINT y = 0; y < rows; y++, data += row_size, mapped_data += mapped_rect.Pitch)
+			{
+				std::memcpy(mapped_data, data, row_size);
+			}
+
+			mem_texture->UnlockRect(level);
+		}
+
+		hr = _device->UpdateTexture(mem_texture.get(), texture_impl->texture.get());
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to update texture from memory texture! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		return true;
+	}
+	bool d3d9_runtime::supports_texture_scaling(const texture &texture) const
+	{
+		if (texture.impl_reference != texture_reference::none || texture.format != texture_format::rgba8)
+		{
+			return false;
+		}
+
+		const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+
+		// 'StretchRect' can only scale into render target textures
+		return texture_impl != nullptr && (texture_impl->usage & D3DUSAGE_RENDERTARGET) != 0;
+	}
+	bool d3d9_runtime::update_texture_scaled(texture &texture, const uint8_t *data, unsigned int width, unsigned int height)
+	{
+		if (!supports_texture_scaling(texture))
+		{
+			return false;
+		}
+
+		const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+
+		assert(data != nullptr);
+		assert(texture_impl != nullptr);
+
+		if (texture_impl->surface == nullptr)
+		{
+			return false;
+		}
+
+		// Scale from the smallest level that is still at least as large as the texture, so the bilinear filter does not skip over any source pixels
+		UINT levels = 1;
+
+		while ((width >> levels) >= texture.width && (height >> levels) >= texture.height)
+		{
+			levels++;
+		}
+
+		HRESULT hr;
+		com_ptr<IDirect3DTexture9> mem_texture, scale_texture;
+		hr = _device->CreateTexture(width, height, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_SYSTEMMEM, &mem_texture, nullptr);
+
+		if (SUCCEEDED(hr))
+		{
+			// The image at its full resolution with the mipmap levels down to that one, so that it is never scaled down by more than a factor of two in one step
+			// These are filled in explicitly, since a texture with 'D3DUSAGE_AUTOGENMIPMAP' only exposes its top level
+			hr = _device->CreateTexture(width, height, levels, D3DUSAGE_RENDERTARGET, D3DFMT_A8R8G8B8, D3DPOOL_DEFAULT, &scale_texture, nullptr);
+		}
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to create textures for scaling texture data! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		D3DLOCKED_RECT mapped_rect;
+		hr = mem_texture->LockRect(0, &mapped_rect, nullptr, 0);
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to lock memory texture for texture updating! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		for (UINT y = 0; y < height; y++)
+		{
+			auto mapped_data = static_cast<BYTE *>(mapped_rect.pBits) + y * mapped_rect.Pitch;
+
+			for (UINT x = 0; x < width; x++, data += 4, mapped_data += 4)
+				mapped_data[0] = data[2],
+				mapped_data[1] = data[1],
+				mapped_data[2] = data[0],
+				mapped_data[3] = data[3];
+		}
+
+		mem_texture->UnlockRect(0);
+
+		com_ptr<IDirect3DSurface9> mem_surface, scale_surface;
+		mem_texture->GetSurfaceLevel(0, &mem_surface);
+		scale_texture->GetSurfaceLevel(0, &scale_surface);
+
+		hr = _device->UpdateSurface(mem_surface.get(), nullptr, scale_surface.get(), nullptr);
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to update texture from memory texture! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		// Halve the image level by level
+		for (UINT level = 1; level < levels && SUCCEEDED(hr); level++)
+		{
+			com_ptr<IDirect3DSurface9> level_surface;
+			scale_texture->GetSurfaceLevel(level, &level_surface);
+
+			hr = _device->StretchRect(scale_surface.get(), nullptr, level_surface.get(), nullptr, D3DTEXF_LINEAR);
+
+			scale_surface = std::move(level_surface);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = _device->StretchRect(scale_surface.get(), nullptr, texture_impl->surface.get(), nullptr, D3DTEXF_LINEAR);
+		}
+
+		if (FAILED(hr))
+		{
+			LOG(ERROR) << "Failed to scale texture data! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return false;
+		}
+
+		// Mipmaps of the texture itself are generated the next time a pass samples it
+		texture_impl->is_mipmap_outdated = (texture_impl->usage & D3DUSAGE_AUTOGENMIPMAP) != 0;
+
+		return true;
+	}
+	bool d3d9_runtime::share_texture(texture &texture, const texture &source)
+	{
+		if (texture.impl_reference != texture_reference::none || source.impl_reference != texture_reference::none)
+		{
+			return false;
+		}
+
+		const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+		const auto source_impl = source.impl->as<d3d9_tex_data>();
+
+		assert(texture_impl != nullptr && source_impl != nullptr);
+
+		if (source_impl->texture == nullptr || texture_impl->levels != source_impl->levels || texture_impl->usage != source_impl->usage || texture_impl->format != source_impl->format)
+		{
+			return false;
+		}
+
+		// Rendering to a shared texture would change the image of all of them, so neither textures passes render to nor sources passes render to are shared, and those that a pass renders to later get a copy of their own in 'update_texture_allocations'
+		for (const auto &technique : _techniques)
+		{
+			for (const auto &pass_object : technique.passes)
+			{
+				const auto &targets = pass_object->as<d3d9_pass_data>()->render_target_textures;
+
+				if (std::find(std::begin(targets), std::end(targets), texture_impl) != std::end(targets) ||
+					std::find(std::begin(targets), std::end(targets), source_impl) != std::end(targets))
+				{
+					return false;
+				}
+			}
+		}
+
+		texture_impl->texture = source_impl->texture;
+		texture_impl->surface = source_impl->surface;
+		texture_impl->is_mipmap_outdated = source_impl->is_mipmap_outdated;
+		texture_impl->is_shared = true;
+		source_impl->is_shared = true;
+
+		return true;
+	}
+	bool d3d9_runtime::update_texture_reference(texture &texture, texture_reference id)
+	{
+		com_ptr<IDirect3DTexture9> new_reference;
+
+		switch (id)
+		{
+			case texture_reference::back_buffer:
+				new_reference = _backbuffer_texture;
+				break;
+			case texture_reference::depth_buffer:
+				new_reference = _depthstencil_texture;
+				break;
+			case texture_reference::linear_depth_buffer:
+				if (_linear_depth_texture == nullptr && !init_linear_depth_texture())
+				{
+					_linear_depth_texture.reset();
+					_linear_depth_surface.reset();
+				}
+				new_reference = _linear_depth_texture;
+				break;
+			case texture_reference::back_buffer_mipmaps:
+				if (_backbuffer_mipmap_texture == nullptr)
+				{
+					init_backbuffer_mipmap_texture();
+				}
+				new_reference = _backbuffer_mipmap_texture;
+				break;
+			default:
+				return false;
+		}
+
+		texture.impl_reference = id;
+
+		const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+
+		assert(texture_impl != nullptr);
+
+		if (new_reference == texture_impl->texture)
+		{
+			return true;
+		}
+
+		texture_impl->surface.reset();
+
+		if (new_reference == nullptr)
+		{
+			texture_impl->texture.reset();
+
+			texture.width = texture.height = texture.levels = 0;
+			texture.format = texture_format::unknown;
+		}
+		else
+		{
+			texture_impl->texture = new_reference;
+			new_reference->GetSurfaceLevel(0, &texture_impl->surface);
+
+			D3DSURFACE_DESC desc;
+			texture_impl->surface->GetDesc(&desc);
+
+			texture.width = desc.Width;
+			texture.height = desc.Height;
+			texture.format = texture_format::unknown;
+			texture.levels = new_reference->GetLevelCount();
+		}
+
+		return true;
+	}
+	bool d3d9_runtime::release_effect_resources()
+	{
+		// Shaders survive a device reset, but textures in the default pool and state blocks have to be released
+		for (auto &texture : _textures)
+		{
+			const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+
+			texture_impl->surface.reset();
+			texture_impl->texture.reset();
+		}
+
+		for (auto &technique : _techniques)
+		{
+			const auto technique_impl = technique.impl->as<d3d9_technique_data>();
+
+			// Results of queries issued before the reset will never arrive
+			for (auto &queries : technique_impl->queries)
+			{
+				queries.in_flight = false;
+			}
+
+			technique_impl->query_read_index = technique_impl->query_write_index = 0;
+
+			for (const auto &pass_object : technique.passes)
+			{
+				const auto pass = pass_object->as<d3d9_pass_data>();
+
+				pass->stateblock.reset();
+
+				std::fill_n(pass->render_targets, _countof(pass->render_targets), nullptr);
+			}
+		}
+
+		_pass_stateblock_cache.clear();
+
+		// Only takes compiling them again from the shader cache
+		_fused_passes.clear();
+
+		return true;
+	}
+	bool d3d9_runtime::restore_effect_resources()
+	{
+		for (auto &texture : _textures)
+		{
+			if (texture.impl_reference != texture_reference::none)
+			{
+				update_texture_reference(texture, texture.impl_reference);
+			}
+		}
+
+		if (!update_texture_allocations())
+		{
+			return false;
+		}
+
+		for (auto &technique : _techniques)
+		{
+			if (!technique.impl->as<d3d9_technique_data>()->is_compiled)
+			{
+				continue;
+			}
+
+			for (const auto &pass_object : technique.passes)
+			{
+				if (const HRESULT hr = create_pass_stateblock(*pass_object->as<d3d9_pass_data>()); FAILED(hr))
+				{
+					LOG(ERROR) << "Failed to recreate pass stateblock! HRESULT is '" << std::hex << hr << std::dec << "'.";
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+	HRESULT d3d9_runtime::create_pass_stateblock(d3d9_pass_data &pass)
+	{
+		return _pass_stateblock_cache.get(pass.render_states.data(), pass.render_states.size() * sizeof(pass.render_states[0]), pass.stateblock, [this, &pass](IDirect3DStateBlock9 **stateblock) {
+			HRESULT hr = _device->BeginStateBlock();
+
+			if (FAILED(hr))
+			{
+				return hr;
+			}
+
+			for (const auto &state : pass.render_states)
+			{
+				_device->SetRenderState(state.first, state.second);
+			}
+
+			return _device->EndStateBlock(stateblock);
+		});
+	}
+	bool d3d9_runtime::load_d3dcompiler(std::string &errors)
+	{
+		const std::lock_guard<std::mutex> lock(_d3dcompiler_mutex);
+
+		if (_d3dcompiler_module == nullptr)
+		{
+			_d3dcompiler_module = LoadLibraryW(L"d3dcompiler_47.dll");
+
+			if (_d3dcompiler_module == nullptr)
+			{
+				_d3dcompiler_module = LoadLibraryW(L"d3dcompiler_43.dll");
+			}
+			if (_d3dcompiler_module == nullptr)
+			{
+				errors += "Unable to load D3DCompiler library. Make sure you have the DirectX end-user runtime (June 2010) installed or a newer version of the library in the application directory.\n";
+				return false;
+			}
+		}
+
+		return true;
+	}
+	bool d3d9_runtime::compile_shader(const std::string &source, const std::string &profile, const D3D_SHADER_MACRO *defines, UINT flags, std::vector<char> &bytecode, std::string &errors)
+	{
+		if (!load_d3dcompiler(errors))
+		{
+			return false;
+		}
+
+		// Defines are not part of the cache key, so only use the cache for sources that have them resolved already
+		const unsigned long long cache_key = shader_cache::compute_key(source, "__main", profile, flags, _d3dcompiler_module);
+
+		shader_cache::compile_lock lock;
+
+		if (defines == nullptr)
+		{
+			if (shader_cache::load(cache_key, bytecode))
+			{
+				return true;
+			}
+
+			// Another game client may be compiling the same shader right now, so wait for it and take its result from the cache instead of compiling it as well
+			if (lock.acquire(cache_key) && shader_cache::load(cache_key, bytecode))
+			{
+				return true;
+			}
+		}
+
+		const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3dcompiler_module, "D3DCompile"));
+
+		com_ptr<ID3DBlob> compiled, compile_errors;
+		const HRESULT hr = D3DCompile(source.c_str(), source.size(), nullptr, defines, nullptr, "__main", profile.c_str(), flags, 0, &compiled, &compile_errors);
+
+		if (compile_errors != nullptr)
+		{
+			errors.append(static_cast<const char *>(compile_errors->GetBufferPointer()), compile_errors->GetBufferSize() - 1);
+		}
+
+		if (FAILED(hr))
+		{
+			return false;
+		}
+
+		if (defines == nullptr)
+		{
+			shader_cache::save(cache_key, compiled->GetBufferPointer(), compiled->GetBufferSize());
+		}
+
+		bytecode.assign(static_cast<const char *>(compiled->GetBufferPointer()), static_cast<const char *>(compiled->GetBufferPointer()) + compiled->GetBufferSize());
+
+		return true;
+	}
+	bool d3d9_runtime::compile_technique(technique &technique, std::string &errors)
+	{
+		return compile_technique_shaders(technique, errors) && create_technique_shaders(technique, errors);
+	}
+	bool d3d9_runtime::compile_technique_shaders(technique &technique, std::string &errors)
+	{
+		const auto technique_impl = technique.impl->as<d3d9_technique_data>();
+
+		bool is_optimization_pending = false;
+
+		// Use optimized shaders right away when they are in the cache already, otherwise start out with unoptimized ones, which compile a lot faster, and optimize them in the background
+		const auto compile = [this, technique_impl, &is_optimization_pending, &errors](const std::string &source, const char *profile, std::vector<char> &bytecode) {
+			if (technique_impl->skip_shader_optimization)
+			{
+				return compile_shader(source, profile, nullptr, D3DCOMPILE_SKIP_OPTIMIZATION, bytecode, errors);
+			}
+
+			// The compiler version is part of the cache key, so it has to be loaded before looking up anything
+			if (!load_d3dcompiler(errors))
+			{
+				return false;
+			}
+
+			if (shader_cache::load(shader_cache::compute_key(source, "__main", profile, 0, _d3dcompiler_module), bytecode))
+			{
+				return true;
+			}
+
+			std::string unoptimized_errors;
+
+			if (compile_shader(source, profile, nullptr, D3DCOMPILE_SKIP_OPTIMIZATION, bytecode, unoptimized_errors))
+			{
+				errors += unoptimized_errors;
+				is_optimization_pending = true;
+				return true;
+			}
+
+			// Unoptimized code can exceed the instruction limits of the shader model, so compile it optimized right away in that case
+			return compile_shader(source, profile, nullptr, 0, bytecode, errors);
+		};
+
+		for (const auto &pass_object : technique.passes)
+		{
+			const auto pass = pass_object->as<d3d9_pass_data>();
+
+			if (!pass->vertex_shader_source.empty() && !compile(pass->vertex_shader_source, "vs_3_0", pass->vertex_shader_bytecode))
+			{
+				return false;
+			}
+			if (!pass->pixel_shader_source.empty() && !compile(pass->pixel_shader_source, "ps_3_0", pass->pixel_shader_bytecode))
+			{
+				return false;
+			}
+		}
+
+		technique_impl->is_optimization_pending = is_optimization_pending;
+
+		return true;
+	}
+	bool d3d9_runtime::create_technique_shaders(technique &technique, std::string &errors)
+	{
+		const auto technique_impl = technique.impl->as<d3d9_technique_data>();
+
+		bool success = true;
+
+		for (const auto &pass_object : technique.passes)
+		{
+			const auto pass = pass_object->as<d3d9_pass_data>();
+			HRESULT hr = S_OK;
+
+			if (!pass->vertex_shader_source.empty())
+			{
+				hr = _device->CreateVertexShader(reinterpret_cast<const DWORD *>(pass->vertex_shader_bytecode.data()), &pass->vertex_shader);
+			}
+			if (SUCCEEDED(hr) && !pass->pixel_shader_source.empty())
+			{
+				hr = _device->CreatePixelShader(reinterpret_cast<const DWORD *>(pass->pixel_shader_bytecode.data()), &pass->pixel_shader);
+			}
+
+			if (FAILED(hr))
+			{
+				errors += "internal shader creation failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!\n";
+				success = false;
+				break;
+			}
+
+			if (hr = create_pass_stateblock(*pass); FAILED(hr))
+			{
+				errors += "internal pass stateblock creation failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!\n";
+				success = false;
+				break;
+			}
+		}
+
+		for (const auto &pass_object : technique.passes)
+		{
+			const auto pass = pass_object->as<d3d9_pass_data>();
+
+			// The shaders keep their own copy of the bytecode
+			std::vector<char>().swap(pass->vertex_shader_bytecode);
+			std::vector<char>().swap(pass->pixel_shader_bytecode);
+
+			if (!success)
+			{
+				pass->vertex_shader.reset();
+				pass->pixel_shader.reset();
+				pass->stateblock.reset();
+			}
+		}
+
+		if (!success)
+		{
+			return false;
+		}
+
+		technique_impl->is_compiled = true;
+
+		if (technique_impl->is_optimization_pending)
+		{
+			queue_shader_optimization(technique);
+		}
+
+		return true;
+	}
+	void d3d9_runtime::queue_shader_optimization(const technique &technique)
+	{
+		auto job = std::make_unique<shader_optimization_job>();
+		job->technique_name = technique.name;
+		job->technique = technique.impl->as<d3d9_technique_data>();
+
+		for (const auto &pass_object : technique.passes)
+		{
+			const auto pass = pass_object->as<d3d9_pass_data>();
+
+			job->sources.push_back(pass->vertex_shader_source);
+			job->sources.push_back(pass->pixel_shader_source);
+		}
+
+		{ const std::lock_guard<std::mutex> lock(_optimization_mutex);
+			_optimization_jobs.push_back(std::move(job));
+		}
+
+		if (!_optimization_worker.joinable())
+		{
+			_optimization_worker = std::thread(&d3d9_runtime::optimization_worker_loop, this);
+		}
+
+		_optimization_signal.notify_one();
+	}
+	void d3d9_runtime::optimization_worker_loop()
+	{
+		// Optimizing is not urgent, so leave the processor to the application first
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+		std::unique_lock<std::mutex> lock(_optimization_mutex);
+
+		while (true)
+		{
+			_optimization_signal.wait(lock, [this]() { return _optimization_worker_exit || !_optimization_jobs.empty(); });
+
+			if (_optimization_worker_exit)
+			{
+				break;
+			}
+
+			auto job = std::move(_optimization_jobs.front());
+			_optimization_jobs.pop_front();
+
+			lock.unlock();
+
+			job->success = true;
+			job->bytecode.resize(job->sources.size());
+
+			for (size_t i = 0; i < job->sources.size() && job->success; i++)
+			{
+				if (!job->sources[i].empty())
+				{
+					job->success = compile_shader(job->sources[i], i % 2 == 0 ? "vs_3_0" : "ps_3_0", nullptr, 0, job->bytecode[i], job->errors);
+				}
+			}
+
+			lock.lock();
+
+			_optimization_results.push_back(std::move(job));
+		}
+	}
+	void d3d9_runtime::apply_optimized_shaders()
+	{
+		std::unique_lock<std::mutex> lock(_optimization_mutex);
+
+		// Nearly every frame has nothing to swap in, so do not even construct the queue then
+		if (_optimization_results.empty())
+		{
+			return;
+		}
+
+		std::deque<std::unique_ptr<shader_optimization_job>> results;
+		results.swap(_optimization_results);
+
+		lock.unlock();
+
+		for (const auto &job : results)
+		{
+			// The technique may have been destroyed or compiled again from different source since the job was queued, so only accept an exact match
+			const auto it = std::find_if(_techniques.begin(), _techniques.end(), [&job](const technique &technique) {
+				if (technique.impl.get() != job->technique || technique.passes.size() * 2 != job->sources.size())
+				{
+					return false;
+				}
+
+				for (size_t i = 0; i < technique.passes.size(); i++)
+				{
+					const auto pass = technique.passes[i]->as<d3d9_pass_data>();
+
+					if (pass->vertex_shader_source != job->sources[i * 2] || pass->pixel_shader_source != job->sources[i * 2 + 1])
+					{
+						return false;
+					}
+				}
+
+				return true;
+			});
+
+			if (it == _techniques.end() || !job->technique->is_compiled)
+			{
+				continue;
+			}
+
+			if (!job->success)
+			{
+				LOG(WARNING) << "Failed to optimize shaders of technique '" << job->technique_name << "', keeping the unoptimized ones:\n" << job->errors;
+				continue;
+			}
+
+			// Create all shaders before touching the passes, so that a failure leaves the technique in a working state
+			HRESULT hr = S_OK;
+			std::vector<com_ptr<IDirect3DVertexShader9>> vertex_shaders(it->passes.size());
+			std::vector<com_ptr<IDirect3DPixelShader9>> pixel_shaders(it->passes.size());
+
+			for (size_t i = 0; i < it->passes.size() && SUCCEEDED(hr); i++)
+			{
+				if (!job->bytecode[i * 2].empty())
+				{
+					hr = _device->CreateVertexShader(reinterpret_cast<const DWORD *>(job->bytecode[i * 2].data()), &vertex_shaders[i]);
+				}
+				if (SUCCEEDED(hr) && !job->bytecode[i * 2 + 1].empty())
+				{
+					hr = _device->CreatePixelShader(reinterpret_cast<const DWORD *>(job->bytecode[i * 2 + 1].data()), &pixel_shaders[i]);
+				}
+			}
+
+			if (FAILED(hr))
+			{
+				LOG(WARNING) << "Failed to create optimized shaders for technique '" << job->technique_name << "'! HRESULT is '" << std::hex << hr << std::dec << "'.";
+				continue;
+			}
+
+			for (size_t i = 0; i < it->passes.size(); i++)
+			{
+				const auto pass = it->passes[i]->as<d3d9_pass_data>();
+
+				pass->vertex_shader = std::move(vertex_shaders[i]);
+				pass->pixel_shader = std::move(pixel_shaders[i]);
+			}
+
+			LOG(INFO) << "Switched technique '" << job->technique_name << "' to optimized shaders.";
+		}
+	}
+	bool d3d9_runtime::load_technique(technique &technique)
+	{
+		if (technique.impl->as<d3d9_technique_data>()->is_compiled)
+		{
+			return true;
+		}
+
+		std::string errors;
+
+		if (!compile_technique(technique, errors))
+		{
+			LOG(ERROR) << "Failed to compile technique '" << technique.name << "':\n" << errors;
+			return false;
+		}
+
+		if (!errors.empty())
+		{
+			LOG(WARNING) << "Compiled technique '" << technique.name << "' with warnings:\n" << errors;
+		}
+
+		return update_texture_allocations();
+	}
+	void d3d9_runtime::unload_technique(technique &technique)
+	{
+		const auto technique_impl = technique.impl->as<d3d9_technique_data>();
+
+		if (!technique_impl->is_compiled)
+		{
+			return;
+		}
+
+		for (const auto &pass_object : technique.passes)
+		{
+			const auto pass = pass_object->as<d3d9_pass_data>();
+
+			pass->vertex_shader.reset();
+			pass->pixel_shader.reset();
+			pass->stateblock.reset();
+		}
+
+		technique_impl->is_compiled = false;
+
+		LOG(INFO) << "Unloaded technique '" << technique.name << "' after it was disabled for a while.";
+
+		update_texture_allocations();
+	}
+	void d3d9_runtime::on_techniques_reordered()
+	{
+		// Which render targets can share memory depends on the order the techniques use them in
+		if (_is_initialized)
+		{
+			update_texture_allocations();
+		}
+	}
+	size_t d3d9_runtime::texture_memory_usage(const texture &texture) const
+	{
+		const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+
+		// Textures nothing uses are released until a technique that uses them is loaded again
+		if (texture_impl == nullptr || texture_impl->texture == nullptr)
+		{
+			return 0;
+		}
+
+		// Render targets that share an allocation, and textures that share an image file, count for the first texture using it
+		if (texture_impl->is_aliased || texture_impl->is_shared)
+		{
+			for (const auto &other : _textures)
+			{
+				if (&other == &texture)
+				{
+					break;
+				}
+
+				if (other.impl_reference == texture_reference::none && other.impl != nullptr && other.impl->as<d3d9_tex_data>()->texture == texture_impl->texture)
+				{
+					return 0;
+				}
+			}
+		}
+
+		return texture_memory_size(texture.width, texture.height, texture_impl->texture->GetLevelCount(), texture.format);
+	}
+	void d3d9_runtime::technique_memory_usage(const technique &technique, size_t &gpu_size, size_t &cpu_size) const
+	{
+		gpu_size = cpu_size = 0;
+
+		for (const auto &pass_object : technique.passes)
+		{
+			const auto pass = pass_object->as<d3d9_pass_data>();
+
+			UINT size = 0;
+
+			if (pass->vertex_shader != nullptr && SUCCEEDED(pass->vertex_shader->GetFunction(nullptr, &size)))
+			{
+				gpu_size += size;
+			}
+			if (pass->pixel_shader != nullptr && SUCCEEDED(pass->pixel_shader->GetFunction(nullptr, &size)))
+			{
+				gpu_size += size;
+			}
+
+			cpu_size += sizeof(d3d9_pass_data) + pass->name.capacity() + pass->vertex_shader_source.capacity() + pass->pixel_shader_source.capacity() + pass->render_states.capacity() * sizeof(pass->render_states[0]);
+		}
+	}
+	bool d3d9_runtime::update_texture_allocations()
+	{
+		struct texture_lifetime
+		{
+			size_t first_use = std::numeric_limits<size_t>::max(), last_use = 0;
+			bool is_written = false, is_persistent = false;
+		};
+		struct texture_allocation
+		{
+			const texture *desc;
+			size_t last_use;
+			com_ptr<IDirect3DTexture9> texture;
+			std::vector<d3d9_tex_data *> aliases;
+		};
+
+		std::unordered_map<const d3d9_tex_data *, texture_lifetime> lifetimes;
+
+		// Walk the compiled techniques in render order to find out when each texture is used within a frame
+		for (size_t technique_index = 0; technique_index < _techniques.size(); technique_index++)
+		{
+			const auto &technique = _techniques[technique_index];
+
+			if (!technique.impl->as<d3d9_technique_data>()->is_compiled)
+			{
+				continue;
+			}
+
+			for (const auto &pass_object : technique.passes)
+			{
+				const auto pass = pass_object->as<d3d9_pass_data>();
+
+				const auto render_state = [pass](D3DRENDERSTATETYPE state) {
+					const auto it = std::find_if(pass->render_states.begin(), pass->render_states.end(), [state](const auto &entry) { return entry.first == state; });
+					return it != pass->render_states.end() ? it->second : 0;
+				};
+
+				// Samplers are read before the render targets of the same pass are written
+				for (DWORD sampler = 0; sampler < pass->sampler_count; sampler++)
+				{
+					auto &lifetime = lifetimes[pass->samplers[sampler].texture];
+
+					// Reading a texture before anything in the frame wrote to it means its contents are carried over from the last frame
+					lifetime.is_persistent |= !lifetime.is_written;
+					lifetime.first_use = std::min(lifetime.first_use, technique_index);
+					lifetime.last_use = technique_index;
+				}
+				for (const auto texture : pass->render_target_textures)
+				{
+					if (texture == nullptr)
+					{
+						continue;
+					}
+
+					auto &lifetime = lifetimes[texture];
+
+					// Blending, masked writes, the stencil test and discarded pixels keep some of the previous contents too
+					if (!lifetime.is_written && (render_state(D3DRS_ALPHABLENDENABLE) != FALSE || render_state(D3DRS_COLORWRITEENABLE) != 0xF || render_state(D3DRS_STENCILENABLE) != FALSE || pass->discards_pixels))
+					{
+						lifetime.is_persistent = true;
+					}
+					// Techniques that skip frames while the camera stands still leave their result in place for the frames they skip, so nothing else may reuse the memory in between
+					if (technique.static_interval > 0)
+					{
+						lifetime.is_persistent = true;
+					}
+
+					lifetime.is_written = true;
+					lifetime.first_use = std::min(lifetime.first_use, technique_index);
+					lifetime.last_use = technique_index;
+				}
+			}
+		}
+
+		bool success = true;
+		std::vector<std::pair<texture *, texture_lifetime>> transient_textures;
+
+		for (auto &texture : _textures)
+		{
+			if (texture.impl_reference != texture_reference::none)
+			{
+				continue;
+			}
+
+			const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+			const auto lifetime = lifetimes.find(texture_impl);
+
+			// Textures loaded from an image file are kept around, so the image does not have to be loaded again
+			if (lifetime == lifetimes.end() && texture.annotations.count("source") == 0)
+			{
+				texture_impl->surface.reset();
+				texture_impl->texture.reset();
+				continue;
+			}
+
+			// Scratch render targets, which are completely rewritten every frame before being read, may share memory with others
+			if (lifetime != lifetimes.end() && !lifetime->second.is_persistent && texture.annotations.count("source") == 0)
+			{
+				transient_textures.emplace_back(&texture, lifetime->second);
+				continue;
+			}
+
+			// A texture loaded from an image file that is shared with other textures needs its own copy of the image as soon as a pass renders to it
+			const bool is_unshared = texture_impl->is_shared && lifetime != lifetimes.end() && lifetime->second.is_written;
+
+			// A texture that used to be transient may still point to an allocation it shared with others
+			if (texture_impl->texture != nullptr && !texture_impl->is_aliased && !is_unshared)
+			{
+				continue;
+			}
+
+			const com_ptr<IDirect3DSurface9> shared_surface = is_unshared ? texture_impl->surface : nullptr;
+
+			texture_impl->surface.reset();
+			texture_impl->texture.reset();
+			texture_impl->is_aliased = false;
+			texture_impl->is_shared = false;
+
+			const HRESULT hr = _device->CreateTexture(texture.width, texture.height, texture_impl->levels, texture_impl->usage, texture_impl->format, D3DPOOL_DEFAULT, &texture_impl->texture, nullptr);
+
+			if (FAILED(hr))
+			{
+				LOG(ERROR) << "Failed to create texture '" << texture.unique_name << "'! HRESULT is '" << std::hex << hr << std::dec << "'.";
+				success = false;
+				continue;
+			}
+
+			texture_impl->texture->GetSurfaceLevel(0, &texture_impl->surface);
+
+			// Only render targets are written by passes, so the shared image can be copied over with 'StretchRect'
+			if (shared_surface != nullptr)
+			{
+				_device->StretchRect(shared_surface.get(), nullptr, texture_impl->surface.get(), nullptr, D3DTEXF_NONE);
+
+				texture_impl->is_mipmap_outdated = true;
+			}
+		}
+
+		// Assign transient textures to allocations greedily in order of first use, reusing one whose last user is done before the texture is needed
+		std::sort(transient_textures.begin(), transient_textures.end(), [](const auto &lhs, const auto &rhs) { return lhs.second.first_use < rhs.second.first_use; });
+
+		std::vector<texture_allocation> allocations;
+
+		for (const auto &[texture, lifetime] : transient_textures)
+		{
+			const auto texture_impl = texture->impl->as<d3d9_tex_data>();
+			const auto allocation = std::find_if(allocations.begin(), allocations.end(), [texture = texture, texture_impl, first_use = lifetime.first_use](const texture_allocation &allocation) {
+				const auto desc_impl = allocation.desc->impl->as<d3d9_tex_data>();
+
+				return allocation.last_use < first_use &&
+					allocation.desc->width == texture->width && allocation.desc->height == texture->height &&
+					desc_impl->levels == texture_impl->levels && desc_impl->usage == texture_impl->usage && desc_impl->format == texture_impl->format;
+			});
+
+			if (allocation != allocations.end())
+			{
+				allocation->last_use = lifetime.last_use;
+				allocation->aliases.push_back(texture_impl);
+			}
+			else
+			{
+				allocations.push_back({ texture, lifetime.last_use, nullptr, { texture_impl } });
+			}
+		}
+
+		std::unordered_set<IDirect3DTexture9 *> claimed_textures;
+
+		for (auto &allocation : allocations)
+		{
+			// Keep an existing texture of one of the aliases, so the allocation does not change unless the lifetimes do
+			for (const auto texture_impl : allocation.aliases)
+			{
+				if (texture_impl->texture != nullptr && claimed_textures.insert(texture_impl->texture.get()).second)
+				{
+					allocation.texture = texture_impl->texture;
+					break;
+				}
+			}
+
+			if (allocation.texture == nullptr)
+			{
+				const auto desc_impl = allocation.desc->impl->as<d3d9_tex_data>();
+				const HRESULT hr = _device->CreateTexture(allocation.desc->width, allocation.desc->height, desc_impl->levels, desc_impl->usage, desc_impl->format, D3DPOOL_DEFAULT, &allocation.texture, nullptr);
+
+				if (FAILED(hr))
+				{
+					LOG(ERROR) << "Failed to create texture for " << allocation.aliases.size() << " render target(s)! HRESULT is '" << std::hex << hr << std::dec << "'.";
+					success = false;
+				}
+			}
+		}
+
+		for (auto &allocation : allocations)
+		{
+			for (const auto texture_impl : allocation.aliases)
+			{
+				texture_impl->surface.reset();
+				texture_impl->texture = allocation.texture;
+				texture_impl->is_aliased = true;
+
+				if (allocation.texture != nullptr)
+				{
+					allocation.texture->GetSurfaceLevel(0, &texture_impl->surface);
+				}
+			}
+		}
+
+		for (const auto &technique : _techniques)
+		{
+			if (!technique.impl->as<d3d9_technique_data>()->is_compiled)
+			{
+				continue;
+			}
+
+			for (const auto &pass_object : technique.passes)
+			{
+				const auto pass = pass_object->as<d3d9_pass_data>();
+
+				pass->render_targets[0] = _backbuffer_resolved.get();
+
+				for (unsigned int target = 0; target < _countof(pass->render_targets); target++)
+				{
+					if (pass->render_target_textures[target] != nullptr)
+					{
+						pass->render_targets[target] = pass->render_target_textures[target]->surface.get();
+					}
+				}
+			}
+		}
+
+		return success;
+	}
+
+	void d3d9_runtime::render_technique(const technique &technique)
+	{
+		const gpu_marker technique_marker(_gpu_markers, technique.name);
+
+		d3d9_technique_data &technique_data = *technique.impl->as<d3d9_technique_data>();
+
+		const bool issue_queries = begin_timestamp_queries(technique_data);
+		const bool issue_pass_queries = issue_queries && _gpu_pass_timing;
+
+		bool is_default_depthstencil_cleared = false;
+
+		// Passes compiled against the back buffer render to wherever effects are applied to this frame
+		IDirect3DSurface9 *const effect_target = _effect_target != nullptr ? _effect_target : _backbuffer_resolved.get();
+
+		// Setup shader constants
+		if (technique.uniform_storage_index >= 0)
+		{
+			const auto uniform_storage_data = reinterpret_cast<const float *>(get_uniform_value_storage().data() + technique.uniform_storage_offset);
+			const auto uniform_register_count = static_cast<UINT>(technique.uniform_storage_index);
+
+			_num_changed_constants = std::max(_num_changed_constants, uniform_register_count);
+
+			// Registers are shared with the application and overwritten by it between effect runs, but techniques of the same effect that follow each other can reuse the upload
+			if (_uploaded_uniform_storage_offset != technique.uniform_storage_offset || _uploaded_uniform_register_count < uniform_register_count)
+			{
+				_device->SetPixelShaderConstantF(0, uniform_storage_data, uniform_register_count);
+
+				_uploaded_uniform_storage_offset = technique.uniform_storage_offset;
+				_uploaded_uniform_register_count = uniform_register_count;
+			}
+
+			// Vertex shader registers are tracked separately, since they are only written for techniques that read them and keep the values of an effect while other effects skip them
+			if (technique_data.vertex_shaders_use_uniforms && (_uploaded_vertex_uniform_storage_offset != technique.uniform_storage_offset || _uploaded_vertex_uniform_register_count < uniform_register_count))
+			{
+				_device->SetVertexShaderConstantF(0, uniform_storage_data, uniform_register_count);
+
+				_uploaded_vertex_uniform_storage_offset = technique.uniform_storage_offset;
+				_uploaded_vertex_uniform_register_count = uniform_register_count;
+			}
+		}
+
+		for (const auto &pass_object : technique.passes)
+		{
+			render_pass(*pass_object->as<d3d9_pass_data>(), effect_target, is_default_depthstencil_cleared);
+
+			if (issue_pass_queries)
+			{
+				issue_pass_timestamp_query(technique_data);
+			}
+		}
+
+		if (issue_queries)
+		{
+			end_timestamp_queries(technique_data);
+		}
+	}
+	size_t d3d9_runtime::render_fused_techniques(const technique *const *techniques, size_t count)
+	{
+		// The replay benchmark times every pass of every technique on its own
+		if (_is_replaying)
+		{
+			return 0;
+		}
+
+		const d3d9_fusion_fragment *const first = techniques[0]->impl->as<d3d9_technique_data>()->fusion.get();
+
+		if (first == nullptr)
+		{
+			return 0;
+		}
+
+		const std::string &vertex_shader_source = techniques[0]->passes[0]->as<d3d9_pass_data>()->vertex_shader_source;
+
+		// Fuse as many of the following techniques as shader model 3.0 has constant registers and samplers for
+		UINT register_count = static_cast<UINT>(std::max(0, techniques[0]->uniform_storage_index));
+		size_t sampler_count = first->samplers.size();
+		size_t fused_count = 1;
+
+		for (; fused_count < count; fused_count++)
+		{
+			const technique &technique = *techniques[fused_count];
+			const d3d9_fusion_fragment *const fragment = technique.impl->as<d3d9_technique_data>()->fusion.get();
+			const d3d9_pass_data &pass = *technique.passes[0]->as<d3d9_pass_data>();
+
+			// The back buffer mipmaps would be generated before the techniques in front of it rendered
+			if (fragment == nullptr || !fragment->reads_backbuffer_pointwise || pass.samples_backbuffer_mipmaps ||
+				fragment->signature != first->signature || pass.vertex_shader_source != vertex_shader_source)
+			{
+				break;
+			}
+
+			const UINT fragment_register_count = static_cast<UINT>(std::max(0, technique.uniform_storage_index));
+			const size_t fragment_sampler_count = std::count_if(fragment->samplers.begin(), fragment->samplers.end(), [](const auto &sampler) { return !sampler.is_backbuffer; });
+
+			if (register_count + fragment_register_count > 224 || sampler_count + fragment_sampler_count > 16)
+			{
+				break;
+			}
+
+			register_count += fragment_register_count;
+			sampler_count += fragment_sampler_count;
+		}
+
+		if (fused_count < 2)
+		{
+			return 0;
+		}
+
+		auto it = std::find_if(_fused_passes.begin(), _fused_passes.end(), [techniques, fused_count](const fused_pass &fused) {
+			return fused.techniques.size() == fused_count && std::equal(fused.techniques.begin(), fused.techniques.end(), techniques,
+				[](const d3d9_technique_data *technique_data, const technique *technique) { return technique_data == technique->impl->as<d3d9_technique_data>(); });
+		});
+
+		// Compiled the first time the techniques follow each other, which adds the same hitch as enabling a technique that was not loaded yet
+		if (it == _fused_passes.end())
+		{
+			it = _fused_passes.insert(_fused_passes.end(), create_fused_pass(techniques, fused_count));
+		}
+
+		if (it->pass == nullptr)
+		{
+			return 0;
+		}
+
+		const gpu_marker technique_marker(_gpu_markers, techniques[0]->name);
+
+		// The fused pass takes the place of the first technique in the statistics
+		d3d9_technique_data &technique_data = *techniques[0]->impl->as<d3d9_technique_data>();
+
+		const bool issue_queries = begin_timestamp_queries(technique_data);
+
+		if (issue_queries)
+		{
+			technique_data.queries[technique_data.query_write_index].fused_techniques = it->techniques;
+		}
+
+		// Each technique reads its uniforms from its own range of constant registers
+		for (size_t i = 0; i < fused_count; i++)
+		{
+			if (techniques[i]->uniform_storage_index <= 0)
+			{
+				continue;
+			}
+
+			const auto uniform_storage_data = reinterpret_cast<const float *>(get_uniform_value_storage().data() + techniques[i]->uniform_storage_offset);
+			const auto uniform_register_count = static_cast<UINT>(techniques[i]->uniform_storage_index);
+
+			_device->SetPixelShaderConstantF(it->uniform_registers[i], uniform_storage_data, uniform_register_count);
+
+			_num_changed_constants = std::max(_num_changed_constants, it->uniform_registers[i] + uniform_register_count);
+		}
+
+		// Which is not what the next technique expects to find in the registers
+		_uploaded_uniform_storage_offset = -1;
+		_uploaded_uniform_register_count = 0;
+
+		IDirect3DSurface9 *const effect_target = _effect_target != nullptr ? _effect_target : _backbuffer_resolved.get();
+
+		bool is_default_depthstencil_cleared = false;
+
+		render_pass(*it->pass, effect_target, is_default_depthstencil_cleared);
+
+		if (issue_queries)
+		{
+			end_timestamp_queries(technique_data);
+		}
+
+		return fused_count;
+	}
+	d3d9_runtime::fused_pass d3d9_runtime::create_fused_pass(const technique *const *techniques, size_t count)
+	{
+		fused_pass fused;
+		std::vector<const d3d9_fusion_fragment *> fragments(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			fused.techniques.push_back(techniques[i]->impl->as<d3d9_technique_data>());
+			fused.uniform_registers.push_back(i == 0 ? 0 : fused.uniform_registers[i - 1] + static_cast<UINT>(std::max(0, techniques[i - 1]->uniform_storage_index)));
+			fragments[i] = fused.techniques[i]->fusion.get();
+		}
+
+		const std::string source = d3d9_effect_compiler::build_fused_pixel_shader(fragments.data(), fused.uniform_registers.data(), count, _backbuffer_format);
+
+		auto pass = std::make_unique<d3d9_pass_data>();
+		std::vector<char> bytecode;
+		std::string errors;
+
+		// Always optimized, since the fused shader replaces several optimized ones and the result is cached
+		if (!compile_shader(source, "ps_3_0", nullptr, 0, bytecode, errors) ||
+			FAILED(_device->CreatePixelShader(reinterpret_cast<const DWORD *>(bytecode.data()), &pass->pixel_shader)))
+		{
+			LOG(WARNING) << "Failed to fuse techniques '" << techniques[0]->name << "' to '" << techniques[count - 1]->name << "', rendering them one after another instead:\n" << errors;
+			return fused;
 		}
 
-		D3DLOCKED_RECT mapped_rect;
-		hr = mem_texture->LockRect(0, &mapped_rect, nullptr, 0);
+		const d3d9_pass_data &first_pass = *techniques[0]->passes[0]->as<d3d9_pass_data>();
 
-		if (FAILED(hr))
+		pass->name = "Fused";
+		pass->vertex_shader = first_pass.vertex_shader;
+		pass->render_states = first_pass.render_states;
+		pass->render_targets[0] = _backbuffer_resolved.get();
+		pass->writes_backbuffer = true;
+		pass->samples_backbuffer = first_pass.samples_backbuffer;
+
+		// Samplers are in the order the fused shader declares them
+		for (size_t i = 0; i < count; i++)
 		{
-			LOG(ERROR) << "Failed to lock memory texture for texture updating! HRESULT is '" << std::hex << hr << std::dec << "'.";
-			return false;
-		}
+			const d3d9_pass_data &technique_pass = *techniques[i]->passes[0]->as<d3d9_pass_data>();
 
-		const UINT size = std::min(texture.width * 4, static_cast<UINT>(mapped_rect.Pitch)) * texture.height;
-		auto mapped_data = static_cast<BYTE *>(mapped_rect.pBits);
+			pass->samples_linear_depth |= technique_pass.samples_linear_depth;
+			pass->samples_backbuffer_mipmaps |= technique_pass.samples_backbuffer_mipmaps;
 
-		switch (texture.format)
+			for (const auto &sampler : fragments[i]->samplers)
+			{
+				if (i == 0 || !sampler.is_backbuffer)
+				{
+					pass->samplers[pass->sampler_count++] = sampler.sampler;
+				}
+			}
+		}
+
+		if (const HRESULT hr = create_pass_stateblock(*pass); FAILED(hr))
 		{
-			case texture_format::r8:
-				for (UINT i = 0; i < size; i += 4, mapped_data += 4)
-					mapped_data[0] = 0,
-					mapped_data[1] = 0,
-					mapped_data[2] = data[i],
-					mapped_data[3] = 0;
-				break;
-			case texture_format::rg8:
-				for (UINT i = 0; i < size; i += 4, mapped_data += 4)
-					mapped_data[0] = 0,
-					mapped_data[1] = data[i + 1],
-					mapped_data[2] = data[i],
-					mapped_data[3] = 0;
-				break;
-			case texture_format::rgba8:
-				for (UINT i = 0; i < size; i += 4, mapped_data += 4)
-					mapped_data[0] = data[i + 2],
-					mapped_data[1] = data[i + 1],
-					mapped_data[2] = data[i],
-					mapped_data[3] = data[i + 3];
-				break;
-			default:
-				std::memcpy(mapped_data, data, size);
-				break;
+			LOG(WARNING) << "Failed to create stateblock for techniques fused from '" << techniques[0]->name << "' to '" << techniques[count - 1]->name << "'! HRESULT is '" << std::hex << hr << std::dec << "'.";
+			return fused;
 		}
 
-		mem_texture->UnlockRect(0);
+		LOG(INFO) << "Fused " << count << " techniques from '" << techniques[0]->name << "' to '" << techniques[count - 1]->name << "' into a single pass.";
 
-		hr = _device->UpdateTexture(mem_texture.get(), texture_impl->texture.get());
+		fused.pass = std::move(pass);
 
-		if (FAILED(hr))
+		return fused;
+	}
+	bool d3d9_runtime::begin_timestamp_queries(d3d9_technique_data &technique_data)
+	{
+		d3d9_technique_data::timestamp_queries &queries = technique_data.queries[technique_data.query_write_index];
+
+		// Skip timing this frame if all query sets are still waiting for the GPU, the replay benchmark does its own timing
+		if (_is_replaying || queries.in_flight || queries.timestamp_disjoint == nullptr)
 		{
-			LOG(ERROR) << "Failed to update texture from memory texture! HRESULT is '" << std::hex << hr << std::dec << "'.";
 			return false;
 		}
 
+		queries.timestamp_disjoint->Issue(D3DISSUE_BEGIN);
+		queries.timestamp_query_beg->Issue(D3DISSUE_END);
+		queries.pass_query_count = 0;
+		queries.fused_techniques.clear();
+
 		return true;
 	}
-	bool d3d9_runtime::update_texture_reference(texture &texture, texture_reference id)
+	void d3d9_runtime::end_timestamp_queries(d3d9_technique_data &technique_data)
 	{
-		com_ptr<IDirect3DTexture9> new_reference;
+		d3d9_technique_data::timestamp_queries &queries = technique_data.queries[technique_data.query_write_index];
 
-		switch (id)
+		queries.timestamp_query_end->Issue(D3DISSUE_END);
+		queries.timestamp_disjoint->Issue(D3DISSUE_END);
+		queries.timestamp_frequency->Issue(D3DISSUE_END);
+		queries.in_flight = true;
+
+		technique_data.query_write_index = (technique_data.query_write_index + 1) % _countof(technique_data.queries);
+	}
+	void d3d9_runtime::issue_pass_timestamp_query(d3d9_technique_data &technique_data)
+	{
+		d3d9_technique_data::timestamp_queries &queries = technique_data.queries[technique_data.query_write_index];
+
+		if (queries.pass_query_count == queries.timestamp_query_passes.size())
 		{
-			case texture_reference::back_buffer:
-				new_reference = _backbuffer_texture;
-				break;
-			case texture_reference::depth_buffer:
-				new_reference = _depthstencil_texture;
-				break;
-			default:
-				return false;
-		}
+			com_ptr<IDirect3DQuery9> query;
 
-		texture.impl_reference = id;
+			if (FAILED(_device->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &query)))
+			{
+				return;
+			}
 
-		const auto texture_impl = texture.impl->as<d3d9_tex_data>();
+			queries.timestamp_query_passes.push_back(std::move(query));
+		}
 
-		assert(texture_impl != nullptr);
+		queries.timestamp_query_passes[queries.pass_query_count++]->Issue(D3DISSUE_END);
+	}
+	void d3d9_runtime::render_pass(const d3d9_pass_data &pass, IDirect3DSurface9 *effect_target, bool &is_default_depthstencil_cleared)
+	{
+		const gpu_marker pass_marker(_gpu_markers, pass.name);
 
-		if (new_reference == texture_impl->texture)
+		// Shared textures are computed once per frame, by the first pass that reads them
+		if (pass.samples_linear_depth && _is_linear_depth_outdated)
 		{
-			return true;
+			update_linear_depth();
+		}
+		if (pass.samples_backbuffer_mipmaps && _is_backbuffer_mipmaps_outdated)
+		{
+			update_backbuffer_mipmaps(effect_target);
 		}
 
-		texture_impl->surface.reset();
+		// Setup states
+		pass.stateblock->Apply();
 
-		if (new_reference == nullptr)
+		_device->SetVertexShader(pass.vertex_shader.get());
+		_device->SetPixelShader(pass.pixel_shader.get());
+
+		// Save back buffer of previous pass, but only if this pass reads it and it changed since the last copy
+		if (pass.samples_backbuffer && _is_backbuffer_texture_outdated)
 		{
-			texture_impl->texture.reset();
+			_device->StretchRect(effect_target, nullptr, _backbuffer_texture_surface.get(), nullptr, D3DTEXF_NONE);
 
-			texture.width = texture.height = texture.levels = 0;
-			texture.format = texture_format::unknown;
+			_is_backbuffer_texture_outdated = false;
 		}
-		else
+
+		// Setup shader resources
+		_num_changed_samplers = std::max(_num_changed_samplers, static_cast<UINT>(pass.sampler_count));
+
+		for (DWORD sampler = 0; sampler < pass.sampler_count; sampler++)
 		{
-			texture_impl->texture = new_reference;
-			new_reference->GetSurfaceLevel(0, &texture_impl->surface);
+			const d3d9_sampler &desc = pass.samplers[sampler];
+			applied_sampler &applied = _applied_samplers[sampler];
 
-			D3DSURFACE_DESC desc;
-			texture_impl->surface->GetDesc(&desc);
+			// Mipmaps of render targets are only generated once a pass actually samples them
+			if (desc.texture->is_mipmap_outdated && desc.states[D3DSAMP_MIPFILTER] != D3DTEXF_NONE)
+			{
+				desc.texture->texture->SetAutoGenFilterType(D3DTEXF_LINEAR);
+				desc.texture->texture->GenerateMipSubLevels();
+				desc.texture->is_mipmap_outdated = false;
+			}
 
-			texture.width = desc.Width;
-			texture.height = desc.Height;
-			texture.format = texture_format::unknown;
-			texture.levels = new_reference->GetLevelCount();
-		}
+			// Only forward what changed since the previous pass, driver calls are the main CPU cost here
+			if (!applied.is_valid || applied.texture != desc.texture->texture)
+			{
+				_device->SetTexture(sampler, desc.texture->texture.get());
 
-		return true;
-	}
+				applied.texture = desc.texture->texture.get();
+			}
 
-	void d3d9_runtime::render_technique(const technique &technique)
-	{
-		bool is_default_depthstencil_cleared = false;
+			for (DWORD state = D3DSAMP_ADDRESSU; state <= D3DSAMP_SRGBTEXTURE; state++)
+			{
+				if (!applied.is_valid || applied.states[state] != desc.states[state])
+				{
+					_device->SetSamplerState(sampler, static_cast<D3DSAMPLERSTATETYPE>(state), desc.states[state]);
 
-		// Setup shader constants
-		if (technique.uniform_storage_index >= 0)
+					applied.states[state] = desc.states[state];
+				}
+			}
+
+			applied.is_valid = true;
+		}
+
+		// Setup render targets
+		for (DWORD target = 0; target < _num_simultaneous_rendertargets; target++)
 		{
-			const auto uniform_storage_data = reinterpret_cast<const float *>(get_uniform_value_storage().data() + technique.uniform_storage_offset);
-			_device->SetVertexShaderConstantF(0, uniform_storage_data, static_cast<UINT>(technique.uniform_storage_index));
-			_device->SetPixelShaderConstantF(0, uniform_storage_data, static_cast<UINT>(technique.uniform_storage_index));
+			_device->SetRenderTarget(target, pass.render_targets[target] == _backbuffer_resolved ? effect_target : pass.render_targets[target]);
 		}
 
-		for (const auto &pass_object : technique.passes)
+		D3DVIEWPORT9 viewport;
+		_device->GetViewport(&viewport);
+
+		const float texelsize[4] = { -1.0f / viewport.Width, 1.0f / viewport.Height };
+		_device->SetVertexShaderConstantF(255, texelsize, 1);
+
+		const bool is_viewport_sized = viewport.Width == _width && viewport.Height == _height;
+
+		_device->SetDepthStencilSurface(is_viewport_sized ? _default_depthstencil.get() : nullptr);
+
+		if (is_viewport_sized && !is_default_depthstencil_cleared)
 		{
-			const d3d9_pass_data &pass = *pass_object->as<d3d9_pass_data>();
+			is_default_depthstencil_cleared = true;
 
-			// Setup states
-			pass.stateblock->Apply();
+			_device->Clear(0, nullptr, (pass.clear_render_targets ? D3DCLEAR_TARGET : 0) | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL, 0, 1.0f, 0);
+		}
+		else if (pass.clear_render_targets)
+		{
+			_device->Clear(0, nullptr, D3DCLEAR_TARGET, 0, 0.0f, 0);
+		}
 
-			// Save back buffer of previous pass
-			_device->StretchRect(_backbuffer_resolved.get(), nullptr, _backbuffer_texture_surface.get(), nullptr, D3DTEXF_NONE);
+		// Draw triangle
+		_device->DrawPrimitive(D3DPT_TRIANGLELIST, 0, 1);
 
-			// Setup shader resources
-			for (DWORD sampler = 0; sampler < pass.sampler_count; sampler++)
-			{
-				_device->SetTexture(sampler, pass.samplers[sampler].texture->texture.get());
+		_vertices += 3;
+		_drawcalls += 1;
 
-				for (DWORD state = D3DSAMP_ADDRESSU; state <= D3DSAMP_SRGBTEXTURE; state++)
-				{
-					_device->SetSamplerState(sampler, static_cast<D3DSAMPLERSTATETYPE>(state), pass.samplers[sampler].states[state]);
-				}
-			}
+		if (pass.writes_backbuffer)
+		{
+			_is_backbuffer_texture_outdated = true;
+		}
 
-			// Setup render targets
-			for (DWORD target = 0; target < _num_simultaneous_rendertargets; target++)
+		// Update shader resources
+		for (const auto texture : pass.render_target_textures)
+		{
+			if (texture != nullptr && (texture->usage & D3DUSAGE_AUTOGENMIPMAP) != 0)
 			{
-				_device->SetRenderTarget(target, pass.render_targets[target]);
+				texture->is_mipmap_outdated = true;
 			}
+		}
 
-			D3DVIEWPORT9 viewport;
-			_device->GetViewport(&viewport);
+		if (_is_replaying && _replay_pass_query_index < _replay_pass_queries.size())
+		{
+			_replay_pass_queries[_replay_pass_query_index++]->Issue(D3DISSUE_END);
+		}
+	}
+	void d3d9_runtime::update_linear_depth()
+	{
+		_is_linear_depth_outdated = false;
 
-			const float texelsize[4] = { -1.0f / viewport.Width, 1.0f / viewport.Height };
-			_device->SetVertexShaderConstantF(255, texelsize, 1);
+		if (_linear_depth_state == nullptr)
+		{
+			return;
+		}
 
-			const bool is_viewport_sized = viewport.Width == _width && viewport.Height == _height;
+		_device->SetRenderTarget(0, _linear_depth_surface.get());
+		for (DWORD target = 1; target < _num_simultaneous_rendertargets; target++)
+		{
+			_device->SetRenderTarget(target, nullptr);
+		}
+		_device->SetDepthStencilSurface(nullptr);
 
-			_device->SetDepthStencilSurface(is_viewport_sized ? _default_depthstencil.get() : nullptr);
+		if (_depthstencil_texture == nullptr)
+		{
+			_device->Clear(0, nullptr, D3DCLEAR_TARGET, 0, 0.0f, 0);
+			return;
+		}
 
-			if (is_viewport_sized && !is_default_depthstencil_cleared)
-			{
-				is_default_depthstencil_cleared = true;
+		_linear_depth_state->Apply();
 
-				_device->Clear(0, nullptr, (pass.clear_render_targets ? D3DCLEAR_TARGET : 0) | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL, 0, 1.0f, 0);
-			}
-			else if (pass.clear_render_targets)
-			{
-				_device->Clear(0, nullptr, D3DCLEAR_TARGET, 0, 0.0f, 0);
-			}
+		_device->SetTexture(0, _depthstencil_texture.get());
 
-			// Draw triangle
-			_device->DrawPrimitive(D3DPT_TRIANGLELIST, 0, 1);
+		// The sampler was changed behind the back of the pass state tracking
+		_applied_samplers[0].is_valid = false;
+		_num_changed_samplers = std::max(_num_changed_samplers, 1u);
 
-			_vertices += 3;
-			_drawcalls += 1;
+		const float texelsize[4] = { -1.0f / _width, 1.0f / _height };
+		_device->SetVertexShaderConstantF(255, texelsize, 1);
 
-			// Update shader resources
-			for (const auto target : pass.render_targets)
-			{
-				if (target == nullptr || target == _backbuffer_resolved)
-				{
-					continue;
-				}
+		_device->DrawPrimitive(D3DPT_TRIANGLELIST, 0, 1);
 
-				com_ptr<IDirect3DBaseTexture9> texture;
+		_vertices += 3;
+		_drawcalls += 1;
+	}
+	void d3d9_runtime::update_backbuffer_mipmaps(IDirect3DSurface9 *source)
+	{
+		_is_backbuffer_mipmaps_outdated = false;
 
-				if (SUCCEEDED(target->GetContainer(IID_PPV_ARGS(&texture))) && texture->GetLevelCount() > 1)
-				{
-					texture->SetAutoGenFilterType(D3DTEXF_LINEAR);
-					texture->GenerateMipSubLevels();
-				}
-			}
+		if (_backbuffer_mipmap_surface == nullptr)
+		{
+			return;
 		}
+
+		_device->StretchRect(source, nullptr, _backbuffer_mipmap_surface.get(), nullptr, D3DTEXF_NONE);
+
+		_backbuffer_mipmap_texture->GenerateMipSubLevels();
 	}
+
 	void d3d9_runtime::render_imgui_draw_data(ImDrawData *draw_data)
 	{
 		// Fixed-function vertex layout
@@ -802,12 +3144,13 @@ namespace reshade::d3d9
 			float u, v;
 		};
 
-		// Create and grow buffers if needed
+		// Create and grow buffers if needed, with room for a few frames so they are only discarded every couple of frames when the ring below wraps around
 		if (_imgui_vertex_buffer == nullptr ||
 			_imgui_vertex_buffer_size < draw_data->TotalVtxCount)
 		{
 			_imgui_vertex_buffer.reset();
-			_imgui_vertex_buffer_size = draw_data->TotalVtxCount + 5000;
+			_imgui_vertex_buffer_size = draw_data->TotalVtxCount * 3 + 5000;
+			_imgui_vertex_buffer_offset = 0;
 
 			if (FAILED(_device->CreateVertexBuffer(_imgui_vertex_buffer_size * sizeof(vertex), D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, D3DFVF_XYZ | D3DFVF_DIFFUSE | D3DFVF_TEX1, D3DPOOL_DEFAULT, &_imgui_vertex_buffer, nullptr)))
 			{
@@ -818,7 +3161,8 @@ namespace reshade::d3d9
 			_imgui_index_buffer_size < draw_data->TotalIdxCount)
 		{
 			_imgui_index_buffer.reset();
-			_imgui_index_buffer_size = draw_data->TotalIdxCount + 10000;
+			_imgui_index_buffer_size = draw_data->TotalIdxCount * 3 + 10000;
+			_imgui_index_buffer_offset = 0;
 
 			if (FAILED(_device->CreateIndexBuffer(_imgui_index_buffer_size * sizeof(ImDrawIdx), D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, sizeof(ImDrawIdx) == 2 ? D3DFMT_INDEX16 : D3DFMT_INDEX32, D3DPOOL_DEFAULT, &_imgui_index_buffer, nullptr)))
 			{
@@ -826,12 +3170,27 @@ namespace reshade::d3d9
 			}
 		}
 
+		// Append behind the data of previous frames, which the GPU may still read from, and only start over at the beginning with a discard once that no longer fits
+		DWORD lock_flags = D3DLOCK_NOOVERWRITE;
+
+		if (_imgui_vertex_buffer_offset + draw_data->TotalVtxCount > _imgui_vertex_buffer_size ||
+			_imgui_index_buffer_offset + draw_data->TotalIdxCount > _imgui_index_buffer_size)
+		{
+			lock_flags = D3DLOCK_DISCARD;
+			_imgui_vertex_buffer_offset = 0;
+			_imgui_index_buffer_offset = 0;
+		}
+
 		vertex *vtx_dst;
 		ImDrawIdx *idx_dst;
 
-		if (FAILED(_imgui_vertex_buffer->Lock(0, draw_data->TotalVtxCount * sizeof(vertex), reinterpret_cast<void **>(&vtx_dst), D3DLOCK_DISCARD)) ||
-			FAILED(_imgui_index_buffer->Lock(0, draw_data->TotalIdxCount * sizeof(ImDrawIdx), reinterpret_cast<void **>(&idx_dst), D3DLOCK_DISCARD)))
+		if (FAILED(_imgui_vertex_buffer->Lock(_imgui_vertex_buffer_offset * sizeof(vertex), draw_data->TotalVtxCount * sizeof(vertex), reinterpret_cast<void **>(&vtx_dst), lock_flags)))
+		{
+			return;
+		}
+		if (FAILED(_imgui_index_buffer->Lock(_imgui_index_buffer_offset * sizeof(ImDrawIdx), draw_data->TotalIdxCount * sizeof(ImDrawIdx), reinterpret_cast<void **>(&idx_dst), lock_flags)))
 		{
+			_imgui_vertex_buffer->Unlock();
 			return;
 		}
 
@@ -871,8 +3230,18 @@ namespace reshade::d3d9
 		_device->SetIndices(_imgui_index_buffer.get());
 		_imgui_state->Apply();
 
-		// Render command lists
-		UINT vtx_offset = 0, idx_offset = 0;
+		// Render command lists, starting at where this frame was written to the buffers
+		UINT vtx_offset = _imgui_vertex_buffer_offset, idx_offset = _imgui_index_buffer_offset;
+
+		_imgui_vertex_buffer_offset += draw_data->TotalVtxCount;
+		_imgui_index_buffer_offset += draw_data->TotalIdxCount;
+
+		_num_changed_samplers = _num_samplers;
+
+		for (auto &applied : _applied_samplers)
+		{
+			applied.is_valid = false;
+		}
 
 		for (UINT i = 0; i < _num_samplers; i++)
 			_device->SetTexture(i, nullptr);
@@ -912,6 +3281,24 @@ namespace reshade::d3d9
 				_depthstencil = nullptr;
 			}
 
+			if (ImGui::Checkbox("Skip detection while no effect uses the depth buffer", &_skip_unused_depth_detection))
+			{
+				runtime::save_config();
+			}
+
+			if (ImGui::Checkbox("Lock onto the depth buffer once detection settled", &_lock_depth_detection))
+			{
+				runtime::save_config();
+
+				_is_depth_source_locked = false;
+				_depth_source_stable_frames = 0;
+			}
+
+			if (_is_depth_source_locked)
+			{
+				ImGui::TextUnformatted("Locked, checking again in a few seconds");
+			}
+
 			for (const auto &it : _depth_source_table)
 			{
 				ImGui::Text("%s0x%p | %u draw calls ==> %u vertices", (it.first == _depthstencil ? "> " : "  "), it.first, it.second.drawcall_count, it.second.vertices_count);
@@ -919,8 +3306,37 @@ namespace reshade::d3d9
 		}
 	}
 
+	// Frames the same depth buffer has to win in a row before detection locks onto it, and frames until a locked one is checked again
+	static const unsigned int s_depth_detection_settle_frames = 30;
+	static const unsigned int s_depth_detection_validation_interval = 300;
+
 	void d3d9_runtime::detect_depth_source()
 	{
+		// Effects may have been reloaded since the last frame
+		const bool is_depth_used = !_skip_unused_depth_detection || std::any_of(_textures.begin(), _textures.end(),
+			[](const texture &texture) { return texture.impl_reference == texture_reference::depth_buffer || texture.impl_reference == texture_reference::linear_depth_buffer; });
+
+		if (!is_depth_used)
+		{
+			_is_depth_detection_active = false;
+			_is_depth_source_locked = false;
+			_depth_source_stable_frames = 0;
+			_current_depth_source = nullptr;
+			return;
+		}
+
+		// Nothing was counted while locked, so there is nothing to score until the next check is due, which counts draw calls for one frame
+		if (_is_depth_source_locked && !_is_depth_detection_active)
+		{
+			if (--_depth_source_validation_countdown == 0)
+			{
+				_is_depth_detection_active = true;
+			}
+			return;
+		}
+
+		_is_depth_detection_active = true;
+
 		if (_is_multisampling_enabled || _depth_source_table.empty())
 		{
 			return;
@@ -936,6 +3352,11 @@ namespace reshade::d3d9
 
 			if ((depthstencil->AddRef(), depthstencil->Release()) == 1)
 			{
+				if (&depthstencil_info == _current_depth_source)
+				{
+					_current_depth_source = nullptr;
+				}
+
 				depthstencil->Release();
 
 				it = _depth_source_table.erase(it);
@@ -960,10 +3381,108 @@ namespace reshade::d3d9
 			depthstencil_info.drawcall_count = depthstencil_info.vertices_count = 0;
 		}
 
-		if (best_match != nullptr && _depthstencil != best_match)
+		if (best_match == nullptr)
+		{
+			return;
+		}
+
+		if (_depthstencil != best_match)
 		{
+			// A different winner after a map change or when a check found one, so detection runs every frame again until it settles
+			_is_depth_source_locked = false;
+			_depth_source_stable_frames = 0;
+
 			create_depthstencil_replacement(best_match);
 		}
+		else if (_lock_depth_detection && (_is_depth_source_locked || ++_depth_source_stable_frames >= s_depth_detection_settle_frames))
+		{
+			_is_depth_source_locked = true;
+			_is_depth_detection_active = false;
+			_depth_source_validation_countdown = s_depth_detection_validation_interval;
+
+			// Stop counting right away, not only once the game binds another depth stencil
+			_current_depth_source = nullptr;
+		}
+	}
+
+	void d3d9_runtime::evaluate_timestamp_queries()
+	{
+		for (technique &technique : _techniques)
+		{
+			d3d9_technique_data &technique_data = *technique.impl->as<d3d9_technique_data>();
+
+			// Consume results in issue order, stopping at the first one the GPU has not finished yet (never flush here)
+			while (technique_data.queries[technique_data.query_read_index].in_flight)
+			{
+				d3d9_technique_data::timestamp_queries &queries = technique_data.queries[technique_data.query_read_index];
+
+				BOOL disjoint;
+				UINT64 frequency, timestamp0, timestamp1;
+
+				if (queries.timestamp_disjoint->GetData(&disjoint, sizeof(disjoint), 0) != S_OK ||
+					queries.timestamp_frequency->GetData(&frequency, sizeof(frequency), 0) != S_OK ||
+					queries.timestamp_query_beg->GetData(&timestamp0, sizeof(timestamp0), 0) != S_OK ||
+					queries.timestamp_query_end->GetData(&timestamp1, sizeof(timestamp1), 0) != S_OK)
+				{
+					break;
+				}
+
+				if (technique.enabled && !disjoint && frequency != 0)
+				{
+					const uint64_t duration = (timestamp1 - timestamp0) * 1'000'000'000 / frequency;
+
+					if (queries.fused_techniques.empty())
+					{
+						if (technique.timings != nullptr)
+						{
+							technique.timings->average_gpu_duration.append(duration);
+							technique.timings->gpu_duration_samples.append(duration * 1e-6f);
+						}
+					}
+					else
+					{
+						// Fused techniques share the time it took to render them, like they do on the CPU, so the budget and statistics of all of them stay current
+						const uint64_t fused_duration = duration / queries.fused_techniques.size();
+
+						for (const d3d9_technique_data *const fused_technique_data : queries.fused_techniques)
+						{
+							// Techniques that were reloaded since are not found anymore
+							const auto fused_technique = std::find_if(_techniques.begin(), _techniques.end(), [fused_technique_data](const reshade::technique &technique) { return technique.impl.get() == fused_technique_data; });
+
+							if (fused_technique != _techniques.end() && fused_technique->timings != nullptr)
+							{
+								fused_technique->timings->average_gpu_duration.append(fused_duration);
+								fused_technique->timings->gpu_duration_samples.append(fused_duration * 1e-6f);
+							}
+						}
+					}
+
+					// The passes finished before the end of the technique, so their timestamps are available too, unless a query could not be created for every one of them (a fused pass issues none)
+					if (_gpu_pass_timing && queries.fused_techniques.empty() && queries.pass_query_count == technique.passes.size())
+					{
+						UINT64 previous_timestamp = timestamp0;
+
+						for (size_t pass_index = 0; pass_index < queries.pass_query_count; pass_index++)
+						{
+							UINT64 timestamp;
+
+							if (queries.timestamp_query_passes[pass_index]->GetData(&timestamp, sizeof(timestamp), 0) != S_OK)
+							{
+								break;
+							}
+
+							append_pass_gpu_duration(technique, pass_index, technique.passes[pass_index]->as<d3d9_pass_data>()->name, (timestamp - previous_timestamp) * 1'000'000'000 / frequency);
+
+							previous_timestamp = timestamp;
+						}
+					}
+				}
+
+				queries.in_flight = false;
+
+				technique_data.query_read_index = (technique_data.query_read_index + 1) % _countof(technique_data.queries);
+			}
+		}
 	}
 
 	bool d3d9_runtime::create_depthstencil_replacement(IDirect3DSurface9 *depthstencil)
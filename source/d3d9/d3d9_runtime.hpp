@@ -6,8 +6,11 @@
 #pragma once
 
 #include <d3d9.h>
+#include <d3dcommon.h>
 #include "runtime.hpp"
 #include "com_ptr.hpp"
+#include "state_object_cache.hpp"
+#include "d3d9_state_tracker.hpp"
 
 namespace reshade::d3d9
 {
@@ -21,25 +24,109 @@ namespace reshade::d3d9
 	{
 		com_ptr<IDirect3DTexture9> texture;
 		com_ptr<IDirect3DSurface9> surface;
+		// Creation parameters, so the texture can be recreated after a device reset
+		UINT levels = 0;
+		DWORD usage = 0;
+		D3DFORMAT format = D3DFMT_UNKNOWN;
+		// Set when the texture shares its allocation with other render targets whose lifetimes within a frame do not overlap
+		bool is_aliased = false;
+		// Set when a pass rendered to the texture since its mipmaps were last generated
+		bool is_mipmap_outdated = false;
+		// Set when the texture uses the same allocation as other textures that were loaded from the same image file
+		bool is_shared = false;
 	};
 	struct d3d9_pass_data : base_object
 	{
+		// Name of the pass in the effect, or its index for passes without one
+		std::string name;
 		com_ptr<IDirect3DVertexShader9> vertex_shader;
 		com_ptr<IDirect3DPixelShader9> pixel_shader;
+		// HLSL sources of the pass shaders, kept so a technique that was unloaded can be compiled again
+		std::string vertex_shader_source, pixel_shader_source;
+		// Compiled on an effect compile worker, until the shaders are created from it on the render thread
+		std::vector<char> vertex_shader_bytecode, pixel_shader_bytecode;
 		d3d9_sampler samplers[16] = { };
 		DWORD sampler_count = 0;
 		com_ptr<IDirect3DStateBlock9> stateblock;
+		// Render states recorded into the stateblock, kept around to record it again after a device reset
+		// The stateblock does not include the shaders, so it is shared with all passes that have the same render states
+		std::vector<std::pair<D3DRENDERSTATETYPE, DWORD>> render_states;
 		bool clear_render_targets = false;
+		bool samples_backbuffer = false, writes_backbuffer = false;
+		bool samples_linear_depth = false, samples_backbuffer_mipmaps = false;
+		// Whether the pixel shader may discard pixels, which leaves the previous contents of the render targets where it does
+		bool discards_pixels = false;
 		IDirect3DSurface9 *render_targets[8] = { };
+		d3d9_tex_data *render_target_textures[8] = { };
+	};
+	struct d3d9_fusion_fragment
+	{
+		struct uniform_declaration
+		{
+			// Type and name, without the register
+			std::string declaration;
+			UINT register_index;
+		};
+		struct sampler_declaration
+		{
+			std::string name, pixelsize;
+			d3d9_sampler sampler;
+			bool is_backbuffer;
+		};
+
+		// Global identifiers the code declares, which are renamed in a fused shader, since fragments of different effects may use the same ones
+		std::vector<std::string> identifiers;
+		// Uniforms and samplers the pixel shader uses, which are declared with the registers they get in the fused shader
+		std::vector<uniform_declaration> uniforms;
+		std::vector<sampler_declaration> samplers;
+		// Structs, global variables and functions the pixel shader needs, apart from the pixel shader function itself
+		std::string code;
+		// The pixel shader function, and the same function written to take the result of a previous fragment as an additional '__fused_color' argument in place of sampling the back buffer
+		std::string entry_point, entry_point_code, fused_entry_point_code;
+		// Parameter list of the pixel shader, the names of the parameters to call it with, and their types and semantics alone, which have to match between fused fragments
+		std::string parameters, arguments, signature;
+		bool reads_backbuffer_pointwise = false;
+	};
+	struct d3d9_technique_data : base_object
+	{
+		struct timestamp_queries
+		{
+			bool in_flight = false;
+			com_ptr<IDirect3DQuery9> timestamp_disjoint;
+			com_ptr<IDirect3DQuery9> timestamp_frequency;
+			com_ptr<IDirect3DQuery9> timestamp_query_beg;
+			com_ptr<IDirect3DQuery9> timestamp_query_end;
+			// Issued at the end of every pass while passes are timed, created the first time they are needed
+			std::vector<com_ptr<IDirect3DQuery9>> timestamp_query_passes;
+			size_t pass_query_count = 0;
+			// The techniques measured together with this one, which share the time, when it was rendered as the first of a fused pass
+			std::vector<const d3d9_technique_data *> fused_techniques;
+		};
+
+		// Ring of query sets, so results can be read back a few frames late without stalling
+		timestamp_queries queries[4];
+		unsigned int query_read_index = 0, query_write_index = 0;
+
+		// Techniques the loaded preset does not enable are only compiled the first time they are enabled
+		bool is_compiled = false;
+		bool skip_shader_optimization = false;
+		// Set when the bytecode of the passes is unoptimized, so optimized shaders are compiled in the background once the shaders were created
+		bool is_optimization_pending = false;
+		// Cleared when no vertex shader of the technique reads a uniform, which is the case for most, so only the pixel shader constants have to be uploaded
+		bool vertex_shaders_use_uniforms = true;
+		// Set for single pass techniques that replace the back buffer, so they can be fused with the techniques rendered right before and after them
+		std::unique_ptr<d3d9_fusion_fragment> fusion;
 	};
 
 	class d3d9_runtime : public runtime
 	{
 	public:
 		d3d9_runtime(IDirect3DDevice9 *device, IDirect3DSwapChain9 *swapchain);
+		~d3d9_runtime();
 
 		bool on_init(const D3DPRESENT_PARAMETERS &pp);
 		void on_reset();
+		void on_reset_effect() override;
 		void on_present();
 		void on_draw_call(D3DPRIMITIVETYPE type, UINT count);
 		void on_set_depthstencil_surface(IDirect3DSurface9 *&depthstencil);
@@ -47,11 +134,37 @@ namespace reshade::d3d9
 
 		void apply_effects(IDirect3DSurface9* surface);
 		void capture_frame(uint8_t *buffer) const override;
-		bool load_effect(const reshadefx::syntax_tree &ast, std::string &errors) override;
+		bool begin_frame_capture(unsigned int slot) override;
+		bool finish_frame_capture(unsigned int slot, uint8_t *buffer, bool wait) override;
+		std::unique_ptr<base_object> compile_effect(const reshadefx::syntax_tree &ast, std::string &errors, bool half_precision) override;
+		bool load_effect(base_object &module) override;
 		bool update_texture(texture &texture, const uint8_t *data) override;
+		bool update_texture_compressed(texture &texture, const uint8_t *data, unsigned int levels) override;
+		bool supports_texture_scaling(const texture &texture) const override;
+		bool update_texture_scaled(texture &texture, const uint8_t *data, unsigned int width, unsigned int height) override;
+		bool share_texture(texture &texture, const texture &source) override;
 		bool update_texture_reference(texture &texture, texture_reference id);
+		bool release_effect_resources() override;
+		bool restore_effect_resources() override;
+		HRESULT create_pass_stateblock(d3d9_pass_data &pass);
+		bool compile_technique(technique &technique, std::string &errors);
+		/// <summary>
+		/// Compile the pass shaders of a technique to bytecode. This does not touch the device, so it can run on a compile worker thread.
+		/// </summary>
+		bool compile_technique_shaders(technique &technique, std::string &errors);
+		/// <summary>
+		/// Create the pass shaders and stateblocks of a technique from the bytecode <see cref="compile_technique_shaders"/> produced.
+		/// </summary>
+		bool create_technique_shaders(technique &technique, std::string &errors);
+		bool load_technique(technique &technique) override;
+		void unload_technique(technique &technique) override;
+		size_t texture_memory_usage(const texture &texture) const override;
+		void technique_memory_usage(const technique &technique, size_t &gpu_size, size_t &cpu_size) const override;
+		void on_techniques_reordered() override;
+		bool update_texture_allocations();
 
 		void render_technique(const technique &technique) override;
+		size_t render_fused_techniques(const technique *const *techniques, size_t count) override;
 		void render_imgui_draw_data(ImDrawData *data) override;
 
 		com_ptr<IDirect3D9> _d3d;
@@ -64,34 +177,129 @@ namespace reshade::d3d9
 		com_ptr<IDirect3DSurface9> _backbuffer_texture_surface;
 		com_ptr<IDirect3DTexture9> _depthstencil_texture;
 
+		// Shadow copy of the application state kept by the device proxy, state blocks are used instead while it is not available
+		const d3d9_state_tracker *_state_tracker = nullptr;
+
 	private:
 		struct depth_source_info
 		{
 			UINT width, height;
 			UINT drawcall_count, vertices_count;
 		};
+		struct applied_sampler
+		{
+			bool is_valid;
+			IDirect3DTexture9 *texture;
+			DWORD states[12];
+		};
+		struct screenshot_slot
+		{
+			com_ptr<IDirect3DSurface9> copy;
+			com_ptr<IDirect3DSurface9> readback;
+			com_ptr<IDirect3DQuery9> copy_finished;
+		};
+		struct shader_optimization_job
+		{
+			std::string technique_name;
+			const d3d9_technique_data *technique;
+			// Vertex and pixel shader source of each pass, in pass order
+			std::vector<std::string> sources;
+			std::vector<std::vector<char>> bytecode;
+			std::string errors;
+			bool success = false;
+		};
+		struct fused_pass
+		{
+			// The techniques the pass renders at once, in order
+			std::vector<const d3d9_technique_data *> techniques;
+			// First constant register of the uniforms of each technique in the fused shader
+			std::vector<UINT> uniform_registers;
+			// Empty if the fused shader failed to compile, so the techniques are rendered one after another without trying again
+			std::unique_ptr<d3d9_pass_data> pass;
+		};
+		struct saved_app_state
+		{
+			bool is_tracked;
+			BOOL software_rendering_enabled;
+			D3DVIEWPORT9 viewport;
+			com_ptr<IDirect3DSurface9> rendertargets[8], depthstencil;
+		};
 
 		bool init_backbuffer_texture();
 		bool init_default_depth_stencil();
 		bool init_fx_resources();
 		bool init_imgui_font_atlas();
+		bool init_linear_depth_texture();
+		bool init_backbuffer_mipmap_texture();
+
+		bool load_d3dcompiler(std::string &errors);
+		bool compile_shader(const std::string &source, const std::string &profile, const D3D_SHADER_MACRO *defines, UINT flags, std::vector<char> &bytecode, std::string &errors);
+		void queue_shader_optimization(const technique &technique);
+		void optimization_worker_loop();
+		void apply_optimized_shaders();
+		fused_pass create_fused_pass(const technique *const *techniques, size_t count);
+		bool begin_timestamp_queries(d3d9_technique_data &technique_data);
+		void end_timestamp_queries(d3d9_technique_data &technique_data);
+		void issue_pass_timestamp_query(d3d9_technique_data &technique_data);
+		void render_pass(const d3d9_pass_data &pass, IDirect3DSurface9 *effect_target, bool &is_default_depthstencil_cleared);
+		void update_linear_depth();
+		bool save_replay_frame(IDirect3DSurface9 *source);
+		bool read_depth_data(std::vector<float> &data);
+		void run_replay_benchmark();
+		void update_backbuffer_mipmaps(IDirect3DSurface9 *source);
 
 		void draw_debug_menu();
 
+		bool read_render_target_data(IDirect3DSurface9 *source, IDirect3DSurface9 *readback, uint8_t *buffer) const;
+
+		void capture_app_state(saved_app_state &state);
+		void apply_app_state(const saved_app_state &state);
+
+		bool can_render_effects_to(IDirect3DSurface9 *surface) const;
 		void detect_depth_source();
+		void evaluate_timestamp_queries();
 		bool create_depthstencil_replacement(IDirect3DSurface9 *depthstencil);
 
+		HMODULE _d3dcompiler_module = nullptr;
+		// The compile workers and the optimization worker load the library as well
+		std::mutex _d3dcompiler_mutex;
 		UINT _behavior_flags;
 		UINT _num_samplers;
 		UINT _num_simultaneous_rendertargets;
 		bool _disable_intz = false;
+		bool _skip_unused_depth_detection = true;
+		bool _is_depth_detection_active = true;
+		// Draw calls are only counted until the same depth buffer won for a while, afterwards detection is locked onto it and only checks it again every now and then
+		bool _lock_depth_detection = true;
+		bool _is_depth_source_locked = false;
+		unsigned int _depth_source_stable_frames = 0, _depth_source_validation_countdown = 0;
 		bool _is_multisampling_enabled = false;
 		D3DFORMAT _backbuffer_format = D3DFMT_UNKNOWN;
 		com_ptr<IDirect3DStateBlock9> _app_state;
+		// Stateblocks of all passes keyed by their render states, which only have to be released for a device reset
+		state_object_cache<IDirect3DStateBlock9> _pass_stateblock_cache;
 		com_ptr<IDirect3DSurface9> _depthstencil;
 		com_ptr<IDirect3DSurface9> _depthstencil_replacement;
 		com_ptr<IDirect3DSurface9> _default_depthstencil;
+		IDirect3DSurface9 *_effect_target = nullptr;
+		bool _is_backbuffer_texture_outdated = true;
+		UINT _num_changed_samplers = 0, _num_changed_constants = 0;
+		ptrdiff_t _uploaded_uniform_storage_offset = -1, _uploaded_vertex_uniform_storage_offset = -1;
+		UINT _uploaded_uniform_register_count = 0, _uploaded_vertex_uniform_register_count = 0;
+		applied_sampler _applied_samplers[16] = { };
 		std::unordered_map<IDirect3DSurface9 *, depth_source_info> _depth_source_table;
+		depth_source_info *_current_depth_source = nullptr;
+
+		// Shared textures behind the 'LINEAR_DEPTH' and 'COLOR_MIPMAPS' semantics, created the first time an effect uses them
+		com_ptr<IDirect3DTexture9> _linear_depth_texture;
+		com_ptr<IDirect3DSurface9> _linear_depth_surface;
+		com_ptr<IDirect3DVertexShader9> _linear_depth_vertex_shader;
+		com_ptr<IDirect3DPixelShader9> _linear_depth_pixel_shader;
+		com_ptr<IDirect3DStateBlock9> _linear_depth_state;
+		com_ptr<IDirect3DTexture9> _backbuffer_mipmap_texture;
+		com_ptr<IDirect3DSurface9> _backbuffer_mipmap_surface;
+		bool _is_linear_depth_outdated = true;
+		bool _is_backbuffer_mipmaps_outdated = true;
 
 		com_ptr<IDirect3DVertexBuffer9> _effect_triangle_buffer;
 		com_ptr<IDirect3DVertexDeclaration9> _effect_triangle_layout;
@@ -100,5 +308,33 @@ namespace reshade::d3d9
 		com_ptr<IDirect3DVertexBuffer9> _imgui_vertex_buffer;
 		com_ptr<IDirect3DIndexBuffer9> _imgui_index_buffer;
 		int _imgui_vertex_buffer_size = 0, _imgui_index_buffer_size = 0;
+		// Where the next frame is written to in the vertex/index buffers, which are filled like a ring
+		int _imgui_vertex_buffer_offset = 0, _imgui_index_buffer_offset = 0;
+
+		// Techniques are first compiled without optimization so they can be used right away, a worker thread then compiles the optimized shaders that replace them once finished
+		std::deque<std::unique_ptr<shader_optimization_job>> _optimization_jobs, _optimization_results;
+		std::thread _optimization_worker;
+		std::mutex _optimization_mutex;
+		std::condition_variable _optimization_signal;
+		bool _optimization_worker_exit = false;
+
+		// Passes that render several single pass techniques which follow each other at once, see 'render_fused_techniques'
+		std::vector<fused_pass> _fused_passes;
+
+		// Set while the replay benchmark renders, so every pass issues a timestamp query from the list
+		bool _is_replaying = false;
+		std::vector<com_ptr<IDirect3DQuery9>> _replay_pass_queries;
+		size_t _replay_pass_query_index = 0;
+
+		// Event queries of the last '_max_frame_latency' frames, which limit how far the CPU runs ahead on devices without 'IDirect3DDevice9Ex::SetMaximumFrameLatency'
+		std::vector<com_ptr<IDirect3DQuery9>> _frame_latency_queries;
+		// Number of frames an event query was issued for since they were created
+		size_t _frame_latency_index = 0;
+		com_ptr<IDirect3DVertexShader9> _depth_copy_vertex_shader;
+		com_ptr<IDirect3DPixelShader9> _depth_copy_pixel_shader;
+		com_ptr<IDirect3DStateBlock9> _depth_copy_state;
+
+		// Copies of the back buffer waiting to be read back for a screenshot, so the readback does not stall on the current frame
+		screenshot_slot _screenshot_slots[MAX_PENDING_SCREENSHOTS];
 	};
 }
@@ -0,0 +1,336 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "log.hpp"
+#include "d3d9_state_tracker.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace reshade::d3d9
+{
+	// Render states changed by effect pass state blocks (see 'd3d9_effect_compiler::visit_pass') and the overlay state block, keep in sync with those
+	static const D3DRENDERSTATETYPE s_render_states[] = {
+		D3DRS_ZENABLE, D3DRS_SPECULARENABLE, D3DRS_FILLMODE, D3DRS_SHADEMODE, D3DRS_ZWRITEENABLE, D3DRS_ALPHATESTENABLE, D3DRS_LASTPIXEL,
+		D3DRS_SRCBLEND, D3DRS_DESTBLEND, D3DRS_ALPHAREF, D3DRS_ALPHAFUNC, D3DRS_DITHERENABLE, D3DRS_FOGSTART, D3DRS_FOGEND, D3DRS_FOGDENSITY,
+		D3DRS_ALPHABLENDENABLE, D3DRS_DEPTHBIAS, D3DRS_STENCILENABLE, D3DRS_STENCILPASS, D3DRS_STENCILFAIL, D3DRS_STENCILZFAIL, D3DRS_STENCILFUNC,
+		D3DRS_STENCILREF, D3DRS_STENCILMASK, D3DRS_STENCILWRITEMASK, D3DRS_TEXTUREFACTOR, D3DRS_LOCALVIEWER, D3DRS_EMISSIVEMATERIALSOURCE,
+		D3DRS_AMBIENTMATERIALSOURCE, D3DRS_DIFFUSEMATERIALSOURCE, D3DRS_SPECULARMATERIALSOURCE, D3DRS_COLORWRITEENABLE, D3DRS_BLENDOP,
+		D3DRS_SCISSORTESTENABLE, D3DRS_SLOPESCALEDEPTHBIAS, D3DRS_ANTIALIASEDLINEENABLE, D3DRS_TWOSIDEDSTENCILMODE, D3DRS_CCW_STENCILFAIL,
+		D3DRS_CCW_STENCILZFAIL, D3DRS_CCW_STENCILPASS, D3DRS_CCW_STENCILFUNC, D3DRS_COLORWRITEENABLE1, D3DRS_COLORWRITEENABLE2, D3DRS_COLORWRITEENABLE3,
+		D3DRS_BLENDFACTOR, D3DRS_SRGBWRITEENABLE, D3DRS_SEPARATEALPHABLENDENABLE, D3DRS_SRCBLENDALPHA, D3DRS_DESTBLENDALPHA, D3DRS_BLENDOPALPHA,
+		D3DRS_FOGENABLE, D3DRS_CULLMODE, D3DRS_LIGHTING, D3DRS_CLIPPING
+	};
+	// Transforms and texture stage states of the first stage changed by the overlay state block
+	static const D3DTRANSFORMSTATETYPE s_transforms[] = { D3DTS_WORLD, D3DTS_VIEW, D3DTS_PROJECTION };
+	static const D3DTEXTURESTAGESTATETYPE s_texture_stage_states[] = { D3DTSS_COLOROP, D3DTSS_COLORARG1, D3DTSS_COLORARG2, D3DTSS_ALPHAOP, D3DTSS_ALPHAARG1, D3DTSS_ALPHAARG2 };
+
+	bool d3d9_state_tracker::sync(IDirect3DDevice9 *device)
+	{
+		release();
+
+		if (_is_disabled)
+		{
+			return false;
+		}
+
+		D3DDEVICE_CREATION_PARAMETERS cp;
+		device->GetCreationParameters(&cp);
+
+		if ((cp.BehaviorFlags & D3DCREATE_PUREDEVICE) != 0)
+		{
+			LOG(INFO) << "Device is a pure device, falling back to state blocks to save and restore application state.";
+
+			_is_disabled = true;
+			return false;
+		}
+
+		D3DCAPS9 caps;
+		device->GetDeviceCaps(&caps);
+
+		_num_render_targets = std::min(static_cast<UINT>(caps.NumSimultaneousRTs), MAX_RENDER_TARGETS);
+
+		for (const auto state : s_render_states)
+		{
+			device->GetRenderState(state, &_render_states[state]);
+		}
+
+		for (DWORD sampler = 0; sampler < MAX_SAMPLERS; sampler++)
+		{
+			device->GetTexture(sampler, &_textures[sampler]);
+
+			for (DWORD state = D3DSAMP_ADDRESSU; state < SAMPLER_STATE_COUNT; state++)
+			{
+				device->GetSamplerState(sampler, static_cast<D3DSAMPLERSTATETYPE>(state), &_sampler_states[sampler][state]);
+			}
+		}
+
+		for (const auto state : s_texture_stage_states)
+		{
+			device->GetTextureStageState(0, state, &_texture_stage_states[state]);
+		}
+
+		for (UINT i = 0; i < ARRAYSIZE(s_transforms); i++)
+		{
+			device->GetTransform(s_transforms[i], &_transforms[i]);
+		}
+
+		for (DWORD target = 0; target < _num_render_targets; target++)
+		{
+			device->GetRenderTarget(target, &_render_targets[target]);
+		}
+
+		device->GetDepthStencilSurface(&_depth_stencil);
+
+		_is_viewport_set = SUCCEEDED(device->GetViewport(&_viewport));
+		_is_scissor_rect_set = SUCCEEDED(device->GetScissorRect(&_scissor_rect));
+
+		device->GetVertexShader(&_vertex_shader);
+		device->GetPixelShader(&_pixel_shader);
+		device->GetVertexShaderConstantF(0, _vs_constants[0], MAX_VS_CONSTANTS);
+		device->GetPixelShaderConstantF(0, _ps_constants[0], MAX_PS_CONSTANTS);
+
+		device->GetFVF(&_fvf);
+		device->GetVertexDeclaration(&_vertex_declaration);
+		_is_fvf = _fvf != 0;
+
+		device->GetStreamSource(0, &_stream_source, &_stream_offset, &_stream_stride);
+		device->GetIndices(&_indices);
+
+		_is_synced = true;
+
+		return true;
+	}
+	void d3d9_state_tracker::release()
+	{
+		_is_synced = false;
+
+		for (auto &texture : _textures)
+		{
+			texture.reset();
+		}
+		for (auto &target : _render_targets)
+		{
+			target.reset();
+		}
+
+		_depth_stencil.reset();
+		_vertex_shader.reset();
+		_pixel_shader.reset();
+		_vertex_declaration.reset();
+		_stream_source.reset();
+		_indices.reset();
+	}
+	void d3d9_state_tracker::disable()
+	{
+		if (!_is_disabled)
+		{
+			LOG(INFO) << "Application uses state blocks, falling back to state blocks to save and restore application state.";
+		}
+
+		release();
+
+		_is_disabled = true;
+	}
+
+	void d3d9_state_tracker::apply(IDirect3DDevice9 *device, UINT num_samplers, UINT num_constants) const
+	{
+		assert(is_valid());
+
+		// Render targets go first, since setting them resets viewport and scissor rectangle
+		for (DWORD target = 0; target < _num_render_targets; target++)
+		{
+			device->SetRenderTarget(target, _render_targets[target].get());
+		}
+
+		device->SetDepthStencilSurface(_depth_stencil.get());
+
+		if (_is_viewport_set)
+		{
+			device->SetViewport(&_viewport);
+		}
+		if (_is_scissor_rect_set)
+		{
+			device->SetScissorRect(&_scissor_rect);
+		}
+
+		device->SetVertexShader(_vertex_shader.get());
+		device->SetPixelShader(_pixel_shader.get());
+
+		if (_is_fvf)
+		{
+			device->SetFVF(_fvf);
+		}
+		else
+		{
+			device->SetVertexDeclaration(_vertex_declaration.get());
+		}
+
+		device->SetStreamSource(0, _stream_source.get(), _stream_offset, _stream_stride);
+		device->SetIndices(_indices.get());
+
+		for (DWORD sampler = 0; sampler < std::min(num_samplers, MAX_SAMPLERS); sampler++)
+		{
+			device->SetTexture(sampler, _textures[sampler].get());
+
+			for (DWORD state = D3DSAMP_ADDRESSU; state <= D3DSAMP_SRGBTEXTURE; state++)
+			{
+				device->SetSamplerState(sampler, static_cast<D3DSAMPLERSTATETYPE>(state), _sampler_states[sampler][state]);
+			}
+		}
+
+		for (const auto state : s_render_states)
+		{
+			device->SetRenderState(state, _render_states[state]);
+		}
+
+		for (const auto state : s_texture_stage_states)
+		{
+			device->SetTextureStageState(0, state, _texture_stage_states[state]);
+		}
+
+		for (UINT i = 0; i < ARRAYSIZE(s_transforms); i++)
+		{
+			device->SetTransform(s_transforms[i], &_transforms[i]);
+		}
+
+		// Effects use the last vertex shader constant register for the pixel size
+		if (num_constants != 0)
+		{
+			device->SetVertexShaderConstantF(0, _vs_constants[0], std::min(num_constants, MAX_VS_CONSTANTS));
+			device->SetPixelShaderConstantF(0, _ps_constants[0], std::min(num_constants, MAX_PS_CONSTANTS));
+		}
+
+		device->SetVertexShaderConstantF(MAX_VS_CONSTANTS - 1, _vs_constants[MAX_VS_CONSTANTS - 1], 1);
+	}
+
+	void d3d9_state_tracker::set_render_state(D3DRENDERSTATETYPE state, DWORD value)
+	{
+		if (state < RENDER_STATE_COUNT)
+		{
+			_render_states[state] = value;
+		}
+	}
+	void d3d9_state_tracker::set_sampler_state(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value)
+	{
+		if (sampler < MAX_SAMPLERS && type < SAMPLER_STATE_COUNT)
+		{
+			_sampler_states[sampler][type] = value;
+		}
+	}
+	void d3d9_state_tracker::set_texture_stage_state(DWORD stage, D3DTEXTURESTAGESTATETYPE type, DWORD value)
+	{
+		if (stage == 0 && type < TEXTURE_STAGE_STATE_COUNT)
+		{
+			_texture_stage_states[type] = value;
+		}
+	}
+	void d3d9_state_tracker::set_texture(DWORD stage, IDirect3DBaseTexture9 *texture)
+	{
+		if (_is_synced && stage < MAX_SAMPLERS)
+		{
+			_textures[stage] = texture;
+		}
+	}
+	void d3d9_state_tracker::set_transform(D3DTRANSFORMSTATETYPE state, const D3DMATRIX *matrix)
+	{
+		for (UINT i = 0; i < ARRAYSIZE(s_transforms); i++)
+		{
+			if (s_transforms[i] == state)
+			{
+				_transforms[i] = *matrix;
+				break;
+			}
+		}
+	}
+	void d3d9_state_tracker::set_render_target(DWORD index, IDirect3DSurface9 *surface)
+	{
+		if (!_is_synced || index >= _num_render_targets)
+		{
+			return;
+		}
+
+		_render_targets[index] = surface;
+
+		if (index == 0)
+		{
+			_is_viewport_set = false;
+			_is_scissor_rect_set = false;
+		}
+	}
+	void d3d9_state_tracker::set_depth_stencil_surface(IDirect3DSurface9 *surface)
+	{
+		if (_is_synced)
+		{
+			_depth_stencil = surface;
+		}
+	}
+	void d3d9_state_tracker::set_viewport(const D3DVIEWPORT9 *viewport)
+	{
+		_viewport = *viewport;
+		_is_viewport_set = true;
+	}
+	void d3d9_state_tracker::set_scissor_rect(const RECT *rect)
+	{
+		_scissor_rect = *rect;
+		_is_scissor_rect_set = true;
+	}
+	void d3d9_state_tracker::set_vertex_shader(IDirect3DVertexShader9 *shader)
+	{
+		if (_is_synced)
+		{
+			_vertex_shader = shader;
+		}
+	}
+	void d3d9_state_tracker::set_pixel_shader(IDirect3DPixelShader9 *shader)
+	{
+		if (_is_synced)
+		{
+			_pixel_shader = shader;
+		}
+	}
+	void d3d9_state_tracker::set_vertex_shader_constants(UINT start, const float *data, UINT count)
+	{
+		if (start < MAX_VS_CONSTANTS)
+		{
+			std::memcpy(_vs_constants[start], data, std::min(count, MAX_VS_CONSTANTS - start) * 4 * sizeof(float));
+		}
+	}
+	void d3d9_state_tracker::set_pixel_shader_constants(UINT start, const float *data, UINT count)
+	{
+		if (start < MAX_PS_CONSTANTS)
+		{
+			std::memcpy(_ps_constants[start], data, std::min(count, MAX_PS_CONSTANTS - start) * 4 * sizeof(float));
+		}
+	}
+	void d3d9_state_tracker::set_vertex_declaration(IDirect3DVertexDeclaration9 *declaration)
+	{
+		if (_is_synced)
+		{
+			_vertex_declaration = declaration;
+			_is_fvf = false;
+		}
+	}
+	void d3d9_state_tracker::set_fvf(DWORD fvf)
+	{
+		_fvf = fvf;
+		_is_fvf = true;
+	}
+	void d3d9_state_tracker::set_stream_source(UINT stream, IDirect3DVertexBuffer9 *buffer, UINT offset, UINT stride)
+	{
+		if (_is_synced && stream == 0)
+		{
+			_stream_source = buffer;
+			_stream_offset = offset;
+			_stream_stride = stride;
+		}
+	}
+	void d3d9_state_tracker::set_indices(IDirect3DIndexBuffer9 *buffer)
+	{
+		if (_is_synced)
+		{
+			_indices = buffer;
+		}
+	}
+}
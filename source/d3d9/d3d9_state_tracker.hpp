@@ -0,0 +1,99 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <d3d9.h>
+#include "com_ptr.hpp"
+
+namespace reshade::d3d9
+{
+	/// <summary>
+	/// Shadow copy of the device state the application set through the device proxy.
+	/// Lets the runtime restore only the state it changes, instead of capturing and applying a full state block around every effect and overlay render.
+	/// </summary>
+	class d3d9_state_tracker
+	{
+	public:
+		static constexpr UINT MAX_SAMPLERS = 16;
+		static constexpr UINT MAX_RENDER_TARGETS = 8;
+		static constexpr UINT MAX_VS_CONSTANTS = 256;
+		static constexpr UINT MAX_PS_CONSTANTS = 224;
+
+		/// <summary>
+		/// Read back the current device state to seed the shadow copy. Fails on pure devices, which cannot be queried.
+		/// </summary>
+		bool sync(IDirect3DDevice9 *device);
+		/// <summary>
+		/// Release all references to application objects, so the device can be reset. Tracking resumes with the next <see cref="sync"/>.
+		/// </summary>
+		void release();
+		/// <summary>
+		/// Stop tracking for good. State blocks of the application change device state without going through the device proxy.
+		/// </summary>
+		void disable();
+
+		/// <summary>
+		/// Return whether the shadow copy matches the device and can be used in place of a state block.
+		/// </summary>
+		bool is_valid() const { return _is_synced && !_is_disabled; }
+
+		/// <summary>
+		/// Restore the state the runtime changes while rendering effects and the overlay.
+		/// </summary>
+		/// <param name="device">The device to apply the state to.</param>
+		/// <param name="num_samplers">The number of samplers to restore textures and sampler states for.</param>
+		/// <param name="num_constants">The number of float constant registers starting at zero to restore for both shader stages.</param>
+		void apply(IDirect3DDevice9 *device, UINT num_samplers, UINT num_constants) const;
+
+		void set_render_state(D3DRENDERSTATETYPE state, DWORD value);
+		void set_sampler_state(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value);
+		void set_texture_stage_state(DWORD stage, D3DTEXTURESTAGESTATETYPE type, DWORD value);
+		void set_texture(DWORD stage, IDirect3DBaseTexture9 *texture);
+		void set_transform(D3DTRANSFORMSTATETYPE state, const D3DMATRIX *matrix);
+		void set_render_target(DWORD index, IDirect3DSurface9 *surface);
+		void set_depth_stencil_surface(IDirect3DSurface9 *surface);
+		void set_viewport(const D3DVIEWPORT9 *viewport);
+		void set_scissor_rect(const RECT *rect);
+		void set_vertex_shader(IDirect3DVertexShader9 *shader);
+		void set_pixel_shader(IDirect3DPixelShader9 *shader);
+		void set_vertex_shader_constants(UINT start, const float *data, UINT count);
+		void set_pixel_shader_constants(UINT start, const float *data, UINT count);
+		void set_vertex_declaration(IDirect3DVertexDeclaration9 *declaration);
+		void set_fvf(DWORD fvf);
+		void set_stream_source(UINT stream, IDirect3DVertexBuffer9 *buffer, UINT offset, UINT stride);
+		void set_indices(IDirect3DIndexBuffer9 *buffer);
+
+	private:
+		static constexpr UINT RENDER_STATE_COUNT = D3DRS_BLENDOPALPHA + 1;
+		static constexpr UINT SAMPLER_STATE_COUNT = D3DSAMP_DMAPOFFSET + 1;
+		static constexpr UINT TEXTURE_STAGE_STATE_COUNT = D3DTSS_ALPHAARG2 + 1;
+
+		bool _is_synced = false;
+		bool _is_disabled = false;
+		UINT _num_render_targets = 1;
+		DWORD _render_states[RENDER_STATE_COUNT] = { };
+		DWORD _sampler_states[MAX_SAMPLERS][SAMPLER_STATE_COUNT] = { };
+		DWORD _texture_stage_states[TEXTURE_STAGE_STATE_COUNT] = { };
+		com_ptr<IDirect3DBaseTexture9> _textures[MAX_SAMPLERS];
+		D3DMATRIX _transforms[3] = { };
+		com_ptr<IDirect3DSurface9> _render_targets[MAX_RENDER_TARGETS];
+		com_ptr<IDirect3DSurface9> _depth_stencil;
+		// Setting the first render target resets viewport and scissor rectangle to cover it, so only restore them when they were set since
+		bool _is_viewport_set = false, _is_scissor_rect_set = false;
+		D3DVIEWPORT9 _viewport = { };
+		RECT _scissor_rect = { };
+		com_ptr<IDirect3DVertexShader9> _vertex_shader;
+		com_ptr<IDirect3DPixelShader9> _pixel_shader;
+		float _vs_constants[MAX_VS_CONSTANTS][4] = { };
+		float _ps_constants[MAX_PS_CONSTANTS][4] = { };
+		bool _is_fvf = false;
+		DWORD _fvf = 0;
+		com_ptr<IDirect3DVertexDeclaration9> _vertex_declaration;
+		com_ptr<IDirect3DVertexBuffer9> _stream_source;
+		UINT _stream_offset = 0, _stream_stride = 0;
+		com_ptr<IDirect3DIndexBuffer9> _indices;
+	};
+}
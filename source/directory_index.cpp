@@ -0,0 +1,154 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "directory_index.hpp"
+#include <algorithm>
+#include <Windows.h>
+
+namespace reshade::filesystem
+{
+	// Paths compare case-insensitive and ignore trailing separators, which is what the keys look like
+	static std::string make_key(const path &path)
+	{
+		std::wstring key = path.wstring();
+		std::replace(key.begin(), key.end(), L'/', L'\\');
+
+		while (!key.empty() && key.back() == L'\\')
+		{
+			key.pop_back();
+		}
+
+		CharLowerBuffW(key.data(), static_cast<DWORD>(key.size()));
+
+		return filesystem::path(key).string();
+	}
+	static bool is_below(const std::string &key, const std::string &parent_key)
+	{
+		return key.size() > parent_key.size() && key[parent_key.size()] == '\\' && key.compare(0, parent_key.size(), parent_key) == 0;
+	}
+
+	void directory_index::set_roots(const std::vector<path> &roots)
+	{
+		_roots = roots;
+		_root_keys.clear();
+		_directories.clear();
+
+		for (const auto &root : roots)
+		{
+			_root_keys.push_back(make_key(root));
+		}
+	}
+
+	void directory_index::invalidate(const path &modified_path)
+	{
+		const std::string key = make_key(modified_path);
+		const std::string parent_key = make_key(modified_path.parent_path());
+
+		for (auto it = _directories.begin(); it != _directories.end();)
+		{
+			if (it->first == key || it->first == parent_key || is_below(it->first, key))
+			{
+				it = _directories.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	bool directory_index::exists(const path &path)
+	{
+		const directory *const parent = find_or_list(path.parent_path());
+
+		if (parent == nullptr)
+		{
+			return filesystem::exists(path);
+		}
+
+		return parent->names.count(make_key(path.filename())) != 0;
+	}
+	path directory_index::resolve(const path &filename, const std::vector<path> &paths)
+	{
+		for (const auto &path : paths)
+		{
+			auto result = absolute(filename, path);
+
+			if (exists(result))
+			{
+				return result;
+			}
+		}
+
+		return filename;
+	}
+	std::vector<path> directory_index::list_files(const path &directory, const path &extension)
+	{
+		const directory_index::directory *const listing = find_or_list(directory);
+
+		if (listing == nullptr)
+		{
+			return filesystem::list_files(directory, "*" + extension.string());
+		}
+
+		std::vector<path> result;
+
+		for (const auto &file : listing->files)
+		{
+			if (file.extension() == extension)
+			{
+				result.push_back(file);
+			}
+		}
+
+		return result;
+	}
+
+	const directory_index::directory *directory_index::find_or_list(const path &path)
+	{
+		std::string key = make_key(path);
+
+		if (std::none_of(_root_keys.begin(), _root_keys.end(), [&key](const std::string &root_key) { return key == root_key || is_below(key, root_key); }))
+		{
+			return nullptr;
+		}
+
+		if (const auto it = _directories.find(key); it != _directories.end())
+		{
+			return &it->second;
+		}
+
+		directory &listing = _directories[std::move(key)];
+
+		WIN32_FIND_DATAW ffd;
+		const HANDLE handle = FindFirstFileW((path / "*").wstring().c_str(), &ffd);
+
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			return &listing;
+		}
+
+		do
+		{
+			const filesystem::path filename(ffd.cFileName);
+
+			if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+			{
+				listing.files.push_back(path / filename);
+			}
+			else if (wcscmp(ffd.cFileName, L".") == 0 || wcscmp(ffd.cFileName, L"..") == 0)
+			{
+				continue;
+			}
+
+			listing.names.insert(make_key(filename));
+		}
+		while (FindNextFileW(handle, &ffd));
+
+		FindClose(handle);
+
+		return &listing;
+	}
+}
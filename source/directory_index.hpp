@@ -0,0 +1,65 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include "filesystem.hpp"
+#include <unordered_map>
+#include <unordered_set>
+
+namespace reshade::filesystem
+{
+	/// <summary>
+	/// An in-memory index of the files below a set of watched directories. Every directory is listed from disk once and then kept until a directory watcher reports a change in it, so reloads do not go to the disk for listings again.
+	/// Paths outside of the watched directories are not indexed and always looked up on disk.
+	/// </summary>
+	class directory_index
+	{
+	public:
+		/// <summary>
+		/// Get the directories whose contents are indexed.
+		/// </summary>
+		const std::vector<path> &roots() const { return _roots; }
+		/// <summary>
+		/// Change the directories whose contents are indexed and throw away everything that is known so far, since there was no watcher for the new ones yet.
+		/// </summary>
+		/// <param name="roots">The directories to index, including all their subdirectories.</param>
+		void set_roots(const std::vector<path> &roots);
+
+		/// <summary>
+		/// Throw away what is known about the directory a file was modified, added, removed or renamed in, so it is listed again the next time it is needed.
+		/// </summary>
+		/// <param name="modified_path">The path a directory watcher reported. If it is a directory, everything below it is thrown away too.</param>
+		void invalidate(const path &modified_path);
+
+		/// <summary>
+		/// Check whether a file or directory exists.
+		/// </summary>
+		bool exists(const path &path);
+		/// <summary>
+		/// Same as <see cref="filesystem::resolve"/>, but checks the candidates against the index.
+		/// </summary>
+		path resolve(const path &filename, const std::vector<path> &paths);
+		/// <summary>
+		/// Same as <see cref="filesystem::list_files"/> without recursion, but only returns files with the specified extension (e.g. ".fx").
+		/// </summary>
+		std::vector<path> list_files(const path &directory, const path &extension);
+
+	private:
+		struct directory
+		{
+			std::vector<path> files;
+			// Lower case names of all files and subdirectories
+			std::unordered_set<std::string> names;
+		};
+
+		// Returns the listing of a directory below one of the roots, or nullptr if it is not indexed
+		const directory *find_or_list(const path &path);
+
+		std::vector<path> _roots;
+		std::vector<std::string> _root_keys;
+		std::unordered_map<std::string, directory> _directories;
+	};
+}
@@ -3,70 +3,241 @@
  * License: https://github.com/crosire/reshade#license
  */
 
+#include "log.hpp"
 #include "directory_watcher.hpp"
+#include <algorithm>
+#include <unordered_map>
 #include <Windows.h>
 
 namespace reshade::filesystem
 {
-	directory_watcher::directory_watcher(const path &path) :
-		_path(path),
-		_buffer(sizeof(FILE_NOTIFY_INFORMATION) + MAX_PATH * sizeof(WCHAR))
+	// Files that are added, removed or renamed are reported as well, so listings of the watched directories can be kept up to date
+	static const DWORD s_notify_filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME;
+	// Largest buffer that still works for directories on network shares
+	static const size_t s_buffer_size = 64 * 1024;
+	// Editors tend to write a file several times when saving it, so a modified file is only reported once it was not modified for this long
+	static const DWORD s_debounce_milliseconds = 500;
+
+	struct directory_watcher::watch
 	{
-		_file_handle = CreateFileW(path.wstring().c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
-		_completion_handle = CreateIoCompletionPort(_file_handle, nullptr, reinterpret_cast<ULONG_PTR>(_file_handle), 1);
-
+		filesystem::path path;
+		HANDLE file_handle = INVALID_HANDLE_VALUE;
+		// The pending read refers to these until it completes, so they have to stay at the same address
 		OVERLAPPED overlapped = { };
-		ReadDirectoryChangesW(_file_handle, _buffer.data(), static_cast<DWORD>(_buffer.size()), TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, &overlapped, nullptr);
+		std::vector<uint8_t> buffer;
+		bool read_pending = false;
+		// Cleared when a read cannot be started again, protected by '_mutex'
+		bool active = true;
+		// Time at which each modified file that was not reported yet was last modified
+		std::unordered_map<std::wstring, DWORD> last_modification;
+
+		bool read()
+		{
+			overlapped = { };
+
+			return read_pending = ReadDirectoryChangesW(file_handle, buffer.data(), static_cast<DWORD>(buffer.size()), TRUE, s_notify_filter, nullptr, &overlapped, nullptr) != FALSE;
+		}
+	};
+
+	directory_watcher::directory_watcher(const std::vector<path> &paths)
+	{
+		_completion_handle = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+
+		for (const auto &path : paths)
+		{
+			auto watch = std::make_unique<directory_watcher::watch>();
+			watch->path = path;
+			watch->file_handle = CreateFileW(path.wstring().c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+
+			if (watch->file_handle == INVALID_HANDLE_VALUE)
+			{
+				LOG(WARNING) << "Failed to watch directory " << path << " for changes with error code " << GetLastError() << ".";
+				continue;
+			}
+
+			// The watch is the completion key, so the background thread knows which directory a completed read belongs to
+			watch->buffer.resize(s_buffer_size);
+
+			if (CreateIoCompletionPort(watch->file_handle, _completion_handle, reinterpret_cast<ULONG_PTR>(watch.get()), 0) == nullptr || !watch->read())
+			{
+				LOG(WARNING) << "Failed to watch directory " << path << " for changes with error code " << GetLastError() << ".";
+				CloseHandle(watch->file_handle);
+				continue;
+			}
+
+			_watches.push_back(std::move(watch));
+		}
+
+		_thread = std::thread(&directory_watcher::thread_loop, this);
 	}
 	directory_watcher::~directory_watcher()
 	{
-		CancelIo(_file_handle);
+		// A packet without a watch as completion key tells the background thread to exit
+		PostQueuedCompletionStatus(_completion_handle, 0, 0, nullptr);
+
+		if (_thread.joinable())
+		{
+			_thread.join();
+		}
+
+		for (const auto &watch : _watches)
+		{
+			DWORD transferred;
+
+			// Wait for the cancelled read to complete before freeing the memory it writes to, it was started by the background thread, so 'CancelIo' would not find it
+			if (watch->read_pending && CancelIoEx(watch->file_handle, &watch->overlapped))
+			{
+				GetOverlappedResult(watch->file_handle, &watch->overlapped, &transferred, TRUE);
+			}
+
+			CloseHandle(watch->file_handle);
+		}
 
-		CloseHandle(_file_handle);
 		CloseHandle(_completion_handle);
 	}
 
 	bool directory_watcher::check(std::vector<path> &modifications)
 	{
-		DWORD transferred;
-		ULONG_PTR key;
-		OVERLAPPED *overlapped;
+		const std::lock_guard<std::mutex> lock(_mutex);
 
-		if (!GetQueuedCompletionStatus(_completion_handle, &transferred, &key, &overlapped, 0))
+		if (_modifications.empty())
 		{
 			return false;
 		}
 
-		static DWORD s_last_tick_count = 0;
-		static std::wstring s_last_filename;
+		modifications.insert(modifications.end(), _modifications.begin(), _modifications.end());
+		_modifications.clear();
 
-		auto record = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(_buffer.data());
-		const auto current_tick_count = GetTickCount();
+		return true;
+	}
 
-		while (true)
-		{
-			const std::wstring filename(record->FileName, record->FileNameLength / sizeof(WCHAR));
+	std::vector<path> directory_watcher::watched_paths()
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
 
-			if (filename != s_last_filename || s_last_tick_count + 2000 < current_tick_count)
-			{
-				s_last_filename = filename;
-				s_last_tick_count = current_tick_count;
+		std::vector<path> paths;
 
-				modifications.push_back(_path / filename);
+		for (const auto &watch : _watches)
+		{
+			if (watch->active)
+			{
+				paths.push_back(watch->path);
 			}
+		}
+
+		return paths;
+	}
 
-			if (record->NextEntryOffset == 0)
+	void directory_watcher::thread_loop()
+	{
+		std::vector<path> changes;
+
+		for (;;)
+		{
+			changes.clear();
+
+			// Wake up in time to report the modification that is due next
+			DWORD timeout = INFINITE;
+			DWORD current_tick_count = GetTickCount();
+
+			for (const auto &watch : _watches)
 			{
-				break;
+				for (const auto &modification : watch->last_modification)
+				{
+					const DWORD elapsed = current_tick_count - modification.second;
+					timeout = std::min(timeout, elapsed < s_debounce_milliseconds ? s_debounce_milliseconds - elapsed : 0);
+				}
 			}
 
-			record = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(reinterpret_cast<const BYTE *>(record) + record->NextEntryOffset);
-		}
+			DWORD transferred = 0;
+			ULONG_PTR key = 0;
+			OVERLAPPED *overlapped = nullptr;
 
-		overlapped->hEvent = nullptr;
+			const BOOL status = GetQueuedCompletionStatus(_completion_handle, &transferred, &key, &overlapped, timeout);
 
-		ReadDirectoryChangesW(_file_handle, _buffer.data(), static_cast<DWORD>(_buffer.size()), TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, overlapped, nullptr);
+			// Nothing completed if the wait timed out, which only happens when modifications are due
+			if (status || overlapped != nullptr)
+			{
+				if (key == 0)
+				{
+					break;
+				}
+
+				watch &watch = *reinterpret_cast<directory_watcher::watch *>(key);
+				watch.read_pending = false;
+
+				// Nothing was written to the buffer if the changes did not fit into it, in which case anything in the directory may have changed
+				// The read also fails when the directory was removed, which is reported the same way
+				if (!status || transferred == 0)
+				{
+					changes.push_back(watch.path);
+				}
+				else
+				{
+					current_tick_count = GetTickCount();
+
+					for (auto record = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(watch.buffer.data());;
+						record = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(reinterpret_cast<const BYTE *>(record) + record->NextEntryOffset))
+					{
+						std::wstring filename(record->FileName, record->FileNameLength / sizeof(WCHAR));
+
+						// Modifications are only reported once the file was left alone for a while, so the last of several writes is the one that gets picked up
+						// Files that were added, removed or renamed are reported right away, since listings of the directory depend on them
+						if (record->Action == FILE_ACTION_MODIFIED)
+						{
+							watch.last_modification[std::move(filename)] = current_tick_count;
+						}
+						else
+						{
+							changes.push_back(watch.path / filename);
+						}
+
+						if (record->NextEntryOffset == 0)
+						{
+							break;
+						}
+					}
+				}
+
+				// Keep watching, unless the directory is gone
+				if (!status || !watch.read())
+				{
+					const std::lock_guard<std::mutex> lock(_mutex);
+
+					watch.active = false;
+				}
+			}
 
-		return true;
+			current_tick_count = GetTickCount();
+
+			for (const auto &watch : _watches)
+			{
+				for (auto it = watch->last_modification.begin(); it != watch->last_modification.end();)
+				{
+					if (current_tick_count - it->second >= s_debounce_milliseconds)
+					{
+						changes.push_back(watch->path / it->first);
+						it = watch->last_modification.erase(it);
+					}
+					else
+					{
+						++it;
+					}
+				}
+			}
+
+			if (!changes.empty())
+			{
+				const std::lock_guard<std::mutex> lock(_mutex);
+
+				for (auto &change : changes)
+				{
+					if (std::find(_modifications.begin(), _modifications.end(), change) == _modifications.end())
+					{
+						_modifications.push_back(std::move(change));
+					}
+				}
+			}
+		}
 	}
 }
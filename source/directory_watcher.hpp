@@ -6,20 +6,41 @@
 #pragma once
 
 #include "filesystem.hpp"
+#include <mutex>
+#include <memory>
+#include <thread>
 
 namespace reshade::filesystem
 {
+	/// <summary>
+	/// Watches any number of directories and their subdirectories for changes on a background thread, which collects them until they are picked up with <see cref="check"/>.
+	/// </summary>
 	class directory_watcher
 	{
 	public:
-		explicit directory_watcher(const path &path);
+		explicit directory_watcher(const std::vector<path> &paths);
 		~directory_watcher();
 
+		/// <summary>
+		/// Add the paths of all files and directories that changed since the last call, or a watched path itself if too much changed in it to tell which ones. Every path is only added once, no matter how often it changed in between.
+		/// </summary>
 		bool check(std::vector<path> &modifications);
 
+		/// <summary>
+		/// Get the directories that are actually watched, which leaves out those that could not be opened and those that stopped being watched, because they were removed for example.
+		/// </summary>
+		std::vector<path> watched_paths();
+
 	private:
-		path _path;
-		std::vector<uint8_t> _buffer;
-		void *_file_handle, *_completion_handle;
+		struct watch;
+
+		void thread_loop();
+
+		std::vector<std::unique_ptr<watch>> _watches;
+		void *_completion_handle;
+		std::thread _thread;
+		std::mutex _mutex;
+		// Changes the background thread collected since the last check, protected by '_mutex'
+		std::vector<path> _modifications;
 	};
 }
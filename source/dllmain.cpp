@@ -203,7 +203,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
 
 #else
 
-BOOL APIENTRY DllMain(HMODULE hModule, DWORD fdwReason, LPVOID)
+BOOL APIENTRY DllMain(HMODULE hModule, DWORD fdwReason, LPVOID lpReserved)
 {
 	using namespace reshade;
 
@@ -224,6 +224,10 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD fdwReason, LPVOID)
 			runtime::s_gw2hook_wrkdir_path = runtime::s_target_executable_path.parent_path() + "\\addons\\Gw2Hook\\";
 			log::open(filesystem::path(runtime::s_gw2hook_wrkdir_path).replace_extension("Gw2Hook.log"));
 
+#if RESHADE_COUNT_ALLOCATIONS
+			profiler::install_allocation_hook();
+#endif
+
 #ifdef WIN64
 			LOG(INFO) << "Initializing crosire's ReShade version '" VERSION_STRING_FILE "' (64-bit) built on '" VERSION_DATE " " VERSION_TIME "' loaded from " << runtime::s_reshade_dll_path << " to " << runtime::s_target_executable_path << " ...";
 #else
@@ -251,6 +255,18 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD fdwReason, LPVOID)
 			hooks::uninstall();
 
 			LOG(INFO) << "Exited.";
+
+			// The process terminated the background threads of the log and the INI files already when it is exiting, otherwise the module is unloaded by 'FreeLibrary' and they are still running
+			if (lpReserved == nullptr)
+			{
+				ini_file::stop();
+				log::close();
+			}
+			else
+			{
+				ini_file::flush();
+				log::flush();
+			}
 			break;
 		}
 	}
@@ -4,9 +4,11 @@
  */
 
 #include "log.hpp"
+#include "ini_file.hpp"
 #include "hook_manager.hpp"
 #include "dxgi_device.hpp"
 #include "dxgi_swapchain.hpp"
+#include <algorithm>
 
 void dump_swapchain_desc(const DXGI_SWAP_CHAIN_DESC &desc)
 {
@@ -61,6 +63,51 @@ void dump_swapchain_desc(const DXGI_SWAP_CHAIN_DESC1 &desc)
 	}
 }
 
+// Switching a bit-block transfer swap chain over to the flip model saves the copy to the desktop compositor on every present, but it also unbinds the back buffer after each present, which not every game copes with, so it is opt-in
+static bool is_flip_model_upgrade_enabled()
+{
+	bool enabled = false;
+	reshade::ini_file(reshade::runtime::s_gw2hook_wrkdir_path + "config.ini").get("DXGI", "ForceFlipModel", enabled);
+
+	return enabled;
+}
+static unsigned int configured_max_frame_latency()
+{
+	unsigned int max_frame_latency = 0;
+	reshade::ini_file(reshade::runtime::s_gw2hook_wrkdir_path + "config.ini").get("GENERAL", "MaxFrameLatency", max_frame_latency);
+
+	return std::min(max_frame_latency, 16u);
+}
+static bool upgrade_to_flip_model(DXGI_SWAP_EFFECT &swap_effect, UINT &buffer_count, DXGI_FORMAT format, const DXGI_SAMPLE_DESC &sample_desc)
+{
+	if (swap_effect != DXGI_SWAP_EFFECT_DISCARD && swap_effect != DXGI_SWAP_EFFECT_SEQUENTIAL)
+	{
+		return false;
+	}
+
+	// The flip model does not support multisampled back buffers and only a few formats, which excludes the sRGB ones
+	if (sample_desc.Count > 1)
+	{
+		return false;
+	}
+
+	switch (format)
+	{
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		case DXGI_FORMAT_R10G10B10A2_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+			break;
+		default:
+			return false;
+	}
+
+	swap_effect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+	buffer_count = std::max(buffer_count, 2u);
+
+	return true;
+}
+
 // IDXGIFactory
 HRESULT STDMETHODCALLTYPE IDXGIFactory_CreateSwapChain(IDXGIFactory *pFactory, IUnknown *pDevice, DXGI_SWAP_CHAIN_DESC *pDesc, IDXGISwapChain **ppSwapChain)
 {
@@ -89,7 +136,47 @@ HRESULT STDMETHODCALLTYPE IDXGIFactory_CreateSwapChain(IDXGIFactory *pFactory, I
 
 	dump_swapchain_desc(*pDesc);
 
-	const HRESULT hr = reshade::hooks::call(&IDXGIFactory_CreateSwapChain)(pFactory, device_orig, pDesc, ppSwapChain);
+	HRESULT hr = E_FAIL;
+	DXGI_SWAP_CHAIN_DESC desc_flip = *pDesc;
+	bool flip_model_upgraded = false;
+	const unsigned int max_frame_latency = configured_max_frame_latency();
+
+	// Only swap chains that get wrapped below can be upgraded, since the wrapper has to hide the change from the game
+	if ((device_d3d10 != nullptr || device_d3d11 != nullptr) && (pDesc->BufferUsage & DXGI_USAGE_RENDER_TARGET_OUTPUT) != 0 &&
+		is_flip_model_upgrade_enabled() && upgrade_to_flip_model(desc_flip.SwapEffect, desc_flip.BufferCount, desc_flip.BufferDesc.Format, desc_flip.SampleDesc))
+	{
+		// A flip model swap chain can signal when it is ready for the next frame, which is waited on after present to limit the frame latency
+		if (max_frame_latency != 0)
+		{
+			desc_flip.Flags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+		}
+
+		hr = reshade::hooks::call(&IDXGIFactory_CreateSwapChain)(pFactory, device_orig, &desc_flip, ppSwapChain);
+
+		// 'DXGI_SWAP_EFFECT_FLIP_DISCARD' is only available on Windows 10
+		if (FAILED(hr))
+		{
+			desc_flip.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
+
+			hr = reshade::hooks::call(&IDXGIFactory_CreateSwapChain)(pFactory, device_orig, &desc_flip, ppSwapChain);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			flip_model_upgraded = true;
+
+			LOG(INFO) << "> Upgraded swap chain to flip model with swap effect " << desc_flip.SwapEffect << " and " << desc_flip.BufferCount << " buffers.";
+		}
+		else
+		{
+			LOG(WARNING) << "> Failed to upgrade swap chain to flip model with error code " << std::hex << hr << std::dec << ". Falling back to the original description.";
+		}
+	}
+
+	if (!flip_model_upgraded)
+	{
+		hr = reshade::hooks::call(&IDXGIFactory_CreateSwapChain)(pFactory, device_orig, pDesc, ppSwapChain);
+	}
 
 	if (FAILED(hr))
 	{
@@ -142,6 +229,15 @@ HRESULT STDMETHODCALLTYPE IDXGIFactory_CreateSwapChain(IDXGIFactory *pFactory, I
 		LOG(WARNING) << "> Skipping swap chain because it was created without a (hooked) Direct3D device.";
 	}
 
+	if (flip_model_upgraded)
+	{
+		static_cast<DXGISwapChain *>(*ppSwapChain)->set_flip_model_upgrade(pDesc->SwapEffect, pDesc->BufferCount, desc_flip.Flags & ~pDesc->Flags);
+	}
+	if (max_frame_latency != 0 && *ppSwapChain != swapchain)
+	{
+		static_cast<DXGISwapChain *>(*ppSwapChain)->set_max_frame_latency(max_frame_latency);
+	}
+
 #if RESHADE_VERBOSE_LOG
 	LOG(DEBUG) << "Returning 'IDXGISwapChain' object " << *ppSwapChain;
 #endif
@@ -177,7 +273,44 @@ HRESULT STDMETHODCALLTYPE IDXGIFactory2_CreateSwapChainForHwnd(IDXGIFactory2 *pF
 
 	dump_swapchain_desc(*pDesc);
 
-	const HRESULT hr = reshade::hooks::call(&IDXGIFactory2_CreateSwapChainForHwnd)(pFactory, device_orig, hWnd, pDesc, pFullscreenDesc, pRestrictToOutput, ppSwapChain);
+	HRESULT hr = E_FAIL;
+	DXGI_SWAP_CHAIN_DESC1 desc_flip = *pDesc;
+	bool flip_model_upgraded = false;
+	const unsigned int max_frame_latency = configured_max_frame_latency();
+
+	if ((device_d3d10 != nullptr || device_d3d11 != nullptr) && (pDesc->BufferUsage & DXGI_USAGE_RENDER_TARGET_OUTPUT) != 0 &&
+		is_flip_model_upgrade_enabled() && upgrade_to_flip_model(desc_flip.SwapEffect, desc_flip.BufferCount, desc_flip.Format, desc_flip.SampleDesc))
+	{
+		if (max_frame_latency != 0)
+		{
+			desc_flip.Flags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+		}
+
+		hr = reshade::hooks::call(&IDXGIFactory2_CreateSwapChainForHwnd)(pFactory, device_orig, hWnd, &desc_flip, pFullscreenDesc, pRestrictToOutput, ppSwapChain);
+
+		if (FAILED(hr))
+		{
+			desc_flip.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
+
+			hr = reshade::hooks::call(&IDXGIFactory2_CreateSwapChainForHwnd)(pFactory, device_orig, hWnd, &desc_flip, pFullscreenDesc, pRestrictToOutput, ppSwapChain);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			flip_model_upgraded = true;
+
+			LOG(INFO) << "> Upgraded swap chain to flip model with swap effect " << desc_flip.SwapEffect << " and " << desc_flip.BufferCount << " buffers.";
+		}
+		else
+		{
+			LOG(WARNING) << "> Failed to upgrade swap chain to flip model with error code " << std::hex << hr << std::dec << ". Falling back to the original description.";
+		}
+	}
+
+	if (!flip_model_upgraded)
+	{
+		hr = reshade::hooks::call(&IDXGIFactory2_CreateSwapChainForHwnd)(pFactory, device_orig, hWnd, pDesc, pFullscreenDesc, pRestrictToOutput, ppSwapChain);
+	}
 
 	if (FAILED(hr))
 	{
@@ -230,6 +363,15 @@ HRESULT STDMETHODCALLTYPE IDXGIFactory2_CreateSwapChainForHwnd(IDXGIFactory2 *pF
 		LOG(WARNING) << "> Skipping swap chain because it was created without a (hooked) Direct3D device.";
 	}
 
+	if (flip_model_upgraded)
+	{
+		static_cast<DXGISwapChain *>(*ppSwapChain)->set_flip_model_upgrade(pDesc->SwapEffect, pDesc->BufferCount, desc_flip.Flags & ~pDesc->Flags);
+	}
+	if (max_frame_latency != 0 && *ppSwapChain != swapchain)
+	{
+		static_cast<DXGISwapChain *>(*ppSwapChain)->set_max_frame_latency(max_frame_latency);
+	}
+
 #if RESHADE_VERBOSE_LOG
 	LOG(DEBUG) << "Returning 'IDXGISwapChain1' object " << *ppSwapChain;
 #endif
@@ -23,6 +23,7 @@ void DXGISwapChain::perform_present(UINT PresentFlags)
 			break;
 		case 11:
 			assert(_runtime != nullptr);
+			static_cast<D3D11Device *>(_direct3d_device)->_redirect->OnPresent();
 			std::static_pointer_cast<reshade::d3d11::d3d11_runtime>(_runtime)->on_present(static_cast<D3D11Device *>(_direct3d_device)->_immediate_context->_draw_call_tracker);
 			clear_drawcall_stats();
 			break;
@@ -30,6 +31,34 @@ void DXGISwapChain::perform_present(UINT PresentFlags)
 	}
 }
 
+void DXGISwapChain::set_max_frame_latency(UINT max_latency)
+{
+	if ((_added_flags & DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT) != 0)
+	{
+		IDXGISwapChain2 *swapchain2 = nullptr;
+
+		if (SUCCEEDED(_orig->QueryInterface(&swapchain2)))
+		{
+			swapchain2->SetMaximumFrameLatency(max_latency);
+			_frame_latency_object = swapchain2->GetFrameLatencyWaitableObject();
+			swapchain2->Release();
+
+			LOG(INFO) << "> Limiting frame latency to " << max_latency << " frames through the waitable object of swap chain " << this << ".";
+			return;
+		}
+	}
+
+	IDXGIDevice1 *device = nullptr;
+
+	if (SUCCEEDED(_orig->GetDevice(IID_PPV_ARGS(&device))))
+	{
+		device->SetMaximumFrameLatency(max_latency);
+		device->Release();
+
+		LOG(INFO) << "> Limiting frame latency to " << max_latency << " frames on the device of swap chain " << this << ".";
+	}
+}
+
 void DXGISwapChain::clear_drawcall_stats()
 {
 	const auto device_d3d10_proxy = static_cast<D3D10Device *>(_direct3d_device);
@@ -192,6 +221,12 @@ ULONG STDMETHODCALLTYPE DXGISwapChain::Release()
 
 		_runtime.reset();
 
+		if (_frame_latency_object != nullptr)
+		{
+			CloseHandle(_frame_latency_object);
+			_frame_latency_object = nullptr;
+		}
+
 		_direct3d_device->Release();
 	}
 
@@ -244,7 +279,21 @@ HRESULT STDMETHODCALLTYPE DXGISwapChain::GetDevice(REFIID riid, void **ppDevice)
 HRESULT STDMETHODCALLTYPE DXGISwapChain::Present(UINT SyncInterval, UINT Flags)
 {
 	perform_present(Flags);
-	return _orig->Present(SyncInterval, Flags);
+	const HRESULT hr = _orig->Present(SyncInterval, Flags);
+
+	// Block until the swap chain is ready for another frame, before the game samples input for it
+	if (_frame_latency_object != nullptr && !(Flags & DXGI_PRESENT_TEST))
+	{
+		WaitForSingleObjectEx(_frame_latency_object, 1000, TRUE);
+	}
+
+	// The overlay may be built on a worker thread while the driver presents, which has to finish before the game continues
+	if (_runtime != nullptr)
+	{
+		_runtime->wait_for_overlay();
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE DXGISwapChain::GetBuffer(UINT Buffer, REFIID riid, void **ppSurface)
 {
@@ -262,7 +311,17 @@ HRESULT STDMETHODCALLTYPE DXGISwapChain::GetFullscreenState(BOOL *pFullscreen, I
 }
 HRESULT STDMETHODCALLTYPE DXGISwapChain::GetDesc(DXGI_SWAP_CHAIN_DESC *pDesc)
 {
-	return _orig->GetDesc(pDesc);
+	const HRESULT hr = _orig->GetDesc(pDesc);
+
+	// Report what the game asked for, so it never sees the flip model it did not create
+	if (SUCCEEDED(hr) && _flip_model_upgraded)
+	{
+		pDesc->SwapEffect = _orig_swap_effect;
+		pDesc->BufferCount = _orig_buffer_count;
+		pDesc->Flags &= ~_added_flags;
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE DXGISwapChain::ResizeBuffers(UINT BufferCount, UINT Width, UINT Height, DXGI_FORMAT NewFormat, UINT SwapChainFlags)
 {
@@ -281,6 +340,16 @@ HRESULT STDMETHODCALLTYPE DXGISwapChain::ResizeBuffers(UINT BufferCount, UINT Wi
 			break;
 	}
 
+	// The flip model needs at least two buffers, while games using the bit-block transfer model usually ask for one, zero keeps the current count
+	if (_flip_model_upgraded && BufferCount != 0)
+	{
+		_orig_buffer_count = BufferCount;
+		BufferCount = std::max(BufferCount, 2u);
+	}
+
+	// Flags like the waitable object one cannot be changed by resizing, so they have to be passed again
+	SwapChainFlags |= _added_flags;
+
 	const HRESULT hr = _orig->ResizeBuffers(BufferCount, Width, Height, NewFormat, SwapChainFlags);
 
 	if (hr == DXGI_ERROR_INVALID_CALL)
@@ -340,7 +409,16 @@ HRESULT STDMETHODCALLTYPE DXGISwapChain::GetDesc1(DXGI_SWAP_CHAIN_DESC1 *pDesc)
 {
 	assert(_interface_version >= 1);
 
-	return static_cast<IDXGISwapChain1 *>(_orig)->GetDesc1(pDesc);
+	const HRESULT hr = static_cast<IDXGISwapChain1 *>(_orig)->GetDesc1(pDesc);
+
+	if (SUCCEEDED(hr) && _flip_model_upgraded)
+	{
+		pDesc->SwapEffect = _orig_swap_effect;
+		pDesc->BufferCount = _orig_buffer_count;
+		pDesc->Flags &= ~_added_flags;
+	}
+
+	return hr;
 }
 HRESULT STDMETHODCALLTYPE DXGISwapChain::GetFullscreenDesc(DXGI_SWAP_CHAIN_FULLSCREEN_DESC *pDesc)
 {
@@ -364,7 +442,19 @@ HRESULT STDMETHODCALLTYPE DXGISwapChain::Present1(UINT SyncInterval, UINT Presen
 {
 	assert(_interface_version >= 1);
 	perform_present(PresentFlags);
-	return static_cast<IDXGISwapChain1 *>(_orig)->Present1(SyncInterval, PresentFlags, pPresentParameters);
+	const HRESULT hr = static_cast<IDXGISwapChain1 *>(_orig)->Present1(SyncInterval, PresentFlags, pPresentParameters);
+
+	if (_frame_latency_object != nullptr && !(PresentFlags & DXGI_PRESENT_TEST))
+	{
+		WaitForSingleObjectEx(_frame_latency_object, 1000, TRUE);
+	}
+
+	if (_runtime != nullptr)
+	{
+		_runtime->wait_for_overlay();
+	}
+
+	return hr;
 }
 BOOL STDMETHODCALLTYPE DXGISwapChain::IsTemporaryMonoSupported()
 {
@@ -485,6 +575,15 @@ HRESULT STDMETHODCALLTYPE DXGISwapChain::ResizeBuffers1(UINT BufferCount, UINT W
 			break;
 	}
 
+	// The node mask and present queue arrays have one entry per buffer, so the count cannot be raised when they are given
+	if (_flip_model_upgraded && BufferCount != 0 && pCreationNodeMask == nullptr && ppPresentQueue == nullptr)
+	{
+		_orig_buffer_count = BufferCount;
+		BufferCount = std::max(BufferCount, 2u);
+	}
+
+	SwapChainFlags |= _added_flags;
+
 	const HRESULT hr = static_cast<IDXGISwapChain3 *>(_orig)->ResizeBuffers1(BufferCount, Width, Height, Format, SwapChainFlags, pCreationNodeMask, ppPresentQueue);
 
 	if (hr == DXGI_ERROR_INVALID_CALL)
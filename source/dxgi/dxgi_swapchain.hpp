@@ -99,10 +99,34 @@ struct DXGISwapChain : IDXGISwapChain4
 
 	void clear_drawcall_stats();
 
+	/// <summary>
+	/// Remember that the swap chain was created with the flip model instead of the bit-block transfer model the game asked for.
+	/// </summary>
+	/// <param name="swap_effect">The swap effect the game asked for.</param>
+	/// <param name="buffer_count">The number of buffers the game asked for.</param>
+	/// <param name="added_flags">The swap chain flags that were added to what the game asked for.</param>
+	void set_flip_model_upgrade(DXGI_SWAP_EFFECT swap_effect, UINT buffer_count, UINT added_flags)
+	{
+		_flip_model_upgraded = true;
+		_orig_swap_effect = swap_effect;
+		_orig_buffer_count = buffer_count;
+		_added_flags = added_flags;
+	}
+	/// <summary>
+	/// Limit the number of frames the CPU may queue up ahead of the GPU, through the waitable object if the swap chain was created with one, or the device otherwise.
+	/// </summary>
+	/// <param name="max_latency">The maximum number of queued frames.</param>
+	void set_max_frame_latency(UINT max_latency);
+
 	LONG _ref = 1;
 	IDXGISwapChain *_orig;
 	unsigned int _interface_version;
 	IUnknown *const _direct3d_device;
 	const unsigned int _direct3d_version;
 	std::shared_ptr<reshade::runtime> _runtime;
+	bool _flip_model_upgraded = false;
+	DXGI_SWAP_EFFECT _orig_swap_effect = DXGI_SWAP_EFFECT_DISCARD;
+	UINT _orig_buffer_count = 0;
+	UINT _added_flags = 0;
+	HANDLE _frame_latency_object = nullptr;
 };
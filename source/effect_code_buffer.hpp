@@ -0,0 +1,99 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <string>
+#include <algorithm>
+#include <charconv>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// An append-only buffer the effect compilers write generated shader code to.
+	/// It has the subset of the stream interface the compilers need, but appends to a pre-sized string and formats numbers into a small stack buffer instead of going through stream locales and temporaries.
+	/// </summary>
+	class code_buffer
+	{
+	public:
+		/// <summary>
+		/// Construct an empty buffer.
+		/// </summary>
+		/// <param name="capacity">The number of characters to reserve up front, so typical output does not have to grow the buffer.</param>
+		explicit code_buffer(size_t capacity = 1024)
+		{
+			_data.reserve(capacity);
+		}
+
+		code_buffer &operator<<(char c)
+		{
+			_data.push_back(c);
+			return *this;
+		}
+		code_buffer &operator<<(const char *s)
+		{
+			_data.append(s);
+			return *this;
+		}
+		code_buffer &operator<<(const std::string &s)
+		{
+			_data.append(s);
+			return *this;
+		}
+		code_buffer &operator<<(int value) { return append_integer(value); }
+		code_buffer &operator<<(long value) { return append_integer(value); }
+		code_buffer &operator<<(long long value) { return append_integer(value); }
+		code_buffer &operator<<(unsigned int value) { return append_integer(value); }
+		code_buffer &operator<<(unsigned long value) { return append_integer(value); }
+		code_buffer &operator<<(unsigned long long value) { return append_integer(value); }
+		/// <summary>
+		/// Append a floating point number in fixed notation with eight decimal places, which is exact enough to round trip any literal through the shader compiler.
+		/// </summary>
+		code_buffer &operator<<(double value)
+		{
+			// Always uses a period as decimal separator, unlike 'snprintf', which follows the locale the application set
+			char buffer[384];
+			const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, 8);
+
+			if (result.ec == std::errc())
+			{
+				_data.append(buffer, result.ptr);
+			}
+
+			return *this;
+		}
+
+		/// <summary>
+		/// Remove characters from the end of the buffer again.
+		/// </summary>
+		/// <param name="count">The number of characters to remove.</param>
+		void pop_back(size_t count = 1) { _data.resize(_data.size() - std::min(count, _data.size())); }
+		/// <summary>
+		/// Make room for at least the specified total number of characters.
+		/// </summary>
+		void reserve(size_t capacity) { _data.reserve(capacity); }
+
+		/// <summary>
+		/// Get the number of characters that were written so far, which can be used as offset into the string returned by <see cref="str"/>.
+		/// </summary>
+		size_t size() const { return _data.size(); }
+		/// <summary>
+		/// Get the code that was written so far.
+		/// </summary>
+		const std::string &str() const { return _data; }
+
+	private:
+		template <typename T>
+		code_buffer &append_integer(T value)
+		{
+			char buffer[24];
+			const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+			_data.append(buffer, result.ptr);
+			return *this;
+		}
+
+		std::string _data;
+	};
+}
@@ -0,0 +1,292 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_fusion.hpp"
+#include "effect_reachability.hpp"
+#include <algorithm>
+
+namespace reshadefx
+{
+	using namespace nodes;
+
+	namespace
+	{
+		bool is_backbuffer_sampler(const variable_declaration_node *node)
+		{
+			if (!node->type.is_sampler() || node->properties.texture == nullptr)
+			{
+				return false;
+			}
+
+			const std::string &semantic = node->properties.texture->semantic;
+
+			return semantic == "COLOR" || semantic == "SV_TARGET";
+		}
+		bool is_color_semantic(const std::string &semantic)
+		{
+			return semantic == "SV_TARGET" || semantic == "SV_TARGET0" || semantic == "COLOR" || semantic == "COLOR0";
+		}
+
+		// Returns the variable an expression refers to when it is written to, looking through swizzles, fields and array indices
+		const variable_declaration_node *find_written_variable(const expression_node *node)
+		{
+			while (node != nullptr)
+			{
+				switch (node->id)
+				{
+					case nodeid::lvalue_expression:
+						return static_cast<const lvalue_expression_node *>(node)->reference;
+					case nodeid::swizzle_expression:
+						node = static_cast<const swizzle_expression_node *>(node)->operand;
+						break;
+					case nodeid::field_expression:
+						node = static_cast<const field_expression_node *>(node)->operand;
+						break;
+					case nodeid::binary_expression:
+						if (static_cast<const binary_expression_node *>(node)->op != binary_expression_node::element_extract)
+							return nullptr;
+						node = static_cast<const binary_expression_node *>(node)->operands[0];
+						break;
+					default:
+						return nullptr;
+				}
+			}
+
+			return nullptr;
+		}
+
+		struct fusion_visitor
+		{
+			const function_declaration_node *entry_point;
+			const function_declaration_node *current_function;
+			pass_fusion_info &info;
+			bool is_pointwise = true;
+			// Texture coordinate inputs of the entry point the back buffer is sampled at, and the parameters that are written to
+			std::unordered_set<const variable_declaration_node *> sampled_parameters, written_parameters;
+
+			bool is_texcoord_parameter(const expression_node *node) const
+			{
+				if (current_function != entry_point || node == nullptr || node->id != nodeid::lvalue_expression)
+				{
+					return false;
+				}
+
+				const auto reference = static_cast<const lvalue_expression_node *>(node)->reference;
+
+				return std::find(entry_point->parameter_list.begin(), entry_point->parameter_list.end(), reference) != entry_point->parameter_list.end() &&
+					reference->semantic.compare(0, 8, "TEXCOORD") == 0;
+			}
+
+			void written(const expression_node *node)
+			{
+				if (const auto variable = find_written_variable(node); variable != nullptr)
+				{
+					written_parameters.insert(variable);
+				}
+			}
+
+			void visit(const expression_node *node)
+			{
+				if (node == nullptr)
+				{
+					return;
+				}
+
+				switch (node->id)
+				{
+					case nodeid::lvalue_expression:
+					{
+						const auto reference = static_cast<const lvalue_expression_node *>(node)->reference;
+
+						// Any use of a back buffer sampler not caught by the 'tex2D' case below, like offset or level sampling or passing it on to a function
+						if (is_backbuffer_sampler(reference))
+						{
+							info.backbuffer_samplers.insert(reference);
+							is_pointwise = false;
+						}
+						break;
+					}
+					case nodeid::unary_expression:
+					{
+						const auto unary = static_cast<const unary_expression_node *>(node);
+
+						if (unary->op == unary_expression_node::pre_increase || unary->op == unary_expression_node::pre_decrease ||
+							unary->op == unary_expression_node::post_increase || unary->op == unary_expression_node::post_decrease)
+						{
+							written(unary->operand);
+						}
+
+						visit(unary->operand);
+						break;
+					}
+					case nodeid::binary_expression:
+						for (auto operand : static_cast<const binary_expression_node *>(node)->operands)
+							visit(operand);
+						break;
+					case nodeid::intrinsic_expression:
+					{
+						const auto intrinsic = static_cast<const intrinsic_expression_node *>(node);
+
+						if (intrinsic->op == intrinsic_expression_node::texture && intrinsic->arguments[0]->id == nodeid::lvalue_expression)
+						{
+							const auto sampler = static_cast<const lvalue_expression_node *>(intrinsic->arguments[0])->reference;
+
+							if (is_backbuffer_sampler(sampler))
+							{
+								info.backbuffer_samplers.insert(sampler);
+
+								if (is_texcoord_parameter(intrinsic->arguments[1]))
+								{
+									sampled_parameters.insert(static_cast<const lvalue_expression_node *>(intrinsic->arguments[1])->reference);
+								}
+								else
+								{
+									is_pointwise = false;
+								}
+
+								visit(intrinsic->arguments[1]);
+								break;
+							}
+						}
+
+						for (auto argument : intrinsic->arguments)
+							visit(argument);
+						break;
+					}
+					case nodeid::conditional_expression:
+						visit(static_cast<const conditional_expression_node *>(node)->condition);
+						visit(static_cast<const conditional_expression_node *>(node)->expression_when_true);
+						visit(static_cast<const conditional_expression_node *>(node)->expression_when_false);
+						break;
+					case nodeid::assignment_expression:
+						written(static_cast<const assignment_expression_node *>(node)->left);
+						visit(static_cast<const assignment_expression_node *>(node)->left);
+						visit(static_cast<const assignment_expression_node *>(node)->right);
+						break;
+					case nodeid::expression_sequence:
+						for (auto expression : static_cast<const expression_sequence_node *>(node)->expression_list)
+							visit(expression);
+						break;
+					case nodeid::call_expression:
+					{
+						const auto call = static_cast<const call_expression_node *>(node);
+
+						for (size_t i = 0; i < call->arguments.size(); i++)
+						{
+							if (i < call->callee->parameter_list.size() && call->callee->parameter_list[i]->type.has_qualifier(type_node::qualifier_out))
+							{
+								written(call->arguments[i]);
+							}
+
+							visit(call->arguments[i]);
+						}
+						break;
+					}
+					case nodeid::constructor_expression:
+						for (auto argument : static_cast<const constructor_expression_node *>(node)->arguments)
+							visit(argument);
+						break;
+					case nodeid::swizzle_expression:
+						visit(static_cast<const swizzle_expression_node *>(node)->operand);
+						break;
+					case nodeid::field_expression:
+						visit(static_cast<const field_expression_node *>(node)->operand);
+						break;
+					case nodeid::initializer_list:
+						for (auto value : static_cast<const initializer_list_node *>(node)->values)
+							visit(value);
+						break;
+				}
+			}
+			void visit(const statement_node *node)
+			{
+				if (node == nullptr)
+				{
+					return;
+				}
+
+				switch (node->id)
+				{
+					case nodeid::compound_statement:
+						for (auto statement : static_cast<const compound_statement_node *>(node)->statement_list)
+							visit(statement);
+						break;
+					case nodeid::declarator_list:
+						for (auto declarator : static_cast<const declarator_list_node *>(node)->declarator_list)
+							visit(declarator->initializer_expression);
+						break;
+					case nodeid::expression_statement:
+						visit(static_cast<const expression_statement_node *>(node)->expression);
+						break;
+					case nodeid::if_statement:
+						visit(static_cast<const if_statement_node *>(node)->condition);
+						visit(static_cast<const if_statement_node *>(node)->statement_when_true);
+						visit(static_cast<const if_statement_node *>(node)->statement_when_false);
+						break;
+					case nodeid::switch_statement:
+						visit(static_cast<const switch_statement_node *>(node)->test_expression);
+						for (auto case_statement : static_cast<const switch_statement_node *>(node)->case_list)
+							visit(case_statement->statement_list);
+						break;
+					case nodeid::case_statement:
+						visit(static_cast<const case_statement_node *>(node)->statement_list);
+						break;
+					case nodeid::for_statement:
+						visit(static_cast<const for_statement_node *>(node)->init_statement);
+						visit(static_cast<const for_statement_node *>(node)->condition);
+						visit(static_cast<const for_statement_node *>(node)->increment_expression);
+						visit(static_cast<const for_statement_node *>(node)->statement_list);
+						break;
+					case nodeid::while_statement:
+						visit(static_cast<const while_statement_node *>(node)->condition);
+						visit(static_cast<const while_statement_node *>(node)->statement_list);
+						break;
+					case nodeid::return_statement:
+						visit(static_cast<const return_statement_node *>(node)->return_value);
+						break;
+				}
+			}
+		};
+	}
+
+	void analyze_pass_fusion(const pass_declaration_node *pass, pass_fusion_info &info)
+	{
+		info = pass_fusion_info();
+
+		const function_declaration_node *const pixel_shader = pass->pixel_shader;
+
+		if (pass->compute_shader != nullptr || pass->vertex_shader == nullptr || pixel_shader == nullptr)
+		{
+			return;
+		}
+
+		info.replaces_backbuffer =
+			!pass->blend_enable && !pass->stencil_enable && !pass->srgb_write_enable && pass->color_write_mask == 0xF &&
+			std::all_of(std::begin(pass->render_targets), std::end(pass->render_targets), [](auto target) { return target == nullptr; }) &&
+			pixel_shader->return_type.is_floating_point() && !pixel_shader->return_type.is_array() && pixel_shader->return_type.rows == 4 && pixel_shader->return_type.cols == 1 &&
+			is_color_semantic(pixel_shader->return_semantic) &&
+			std::none_of(pixel_shader->parameter_list.begin(), pixel_shader->parameter_list.end(), [](auto parameter) { return parameter->type.has_qualifier(type_node::qualifier_out); });
+
+		reachable_declarations reachable;
+		find_reachable_declarations(pixel_shader, reachable);
+
+		// A discarded pixel keeps what the back buffer held, which a following pass cannot get from a register (ReShadeFX has no 'clip' intrinsic, so 'discard' is the only way to do so)
+		info.replaces_backbuffer &= !reachable.discards;
+
+		fusion_visitor visitor = { pixel_shader, nullptr, info };
+
+		for (auto function : reachable.functions)
+		{
+			visitor.current_function = function;
+			visitor.visit(function->definition);
+		}
+
+		// A previous result in a register is not converted from sRGB like a sample of the back buffer would be
+		const bool is_linear = std::none_of(info.backbuffer_samplers.begin(), info.backbuffer_samplers.end(), [](auto sampler) { return sampler->properties.srgb_texture; });
+		const bool is_texcoord_unmodified = std::none_of(visitor.sampled_parameters.begin(), visitor.sampled_parameters.end(), [&visitor](auto parameter) { return visitor.written_parameters.count(parameter) != 0; });
+
+		info.reads_backbuffer_pointwise = visitor.is_pointwise && is_linear && is_texcoord_unmodified;
+	}
+}
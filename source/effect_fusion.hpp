@@ -0,0 +1,39 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include "effect_syntax_tree_nodes.hpp"
+#include <unordered_set>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// How a pass uses the back buffer, which decides whether its pixel shader can be fused with those of the techniques that are rendered right before and after it.
+	/// </summary>
+	struct pass_fusion_info
+	{
+		/// <summary>
+		/// Set when the pass draws a single color to the back buffer alone and replaces every pixel of it, without blending, stencil, sRGB conversion, a partial write mask or discarding pixels, so its result can be handed to a following pass in a register instead.
+		/// </summary>
+		bool replaces_backbuffer = false;
+		/// <summary>
+		/// Set when the pixel shader only samples the back buffer at the pixel it writes, by passing its unmodified texture coordinate input straight to 'tex2D', so it can take the result of a previous pass from a register instead.
+		/// </summary>
+		bool reads_backbuffer_pointwise = false;
+		/// <summary>
+		/// The samplers of the back buffer the pixel shader reads.
+		/// </summary>
+		std::unordered_set<const nodes::variable_declaration_node *> backbuffer_samplers;
+	};
+
+	/// <summary>
+	/// Find out whether the pixel shader of a pass can be fused with the passes of other techniques.
+	/// Only passes that replace the back buffer can be fused, the first of them may sample the back buffer anywhere, all others have to read it pointwise.
+	/// </summary>
+	/// <param name="pass">The pass to analyze.</param>
+	/// <param name="info">The result of the analysis.</param>
+	void analyze_pass_fusion(const nodes::pass_declaration_node *pass, pass_fusion_info &info);
+}
@@ -4,7 +4,14 @@
  */
 
 #include "effect_lexer.hpp"
-#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <initializer_list>
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace reshadefx
 {
@@ -32,7 +39,69 @@ namespace reshadefx
 			IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT,
 			IDENT, IDENT, IDENT,   '{',   '|',   '}',   '~',  0x00,  0x00,  0x00,
 		};
-		const std::unordered_map<std::string, tokenid> keyword_lookup = {
+		/// <summary>
+		/// A fixed-size open addressing hash table for looking up keywords, which does not allocate and compares string views directly.
+		/// </summary>
+		class keyword_table
+		{
+			// Power of two, a few times larger than the keyword list, so almost every lookup ends on its first slot
+			static constexpr size_t SIZE = 512;
+
+		public:
+			keyword_table(std::initializer_list<std::pair<std::string_view, tokenid>> keywords)
+			{
+				for (const auto &keyword : keywords)
+				{
+					size_t index = hash(keyword.first);
+
+					while (!_slots[index].first.empty() && _slots[index].first != keyword.first)
+					{
+						index = (index + 1) & (SIZE - 1);
+					}
+
+					if (_slots[index].first.empty())
+					{
+						_slots[index] = keyword;
+					}
+				}
+			}
+
+			/// <summary>
+			/// Look up the token of a keyword.
+			/// </summary>
+			/// <param name="name">The identifier to look up.</param>
+			/// <param name="fallback">The token to return if the identifier is not a keyword.</param>
+			tokenid find(std::string_view name, tokenid fallback) const
+			{
+				for (size_t index = hash(name); !_slots[index].first.empty(); index = (index + 1) & (SIZE - 1))
+				{
+					if (_slots[index].first == name)
+					{
+						return _slots[index].second;
+					}
+				}
+
+				return fallback;
+			}
+
+		private:
+			static size_t hash(std::string_view name)
+			{
+				// FNV-1a, keywords are short so this is cheaper than the generic string hash
+				uint32_t value = 2166136261u;
+
+				for (const char c : name)
+				{
+					value = (value ^ static_cast<unsigned char>(c)) * 16777619u;
+				}
+
+				return (value ^ (value >> 16)) & (SIZE - 1);
+			}
+
+			std::pair<std::string_view, tokenid> _slots[SIZE] = { };
+		};
+
+		const keyword_table keyword_lookup = {
 			{ "asm", tokenid::reserved },
 			{ "asm_fragment", tokenid::reserved },
 			{ "auto", tokenid::reserved },
@@ -87,7 +156,7 @@ namespace reshadefx
 			{ "friend", tokenid::reserved },
 			{ "globallycoherent", tokenid::reserved },
 			{ "goto", tokenid::reserved },
-			{ "groupshared", tokenid::reserved },
+			{ "groupshared", tokenid::groupshared },
 			{ "half", tokenid::reserved },
 			{ "half2", tokenid::reserved },
 			{ "half2x2", tokenid::reserved },
@@ -153,6 +222,8 @@ namespace reshadefx
 			{ "snorm", tokenid::reserved },
 			{ "static", tokenid::static_ },
 			{ "static_cast", tokenid::reserved },
+			{ "storage", tokenid::storage },
+			{ "storage2D", tokenid::storage },
 			{ "string", tokenid::string_ },
 			{ "struct", tokenid::struct_ },
 			{ "switch", tokenid::switch_ },
@@ -195,7 +266,7 @@ namespace reshadefx
 			{ "volatile", tokenid::volatile_ },
 			{ "while", tokenid::while_ }
 		};
-		const std::unordered_map<std::string, tokenid> pp_directive_lookup = {
+		const keyword_table pp_directive_lookup = {
 			{ "define", tokenid::hash_def },
 			{ "undef", tokenid::hash_undef },
 			{ "if", tokenid::hash_if },
@@ -210,6 +281,71 @@ namespace reshadefx
 			{ "include", tokenid::hash_include },
 		};
 
+		inline unsigned int bit_scan_forward(unsigned int mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		/// <summary>
+		/// Find the first occurrence of either of two characters, comparing 16 characters at a time.
+		/// </summary>
+		const char *find_first_of(const char *begin, const char *end, char a, char b)
+		{
+			const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+
+			for (; end - begin >= 16; begin += 16)
+			{
+				const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+				const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(data, va), _mm_cmpeq_epi8(data, vb)));
+
+				if (mask != 0)
+				{
+					return begin + bit_scan_forward(mask);
+				}
+			}
+
+			while (begin < end && *begin != a && *begin != b)
+			{
+				begin++;
+			}
+
+			return begin;
+		}
+		/// <summary>
+		/// Find the first character that is not whitespace (excluding new lines), comparing 16 characters at a time.
+		/// </summary>
+		const char *find_first_not_space(const char *begin, const char *end)
+		{
+			const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), vtab = _mm_set1_epi8('\v'), feed = _mm_set1_epi8('\f'), ret = _mm_set1_epi8('\r');
+
+			for (; end - begin >= 16; begin += 16)
+			{
+				const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+				const __m128i is_space = _mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(data, space), _mm_cmpeq_epi8(data, tab)),
+					_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(data, vtab), _mm_cmpeq_epi8(data, feed)), _mm_cmpeq_epi8(data, ret)));
+				const int mask = ~_mm_movemask_epi8(is_space) & 0xFFFF;
+
+				if (mask != 0)
+				{
+					return begin + bit_scan_forward(mask);
+				}
+			}
+
+			while (begin < end && type_lookup[static_cast<unsigned char>(*begin)] == SPACE)
+			{
+				begin++;
+			}
+
+			return begin;
+		}
+
 		inline bool is_octal_digit(char c)
 		{
 			return static_cast<unsigned>(c - '0') < 8;
@@ -259,39 +395,18 @@ namespace reshadefx
 	}
 
 	lexer::lexer(const std::string &source, bool ignore_whitespace, bool ignore_pp_directives, bool ignore_keywords, bool escape_string_literals) :
-		_input(source),
+		lexer(std::make_shared<const std::string>(source), ignore_whitespace, ignore_pp_directives, ignore_keywords, escape_string_literals)
+	{
+	}
+	lexer::lexer(std::shared_ptr<const std::string> source, bool ignore_whitespace, bool ignore_pp_directives, bool ignore_keywords, bool escape_string_literals) :
+		_input(std::move(source)),
 		_ignore_whitespace(ignore_whitespace),
 		_ignore_pp_directives(ignore_pp_directives),
 		_ignore_keywords(ignore_keywords),
 		_escape_string_literals(escape_string_literals)
 	{
-		_cur = _input.data();
-		_end = _cur + _input.size();
-	}
-	lexer::lexer(const lexer &lexer) :
-		_input(lexer._input),
-		_cur_location(lexer._cur_location),
-		_ignore_whitespace(lexer._ignore_whitespace),
-		_ignore_pp_directives(lexer._ignore_pp_directives),
-		_ignore_keywords(lexer._ignore_keywords),
-		_escape_string_literals(lexer._escape_string_literals)
-	{
-		_cur = _input.data() + (lexer._cur - lexer._input.data());
-		_end = _input.data() + _input.size();
-	}
-
-	lexer &lexer::operator=(const lexer &lexer)
-	{
-		_input = lexer._input;
-		_cur_location = lexer._cur_location;
-		_cur = _input.data() + (lexer._cur - lexer._input.data());
-		_end = _input.data() + _input.size();
-		_ignore_whitespace = lexer._ignore_whitespace;
-		_ignore_pp_directives = lexer._ignore_pp_directives;
-		_ignore_keywords = lexer._ignore_keywords;
-		_escape_string_literals = lexer._escape_string_literals;
-
-		return *this;
+		_cur = _input->data();
+		_end = _cur + _input->size();
 	}
 
 	token lexer::lex()
@@ -300,7 +415,7 @@ namespace reshadefx
 		token tok;
 	next_token:
 		tok.location = _cur_location;
-		tok.offset = _cur - _input.data();
+		tok.offset = _cur - _input->data();
 		tok.length = 1;
 		tok.literal_as_double = 0;
 
@@ -428,19 +543,32 @@ namespace reshadefx
 				}
 				else if (_cur[1] == '*')
 				{
+					skip(2);
+
+					// Only line breaks and the end marker are of interest inside a block comment, so jump straight to the next one of those
 					while (_cur < _end)
 					{
-						if (*_cur == '\n')
+						skip(find_first_of(_cur, _end, '*', '\n') - _cur);
+
+						if (_cur >= _end)
+						{
+							break;
+						}
+						else if (*_cur == '\n')
 						{
+							_cur++;
 							_cur_location.line++;
 							_cur_location.column = 1;
 						}
-						else if (_cur[0] == '*' && _cur[1] == '/')
+						else if (_cur[1] == '/')
 						{
 							skip(2);
 							break;
 						}
-						skip(1);
+						else
+						{
+							skip(1);
+						}
 					}
 					goto next_token;
 				}
@@ -553,16 +681,26 @@ namespace reshadefx
 	}
 	void lexer::skip_space()
 	{
-		while (type_lookup[*_cur] == SPACE && _cur < _end)
-		{
-			skip(1);
-		}
+		skip(find_first_not_space(_cur, _end) - _cur);
 	}
 	void lexer::skip_to_next_line()
 	{
-		while (*_cur != '\n' && _cur < _end)
+		const auto next = static_cast<const char *>(std::memchr(_cur, '\n', _end - _cur));
+
+		skip((next != nullptr ? next : _end) - _cur);
+	}
+
+	void lexer::convert_to_default(token &tok, const std::string &raw_data)
+	{
+		if (tok.id == tokenid::identifier)
+		{
+			tok.id = keyword_lookup.find(tok.literal_as_string, tokenid::identifier);
+		}
+		else if (tok.id == tokenid::string_literal)
 		{
-			skip(1);
+			tok.literal_as_string.clear();
+
+			lexer(raw_data).parse_string_literal(tok, true);
 		}
 	}
 
@@ -581,12 +719,7 @@ namespace reshadefx
 			return;
 		}
 
-		const auto it = keyword_lookup.find(tok.literal_as_string);
-
-		if (it != keyword_lookup.end())
-		{
-			tok.id = it->second;
-		}
+		tok.id = keyword_lookup.find(tok.literal_as_string, tokenid::identifier);
 	}
 	bool lexer::parse_pp_directive(token &tok)
 	{
@@ -594,12 +727,10 @@ namespace reshadefx
 		skip_space();
 		parse_identifier(tok);
 
-		const auto it = pp_directive_lookup.find(tok.literal_as_string);
+		tok.id = pp_directive_lookup.find(tok.literal_as_string, tokenid::hash_unknown);
 
-		if (it != pp_directive_lookup.end())
+		if (tok.id != tokenid::hash_unknown)
 		{
-			tok.id = it->second;
-
 			return true;
 		}
 		else if (tok.literal_as_string == "line")
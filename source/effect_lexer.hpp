@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <memory>
 #include "source_location.hpp"
 
 namespace reshadefx
@@ -107,6 +108,7 @@ namespace reshadefx
 		uniform_,
 		volatile_,
 		precise,
+		groupshared,
 		in,
 		out,
 		inout,
@@ -150,6 +152,7 @@ namespace reshadefx
 		string_,
 		texture,
 		sampler,
+		storage,
 
 		// preprocessor directives
 		hash_def,
@@ -204,17 +207,28 @@ namespace reshadefx
 			bool ignore_keywords = false,
 			bool escape_string_literals = true);
 		/// <summary>
+		/// Construct a new lexical analyzer for an input string that is shared with others instead of copied.
+		/// </summary>
+		/// <param name="source">The string to analyze. It must not be modified while any lexer refers to it.</param>
+		explicit lexer(
+			std::shared_ptr<const std::string> input,
+			bool ignore_whitespace = true,
+			bool ignore_pp_directives = true,
+			bool ignore_keywords = false,
+			bool escape_string_literals = true);
+		/// <summary>
 		/// Construct a copy of an existing instance.
+		/// This only copies the position in the input, which is shared between both.
 		/// </summary>
 		/// <param name="lexer">The instance to copy.</param>
-		lexer(const lexer &lexer);
-		lexer &operator=(const lexer &);
+		lexer(const lexer &lexer) = default;
+		lexer &operator=(const lexer &) = default;
 
 		/// <summary>
 		/// Get the input string this lexical analyzer works on.
 		/// </summary>
 		/// <returns>A constant reference to the input string.</returns>
-		inline const std::string &input_string() const { return _input; }
+		inline const std::string &input_string() const { return *_input; }
 
 		/// <summary>
 		/// Perform lexical analysis on the input string and return the next token in sequence.
@@ -227,6 +241,12 @@ namespace reshadefx
 		/// </summary>
 		void skip_space();
 		/// <summary>
+		/// Turn an identifier or string literal that was lexed with keywords or escapes ignored into the token a lexer with default settings would have returned.
+		/// </summary>
+		/// <param name="tok">The token to convert.</param>
+		/// <param name="raw_data">The input characters the token was lexed from.</param>
+		static void convert_to_default(token &tok, const std::string &raw_data);
+		/// <summary>
 		/// Advances to the next new line, ignoring all tokens.
 		/// </summary>
 		void skip_to_next_line();
@@ -243,7 +263,7 @@ namespace reshadefx
 		void parse_string_literal(token &tok, bool escape) const;
 		void parse_numeric_literal(token &tok) const;
 
-		std::string _input;
+		std::shared_ptr<const std::string> _input;
 		location _cur_location;
 		const std::string::value_type *_cur, *_end;
 		bool _ignore_whitespace;
@@ -0,0 +1,264 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <new>
+#include <list>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <type_traits>
+#include <unordered_set>
+#include <algorithm>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// An immutable, null-terminated string owned by a <see cref="memory_pool"/>, which stays valid for as long as the pool does. Only <see cref="memory_pool::intern"/> creates non-empty ones.
+	/// It has the reading part of the standard string interface and converts to a standard string where one is needed, so code reading names from syntax tree nodes can treat it like one.
+	/// </summary>
+	class pool_string
+	{
+		friend class memory_pool;
+
+		pool_string(const char *data, size_t size) : _data(data), _size(size) { }
+
+	public:
+		static constexpr size_t npos = std::string_view::npos;
+
+		pool_string() : _data(""), _size(0) { }
+
+		const char *c_str() const { return _data; }
+		const char *data() const { return _data; }
+		size_t size() const { return _size; }
+		size_t length() const { return _size; }
+		bool empty() const { return _size == 0; }
+
+		const char *begin() const { return _data; }
+		const char *end() const { return _data + _size; }
+		char operator[](size_t index) const { return _data[index]; }
+		char front() const { return _data[0]; }
+		char back() const { return _data[_size - 1]; }
+
+		int compare(std::string_view other) const { return view().compare(other); }
+		int compare(size_t pos, size_t count, std::string_view other) const { return view().compare(pos, count, other); }
+		size_t find(char c, size_t pos = 0) const { return view().find(c, pos); }
+		size_t find(std::string_view other, size_t pos = 0) const { return view().find(other, pos); }
+		size_t rfind(char c, size_t pos = npos) const { return view().rfind(c, pos); }
+		size_t rfind(std::string_view other, size_t pos = npos) const { return view().rfind(other, pos); }
+		size_t find_first_of(std::string_view chars, size_t pos = 0) const { return view().find_first_of(chars, pos); }
+		size_t find_last_of(std::string_view chars, size_t pos = npos) const { return view().find_last_of(chars, pos); }
+		std::string substr(size_t pos = 0, size_t count = npos) const { return std::string(view().substr(pos, count)); }
+
+		operator std::string_view() const { return view(); }
+		operator std::string() const { return std::string(_data, _size); }
+
+		friend bool operator==(const pool_string &lhs, const pool_string &rhs) { return lhs.view() == rhs.view(); }
+		friend bool operator==(const pool_string &lhs, std::string_view rhs) { return lhs.view() == rhs; }
+		friend bool operator==(std::string_view lhs, const pool_string &rhs) { return lhs == rhs.view(); }
+		friend bool operator!=(const pool_string &lhs, const pool_string &rhs) { return lhs.view() != rhs.view(); }
+		friend bool operator!=(const pool_string &lhs, std::string_view rhs) { return lhs.view() != rhs; }
+		friend bool operator!=(std::string_view lhs, const pool_string &rhs) { return lhs != rhs.view(); }
+		friend bool operator<(const pool_string &lhs, const pool_string &rhs) { return lhs.view() < rhs.view(); }
+
+		// Concatenation creates a standard string, since pool strings cannot change
+		friend std::string operator+(const pool_string &lhs, const pool_string &rhs) { return concat(lhs.view(), rhs.view()); }
+		friend std::string operator+(const pool_string &lhs, std::string_view rhs) { return concat(lhs.view(), rhs); }
+		friend std::string operator+(std::string_view lhs, const pool_string &rhs) { return concat(lhs, rhs.view()); }
+		friend std::string operator+(const pool_string &lhs, char rhs) { return concat(lhs.view(), std::string_view(&rhs, 1)); }
+		friend std::string operator+(char lhs, const pool_string &rhs) { return concat(std::string_view(&lhs, 1), rhs.view()); }
+
+		friend std::ostream &operator<<(std::ostream &stream, const pool_string &string) { return stream << string.view(); }
+
+	private:
+		std::string_view view() const { return std::string_view(_data, _size); }
+
+		static std::string concat(std::string_view lhs, std::string_view rhs)
+		{
+			std::string result;
+			result.reserve(lhs.size() + rhs.size());
+			result.append(lhs);
+			result.append(rhs);
+			return result;
+		}
+
+		const char *_data;
+		size_t _size;
+	};
+
+	/// <summary>
+	/// An arena that hands out memory from large pages and releases all of it at once when it is destroyed, instead of making many small heap allocations.
+	/// </summary>
+	class memory_pool
+	{
+		memory_pool(const memory_pool &) = delete;
+		memory_pool &operator=(const memory_pool &) = delete;
+
+		static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+		static constexpr size_t PAGE_SIZE = 64 * 1024;
+
+		struct page
+		{
+			// Pages start out zeroed, syntax tree nodes rely on members they do not initialize being null
+			explicit page(size_t size) : cursor(0), size(size), memory(new unsigned char[size]()) { }
+
+			size_t cursor, size;
+			std::unique_ptr<unsigned char[]> memory;
+		};
+		struct header
+		{
+			// Size of the allocation including this header, so the next one can be found when destroying them
+			size_t size;
+			void(*dtor)(void *);
+		};
+
+		static constexpr size_t align(size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+		static void *data(header *block) { return reinterpret_cast<unsigned char *>(block) + align(sizeof(header)); }
+
+	public:
+		/// <summary>
+		/// A standard library allocator that draws from a memory pool. Deallocation does nothing, the memory is only released with the pool.
+		/// </summary>
+		template <typename T>
+		struct allocator
+		{
+			using value_type = T;
+
+			allocator(memory_pool &pool) : pool(&pool) { }
+			template <typename U>
+			allocator(const allocator<U> &other) : pool(other.pool) { }
+
+			T *allocate(size_t count) { return static_cast<T *>(pool->allocate(count * sizeof(T))); }
+			void deallocate(T *, size_t) { }
+
+			template <typename U>
+			bool operator==(const allocator<U> &other) const { return pool == other.pool; }
+			template <typename U>
+			bool operator!=(const allocator<U> &other) const { return pool != other.pool; }
+
+			memory_pool *pool;
+		};
+
+		// Pool allocators are bound to one pool, so containers keep theirs when another container is assigned to them
+		template <typename T>
+		using vector = std::vector<T, allocator<T>>;
+
+		memory_pool() : _strings(allocator<std::string_view>(*this)) { }
+		~memory_pool()
+		{
+			// Destroy all objects, the pages themselves are freed afterwards together with the member list
+			for (auto &page : _pages)
+			{
+				for (size_t offset = 0; offset < page.cursor;)
+				{
+					const auto block = reinterpret_cast<header *>(page.memory.get() + offset);
+
+					if (block->dtor != nullptr)
+					{
+						block->dtor(data(block));
+					}
+
+					offset += block->size;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Construct a new object in the pool. It is destroyed together with the pool.
+		/// Types that can be constructed from a pool get this one, so the containers they own allocate from it too.
+		/// </summary>
+		template <typename T>
+		T *add()
+		{
+			const auto block = allocate_block(sizeof(T));
+			T *object;
+			if constexpr (std::is_constructible_v<T, memory_pool &>)
+				object = new (data(block)) T(*this);
+			else
+				object = new (data(block)) T();
+			block->dtor = [](void *memory) { static_cast<T *>(memory)->~T(); };
+
+			return object;
+		}
+		/// <summary>
+		/// Allocate uninitialized memory in the pool, aligned for any type.
+		/// </summary>
+		/// <param name="size">The number of bytes to allocate.</param>
+		void *allocate(size_t size)
+		{
+			return data(allocate_block(size));
+		}
+		/// <summary>
+		/// Return a copy of the string that is owned by the pool, reusing an existing one with the same contents.
+		/// </summary>
+		/// <param name="string">The string to look up.</param>
+		pool_string intern(std::string_view string)
+		{
+			if (string.empty())
+			{
+				return pool_string();
+			}
+
+			auto it = _strings.find(string);
+
+			if (it == _strings.end())
+			{
+				// Copies are null-terminated, so they can be passed to functions that expect a C string
+				const auto copy = static_cast<char *>(allocate(string.size() + 1));
+				std::copy(string.begin(), string.end(), copy);
+				copy[string.size()] = '\0';
+
+				it = _strings.emplace(copy, string.size()).first;
+			}
+
+			return pool_string(it->data(), it->size());
+		}
+
+		/// <summary>
+		/// Get the number of bytes the pool reserved for its pages.
+		/// </summary>
+		size_t size() const
+		{
+			size_t size = 0;
+
+			for (const auto &page : _pages)
+			{
+				size += page.size;
+			}
+
+			return size;
+		}
+
+	private:
+		header *allocate_block(size_t size)
+		{
+			size = align(sizeof(header)) + align(size);
+
+			// Only the last page is considered, earlier ones are full or were left for a large allocation
+			if (_pages.empty() || _pages.back().cursor + size > _pages.back().size)
+			{
+				_pages.emplace_back(std::max(PAGE_SIZE, size));
+			}
+
+			auto &page = _pages.back();
+
+			const auto block = reinterpret_cast<header *>(page.memory.get() + page.cursor);
+			block->size = size;
+			block->dtor = nullptr;
+
+			page.cursor += size;
+
+			return block;
+		}
+
+		// Declared first, so it outlives the containers below that allocate from it
+		std::list<page> _pages;
+		std::unordered_set<std::string_view, std::hash<std::string_view>, std::equal_to<std::string_view>, allocator<std::string_view>> _strings;
+	};
+}
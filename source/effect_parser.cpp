@@ -6,6 +6,7 @@
 #include "effect_parser.hpp"
 #include "effect_symbol_table.hpp"
 #include <algorithm>
+#include <assert.h>
 
 namespace reshadefx
 {
@@ -187,6 +188,8 @@ namespace reshadefx
 				return "volatile";
 			case tokenid::precise:
 				return "precise";
+			case tokenid::groupshared:
+				return "groupshared";
 			case tokenid::in:
 				return "in";
 			case tokenid::out:
@@ -247,6 +250,8 @@ namespace reshadefx
 				return "texture";
 			case tokenid::sampler:
 				return "sampler";
+			case tokenid::storage:
+				return "storage";
 		}
 	}
 
@@ -261,8 +266,24 @@ namespace reshadefx
 
 	bool parser::run(const std::string &input)
 	{
-		_lexer.reset(new lexer(input));
-		_lexer_backup.reset();
+		lexer lexer(input);
+
+		_source_tokens.clear();
+
+		do
+		{
+			_source_tokens.push_back(lexer.lex());
+		}
+		while (_source_tokens.back().id != tokenid::end_of_file);
+
+		return run(_source_tokens);
+	}
+	bool parser::run(const std::vector<token> &tokens)
+	{
+		assert(!tokens.empty() && tokens.back().id == tokenid::end_of_file);
+
+		_tokens = &tokens;
+		_token_index = 0;
 
 		consume();
 
@@ -274,8 +295,58 @@ namespace reshadefx
 			}
 		}
 
+		apply_render_scales();
+
 		return true;
 	}
+	void parser::apply_render_scales()
+	{
+		std::unordered_map<const variable_declaration_node *, float> scales;
+
+		for (const auto technique : _ast.techniques)
+		{
+			float scale = 1.0f;
+
+			if (const auto it = technique->annotation_list.find("render_scale"); it != technique->annotation_list.end())
+			{
+				scale = std::min(std::max(it->second.as<float>(), 0.1f), 1.0f);
+			}
+
+			for (const auto pass : technique->pass_list)
+			{
+				for (const auto target : pass->render_targets)
+				{
+					if (target == nullptr)
+					{
+						continue;
+					}
+
+					// A texture that any full resolution technique renders to keeps its size, otherwise the largest scale of its writers is used
+					if (const auto it = scales.find(target); it == scales.end() || (it->second < 1.0f && (scale == 1.0f || scale > it->second)))
+					{
+						scales[target] = scale;
+					}
+				}
+			}
+		}
+
+		// Shrink the render targets of reduced scale techniques, passes that sample them afterwards (like the final one writing to the back buffer) upscale them through filtering
+		for (const auto variable : _ast.variables)
+		{
+			if (const auto it = scales.find(variable); it != scales.end() && it->second < 1.0f && variable->semantic.empty())
+			{
+				variable->properties.width = std::max(1u, static_cast<unsigned int>(variable->properties.width * it->second + 0.5f));
+				variable->properties.height = std::max(1u, static_cast<unsigned int>(variable->properties.height * it->second + 0.5f));
+
+				// The smaller size may not allow as many mipmap levels as the original one did
+				unsigned int max_levels = 1;
+				for (unsigned int size = std::max(variable->properties.width, variable->properties.height); size > 1; size /= 2)
+					max_levels++;
+
+				variable->properties.levels = std::min(variable->properties.levels, max_levels);
+			}
+		}
+	}
 
 	// Error handling
 	void parser::error(const location &location, unsigned int code, const std::string &message)
@@ -312,13 +383,12 @@ namespace reshadefx
 	// Input management
 	void parser::backup()
 	{
-		_lexer.swap(_lexer_backup);
-		_lexer.reset(new lexer(*_lexer_backup));
+		_token_index_backup = _token_index;
 		_token_backup = _token_next;
 	}
 	void parser::restore()
 	{
-		_lexer.swap(_lexer_backup);
+		_token_index = _token_index_backup;
 		_token_next = _token_backup;
 	}
 
@@ -329,7 +399,13 @@ namespace reshadefx
 	void parser::consume()
 	{
 		_token = _token_next;
-		_token_next = _lexer->lex();
+		_token_next = (*_tokens)[_token_index];
+
+		// Keep returning the end of file token once it was reached
+		if (_token_index + 1 < _tokens->size())
+		{
+			_token_index++;
+		}
 	}
 	void parser::consume_until(tokenid tokid)
 	{
@@ -611,6 +687,9 @@ namespace reshadefx
 				case tokenid::sampler:
 					type.basetype = type_node::datatype_sampler;
 					break;
+				case tokenid::storage:
+					type.basetype = type_node::datatype_storage;
+					break;
 				default:
 					return false;
 			}
@@ -645,6 +724,10 @@ namespace reshadefx
 		{
 			qualifiers |= type_node::qualifier_precise;
 		}
+		if (accept(tokenid::groupshared))
+		{
+			qualifiers |= type_node::qualifier_groupshared;
+		}
 
 		if (accept(tokenid::in))
 		{
@@ -1125,13 +1208,15 @@ namespace reshadefx
 			literal->type.basetype = type_node::datatype_string;
 			literal->type.qualifiers = type_node::qualifier_const;
 			literal->type.rows = literal->type.cols = 0, literal->type.array_length = 0;
-			literal->value_string = _token.literal_as_string;
+			std::string value = _token.literal_as_string;
 
 			while (accept(tokenid::string_literal))
 			{
-				literal->value_string += _token.literal_as_string;
+				value += _token.literal_as_string;
 			}
 
+			literal->value_string = _ast.make_string(value);
+
 			node = literal;
 			type = literal->type;
 		}
@@ -1266,7 +1351,7 @@ namespace reshadefx
 				}
 
 				const auto callexpression = _ast.make_node<call_expression_node>(location);
-				callexpression->callee_name = identifier;
+				callexpression->callee_name = _ast.make_string(identifier);
 
 				while (!peek(')'))
 				{
@@ -1908,14 +1993,14 @@ namespace reshadefx
 	// Statements
 	bool parser::parse_statement(statement_node *&statement, bool scoped)
 	{
-		std::vector<std::string> attributes;
+		std::vector<pool_string> attributes;
 
 		// Attributes
 		while (accept('['))
 		{
 			if (expect(tokenid::identifier))
 			{
-				const auto attribute = _token.literal_as_string;
+				const auto attribute = _ast.make_string(_token.literal_as_string);
 
 				if (expect(']'))
 				{
@@ -1935,7 +2020,7 @@ namespace reshadefx
 				return false;
 			}
 
-			statement->attributes = attributes;
+			statement->attributes.assign(attributes.begin(), attributes.end());
 
 			return true;
 		}
@@ -1951,7 +2036,7 @@ namespace reshadefx
 		if (accept(tokenid::if_))
 		{
 			const auto newstatement = _ast.make_node<if_statement_node>(_token.location);
-			newstatement->attributes = attributes;
+			newstatement->attributes.assign(attributes.begin(), attributes.end());
 
 			if (!(expect('(') && parse_expression(newstatement->condition) && expect(')')))
 			{
@@ -1985,7 +2070,7 @@ namespace reshadefx
 		if (accept(tokenid::switch_))
 		{
 			const auto newstatement = _ast.make_node<switch_statement_node>(_token.location);
-			newstatement->attributes = attributes;
+			newstatement->attributes.assign(attributes.begin(), attributes.end());
 
 			if (!(expect('(') && parse_expression(newstatement->test_expression) && expect(')')))
 			{
@@ -2069,7 +2154,7 @@ namespace reshadefx
 		if (accept(tokenid::for_))
 		{
 			const auto newstatement = _ast.make_node<for_statement_node>(_token.location);
-			newstatement->attributes = attributes;
+			newstatement->attributes.assign(attributes.begin(), attributes.end());
 
 			if (!expect('('))
 			{
@@ -2142,7 +2227,7 @@ namespace reshadefx
 		if (accept(tokenid::while_))
 		{
 			const auto newstatement = _ast.make_node<while_statement_node>(_token.location);
-			newstatement->attributes = attributes;
+			newstatement->attributes.assign(attributes.begin(), attributes.end());
 			newstatement->is_do_while = false;
 
 			_symbol_table->enter_scope();
@@ -2182,7 +2267,7 @@ namespace reshadefx
 		if (accept(tokenid::do_))
 		{
 			const auto newstatement = _ast.make_node<while_statement_node>(_token.location);
-			newstatement->attributes = attributes;
+			newstatement->attributes.assign(attributes.begin(), attributes.end());
 			newstatement->is_do_while = true;
 
 			if (!(parse_statement(newstatement->statement_list) && expect(tokenid::while_) && expect('(') && parse_expression(newstatement->condition) && expect(')') && expect(';')))
@@ -2207,7 +2292,7 @@ namespace reshadefx
 		if (accept(tokenid::break_))
 		{
 			const auto newstatement = _ast.make_node<jump_statement_node>(_token.location);
-			newstatement->attributes = attributes;
+			newstatement->attributes.assign(attributes.begin(), attributes.end());
 			newstatement->is_break = true;
 
 			statement = newstatement;
@@ -2220,7 +2305,7 @@ namespace reshadefx
 		if (accept(tokenid::continue_))
 		{
 			const auto newstatement = _ast.make_node<jump_statement_node>(_token.location);
-			newstatement->attributes = attributes;
+			newstatement->attributes.assign(attributes.begin(), attributes.end());
 			newstatement->is_continue = true;
 
 			statement = newstatement;
@@ -2233,7 +2318,7 @@ namespace reshadefx
 		if (accept(tokenid::return_))
 		{
 			const auto newstatement = _ast.make_node<return_statement_node>(_token.location);
-			newstatement->attributes = attributes;
+			newstatement->attributes.assign(attributes.begin(), attributes.end());
 			newstatement->is_discard = false;
 
 			const auto parent = static_cast<const function_declaration_node *>(_symbol_table->current_parent());
@@ -2285,7 +2370,7 @@ namespace reshadefx
 		if (accept(tokenid::discard_))
 		{
 			const auto newstatement = _ast.make_node<return_statement_node>(_token.location);
-			newstatement->attributes = attributes;
+			newstatement->attributes.assign(attributes.begin(), attributes.end());
 			newstatement->is_discard = true;
 
 			statement = newstatement;
@@ -2297,7 +2382,7 @@ namespace reshadefx
 		#pragma region Declaration
 		if (parse_statement_declarator_list(statement))
 		{
-			statement->attributes = attributes;
+			statement->attributes.assign(attributes.begin(), attributes.end());
 
 			return expect(';');
 		}
@@ -2309,7 +2394,7 @@ namespace reshadefx
 		if (parse_expression(expression))
 		{
 			const auto newstatement = _ast.make_node<expression_statement_node>(expression->location);
-			newstatement->attributes = attributes;
+			newstatement->attributes.assign(attributes.begin(), attributes.end());
 			newstatement->expression = expression;
 
 			statement = newstatement;
@@ -2594,7 +2679,7 @@ namespace reshadefx
 
 		return true;
 	}
-	bool parser::parse_annotations(std::unordered_map<std::string, reshade::variant> &annotations)
+	bool parser::parse_annotations(annotation_map &annotations)
 	{
 		if (!accept('<'))
 		{
@@ -2615,7 +2700,8 @@ namespace reshadefx
 				return false;
 			}
 
-			const auto name = _token.literal_as_string;
+			// The map only holds a view of the name, so it has to live in the pool of the syntax tree
+			const std::string_view name = _ast.make_string(_token.literal_as_string);
 			literal_expression_node *expression = nullptr;
 
 			if (!(expect('=') && parse_expression_unary(reinterpret_cast<expression_node *&>(expression)) && expect(';')))
@@ -2630,20 +2716,23 @@ namespace reshadefx
 				continue;
 			}
 
+			// Only keep the components the literal actually has, the remaining ones of the value array are zero anyway
+			const size_t component_count = std::max(1u, static_cast<unsigned int>(expression->type.rows * expression->type.cols));
+
 			switch (expression->type.basetype)
 			{
 				case type_node::datatype_int:
-					annotations[name] = expression->value_int;
+					annotations[name] = reshade::variant(expression->value_int, component_count);
 					break;
 				case type_node::datatype_bool:
 				case type_node::datatype_uint:
-					annotations[name] = expression->value_uint;
+					annotations[name] = reshade::variant(expression->value_uint, component_count);
 					break;
 				case type_node::datatype_float:
-					annotations[name] = expression->value_float;
+					annotations[name] = reshade::variant(expression->value_float, component_count);
 					break;
 				case type_node::datatype_string:
-					annotations[name] = expression->value_string;
+					annotations[name] = std::string(expression->value_string);
 					break;
 			}
 		}
@@ -2661,7 +2750,7 @@ namespace reshadefx
 
 		if (accept(tokenid::identifier))
 		{
-			structure->name = _token.literal_as_string;
+			structure->name = _ast.make_string(_token.literal_as_string);
 
 			if (!_symbol_table->insert(structure, true))
 			{
@@ -2672,11 +2761,12 @@ namespace reshadefx
 		}
 		else
 		{
-			structure->name = "__anonymous_struct_" + std::to_string(structure->location.line) + '_' + std::to_string(structure->location.column);
+			structure->name = _ast.make_string("__anonymous_struct_" + std::to_string(structure->location.line) + '_' + std::to_string(structure->location.column));
 		}
 
-		structure->unique_name = 'S' + _symbol_table->current_scope().name + structure->name;
-		std::replace(structure->unique_name.begin(), structure->unique_name.end(), ':', '_');
+		std::string unique_name = 'S' + _symbol_table->current_scope().name + structure->name;
+		std::replace(unique_name.begin(), unique_name.end(), ':', '_');
+		structure->unique_name = _ast.make_string(unique_name);
 
 		if (!expect('{'))
 		{
@@ -2732,7 +2822,7 @@ namespace reshadefx
 				}
 
 				const auto field = _ast.make_node<variable_declaration_node>(_token.location);
-				field->unique_name = field->name = _token.literal_as_string;
+				field->unique_name = field->name = _ast.make_string(_token.literal_as_string);
 				field->type = type;
 
 				if (!parse_array(field->type.array_length))
@@ -2749,8 +2839,9 @@ namespace reshadefx
 						return false;
 					}
 
-					field->semantic = _token.literal_as_string;
-					std::transform(field->semantic.begin(), field->semantic.end(), field->semantic.begin(), ::toupper);
+					std::string semantic = _token.literal_as_string;
+					std::transform(semantic.begin(), semantic.end(), semantic.begin(), ::toupper);
+					field->semantic = _ast.make_string(semantic);
 				}
 
 				structure->field_list.push_back(std::move(field));
@@ -2793,10 +2884,11 @@ namespace reshadefx
 		function = _ast.make_node<function_declaration_node>(location);
 		function->return_type = type;
 		function->return_type.qualifiers = type_node::qualifier_const;
-		function->name = name;
+		function->name = _ast.make_string(name);
 
-		function->unique_name = 'F' + _symbol_table->current_scope().name + function->name;
-		std::replace(function->unique_name.begin(), function->unique_name.end(), ':', '_');
+		std::string unique_name = 'F' + _symbol_table->current_scope().name + function->name;
+		std::replace(unique_name.begin(), unique_name.end(), ':', '_');
+		function->unique_name = _ast.make_string(unique_name);
 
 		_symbol_table->insert(function, true);
 
@@ -2829,7 +2921,7 @@ namespace reshadefx
 				return false;
 			}
 
-			parameter->unique_name = parameter->name = _token.literal_as_string;
+			parameter->unique_name = parameter->name = _ast.make_string(_token.literal_as_string);
 			parameter->location = _token.location;
 
 			if (parameter->type.is_void())
@@ -2904,8 +2996,9 @@ namespace reshadefx
 					return false;
 				}
 
-				parameter->semantic = _token.literal_as_string;
-				std::transform(parameter->semantic.begin(), parameter->semantic.end(), parameter->semantic.begin(), ::toupper);
+				std::string semantic = _token.literal_as_string;
+				std::transform(semantic.begin(), semantic.end(), semantic.begin(), ::toupper);
+				parameter->semantic = _ast.make_string(semantic);
 			}
 
 			function->parameter_list.push_back(parameter);
@@ -2927,8 +3020,9 @@ namespace reshadefx
 				return false;
 			}
 
-			function->return_semantic = _token.literal_as_string;
-			std::transform(function->return_semantic.begin(), function->return_semantic.end(), function->return_semantic.begin(), ::toupper);
+			std::string semantic = _token.literal_as_string;
+			std::transform(semantic.begin(), semantic.end(), semantic.begin(), ::toupper);
+			function->return_semantic = _ast.make_string(semantic);
 
 			if (type.is_void())
 			{
@@ -2970,9 +3064,18 @@ namespace reshadefx
 
 		if (parent == nullptr)
 		{
-			if (!type.has_qualifier(type_node::qualifier_static))
+			if (type.has_qualifier(type_node::qualifier_groupshared))
 			{
-				if (!type.has_qualifier(type_node::qualifier_uniform) && !(type.is_texture() || type.is_sampler()))
+				if (type.has_qualifier(type_node::qualifier_uniform) || type.has_qualifier(type_node::qualifier_const) || !type.is_numeric())
+				{
+					error(location, 3010, "variables which are 'groupshared' must be numeric and cannot be declared 'uniform' or 'const'");
+
+					return false;
+				}
+			}
+			else if (!type.has_qualifier(type_node::qualifier_static))
+			{
+				if (!type.has_qualifier(type_node::qualifier_uniform) && !(type.is_texture() || type.is_sampler() || type.is_storage()))
 				{
 					warning(location, 5000, "global variables are considered 'uniform' by default");
 				}
@@ -3002,9 +3105,15 @@ namespace reshadefx
 				return false;
 			}
 
-			if (type.is_texture() || type.is_sampler())
+			if (type.has_qualifier(type_node::qualifier_groupshared))
 			{
-				error(location, 3038, "local variables cannot be textures or samplers");
+				error(location, 3010, "local variables cannot be declared 'groupshared'");
+
+				return false;
+			}
+			if (type.is_texture() || type.is_sampler() || type.is_storage())
+			{
+				error(location, 3038, "local variables cannot be textures, samplers or storage objects");
 
 				return false;
 			}
@@ -3017,12 +3126,13 @@ namespace reshadefx
 
 		variable = _ast.make_node<variable_declaration_node>(location);
 		variable->type = type;
-		variable->name = name;
+		variable->name = _ast.make_string(name);
 
 		if (global)
 		{
-			variable->unique_name = (type.has_qualifier(type_node::qualifier_uniform) ? 'U' : 'V') + _symbol_table->current_scope().name + variable->name;
-			std::replace(variable->unique_name.begin(), variable->unique_name.end(), ':', '_');
+			std::string unique_name = (type.has_qualifier(type_node::qualifier_uniform) ? 'U' : 'V') + _symbol_table->current_scope().name + variable->name;
+			std::replace(unique_name.begin(), unique_name.end(), ':', '_');
+			variable->unique_name = _ast.make_string(unique_name);
 		}
 		else
 		{
@@ -3043,8 +3153,9 @@ namespace reshadefx
 				return false;
 			}
 
-			variable->semantic = _token.literal_as_string;
-			std::transform(variable->semantic.begin(), variable->semantic.end(), variable->semantic.begin(), ::toupper);
+			std::string semantic = _token.literal_as_string;
+			std::transform(semantic.begin(), semantic.end(), semantic.begin(), ::toupper);
+			variable->semantic = _ast.make_string(semantic);
 
 			return true;
 		}
@@ -3058,6 +3169,13 @@ namespace reshadefx
 		{
 			location = _token.location;
 
+			if (type.has_qualifier(type_node::qualifier_groupshared))
+			{
+				error(location, 3009, "variables which are 'groupshared' cannot have an initial value");
+
+				return false;
+			}
+
 			if (!parse_variable_assignment(variable->initializer_expression))
 			{
 				return false;
@@ -3103,6 +3221,11 @@ namespace reshadefx
 			{
 				warning(location, 3206, "implicit truncation of vector type");
 			}
+
+			if (parent == nullptr && _uniform_callback != nullptr && type.has_qualifier(type_node::qualifier_uniform))
+			{
+				_uniform_callback(variable);
+			}
 		}
 		else if (type.is_numeric())
 		{
@@ -3112,7 +3235,7 @@ namespace reshadefx
 
 				return false;
 			}
-			else if (!type.has_qualifier(type_node::qualifier_uniform) && !type.is_array())
+			else if (!type.has_qualifier(type_node::qualifier_uniform) && !type.has_qualifier(type_node::qualifier_groupshared) && !type.is_array())
 			{
 				const auto zero_initializer = _ast.make_node<literal_expression_node>(location);
 				zero_initializer->type = type;
@@ -3129,7 +3252,7 @@ namespace reshadefx
 			}
 		}
 
-		if (type.is_sampler() && variable->properties.texture == nullptr)
+		if ((type.is_sampler() || type.is_storage()) && variable->properties.texture == nullptr)
 		{
 			error(location, 3012, "missing 'Texture' property for '" + name + "'");
 
@@ -3413,10 +3536,11 @@ namespace reshadefx
 		}
 
 		technique = _ast.make_node<technique_declaration_node>(location);
-		technique->name = _token.literal_as_string;
+		technique->name = _ast.make_string(_token.literal_as_string);
 
-		technique->unique_name = 'T' + _symbol_table->current_scope().name + technique->name;
-		std::replace(technique->unique_name.begin(), technique->unique_name.end(), ':', '_');
+		std::string unique_name = 'T' + _symbol_table->current_scope().name + technique->name;
+		std::replace(unique_name.begin(), unique_name.end(), ':', '_');
+		technique->unique_name = _ast.make_string(unique_name);
 
 		if (!parse_annotations(technique->annotation_list))
 		{
@@ -3453,7 +3577,7 @@ namespace reshadefx
 
 		if (accept(tokenid::identifier))
 		{
-			pass->unique_name = pass->name = _token.literal_as_string;
+			pass->unique_name = pass->name = _ast.make_string(_token.literal_as_string);
 		}
 
 		if (!expect('{'))
@@ -3478,7 +3602,7 @@ namespace reshadefx
 				return false;
 			}
 
-			if (passstate == "VertexShader" || passstate == "PixelShader")
+			if (passstate == "VertexShader" || passstate == "PixelShader" || passstate == "ComputeShader")
 			{
 				if (value->id != nodeid::lvalue_expression || static_cast<lvalue_expression_node *>(value)->reference->id != nodeid::function_declaration)
 				{
@@ -3487,7 +3611,7 @@ namespace reshadefx
 					return false;
 				}
 
-				(passstate[0] == 'V' ? pass->vertex_shader : pass->pixel_shader) = reinterpret_cast<const function_declaration_node *>(static_cast<lvalue_expression_node *>(value)->reference);
+				(passstate[0] == 'V' ? pass->vertex_shader : passstate[0] == 'P' ? pass->pixel_shader : pass->compute_shader) = reinterpret_cast<const function_declaration_node *>(static_cast<lvalue_expression_node *>(value)->reference);
 			}
 			else if (passstate.compare(0, 12, "RenderTarget") == 0 && (passstate == "RenderTarget" || (passstate[12] >= '0' && passstate[12] < '8')))
 			{
@@ -3599,6 +3723,19 @@ namespace reshadefx
 				{
 					scalar_literal_cast(value_literal, 0, pass->stencil_op_depth_fail);
 				}
+				else if ((passstate.compare(0, 12, "DispatchSize") == 0 && passstate.size() == 13) || (passstate.compare(0, 15, "ThreadGroupSize") == 0 && passstate.size() == 16))
+				{
+					const char dimension = passstate.back();
+
+					if (dimension < 'X' || dimension > 'Z')
+					{
+						error(location, 3004, "unrecognized pass state '" + passstate + "'");
+
+						return false;
+					}
+
+					scalar_literal_cast(value_literal, 0, (passstate[0] == 'D' ? pass->dispatch_size : pass->thread_group_size)[dimension - 'X']);
+				}
 				else
 				{
 					error(location, 3004, "unrecognized pass state '" + passstate + "'");
@@ -3608,6 +3745,23 @@ namespace reshadefx
 			}
 		}
 
+		if (pass->compute_shader != nullptr)
+		{
+			if (pass->vertex_shader != nullptr || pass->pixel_shader != nullptr || std::any_of(std::begin(pass->render_targets), std::end(pass->render_targets), [](const variable_declaration_node *target) { return target != nullptr; }))
+			{
+				error(pass->location, 3020, "compute passes cannot have a vertex shader, pixel shader or render targets, write to storage objects instead");
+
+				return false;
+			}
+
+			if (pass->thread_group_size[0] * pass->thread_group_size[1] * pass->thread_group_size[2] == 0 || pass->thread_group_size[0] * pass->thread_group_size[1] * pass->thread_group_size[2] > 1024 || pass->thread_group_size[2] > 64 || pass->dispatch_size[2] == 0)
+			{
+				error(pass->location, 3020, "invalid thread group or dispatch size");
+
+				return false;
+			}
+		}
+
 		return expect('}');
 	}
 	bool parser::parse_technique_pass_expression(expression_node *&expression)
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <memory>
+#include <functional>
 #include "effect_lexer.hpp"
 #include "effect_syntax_tree.hpp"
 
@@ -37,6 +38,18 @@ namespace reshadefx
 		/// <param name="source">The string to analyze.</param>
 		/// <returns>A boolean value indicating whether parsing was successful or not.</returns>
 		bool run(const std::string &source);
+		/// <summary>
+		/// Parse the provided list of tokens, as produced by the pre-processor, without lexing the source again.
+		/// </summary>
+		/// <param name="tokens">The tokens to analyze. They have to end with an end of file token and stay alive while parsing.</param>
+		/// <returns>A boolean value indicating whether parsing was successful or not.</returns>
+		bool run(const std::vector<token> &tokens);
+		/// <summary>
+		/// Set a callback that is called on every uniform variable with an initial value right after its declaration was parsed.
+		/// It may turn the variable into a constant, which then is folded into all expressions that reference it later on.
+		/// </summary>
+		/// <param name="callback">The function to call with the variable declaration.</param>
+		void set_uniform_callback(std::function<void(nodes::variable_declaration_node *)> callback) { _uniform_callback = std::move(callback); }
 
 	private:
 		void error(const location &location, unsigned int code, const std::string &message);
@@ -72,7 +85,7 @@ namespace reshadefx
 		bool parse_statement_block(nodes::statement_node *&statement, bool scoped = true);
 		bool parse_statement_declarator_list(nodes::statement_node *&statement);
 		bool parse_array(int &size);
-		bool parse_annotations(std::unordered_map<std::string, reshade::variant> &annotations);
+		bool parse_annotations(nodes::annotation_map &annotations);
 		bool parse_struct(nodes::struct_declaration_node *&structure);
 		bool parse_function_declaration(nodes::type_node &type, std::string name, nodes::function_declaration_node *&function);
 		bool parse_variable_declaration(nodes::type_node &type, std::string name, nodes::variable_declaration_node *&variable, bool global = false);
@@ -83,10 +96,15 @@ namespace reshadefx
 		bool parse_technique_pass(nodes::pass_declaration_node *&pass);
 		bool parse_technique_pass_expression(nodes::expression_node *&expression);
 
+		void apply_render_scales();
+
 		syntax_tree &_ast;
 		std::string _errors;
-		std::unique_ptr<lexer> _lexer, _lexer_backup;
+		std::vector<token> _source_tokens;
+		const std::vector<token> *_tokens = nullptr;
+		size_t _token_index = 0, _token_index_backup = 0;
 		token _token, _token_next, _token_backup;
 		std::unique_ptr<class symbol_table> _symbol_table;
+		std::function<void(nodes::variable_declaration_node *)> _uniform_callback;
 	};
 }
@@ -0,0 +1,436 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_precision.hpp"
+#include <iterator>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace reshadefx
+{
+	using namespace nodes;
+
+	namespace
+	{
+		// Returns the variable an expression refers to when it is written to, looking through swizzles, fields and array indices
+		const variable_declaration_node *find_written_variable(const expression_node *node)
+		{
+			while (node != nullptr)
+			{
+				switch (node->id)
+				{
+					case nodeid::lvalue_expression:
+						return static_cast<const lvalue_expression_node *>(node)->reference;
+					case nodeid::swizzle_expression:
+						node = static_cast<const swizzle_expression_node *>(node)->operand;
+						break;
+					case nodeid::field_expression:
+						node = static_cast<const field_expression_node *>(node)->operand;
+						break;
+					case nodeid::binary_expression:
+						if (static_cast<const binary_expression_node *>(node)->op != binary_expression_node::element_extract)
+							return nullptr;
+						node = static_cast<const binary_expression_node *>(node)->operands[0];
+						break;
+					default:
+						return nullptr;
+				}
+			}
+
+			return nullptr;
+		}
+
+		// Formats that store more precision than a 16-bit float has, so values written to them have to be computed at full precision
+		bool is_high_precision_format(reshade::texture_format format)
+		{
+			switch (format)
+			{
+				case reshade::texture_format::r16f:
+				case reshade::texture_format::r32f:
+				case reshade::texture_format::rg16:
+				case reshade::texture_format::rg16f:
+				case reshade::texture_format::rg32f:
+				case reshade::texture_format::rgba16:
+				case reshade::texture_format::rgba16f:
+				case reshade::texture_format::rgba32f:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		// Variables are keyed by their declaration and the return value of a function by the declaration of the function
+		using value_list = std::vector<const declaration_node *>;
+
+		struct precision_visitor
+		{
+			const function_declaration_node *current_function = nullptr;
+			// The values each value is computed from, if the first needs full precision, so do all of these
+			std::unordered_map<const declaration_node *, value_list> sources;
+			// Values that are used where reduced precision is visible, like texture coordinates
+			value_list critical;
+			// Values that are too precise for reduced precision, like depth and uniforms, everything computed from them needs full precision too
+			value_list precise_origins;
+			// Variables that have to stay a full precision type regardless of their values, since HLSL does not convert arguments of output parameters
+			std::unordered_set<const variable_declaration_node *> pinned;
+			// The local variables and the function each is declared in
+			std::unordered_map<const variable_declaration_node *, const function_declaration_node *> locals;
+
+			void flows_into(const declaration_node *target, const value_list &values)
+			{
+				if (target != nullptr && !values.empty())
+				{
+					value_list &list = sources[target];
+					list.insert(list.end(), values.begin(), values.end());
+				}
+			}
+			void visit_critical(const expression_node *node)
+			{
+				value_list values;
+				visit(node, values);
+				critical.insert(critical.end(), values.begin(), values.end());
+			}
+			void visit_output(const expression_node *node, const declaration_node *parameter, value_list &values)
+			{
+				const auto variable = find_written_variable(node);
+
+				if (variable != nullptr)
+				{
+					pinned.insert(variable);
+
+					if (parameter != nullptr)
+					{
+						flows_into(variable, { parameter });
+					}
+				}
+
+				visit(node, values);
+			}
+
+			// Adds the values an expression is computed from to 'values' and records how values flow through the assignments and calls inside of it
+			void visit(const expression_node *node, value_list &values)
+			{
+				if (node == nullptr)
+				{
+					return;
+				}
+
+				switch (node->id)
+				{
+					case nodeid::lvalue_expression:
+					{
+						const auto reference = static_cast<const lvalue_expression_node *>(node)->reference;
+
+						// Uniforms often hold large values like timers or the frame count, or small differences like the size of a pixel
+						if (reference->type.has_qualifier(type_node::qualifier_uniform))
+						{
+							precise_origins.push_back(reference);
+						}
+
+						values.push_back(reference);
+						break;
+					}
+					case nodeid::unary_expression:
+						visit(static_cast<const unary_expression_node *>(node)->operand, values);
+						break;
+					case nodeid::binary_expression:
+					{
+						const auto binary = static_cast<const binary_expression_node *>(node);
+
+						visit(binary->operands[0], values);
+
+						if (binary->op == binary_expression_node::element_extract)
+						{
+							visit_critical(binary->operands[1]);
+						}
+						else
+						{
+							visit(binary->operands[1], values);
+						}
+						break;
+					}
+					case nodeid::intrinsic_expression:
+					{
+						const auto intrinsic = static_cast<const intrinsic_expression_node *>(node);
+
+						switch (intrinsic->op)
+						{
+							case intrinsic_expression_node::texture:
+							case intrinsic_expression_node::texture_fetch:
+							case intrinsic_expression_node::texture_gather:
+							case intrinsic_expression_node::texture_gather_offset:
+							case intrinsic_expression_node::texture_gradient:
+							case intrinsic_expression_node::texture_level:
+							case intrinsic_expression_node::texture_level_offset:
+							case intrinsic_expression_node::texture_offset:
+							case intrinsic_expression_node::texture_projection:
+							case intrinsic_expression_node::texture_size:
+								// The sampled value does not depend on how precise the coordinates are, as long as they are precise enough to hit the right texel
+								for (size_t i = 1; i < std::size(intrinsic->arguments); i++)
+									visit_critical(intrinsic->arguments[i]);
+
+								// Depth values are non-linear and crowd close to one, where a 16-bit float cannot tell them apart
+								if (const auto sampler = find_written_variable(intrinsic->arguments[0]); sampler != nullptr && intrinsic->op != intrinsic_expression_node::texture_size &&
+									sampler->properties.texture != nullptr && (sampler->properties.texture->semantic == "DEPTH" || sampler->properties.texture->semantic == "SV_DEPTH"))
+								{
+									precise_origins.push_back(sampler);
+									values.push_back(sampler);
+								}
+								break;
+							case intrinsic_expression_node::texture_store:
+								visit_critical(intrinsic->arguments[1]);
+								visit(intrinsic->arguments[2], values);
+								break;
+							case intrinsic_expression_node::sincos:
+								visit(intrinsic->arguments[0], values);
+								visit_output(intrinsic->arguments[1], nullptr, values);
+								visit_output(intrinsic->arguments[2], nullptr, values);
+								break;
+							case intrinsic_expression_node::frexp:
+							case intrinsic_expression_node::modf:
+								visit(intrinsic->arguments[0], values);
+								visit_output(intrinsic->arguments[1], nullptr, values);
+								break;
+							default:
+								for (auto argument : intrinsic->arguments)
+									visit(argument, values);
+								break;
+						}
+						break;
+					}
+					case nodeid::conditional_expression:
+						visit(static_cast<const conditional_expression_node *>(node)->condition, values);
+						visit(static_cast<const conditional_expression_node *>(node)->expression_when_true, values);
+						visit(static_cast<const conditional_expression_node *>(node)->expression_when_false, values);
+						break;
+					case nodeid::assignment_expression:
+					{
+						const auto assignment = static_cast<const assignment_expression_node *>(node);
+
+						value_list right;
+						visit(assignment->right, right);
+
+						flows_into(find_written_variable(assignment->left), right);
+
+						// The left side may index arrays, which makes its indices critical, and it is the value of the assignment
+						visit(assignment->left, values);
+						values.insert(values.end(), right.begin(), right.end());
+						break;
+					}
+					case nodeid::expression_sequence:
+						for (auto expression : static_cast<const expression_sequence_node *>(node)->expression_list)
+							visit(expression, values);
+						break;
+					case nodeid::call_expression:
+					{
+						const auto call = static_cast<const call_expression_node *>(node);
+
+						for (size_t i = 0; i < call->arguments.size(); i++)
+						{
+							const auto parameter = call->callee->parameter_list[i];
+
+							// The result of the call depends on the arguments through the parameters, which is recorded here, so they are not added to the values of the call itself
+							value_list argument;
+
+							if (parameter->type.has_qualifier(type_node::qualifier_out))
+							{
+								visit_output(call->arguments[i], parameter, argument);
+							}
+							else
+							{
+								visit(call->arguments[i], argument);
+							}
+
+							if (!parameter->type.has_qualifier(type_node::qualifier_out) || parameter->type.has_qualifier(type_node::qualifier_in))
+							{
+								flows_into(parameter, argument);
+							}
+						}
+
+						values.push_back(call->callee);
+						break;
+					}
+					case nodeid::constructor_expression:
+						for (auto argument : static_cast<const constructor_expression_node *>(node)->arguments)
+							visit(argument, values);
+						break;
+					case nodeid::swizzle_expression:
+						visit(static_cast<const swizzle_expression_node *>(node)->operand, values);
+						break;
+					case nodeid::field_expression:
+						visit(static_cast<const field_expression_node *>(node)->operand, values);
+						break;
+					case nodeid::initializer_list:
+						for (auto value : static_cast<const initializer_list_node *>(node)->values)
+							visit(value, values);
+						break;
+				}
+			}
+			void visit(const statement_node *node, bool is_loop_init = false)
+			{
+				if (node == nullptr)
+				{
+					return;
+				}
+
+				value_list values;
+
+				switch (node->id)
+				{
+					case nodeid::compound_statement:
+						for (auto statement : static_cast<const compound_statement_node *>(node)->statement_list)
+							visit(statement);
+						break;
+					case nodeid::declarator_list:
+						for (auto declarator : static_cast<const declarator_list_node *>(node)->declarator_list)
+						{
+							value_list initializer;
+							visit(declarator->initializer_expression, initializer);
+							flows_into(declarator, initializer);
+
+							// Declarators in the head of a loop share a single type, so they are left alone
+							if (!is_loop_init)
+							{
+								locals[declarator] = current_function;
+							}
+						}
+						break;
+					case nodeid::expression_statement:
+						visit(static_cast<const expression_statement_node *>(node)->expression, values);
+						break;
+					case nodeid::if_statement:
+						visit(static_cast<const if_statement_node *>(node)->condition, values);
+						visit(static_cast<const if_statement_node *>(node)->statement_when_true);
+						visit(static_cast<const if_statement_node *>(node)->statement_when_false);
+						break;
+					case nodeid::switch_statement:
+						visit_critical(static_cast<const switch_statement_node *>(node)->test_expression);
+						for (auto case_statement : static_cast<const switch_statement_node *>(node)->case_list)
+							visit(case_statement->statement_list);
+						break;
+					case nodeid::case_statement:
+						visit(static_cast<const case_statement_node *>(node)->statement_list);
+						break;
+					case nodeid::for_statement:
+						// A counter that is not precise enough to reach its limit would never end the loop
+						visit(static_cast<const for_statement_node *>(node)->init_statement, true);
+						visit_critical(static_cast<const for_statement_node *>(node)->condition);
+						visit_critical(static_cast<const for_statement_node *>(node)->increment_expression);
+						visit(static_cast<const for_statement_node *>(node)->statement_list);
+						break;
+					case nodeid::while_statement:
+						visit_critical(static_cast<const while_statement_node *>(node)->condition);
+						visit(static_cast<const while_statement_node *>(node)->statement_list);
+						break;
+					case nodeid::return_statement:
+						visit(static_cast<const return_statement_node *>(node)->return_value, values);
+						flows_into(current_function, values);
+						break;
+				}
+			}
+		};
+	}
+
+	void find_half_precision_variables(const syntax_tree &ast, const std::unordered_set<const function_declaration_node *> &functions, std::unordered_set<const variable_declaration_node *> &variables)
+	{
+		if (functions.empty())
+		{
+			return;
+		}
+
+		precision_visitor visitor;
+
+		// Values flow between all functions through calls, so all of them are visited, even those that keep full precision
+		for (auto function : ast.functions)
+		{
+			visitor.current_function = function;
+			visitor.visit(function->definition);
+		}
+
+		// Pixel shaders that write to render targets with a more precise format than a 16-bit float have to compute their result at full precision
+		for (auto technique : ast.techniques)
+		{
+			for (auto pass : technique->pass_list)
+			{
+				if (pass->pixel_shader == nullptr || std::none_of(std::begin(pass->render_targets), std::end(pass->render_targets),
+					[](auto target) { return target != nullptr && is_high_precision_format(target->properties.format); }))
+				{
+					continue;
+				}
+
+				visitor.critical.push_back(pass->pixel_shader);
+
+				for (auto parameter : pass->pixel_shader->parameter_list)
+				{
+					if (parameter->type.has_qualifier(type_node::qualifier_out))
+					{
+						visitor.critical.push_back(parameter);
+					}
+				}
+			}
+		}
+
+		std::unordered_set<const declaration_node *> critical(visitor.critical.begin(), visitor.critical.end());
+
+		for (value_list pending = std::move(visitor.critical); !pending.empty();)
+		{
+			const auto value = pending.back();
+			pending.pop_back();
+
+			if (const auto it = visitor.sources.find(value); it != visitor.sources.end())
+			{
+				for (auto source : it->second)
+				{
+					if (critical.insert(source).second)
+					{
+						pending.push_back(source);
+					}
+				}
+			}
+		}
+
+		// Values computed from a precise one are as precise, so follow the flow of values forward from those too
+		std::unordered_map<const declaration_node *, value_list> targets;
+
+		for (const auto &source : visitor.sources)
+		{
+			for (auto value : source.second)
+			{
+				targets[value].push_back(source.first);
+			}
+		}
+
+		std::unordered_set<const declaration_node *> derived(visitor.precise_origins.begin(), visitor.precise_origins.end());
+
+		for (value_list pending = std::move(visitor.precise_origins); !pending.empty();)
+		{
+			const auto value = pending.back();
+			pending.pop_back();
+
+			if (const auto it = targets.find(value); it != targets.end())
+			{
+				for (auto target : it->second)
+				{
+					if (derived.insert(target).second)
+					{
+						pending.push_back(target);
+					}
+				}
+			}
+		}
+
+		for (const auto &local : visitor.locals)
+		{
+			const auto variable = local.first;
+
+			if (functions.count(local.second) != 0 && variable->type.is_floating_point() && !variable->type.has_qualifier(type_node::qualifier_precise) &&
+				critical.count(variable) == 0 && derived.count(variable) == 0 && visitor.pinned.count(variable) == 0)
+			{
+				variables.insert(variable);
+			}
+		}
+	}
+}
@@ -0,0 +1,21 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include "effect_syntax_tree.hpp"
+#include <unordered_set>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// Find the local floating-point variables that can be computed at reduced precision without visible artifacts.
+	/// Values that end up in texture coordinates, array indices, loop conditions or the results of pixel shaders that write to render targets with a more precise format than a 16-bit float, values computed from depth samples or uniforms, variables passed to output parameters and variables declared 'precise' keep full precision, following the flow of values through assignments, calls and return values across functions.
+	/// </summary>
+	/// <param name="ast">The syntax tree of the effect.</param>
+	/// <param name="functions">The functions whose local variables may use reduced precision, because every shader that reaches them tolerates it.</param>
+	/// <param name="variables">The set to add the variables to.</param>
+	void find_half_precision_variables(const syntax_tree &ast, const std::unordered_set<const nodes::function_declaration_node *> &functions, std::unordered_set<const nodes::variable_declaration_node *> &variables);
+}
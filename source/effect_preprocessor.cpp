@@ -5,22 +5,186 @@
 
 #include "effect_preprocessor.hpp"
 #include <fstream>
+#include <algorithm>
 #include <assert.h>
 
 namespace reshadefx
 {
-	enum macro_replacement
+	namespace filesystem = reshade::filesystem;
+
+	static void lex_macro_tokens(const std::string &text, std::vector<preprocessor::macro_token> &out)
 	{
-		macro_replacement_start = '\x00',
-		macro_replacement_argument = '\xFA',
-		macro_replacement_concat = '\xFF',
-		macro_replacement_stringize = '\xFE',
-		macro_replacement_space = '\xFD',
-		macro_replacement_break = '\xFC',
-		macro_replacement_expand = '\xFB',
-	};
+		lexer lexer(text, false, false, true, false);
 
-	namespace filesystem = reshade::filesystem;
+		for (token tok = lexer.lex(); tok != tokenid::end_of_file; tok = lexer.lex())
+		{
+			auto &element = out.emplace_back();
+			element.raw_data = text.substr(tok.offset, tok.length);
+			element.token = std::move(tok);
+		}
+	}
+	static void trim_macro_tokens(std::vector<preprocessor::macro_token> &tokens, size_t first = 0)
+	{
+		while (tokens.size() > first && tokens.back().kind == preprocessor::macro_token::plain && tokens.back().token == tokenid::space)
+		{
+			tokens.pop_back();
+		}
+
+		size_t count = 0;
+
+		while (first + count < tokens.size() && tokens[first + count].kind == preprocessor::macro_token::plain && tokens[first + count].token == tokenid::space)
+		{
+			count++;
+		}
+
+		tokens.erase(tokens.begin() + first, tokens.begin() + first + count);
+	}
+
+	static std::string find_include_guard(const std::string &data)
+	{
+		// Strip comments first, so they cannot hide directives or content outside the guard
+		std::string text;
+		text.reserve(data.size());
+
+		for (size_t i = 0; i < data.size(); i++)
+		{
+			if (data[i] == '"')
+			{
+				const size_t end = std::min(data.find('"', i + 1), data.size() - 1);
+				text.append(data, i, end - i + 1);
+				i = end;
+			}
+			else if (data.compare(i, 2, "//") == 0)
+			{
+				i = std::min(data.find('\n', i), data.size()) - 1;
+			}
+			else if (data.compare(i, 2, "/*") == 0)
+			{
+				const size_t end = data.find("*/", i + 2);
+
+				if (end == std::string::npos)
+				{
+					return std::string();
+				}
+
+				// Keep line breaks, so directives stay on lines of their own
+				text.append(std::count(data.begin() + i, data.begin() + end, '\n'), '\n');
+				i = end + 1;
+			}
+			else
+			{
+				text += data[i];
+			}
+		}
+
+		// Only the common form is recognized: "#ifndef NAME" and "#define NAME" come first and the matching "#endif" is the last thing in the file
+		std::string guard;
+		bool is_defined = false, is_closed = false;
+		size_t depth = 0;
+
+		for (size_t line_begin = 0, line_end; line_begin < text.size(); line_begin = line_end + 1)
+		{
+			line_end = std::min(text.find('\n', line_begin), text.size());
+
+			const size_t first = text.find_first_not_of(" \t\r", line_begin);
+
+			if (first == std::string::npos || first >= line_end)
+			{
+				continue;
+			}
+
+			if (is_closed || (text[first] != '#' && !is_defined))
+			{
+				return std::string();
+			}
+
+			if (text[first] != '#')
+			{
+				continue;
+			}
+
+			const std::string line = text.substr(first + 1, line_end - first - 1);
+			const size_t directive_begin = line.find_first_not_of(" \t");
+
+			if (directive_begin == std::string::npos)
+			{
+				continue;
+			}
+
+			const size_t directive_end = std::min(line.find_first_of(" \t\r(", directive_begin), line.size());
+			const size_t argument_begin = std::min(line.find_first_not_of(" \t", directive_end), line.size());
+			const std::string directive = line.substr(directive_begin, directive_end - directive_begin);
+			const std::string argument = line.substr(argument_begin, std::min(line.find_first_of(" \t\r", argument_begin), line.size()) - argument_begin);
+
+			if (guard.empty())
+			{
+				if (directive != "ifndef" || argument.empty())
+				{
+					return std::string();
+				}
+
+				guard = argument;
+				depth = 1;
+			}
+			else if (!is_defined)
+			{
+				if (directive != "define" || argument != guard)
+				{
+					return std::string();
+				}
+
+				is_defined = true;
+			}
+			else if (directive == "if" || directive == "ifdef" || directive == "ifndef")
+			{
+				depth++;
+			}
+			else if ((directive == "else" || directive == "elif") && depth == 1)
+			{
+				// An alternative to the guard itself means part of the file is not guarded
+				return std::string();
+			}
+			else if (directive == "endif" && --depth == 0)
+			{
+				is_closed = true;
+			}
+		}
+
+		return is_closed ? guard : std::string();
+	}
+
+	std::shared_ptr<const include_cache::file> include_cache::load(const filesystem::path &path)
+	{
+		const uint64_t last_write_time = filesystem::last_write_time(path);
+
+		{
+			const std::lock_guard<std::mutex> lock(_mutex);
+
+			const auto it = _files.find(path.string());
+
+			if (it != _files.end() && it->second->last_write_time == last_write_time)
+			{
+				return it->second;
+			}
+		}
+
+		std::ifstream stream(path.wstring());
+
+		if (!stream.is_open())
+		{
+			return nullptr;
+		}
+
+		const auto file = std::make_shared<include_cache::file>();
+		file->data.assign(std::istreambuf_iterator<char>(stream.rdbuf()), std::istreambuf_iterator<char>());
+		file->data += '\n';
+		file->include_guard = find_include_guard(file->data);
+		file->last_write_time = last_write_time;
+
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		return _files[path.string()] = file;
+	}
 
 	void preprocessor::add_include_path(const filesystem::path &path)
 	{
@@ -37,7 +201,7 @@ namespace reshadefx
 	bool preprocessor::add_macro_definition(const std::string &name, const std::string &value)
 	{
 		macro macro;
-		macro.replacement_list = value;
+		lex_macro_tokens(value, macro.replacement_list);
 
 		return add_macro_definition(name, macro);
 	}
@@ -53,12 +217,24 @@ namespace reshadefx
 
 		_success = true;
 		_filecache.clear();
+		_pragma_once_files.clear();
+		_output_tokens.clear();
+		_used_macros.clear();
 
 		const std::string filedata(std::istreambuf_iterator<char>(file.rdbuf()), std::istreambuf_iterator<char>());
 
 		push(filedata + '\n', file_path.string());
 		parse();
 
+		if (_is_token_output)
+		{
+			token end_of_file = { };
+			end_of_file.id = tokenid::end_of_file;
+			end_of_file.location = _output_location;
+
+			_output_tokens.push_back(std::move(end_of_file));
+		}
+
 		return _success;
 	}
 	bool preprocessor::run(const filesystem::path &file_path, std::vector<filesystem::path> &included_files)
@@ -90,12 +266,6 @@ namespace reshadefx
 	}
 
 	// Input management
-	lexer &preprocessor::current_lexer()
-	{
-		assert(!_input_stack.empty());
-
-		return *_input_stack.top()._lexer;
-	}
 	std::stack<preprocessor::if_level> &preprocessor::current_if_stack()
 	{
 		assert(!_input_stack.empty());
@@ -107,26 +277,48 @@ namespace reshadefx
 		return current_if_stack().top();
 	}
 	void preprocessor::push(const std::string &input, const std::string &name)
+	{
+		push(std::make_shared<const std::string>(input), name);
+	}
+	void preprocessor::push(std::shared_ptr<const std::string> input, const std::string &name)
 	{
 		const auto parent = _input_stack.empty() ? nullptr : &_input_stack.top();
 
-		_input_stack.emplace(name, input, parent);
+		_input_stack.emplace(name, std::move(input), parent);
 
 		if (name.empty())
 		{
 			if (parent != nullptr)
 			{
 				_input_stack.top()._name = parent->_name;
+				_input_stack.top()._is_expansion = true;
+				_input_stack.top()._expansion_location = _token.location;
 			}
 		}
 		else
 		{
 			_output_location.source = name;
-			_output += "#line 1 \"" + name + "\"\n";
+
+			if (!_is_token_output)
+			{
+				_output += "#line 1 \"" + name + "\"\n";
+			}
 		}
 
 		consume();
 	}
+	void preprocessor::push(std::vector<macro_token> &&tokens, const location &location)
+	{
+		assert(!_input_stack.empty());
+
+		const auto parent = &_input_stack.top();
+
+		_input_stack.emplace(parent->_name, std::move(tokens), parent);
+		_input_stack.top()._is_expansion = true;
+		_input_stack.top()._expansion_location = location;
+
+		consume();
+	}
 	bool preprocessor::peek(tokenid token) const
 	{
 		assert(!_input_stack.empty());
@@ -140,10 +332,30 @@ namespace reshadefx
 		auto &input_level = _input_stack.top();
 		_token = input_level._next_token;
 		_token.location.source = _output_location.source;
-		_current_token_raw_data = current_lexer().input_string().substr(_token.offset, _token.length);
 
-		input_level._next_token = input_level._lexer->lex();
-		input_level._offset = input_level._next_token.offset;
+		if (input_level._is_expansion)
+		{
+			_token.location = input_level._expansion_location;
+		}
+		_current_token_raw_data = std::move(input_level._next_token_raw_data);
+
+		if (input_level._lexer != nullptr)
+		{
+			input_level._next_token = input_level._lexer->lex();
+			input_level._next_token_raw_data = input_level._lexer->input_string().substr(input_level._next_token.offset, input_level._next_token.length);
+		}
+		else if (input_level._token_index < input_level._tokens.size())
+		{
+			auto &element = input_level._tokens[input_level._token_index++];
+			input_level._next_token = std::move(element.token);
+			input_level._next_token_raw_data = std::move(element.raw_data);
+		}
+		else
+		{
+			input_level._next_token = { };
+			input_level._next_token.id = tokenid::end_of_file;
+			input_level._next_token_raw_data.clear();
+		}
 
 		// Pop input level if lexical analysis has reached the end of it
 		while (_input_stack.top()._next_token == tokenid::end_of_file)
@@ -164,7 +376,11 @@ namespace reshadefx
 			{
 				_output_location.line = 1;
 				_output_location.source = _input_stack.top()._name;
-				_output += "#line 1 \"" + _output_location.source + "\"\n";
+
+				if (!_is_token_output)
+				{
+					_output += "#line 1 \"" + _output_location.source + "\"\n";
+				}
 			}
 		}
 	}
@@ -197,15 +413,24 @@ namespace reshadefx
 		{
 			assert(!_input_stack.empty());
 
-			const auto &actual_token = _input_stack.top()._next_token;
+			const auto &input_level = _input_stack.top();
 
-			error(actual_token.location, "syntax error: unexpected token '" + current_lexer().input_string().substr(actual_token.offset, actual_token.length) + "'");
+			error(input_level._next_token.location, "syntax error: unexpected token '" + input_level._next_token_raw_data + "'");
 
 			return false;
 		}
 
 		return true;
 	}
+	void preprocessor::emit_token()
+	{
+		if (_token == tokenid::space)
+		{
+			return;
+		}
+
+		lexer::convert_to_default(_output_tokens.emplace_back(_token), _current_token_raw_data);
+	}
 
 	// Parsing routines
 	void preprocessor::parse()
@@ -295,7 +520,7 @@ namespace reshadefx
 					continue;
 
 				case tokenid::end_of_line:
-					if (line.empty())
+					if (_is_token_output || line.empty())
 					{
 						continue;
 					}
@@ -313,7 +538,14 @@ namespace reshadefx
 						continue;
 					}
 				default:
-					line += _current_token_raw_data;
+					if (_is_token_output)
+					{
+						emit_token();
+					}
+					else
+					{
+						line += _current_token_raw_data;
+					}
 					break;
 			}
 		}
@@ -330,7 +562,6 @@ namespace reshadefx
 		macro m;
 		const auto location = current_token().location;
 		const auto macro_name = current_token().literal_as_string;
-		const auto macro_name_end_offset = current_token().offset + current_token().length;
 
 		if (macro_name == "defined")
 		{
@@ -338,9 +569,10 @@ namespace reshadefx
 			return;
 		}
 
-		if (current_lexer().input_string()[macro_name_end_offset] == '(')
+		// A parenthesis directly after the name, without whitespace in between, makes this a function-like macro
+		if (peek(tokenid::parenthesis_open))
 		{
-			accept(tokenid::parenthesis_open);
+			consume();
 
 			m.is_function_like = true;
 
@@ -372,6 +604,9 @@ namespace reshadefx
 
 		create_macro_replacement_list(m);
 
+		// A definition from outside with the same name makes this one fail
+		_used_macros.insert(macro_name);
+
 		if (!add_macro_definition(macro_name, m))
 		{
 			error(location, "redefinition of '" + macro_name + "'");
@@ -394,6 +629,7 @@ namespace reshadefx
 			return;
 		}
 
+		_used_macros.insert(macro_name);
 		_macros.erase(macro_name);
 	}
 	void preprocessor::parse_if()
@@ -423,7 +659,7 @@ namespace reshadefx
 
 		const auto &macro_name = current_token().literal_as_string;
 
-		level.value = _macros.find(macro_name) != _macros.end();
+		level.value = is_macro_defined(macro_name);
 		level.skipping = (parent != nullptr && parent->skipping) || !level.value;
 		level.parent = parent;
 
@@ -443,7 +679,7 @@ namespace reshadefx
 
 		const auto &macro_name = current_token().literal_as_string;
 
-		level.value = _macros.find(macro_name) == _macros.end();
+		level.value = !is_macro_defined(macro_name);
 		level.skipping = (parent != nullptr && parent->skipping) || !level.value;
 		level.parent = parent;
 
@@ -565,12 +801,7 @@ namespace reshadefx
 
 		if (pragma == "once")
 		{
-			const auto it = _filecache.find(_output_location.source);
-
-			if (it != _filecache.end())
-			{
-				it->second.clear();
-			}
+			_pragma_once_files.insert(_output_location.source);
 		}
 
 		_pragmas.push_back(pragma);
@@ -605,23 +836,31 @@ namespace reshadefx
 
 		auto it = _filecache.find(filepath.string());
 
-		if (it == _filecache.end())
+		if (it != _filecache.end())
+		{
+			// Skip files that were included before and would not produce anything again, without lexing them
+			if (_pragma_once_files.count(it->first) != 0 ||
+				(!it->second->include_guard.empty() && is_macro_defined(it->second->include_guard)))
+			{
+				return;
+			}
+		}
+		else
 		{
-			std::ifstream file(filepath.wstring());
+			const auto file = _include_cache->load(filepath);
 
-			if (!file.is_open())
+			if (file == nullptr)
 			{
 				error(keyword_location, "could not open included file '" + filepath.string() + "'");
 				consume_until(tokenid::end_of_line);
 				return;
 			}
 
-			const std::string filedata(std::istreambuf_iterator<char>(file.rdbuf()), std::istreambuf_iterator<char>());
-
-			it = _filecache.emplace(filepath.string(), filedata + '\n').first;
+			it = _filecache.emplace(filepath.string(), file).first;
 		}
 
-		push(it->second, filepath.string());
+		// Lex the cached file contents in place, instead of copying them for every file that includes it
+		push(std::shared_ptr<const std::string>(it->second, &it->second->data), filepath.string());
 	}
 
 	bool preprocessor::evaluate_expression()
@@ -835,7 +1074,7 @@ namespace reshadefx
 							return false;
 						}
 
-						const bool is_macro_defined = _macros.find(current_token().literal_as_string) != _macros.end();
+						const bool is_defined = is_macro_defined(current_token().literal_as_string);
 
 						if (has_parentheses && !expect(tokenid::parenthesis_close))
 						{
@@ -843,7 +1082,7 @@ namespace reshadefx
 						}
 
 						rpn[rpn_count].is_op = false;
-						rpn[rpn_count++].value = is_macro_defined;
+						rpn[rpn_count++].value = is_defined;
 						continue;
 					}
 
@@ -970,7 +1209,7 @@ namespace reshadefx
 			return false;
 		}
 
-		const auto it = _macros.find(current_token().literal_as_string);
+		const auto it = find_macro(current_token().literal_as_string);
 
 		if (it == _macros.end())
 		{
@@ -978,7 +1217,8 @@ namespace reshadefx
 		}
 
 		const auto &macro = it->second;
-		std::vector<std::string> arguments;
+		const auto macro_location = current_token().location;
+		std::vector<std::vector<macro_token>> arguments;
 
 		if (macro.is_function_like)
 		{
@@ -990,10 +1230,16 @@ namespace reshadefx
 			while (true)
 			{
 				int parentheses_level = 0;
-				std::string argument;
+				auto &argument = arguments.emplace_back();
 
 				while (true)
 				{
+					if (_input_stack.empty())
+					{
+						error(current_token().location, "unterminated invocation of macro '" + it->first + "'");
+						return true;
+					}
+
 					consume();
 
 					if (current_token() == tokenid::parenthesis_open)
@@ -1007,19 +1253,19 @@ namespace reshadefx
 						break;
 					}
 
-					argument += _current_token_raw_data;
-				}
+					auto &element = argument.emplace_back();
+					element.token = current_token();
+					element.raw_data = _current_token_raw_data;
 
-				if (!argument.empty() && argument.back() == ' ')
-				{
-					argument.pop_back();
-				}
-				if (!argument.empty() && argument.front() == ' ')
-				{
-					argument.erase(0, 1);
+					// Line breaks of an invocation spanning multiple lines only separate tokens inside the expansion
+					if (element.token == tokenid::end_of_line)
+					{
+						element.token.id = tokenid::space;
+						element.raw_data = " ";
+					}
 				}
 
-				arguments.push_back(argument);
+				trim_macro_tokens(argument);
 
 				if (parentheses_level < 0)
 				{
@@ -1028,48 +1274,95 @@ namespace reshadefx
 			}
 		}
 
-		std::string input;
-		expand_macro(it->second, arguments, input);
+		std::vector<macro_token> tokens;
+		expand_macro(macro, arguments, tokens);
 
-		push(input);
+		push(std::move(tokens), macro_location);
 
 		return true;
 	}
 
 	// Macro management routines
-	void preprocessor::expand_macro(const macro &macro, const std::vector<std::string> &arguments, std::string &out)
+	std::unordered_map<std::string, preprocessor::macro>::const_iterator preprocessor::find_macro(const std::string &name)
 	{
-		for (auto it = macro.replacement_list.begin(); it != macro.replacement_list.end(); ++it)
+		_used_macros.insert(name);
+
+		return _macros.find(name);
+	}
+	void preprocessor::expand_macro(const macro &macro, const std::vector<std::vector<macro_token>> &arguments, std::vector<macro_token> &out)
+	{
+		// Position in the output after a ## operator, at which the next element is pasted to the token before it
+		size_t paste_index = 0;
+		bool is_pasting = false;
+
+		for (const auto &element : macro.replacement_list)
 		{
-			if (*it == macro_replacement_start)
+			const size_t first = out.size();
+
+			switch (element.kind)
 			{
-				switch (*++it)
+				case macro_token::plain:
+					out.push_back(element);
+					break;
+				case macro_token::concat:
+					paste_index = out.size();
+					is_pasting = true;
+					continue;
+				case macro_token::stringize:
 				{
-					case macro_replacement_concat:
-						continue;
-					case macro_replacement_stringize:
-						out += '"' + arguments.at(*++it) + '"';
-						break;
-					case macro_replacement_argument:
-						push(arguments.at(*++it) + static_cast<char>(macro_replacement_argument));
-						while (!accept(tokenid::unknown))
-						{
-							consume();
+					std::string value;
+					for (const auto &argument_token : arguments.at(element.parameter))
+					{
+						value += argument_token.raw_data;
+					}
 
-							if (current_token() == tokenid::identifier && evaluate_identifier_as_macro())
-							{
-								continue;
-							}
+					lex_macro_tokens('"' + value + '"', out);
+					break;
+				}
+				case macro_token::argument:
+				{
+					// Arguments are fully macro-expanded before they are substituted
+					auto argument = arguments.at(element.parameter);
+					auto &sentinel = argument.emplace_back();
+					sentinel.token.id = tokenid::unknown;
+					sentinel.raw_data = '\xFA';
 
-							out += _current_token_raw_data;
+					push(std::move(argument), _token.location);
+
+					while (!accept(tokenid::unknown))
+					{
+						consume();
+
+						if (current_token() == tokenid::identifier && evaluate_identifier_as_macro())
+						{
+							continue;
 						}
-						assert(_current_token_raw_data[0] == macro_replacement_argument);
-						break;
+
+						auto &expanded = out.emplace_back();
+						expanded.token = current_token();
+						expanded.raw_data = _current_token_raw_data;
+					}
+
+					assert(_current_token_raw_data[0] == '\xFA');
+					break;
 				}
 			}
-			else
+
+			if (is_pasting)
 			{
-				out += *it;
+				is_pasting = false;
+
+				trim_macro_tokens(out, first);
+
+				if (paste_index != 0 && paste_index < out.size())
+				{
+					// Join the raw text of the two tokens and lex the result again, which usually produces a single new token
+					std::vector<macro_token> pasted;
+					lex_macro_tokens(out[paste_index - 1].raw_data + out[paste_index].raw_data, pasted);
+
+					out.erase(out.begin() + paste_index - 1, out.begin() + paste_index + 1);
+					out.insert(out.begin() + paste_index - 1, std::make_move_iterator(pasted.begin()), std::make_move_iterator(pasted.end()));
+				}
 			}
 		}
 	}
@@ -1085,6 +1378,8 @@ namespace reshadefx
 		{
 			consume();
 
+			macro_token element;
+
 			switch (current_token())
 			{
 				case tokenid::hash:
@@ -1097,9 +1392,16 @@ namespace reshadefx
 							return;
 						}
 
-						// the ## token concatenation operator
-						macro.replacement_list += macro_replacement_start;
-						macro.replacement_list += macro_replacement_concat;
+						// the ## token concatenation operator, whitespace around it is not part of the result
+						trim_macro_tokens(macro.replacement_list);
+
+						element.kind = macro_token::concat;
+						macro.replacement_list.push_back(std::move(element));
+
+						while (peek(tokenid::space))
+						{
+							consume();
+						}
 						continue;
 					}
 					else if (macro.is_function_like)
@@ -1118,9 +1420,9 @@ namespace reshadefx
 						}
 
 						// the # stringize operator
-						macro.replacement_list += macro_replacement_start;
-						macro.replacement_list += macro_replacement_stringize;
-						macro.replacement_list += static_cast<char>(std::distance(macro.parameters.begin(), it));
+						element.kind = macro_token::stringize;
+						element.parameter = std::distance(macro.parameters.begin(), it);
+						macro.replacement_list.push_back(std::move(element));
 						continue;
 					}
 					break;
@@ -1140,16 +1442,20 @@ namespace reshadefx
 
 					if (it != macro.parameters.end())
 					{
-						macro.replacement_list += macro_replacement_start;
-						macro.replacement_list += macro_replacement_argument;
-						macro.replacement_list += static_cast<char>(std::distance(macro.parameters.begin(), it));
+						element.kind = macro_token::argument;
+						element.parameter = std::distance(macro.parameters.begin(), it);
+						macro.replacement_list.push_back(std::move(element));
 						continue;
 					}
 					break;
 				}
 			}
 
-			macro.replacement_list += _current_token_raw_data;
+			element.token = current_token();
+			element.raw_data = _current_token_raw_data;
+			macro.replacement_list.push_back(std::move(element));
 		}
+
+		trim_macro_tokens(macro.replacement_list);
 	}
 }
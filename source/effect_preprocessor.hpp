@@ -6,34 +6,92 @@
 #pragma once
 
 #include <stack>
+#include <mutex>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include "effect_lexer.hpp"
 #include "filesystem.hpp"
 
 namespace reshadefx
 {
+	/// <summary>
+	/// A cache of included files that can be shared by several pre-processor instances, so headers common to all effects are only read from disk once per reload.
+	/// </summary>
+	class include_cache
+	{
+	public:
+		struct file
+		{
+			std::string data;
+			// Macro the whole file is wrapped in with "#ifndef NAME", "#define NAME" and "#endif", or empty if it has no include guard
+			std::string include_guard;
+			uint64_t last_write_time = 0;
+		};
+
+		/// <summary>
+		/// Return the contents of a file, reading it from disk if it is not cached yet or was modified since.
+		/// This may be called from multiple threads at once.
+		/// </summary>
+		/// <param name="path">The path to the file to read.</param>
+		/// <returns>The file, or nullptr if it could not be opened.</returns>
+		std::shared_ptr<const file> load(const reshade::filesystem::path &path);
+
+	private:
+		std::mutex _mutex;
+		std::unordered_map<std::string, std::shared_ptr<const file>> _files;
+	};
+
 	/// <summary>
 	/// A C-style pre-processor implementation.
 	/// </summary>
 	class preprocessor
 	{
 	public:
+		/// <summary>
+		/// An element of a macro replacement list. Replacement lists are kept as tokens, so expanding a macro does not have to lex its text again.
+		/// </summary>
+		struct macro_token
+		{
+			enum kind
+			{
+				plain,
+				argument,
+				stringize,
+				concat,
+			};
+
+			kind kind = plain;
+			// Index of the macro parameter that is substituted for 'argument' and 'stringize' elements
+			size_t parameter = 0;
+			reshadefx::token token;
+			std::string raw_data;
+		};
 		struct macro
 		{
-			std::string replacement_list;
+			std::vector<macro_token> replacement_list;
 			bool is_function_like = false, is_variadic = false;
 			std::vector<std::string> parameters;
 		};
 
 		void add_include_path(const reshade::filesystem::path &path);
+		void set_include_cache(std::shared_ptr<include_cache> cache) { _include_cache = std::move(cache); }
+		/// <summary>
+		/// Make <see cref="run"/> produce the tokens the parser consumes in <see cref="current_tokens"/>, instead of an output string it would have to lex again.
+		/// </summary>
+		void set_token_output(bool enable) { _is_token_output = enable; }
 		bool add_macro_definition(const std::string &name, const macro &macro);
 		bool add_macro_definition(const std::string &name, const std::string &value = "1");
 
 		const std::string &errors() const { return _errors; }
 		const std::string &current_output() const { return _output; }
+		const std::vector<token> &current_tokens() const { return _output_tokens; }
 		const std::vector<std::string> &current_pragmas() const { return _pragmas; }
+		/// <summary>
+		/// Get the names of all macros the last <see cref="run"/> looked up, whether they were defined or not, so changing the definition of any other macro cannot change its output.
+		/// </summary>
+		const std::unordered_set<std::string> &used_macros() const { return _used_macros; }
 
 		bool run(const reshade::filesystem::path &file_path);
 		bool run(const reshade::filesystem::path &file_path, std::vector<reshade::filesystem::path> &included_files);
@@ -47,9 +105,17 @@ namespace reshadefx
 		};
 		struct input_level
 		{
-			input_level(const std::string &name, const std::string &text, input_level *parent) :
+			input_level(const std::string &name, std::shared_ptr<const std::string> text, input_level *parent) :
+				_name(name),
+				_lexer(new lexer(std::move(text), false, false, true, false)),
+				_parent(parent)
+			{
+				_next_token.id = tokenid::unknown;
+				_next_token.offset = _next_token.length = 0;
+			}
+			input_level(const std::string &name, std::vector<macro_token> &&tokens, input_level *parent) :
 				_name(name),
-				_lexer(new lexer(text, false, false, true, false)),
+				_tokens(std::move(tokens)),
 				_parent(parent)
 			{
 				_next_token.id = tokenid::unknown;
@@ -57,9 +123,15 @@ namespace reshadefx
 			}
 
 			std::string _name;
+			// Either a lexer for text input, or the tokens of a macro expansion that are read without lexing them again
 			std::unique_ptr<lexer> _lexer;
+			std::vector<macro_token> _tokens;
+			size_t _token_index = 0;
+			// Set on input levels that are the result of a macro expansion, whose tokens are all reported at the location of the macro invocation
+			bool _is_expansion = false;
+			location _expansion_location;
 			token _next_token;
-			size_t _offset;
+			std::string _next_token_raw_data;
 			std::stack<if_level> _if_stack;
 			input_level *_parent;
 		};
@@ -67,16 +139,18 @@ namespace reshadefx
 		void error(const location &location, const std::string &message);
 		void warning(const location &location, const std::string &message);
 
-		lexer &current_lexer();
 		inline token current_token() const { return _token; }
 		std::stack<if_level> &current_if_stack();
 		if_level &current_if_level();
 		void push(const std::string &input, const std::string &name = std::string());
+		void push(std::shared_ptr<const std::string> input, const std::string &name = std::string());
+		void push(std::vector<macro_token> &&tokens, const location &location);
 		bool peek(tokenid token) const;
 		void consume();
 		void consume_until(tokenid token);
 		bool accept(tokenid token);
 		bool expect(tokenid token);
+		void emit_token();
 
 		void parse();
 		void parse_def();
@@ -94,8 +168,10 @@ namespace reshadefx
 
 		bool evaluate_expression();
 		bool evaluate_identifier_as_macro();
+		std::unordered_map<std::string, macro>::const_iterator find_macro(const std::string &name);
+		bool is_macro_defined(const std::string &name) { return find_macro(name) != _macros.end(); }
 
-		void expand_macro(const macro &macro, const std::vector<std::string> &arguments, std::string &out);
+		void expand_macro(const macro &macro, const std::vector<std::vector<macro_token>> &arguments, std::vector<macro_token> &out);
 		void create_macro_replacement_list(macro &macro);
 
 		bool _success = true;
@@ -103,10 +179,16 @@ namespace reshadefx
 		std::stack<input_level> _input_stack;
 		location _output_location;
 		std::string _output, _errors, _current_token_raw_data;
+		bool _is_token_output = false;
+		std::vector<token> _output_tokens;
 		int _recursion_count = 0;
 		std::unordered_map<std::string, macro> _macros;
+		std::unordered_set<std::string> _used_macros;
 		std::vector<std::string> _pragmas;
 		std::vector<reshade::filesystem::path> _include_paths;
-		std::unordered_map<std::string, std::string> _filecache;
+		std::shared_ptr<include_cache> _include_cache = std::make_shared<include_cache>();
+		// Files included so far, with the guard macro of each and whether it contained "#pragma once"
+		std::unordered_map<std::string, std::shared_ptr<const include_cache::file>> _filecache;
+		std::unordered_set<std::string> _pragma_once_files;
 	};
 }
@@ -0,0 +1,178 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_reachability.hpp"
+
+namespace reshadefx
+{
+	using namespace nodes;
+
+	namespace
+	{
+		void visit(const statement_node *node, reachable_declarations &reachable);
+		void visit(const expression_node *node, reachable_declarations &reachable);
+
+		void visit(const variable_declaration_node *node, reachable_declarations &reachable)
+		{
+			if (node == nullptr || !reachable.variables.insert(node).second)
+			{
+				return;
+			}
+
+			visit(node->initializer_expression, reachable);
+
+			if (node->type.is_sampler() && node->properties.texture != nullptr)
+			{
+				visit(node->properties.texture, reachable);
+			}
+		}
+		void visit(const function_declaration_node *node, reachable_declarations &reachable)
+		{
+			if (node == nullptr || !reachable.functions.insert(node).second)
+			{
+				return;
+			}
+
+			visit(node->definition, reachable);
+		}
+		void visit(const expression_node *node, reachable_declarations &reachable)
+		{
+			if (node == nullptr)
+			{
+				return;
+			}
+
+			switch (node->id)
+			{
+				case nodeid::lvalue_expression:
+					visit(static_cast<const lvalue_expression_node *>(node)->reference, reachable);
+					break;
+				case nodeid::unary_expression:
+					visit(static_cast<const unary_expression_node *>(node)->operand, reachable);
+					break;
+				case nodeid::binary_expression:
+					for (auto operand : static_cast<const binary_expression_node *>(node)->operands)
+						visit(operand, reachable);
+					break;
+				case nodeid::intrinsic_expression:
+					for (auto argument : static_cast<const intrinsic_expression_node *>(node)->arguments)
+						visit(argument, reachable);
+					break;
+				case nodeid::conditional_expression:
+					visit(static_cast<const conditional_expression_node *>(node)->condition, reachable);
+					visit(static_cast<const conditional_expression_node *>(node)->expression_when_true, reachable);
+					visit(static_cast<const conditional_expression_node *>(node)->expression_when_false, reachable);
+					break;
+				case nodeid::assignment_expression:
+					visit(static_cast<const assignment_expression_node *>(node)->left, reachable);
+					visit(static_cast<const assignment_expression_node *>(node)->right, reachable);
+					break;
+				case nodeid::expression_sequence:
+					for (auto expression : static_cast<const expression_sequence_node *>(node)->expression_list)
+						visit(expression, reachable);
+					break;
+				case nodeid::call_expression:
+					for (auto argument : static_cast<const call_expression_node *>(node)->arguments)
+						visit(argument, reachable);
+					visit(static_cast<const call_expression_node *>(node)->callee, reachable);
+					break;
+				case nodeid::constructor_expression:
+					for (auto argument : static_cast<const constructor_expression_node *>(node)->arguments)
+						visit(argument, reachable);
+					break;
+				case nodeid::swizzle_expression:
+					visit(static_cast<const swizzle_expression_node *>(node)->operand, reachable);
+					break;
+				case nodeid::field_expression:
+					visit(static_cast<const field_expression_node *>(node)->operand, reachable);
+					break;
+				case nodeid::initializer_list:
+					for (auto value : static_cast<const initializer_list_node *>(node)->values)
+						visit(value, reachable);
+					break;
+			}
+		}
+		void visit(const statement_node *node, reachable_declarations &reachable)
+		{
+			if (node == nullptr)
+			{
+				return;
+			}
+
+			switch (node->id)
+			{
+				case nodeid::compound_statement:
+					for (auto statement : static_cast<const compound_statement_node *>(node)->statement_list)
+						visit(statement, reachable);
+					break;
+				case nodeid::declarator_list:
+					for (auto declarator : static_cast<const declarator_list_node *>(node)->declarator_list)
+						visit(static_cast<const variable_declaration_node *>(declarator), reachable);
+					break;
+				case nodeid::expression_statement:
+					visit(static_cast<const expression_statement_node *>(node)->expression, reachable);
+					break;
+				case nodeid::if_statement:
+					visit(static_cast<const if_statement_node *>(node)->condition, reachable);
+					visit(static_cast<const if_statement_node *>(node)->statement_when_true, reachable);
+					visit(static_cast<const if_statement_node *>(node)->statement_when_false, reachable);
+					break;
+				case nodeid::switch_statement:
+					visit(static_cast<const switch_statement_node *>(node)->test_expression, reachable);
+					for (auto case_statement : static_cast<const switch_statement_node *>(node)->case_list)
+						visit(case_statement->statement_list, reachable);
+					break;
+				case nodeid::case_statement:
+					visit(static_cast<const case_statement_node *>(node)->statement_list, reachable);
+					break;
+				case nodeid::for_statement:
+					visit(static_cast<const for_statement_node *>(node)->init_statement, reachable);
+					visit(static_cast<const for_statement_node *>(node)->condition, reachable);
+					visit(static_cast<const for_statement_node *>(node)->increment_expression, reachable);
+					visit(static_cast<const for_statement_node *>(node)->statement_list, reachable);
+					break;
+				case nodeid::while_statement:
+					visit(static_cast<const while_statement_node *>(node)->condition, reachable);
+					visit(static_cast<const while_statement_node *>(node)->statement_list, reachable);
+					break;
+				case nodeid::return_statement:
+					reachable.discards |= static_cast<const return_statement_node *>(node)->is_discard;
+					visit(static_cast<const return_statement_node *>(node)->return_value, reachable);
+					break;
+			}
+		}
+	}
+
+	void find_reachable_declarations(const function_declaration_node *entry_point, reachable_declarations &reachable)
+	{
+		visit(entry_point, reachable);
+	}
+	std::string reachable_global_code(const std::string &code, const std::vector<global_declaration> &declarations, const reachable_declarations &reachable)
+	{
+		std::string result;
+		result.reserve(code.size());
+
+		size_t offset = 0;
+
+		for (const auto &declaration : declarations)
+		{
+			result.append(code, offset, declaration.code_begin - offset);
+			offset = declaration.code_end;
+
+			const bool is_reachable = declaration.node->id == nodeid::function_declaration ?
+				reachable.functions.count(static_cast<const function_declaration_node *>(declaration.node)) != 0 :
+				reachable.variables.count(static_cast<const variable_declaration_node *>(declaration.node)) != 0;
+
+			if (is_reachable)
+			{
+				result.append(code, declaration.code_begin, declaration.code_end - declaration.code_begin);
+			}
+		}
+
+		result.append(code, offset, std::string::npos);
+
+		return result;
+	}
+}
@@ -0,0 +1,51 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include "effect_syntax_tree_nodes.hpp"
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// The declarations a shader entry point makes use of.
+	/// </summary>
+	struct reachable_declarations
+	{
+		std::unordered_set<const nodes::function_declaration_node *> functions;
+		std::unordered_set<const nodes::variable_declaration_node *> variables;
+		// Whether any of the reachable code discards pixels
+		bool discards = false;
+	};
+
+	/// <summary>
+	/// Collect all functions and variables that are reachable from a shader entry point, following calls, the initializers of referenced variables and the textures of referenced samplers.
+	/// Code generators use this to leave out global declarations a shader does not need.
+	/// </summary>
+	/// <param name="entry_point">The shader function to start from.</param>
+	/// <param name="reachable">The set to add the reachable declarations to, so the declarations of multiple entry points can be merged.</param>
+	void find_reachable_declarations(const nodes::function_declaration_node *entry_point, reachable_declarations &reachable);
+
+	/// <summary>
+	/// The part of the generated global code that belongs to a single variable or function declaration.
+	/// </summary>
+	struct global_declaration
+	{
+		const nodes::declaration_node *node;
+		size_t code_begin, code_end;
+	};
+
+	/// <summary>
+	/// Assemble the global code a shader needs, leaving out the declarations that are not reachable from it. Code in between declarations, like struct definitions, is always kept.
+	/// </summary>
+	/// <param name="code">The global code generated for the entire effect.</param>
+	/// <param name="declarations">The parts of the global code that belong to a single declaration, in the order they appear in.</param>
+	/// <param name="reachable">The declarations the shader makes use of.</param>
+	/// <returns>The global code of the shader.</returns>
+	std::string reachable_global_code(const std::string &code, const std::vector<global_declaration> &declarations, const reachable_declarations &reachable);
+}
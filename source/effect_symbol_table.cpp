@@ -16,33 +16,37 @@ namespace reshadefx
 
 	namespace
 	{
+		// Owns the names of the intrinsic functions below, which are only written during static initialization
+		memory_pool s_intrinsic_pool;
+
 		struct intrinsic
 		{
-			intrinsic(const std::string &name, enum intrinsic_expression_node::op op, type_node::datatype returntype, unsigned int returnrows, unsigned int returncols) : op(op)
+			intrinsic(const std::string &name, enum intrinsic_expression_node::op op, type_node::datatype returntype, unsigned int returnrows, unsigned int returncols)
+				: op(op),
+				// The intrinsic operation is passed on to the parser encoded in the name of the callee, see 'resolve_call'
+				op_name(s_intrinsic_pool.intern(std::string(1, static_cast<char>(op)))),
+				function(s_intrinsic_pool),
+				arguments{ variable_declaration_node(s_intrinsic_pool), variable_declaration_node(s_intrinsic_pool), variable_declaration_node(s_intrinsic_pool), variable_declaration_node(s_intrinsic_pool) }
 			{
-				function.name = name;
+				assert(op < 0xFF);
+
+				function.name = s_intrinsic_pool.intern(name);
 				function.return_type.basetype = returntype;
 				function.return_type.rows = returnrows;
 				function.return_type.cols = returncols;
 			}
-			intrinsic(const std::string &name, enum intrinsic_expression_node::op op, type_node::datatype returntype, unsigned int returnrows, unsigned int returncols, type_node::datatype arg0type, unsigned int arg0rows, unsigned int arg0cols) : op(op)
+			intrinsic(const std::string &name, enum intrinsic_expression_node::op op, type_node::datatype returntype, unsigned int returnrows, unsigned int returncols, type_node::datatype arg0type, unsigned int arg0rows, unsigned int arg0cols)
+				: intrinsic(name, op, returntype, returnrows, returncols)
 			{
-				function.name = name;
-				function.return_type.basetype = returntype;
-				function.return_type.rows = returnrows;
-				function.return_type.cols = returncols;
 				arguments[0].type.basetype = arg0type;
 				arguments[0].type.rows = arg0rows;
 				arguments[0].type.cols = arg0cols;
 
 				function.parameter_list.push_back(&arguments[0]);
 			}
-			intrinsic(const std::string &name, enum intrinsic_expression_node::op op, type_node::datatype returntype, unsigned int returnrows, unsigned int returncols, type_node::datatype arg0type, unsigned int arg0rows, unsigned int arg0cols, type_node::datatype arg1type, unsigned int arg1rows, unsigned int arg1cols) : op(op)
+			intrinsic(const std::string &name, enum intrinsic_expression_node::op op, type_node::datatype returntype, unsigned int returnrows, unsigned int returncols, type_node::datatype arg0type, unsigned int arg0rows, unsigned int arg0cols, type_node::datatype arg1type, unsigned int arg1rows, unsigned int arg1cols)
+				: intrinsic(name, op, returntype, returnrows, returncols)
 			{
-				function.name = name;
-				function.return_type.basetype = returntype;
-				function.return_type.rows = returnrows;
-				function.return_type.cols = returncols;
 				arguments[0].type.basetype = arg0type;
 				arguments[0].type.rows = arg0rows;
 				arguments[0].type.cols = arg0cols;
@@ -53,12 +57,9 @@ namespace reshadefx
 				function.parameter_list.push_back(&arguments[0]);
 				function.parameter_list.push_back(&arguments[1]);
 			}
-			intrinsic(const std::string &name, enum intrinsic_expression_node::op op, type_node::datatype returntype, unsigned int returnrows, unsigned int returncols, type_node::datatype arg0type, unsigned int arg0rows, unsigned int arg0cols, type_node::datatype arg1type, unsigned int arg1rows, unsigned int arg1cols, type_node::datatype arg2type, unsigned int arg2rows, unsigned int arg2cols) : op(op)
+			intrinsic(const std::string &name, enum intrinsic_expression_node::op op, type_node::datatype returntype, unsigned int returnrows, unsigned int returncols, type_node::datatype arg0type, unsigned int arg0rows, unsigned int arg0cols, type_node::datatype arg1type, unsigned int arg1rows, unsigned int arg1cols, type_node::datatype arg2type, unsigned int arg2rows, unsigned int arg2cols)
+				: intrinsic(name, op, returntype, returnrows, returncols)
 			{
-				function.name = name;
-				function.return_type.basetype = returntype;
-				function.return_type.rows = returnrows;
-				function.return_type.cols = returncols;
 				arguments[0].type.basetype = arg0type;
 				arguments[0].type.rows = arg0rows;
 				arguments[0].type.cols = arg0cols;
@@ -73,12 +74,9 @@ namespace reshadefx
 				function.parameter_list.push_back(&arguments[1]);
 				function.parameter_list.push_back(&arguments[2]);
 			}
-			intrinsic(const std::string &name, enum intrinsic_expression_node::op op, type_node::datatype returntype, unsigned int returnrows, unsigned int returncols, type_node::datatype arg0type, unsigned int arg0rows, unsigned int arg0cols, type_node::datatype arg1type, unsigned int arg1rows, unsigned int arg1cols, type_node::datatype arg2type, unsigned int arg2rows, unsigned int arg2cols, type_node::datatype arg3type, unsigned int arg3rows, unsigned int arg3cols) : op(op)
+			intrinsic(const std::string &name, enum intrinsic_expression_node::op op, type_node::datatype returntype, unsigned int returnrows, unsigned int returncols, type_node::datatype arg0type, unsigned int arg0rows, unsigned int arg0cols, type_node::datatype arg1type, unsigned int arg1rows, unsigned int arg1cols, type_node::datatype arg2type, unsigned int arg2rows, unsigned int arg2cols, type_node::datatype arg3type, unsigned int arg3rows, unsigned int arg3cols)
+				: intrinsic(name, op, returntype, returnrows, returncols)
 			{
-				function.name = name;
-				function.return_type.basetype = returntype;
-				function.return_type.rows = returnrows;
-				function.return_type.cols = returncols;
 				arguments[0].type.basetype = arg0type;
 				arguments[0].type.rows = arg0rows;
 				arguments[0].type.cols = arg0cols;
@@ -99,6 +97,7 @@ namespace reshadefx
 			}
 
 			enum intrinsic_expression_node::op op;
+			pool_string op_name;
 			function_declaration_node function;
 			variable_declaration_node arguments[4];
 		};
@@ -148,6 +147,7 @@ namespace reshadefx
 			intrinsic("atan2", intrinsic_expression_node::atan2, type_node::datatype_float, 2, 1, type_node::datatype_float, 2, 1, type_node::datatype_float, 2, 1),
 			intrinsic("atan2", intrinsic_expression_node::atan2, type_node::datatype_float, 3, 1, type_node::datatype_float, 3, 1, type_node::datatype_float, 3, 1),
 			intrinsic("atan2", intrinsic_expression_node::atan2, type_node::datatype_float, 4, 1, type_node::datatype_float, 4, 1, type_node::datatype_float, 4, 1),
+			intrinsic("barrier", intrinsic_expression_node::barrier, type_node::datatype_void, 0, 0),
 			intrinsic("ceil", intrinsic_expression_node::ceil, type_node::datatype_float, 1, 1, type_node::datatype_float, 1, 1),
 			intrinsic("ceil", intrinsic_expression_node::ceil, type_node::datatype_float, 2, 1, type_node::datatype_float, 2, 1),
 			intrinsic("ceil", intrinsic_expression_node::ceil, type_node::datatype_float, 3, 1, type_node::datatype_float, 3, 1),
@@ -368,6 +368,7 @@ namespace reshadefx
 			intrinsic("tex2Doffset", intrinsic_expression_node::texture_offset, type_node::datatype_float, 4, 1, type_node::datatype_sampler, 0, 0, type_node::datatype_float, 2, 1, type_node::datatype_int,  2, 1),
 			intrinsic("tex2Dproj", intrinsic_expression_node::texture_projection, type_node::datatype_float, 4, 1, type_node::datatype_sampler, 0, 0, type_node::datatype_float, 4, 1),
 			intrinsic("tex2Dsize", intrinsic_expression_node::texture_size, type_node::datatype_int, 2, 1, type_node::datatype_sampler, 0, 0, type_node::datatype_int, 1, 1),
+			intrinsic("tex2Dstore", intrinsic_expression_node::texture_store, type_node::datatype_void, 0, 0, type_node::datatype_storage, 0, 0, type_node::datatype_int, 2, 1, type_node::datatype_float, 4, 1),
 			intrinsic("transpose", intrinsic_expression_node::transpose, type_node::datatype_float, 2, 2, type_node::datatype_float, 2, 2),
 			intrinsic("transpose", intrinsic_expression_node::transpose, type_node::datatype_float, 3, 3, type_node::datatype_float, 3, 3),
 			intrinsic("transpose", intrinsic_expression_node::transpose, type_node::datatype_float, 4, 4, type_node::datatype_float, 4, 4),
@@ -377,6 +378,21 @@ namespace reshadefx
 			intrinsic("trunc", intrinsic_expression_node::trunc, type_node::datatype_float, 4, 1, type_node::datatype_float, 4, 1),
 		};
 
+		// The overloads of an intrinsic, indexed by name once on first use, so resolving a call does not compare it against the whole table
+		const std::vector<const intrinsic *> *find_intrinsic_overloads(std::string_view name)
+		{
+			static const auto s_intrinsic_overloads = []() {
+				std::unordered_map<std::string_view, std::vector<const intrinsic *>> overloads;
+				for (const intrinsic &intrinsic : s_intrinsics)
+					overloads[intrinsic.function.name].push_back(&intrinsic);
+				return overloads;
+			}();
+
+			const auto it = s_intrinsic_overloads.find(name);
+
+			return it != s_intrinsic_overloads.end() ? &it->second : nullptr;
+		}
+
 		int compare_functions(const call_expression_node *call, const function_declaration_node *function1, const function_declaration_node *function2)
 		{
 			if (function2 == nullptr)
@@ -483,7 +499,8 @@ namespace reshadefx
 		return rank;
 	}
 
-	symbol_table::symbol_table()
+	symbol_table::symbol_table() :
+		_symbol_stack(memory_pool::allocator<std::pair<const std::string_view, scope_list>>(_pool))
 	{
 		_current_scope.name = "::";
 		_current_scope.level = 0;
@@ -513,22 +530,23 @@ namespace reshadefx
 	{
 		assert(_current_scope.level > 0);
 
-		for (auto &symbol : _symbol_stack)
+		// Only remove the symbols declared in this scope, instead of scanning every name in the table
+		while (!_local_symbols.empty() && _local_symbols.back().level >= _current_scope.level)
 		{
-			auto &scope_list = symbol.second;
+			const local_symbol &local = _local_symbols.back();
+			auto &scope_list = *local.list;
 
-			for (auto scope_it = scope_list.begin(); scope_it != scope_list.end();)
+			// The list is sorted by namespace level, so the symbol is usually the last one, but may be followed by symbols of nested namespaces
+			for (auto scope_it = scope_list.end(); scope_it != scope_list.begin();)
 			{
-				if (scope_it->first.level > scope_it->first.namespace_level &&
-					scope_it->first.level >= _current_scope.level)
+				if ((--scope_it)->second == local.declaration && scope_it->first.level == local.level)
 				{
-					scope_it = scope_list.erase(scope_it);
-				}
-				else
-				{
-					++scope_it;
+					scope_list.erase(scope_it);
+					break;
 				}
 			}
+
+			_local_symbols.pop_back();
 		}
 
 		_parent_stack.pop();
@@ -545,6 +563,18 @@ namespace reshadefx
 		_current_scope.namespace_level--;
 	}
 
+	symbol_table::scope_list &symbol_table::find_or_insert(std::string_view name)
+	{
+		const auto it = _symbol_stack.find(name);
+
+		if (it != _symbol_stack.end())
+		{
+			return it->second;
+		}
+
+		return _symbol_stack.emplace(_pool.intern(name), scope_list(memory_pool::allocator<std::pair<scope, symbol>>(_pool))).first->second;
+	}
+
 	bool symbol_table::insert(symbol symbol, bool global)
 	{
 		// Make sure the symbol does not exist yet
@@ -575,7 +605,7 @@ namespace reshadefx
 				const auto previous_scope_name = _current_scope.name.substr(pos);
 
 				// Insert symbol into this scope
-				insert_sorted(_symbol_stack[previous_scope_name + symbol->name], std::make_pair(scope, symbol));
+				insert_sorted(find_or_insert(previous_scope_name + symbol->name), std::make_pair(scope, symbol));
 
 				// Continue walking up the scope chain
 				scope.level = ++scope.namespace_level;
@@ -584,17 +614,24 @@ namespace reshadefx
 		else
 		{
 			// This is a local symbol so it's sufficient to update the symbol stack with just the current scope
-			insert_sorted(_symbol_stack[symbol->name], std::make_pair(_current_scope, symbol));
+			auto &scope_list = find_or_insert(symbol->name);
+			insert_sorted(scope_list, std::make_pair(_current_scope, symbol));
+
+			// Remember where it went, so it can be removed again right away when its scope is left
+			if (_current_scope.level > _current_scope.namespace_level)
+			{
+				_local_symbols.push_back({ _current_scope.level, &scope_list, symbol });
+			}
 		}
 
 		return true;
 	}
-	symbol symbol_table::find(const std::string &name) const
+	symbol symbol_table::find(std::string_view name) const
 	{
 		// Default to start search with current scope and walk back the scope chain
 		return find(name, _current_scope, false);
 	}
-	symbol symbol_table::find(const std::string &name, const scope &scope, bool exclusive) const
+	symbol symbol_table::find(std::string_view name, const scope &scope, bool exclusive) const
 	{
 		const auto it = _symbol_stack.find(name);
 
@@ -640,7 +677,7 @@ namespace reshadefx
 
 		unsigned int overload_count = 0, overload_namespace = scope.namespace_level;
 		const function_declaration_node *overload = nullptr;
-		auto intrinsic_op = intrinsic_expression_node::none;
+		pool_string intrinsic_name;
 
 		const auto it = _symbol_stack.find(call->callee_name);
 
@@ -694,16 +731,17 @@ namespace reshadefx
 
 		if (overload_count == 0)
 		{
-			for (auto &intrinsic : s_intrinsics)
+			const auto intrinsics = find_intrinsic_overloads(call->callee_name);
+
+			for (size_t i = 0, count = intrinsics != nullptr ? intrinsics->size() : 0; i < count; ++i)
 			{
-				if (intrinsic.function.name != call->callee_name)
-				{
-					continue;
-				}
+				const intrinsic &intrinsic = *(*intrinsics)[i];
+
+				// Only overloads with the same number of arguments are candidates, but a mismatch still means the name refers to an intrinsic
 				if (intrinsic.function.parameter_list.size() != call->arguments.size())
 				{
-					is_intrinsic = overload_count == 0;
-					break;
+					is_intrinsic = true;
+					continue;
 				}
 
 				const int comparison = compare_functions(call, &intrinsic.function, overload);
@@ -714,7 +752,7 @@ namespace reshadefx
 					overload_count = 1;
 
 					is_intrinsic = true;
-					intrinsic_op = intrinsic.op;
+					intrinsic_name = intrinsic.op_name;
 				}
 				else if (comparison == 0 && overload_namespace == 0)
 				{
@@ -730,9 +768,7 @@ namespace reshadefx
 
 			if (is_intrinsic)
 			{
-				assert(intrinsic_op < 0xFF);
-
-				call->callee_name = static_cast<char>(intrinsic_op);
+				call->callee_name = intrinsic_name;
 			}
 			else
 			{
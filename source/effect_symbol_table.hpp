@@ -6,8 +6,10 @@
 #pragma once
 
 #include <stack>
+#include <vector>
 #include <unordered_map>
 #include <string>
+#include "effect_memory_pool.hpp"
 
 namespace reshadefx
 {
@@ -50,13 +52,29 @@ namespace reshadefx
 		const scope &current_scope() const { return _current_scope; }
 
 		bool insert(symbol symbol, bool global = false);
-		symbol find(const std::string &name) const;
-		symbol find(const std::string &name, const scope &scope, bool exclusive) const;
+		symbol find(std::string_view name) const;
+		symbol find(std::string_view name, const scope &scope, bool exclusive) const;
 		bool resolve_call(nodes::call_expression_node *call, const scope &scope, bool &intrinsic, bool &ambiguous) const;
 
 	private:
+		using scope_list = std::vector<std::pair<scope, symbol>, memory_pool::allocator<std::pair<scope, symbol>>>;
+
+		scope_list &find_or_insert(std::string_view name);
+
+		// A local symbol together with the list it was added to, so leaving its scope only has to touch the symbols declared in it
+		struct local_symbol
+		{
+			unsigned int level;
+			scope_list *list;
+			symbol declaration;
+		};
+
 		scope _current_scope;
 		std::stack<symbol> _parent_stack;
-		std::unordered_map<std::string, std::vector<std::pair<scope, symbol>>> _symbol_stack;
+		// Symbol names and lists are allocated from the pool, so they are all freed at once with the symbol table
+		memory_pool _pool;
+		std::unordered_map<std::string_view, scope_list, std::hash<std::string_view>, std::equal_to<std::string_view>, memory_pool::allocator<std::pair<const std::string_view, scope_list>>> _symbol_stack;
+		// Local symbols in the order they were declared, which is also ordered by scope level since scopes nest
+		std::vector<local_symbol> _local_symbols;
 	};
 }
@@ -6,7 +6,7 @@
 #pragma once
 
 #include "effect_syntax_tree_nodes.hpp"
-#include <list>
+#include "effect_memory_pool.hpp"
 
 namespace reshadefx
 {
@@ -15,8 +15,11 @@ namespace reshadefx
 		syntax_tree(const syntax_tree &) = delete;
 		syntax_tree &operator=(const syntax_tree &) = delete;
 
+		// Declared first, so it outlives everything below that allocates from it
+		memory_pool _pool;
+
 	public:
-		syntax_tree() { }
+		syntax_tree() : structs(_pool), variables(_pool), functions(_pool), techniques(_pool) { }
 
 		template <typename T>
 		T *make_node(const location &location)
@@ -26,78 +29,44 @@ namespace reshadefx
 
 			return node;
 		}
-
-		std::vector<nodes::struct_declaration_node *> structs;
-		std::vector<nodes::variable_declaration_node *> variables;
-		std::vector<nodes::function_declaration_node *> functions;
-		std::vector<nodes::technique_declaration_node *> techniques;
-
-	private:
-		class memory_pool
+		/// <summary>
+		/// Copy a string into the pool of the syntax tree, so it can be assigned to a node.
+		/// </summary>
+		pool_string make_string(std::string_view string)
 		{
-			struct page
-			{
-				explicit page(size_t size) : cursor(0), memory(size, '\0') { }
-
-				size_t cursor;
-				std::vector<unsigned char> memory;
-			};
-			struct nodeinfo
-			{
-				size_t size;
-				void(*dtor)(void *);
-				unsigned char data[sizeof(node)];
-			};
+			return _pool.intern(string);
+		}
 
-		public:
-			~memory_pool()
-			{
-				clear();
-			}
+		memory_pool::vector<nodes::struct_declaration_node *> structs;
+		memory_pool::vector<nodes::variable_declaration_node *> variables;
+		memory_pool::vector<nodes::function_declaration_node *> functions;
+		memory_pool::vector<nodes::technique_declaration_node *> techniques;
 
-			template <typename T>
-			T *add()
-			{
-				auto size = sizeof(nodeinfo) - sizeof(node) + sizeof(T);
-				auto page = std::find_if(_pages.begin(), _pages.end(),
-					[size](const struct page &page)
-				{
-					return page.cursor + size < page.memory.size();
-				});
+		/// <summary>
+		/// Get the number of bytes the syntax tree occupies in memory.
+		/// All nodes, their names and child lists are in its pool, only the values of annotations on global variables and techniques own heap memory of their own, which is added to it.
+		/// </summary>
+		size_t memory_usage() const
+		{
+			size_t size = _pool.size();
 
-				if (page == _pages.end())
+			const auto add_annotations = [&size](const nodes::annotation_map &annotations) {
+				for (const auto &annotation : annotations)
 				{
-					_pages.emplace_back(std::max(size_t(4096), size));
-
-					page = std::prev(_pages.end());
+					size += annotation.second.heap_size();
 				}
+			};
 
-				const auto node = new (&page->memory.at(page->cursor)) nodeinfo;
-				const auto node_data = new (&node->data) T();
-				node->size = size;
-				node->dtor = [](void *object) { reinterpret_cast<T *>(object)->~T(); };
-
-				page->cursor += node->size;
-
-				return node_data;
+			for (const auto variable : variables)
+			{
+				add_annotations(variable->annotation_list);
 			}
-			void clear()
+			for (const auto technique : techniques)
 			{
-				for (auto &page : _pages)
-				{
-					auto node = reinterpret_cast<nodeinfo *>(&page.memory.front());
-
-					do
-					{
-						node->dtor(node->data);
-						node = reinterpret_cast<nodeinfo *>(reinterpret_cast<unsigned char *>(node) + node->size);
-					}
-					while (node->size > 0 && (page.cursor -= node->size) > 0);
-				}
+				add_annotations(technique->annotation_list);
 			}
 
-		private:
-			std::list<page> _pages;
-		} _pool;
+			return size;
+		}
 	};
 }
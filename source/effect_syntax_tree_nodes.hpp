@@ -8,6 +8,8 @@
 #include "variant.hpp"
 #include "source_location.hpp"
 #include "runtime_objects.hpp"
+#include "effect_memory_pool.hpp"
+#include <unordered_map>
 
 namespace reshadefx
 {
@@ -63,6 +65,22 @@ namespace reshadefx
 
 namespace reshadefx::nodes
 {
+	// Annotation names are interned in the pool of the syntax tree, only the values still own their memory
+	using annotation_map = std::unordered_map<std::string_view, reshade::variant, std::hash<std::string_view>, std::equal_to<std::string_view>, memory_pool::allocator<std::pair<const std::string_view, reshade::variant>>>;
+
+	/// <summary>
+	/// Copy annotations into a map that owns its names, like the one of a runtime object.
+	/// </summary>
+	inline void copy_annotations(const annotation_map &annotations, std::unordered_map<std::string, reshade::variant> &out)
+	{
+		out.clear();
+
+		for (const auto &annotation : annotations)
+		{
+			out.emplace(annotation.first, annotation.second);
+		}
+	}
+
 	struct type_node
 	{
 		enum datatype
@@ -76,6 +94,7 @@ namespace reshadefx::nodes
 			datatype_sampler,
 			datatype_texture,
 			datatype_struct,
+			datatype_storage,
 		};
 		enum qualifier : unsigned int
 		{
@@ -88,6 +107,7 @@ namespace reshadefx::nodes
 			qualifier_in = 1 << 5,
 			qualifier_out = 1 << 6,
 			qualifier_inout = qualifier_in | qualifier_out,
+			qualifier_groupshared = 1 << 7,
 
 			// Modifier
 			qualifier_const = 1 << 8,
@@ -112,6 +132,7 @@ namespace reshadefx::nodes
 		inline bool is_floating_point() const { return basetype == datatype_float; }
 		inline bool is_texture() const { return basetype == datatype_texture; }
 		inline bool is_sampler() const { return basetype == datatype_sampler; }
+		inline bool is_storage() const { return basetype == datatype_storage; }
 		inline bool is_struct() const { return basetype == datatype_struct; }
 		inline bool has_qualifier(qualifier qualifier) const { return (qualifiers & qualifier) == qualifier; }
 
@@ -131,14 +152,14 @@ namespace reshadefx::nodes
 	};
 	struct statement_node abstract : public node
 	{
-		std::vector<std::string> attributes;
+		memory_pool::vector<pool_string> attributes;
 
 	protected:
-		statement_node(nodeid id) : node(id) { }
+		statement_node(nodeid id, memory_pool &pool) : node(id), attributes(pool) { }
 	};
 	struct declaration_node abstract : public node
 	{
-		std::string name, unique_name;
+		pool_string name, unique_name;
 
 	protected:
 		declaration_node(nodeid id) : node(id) { }
@@ -162,7 +183,7 @@ namespace reshadefx::nodes
 			float value_float[16];
 		};
 
-		std::string value_string;
+		pool_string value_string;
 	};
 	struct unary_expression_node : public expression_node
 	{
@@ -231,6 +252,7 @@ namespace reshadefx::nodes
 			bitcast_float2uint,
 			atan,
 			atan2,
+			barrier,
 			ceil,
 			clamp,
 			cos,
@@ -290,6 +312,7 @@ namespace reshadefx::nodes
 			texture_offset,
 			texture_projection,
 			texture_size,
+			texture_store,
 			transpose,
 			trunc
 		};
@@ -330,23 +353,23 @@ namespace reshadefx::nodes
 	};
 	struct expression_sequence_node : public expression_node
 	{
-		expression_sequence_node() : expression_node(nodeid::expression_sequence) { }
+		explicit expression_sequence_node(memory_pool &pool) : expression_node(nodeid::expression_sequence), expression_list(pool) { }
 
-		std::vector<expression_node *> expression_list;
+		memory_pool::vector<expression_node *> expression_list;
 	};
 	struct call_expression_node : public expression_node
 	{
-		call_expression_node() : expression_node(nodeid::call_expression) { }
+		explicit call_expression_node(memory_pool &pool) : expression_node(nodeid::call_expression), arguments(pool) { }
 
-		std::string callee_name;
+		pool_string callee_name;
 		const struct function_declaration_node *callee;
-		std::vector<expression_node *> arguments;
+		memory_pool::vector<expression_node *> arguments;
 	};
 	struct constructor_expression_node : public expression_node
 	{
-		constructor_expression_node() : expression_node(nodeid::constructor_expression) { }
+		explicit constructor_expression_node(memory_pool &pool) : expression_node(nodeid::constructor_expression), arguments(pool) { }
 
-		std::vector<expression_node *> arguments;
+		memory_pool::vector<expression_node *> arguments;
 	};
 	struct swizzle_expression_node : public expression_node
 	{
@@ -364,48 +387,48 @@ namespace reshadefx::nodes
 	};
 	struct initializer_list_node : public expression_node
 	{
-		initializer_list_node() : expression_node(nodeid::initializer_list) { }
+		explicit initializer_list_node(memory_pool &pool) : expression_node(nodeid::initializer_list), values(pool) { }
 
-		std::vector<expression_node *> values;
+		memory_pool::vector<expression_node *> values;
 	};
 
 	// Statements
 	struct compound_statement_node : public statement_node
 	{
-		compound_statement_node() : statement_node(nodeid::compound_statement) { }
+		explicit compound_statement_node(memory_pool &pool) : statement_node(nodeid::compound_statement, pool), statement_list(pool) { }
 
-		std::vector<statement_node *> statement_list;
+		memory_pool::vector<statement_node *> statement_list;
 	};
 	struct expression_statement_node : public statement_node
 	{
-		expression_statement_node() : statement_node(nodeid::expression_statement) { }
+		explicit expression_statement_node(memory_pool &pool) : statement_node(nodeid::expression_statement, pool) { }
 
 		expression_node *expression;
 	};
 	struct if_statement_node : public statement_node
 	{
-		if_statement_node() : statement_node(nodeid::if_statement) { }
+		explicit if_statement_node(memory_pool &pool) : statement_node(nodeid::if_statement, pool) { }
 
 		expression_node *condition;
 		statement_node *statement_when_true, *statement_when_false;
 	};
 	struct case_statement_node : public statement_node
 	{
-		case_statement_node() : statement_node(nodeid::case_statement) { }
+		explicit case_statement_node(memory_pool &pool) : statement_node(nodeid::case_statement, pool), labels(pool) { }
 
 		statement_node *statement_list;
-		std::vector<literal_expression_node *> labels;
+		memory_pool::vector<literal_expression_node *> labels;
 	};
 	struct switch_statement_node : public statement_node
 	{
-		switch_statement_node() : statement_node(nodeid::switch_statement) { }
+		explicit switch_statement_node(memory_pool &pool) : statement_node(nodeid::switch_statement, pool), case_list(pool) { }
 
 		expression_node *test_expression;
-		std::vector<case_statement_node *> case_list;
+		memory_pool::vector<case_statement_node *> case_list;
 	};
 	struct for_statement_node : public statement_node
 	{
-		for_statement_node() : statement_node(nodeid::for_statement) { }
+		explicit for_statement_node(memory_pool &pool) : statement_node(nodeid::for_statement, pool) { }
 
 		statement_node *init_statement;
 		expression_node *condition, *increment_expression;
@@ -413,7 +436,7 @@ namespace reshadefx::nodes
 	};
 	struct while_statement_node : public statement_node
 	{
-		while_statement_node() : statement_node(nodeid::while_statement) { }
+		explicit while_statement_node(memory_pool &pool) : statement_node(nodeid::while_statement, pool) { }
 
 		bool is_do_while;
 		expression_node *condition;
@@ -421,14 +444,14 @@ namespace reshadefx::nodes
 	};
 	struct return_statement_node : public statement_node
 	{
-		return_statement_node() : statement_node(nodeid::return_statement) { }
+		explicit return_statement_node(memory_pool &pool) : statement_node(nodeid::return_statement, pool) { }
 
 		bool is_discard;
 		expression_node *return_value;
 	};
 	struct jump_statement_node : public statement_node
 	{
-		jump_statement_node() : statement_node(nodeid::jump_statement) { }
+		explicit jump_statement_node(memory_pool &pool) : statement_node(nodeid::jump_statement, pool) { }
 
 		bool is_break, is_continue;
 	};
@@ -436,11 +459,11 @@ namespace reshadefx::nodes
 	// Declarations
 	struct variable_declaration_node : public declaration_node
 	{
-		variable_declaration_node() : declaration_node(nodeid::variable_declaration) { }
+		explicit variable_declaration_node(memory_pool &pool) : declaration_node(nodeid::variable_declaration), annotation_list(pool) { }
 
 		type_node type;
-		std::unordered_map<std::string, reshade::variant> annotation_list;
-		std::string semantic;
+		annotation_map annotation_list;
+		pool_string semantic;
 		expression_node *initializer_expression;
 
 		struct
@@ -458,23 +481,23 @@ namespace reshadefx::nodes
 	};
 	struct declarator_list_node : public statement_node
 	{
-		declarator_list_node() : statement_node(nodeid::declarator_list) { }
+		explicit declarator_list_node(memory_pool &pool) : statement_node(nodeid::declarator_list, pool), declarator_list(pool) { }
 
-		std::vector<variable_declaration_node *> declarator_list;
+		memory_pool::vector<variable_declaration_node *> declarator_list;
 	};
 	struct struct_declaration_node : public declaration_node
 	{
-		struct_declaration_node() : declaration_node(nodeid::struct_declaration) { }
+		explicit struct_declaration_node(memory_pool &pool) : declaration_node(nodeid::struct_declaration), field_list(pool) { }
 
-		std::vector<variable_declaration_node *> field_list;
+		memory_pool::vector<variable_declaration_node *> field_list;
 	};
 	struct function_declaration_node : public declaration_node
 	{
-		function_declaration_node() : declaration_node(nodeid::function_declaration) { }
+		explicit function_declaration_node(memory_pool &pool) : declaration_node(nodeid::function_declaration), parameter_list(pool) { }
 
 		type_node return_type;
-		std::vector<variable_declaration_node *> parameter_list;
-		std::string return_semantic;
+		memory_pool::vector<variable_declaration_node *> parameter_list;
+		pool_string return_semantic;
 		compound_statement_node *definition;
 	};
 	struct pass_declaration_node : public declaration_node
@@ -522,6 +545,10 @@ namespace reshadefx::nodes
 
 		const variable_declaration_node *render_targets[8];
 		const function_declaration_node *vertex_shader, *pixel_shader;
+		// Compute passes have no vertex or pixel shader and write to storage objects instead of render targets
+		const function_declaration_node *compute_shader;
+		// The thread group size is compiled into the shader, a dispatch size of zero covers the frame with thread groups
+		unsigned int thread_group_size[3] = { 8, 8, 1 }, dispatch_size[3] = { 0, 0, 1 };
 		bool clear_render_targets = true, srgb_write_enable, blend_enable, stencil_enable;
 		unsigned char color_write_mask = 0xF, stencil_read_mask = 0xFF, stencil_write_mask = 0xFF;
 		unsigned int blend_op = ADD, blend_op_alpha = ADD, src_blend = ONE, dest_blend = ZERO, src_blend_alpha = ONE, dest_blend_alpha = ZERO;
@@ -529,9 +556,9 @@ namespace reshadefx::nodes
 	};
 	struct technique_declaration_node : public declaration_node
 	{
-		technique_declaration_node() : declaration_node(nodeid::technique_declaration) { }
+		explicit technique_declaration_node(memory_pool &pool) : declaration_node(nodeid::technique_declaration), annotation_list(pool), pass_list(pool) { }
 
-		std::unordered_map<std::string, reshade::variant> annotation_list;
-		std::vector<pass_declaration_node *> pass_list;
+		annotation_map annotation_list;
+		memory_pool::vector<pass_declaration_node *> pass_list;
 	};
 }
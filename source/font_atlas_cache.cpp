@@ -0,0 +1,267 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "log.hpp"
+#include "shader_cache.hpp"
+#include "font_atlas_cache.hpp"
+#include "xxhash.h"
+#include <vector>
+#include <fstream>
+#include <imgui.h>
+#include <Windows.h>
+
+namespace reshade::font_atlas_cache
+{
+	// File layout: Header, then the custom rectangles, then a font header and the glyphs for every font, then the alpha texture
+	struct cache_file_header
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long key;
+		int tex_width, tex_height;
+		float white_pixel_u, white_pixel_v;
+		int font_count, custom_rect_count, cursor_rect_index;
+	};
+	struct cache_font_header
+	{
+		float size, ascent, descent;
+		unsigned int fallback_char;
+		int glyph_count;
+	};
+
+	// The custom rectangle type was renamed between ImGui versions, but the atlas always keeps them in the same vector
+	using custom_rect = decltype(ImFontAtlas::CustomRects)::value_type;
+
+	static const unsigned int s_cache_magic = 0x41465352; // 'RSFA'
+	static const unsigned int s_cache_version = 1;
+
+	static filesystem::path cache_file_path(unsigned long long key)
+	{
+		char filename[32];
+		sprintf_s(filename, "%016llx.font", key);
+
+		return shader_cache::cache_directory() / filename;
+	}
+
+	// Merged fonts share glyphs across configurations, which this cache does not keep track of
+	static bool is_cacheable(const ImFontAtlas &atlas)
+	{
+		if (atlas.Fonts.Size == 0 || atlas.Fonts.Size != atlas.ConfigData.Size)
+		{
+			return false;
+		}
+
+		for (int i = 0; i < atlas.ConfigData.Size; i++)
+		{
+			if (atlas.ConfigData[i].MergeMode)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	unsigned long long compute_key(const ImFontAtlas &atlas)
+	{
+		XXH64_state_t state;
+		XXH64_reset(&state, 0);
+		XXH64_update(&state, IMGUI_VERSION, sizeof(IMGUI_VERSION));
+		XXH64_update(&state, &atlas.Flags, sizeof(atlas.Flags));
+		XXH64_update(&state, &atlas.TexDesiredWidth, sizeof(atlas.TexDesiredWidth));
+		XXH64_update(&state, &atlas.TexGlyphPadding, sizeof(atlas.TexGlyphPadding));
+
+		for (int i = 0; i < atlas.ConfigData.Size; i++)
+		{
+			const ImFontConfig &config = atlas.ConfigData[i];
+
+			XXH64_update(&state, config.FontData, config.FontDataSize);
+			XXH64_update(&state, &config.FontNo, sizeof(config.FontNo));
+			XXH64_update(&state, &config.SizePixels, sizeof(config.SizePixels));
+			XXH64_update(&state, &config.OversampleH, sizeof(config.OversampleH));
+			XXH64_update(&state, &config.OversampleV, sizeof(config.OversampleV));
+			XXH64_update(&state, &config.PixelSnapH, sizeof(config.PixelSnapH));
+			XXH64_update(&state, &config.GlyphExtraSpacing, sizeof(config.GlyphExtraSpacing));
+			XXH64_update(&state, &config.GlyphOffset, sizeof(config.GlyphOffset));
+			XXH64_update(&state, &config.RasterizerMultiply, sizeof(config.RasterizerMultiply));
+
+			// Ranges are pairs of characters terminated by a zero, no ranges means the default ones, which are part of the version already
+			if (const ImWchar *const ranges = config.GlyphRanges; ranges != nullptr)
+			{
+				size_t range_count = 0;
+				while (ranges[range_count] != 0)
+					range_count++;
+
+				XXH64_update(&state, ranges, range_count * sizeof(ImWchar));
+			}
+		}
+
+		return XXH64_digest(&state);
+	}
+
+	bool load(ImFontAtlas &atlas, unsigned long long key)
+	{
+		if (!is_cacheable(atlas))
+		{
+			return false;
+		}
+
+		std::ifstream file(cache_file_path(key).wstring(), std::ios::in | std::ios::binary);
+
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		cache_file_header header = { };
+
+		if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+			header.magic != s_cache_magic || header.version != s_cache_version || header.key != key ||
+			header.font_count != atlas.Fonts.Size || header.tex_width <= 0 || header.tex_height <= 0 ||
+			header.custom_rect_count < 0 || header.cursor_rect_index >= header.custom_rect_count)
+		{
+			return false;
+		}
+
+		// Read everything before touching the atlas, so a truncated file leaves it ready to be built as usual
+		std::vector<custom_rect> custom_rects(header.custom_rect_count);
+		std::vector<cache_font_header> font_headers(header.font_count);
+		std::vector<std::vector<ImFontGlyph>> font_glyphs(header.font_count);
+		std::vector<unsigned char> pixels(static_cast<size_t>(header.tex_width) * header.tex_height);
+
+		if (!file.read(reinterpret_cast<char *>(custom_rects.data()), custom_rects.size() * sizeof(custom_rect)))
+		{
+			return false;
+		}
+
+		for (int i = 0; i < header.font_count; i++)
+		{
+			if (!file.read(reinterpret_cast<char *>(&font_headers[i]), sizeof(cache_font_header)) || font_headers[i].glyph_count < 0)
+			{
+				return false;
+			}
+
+			font_glyphs[i].resize(font_headers[i].glyph_count);
+
+			if (!file.read(reinterpret_cast<char *>(font_glyphs[i].data()), font_glyphs[i].size() * sizeof(ImFontGlyph)))
+			{
+				return false;
+			}
+		}
+
+		if (!file.read(reinterpret_cast<char *>(pixels.data()), pixels.size()))
+		{
+			return false;
+		}
+
+		// Set up the atlas the same way building it does, see 'ImFontAtlasBuildSetupFont' and 'ImFontAtlasBuildFinish'
+		atlas.ClearTexData();
+		atlas.TexWidth = header.tex_width;
+		atlas.TexHeight = header.tex_height;
+		atlas.TexUvScale = ImVec2(1.0f / header.tex_width, 1.0f / header.tex_height);
+		atlas.TexUvWhitePixel = ImVec2(header.white_pixel_u, header.white_pixel_v);
+		atlas.TexPixelsAlpha8 = static_cast<unsigned char *>(ImGui::MemAlloc(pixels.size()));
+		std::memcpy(atlas.TexPixelsAlpha8, pixels.data(), pixels.size());
+
+		atlas.CustomRects.resize(header.custom_rect_count);
+		for (int i = 0; i < header.custom_rect_count; i++)
+		{
+			atlas.CustomRects[i] = custom_rects[i];
+			atlas.CustomRects[i].Font = nullptr;
+		}
+		atlas.CustomRectIds[0] = header.cursor_rect_index;
+
+		for (int i = 0; i < header.font_count; i++)
+		{
+			ImFont *const font = atlas.Fonts[i];
+
+			font->ClearOutputData();
+			font->FontSize = font_headers[i].size;
+			font->ConfigData = &atlas.ConfigData[i];
+			font->ConfigDataCount = 1;
+			font->ContainerAtlas = &atlas;
+			font->Ascent = font_headers[i].ascent;
+			font->Descent = font_headers[i].descent;
+			font->FallbackChar = static_cast<ImWchar>(font_headers[i].fallback_char);
+
+			for (const ImFontGlyph &glyph : font_glyphs[i])
+			{
+				font->Glyphs.push_back(glyph);
+			}
+
+			font->BuildLookupTable();
+		}
+
+		return true;
+	}
+	void save(const ImFontAtlas &atlas, unsigned long long key)
+	{
+		if (!is_cacheable(atlas) || atlas.TexPixelsAlpha8 == nullptr)
+		{
+			return;
+		}
+
+		const filesystem::path directory = shader_cache::cache_directory();
+
+		if (!CreateDirectoryW(directory.wstring().c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+		{
+			LOG(WARNING) << "Failed to create font atlas cache directory " << directory << ".";
+			return;
+		}
+
+		const filesystem::path path = cache_file_path(key);
+		const filesystem::path temp_path = path + ".tmp";
+
+		// Write to a temporary file first and rename it afterwards, so a crash never leaves a truncated cache entry behind
+		{
+			std::ofstream file(temp_path.wstring(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+			if (!file.is_open())
+			{
+				return;
+			}
+
+			const cache_file_header header = {
+				s_cache_magic, s_cache_version, key,
+				atlas.TexWidth, atlas.TexHeight,
+				atlas.TexUvWhitePixel.x, atlas.TexUvWhitePixel.y,
+				atlas.Fonts.Size, atlas.CustomRects.Size, atlas.CustomRectIds[0] };
+
+			file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+			for (int i = 0; i < atlas.CustomRects.Size; i++)
+			{
+				// The font pointer is only used while building and meaningless in another process
+				custom_rect rect = atlas.CustomRects[i];
+				rect.Font = nullptr;
+
+				file.write(reinterpret_cast<const char *>(&rect), sizeof(rect));
+			}
+
+			for (int i = 0; i < atlas.Fonts.Size; i++)
+			{
+				const ImFont *const font = atlas.Fonts[i];
+				const cache_font_header font_header = { font->FontSize, font->Ascent, font->Descent, font->FallbackChar, font->Glyphs.Size };
+
+				file.write(reinterpret_cast<const char *>(&font_header), sizeof(font_header));
+				file.write(reinterpret_cast<const char *>(font->Glyphs.Data), font->Glyphs.Size * sizeof(ImFontGlyph));
+			}
+
+			file.write(reinterpret_cast<const char *>(atlas.TexPixelsAlpha8), static_cast<size_t>(atlas.TexWidth) * atlas.TexHeight);
+
+			if (!file)
+			{
+				file.close();
+				DeleteFileW(temp_path.wstring().c_str());
+				return;
+			}
+		}
+
+		if (!MoveFileExW(temp_path.wstring().c_str(), path.wstring().c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			DeleteFileW(temp_path.wstring().c_str());
+		}
+	}
+}
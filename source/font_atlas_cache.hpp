@@ -0,0 +1,30 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+struct ImFontAtlas;
+
+namespace reshade::font_atlas_cache
+{
+	/// <summary>
+	/// Compute the cache key for a font atlas, which covers the data and configuration of every font that was added to it, but not yet built.
+	/// </summary>
+	/// <param name="atlas">The font atlas to compute the key for.</param>
+	unsigned long long compute_key(const ImFontAtlas &atlas);
+
+	/// <summary>
+	/// Fill in the texture and glyphs of a font atlas from the on-disk cache instead of building it.
+	/// </summary>
+	/// <param name="atlas">The font atlas with all fonts added to it, but not yet built.</param>
+	/// <param name="key">The cache key returned by <see cref="compute_key"/>.</param>
+	bool load(ImFontAtlas &atlas, unsigned long long key);
+	/// <summary>
+	/// Store the texture and glyphs of a built font atlas in the on-disk cache.
+	/// </summary>
+	/// <param name="atlas">The font atlas after a successful build.</param>
+	/// <param name="key">The cache key returned by <see cref="compute_key"/>.</param>
+	void save(const ImFontAtlas &atlas, unsigned long long key);
+}
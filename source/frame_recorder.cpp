@@ -0,0 +1,195 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "log.hpp"
+#include "frame_recorder.hpp"
+#include <chrono>
+#include <algorithm>
+
+namespace reshade
+{
+	// File layout: Header, then the length and characters of every technique name, then a frame header and a CPU and GPU time per technique for every frame
+	struct frame_recording_header
+	{
+		uint32_t magic, version, technique_count;
+	};
+
+	static const uint32_t FRAME_RECORDING_MAGIC = 'R' | ('S' << 8) | ('F' << 16) | ('T' << 24);
+	static const uint32_t FRAME_RECORDING_VERSION = 1;
+
+	frame_recorder::~frame_recorder()
+	{
+		stop();
+	}
+
+	void frame_recorder::start(const filesystem::path &path, const std::vector<std::string> &technique_names, size_t capacity)
+	{
+		stop();
+
+		_capacity = std::max<size_t>(capacity, 2);
+		_technique_count = technique_names.size();
+		_frames.assign(_capacity, { });
+		_technique_times.assign(_capacity * _technique_count * 2, 0.0f);
+		_write_count.store(0, std::memory_order_relaxed);
+		_read_count.store(0, std::memory_order_relaxed);
+		_dropped_count = 0;
+		_frame_times.clear();
+		_frame_times.reserve(_capacity);
+		_overhead_sum = 0.0;
+		_first_timestamp = _last_timestamp = 0;
+		_exit = false;
+
+		LOG(INFO) << "Starting frame time recording to " << path << " ...";
+
+		_writer = std::thread(&frame_recorder::writer_loop, this, path, technique_names);
+	}
+	void frame_recorder::stop()
+	{
+		if (!_writer.joinable())
+		{
+			return;
+		}
+
+		{ const std::lock_guard<std::mutex> lock(_mutex);
+			_exit = true;
+		}
+
+		_signal.notify_one();
+		_writer.join();
+
+		const size_t frame_count = _frame_times.size();
+
+		if (frame_count == 0)
+		{
+			LOG(INFO) << "Stopped frame time recording without any frames.";
+			return;
+		}
+
+		std::sort(_frame_times.begin(), _frame_times.end());
+
+		const size_t worst_count = std::max<size_t>(1, frame_count / 100);
+		double worst_sum = 0.0;
+
+		for (size_t i = frame_count - worst_count; i < frame_count; i++)
+		{
+			worst_sum += _frame_times[i];
+		}
+
+		const double duration = (_last_timestamp - _first_timestamp) * 1e-9;
+		const float median = _frame_times[frame_count / 2];
+		const float p99 = _frame_times[std::min(frame_count - 1, frame_count * 99 / 100)];
+
+		LOG(INFO) << "Stopped frame time recording after " << frame_count << " frames in " << duration << " seconds:";
+		LOG(INFO) << "> Average frame rate " << (duration > 0.0 ? (frame_count - 1) / duration : 0.0) << ", 1% low " << 1000.0 / (worst_sum / worst_count);
+		LOG(INFO) << "> Frame time median " << median << " ms, 99th percentile " << p99 << " ms, maximum " << _frame_times.back() << " ms";
+		LOG(INFO) << "> Average ReShade overhead " << _overhead_sum / frame_count << " ms per frame";
+
+		if (_dropped_count != 0)
+		{
+			LOG(WARNING) << "> Dropped " << _dropped_count << " frames because the recording could not be written fast enough.";
+		}
+
+		// Give the memory back, recordings are rare
+		_frames = { };
+		_technique_times = { };
+		_frame_times = { };
+	}
+
+	bool frame_recorder::begin_frame(int64_t timestamp, float frame_time, float overhead)
+	{
+		const size_t index = _write_count.load(std::memory_order_relaxed);
+
+		if (index - _read_count.load(std::memory_order_acquire) >= _capacity)
+		{
+			_dropped_count++;
+			return false;
+		}
+
+		_frames[index % _capacity] = { timestamp, frame_time, overhead };
+
+		return true;
+	}
+	void frame_recorder::set_technique(size_t index, float cpu_time, float gpu_time)
+	{
+		float *const times = _technique_times.data() + (_write_count.load(std::memory_order_relaxed) % _capacity) * _technique_count * 2;
+
+		times[index * 2 + 0] = cpu_time;
+		times[index * 2 + 1] = gpu_time;
+	}
+	void frame_recorder::end_frame()
+	{
+		_write_count.fetch_add(1, std::memory_order_release);
+	}
+
+	void frame_recorder::writer_loop(filesystem::path path, std::vector<std::string> technique_names)
+	{
+		FILE *file = nullptr;
+
+		if (_wfopen_s(&file, path.wstring().c_str(), L"wb") == 0)
+		{
+			const frame_recording_header header = { FRAME_RECORDING_MAGIC, FRAME_RECORDING_VERSION, static_cast<uint32_t>(technique_names.size()) };
+			fwrite(&header, sizeof(header), 1, file);
+
+			for (const auto &name : technique_names)
+			{
+				const auto length = static_cast<uint32_t>(name.size());
+				fwrite(&length, sizeof(length), 1, file);
+				fwrite(name.data(), 1, name.size(), file);
+			}
+		}
+		else
+		{
+			LOG(ERROR) << "Failed to open " << path << " for frame time recording!";
+		}
+
+		for (bool exit = false; !exit;)
+		{
+			{ std::unique_lock<std::mutex> lock(_mutex);
+				_signal.wait_for(lock, std::chrono::milliseconds(250), [this]() { return _exit; });
+				exit = _exit;
+			}
+
+			flush(file);
+		}
+
+		if (file != nullptr)
+		{
+			fclose(file);
+		}
+	}
+	void frame_recorder::flush(FILE *file)
+	{
+		const size_t write_count = _write_count.load(std::memory_order_acquire);
+
+		for (size_t index = _read_count.load(std::memory_order_relaxed); index < write_count; index++)
+		{
+			const frame &frame = _frames[index % _capacity];
+			const float *const times = _technique_times.data() + (index % _capacity) * _technique_count * 2;
+
+			if (file != nullptr)
+			{
+				fwrite(&frame, sizeof(frame), 1, file);
+				fwrite(times, sizeof(float), _technique_count * 2, file);
+			}
+
+			if (_frame_times.empty())
+			{
+				_first_timestamp = frame.timestamp;
+			}
+
+			_last_timestamp = frame.timestamp;
+			_frame_times.push_back(frame.frame_time);
+			_overhead_sum += frame.overhead;
+
+			// Hand the slot back to the render thread only after it was read
+			_read_count.store(index + 1, std::memory_order_release);
+		}
+
+		if (file != nullptr)
+		{
+			fflush(file);
+		}
+	}
+}
@@ -0,0 +1,95 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <condition_variable>
+#include "filesystem.hpp"
+
+namespace reshade
+{
+	/// <summary>
+	/// Records timings of every frame into a ring that is allocated up front and written to a file by a background thread, so recording never allocates memory or touches the file system on the render thread.
+	/// </summary>
+	class frame_recorder
+	{
+	public:
+		frame_recorder() = default;
+		~frame_recorder();
+
+		frame_recorder(const frame_recorder &) = delete;
+		frame_recorder &operator=(const frame_recorder &) = delete;
+
+		/// <summary>
+		/// Check whether a recording is in progress.
+		/// </summary>
+		bool is_recording() const { return _writer.joinable(); }
+		/// <summary>
+		/// Get the number of techniques every frame has timings for.
+		/// </summary>
+		size_t technique_count() const { return _technique_count; }
+
+		/// <summary>
+		/// Start a new recording.
+		/// </summary>
+		/// <param name="path">The file to write the recording to. It is opened by the background thread.</param>
+		/// <param name="technique_names">The names of the techniques every frame has timings for, in order.</param>
+		/// <param name="capacity">The number of frames the ring can hold before frames are dropped because the background thread fell behind.</param>
+		void start(const filesystem::path &path, const std::vector<std::string> &technique_names, size_t capacity = 4096);
+		/// <summary>
+		/// Stop the recording, wait for the remaining frames to be written and log a summary of the recording.
+		/// </summary>
+		void stop();
+
+		/// <summary>
+		/// Begin recording a frame. Fill in the technique timings with <see cref="set_technique"/> and finish it with <see cref="end_frame"/>.
+		/// </summary>
+		/// <param name="timestamp">The time the frame was presented in nanoseconds.</param>
+		/// <param name="frame_time">The time since the previous frame in milliseconds.</param>
+		/// <param name="overhead">The CPU time ReShade took during the frame in milliseconds.</param>
+		/// <returns><c>false</c> if the ring is full and the frame was dropped, in which case the other functions must not be called for it.</returns>
+		bool begin_frame(int64_t timestamp, float frame_time, float overhead);
+		/// <summary>
+		/// Set the timings of a technique in milliseconds for the frame begun last, zero for techniques that did not render.
+		/// </summary>
+		void set_technique(size_t index, float cpu_time, float gpu_time);
+		/// <summary>
+		/// Hand the frame begun last to the background thread.
+		/// </summary>
+		void end_frame();
+
+	private:
+		struct frame
+		{
+			int64_t timestamp;
+			float frame_time, overhead;
+		};
+
+		void writer_loop(filesystem::path path, std::vector<std::string> technique_names);
+		void flush(FILE *file);
+
+		std::thread _writer;
+		std::mutex _mutex;
+		std::condition_variable _signal;
+		bool _exit = false;
+		size_t _capacity = 0, _technique_count = 0;
+		// Frame headers and two timings per technique per frame, indexed by the frame count modulo the capacity
+		std::vector<frame> _frames;
+		std::vector<float> _technique_times;
+		// Frames handed to the background thread and frames it wrote, these only ever increase
+		std::atomic<size_t> _write_count { 0 }, _read_count { 0 };
+		size_t _dropped_count = 0;
+		// Only accessed by the background thread until it exits
+		std::vector<float> _frame_times;
+		double _overhead_sum = 0.0;
+		int64_t _first_timestamp = 0, _last_timestamp = 0;
+	};
+}
@@ -0,0 +1,33 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "gpu_marker.hpp"
+#include "filesystem.hpp"
+
+namespace reshade
+{
+	const d3d9_event_functions &get_d3d9_event_functions()
+	{
+		static const d3d9_event_functions functions = []() {
+			d3d9_event_functions result;
+
+			if (const HMODULE module = LoadLibraryW((filesystem::get_special_folder_path(filesystem::special_folder::system) / "d3d9.dll").wstring().c_str()); module != nullptr)
+			{
+				result.begin_event = reinterpret_cast<decltype(result.begin_event)>(GetProcAddress(module, "D3DPERF_BeginEvent"));
+				result.end_event = reinterpret_cast<decltype(result.end_event)>(GetProcAddress(module, "D3DPERF_EndEvent"));
+			}
+
+			// Only use them as a pair, so every event that begins also ends
+			if (result.begin_event == nullptr || result.end_event == nullptr)
+			{
+				result = { };
+			}
+
+			return result;
+		}();
+
+		return functions;
+	}
+}
@@ -0,0 +1,61 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <string>
+#include <algorithm>
+#include <Windows.h>
+
+namespace reshade
+{
+	/// <summary>
+	/// Name a pass that has none after its index in the technique.
+	/// Effect compilers call this once when they create a technique, so labelling passes for GPU debuggers and benchmarks does not build a string every frame.
+	/// </summary>
+	/// <param name="name">The name of the pass, which is only changed if it is empty.</param>
+	/// <param name="index">The index of the pass in its technique.</param>
+	inline void name_unnamed_pass(std::string &name, size_t index)
+	{
+		if (name.empty())
+		{
+			name = "Pass " + std::to_string(index);
+		}
+	}
+
+	/// <summary>
+	/// A marker name widened on the stack, so labelling does not allocate on the frame path. Longer names are cut off.
+	/// </summary>
+	class wide_marker_name
+	{
+	public:
+		explicit wide_marker_name(const std::string &name)
+		{
+			const size_t length = std::min(name.size(), _countof(_name) - 1);
+			std::copy_n(name.begin(), length, _name);
+			_name[length] = L'\0';
+		}
+
+		const wchar_t *c_str() const { return _name; }
+
+	private:
+		wchar_t _name[256];
+	};
+
+	/// <summary>
+	/// The event functions of the Direct3D 9 library, which PIX reads markers from, for Direct3D 10 as well.
+	/// </summary>
+	struct d3d9_event_functions
+	{
+		int (WINAPI *begin_event)(DWORD color, LPCWSTR name) = nullptr;
+		int (WINAPI *end_event)() = nullptr;
+	};
+
+	/// <summary>
+	/// Get the event functions of the Direct3D 9 library in the system directory, or none if it does not export both of them.
+	/// The exports of this module are stubs that hide the application from PIX and Direct3D 10 applications usually do not load the library at all, so the real one is loaded directly, instead of relying on the export hooks. It stays loaded until the process exits.
+	/// </summary>
+	const d3d9_event_functions &get_d3d9_event_functions();
+}
@@ -0,0 +1,375 @@
+#include "dxbc_patch.hpp"
+#include <cstring>
+
+//Chunks and tokens of the Shader Model 4/5 bytecode format
+#define FOURCC_SHDR	0x52444853 //'SHDR'
+#define FOURCC_SHEX	0x58454853 //'SHEX'
+
+#define OPCODE_ADD	0
+#define OPCODE_MAD	50
+#define OPCODE_CUSTOMDATA	53
+#define OPCODE_MOV	54
+#define OPCODE_MUL	56
+#define OPCODE_NOP	58
+#define OPCODE_RET	62
+#define OPCODE_DCL_CONSTANT_BUFFER	89
+#define OPCODE_DCL_TEMPS	104
+#define OPCODE_DCL_GLOBAL_FLAGS	106
+
+#define OPERAND_TEMP	0
+#define OPERAND_OUTPUT	2
+#define OPERAND_IMMEDIATE32	4
+#define OPERAND_IMMEDIATE64	5
+#define OPERAND_CONSTANT_BUFFER	8
+
+//Operand tokens the patches are built from, all with a single immediate index per dimension
+#define TOKEN_TEMP_XYZ	0x00100072 //rN.xyz
+#define TOKEN_TEMP_XYZX	0x00100246 //rN.xyzx
+#define TOKEN_CB_XXXX	0x00208006 //cbN[M].xxxx
+#define TOKEN_CB_YYYY	0x00208556 //cbN[M].yyyy
+#define TOKEN_CB_XYZW	0x00208e46 //cbN[M].xyzw
+#define TOKEN_IMMEDIATE4	0x00004002 //l(x, y, z, w)
+
+namespace dxbc_patch {
+	struct instruction {
+		DWORD opcode;
+		size_t offset, length;
+		size_t operands[4], operand_lengths[4];
+		size_t operand_count;
+	};
+
+	static DWORD opcode(DWORD token) { return token & 0x7ff; }
+	static DWORD operand_type(DWORD token) { return (token >> 12) & 0xff; }
+	//Write mask of a destination operand, zero when the operand selects components some other way
+	static DWORD operand_mask(DWORD token) { return ((token >> 2) & 3) == 0 ? (token >> 4) & 0xf : 0; }
+	static DWORD with_length(DWORD token, size_t length) { return (token & ~(0x7fu << 24)) | static_cast<DWORD>(length) << 24; }
+
+	static bool find_program(const BYTE *data, size_t length, size_t &chunk_index, const DWORD *&program, size_t &program_length) {
+		if (length < 32 || memcmp(data, "DXBC", 4) != 0) return false;
+
+		const DWORD chunk_count = reinterpret_cast<const DWORD *>(data)[7];
+		if (32 + static_cast<size_t>(chunk_count) * 4 > length) return false;
+		const DWORD *offsets = reinterpret_cast<const DWORD *>(data + 32);
+
+		for (DWORD i = 0; i < chunk_count; ++i) {
+			if (offsets[i] + 8ull > length) return false;
+			const DWORD *chunk = reinterpret_cast<const DWORD *>(data + offsets[i]);
+			if (chunk[0] != FOURCC_SHDR && chunk[0] != FOURCC_SHEX) continue;
+			if (offsets[i] + 8ull + chunk[1] > length || chunk[1] < 8) return false;
+
+			//Version token, then the length of the program in tokens including these two
+			program = chunk + 2;
+			program_length = program[1] < chunk[1] / 4 ? program[1] : chunk[1] / 4;
+			chunk_index = i;
+			return program_length >= 2;
+		}
+		return false;
+	}
+
+	static bool parse_instructions(const DWORD *program, size_t program_length, std::vector<size_t> &instructions) {
+		for (size_t i = 2; i < program_length;) {
+			//Custom data blocks, like immediate constant buffers, store their length in the next token
+			const size_t l = opcode(program[i]) == OPCODE_CUSTOMDATA ? (i + 1 < program_length ? program[i + 1] : 0) : (program[i] >> 24) & 0x7f;
+			if (l == 0 || i + l > program_length) return false;
+			instructions.push_back(i);
+			i += l;
+		}
+		return true;
+	}
+
+	static size_t operand_length(const DWORD *tokens, size_t available) {
+		if (available == 0) return 0;
+
+		const DWORD token = tokens[0];
+		size_t l = 1;
+
+		//Extended operand tokens, like modifiers, follow as long as the previous one has the top bit set
+		for (DWORD t = token; t & 0x80000000; t = tokens[l++]) {
+			if (l >= available) return 0;
+		}
+
+		const DWORD type = operand_type(token);
+		if (type == OPERAND_IMMEDIATE32 || type == OPERAND_IMMEDIATE64)
+			l += ((token & 3) == 2 ? 4 : 1) * (type == OPERAND_IMMEDIATE64 ? 2 : 1);
+
+		for (DWORD d = 0, dimension = (token >> 20) & 3; d < dimension; ++d) {
+			const DWORD representation = (token >> (22 + 3 * d)) & 7;
+			if (representation == 0 || representation == 3) l += 1;
+			if (representation == 1 || representation == 4) l += 2;
+			if (representation >= 2) {
+				if (l >= available) return 0;
+				const size_t relative = operand_length(tokens + l, available - l);
+				if (relative == 0) return 0;
+				l += relative;
+			}
+		}
+		return l <= available ? l : 0;
+	}
+
+	static bool decode(const DWORD *program, size_t offset, instruction &inst) {
+		inst.opcode = opcode(program[offset]);
+		inst.offset = offset;
+		inst.length = (program[offset] >> 24) & 0x7f;
+		inst.operand_count = 0;
+		if (inst.opcode == OPCODE_CUSTOMDATA) return false;
+
+		const size_t end = offset + inst.length;
+		size_t p = offset;
+		while (program[p++] & 0x80000000) {
+			if (p >= end) return false;
+		}
+
+		while (p < end && inst.operand_count < 4) {
+			const size_t l = operand_length(program + p, end - p);
+			if (l == 0) return false;
+			inst.operands[inst.operand_count] = p;
+			inst.operand_lengths[inst.operand_count++] = l;
+			p += l;
+		}
+		return p == end;
+	}
+
+	//Whether the operand is register 'index' of 'type', addressed by a single immediate index
+	static bool is_register(const DWORD *tokens, DWORD type, DWORD index) {
+		return (tokens[0] & 0x80000000) == 0 && operand_type(tokens[0]) == type && ((tokens[0] >> 20) & 3) == 1 && ((tokens[0] >> 22) & 7) == 0 && tokens[1] == index;
+	}
+	static bool is_same_temp(const DWORD *a, const DWORD *b) {
+		return is_register(a, OPERAND_TEMP, a[1]) && is_register(b, OPERAND_TEMP, a[1]);
+	}
+	static bool writes_output(const DWORD *program, const instruction &inst, DWORD mask) {
+		return inst.operand_count != 0 && is_register(program + inst.operands[0], OPERAND_OUTPUT, 0) && operand_mask(program[inst.operands[0]]) == mask;
+	}
+	static bool is_constant(DWORD token) {
+		return operand_type(token) == OPERAND_CONSTANT_BUFFER || operand_type(token) == OPERAND_IMMEDIATE32;
+	}
+
+	static void md5_transform(DWORD state[4], const DWORD block[16]) {
+		static const DWORD k[64] = {
+			0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+			0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+			0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+			0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+			0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+			0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+			0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+			0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+		};
+		static const int r[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+		DWORD a = state[0], b = state[1], c = state[2], d = state[3];
+		for (int i = 0; i < 64; ++i) {
+			DWORD f; int g;
+			if (i < 16) { f = (b & c) | (~b & d); g = i; }
+			else if (i < 32) { f = (d & b) | (~d & c); g = (5 * i + 1) % 16; }
+			else if (i < 48) { f = b ^ c ^ d; g = (3 * i + 5) % 16; }
+			else { f = c ^ (b | ~d); g = (7 * i) % 16; }
+
+			const DWORD t = d;
+			const DWORD x = a + f + k[i] + block[g];
+			const int s = r[(i / 16) * 4 + i % 4];
+			d = c;
+			c = b;
+			b = b + ((x << s) | (x >> (32 - s)));
+			a = t;
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+	}
+
+	//The container checksum is MD5 over everything after it, except that the padding stores the length in bits in the first and last word of the final block
+	static void update_checksum(std::vector<char> &blob) {
+		const BYTE *data = reinterpret_cast<const BYTE *>(blob.data()) + 20;
+		const size_t size = blob.size() - 20;
+		const DWORD bits = static_cast<DWORD>(size * 8);
+
+		DWORD state[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+		DWORD block[16];
+
+		size_t offset = 0;
+		for (; offset + 64 <= size; offset += 64) {
+			memcpy(block, data + offset, 64);
+			md5_transform(state, block);
+		}
+
+		const size_t remaining = size - offset;
+		memset(block, 0, sizeof(block));
+		if (remaining >= 56) {
+			memcpy(block, data + offset, remaining);
+			reinterpret_cast<BYTE *>(block)[remaining] = 0x80;
+			md5_transform(state, block);
+
+			memset(block, 0, sizeof(block));
+			block[0] = bits;
+			block[15] = (bits >> 2) | 1;
+			md5_transform(state, block);
+		} else {
+			block[0] = bits;
+			memcpy(reinterpret_cast<BYTE *>(block) + 4, data + offset, remaining);
+			reinterpret_cast<BYTE *>(block)[4 + remaining] = 0x80;
+			block[15] = (bits >> 2) | 1;
+			md5_transform(state, block);
+		}
+
+		memcpy(blob.data() + 4, state, sizeof(state));
+	}
+
+	//Copies the container with the program chunk replaced and updates its size and checksum
+	static bool build_container(const BYTE *data, size_t length, size_t program_chunk, const std::vector<DWORD> &program, std::vector<char> &out) {
+		const DWORD chunk_count = reinterpret_cast<const DWORD *>(data)[7];
+		const DWORD *offsets = reinterpret_cast<const DWORD *>(data + 32);
+		const size_t header_size = 32 + static_cast<size_t>(chunk_count) * 4;
+
+		out.assign(data, data + header_size);
+
+		for (DWORD i = 0; i < chunk_count; ++i) {
+			if (offsets[i] + 8ull > length) return false;
+			const DWORD *chunk = reinterpret_cast<const DWORD *>(data + offsets[i]);
+			if (offsets[i] + 8ull + chunk[1] > length) return false;
+
+			reinterpret_cast<DWORD *>(out.data() + 32)[i] = static_cast<DWORD>(out.size());
+
+			if (i == program_chunk) {
+				const DWORD header[2] = { chunk[0], static_cast<DWORD>(program.size() * 4) };
+				out.insert(out.end(), reinterpret_cast<const char *>(header), reinterpret_cast<const char *>(header + 2));
+				out.insert(out.end(), reinterpret_cast<const char *>(program.data()), reinterpret_cast<const char *>(program.data() + program.size()));
+			} else {
+				out.insert(out.end(), reinterpret_cast<const char *>(chunk), reinterpret_cast<const char *>(chunk) + 8 + chunk[1]);
+			}
+		}
+
+		reinterpret_cast<DWORD *>(out.data())[6] = static_cast<DWORD>(out.size());
+		update_checksum(out);
+		return true;
+	}
+
+	XXH64_hash_t hash_program(const void *bytecode, size_t length) {
+		const DWORD *program;
+		size_t program_length, chunk;
+		if (!find_program(static_cast<const BYTE *>(bytecode), length, chunk, program, program_length))
+			return XXH64(bytecode, length, 0);
+
+		return XXH64(program, program_length * sizeof(DWORD), 0);
+	}
+
+	int get_pattern(const void *bytecode, size_t length) {
+		const DWORD *program;
+		size_t program_length, chunk;
+		std::vector<size_t> instructions;
+
+		//Only pixel shaders, which have a program type of zero
+		if (!find_program(static_cast<const BYTE *>(bytecode), length, chunk, program, program_length) || (program[0] >> 16) != 0 ||
+			!parse_instructions(program, program_length, instructions) || instructions.size() < 3)
+			return pattern_none;
+
+		const size_t n = instructions.size();
+		instruction last, prev;
+		if (opcode(program[instructions[n - 1]]) != OPCODE_RET || !decode(program, instructions[n - 2], last) || !decode(program, instructions[n - 3], prev))
+			return pattern_none;
+
+		//If mad o0.xyz -> mov o0.w -> ret
+		if (last.opcode == OPCODE_MOV && writes_output(program, last, 0x8) && prev.opcode == OPCODE_MAD && writes_output(program, prev, 0x7)) {
+			if (last.operand_count != 2 || !is_constant(program[last.operands[1]])) return pattern_none;
+			//If op above are lerp (add and mad in DXBC) and add, it's map ps so ignore
+			if (n >= 5 && opcode(program[instructions[n - 4]]) == OPCODE_ADD && opcode(program[instructions[n - 5]]) == OPCODE_MAD) return pattern_none;
+			return pattern_fog1;
+		}
+		//If it's only mad o0.xyz -> ret
+		if (last.opcode == OPCODE_MAD && writes_output(program, last, 0x7)) {
+			//If it's mad -> mad, it's UI ps
+			if (prev.opcode == OPCODE_MAD) return pattern_none;
+			return pattern_fog2;
+		}
+		//If mul rN.xyz, rN, constant -> mov o0.xyzw, rN -> ret
+		if (last.opcode == OPCODE_MOV && last.operand_count == 2 && writes_output(program, last, 0xf) && prev.opcode == OPCODE_MUL && prev.operand_count == 3 &&
+			operand_mask(program[prev.operands[0]]) == 0x7 && is_same_temp(program + prev.operands[0], program + prev.operands[1]) &&
+			is_same_temp(program + prev.operands[0], program + last.operands[1]) && is_constant(program[prev.operands[2]]))
+			return pattern_bloom;
+
+		return pattern_none;
+	}
+
+	bool patch(const void *bytecode, size_t length, int pattern, std::vector<char> &out) {
+		const BYTE *const data = static_cast<const BYTE *>(bytecode);
+		const DWORD *program;
+		size_t program_length, chunk;
+		std::vector<size_t> instructions;
+
+		if (!find_program(data, length, chunk, program, program_length) || !parse_instructions(program, program_length, instructions) || instructions.size() < 3)
+			return false;
+
+		const size_t n = instructions.size();
+		std::vector<DWORD> tokens(program, program + program_length);
+
+		if (pattern == pattern_bloom) {
+			//Replace the mul with a mov of zero in place, the rest of its tokens become nops
+			instruction mul;
+			if (!decode(program, instructions[n - 3], mul) || mul.opcode != OPCODE_MUL) return false;
+
+			const size_t l = 1 + mul.operand_lengths[0] + 5;
+			if (l > mul.length) return false;
+
+			size_t p = mul.offset;
+			tokens[p++] = with_length(OPCODE_MOV, l);
+			for (size_t i = 0; i < mul.operand_lengths[0]; ++i) tokens[p++] = program[mul.operands[0] + i];
+			tokens[p++] = TOKEN_IMMEDIATE4;
+			for (int i = 0; i < 4; ++i) tokens[p++] = 0;
+			while (p < mul.offset + mul.length) tokens[p++] = with_length(OPCODE_NOP, 1);
+
+			return build_container(data, length, chunk, tokens, out);
+		}
+
+		if (pattern != pattern_fog1 && pattern != pattern_fog2) return false;
+
+		instruction mad;
+		if (!decode(program, instructions[pattern == pattern_fog1 ? n - 3 : n - 2], mad) || mad.opcode != OPCODE_MAD || mad.operand_count != 4) return false;
+
+		//The fogged color goes into a new temporary register, so the color before fog in the first source stays available
+		size_t temps_offset = 0;
+		DWORD temp = 0;
+		for (size_t i : instructions) {
+			if (opcode(program[i]) == OPCODE_DCL_TEMPS) {
+				temps_offset = i;
+				temp = program[i + 1];
+			} else if (opcode(program[i]) == OPCODE_DCL_CONSTANT_BUFFER && program[i + 2] == DXBC_FOG_CONSTANT_SLOT) {
+				return false;
+			}
+		}
+
+		const size_t first_operand = mad.operands[0];
+		const DWORD *const source = program + mad.operands[1];
+		const size_t source_length = mad.operand_lengths[1];
+
+		std::vector<DWORD> blend;
+		//mad rT.xyz, a, b, c
+		blend.insert(blend.end(), program + mad.offset, program + first_operand);
+		blend.push_back(TOKEN_TEMP_XYZ);
+		blend.push_back(temp);
+		blend.insert(blend.end(), program + mad.operands[1], program + mad.offset + mad.length);
+		blend[0] = with_length(blend[0], blend.size());
+		//mul rT.xyz, rT.xyzx, cb13[0].xxxx
+		blend.insert(blend.end(), { with_length(OPCODE_MUL, 8), TOKEN_TEMP_XYZ, temp, TOKEN_TEMP_XYZX, temp, TOKEN_CB_XXXX, DXBC_FOG_CONSTANT_SLOT, 0 });
+		//mad o0.xyz, a, cb13[0].yyyy, rT.xyzx
+		blend.push_back(with_length(OPCODE_MAD, 1 + mad.operand_lengths[0] + source_length + 3 + 2));
+		blend.insert(blend.end(), program + mad.operands[0], program + mad.operands[0] + mad.operand_lengths[0]);
+		blend.insert(blend.end(), source, source + source_length);
+		blend.insert(blend.end(), { TOKEN_CB_YYYY, DXBC_FOG_CONSTANT_SLOT, 0, TOKEN_TEMP_XYZX, temp });
+
+		tokens.erase(tokens.begin() + mad.offset, tokens.begin() + mad.offset + mad.length);
+		tokens.insert(tokens.begin() + mad.offset, blend.begin(), blend.end());
+
+		//Declarations go after the global flags, their order does not matter otherwise
+		std::vector<DWORD> declarations = { with_length(OPCODE_DCL_CONSTANT_BUFFER, 4), TOKEN_CB_XYZW, DXBC_FOG_CONSTANT_SLOT, 1 };
+		if (temps_offset != 0)
+			tokens[temps_offset + 1] = temp + 1;
+		else
+			declarations.insert(declarations.end(), { with_length(OPCODE_DCL_TEMPS, 2), 1 });
+
+		const size_t position = opcode(program[instructions[0]]) == OPCODE_DCL_GLOBAL_FLAGS ? instructions[0] + 1 : 2;
+		tokens.insert(tokens.begin() + position, declarations.begin(), declarations.end());
+		tokens[1] = static_cast<DWORD>(tokens.size());
+
+		return build_container(data, length, chunk, tokens, out);
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include <Windows.h>
+#include "xxhash.h"
+
+//Constant buffer slot the patched fog shaders read the fog amount from, the game only uses the lower ones
+#define DXBC_FOG_CONSTANT_SLOT	13
+
+//Pattern detection and patching of the DirectX 11 client's pixel shaders, the Shader Model 4/5 counterpart of what hook_gw2 does to DirectX 9 bytecode.
+//The same HLSL is compiled for both clients, so the patterns are the DXBC form of the DirectX 9 ones: The fog blend is a mad into o0.xyz at the end of the program and bloom is scaled by a constant right before it is written.
+namespace dxbc_patch {
+	enum pattern {
+		pattern_none = -1,
+		pattern_fog1 = 1, //mad o0.xyz -> mov o0.w -> ret
+		pattern_fog2 = 2, //mad o0.xyz -> ret
+		pattern_bloom = 3, //mul rN.xyz, rN, constant -> mov o0, rN -> ret
+	};
+
+	//Hash of the program chunk alone, the rest of the container holds reflection data and a checksum that can change without the program changing
+	XXH64_hash_t hash_program(const void *bytecode, size_t length);
+
+	int get_pattern(const void *bytecode, size_t length);
+
+	//Fog patterns blend the result with the color before fog by the amount in the constant buffer at DXBC_FOG_CONSTANT_SLOT, which holds (amount, 1 - amount, 0, 0)
+	//Bloom is scaled by zero instead of the constant
+	bool patch(const void *bytecode, size_t length, int pattern, std::vector<char> &out);
+}
@@ -0,0 +1,116 @@
+#include "ini_file.hpp"
+#include "gw2_map_tracker.hpp"
+#include <cmath>
+
+void gw2_map_tracker::update(reshade::runtime *runtime) {
+	if (lm == NULL) initMumble();
+	if (lm == NULL) return;
+
+	update_skip_effects(runtime);
+	update_camera(runtime);
+
+	if (runtime->_map_id != lm->context.mapId) {
+		runtime->map_region = rt->get_region(lm->context.mapId);
+		runtime->_map_id = lm->context.mapId;
+		_is_in_competitive_map = rt->is_competitive(lm->context.mapId);
+
+		if (runtime->_auto_preset == 0) {
+			//Map changed
+			//The runtime watches the directories of the presets, so edits made outside of the game change the generation too
+			if (!_is_preset_index_valid || _preset_index_generation != runtime->_preset_files_generation)
+				build_preset_zone_index(runtime);
+
+			//Check map, then region, then global
+			auto map_it = _preset_by_map.find(lm->context.mapId);
+			if (map_it != _preset_by_map.end()) {
+				select_preset(runtime, map_it->second);
+			}
+			else {
+				auto region_it = _preset_by_region.find(runtime->map_region);
+				if (region_it == _preset_by_region.end())
+					region_it = _preset_by_region.find("global");
+				if (region_it != _preset_by_region.end())
+					select_preset(runtime, region_it->second);
+			}
+		}
+	}
+}
+
+void gw2_map_tracker::update_skip_effects(reshade::runtime *runtime) {
+	const DWORD now = GetTickCount();
+
+	if (lm->uiTick != _last_ui_tick) {
+		_last_ui_tick = lm->uiTick;
+		_last_ui_tick_change = now;
+		_has_seen_ui_tick = true;
+	}
+
+	//Only trust a link that was updated at least once, it stays empty when the game was started without one
+	const bool is_link_stale = _has_seen_ui_tick && now - _last_ui_tick_change > 500;
+	const bool is_map_open = (lm->context.uiState & 0x1) != 0;
+
+	runtime->_skip_effects = runtime->_skip_loading_screens == 0 && (is_link_stale || is_map_open);
+}
+
+void gw2_map_tracker::update_camera(reshade::runtime *runtime) {
+	if (lm->uiTick == _camera_ui_tick) return;
+	_camera_ui_tick = lm->uiTick;
+
+	//The link carries some noise, anything below these is not a visible change
+	bool moved = false;
+	for (int i = 0; i < 3; ++i) {
+		moved |= fabsf(lm->fCameraPosition[i] - _last_camera_position[i]) > 0.001f;
+		moved |= fabsf(lm->fCameraFront[i] - _last_camera_front[i]) > 0.0001f;
+		_last_camera_position[i] = lm->fCameraPosition[i];
+		_last_camera_front[i] = lm->fCameraFront[i];
+	}
+
+	runtime->_camera_static_frames = moved ? 0 : runtime->_camera_static_frames + 1;
+}
+
+void gw2_map_tracker::build_preset_zone_index(reshade::runtime *runtime) {
+	_preset_by_map.clear();
+	_preset_by_region.clear();
+
+	//Earlier presets win, same as the order they are listed in
+	for (size_t i = 0; i < runtime->_preset_files.size(); ++i) {
+		std::string zone;
+		reshade::ini_file(runtime->_preset_files[i]).get("", "Zone", zone);
+
+		_preset_by_region.emplace(zone, i);
+
+		for (int id : gw2_table::parseIDs(zone))
+			_preset_by_map.emplace(id, i);
+	}
+
+	_preset_index_generation = runtime->_preset_files_generation;
+	_is_preset_index_valid = true;
+}
+
+bool gw2_map_tracker::select_preset(reshade::runtime *runtime, size_t index) {
+	if (index >= runtime->_preset_files.size()) return false;
+
+	runtime->_current_preset = static_cast<int>(index);
+
+	//Only recompile when the preset needs effects that are not loaded or differs in values baked into the shaders
+	if (runtime->_performance_mode && !runtime->is_preset_compatible(runtime->_preset_files[index]))
+		runtime->reload();
+	else
+		runtime->load_preset(runtime->_preset_files[index]);
+	return true;
+}
+
+void gw2_map_tracker::initMumble() {
+	HANDLE hMapObject = OpenFileMappingW(PAGE_READONLY, FALSE, L"MumbleLink");
+	if (hMapObject == NULL) {
+		hMapObject = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(LinkedMem), L"MumbleLink");
+	}
+	if (hMapObject != NULL) {
+		lm = (LinkedMem *)MapViewOfFile(hMapObject, PAGE_READONLY, 0, 0, sizeof(LinkedMem));
+		if (lm == NULL) {
+			CloseHandle(hMapObject);
+			hMapObject = NULL;
+			return;
+		}
+	}
+}
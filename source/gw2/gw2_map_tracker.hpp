@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <Windows.h>
+
+#include "runtime.hpp"
+#include "gw2_table.hpp"
+
+//Layout of the context the game writes, which takes up the 256 bytes the Mumble link reserves for it
+struct MumbleContext {
+	byte serverAddress[28];
+	unsigned mapId;
+	unsigned mapType;
+	unsigned shardId;
+	unsigned instance;
+	unsigned buildId;
+	unsigned uiState; //Bit 0 is set while the full-screen map is open
+	unsigned short compassWidth;
+	unsigned short compassHeight;
+	float compassRotation;
+	float playerX;
+	float playerY;
+	float mapCenterX;
+	float mapCenterY;
+	float mapScale;
+	unsigned processId;
+	byte mountIndex;
+	byte reserved[171];
+};
+static_assert(sizeof(MumbleContext) == 256, "Mumble link context has to be 256 bytes");
+
+struct LinkedMem {
+	UINT32	uiVersion;
+	DWORD	uiTick;
+	float	fAvatarPosition[3];
+	float	fAvatarFront[3];
+	float	fAvatarTop[3];
+	wchar_t	name[256];
+	float	fCameraPosition[3];
+	float	fCameraFront[3];
+	float	fCameraTop[3];
+	wchar_t	identity[256];
+	UINT32	context_len;
+	MumbleContext context;
+	wchar_t description[2048];
+};
+
+//Follows the current map through the Mumble link and selects the preset of its zone, shared by the hooks of every graphics API
+class gw2_map_tracker {
+public:
+	gw2_map_tracker() : rt(new gw2_table) { }
+
+	//Call once per frame, updates map ID and region of the runtime and switches presets when the map changed
+	void update(reshade::runtime *runtime);
+
+	bool is_in_competitive_map() const { return _is_in_competitive_map; }
+	//Zero until the game wrote the link for the first time
+	unsigned build_id() const { return lm != NULL ? lm->context.buildId : 0; }
+
+private:
+	void initMumble();
+	void update_skip_effects(reshade::runtime *runtime);
+	void update_camera(reshade::runtime *runtime);
+	void build_preset_zone_index(reshade::runtime *runtime);
+	bool select_preset(reshade::runtime *runtime, size_t index);
+
+	bool _is_in_competitive_map = false;
+
+	//The game only updates the link while a map is loaded, so a tick that stops changing means loading screen or character select
+	DWORD _last_ui_tick = 0;
+	DWORD _last_ui_tick_change = 0;
+	bool _has_seen_ui_tick = false;
+
+	//Camera of the last link update, the static frame count only advances when the game wrote a new one
+	DWORD _camera_ui_tick = 0;
+	float _last_camera_position[3] = { };
+	float _last_camera_front[3] = { };
+
+	//Preset lookup by map ID and region, built from the "Zone" key of every preset
+	std::unordered_map<unsigned, size_t> _preset_by_map;
+	std::unordered_map<std::string, size_t> _preset_by_region;
+	unsigned int _preset_index_generation = 0;
+	bool _is_preset_index_valid = false;
+
+	LinkedMem *lm = NULL;
+	std::unique_ptr<gw2_table> rt;
+};
@@ -2,27 +2,29 @@
 #include "filesystem.hpp"
 #include "runtime.hpp"
 #include "log.hpp"
+#include <algorithm>
 
 gw2_table::gw2_table() {
 	std::string path = reshade::runtime::s_gw2hook_wrkdir_path.string();
-	fileBuffer = std::ifstream(path + "region.bin", std::ios::in | std::ios::binary);
+	std::ifstream fileBuffer(path + "region.bin", std::ios::in | std::ios::binary);
 	if (fileBuffer.is_open()) {
+		//Read the whole index once, every lookup afterwards is a plain array access
 		fileBuffer.seekg(0, std::ios::end);
-		region_file_lenght = (int)fileBuffer.tellg();
+		region_data.resize((size_t)fileBuffer.tellg());
+		fileBuffer.seekg(0, std::ios::beg);
+		if (!fileBuffer.read(reinterpret_cast<char *>(region_data.data()), region_data.size()))
+			region_data.clear();
 		LOG(INFO) << "Region index found. >" << path << ".";
 	} else {
-		region_file_lenght = 0;
 		LOG(INFO) << "Region index not found! >" << path << ".";
 	}
 }
 
-std::string gw2_table::get_region(int index) {
-	if (region_file_lenght == 0 || index >= region_file_lenght || index <= 0) {
+const std::string &gw2_table::get_region(int index) const {
+	if (index <= 0 || (size_t)index >= region_data.size()) {
 		return region[0];
 	}
-	char b;
-	fileBuffer.seekg(index, std::ios::beg);
-	fileBuffer.read(&b, 1);
+	unsigned char b = region_data[index];
 	if (b >= region_lenght) {
 		return region[0];
 	}
@@ -30,6 +32,11 @@ std::string gw2_table::get_region(int index) {
 }
 
 bool gw2_table::checkID(int n, std::string str){
+	std::vector<int> vect = parseIDs(str);
+	return (std::find(vect.begin(), vect.end(), n) != vect.end());
+}
+
+std::vector<int> gw2_table::parseIDs(const std::string &str){
 	std::vector<int> vect;
 	std::stringstream ss(str);
 	int i;
@@ -38,9 +45,10 @@ bool gw2_table::checkID(int n, std::string str){
 		if (ss.peek() == '-')
 			ss.ignore();
 	}
-	return (std::find(vect.begin(), vect.end(), n) != vect.end());
+	return vect;
 }
 
-bool gw2_table::is_competitive(int n){
-	return std::find(comp_map.begin(), comp_map.end(), n) != comp_map.end();
+bool gw2_table::is_competitive(int n) const {
+	//comp_map is kept sorted
+	return std::binary_search(comp_map.begin(), comp_map.end(), n);
 }
@@ -8,12 +8,12 @@
 class gw2_table {
 public:
 	gw2_table();
-	std::string get_region(int index);
+	const std::string &get_region(int index) const;
 	static bool checkID(int n, std::string str);
-	bool is_competitive(int n);
+	static std::vector<int> parseIDs(const std::string &str);
+	bool is_competitive(int n) const;
 private:
-	int region_file_lenght;
-	std::ifstream fileBuffer;
+	std::vector<unsigned char> region_data;
 	const int region_lenght = 13;
 	//38, 95, 96, 899, 968, 1099 (McM)
 	//350, 549, 554, 795, 875, 894, 900, 984, 1010, 1161, 1171, 1200
@@ -47,6 +47,7 @@ private:
 		c_region[11],
 		c_region[12],
 	};
+	//Sorted, so it can be binary searched
 	const std::vector<int> comp_map = {
 		38, 95, 96, 350, 549, 554, 795, 875, 894, 899, 900, 968, 984, 1011, 1099, 1163, 1171, 1200
 	};
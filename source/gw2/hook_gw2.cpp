@@ -1,77 +1,159 @@
 #include "d3d9/d3d9_device.hpp"
 #include "d3d9/d3d9_swapchain.hpp"
-#include "ini_file.hpp"
 #include "hook_gw2.hpp"
+#include "ini_file.hpp"
+#include "profiler.hpp"
+
+//Same hash as the one CreateVertexShader and CreatePixelShader compare against the configured values
+template <typename T>
+static XXH64_hash_t injection_hash(T *shader) {
+	UINT size = 0;
+	if (shader == NULL || FAILED(shader->GetFunction(NULL, &size)) || size == 0) return 0;
+
+	std::vector<DWORD> function(size / sizeof(DWORD));
+	if (FAILED(shader->GetFunction(function.data(), &size))) return 0;
+
+	return XXH64(function.data(), function.size(), 0);
+}
+
+hook_gw2::~hook_gw2() {
+	if (_patch_store_thread.joinable())
+		_patch_store_thread.join();
+}
 
 void hook_gw2::OnPresent() {
-	auto runtime = _device->_implicit_swapchain->_runtime;
-	if (lm == NULL) initMumble();
+	RESHADE_PROFILE_SCOPE("hook_gw2::OnPresent");
+
+	//Game state blocks applied during the frame may restore c222 behind our back, upload it again at least once per frame
+	InvalidateFogConstant();
+
+	{
+		RESHADE_PROFILE_SCOPE("Shader patch store");
+
+		if (_patch_store_started) mergePatchStore();
+		flushPatchStore();
+	}
 
 	if (!_is_fx_done) _device->_implicit_swapchain->_runtime->apply_effects(_surface_current);
 	_is_fx_done = false;
 
-	if (shader_map.size() > 2000) {
-		for (auto const& x : shader_map){
-			x.second->Release();
-		}
-		shader_map.clear();
-		LOG(INFO) << "Cleared shader cache.";
-	}
 	edited_shader_this_frame = 0;
-	
-	if (_device->_implicit_swapchain->_runtime->_map_id != lm->context.mapId) {
-		shader_map.clear();
-		_device->_implicit_swapchain->_runtime->map_region = rt->get_region(lm->context.mapId);
-		_device->_implicit_swapchain->_runtime->_map_id = lm->context.mapId;
-		_is_in_competitive_map = rt->is_competitive(lm->context.mapId);
-
-		if (_device->_implicit_swapchain->_runtime->_auto_preset == 0) {
-			//Map changed
-			bool preset_exist = false;
-
-			//Check map
-			for (int i = 0; i < runtime->_preset_files.size(); ++i) {
-				std::string region;
-				reshade::ini_file(runtime->_preset_files[i]).get("", "Zone", region);
-				if (gw2_table::checkID(lm->context.mapId, region)) {
-					runtime->_current_preset = i;
-					runtime->load_preset(runtime->_preset_files[i]);
-					preset_exist = true;
-					if (runtime->_performance_mode) runtime->reload();
-					break;
-				}
-			}
-			if (!preset_exist) {
-				//check region
-				for (int i = 0; i < runtime->_preset_files.size(); ++i) {
-					std::string region;
-					reshade::ini_file(runtime->_preset_files[i]).get("", "Zone", region);
-					if(region == rt->get_region(lm->context.mapId)) {
-						runtime->_current_preset = i;
-						runtime->load_preset(runtime->_preset_files[i]);
-						preset_exist = true;
-						if (runtime->_performance_mode) runtime->reload();
-						break;
-					}
-				}
-			}
-			if (!preset_exist) {
-				//global
-				for (int i = 0; i < runtime->_preset_files.size(); ++i) {
-					std::string region;
-					reshade::ini_file(runtime->_preset_files[i]).get("", "Zone", region);
-					if (region == "global") {
-						runtime->_current_preset = i;
-						runtime->load_preset(runtime->_preset_files[i]);
-						preset_exist = true;
-						if (runtime->_performance_mode) runtime->reload();
-						break;
-					}
-				}
-			}
+
+	{
+		RESHADE_PROFILE_SCOPE("Map tracker");
+
+		_map_tracker.update(_device->_implicit_swapchain->_runtime.get());
+	}
+
+	updateInjectionDiscovery();
+}
+
+void hook_gw2::updateInjectionDiscovery() {
+	auto runtime = _device->_implicit_swapchain->_runtime;
+	const unsigned build_id = _map_tracker.build_id();
+
+	_is_discovering = false;
+
+	//Only learn in the world, character select and loading screens draw a different UI
+	if (build_id == 0 || runtime->_skip_effects || runtime->_skip_ui != 0) return;
+
+	if (build_id != _injection_build_id) {
+		_injection_build_id = build_id;
+		_is_build_verified = loadInjectionPoint(build_id);
+		_discovery_vs = NULL;
+		_discovery_ps = NULL;
+		_discovery_streak = 0;
+	}
+
+	//The configured hashes matched, so they are the pair for this build
+	if (_pShaderInjection_vs != NULL || _pShaderInjection_ps != NULL) {
+		if (!_is_build_verified) {
+			storeInjectionPoint(build_id);
+			_is_build_verified = true;
 		}
+		return;
+	}
 
+	if (_is_build_verified || runtime->_discover_injection != 0) return;
+
+	_is_discovering = true;
+
+	//A UI that only shows up now and then, like a menu, must not win, so the same shaders have to start it in every frame
+	if (_discovery_frame_vs != NULL && _discovery_frame_vs == _discovery_vs && _discovery_frame_ps == _discovery_ps) {
+		++_discovery_streak;
+	} else {
+		_discovery_vs = _discovery_frame_vs;
+		_discovery_ps = _discovery_frame_ps;
+		_discovery_streak = _discovery_vs != NULL ? 1 : 0;
+	}
+	_discovery_frame_vs = NULL;
+	_discovery_frame_ps = NULL;
+
+	if (_discovery_streak < INJECTION_DISCOVERY_FRAMES) return;
+
+	const XXH64_hash_t vs_hash = injection_hash(_discovery_vs);
+	const XXH64_hash_t ps_hash = injection_hash(_discovery_ps);
+	if (vs_hash == 0 || ps_hash == 0) {
+		_discovery_streak = 0;
+		return;
+	}
+
+	LOG(INFO) << "Discovered injection point for game build " << build_id << ".";
+
+	runtime->_inj_vs = vs_hash;
+	runtime->_inj_ps = ps_hash;
+	snprintf(runtime->_c_inj_vs, sizeof(runtime->_c_inj_vs), "%#llx", runtime->_inj_vs);
+	snprintf(runtime->_c_inj_ps, sizeof(runtime->_c_inj_ps), "%#llx", runtime->_inj_ps);
+
+	//The vertex shader comes first in the draw, so effects are applied there from the next frame on
+	_pShaderInjection_vs = _discovery_vs;
+
+	storeInjectionPoint(build_id);
+	_is_build_verified = true;
+	_is_discovering = false;
+	_ui_pixel_shaders.clear();
+}
+
+bool hook_gw2::loadInjectionPoint(unsigned build_id) {
+	const reshade::ini_file store(reshade::runtime::s_gw2hook_wrkdir_path + "InjectionPoints.ini");
+	const std::string section = std::to_string(build_id);
+	if (!store.has(section, "InjVS") || !store.has(section, "InjPS")) return false;
+
+	auto runtime = _device->_implicit_swapchain->_runtime;
+	unsigned long long inj_vs = 0, inj_ps = 0;
+	store.get(section, "InjVS", inj_vs);
+	store.get(section, "InjPS", inj_ps);
+
+	//Shaders created from now on are matched against the pair of this build, and the next start uses it right away
+	if (inj_vs != runtime->_inj_vs || inj_ps != runtime->_inj_ps) {
+		runtime->_inj_vs = inj_vs;
+		runtime->_inj_ps = inj_ps;
+		snprintf(runtime->_c_inj_vs, sizeof(runtime->_c_inj_vs), "%#llx", runtime->_inj_vs);
+		snprintf(runtime->_c_inj_ps, sizeof(runtime->_c_inj_ps), "%#llx", runtime->_inj_ps);
+
+		reshade::ini_file config(reshade::runtime::s_gw2hook_wrkdir_path + "config.ini");
+		config.set("GENERAL", "InjVS", runtime->_inj_vs);
+		config.set("GENERAL", "InjPS", runtime->_inj_ps);
 	}
+	return true;
+}
+
+void hook_gw2::storeInjectionPoint(unsigned build_id) {
+	auto runtime = _device->_implicit_swapchain->_runtime;
+	const std::string section = std::to_string(build_id);
+
+	reshade::ini_file store(reshade::runtime::s_gw2hook_wrkdir_path + "InjectionPoints.ini");
+	store.set(section, "InjVS", runtime->_inj_vs);
+	store.set(section, "InjPS", runtime->_inj_ps);
+
+	reshade::ini_file config(reshade::runtime::s_gw2hook_wrkdir_path + "config.ini");
+	config.set("GENERAL", "InjVS", runtime->_inj_vs);
+	config.set("GENERAL", "InjPS", runtime->_inj_ps);
+}
+
+//Same check get_pattern uses to leave UI pixel shaders alone
+bool hook_gw2::isUiPixelShader(const DWORD *pFunction, int l) {
+	return l > 11 && pFunction[l - 6] == 0x4000004 && pFunction[l - 5] == 0x80270800 && pFunction[l - 4] == 0x80e40000 && pFunction[l - 11] == 0x4000004;
 }
 
 HRESULT hook_gw2::SetRenderTarget(DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget) {
@@ -84,7 +166,7 @@ HRESULT hook_gw2::CreateVertexShader(const DWORD *pFunction, IDirect3DVertexShad
 	HRESULT hr = _device->_orig->CreateVertexShader(pFunction, ppShader);
 	
 	if (_pShaderInjection_vs == NULL) {
-		int l = getFuncLenght(pFunction);
+		int l = scanShader(pFunction, nullptr);
 		XXH64_hash_t hash = XXH64(pFunction, l, 0);
 		if (hash == _device->_implicit_swapchain->_runtime->_inj_vs) {
 			LOG(INFO) << "Stable injection point found.";
@@ -96,6 +178,7 @@ HRESULT hook_gw2::CreateVertexShader(const DWORD *pFunction, IDirect3DVertexShad
 }
 
 HRESULT hook_gw2::SetVertexShader(IDirect3DVertexShader9 *pShader) {
+	_vs_current = pShader;
 	if (pShader == NULL) return _device->_orig->SetVertexShader(pShader);
 
 	if (_device->_implicit_swapchain->_runtime->_skip_ui == 0 && !_is_fx_done && pShader == _pShaderInjection_vs) {
@@ -107,39 +190,64 @@ HRESULT hook_gw2::SetVertexShader(IDirect3DVertexShader9 *pShader) {
 }
 
 HRESULT hook_gw2::CreatePixelShader(const DWORD *pFunction, IDirect3DPixelShader9 **ppShader) {
-	int l = getFuncLenght(pFunction);
+	if (!_patch_store_started) startPatchStore();
+	mergePatchStore();
 
+	//Length and cache key in one walk over the bytecode
+	XXH64_hash_t key;
+	int l = scanShader(pFunction, &key);
 
 	if (_pShaderInjection_ps == NULL) {
-		HRESULT hr = _device->_orig->CreatePixelShader(pFunction, ppShader);
+		//The injection hashes in the config only cover the first 'l' bytes, keep it that way so existing values stay valid
 		XXH64_hash_t hash = XXH64(pFunction, l, 0);
 		if (hash == _device->_implicit_swapchain->_runtime->_inj_ps) {
+			HRESULT hr = _device->_orig->CreatePixelShader(pFunction, ppShader);
 			LOG(INFO) << "Unstable injection point found.";
 			_pShaderInjection_ps = *ppShader;
 			return hr;
 		}
 	}
 	
-	int _pattern = get_pattern(pFunction, l);
-	switch (_pattern) {
-		case 1: //Detected pattern 1
-			replacePatternFog1(pFunction, l, _device->_implicit_swapchain->_runtime->_fog_amount);
-			return _device->_orig->CreatePixelShader(_pFunction, ppShader);
-		case 2: //Detected pattern 2
-			replacePatternFog2(pFunction, l, _device->_implicit_swapchain->_runtime->_fog_amount);
-			return _device->_orig->CreatePixelShader(_pFunction, ppShader);
-		case 3://Detected bloom
-			if (_device->_implicit_swapchain->_runtime->_no_bloom == 0)
-				return _device->_orig->CreatePixelShader(pFunction, ppShader);
-			replacePatternBloom(pFunction, l);
-			return _device->_orig->CreatePixelShader(_pFunction, ppShader);
-		default: //No pattern detected
-			return _device->_orig->CreatePixelShader(pFunction, ppShader);
+	const shader_patch_cache::entry *cached = _patch_cache.find(key);
+	if (cached == nullptr) {
+		int _pattern = get_pattern(pFunction, l);
+		std::vector<DWORD> patched;
+		switch (_pattern) {
+			case 1: //Detected pattern 1
+				replacePatternFog1(pFunction, l, patched);
+				break;
+			case 2: //Detected pattern 2
+				replacePatternFog2(pFunction, l, patched);
+				break;
+			case 3://Detected bloom
+				replacePatternBloom(pFunction, l, patched);
+				break;
+		}
+		cached = &_patch_cache.insert(key, _pattern, std::move(patched));
+
+		if (_device->_implicit_swapchain->_runtime->_cache_shader_patches == 0)
+			_patch_store_pending.push_back({ key, cached->pattern, cached->patched });
 	}
+
+	HRESULT hr;
+	if (cached->patched.empty() || (cached->pattern == 3 && _device->_implicit_swapchain->_runtime->_no_bloom == 0))
+		hr = _device->_orig->CreatePixelShader(pFunction, ppShader);
+	else
+		hr = _device->_orig->CreatePixelShader(cached->patched.data(), ppShader);
+
+	//Remembered for discovery until an injection point is known, the game may create them before the link tells what build it is
+	if (SUCCEEDED(hr) && _pShaderInjection_vs == NULL && _pShaderInjection_ps == NULL && isUiPixelShader(pFunction, l))
+		_ui_pixel_shaders.insert(*ppShader);
+	return hr;
 }
 
 HRESULT hook_gw2::SetPixelShader(IDirect3DPixelShader9 *pShader) {
 	if (pShader == NULL) return _device->_orig->SetPixelShader(pShader);
+
+	if (_is_discovering && _discovery_frame_vs == NULL && _vs_current != NULL && _ui_pixel_shaders.count(pShader) != 0) {
+		_discovery_frame_vs = _vs_current;
+		_discovery_frame_ps = pShader;
+	}
 	
 	if (_device->_implicit_swapchain->_runtime->_skip_ui == 0 && pShader == _pShaderInjection_ps && !_is_fx_done) {
 		_is_fx_done = true;
@@ -148,13 +256,66 @@ HRESULT hook_gw2::SetPixelShader(IDirect3DPixelShader9 *pShader) {
 
 	HRESULT hr = _device->_orig->SetPixelShader(pShader);
 
-	float fa = _is_in_competitive_map?1.0f:_device->_implicit_swapchain->_runtime->_fog_amount;
-	float constant[] = { fa, fa, fa, fa};
-	_device->SetPixelShaderConstantF(222, constant, 1);
+	//Constant registers survive shader changes, so only upload when the game overwrote it or the value changed
+	float fa = _map_tracker.is_in_competitive_map()?1.0f:_device->_implicit_swapchain->_runtime->_fog_amount;
+	if (!_is_fog_constant_valid || fa != _fog_constant_value) {
+		float constant[] = { fa, fa, fa, fa};
+		_device->_orig->SetPixelShaderConstantF(FOG_CONSTANT_REGISTER, constant, 1);
+		_device->_state_tracker.set_pixel_shader_constants(FOG_CONSTANT_REGISTER, constant, 1);
+		_fog_constant_value = fa;
+		_is_fog_constant_valid = true;
+	}
 
 	return hr;
 }
 
+void hook_gw2::startPatchStore() {
+	_patch_store_started = true;
+
+	if (_device->_implicit_swapchain->_runtime->_cache_shader_patches != 0) {
+		_patch_store_merged = true;
+		return;
+	}
+
+	//Read the store in the background, shaders created meanwhile are simply patched the regular way
+	_patch_store_idle = false;
+	_patch_store_thread = std::thread([this]() {
+		shader_patch_cache::read_store(reshade::runtime::s_gw2hook_wrkdir_path.string() + "ShaderPatches.bin", _patch_store_loaded);
+		_patch_store_idle = true;
+	});
+}
+
+void hook_gw2::mergePatchStore() {
+	if (_patch_store_merged || !_patch_store_idle) return;
+	_patch_store_thread.join();
+
+	for (auto &r : _patch_store_loaded) {
+		if (_patch_cache.find(r.hash) == nullptr)
+			_patch_cache.insert(r.hash, r.pattern, std::move(r.patched));
+	}
+	LOG(INFO) << "Loaded " << _patch_store_loaded.size() << " patched shaders from disk.";
+
+	_patch_store_loaded.clear();
+	_patch_store_loaded.shrink_to_fit();
+	_patch_store_merged = true;
+}
+
+void hook_gw2::flushPatchStore() {
+	//Batch up new results and write them out at most every few seconds, while the game is streaming in a map this adds up quickly
+	if (!_patch_store_merged || _patch_store_pending.empty() || !_patch_store_idle || GetTickCount() - _patch_store_last_flush < 5000)
+		return;
+	if (_patch_store_thread.joinable())
+		_patch_store_thread.join();
+
+	_patch_store_last_flush = GetTickCount();
+	_patch_store_idle = false;
+	_patch_store_thread = std::thread([this, records = std::move(_patch_store_pending)]() {
+		shader_patch_cache::append_store(reshade::runtime::s_gw2hook_wrkdir_path.string() + "ShaderPatches.bin", records);
+		_patch_store_idle = true;
+	});
+	_patch_store_pending.clear();
+}
+
 int hook_gw2::get_pattern(const DWORD *pFunction, int l) {
 	//pattern bugged { 0x91ff0000, 0x4000004, 0x80270800, 0xa0e40001, 0x80000000, 0x90e40000, 0x2000001, 0x80280800, 0xa0000000, }
 	//If mad oC0 -> mov oC0 -> end
@@ -180,60 +341,67 @@ int hook_gw2::get_pattern(const DWORD *pFunction, int l) {
 	return -1;
 }
 
-void hook_gw2::replacePatternFog1(const DWORD * pFunction, int l, float _fog_amount) {
+void hook_gw2::replacePatternFog1(const DWORD * pFunction, int l, std::vector<DWORD> &out) {
+	out.assign(l + 11, 0);
+	DWORD *const patched = out.data();
 	DWORD constant[] = { 0x5000051, 0xa00f00df, 0, 0, 0, 0 };
 
-	_pFunction[0] = pFunction[0];
-	for (int i = 1; i < 7; ++i) _pFunction[i] = constant[i - 1];
+	patched[0] = pFunction[0];
+	for (int i = 1; i < 7; ++i) patched[i] = constant[i - 1];
 	for (int i = 1; i < l; ++i) {
 		//0x5000051
-		_pFunction[i + 6] = pFunction[i];
+		patched[i + 6] = pFunction[i];
 	}
 	l += 6;
-	_pFunction[l + 4] = _pFunction[l - 1]; //END>>5
-	_pFunction[l + 3] = _pFunction[l - 2];//c1>>4
-	_pFunction[l + 2] = _pFunction[l - 3];//oC0.w>>4
-	_pFunction[l + 1] = _pFunction[l - 4];//mov>>4
-
-	_pFunction[l - 4] = 0x4000012; //lrp
-	_pFunction[l - 3] = _pFunction[l - 8];//oC0.xyz
-	_pFunction[l - 2] = 0xa00000de;//c223
-	_pFunction[l - 1] = 0x80e40001;//r1
-	_pFunction[l] = _pFunction[l - 7];//r0
-
-	_pFunction[l - 8] = 0x800f0001;//oC0.xyz > r1
+	patched[l + 4] = patched[l - 1]; //END>>5
+	patched[l + 3] = patched[l - 2];//c1>>4
+	patched[l + 2] = patched[l - 3];//oC0.w>>4
+	patched[l + 1] = patched[l - 4];//mov>>4
+
+	patched[l - 4] = 0x4000012; //lrp
+	patched[l - 3] = patched[l - 8];//oC0.xyz
+	patched[l - 2] = 0xa00000de;//c223
+	patched[l - 1] = 0x80e40001;//r1
+	patched[l] = patched[l - 7];//r0
+
+	patched[l - 8] = 0x800f0001;//oC0.xyz > r1
 }
 
-void hook_gw2::replacePatternFog2(const DWORD * pFunction, int l, float _fog_amount) {
+void hook_gw2::replacePatternFog2(const DWORD * pFunction, int l, std::vector<DWORD> &out) {
+	out.assign(l + 11, 0);
+	DWORD *const patched = out.data();
 	DWORD constant[] = { 0x5000051, 0xa00f00df, 0, 0, 0, 0 };
 
-	for (int i = 1; i < 7; ++i) _pFunction[i] = constant[i - 1];
+	patched[0] = pFunction[0];
+	for (int i = 1; i < 7; ++i) patched[i] = constant[i - 1];
 	for (int i = 1; i < l; ++i) {
 		//0x5000051
-		_pFunction[i + 6] = pFunction[i];
+		patched[i + 6] = pFunction[i];
 	}
 	l += 6;
 
-	_pFunction[l + 4] = _pFunction[l - 1]; //END>>5
+	patched[l + 4] = patched[l - 1]; //END>>5
 
-	_pFunction[l - 1] = 0x4000012; //lrp
-	_pFunction[l] = _pFunction[l - 5];//oC0.xyz
-	_pFunction[l + 1] = 0xa00000de;//c223
-	_pFunction[l + 2] = 0x80e40001;//r1
-	_pFunction[l + 3] = _pFunction[l - 4];//r0
+	patched[l - 1] = 0x4000012; //lrp
+	patched[l] = patched[l - 5];//oC0.xyz
+	patched[l + 1] = 0xa00000de;//c223
+	patched[l + 2] = 0x80e40001;//r1
+	patched[l + 3] = patched[l - 4];//r0
 
-	_pFunction[l - 5] = 0x800f0001;//oC0.xyz > r1
+	patched[l - 5] = 0x800f0001;//oC0.xyz > r1
 }
 
-void hook_gw2::replacePatternBloom(const DWORD * pFunction, int l) {
+void hook_gw2::replacePatternBloom(const DWORD * pFunction, int l, std::vector<DWORD> &out) {
+	out.assign(l, 0);
+	DWORD *const patched = out.data();
 	LOG(INFO) << "Bloom shader edited.";
 	DWFL hexFloat;
 	hexFloat.f = 0;
-	for (int i = 0; i < l; ++i) _pFunction[i] = pFunction[i];
-	_pFunction[3] = hexFloat.d;
-	_pFunction[4] = hexFloat.d;
-	_pFunction[5] = hexFloat.d;
-	_pFunction[6] = hexFloat.d;
+	for (int i = 0; i < l; ++i) patched[i] = pFunction[i];
+	patched[3] = hexFloat.d;
+	patched[4] = hexFloat.d;
+	patched[5] = hexFloat.d;
+	patched[6] = hexFloat.d;
 }
 
 bool hook_gw2::checkPattern(const DWORD *pFunction, int l, DWORD *pattern, int pl) {
@@ -245,6 +413,48 @@ bool hook_gw2::checkPattern(const DWORD *pFunction, int l, DWORD *pattern, int p
 	return true;
 }
 
+int hook_gw2::scanShader(const DWORD *pFunction, XXH64_hash_t *hash) {
+	XXH64_state_t state;
+	if (hash != NULL) XXH64_reset(&state, 0);
+
+	const DWORD *p = pFunction;
+	const DWORD *hashed = pFunction;
+
+	//Scalar until the pointer is aligned to a whole block. Aligned blocks never straddle a page boundary,
+	//so reading a full block that contains the end token can never touch memory the bytecode is not in.
+	while ((reinterpret_cast<uintptr_t>(p) & (SCAN_BLOCK * sizeof(DWORD) - 1)) != 0) {
+		if (isEnd(*p++)) goto found_end;
+	}
+
+	for (;; p += SCAN_BLOCK) {
+		//Branchless so the compiler can vectorize it
+		unsigned int mask = 0;
+		for (int k = 0; k < SCAN_BLOCK; ++k)
+			mask |= static_cast<unsigned int>((p[k] & D3DSI_OPCODE_MASK) == D3DSIO_END) << k;
+
+		if (mask != 0) {
+			unsigned long k;
+			_BitScanForward(&k, mask);
+			p += k + 1;
+			break;
+		}
+
+		//Feed the hash in larger chunks while the data is still in cache
+		if (hash != NULL && p + SCAN_BLOCK - hashed >= SCAN_HASH_CHUNK) {
+			XXH64_update(&state, hashed, (p + SCAN_BLOCK - hashed) * sizeof(DWORD));
+			hashed = p + SCAN_BLOCK;
+		}
+	}
+
+found_end:
+	if (hash != NULL) {
+		XXH64_update(&state, hashed, (p - hashed) * sizeof(DWORD));
+		*hash = XXH64_digest(&state);
+	}
+
+	return static_cast<int>(p - pFunction);
+}
+
 int hook_gw2::getFuncLenght(const DWORD *pFunction) {
 	int op = 0, l = 1;
 	while (!isEnd(pFunction[op++]))  l++;
@@ -254,18 +464,3 @@ int hook_gw2::getFuncLenght(const DWORD *pFunction) {
 bool hook_gw2::isEnd(DWORD token) {
 	return (token & D3DSI_OPCODE_MASK) == D3DSIO_END;
 }
-
-void hook_gw2::initMumble() {
-	HANDLE hMapObject = OpenFileMappingW(PAGE_READONLY, FALSE, L"MumbleLink");
-	if (hMapObject == NULL) {
-		hMapObject = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(LinkedMem), L"MumbleLink");
-	}
-	if (hMapObject != NULL) {
-		lm = (LinkedMem *)MapViewOfFile(hMapObject, PAGE_READONLY, 0, 0, sizeof(LinkedMem));
-		if (lm == NULL) {
-			CloseHandle(hMapObject);
-			hMapObject = NULL;
-			return;
-		}
-	}
-}
@@ -3,58 +3,43 @@
 #include <vector>
 #include <array>
 #include <map>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "../d3d9/d3d9.hpp"
 #include "log.hpp"
-#include "gw2_table.hpp"
+#include "gw2_map_tracker.hpp"
 #include "xxhash.h"
+#include "shader_patch_cache.hpp"
 
-#define MAX_TOKENS	8192
+#define PATCH_CACHE_SIZE	(8 * 1024 * 1024)
+#define FOG_CONSTANT_REGISTER	222
+#define SCAN_BLOCK	8
+#define SCAN_HASH_CHUNK	256
+#define INJECTION_DISCOVERY_FRAMES	300
 
 typedef union {
 	DWORD d;
 	float f;
 } DWFL;
 
-struct MumbleContext {
-	byte serverAddress[28];
-	unsigned mapId;
-	unsigned mapType;
-	unsigned shardId;
-	unsigned instance;
-	unsigned buildId;
-};
-
-struct LinkedMem {
-	UINT32	uiVersion;
-	DWORD	uiTick;
-	float	fAvatarPosition[3];
-	float	fAvatarFront[3];
-	float	fAvatarTop[3];
-	wchar_t	name[256];
-	float	fCameraPosition[3];
-	float	fCameraFront[3];
-	float	fCameraTop[3];
-	wchar_t	identity[256];
-	UINT32	context_len;
-	MumbleContext context;
-	wchar_t description[2048];
-};
-
 class hook_gw2 {
 public:
 	hook_gw2(Direct3DDevice9* device) :
 		_device(device),
-		rt(new gw2_table),
 		_pShaderInjection_vs(NULL),
 		_pShaderInjection_ps(NULL),
 		_surface_current(NULL),
 		_is_fx_done(false),
-		_is_in_competitive_map(false),
+		_patch_cache(PATCH_CACHE_SIZE),
 		_pattern_InjectionStable{ 0x800c0001, 0xa0550006, 0x3000009, 0x80010002, 0x80e40001, 0xa0e40004, 0x3000009, 0x80020002, 0x80e40001, 0xa0e40005, 0x2000001, 0xe0030000, 0x80440002 },//l = 13
 		_pattern_charScreen{ 0x80440002, 0x2000001, 0xe00c0000, 0x90440009, 0x2000001, 0xe0030001, 0x90440008 }, //l = 7
 		_pattern_bloom{ 0x3000005, 0x80270000, 0x80e40000, 0xa0ff0000, 0x2000001, 0x802f0800, 0x80e40000, } //l = 7
 	{ }
+	~hook_gw2();
 
 	void OnPresent();
 	HRESULT CreateVertexShader(const DWORD *pFunction, IDirect3DVertexShader9 **ppShader);
@@ -63,19 +48,34 @@ public:
 	HRESULT SetPixelShader(IDirect3DPixelShader9 *pShader);
 	HRESULT SetRenderTarget(DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget);
 
+	//Tracks whether the fog amount in c222 is still what we last uploaded
+	void OnSetPixelShaderConstantF(UINT StartRegister, UINT Vector4fCount) {
+		if (StartRegister <= FOG_CONSTANT_REGISTER && FOG_CONSTANT_REGISTER - StartRegister < Vector4fCount)
+			_is_fog_constant_valid = false;
+	}
+	void InvalidateFogConstant() { _is_fog_constant_valid = false; }
+
 private:
-	void replacePatternFog1(const DWORD *pFunction, int l, float _fog_amount);
-	void replacePatternFog2(const DWORD *pFunction, int l, float _fog_amount);
-	void replacePatternBloom(const DWORD *pFunction, int l);
+	//Reentrant, every call writes into its own output buffer
+	static void replacePatternFog1(const DWORD *pFunction, int l, std::vector<DWORD> &out);
+	static void replacePatternFog2(const DWORD *pFunction, int l, std::vector<DWORD> &out);
+	static void replacePatternBloom(const DWORD *pFunction, int l, std::vector<DWORD> &out);
+
+	void updateInjectionDiscovery();
+	bool loadInjectionPoint(unsigned build_id);
+	void storeInjectionPoint(unsigned build_id);
+	static bool isUiPixelShader(const DWORD *pFunction, int l);
+
+	void startPatchStore();
+	void mergePatchStore();
+	void flushPatchStore();
 
 	bool isEnd(DWORD token);
 	int get_pattern(const DWORD *pFunction, int l);
 	bool checkPattern(const DWORD *pFunction, int l, DWORD *pattern, int pl);
 	int getFuncLenght(const DWORD *pFunction);
+	int scanShader(const DWORD *pFunction, XXH64_hash_t *hash);
 
-	void initMumble();
-
-	DWORD _pFunction[MAX_TOKENS];
 	void* _pShaderInjection_vs;
 	void* _pShaderInjection_ps;
 
@@ -84,15 +84,34 @@ private:
 	DWORD _pattern_bloom[7]; //l = 7
 
 	bool _is_fx_done;
-	bool _is_lm_resolved;
-	bool _is_in_competitive_map;
+	bool _is_fog_constant_valid = false;
+	float _fog_constant_value = 0;
 
 	IDirect3DSurface9* _surface_current;
 	Direct3DDevice9 *_device;
-	std::map<LPDIRECT3DPIXELSHADER9, LPDIRECT3DPIXELSHADER9> shader_map;
+	shader_patch_cache _patch_cache;
+
+	//Loading and appending the on-disk patch store happens on this thread, one job at a time
+	std::thread _patch_store_thread;
+	std::atomic<bool> _patch_store_idle = true;
+	bool _patch_store_started = false;
+	bool _patch_store_merged = false;
+	std::vector<shader_patch_cache::record> _patch_store_loaded;
+	std::vector<shader_patch_cache::record> _patch_store_pending;
+	DWORD _patch_store_last_flush = 0;
 	int edited_shader_this_frame = 0;
 
-	LinkedMem *lm = NULL;
-	gw2_table *rt;
+	gw2_map_tracker _map_tracker;
+
+	//Injection point discovery, runs while the game build has no verified pair and no shader matched the configured hashes
+	//The vertex shader that is bound for the first UI draw in every frame for a while becomes the injection point
+	std::unordered_set<IDirect3DPixelShader9 *> _ui_pixel_shaders;
+	IDirect3DVertexShader9 *_vs_current = NULL;
+	IDirect3DVertexShader9 *_discovery_vs = NULL, *_discovery_frame_vs = NULL;
+	IDirect3DPixelShader9 *_discovery_ps = NULL, *_discovery_frame_ps = NULL;
+	int _discovery_streak = 0;
+	unsigned _injection_build_id = 0;
+	bool _is_build_verified = false;
+	bool _is_discovering = false;
 };	
 
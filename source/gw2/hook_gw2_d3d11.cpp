@@ -0,0 +1,116 @@
+#include "d3d11/d3d11_device.hpp"
+#include "d3d11/d3d11_device_context.hpp"
+#include "log.hpp"
+#include "hook_gw2_d3d11.hpp"
+
+reshade::d3d11::d3d11_runtime *hook_gw2_d3d11::get_runtime() const {
+	return _device->_runtimes.empty() ? nullptr : _device->_runtimes.front().get();
+}
+
+float hook_gw2_d3d11::fog_amount() const {
+	auto runtime = get_runtime();
+	return _map_tracker.is_in_competitive_map() || runtime == nullptr ? 1.0f : runtime->_fog_amount;
+}
+
+void hook_gw2_d3d11::OnPresent() {
+	auto runtime = get_runtime();
+	if (runtime == nullptr) return;
+
+	//Effects that were not applied mid-frame are rendered by the runtime on present as usual
+	_is_fx_done = false;
+
+	//The runtime binds its own state while rendering effects, bind the fog amount again at least once per frame
+	InvalidateFogConstants();
+
+	//Updated here instead of when binding, so shaders the game only draws with on deferred contexts see changes too
+	const float fa = fog_amount();
+	if (_fog_constants != nullptr && fa != _fog_constant_value) {
+		const float constants[4] = { fa, 1.0f - fa, 0, 0 };
+		_device->_immediate_context->_orig->UpdateSubresource(_fog_constants.get(), 0, nullptr, constants, 0, 0);
+		_fog_constant_value = fa;
+	}
+
+	_map_tracker.update(runtime);
+}
+
+void hook_gw2_d3d11::OnCreateVertexShader(const void *pShaderBytecode, SIZE_T BytecodeLength, ID3D11VertexShader *pShader) {
+	auto runtime = get_runtime();
+	if (runtime == nullptr || _pShaderInjection_vs != NULL) return;
+
+	if (dxbc_patch::hash_program(pShaderBytecode, BytecodeLength) == runtime->_inj_vs) {
+		LOG(INFO) << "Stable injection point found.";
+		_pShaderInjection_vs = pShader;
+	}
+}
+
+HRESULT hook_gw2_d3d11::CreatePixelShader(const void *pShaderBytecode, SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage, ID3D11PixelShader **ppPixelShader) {
+	auto runtime = get_runtime();
+	if (runtime == nullptr || ppPixelShader == NULL)
+		return _device->_orig->CreatePixelShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppPixelShader);
+
+	if (_pShaderInjection_ps == NULL && dxbc_patch::hash_program(pShaderBytecode, BytecodeLength) == runtime->_inj_ps) {
+		HRESULT hr = _device->_orig->CreatePixelShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppPixelShader);
+		LOG(INFO) << "Unstable injection point found.";
+		if (SUCCEEDED(hr)) _pShaderInjection_ps = *ppPixelShader;
+		return hr;
+	}
+
+	const int pattern = dxbc_patch::get_pattern(pShaderBytecode, BytecodeLength);
+	std::vector<char> patched;
+	if (pattern == dxbc_patch::pattern_none || (pattern == dxbc_patch::pattern_bloom && runtime->_no_bloom == 0) ||
+		!dxbc_patch::patch(pShaderBytecode, BytecodeLength, pattern, patched))
+		return _device->_orig->CreatePixelShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppPixelShader);
+
+	HRESULT hr = _device->_orig->CreatePixelShader(patched.data(), patched.size(), pClassLinkage, ppPixelShader);
+	if (FAILED(hr)) {
+		//Better unpatched than not at all
+		LOG(WARNING) << "Failed to create patched pixel shader with error code " << hr << ", using the original.";
+		return _device->_orig->CreatePixelShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppPixelShader);
+	}
+
+	if (pattern == dxbc_patch::pattern_bloom)
+		LOG(INFO) << "Bloom shader edited.";
+	else
+		_fog_shaders.insert(*ppPixelShader);
+	return hr;
+}
+
+void hook_gw2_d3d11::OnSetVertexShader(ID3D11VertexShader *pShader) {
+	if (pShader == NULL || pShader != _pShaderInjection_vs || _is_fx_done) return;
+
+	auto runtime = get_runtime();
+	if (runtime != nullptr && runtime->_skip_ui == 0) {
+		_is_fx_done = runtime->apply_effects();
+		InvalidateFogConstants();
+	}
+}
+
+void hook_gw2_d3d11::OnSetPixelShader(ID3D11PixelShader *pShader) {
+	if (pShader == NULL || pShader != _pShaderInjection_ps || _is_fx_done) return;
+
+	auto runtime = get_runtime();
+	if (runtime != nullptr && runtime->_skip_ui == 0) {
+		_is_fx_done = runtime->apply_effects();
+		InvalidateFogConstants();
+	}
+}
+
+void hook_gw2_d3d11::BindFogConstants(ID3D11DeviceContext *context, bool is_immediate, ID3D11PixelShader *pShader) {
+	if (pShader == NULL || _fog_shaders.count(pShader) == 0) return;
+
+	if (_fog_constants == nullptr) {
+		const float fa = fog_amount();
+		const float constants[4] = { fa, 1.0f - fa, 0, 0 };
+		const D3D11_BUFFER_DESC desc = { sizeof(constants), D3D11_USAGE_DEFAULT, D3D11_BIND_CONSTANT_BUFFER };
+		const D3D11_SUBRESOURCE_DATA data = { constants };
+		if (FAILED(_device->_orig->CreateBuffer(&desc, &data, &_fog_constants))) return;
+		_fog_constant_value = fa;
+	}
+
+	//Constant buffer bindings survive shader changes, so only bind when the game overwrote the slot
+	if (is_immediate && _is_fog_constant_bound) return;
+
+	ID3D11Buffer *const buffer = _fog_constants.get();
+	context->PSSetConstantBuffers(DXBC_FOG_CONSTANT_SLOT, 1, &buffer);
+	if (is_immediate) _is_fog_constant_bound = true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <unordered_set>
+#include "../d3d11/d3d11.hpp"
+#include "dxbc_patch.hpp"
+#include "gw2_map_tracker.hpp"
+
+struct D3D11Device;
+
+//Counterpart of hook_gw2 for the DirectX 11 client, driven by the D3D11 device and immediate context proxies
+//The fog and bloom patches rewrite the DXBC of the matching pixel shaders, see dxbc_patch
+class hook_gw2_d3d11 {
+public:
+	explicit hook_gw2_d3d11(D3D11Device *device) : _device(device) { }
+
+	void OnPresent();
+	void OnCreateVertexShader(const void *pShaderBytecode, SIZE_T BytecodeLength, ID3D11VertexShader *pShader);
+	HRESULT CreatePixelShader(const void *pShaderBytecode, SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage, ID3D11PixelShader **ppPixelShader);
+	void OnSetVertexShader(ID3D11VertexShader *pShader);
+	void OnSetPixelShader(ID3D11PixelShader *pShader);
+
+	//Called after a pixel shader was bound on any context, binds the fog amount for patched shaders
+	void BindFogConstants(ID3D11DeviceContext *context, bool is_immediate, ID3D11PixelShader *pShader);
+	//Tracks whether the fog amount buffer is still bound on the immediate context
+	void OnSetPixelShaderConstantBuffers(UINT StartSlot, UINT NumBuffers) {
+		if (StartSlot <= DXBC_FOG_CONSTANT_SLOT && DXBC_FOG_CONSTANT_SLOT - StartSlot < NumBuffers)
+			_is_fog_constant_bound = false;
+	}
+	void InvalidateFogConstants() { _is_fog_constant_bound = false; }
+
+private:
+	reshade::d3d11::d3d11_runtime *get_runtime() const;
+	float fog_amount() const;
+
+	//Only compared against, never dereferenced
+	const void *_pShaderInjection_vs = NULL;
+	const void *_pShaderInjection_ps = NULL;
+
+	bool _is_fx_done = false;
+
+	//Pixel shaders created from patched fog bytecode, which read the fog amount from DXBC_FOG_CONSTANT_SLOT
+	std::unordered_set<const void *> _fog_shaders;
+	com_ptr<ID3D11Buffer> _fog_constants;
+	float _fog_constant_value = -1.0f;
+	bool _is_fog_constant_bound = false;
+
+	D3D11Device *_device;
+	gw2_map_tracker _map_tracker;
+};
@@ -0,0 +1,147 @@
+#include "shader_patch_cache.hpp"
+#include <fstream>
+
+const shader_patch_cache::entry *shader_patch_cache::find(XXH64_hash_t hash) {
+	auto it = _index.find(hash);
+	if (it == _index.end()) return nullptr;
+
+	//Move to the front, without invalidating the iterator stored in the index
+	_lru.splice(_lru.begin(), _lru, it->second);
+	return &it->second->second;
+}
+
+const shader_patch_cache::entry &shader_patch_cache::insert(XXH64_hash_t hash, int pattern, std::vector<DWORD> &&patched) {
+	auto it = _index.find(hash);
+	if (it != _index.end()) {
+		_bytes -= entry_size(it->second->second);
+		_lru.erase(it->second);
+		_index.erase(it);
+	}
+
+	_lru.emplace_front(hash, entry{ pattern, std::move(patched) });
+	_index.emplace(hash, _lru.begin());
+	_bytes += entry_size(_lru.front().second);
+
+	//Evict from the back, but always keep the entry just added
+	while (_bytes > _max_bytes && _lru.size() > 1) {
+		auto &last = _lru.back();
+		_bytes -= entry_size(last.second);
+		_index.erase(last.first);
+		_lru.pop_back();
+	}
+
+	return _lru.front().second;
+}
+
+void shader_patch_cache::clear() {
+	_lru.clear();
+	_index.clear();
+	_bytes = 0;
+}
+
+//File layout: header, then records of { hash, pattern, token count, tokens... } appended over time
+struct patch_store_header {
+	DWORD magic;
+	DWORD version;
+};
+
+static const DWORD s_patch_store_magic = 0x50325747; //'GW2P'
+
+//Every running client reads and appends to the same store, so access to it is serialized across processes
+class patch_store_lock {
+public:
+	patch_store_lock() : _mutex(CreateMutexW(nullptr, FALSE, L"Local\\GW2HookShaderPatchStore")) {
+		if (_mutex == nullptr) return;
+
+		//An abandoned mutex belonged to a client that exited while writing, the reader copes with the truncated record it may have left
+		const DWORD result = WaitForSingleObject(_mutex, 10000);
+		if (result != WAIT_OBJECT_0 && result != WAIT_ABANDONED) {
+			CloseHandle(_mutex);
+			_mutex = nullptr;
+		}
+	}
+	~patch_store_lock() {
+		if (_mutex == nullptr) return;
+		ReleaseMutex(_mutex);
+		CloseHandle(_mutex);
+	}
+
+	patch_store_lock(const patch_store_lock &) = delete;
+	patch_store_lock &operator=(const patch_store_lock &) = delete;
+
+	bool is_locked() const { return _mutex != nullptr; }
+
+private:
+	HANDLE _mutex;
+};
+
+bool shader_patch_cache::read_store(const std::string &path, std::vector<record> &records) {
+	//Reading without the lock only risks seeing a partial last record, which is skipped
+	const patch_store_lock lock;
+
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file.is_open()) return false;
+
+	file.seekg(0, std::ios::end);
+	const std::streamoff file_size = file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	patch_store_header header = {};
+	if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != s_patch_store_magic || header.version != PATCH_STORE_VERSION)
+		return false;
+
+	const DWORD max_tokens = static_cast<DWORD>(file_size / sizeof(DWORD));
+
+	for (;;) {
+		record r;
+		DWORD count = 0;
+		if (!file.read(reinterpret_cast<char *>(&r.hash), sizeof(r.hash)) ||
+			!file.read(reinterpret_cast<char *>(&r.pattern), sizeof(r.pattern)) ||
+			!file.read(reinterpret_cast<char *>(&count), sizeof(count)) || count > max_tokens)
+			break;
+
+		r.patched.resize(count);
+		if (count != 0 && !file.read(reinterpret_cast<char *>(r.patched.data()), count * sizeof(DWORD)))
+			break; //Truncated by a crash during the last append, keep everything before it
+
+		records.push_back(std::move(r));
+	}
+
+	return true;
+}
+
+bool shader_patch_cache::append_store(const std::string &path, const std::vector<record> &records) {
+	//Appending without the lock could interleave records with those of another client
+	const patch_store_lock lock;
+	if (!lock.is_locked()) return false;
+
+	std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::ate);
+	bool valid = false;
+
+	if (file.is_open() && file.tellp() >= static_cast<std::streamoff>(sizeof(patch_store_header))) {
+		patch_store_header header = {};
+		file.seekg(0, std::ios::beg);
+		valid = file.read(reinterpret_cast<char *>(&header), sizeof(header)) && header.magic == s_patch_store_magic && header.version == PATCH_STORE_VERSION &&
+			file.seekp(0, std::ios::end) && file.tellp() < PATCH_STORE_MAX_SIZE;
+	}
+
+	if (!valid) {
+		//Missing, outdated or grown too large, start over
+		file.close();
+		file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return false;
+
+		const patch_store_header header = { s_patch_store_magic, PATCH_STORE_VERSION };
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	}
+
+	for (const record &r : records) {
+		const DWORD count = static_cast<DWORD>(r.patched.size());
+		file.write(reinterpret_cast<const char *>(&r.hash), sizeof(r.hash));
+		file.write(reinterpret_cast<const char *>(&r.pattern), sizeof(r.pattern));
+		file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+		file.write(reinterpret_cast<const char *>(r.patched.data()), count * sizeof(DWORD));
+	}
+
+	return !file.fail();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <Windows.h>
+#include "xxhash.h"
+
+//Bump whenever pattern detection or the rewrites change, so stale patched bytecode on disk is discarded
+#define PATCH_STORE_VERSION	1
+#define PATCH_STORE_MAX_SIZE	(32 * 1024 * 1024)
+
+//Remembers the result of scanning and patching a game shader, keyed by the hash of its original bytecode.
+//Bounded by the total size of the stored bytecode, evicting the least recently used entries first.
+class shader_patch_cache {
+public:
+	struct entry {
+		int pattern;
+		std::vector<DWORD> patched; //Empty when the shader is used unmodified
+	};
+
+	struct record {
+		XXH64_hash_t hash;
+		int pattern;
+		std::vector<DWORD> patched;
+	};
+
+	explicit shader_patch_cache(size_t max_bytes) : _max_bytes(max_bytes), _bytes(0) { }
+
+	const entry *find(XXH64_hash_t hash);
+	const entry &insert(XXH64_hash_t hash, int pattern, std::vector<DWORD> &&patched);
+	void clear();
+	size_t size() const { return _index.size(); }
+	size_t memory_usage() const { return _bytes; }
+
+	//Persisted patch results, so later sessions can skip pattern detection and rewriting entirely
+	static bool read_store(const std::string &path, std::vector<record> &records);
+	static bool append_store(const std::string &path, const std::vector<record> &records);
+
+private:
+	static size_t entry_size(const entry &e) { return sizeof(entry) + e.patched.size() * sizeof(DWORD); }
+
+	std::list<std::pair<XXH64_hash_t, entry>> _lru; //Most recently used at the front
+	std::unordered_map<XXH64_hash_t, std::list<std::pair<XXH64_hash_t, entry>>::iterator> _index;
+	size_t _max_bytes;
+	size_t _bytes;
+};
@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <tuple>
 #include <vector>
+#include <string_view>
 #include <unordered_map>
 #include <Windows.h>
 
@@ -79,9 +80,20 @@ namespace
 
 	reshade::filesystem::path s_export_hook_path;
 	std::vector<std::tuple<const char *, reshade::hook, hook_method>> s_hooks; std::mutex s_mutex_hooks;
+	// Indices into 's_hooks' by replacement and target address, so looking up a hook does not have to walk the whole list, which grows to several hundred entries
+	std::unordered_map<reshade::hook::address, size_t> s_hooks_by_replacement, s_hooks_by_target;
 	std::vector<reshade::filesystem::path> s_delayed_hook_paths; std::mutex s_mutex_delayed_hook_paths;
 	std::unordered_map<reshade::hook::address, reshade::hook::address *> s_vtable_addresses; std::mutex s_mutex_vtable_addresses;
+	// Overlays and other tools load the OpenGL module into many processes that never use it, so only its "wgl" exports are hooked right away and the several hundred others once a context is made current
+	std::vector<std::tuple<const char *, reshade::hook::address, reshade::hook::address>> s_deferred_matches; std::mutex s_mutex_deferred_matches;
 
+	void register_internal(const char *name, const reshade::hook &hook, hook_method method)
+	{ const std::lock_guard<std::mutex> lock(s_mutex_hooks);
+		// Only the first hook for a target is indexed by it, since that is the one that owns the trampoline
+		s_hooks_by_replacement.emplace(hook.replacement, s_hooks.size());
+		s_hooks_by_target.emplace(hook.target, s_hooks.size());
+		s_hooks.push_back(std::make_tuple(name, hook, method));
+	}
 	bool install_internal(const char *name, reshade::hook &hook, hook_method method)
 	{
 #if RESHADE_VERBOSE_LOG
@@ -134,9 +146,7 @@ namespace
 		LOG(DEBUG) << "> Succeeded.";
 #endif
 
-		{ const std::lock_guard<std::mutex> lock(s_mutex_hooks);
-			s_hooks.push_back(std::make_tuple(name, hook, method));
-		}
+		register_internal(name, hook, method);
 
 		return true;
 	}
@@ -160,6 +170,22 @@ namespace
 		std::vector<std::tuple<const char *, reshade::hook::address, reshade::hook::address>> matches;
 		matches.reserve(replacement_exports.size());
 
+		// Export hooks cost nothing to install, so there is no point in deferring those
+		const bool defer_non_wgl_exports = method == hook_method::function_hook &&
+			reshade::filesystem::get_module_path(target_module).filename_without_extension() == "opengl32";
+
+		// Look up replacements by name, instead of comparing every export of the target against every export of the replacement
+		std::unordered_map<std::string_view, reshade::hook::address> replacements_by_name;
+		replacements_by_name.reserve(replacement_exports.size());
+
+		for (const auto &symbol : replacement_exports)
+		{
+			if (symbol.name != nullptr)
+			{
+				replacements_by_name.emplace(symbol.name, symbol.address);
+			}
+		}
+
 #if RESHADE_VERBOSE_LOG
 		LOG(DEBUG) << "> Dumping matches in export table:";
 		LOG(DEBUG) << "  +--------------------+---------+----------------------------------------------------+";
@@ -176,13 +202,10 @@ namespace
 			}
 
 			// Find appropriate replacement
-			const auto it = std::find_if(replacement_exports.cbegin(), replacement_exports.cend(),
-				[&symbol](const auto &moduleexport) {
-					return std::strcmp(moduleexport.name, symbol.name) == 0;
-				});
+			const auto it = replacements_by_name.find(symbol.name);
 
 			// Filter uninteresting functions
-			if (it != replacement_exports.cend() &&
+			if (it != replacements_by_name.cend() &&
 				std::strcmp(symbol.name, "DXGIReportAdapterConfiguration") != 0 &&
 				std::strcmp(symbol.name, "DXGIDumpJournal") != 0)
 			{
@@ -190,13 +213,29 @@ namespace
 				LOG(DEBUG) << "  | 0x" << std::setw(16) << symbol.address << " | " << std::setw(7) << symbol.ordinal << " | " << std::setw(50) << symbol.name << " |";
 #endif
 
-				matches.push_back(std::make_tuple(symbol.name, symbol.address, it->address));
+				matches.push_back(std::make_tuple(symbol.name, symbol.address, it->second));
 			}
 		}
 
 #if RESHADE_VERBOSE_LOG
 		LOG(DEBUG) << "  +--------------------+---------+----------------------------------------------------+";
 #endif
+		if (defer_non_wgl_exports)
+		{
+			const auto deferred = std::stable_partition(matches.begin(), matches.end(),
+				[](const auto &match) {
+					return std::strncmp(std::get<0>(match), "wgl", 3) == 0;
+				});
+
+			{ const std::lock_guard<std::mutex> lock(s_mutex_deferred_matches);
+				s_deferred_matches.insert(s_deferred_matches.end(), deferred, matches.end());
+			}
+
+			LOG(INFO) << "> Deferring " << std::distance(deferred, matches.end()) << " match(es) until an OpenGL context is made current.";
+
+			matches.erase(deferred, matches.end());
+		}
+
 		LOG(INFO) << "> Found " << matches.size() << " match(es). Installing ...";
 
 		// Hook matching exports
@@ -285,12 +324,15 @@ namespace
 
 	reshade::hook find_internal(reshade::hook::address replacement)
 	{ const std::lock_guard<std::mutex> lock(s_mutex_hooks);
-		const auto it = std::find_if(s_hooks.cbegin(), s_hooks.cend(),
-			[replacement](const auto &hook) {
-				return std::get<1>(hook).replacement == replacement;
-			});
+		const auto it = s_hooks_by_replacement.find(replacement);
+
+		return it != s_hooks_by_replacement.cend() ? std::get<1>(s_hooks[it->second]) : reshade::hook { };
+	}
+	reshade::hook find_target_internal(reshade::hook::address target)
+	{ const std::lock_guard<std::mutex> lock(s_mutex_hooks);
+		const auto it = s_hooks_by_target.find(target);
 
-		return it != s_hooks.cend() ? std::get<1>(*it) : reshade::hook { };
+		return it != s_hooks_by_target.cend() ? std::get<1>(s_hooks[it->second]) : reshade::hook { };
 	}
 	template <typename T>
 	inline T call_unchecked(T replacement)
@@ -418,7 +460,20 @@ bool reshade::hooks::install(const char *name, hook::address target, hook::addre
 		hook.replacement = replacement;
 	}
 
-	return install_internal(name, hook, hook_method::function_hook) && (!queue_enable || hook::apply_queued_actions());
+	// Drivers return the same address for aliases like "glBindFramebuffer" and "glBindFramebufferEXT", which can only be hooked once, so the other replacement shares the trampoline
+	if (const auto existing = find_target_internal(target); existing.installed())
+	{
+#if RESHADE_VERBOSE_LOG
+		LOG(DEBUG) << "Hook for '" << name << "' shares the target 0x" << target << " with an existing hook.";
+#endif
+		hook.trampoline = existing.trampoline;
+
+		register_internal(name, hook, hook_method::function_hook);
+
+		return true;
+	}
+
+	return install_internal(name, hook, hook_method::function_hook) && (queue_enable || hook::apply_queued_actions());
 }
 bool reshade::hooks::install(const char *name, hook::address vtable[], unsigned int offset, hook::address replacement)
 {
@@ -453,6 +508,33 @@ bool reshade::hooks::install(const char *name, hook::address vtable[], unsigned
 
 	return false;
 }
+void reshade::hooks::install_deferred()
+{
+	std::vector<std::tuple<const char *, hook::address, hook::address>> matches;
+
+	{ const std::lock_guard<std::mutex> lock(s_mutex_deferred_matches);
+		if (s_deferred_matches.empty())
+		{
+			return;
+		}
+
+		matches.swap(s_deferred_matches);
+	}
+
+	LOG(INFO) << "Installing " << matches.size() << " deferred hook(s) ...";
+
+	for (const auto &match : matches)
+	{
+		hook hook;
+		hook.target = std::get<1>(match);
+		hook.trampoline = hook.target;
+		hook.replacement = std::get<2>(match);
+
+		install_internal(std::get<0>(match), hook, hook_method::function_hook);
+	}
+
+	hook::apply_queued_actions();
+}
 void reshade::hooks::uninstall()
 {
 	LOG(INFO) << "Uninstalling " << s_hooks.size() << " hook(s) ...";
@@ -474,6 +556,8 @@ void reshade::hooks::uninstall()
 	}
 
 	s_hooks.clear();
+	s_hooks_by_replacement.clear();
+	s_hooks_by_target.clear();
 }
 void reshade::hooks::register_module(const filesystem::path &target_path)
 {
@@ -39,6 +39,11 @@ namespace reshade::hooks
 	/// <returns>The status of the hook installation.</returns>
 	bool install(const char *name, hook::address vtable[], unsigned int offset, hook::address replacement);
 	/// <summary>
+	/// Install the hooks that <see cref="register_module"/> held back until they are needed, which are those of OpenGL functions other than the "wgl" ones.
+	/// Call this before an OpenGL context is made current.
+	/// </summary>
+	void install_deferred();
+	/// <summary>
 	/// Uninstall all previously installed hooks.
 	/// Only call this function as long as the loader-lock is active, since it is not thread-safe.
 	/// </summary>
@@ -4,39 +4,98 @@
  */
 
 #include "ini_file.hpp"
+#include <mutex>
+#include <thread>
+#include <chrono>
 #include <fstream>
+#include <string_view>
+#include <condition_variable>
+#include <Windows.h>
 
 namespace reshade
 {
-	static inline void trim(std::string &str, const char *chars = " \t")
+	using section_map = std::unordered_map<std::string, std::unordered_map<std::string, variant>>;
+
+	struct file_stamp
 	{
-		str.erase(0, str.find_first_not_of(chars));
-		str.erase(str.find_last_not_of(chars) + 1);
-	}
-	static inline std::string trim(const std::string &str, const char *chars = " \t")
+		FILETIME last_write_time;
+		unsigned long long size;
+
+		bool operator==(const file_stamp &other) const
+		{
+			return CompareFileTime(&last_write_time, &other.last_write_time) == 0 && size == other.size;
+		}
+	};
+	struct cache_entry
 	{
-		std::string res(str);
-		trim(res, chars);
-		return res;
-	}
+		file_stamp stamp;
+		std::shared_ptr<section_map> sections;
+	};
 
-	ini_file::ini_file(const filesystem::path &path) : _path(path)
+	struct pending_save
 	{
-		load();
+		std::shared_ptr<section_map> sections;
+		std::chrono::steady_clock::time_point last_change;
+	};
+
+	// Changes are only written after a file was left alone for this long, so dragging a slider does not rewrite the preset on every frame
+	static const auto SAVE_DELAY = std::chrono::milliseconds(500);
+
+	// Guards the cache and the pending saves, which are newer than what the cache or the file on disk have
+	static std::mutex s_cache_mutex;
+	static std::unordered_map<std::wstring, cache_entry> s_cache;
+	static std::unordered_map<std::wstring, pending_save> s_pending_saves;
+	// Held by whoever writes files, the background thread or 'ini_file::flush'
+	static std::mutex s_write_mutex;
+	static std::condition_variable s_save_signal;
+	// Guarded by 's_cache_mutex', the thread is detached, so 'ini_file::stop' waits for it to leave its loop instead of joining it
+	static bool s_is_writer_running = false, s_stop_writer = false;
+	static std::condition_variable s_writer_stopped;
+
+	static bool get_file_stamp(const std::wstring &path, file_stamp &stamp)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+		if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes))
+		{
+			return false;
+		}
+
+		stamp.last_write_time = attributes.ftLastWriteTime;
+		stamp.size = (static_cast<unsigned long long>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+
+		return true;
 	}
-	ini_file::~ini_file()
+
+	static inline std::string_view trim(std::string_view str, const char *chars = " \t\r")
 	{
-		save();
+		const size_t first = str.find_first_not_of(chars);
+
+		if (first == std::string_view::npos)
+		{
+			return std::string_view();
+		}
+
+		return str.substr(first, str.find_last_not_of(chars) - first + 1);
 	}
 
-	void ini_file::load()
+	// Works on the file contents directly and only allocates for the keys and values that end up in the sections
+	static void parse(std::string_view data, section_map &sections)
 	{
-		std::string line, section;
-		std::ifstream file(_path.wstring());
+		// Skip byte order mark written by some editors
+		if (data.size() >= 3 && data.substr(0, 3) == "\xEF\xBB\xBF")
+		{
+			data.remove_prefix(3);
+		}
+
+		std::string section;
 
-		while (std::getline(file, line))
+		while (!data.empty())
 		{
-			trim(line);
+			const size_t line_end = data.find('\n');
+			const std::string_view line = trim(data.substr(0, line_end));
+
+			data.remove_prefix(line_end != std::string_view::npos ? line_end + 1 : data.size());
 
 			if (line.empty() || line[0] == ';' || line[0] == '/')
 			{
@@ -53,7 +112,7 @@ namespace reshade
 			// Read section content
 			const auto assign_index = line.find('=');
 
-			if (assign_index != std::string::npos)
+			if (assign_index != std::string_view::npos)
 			{
 				const auto key = trim(line.substr(0, assign_index));
 				const auto value = trim(line.substr(assign_index + 1));
@@ -63,84 +122,275 @@ namespace reshade
 				{
 					found = value.find_first_of(',', i);
 
-					if (found == std::string::npos)
+					if (found == std::string_view::npos)
 						found = len;
 
-					value_splitted.push_back(value.substr(i, found - i));
+					value_splitted.emplace_back(value.substr(i, found - i));
 				}
 
-				_sections[section][key] = value_splitted;
+				sections[section][std::string(key)] = std::move(value_splitted);
 			}
 			else
 			{
-				_sections[section][line] = 0;
+				sections[section][std::string(line)] = 0;
 			}
 		}
 	}
-	void ini_file::save() const
+
+	ini_file::ini_file(const filesystem::path &path) : _path(path)
 	{
-		if (!_modified)
+		load();
+	}
+	ini_file::~ini_file()
+	{
+		save();
+	}
+
+	void ini_file::load()
+	{
+		const std::wstring path = _path.wstring();
+
+		{ const std::lock_guard<std::mutex> lock(s_cache_mutex);
+			if (const auto it = s_pending_saves.find(path); it != s_pending_saves.end())
+			{
+				_sections = it->second.sections;
+				_is_shared = true;
+				return;
+			}
+		}
+
+		file_stamp stamp;
+
+		if (!get_file_stamp(path, stamp))
 		{
+			_sections = std::make_shared<section_map>();
 			return;
 		}
 
-		std::ofstream file(_path.wstring());
+		{ const std::lock_guard<std::mutex> lock(s_cache_mutex);
+			if (const auto it = s_cache.find(path); it != s_cache.end() && it->second.stamp == stamp)
+			{
+				_sections = it->second.sections;
+				_is_shared = true;
+				return;
+			}
+		}
+
+		_sections = std::make_shared<section_map>();
+
+		const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
 
-		const auto it = _sections.find("");
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return;
+		}
 
-		if (it != _sections.end())
+		// Empty files cannot be mapped, but there is nothing to parse in them anyway
+		if (stamp.size != 0)
 		{
-			for (const auto &section_line : it->second)
+			if (const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr); mapping != nullptr)
+			{
+				if (const void *const view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0); view != nullptr)
+				{
+					parse(std::string_view(static_cast<const char *>(view), static_cast<size_t>(stamp.size)), *_sections);
+
+					UnmapViewOfFile(view);
+				}
+
+				CloseHandle(mapping);
+			}
+		}
+
+		CloseHandle(file);
+
+		const std::lock_guard<std::mutex> lock(s_cache_mutex);
+		s_cache[path] = { stamp, _sections };
+		_is_shared = true;
+	}
+
+	// Write to a temporary file first and rename it afterwards, so a crash never leaves a truncated file behind
+	static void write_file(const std::wstring &path, const std::shared_ptr<section_map> &sections_ptr)
+	{
+		const section_map &sections = *sections_ptr;
+		const std::wstring temp_path = path + L".tmp";
+
+		{ std::ofstream file(temp_path);
+
+			const auto it = sections.find("");
+
+			if (it != sections.end())
 			{
-				file << section_line.first << '=';
+				for (const auto &section_line : it->second)
+				{
+					file << section_line.first << '=';
+
+					for (size_t i = 0; i < section_line.second.size(); i++)
+					{
+						if (i != 0)
+						{
+							file << ',';
+						}
+
+						file << section_line.second.as<std::string>(i);
+					}
+
+					file << std::endl;
+				}
+
+				file << std::endl;
+			}
+
+			for (const auto &section : sections)
+			{
+				if (section.first.empty())
+				{
+					continue;
+				}
 
-				size_t i = 0;
+				file << '[' << section.first << ']' << std::endl;
 
-				for (const auto &item : section_line.second.data())
+				for (const auto &section_line : section.second)
 				{
-					if (i++ != 0)
+					file << section_line.first << '=';
+
+					for (size_t i = 0; i < section_line.second.size(); i++)
 					{
-						file << ',';
+						if (i != 0)
+						{
+							file << ',';
+						}
+
+						file << section_line.second.as<std::string>(i);
 					}
 
-					file << item;
+					file << std::endl;
 				}
 
 				file << std::endl;
 			}
 
-			file << std::endl;
+			file.close();
+
+			if (!file)
+			{
+				DeleteFileW(temp_path.c_str());
+				return;
+			}
+		}
+
+		if (!MoveFileExW(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			DeleteFileW(temp_path.c_str());
+			return;
 		}
 
-		for (const auto &section : _sections)
+		// The sections are never modified after they were queued, so they can become what later loads of the file get
+		if (file_stamp stamp; get_file_stamp(path, stamp))
 		{
-			if (section.first.empty())
+			const std::lock_guard<std::mutex> lock(s_cache_mutex);
+			s_cache[path] = { stamp, sections_ptr };
+		}
+	}
+
+	// Write all pending saves that were not changed for the specified time, the caller has to hold the write lock
+	static void write_pending_saves(std::chrono::steady_clock::duration min_age)
+	{
+		std::vector<std::pair<std::wstring, std::shared_ptr<section_map>>> saves;
+
+		{ const std::lock_guard<std::mutex> lock(s_cache_mutex);
+			const auto now = std::chrono::steady_clock::now();
+
+			for (const auto &save : s_pending_saves)
 			{
-				continue;
+				if (now - save.second.last_change >= min_age)
+				{
+					saves.emplace_back(save.first, save.second.sections);
+				}
 			}
+		}
 
-			file << '[' << section.first << ']' << std::endl;
+		for (const auto &save : saves)
+		{
+			write_file(save.first, save.second);
 
-			for (const auto &section_line : section.second)
+			// The entry stays pending until it was written, so loads always find the latest contents, unless it changed again in the meantime
+			const std::lock_guard<std::mutex> lock(s_cache_mutex);
+			if (const auto it = s_pending_saves.find(save.first); it != s_pending_saves.end() && it->second.sections == save.second)
 			{
-				file << section_line.first << '=';
+				s_pending_saves.erase(it);
+			}
+		}
+	}
 
-				size_t i = 0;
+	void ini_file::save() const
+	{
+		if (!_modified)
+		{
+			return;
+		}
 
-				for (const auto &item : section_line.second.data())
-				{
-					if (i++ != 0)
+		{ const std::lock_guard<std::mutex> lock(s_cache_mutex);
+			s_pending_saves[_path.wstring()] = { _sections, std::chrono::steady_clock::now() };
+
+			if (!s_is_writer_running && !s_stop_writer)
+			{
+				s_is_writer_running = true;
+
+				// Detached like the one of the log, see 'log::open', anything it did not write yet is written by 'ini_file::stop' or 'ini_file::flush' during shutdown
+				std::thread([]() {
+					for (;;)
 					{
-						file << ',';
-					}
+						{ std::unique_lock<std::mutex> lock(s_cache_mutex);
+							s_save_signal.wait(lock, []() { return !s_pending_saves.empty() || s_stop_writer; });
 
-					file << item;
-				}
+							// Wait for the user to stop changing things before writing anything
+							if (s_stop_writer || s_save_signal.wait_for(lock, SAVE_DELAY, []() { return s_stop_writer; }))
+							{
+								break;
+							}
+						}
 
-				file << std::endl;
+						const std::lock_guard<std::mutex> lock(s_write_mutex);
+						write_pending_saves(SAVE_DELAY);
+					}
+
+					const std::lock_guard<std::mutex> lock(s_cache_mutex);
+					s_is_writer_running = false;
+					s_writer_stopped.notify_all();
+				}).detach();
 			}
+		}
 
-			file << std::endl;
+		s_save_signal.notify_one();
+	}
+	void ini_file::flush()
+	{
+		// The background thread may have been terminated while holding the lock, in which case nothing can be written anymore
+		if (s_write_mutex.try_lock())
+		{
+			const std::lock_guard<std::mutex> lock(s_write_mutex, std::adopt_lock);
+			write_pending_saves(std::chrono::steady_clock::duration::zero());
 		}
 	}
+	void ini_file::stop()
+	{
+		{ std::unique_lock<std::mutex> lock(s_cache_mutex);
+			s_stop_writer = true;
+			s_save_signal.notify_all();
+			s_writer_stopped.wait(lock, []() { return !s_is_writer_running; });
+		}
+
+		const std::lock_guard<std::mutex> lock(s_write_mutex);
+		write_pending_saves(std::chrono::steady_clock::duration::zero());
+	}
+	std::unordered_map<std::string, ini_file::section> &ini_file::modify()
+	{
+		if (_is_shared)
+		{
+			_sections = std::make_shared<section_map>(*_sections);
+			_is_shared = false;
+		}
+
+		return *_sections;
+	}
 }
@@ -5,24 +5,51 @@
 
 #pragma once
 
+#include <memory>
 #include <unordered_map>
 #include "variant.hpp"
 #include "filesystem.hpp"
 
 namespace reshade
 {
+	/// <summary>
+	/// An INI file that is parsed when constructed and queued to be written back when destroyed if it was modified. Parsed files are kept in a process-wide cache until they change on disk, so opening the same file again does not read it.
+	/// </summary>
 	class ini_file
 	{
 	public:
 		explicit ini_file(const filesystem::path &path);
 		~ini_file();
 
+		/// <summary>
+		/// Write all queued changes to disk on the calling thread, for when the background thread may no longer run, like during shutdown. Changes are otherwise only written once a file was not modified for a short while.
+		/// </summary>
+		static void flush();
+		/// <summary>
+		/// Stop the background thread, wait for it to finish what it is writing and then write the remaining queued changes on the calling thread. For when the module is unloaded while the process keeps running.
+		/// </summary>
+		static void stop();
+
+		/// <summary>
+		/// Check whether the file has a value for a key.
+		/// </summary>
+		bool has(const std::string &section, const std::string &key) const
+		{
+			const auto it = _sections->find(section);
+
+			return it != _sections->end() && it->second.count(key) != 0;
+		}
+		/// <summary>
+		/// Get the parsed contents of the file, which stay the same object for as long as neither the file changes nor this instance is modified. Keeping a reference to them tells whether something derived from the file is still up to date.
+		/// </summary>
+		std::shared_ptr<const void> contents() const { return _sections; }
+
 		template <typename T>
 		void get(const std::string &section, const std::string &key, T &value) const
 		{
-			const auto it1 = _sections.find(section);
+			const auto it1 = _sections->find(section);
 
-			if (it1 == _sections.end())
+			if (it1 == _sections->end())
 			{
 				return;
 			}
@@ -39,9 +66,9 @@ namespace reshade
 		template <typename T, size_t SIZE>
 		void get(const std::string &section, const std::string &key, T(&values)[SIZE]) const
 		{
-			const auto it1 = _sections.find(section);
+			const auto it1 = _sections->find(section);
 
-			if (it1 == _sections.end())
+			if (it1 == _sections->end())
 			{
 				return;
 			}
@@ -61,9 +88,9 @@ namespace reshade
 		template <typename T>
 		void get(const std::string &section, const std::string &key, std::vector<T> &values) const
 		{
-			const auto it1 = _sections.find(section);
+			const auto it1 = _sections->find(section);
 
-			if (it1 == _sections.end())
+			if (it1 == _sections->end())
 			{
 				return;
 			}
@@ -77,7 +104,7 @@ namespace reshade
 
 			values.clear();
 
-			for (size_t i = 0; i < it2->second.data().size(); i++)
+			for (size_t i = 0; i < it2->second.size(); i++)
 			{
 				values.emplace_back(it2->second.as<T>(i));
 			}
@@ -86,28 +113,32 @@ namespace reshade
 		void set(const std::string &section, const std::string &key, const T &value)
 		{
 			_modified = true;
-			_sections[section][key] = value;
+			modify()[section][key] = value;
 		}
 		template <typename T, size_t SIZE>
 		void set(const std::string &section, const std::string &key, const T(&values)[SIZE])
 		{
 			_modified = true;
-			_sections[section][key] = values;
+			modify()[section][key] = values;
 		}
 		template <typename T, size_t SIZE>
 		void set(const std::string &section, const std::string &key, const std::vector<T> &values)
 		{
 			_modified = true;
-			_sections[section][key] = values;
+			modify()[section][key] = values;
 		}
 
 	private:
+		using section = std::unordered_map<std::string, variant>;
+
 		void load();
 		void save() const;
+		std::unordered_map<std::string, section> &modify();
 
 		bool _modified = false;
 		filesystem::path _path;
-		using section = std::unordered_map<std::string, variant>;
-		std::unordered_map<std::string, section> _sections;
+		// Shared with the cache of parsed files until the first modification, which works on a copy instead
+		std::shared_ptr<std::unordered_map<std::string, section>> _sections;
+		bool _is_shared = false;
 	};
 }
@@ -18,6 +18,14 @@ namespace reshade
 	static std::unordered_map<HWND, unsigned int> s_raw_input_windows;
 	static std::unordered_map<HWND, std::weak_ptr<input>> s_windows;
 
+	// Nearly all input arrives for the same window, so the result of the last lookup is kept to avoid searching the window lists for every message, which adds up with high polling rate mice
+	static struct
+	{
+		HWND hwnd = nullptr;
+		std::weak_ptr<input> window;
+		unsigned int raw_input_flags = 0;
+	} s_last_lookup;
+
 	input::input(window_handle window) : _window(window)
 	{
 		assert(window != nullptr);
@@ -34,6 +42,8 @@ namespace reshade
 		{
 			insert.first->second |= flags;
 		}
+
+		s_last_lookup.hwnd = nullptr;
 	}
 	std::shared_ptr<input> input::register_window(window_handle window)
 	{
@@ -41,6 +51,8 @@ namespace reshade
 
 		const auto insert = s_windows.emplace(static_cast<HWND>(window), std::weak_ptr<input>());
 
+		s_last_lookup.hwnd = nullptr;
+
 		if (insert.second || insert.first->second.expired())
 		{
 #if RESHADE_VERBOSE_LOG
@@ -62,13 +74,15 @@ namespace reshade
 	{
 		s_windows.clear();
 		s_raw_input_windows.clear();
+		s_last_lookup.hwnd = nullptr;
+		s_last_lookup.window.reset();
 	}
 
 	bool input::handle_window_message(const void *message_data)
 	{
 		assert(message_data != nullptr);
 
-		MSG details = *static_cast<const MSG *>(message_data);
+		const MSG &details = *static_cast<const MSG *>(message_data);
 
 		bool is_mouse_message = details.message >= WM_MOUSEFIRST && details.message <= WM_MOUSELAST;
 		bool is_keyboard_message = details.message >= WM_KEYFIRST && details.message <= WM_KEYLAST;
@@ -79,140 +93,150 @@ namespace reshade
 			return false;
 		}
 
-		const std::lock_guard<std::mutex> lock(s_mutex);
-
-		// Remove any expired entry from the list
-		for (auto it = s_windows.begin(); it != s_windows.end();)
-			it->second.expired() ? it = s_windows.erase(it) : ++it;
-
-		// Look up the window in the list of known input windows
-		auto input_window = s_windows.find(details.hwnd);
-		const auto raw_input_window = s_raw_input_windows.find(details.hwnd);
+		RAWINPUT raw_data = {};
+		UINT raw_data_size = sizeof(raw_data);
 
-		if (input_window == s_windows.end())
+		// Raw input is read before taking the lock, so other threads do not have to wait for it
+		if (details.message == WM_INPUT)
 		{
-			// Walk through the window chain and until an known window is found
-			EnumChildWindows(details.hwnd, [](HWND hwnd, LPARAM lparam) -> BOOL {
-				auto &input_window = *reinterpret_cast<decltype(s_windows)::iterator *>(lparam);
-				// Return true to continue enumeration
-				return (input_window = s_windows.find(hwnd)) == s_windows.end();
-			}, reinterpret_cast<LPARAM>(&input_window));
+			if (GET_RAWINPUT_CODE_WPARAM(details.wParam) != RIM_INPUT ||
+				GetRawInputData(reinterpret_cast<HRAWINPUT>(details.lParam), RID_INPUT, &raw_data, &raw_data_size, sizeof(raw_data.header)) == UINT(-1))
+			{
+				return false;
+			}
+
+			is_mouse_message = raw_data.header.dwType == RIM_TYPEMOUSE;
+			is_keyboard_message = raw_data.header.dwType == RIM_TYPEKEYBOARD;
 		}
 
-		if (input_window == s_windows.end() && raw_input_window != s_raw_input_windows.end())
+		const std::lock_guard<std::mutex> lock(s_mutex);
+
+		if (details.hwnd != s_last_lookup.hwnd)
 		{
-			// Reroute this raw input message to the window with the most rendering
-			input_window = std::max_element(s_windows.begin(), s_windows.end(),
-				[](auto lhs, auto rhs) { return lhs.second.lock()->_frame_count < rhs.second.lock()->_frame_count; });
+			// Remove any expired entry from the list
+			for (auto it = s_windows.begin(); it != s_windows.end();)
+				it->second.expired() ? it = s_windows.erase(it) : ++it;
+
+			// Look up the window in the list of known input windows
+			auto input_window = s_windows.find(details.hwnd);
+			const auto raw_input_window = s_raw_input_windows.find(details.hwnd);
+
+			if (input_window == s_windows.end())
+			{
+				// Walk through the window chain and until an known window is found
+				EnumChildWindows(details.hwnd, [](HWND hwnd, LPARAM lparam) -> BOOL {
+					auto &input_window = *reinterpret_cast<decltype(s_windows)::iterator *>(lparam);
+					// Return true to continue enumeration
+					return (input_window = s_windows.find(hwnd)) == s_windows.end();
+				}, reinterpret_cast<LPARAM>(&input_window));
+			}
+
+			if (input_window == s_windows.end() && raw_input_window != s_raw_input_windows.end())
+			{
+				// Reroute this raw input message to the window with the most rendering
+				input_window = std::max_element(s_windows.begin(), s_windows.end(),
+					[](auto lhs, auto rhs) { return lhs.second.lock()->_frame_count < rhs.second.lock()->_frame_count; });
+			}
+
+			// Windows that were not registered for raw input process both raw keyboard and mouse input
+			s_last_lookup.hwnd = details.hwnd;
+			s_last_lookup.window = input_window != s_windows.end() ? input_window->second : std::weak_ptr<input>();
+			s_last_lookup.raw_input_flags = raw_input_window != s_raw_input_windows.end() ? raw_input_window->second : 0x3;
 		}
 
-		if (input_window == s_windows.end())
+		const auto input_lock = s_last_lookup.window.lock();
+
+		if (input_lock == nullptr)
 		{
 			return false;
 		}
 
-		RAWINPUT raw_data = {};
-		UINT raw_data_size = sizeof(raw_data);
-
-		const auto input_lock = input_window->second.lock();
 		input &input = *input_lock;
 
-		// Calculate window client mouse position
-		ScreenToClient(static_cast<HWND>(input._window), &details.pt);
-
-		input._mouse_position[0] = details.pt.x;
-		input._mouse_position[1] = details.pt.y;
+		// Converted to window client coordinates only once per frame in 'next_frame'
+		input._pending.mouse_position[0] = details.pt.x;
+		input._pending.mouse_position[1] = details.pt.y;
 
 		switch (details.message)
 		{
 			case WM_INPUT:
-				if (GET_RAWINPUT_CODE_WPARAM(details.wParam) != RIM_INPUT ||
-					GetRawInputData(reinterpret_cast<HRAWINPUT>(details.lParam), RID_INPUT, &raw_data, &raw_data_size, sizeof(raw_data.header)) == UINT(-1))
-				{
-					break;
-				}
-
 				switch (raw_data.header.dwType)
 				{
 					case RIM_TYPEMOUSE:
-						is_mouse_message = true;
-
-						if (raw_input_window != s_raw_input_windows.end() && (raw_input_window->second & 0x2) == 0)
+						if ((s_last_lookup.raw_input_flags & 0x2) == 0)
 							break;
 
 						if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_LEFT_BUTTON_DOWN)
-							input._mouse_buttons[0] = 0x88;
+							input._pending.mouse_buttons[0] = 0x88;
 						else if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_LEFT_BUTTON_UP)
-							input._mouse_buttons[0] = 0x08;
+							input._pending.mouse_buttons[0] = 0x08;
 						if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_RIGHT_BUTTON_DOWN)
-							input._mouse_buttons[1] = 0x88;
+							input._pending.mouse_buttons[1] = 0x88;
 						else if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_RIGHT_BUTTON_UP)
-							input._mouse_buttons[1] = 0x08;
+							input._pending.mouse_buttons[1] = 0x08;
 						if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_MIDDLE_BUTTON_DOWN)
-							input._mouse_buttons[2] = 0x88;
+							input._pending.mouse_buttons[2] = 0x88;
 						else if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_MIDDLE_BUTTON_UP)
-							input._mouse_buttons[2] = 0x08;
+							input._pending.mouse_buttons[2] = 0x08;
 
 						if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_BUTTON_4_DOWN)
-							input._mouse_buttons[3] = 0x88;
+							input._pending.mouse_buttons[3] = 0x88;
 						else if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_BUTTON_4_UP)
-							input._mouse_buttons[3] = 0x08;
+							input._pending.mouse_buttons[3] = 0x08;
 
 						if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_BUTTON_5_DOWN)
-							input._mouse_buttons[4] = 0x88;
+							input._pending.mouse_buttons[4] = 0x88;
 						else if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_BUTTON_5_UP)
-							input._mouse_buttons[4] = 0x08;
+							input._pending.mouse_buttons[4] = 0x08;
 
 						if (raw_data.data.mouse.usButtonFlags & RI_MOUSE_WHEEL)
-							input._mouse_wheel_delta += static_cast<short>(raw_data.data.mouse.usButtonData) / WHEEL_DELTA;
+							input._pending.mouse_wheel_delta += static_cast<short>(raw_data.data.mouse.usButtonData) / WHEEL_DELTA;
 						break;
 					case RIM_TYPEKEYBOARD:
-						is_keyboard_message = true;
-
-						if (raw_input_window != s_raw_input_windows.end() && (raw_input_window->second & 0x1) == 0)
+						if ((s_last_lookup.raw_input_flags & 0x1) == 0)
 							break;
 
 						if (raw_data.data.keyboard.VKey != 0xFF)
-							input._keys[raw_data.data.keyboard.VKey] = (raw_data.data.keyboard.Flags & RI_KEY_BREAK) == 0 ? 0x88 : 0x08;
+							input._pending.keys[raw_data.data.keyboard.VKey] = (raw_data.data.keyboard.Flags & RI_KEY_BREAK) == 0 ? 0x88 : 0x08;
 						break;
 				}
 				break;
 			case WM_KEYDOWN:
 			case WM_SYSKEYDOWN:
-				input._keys[details.wParam] = 0x88;
+				input._pending.keys[details.wParam] = 0x88;
 				break;
 			case WM_KEYUP:
 			case WM_SYSKEYUP:
-				input._keys[details.wParam] = 0x08;
+				input._pending.keys[details.wParam] = 0x08;
 				break;
 			case WM_LBUTTONDOWN:
-				input._mouse_buttons[0] = 0x88;
+				input._pending.mouse_buttons[0] = 0x88;
 				break;
 			case WM_LBUTTONUP:
-				input._mouse_buttons[0] = 0x08;
+				input._pending.mouse_buttons[0] = 0x08;
 				break;
 			case WM_RBUTTONDOWN:
-				input._mouse_buttons[1] = 0x88;
+				input._pending.mouse_buttons[1] = 0x88;
 				break;
 			case WM_RBUTTONUP:
-				input._mouse_buttons[1] = 0x08;
+				input._pending.mouse_buttons[1] = 0x08;
 				break;
 			case WM_MBUTTONDOWN:
-				input._mouse_buttons[2] = 0x88;
+				input._pending.mouse_buttons[2] = 0x88;
 				break;
 			case WM_MBUTTONUP:
-				input._mouse_buttons[2] = 0x08;
+				input._pending.mouse_buttons[2] = 0x08;
 				break;
 			case WM_MOUSEWHEEL:
-				input._mouse_wheel_delta += GET_WHEEL_DELTA_WPARAM(details.wParam) / WHEEL_DELTA;
+				input._pending.mouse_wheel_delta += GET_WHEEL_DELTA_WPARAM(details.wParam) / WHEEL_DELTA;
 				break;
 			case WM_XBUTTONDOWN:
 				assert(HIWORD(details.wParam) < 3);
-				input._mouse_buttons[2 + HIWORD(details.wParam)] = 0x88;
+				input._pending.mouse_buttons[2 + HIWORD(details.wParam)] = 0x88;
 				break;
 			case WM_XBUTTONUP:
 				assert(HIWORD(details.wParam) < 3);
-				input._mouse_buttons[2 + HIWORD(details.wParam)] = 0x08;
+				input._pending.mouse_buttons[2 + HIWORD(details.wParam)] = 0x08;
 				break;
 		}
 
@@ -223,7 +247,7 @@ namespace reshade
 	{
 		assert(keycode < 256);
 
-		return (_keys[keycode] & 0x80) == 0x80;
+		return (current_state().keys[keycode] & 0x80) == 0x80;
 	}
 	bool input::is_key_down(unsigned int keycode, bool ctrl, bool shift, bool alt) const
 	{
@@ -233,7 +257,7 @@ namespace reshade
 	{
 		assert(keycode < 256);
 
-		return (_keys[keycode] & 0x88) == 0x88;
+		return (current_state().keys[keycode] & 0x88) == 0x88;
 	}
 	bool input::is_key_pressed(unsigned int keycode, bool ctrl, bool shift, bool alt) const
 	{
@@ -243,7 +267,7 @@ namespace reshade
 	{
 		assert(keycode < 256);
 
-		return (_keys[keycode] & 0x88) == 0x08;
+		return (current_state().keys[keycode] & 0x88) == 0x08;
 	}
 	bool input::is_any_key_down() const
 	{
@@ -293,19 +317,19 @@ namespace reshade
 	{
 		assert(button < 5);
 
-		return (_mouse_buttons[button] & 0x80) == 0x80;
+		return (current_state().mouse_buttons[button] & 0x80) == 0x80;
 	}
 	bool input::is_mouse_button_pressed(unsigned int button) const
 	{
 		assert(button < 5);
 
-		return (_mouse_buttons[button] & 0x88) == 0x88;
+		return (current_state().mouse_buttons[button] & 0x88) == 0x88;
 	}
 	bool input::is_mouse_button_released(unsigned int button) const
 	{
 		assert(button < 5);
 
-		return (_mouse_buttons[button] & 0x88) == 0x08;
+		return (current_state().mouse_buttons[button] & 0x88) == 0x08;
 	}
 	bool input::is_any_mouse_button_down() const
 	{
@@ -347,7 +371,7 @@ namespace reshade
 	unsigned short input::key_to_text(unsigned int keycode) const
 	{
 		WORD ch = 0;
-		return ToAscii(keycode, MapVirtualKey(keycode, MAPVK_VK_TO_VSC), _keys, &ch, 0) ? ch : 0;
+		return ToAscii(keycode, MapVirtualKey(keycode, MAPVK_VK_TO_VSC), current_state().keys, &ch, 0) ? ch : 0;
 	}
 
 	void input::block_mouse_input(bool enable)
@@ -364,6 +388,14 @@ namespace reshade
 		_block_keyboard = enable;
 	}
 
+	bool input::is_window_in_background() const
+	{
+		// Input may be captured for a child window, while focus and minimizing apply to the top-level window
+		const HWND root = GetAncestor(static_cast<HWND>(_window), GA_ROOT);
+
+		return IsIconic(root) || GetAncestor(GetForegroundWindow(), GA_ROOT) != root;
+	}
+
 	static inline bool is_blocking_mouse_input()
 	{
 		const auto predicate = [](auto input_window) {
@@ -383,37 +415,57 @@ namespace reshade
 
 	void input::next_frame()
 	{
-		_frame_count++;
+		const unsigned int next_index = _state_index.load(std::memory_order_relaxed) ^ 1;
+		state &next = _states[next_index];
 
-		for (auto &state : _keys)
-		{
-			state &= ~0x8;
-		}
-		for (auto &state : _mouse_buttons)
-		{
-			state &= ~0x8;
-		}
+		{ const std::lock_guard<std::mutex> lock(s_mutex);
+			next = _pending;
 
-		_mouse_wheel_delta = 0;
-		_last_mouse_position[0] = _mouse_position[0];
-		_last_mouse_position[1] = _mouse_position[1];
+			_frame_count++;
 
-		// Update caps lock state
-		_keys[VK_CAPITAL] |= GetKeyState(VK_CAPITAL) & 0x1;
+			for (auto &state : _pending.keys)
+			{
+				state &= ~0x8;
+			}
+			for (auto &state : _pending.mouse_buttons)
+			{
+				state &= ~0x8;
+			}
 
-		// Update modifier key state
-		if ((_keys[VK_MENU] & 0x88) != 0 &&
-			(GetKeyState(VK_MENU) & 0x8000) == 0)
-		{
-			_keys[VK_MENU] = 0x08;
-		}
+			_pending.mouse_wheel_delta = 0;
 
-		// Update print screen state
-		if ((_keys[VK_SNAPSHOT] & 0x80) == 0 &&
-			(GetAsyncKeyState(VK_SNAPSHOT) & 0x8000) != 0)
-		{
-			_keys[VK_SNAPSHOT] = 0x88;
+			// Update caps lock state
+			_pending.keys[VK_CAPITAL] |= GetKeyState(VK_CAPITAL) & 0x1;
+
+			// Update modifier key state
+			if ((_pending.keys[VK_MENU] & 0x88) != 0 &&
+				(GetKeyState(VK_MENU) & 0x8000) == 0)
+			{
+				_pending.keys[VK_MENU] = 0x08;
+			}
+
+			// Update print screen state
+			if ((_pending.keys[VK_SNAPSHOT] & 0x80) == 0 &&
+				(GetAsyncKeyState(VK_SNAPSHOT) & 0x8000) != 0)
+			{
+				_pending.keys[VK_SNAPSHOT] = 0x88;
+			}
+
+			// Look up windows again once per frame, so raw input follows the window with the most rendering
+			s_last_lookup.hwnd = nullptr;
 		}
+
+		// Calculate window client mouse position
+		POINT position = { static_cast<LONG>(next.mouse_position[0]), static_cast<LONG>(next.mouse_position[1]) };
+		ScreenToClient(static_cast<HWND>(_window), &position);
+
+		const state &current = _states[next_index ^ 1];
+		next.mouse_position[0] = position.x;
+		next.mouse_position[1] = position.y;
+		next.last_mouse_position[0] = current.mouse_position[0];
+		next.last_mouse_position[1] = current.mouse_position[1];
+
+		_state_index.store(next_index, std::memory_order_release);
 	}
 }
 
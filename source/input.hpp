@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 
 namespace reshade
@@ -36,11 +37,11 @@ namespace reshade
 		bool is_any_mouse_button_down() const;
 		bool is_any_mouse_button_pressed() const;
 		bool is_any_mouse_button_released() const;
-		short mouse_wheel_delta() const { return _mouse_wheel_delta; }
-		int mouse_movement_delta_x() const { return _mouse_position[0] - _last_mouse_position[0]; }
-		int mouse_movement_delta_y() const { return _mouse_position[1] - _last_mouse_position[1]; }
-		unsigned int mouse_position_x() const { return _mouse_position[0]; }
-		unsigned int mouse_position_y() const { return _mouse_position[1]; }
+		short mouse_wheel_delta() const { return current_state().mouse_wheel_delta; }
+		int mouse_movement_delta_x() const { return current_state().mouse_position[0] - current_state().last_mouse_position[0]; }
+		int mouse_movement_delta_y() const { return current_state().mouse_position[1] - current_state().last_mouse_position[1]; }
+		unsigned int mouse_position_x() const { return current_state().mouse_position[0]; }
+		unsigned int mouse_position_y() const { return current_state().mouse_position[1]; }
 
 		unsigned short key_to_text(unsigned int keycode) const;
 
@@ -50,17 +51,36 @@ namespace reshade
 		bool is_blocking_mouse_input() const { return _block_mouse; }
 		bool is_blocking_keyboard_input() const { return _block_keyboard; }
 
+		/// <summary>
+		/// Check whether the window is minimized or another application has the focus.
+		/// </summary>
+		bool is_window_in_background() const;
+
+		/// <summary>
+		/// Publish all input received since the last call as the state queries see for the frame that is about to be processed.
+		/// </summary>
 		void next_frame();
 
 		static bool handle_window_message(const void *message_data);
 
 	private:
+		struct state
+		{
+			uint8_t keys[256] = { }, mouse_buttons[5] = { };
+			short mouse_wheel_delta = 0;
+			unsigned int mouse_position[2] = { };
+			unsigned int last_mouse_position[2] = { };
+		};
+
+		const state &current_state() const { return _states[_state_index.load(std::memory_order_acquire)]; }
+
 		window_handle _window;
 		bool _block_mouse = false, _block_keyboard = false;
-		uint8_t _keys[256] = { }, _mouse_buttons[5] = { };
-		short _mouse_wheel_delta = 0;
-		unsigned int _mouse_position[2] = { };
-		unsigned int _last_mouse_position[2] = { };
+		// Written by the thread that receives the window messages while holding the input lock, the mouse position is in screen coordinates here
+		state _pending;
+		// Only 'next_frame' writes to the state that is not current, so queries never see it change halfway through a frame
+		state _states[2];
+		std::atomic<unsigned int> _state_index = 0;
 		uint64_t _frame_count = 0;
 	};
 }
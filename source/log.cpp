@@ -4,73 +4,302 @@
  */
 
 #include "log.hpp"
+#include <deque>
 #include <mutex>
+#include <thread>
+#include <utility>
 #include <assert.h>
+#include <condition_variable>
 #include <Windows.h>
 
 namespace reshade::log
 {
-	std::ofstream stream;
-	std::ostringstream linestream;
-	std::vector<std::string> lines;
-	static std::mutex s_mutex;
+	std::atomic<int> s_max_level(static_cast<int>(level::debug));
 
-	message::message(level level)
+	namespace
 	{
-		SYSTEMTIME time;
-		GetLocalTime(&time);
+		struct queue_entry
+		{
+			// Position this entry was last written for, which tells producers and the consumer whose turn it is
+			std::atomic<size_t> sequence;
+			level message_level;
+			DWORD thread_id;
+			uint64_t time;
+			std::string text;
+		};
+
+		// Bounded multi-producer queue, producers only contend on the enqueue position and never wait on the file
+		const size_t QUEUE_SIZE = 4096; // Has to be a power of two
+		const size_t HISTORY_SIZE = 2000;
+
+		struct message_queue
+		{
+			queue_entry entries[QUEUE_SIZE];
+			std::atomic<size_t> enqueue_position = 0;
+			// Only accessed by the consumer, which holds 's_consumer_mutex'
+			size_t dequeue_position = 0;
+
+			message_queue()
+			{
+				for (size_t i = 0; i < QUEUE_SIZE; i++)
+				{
+					entries[i].sequence.store(i, std::memory_order_relaxed);
+				}
+			}
+		} s_queue;
+
+		std::ofstream s_file;
+		std::mutex s_consumer_mutex;
+		std::mutex s_signal_mutex;
+		std::condition_variable s_signal;
+		// Guarded by 's_signal_mutex', the thread is detached, so 'close' waits for it to leave its loop instead of joining it
+		bool s_is_writer_running = false, s_stop_writer = false;
+		std::condition_variable s_writer_stopped;
+		std::mutex s_history_mutex;
+		std::deque<std::string> s_history;
+		std::atomic<size_t> s_history_revision = 0;
+
+		std::ostringstream &thread_stream()
+		{
+			thread_local std::ostringstream stream;
+			return stream;
+		}
+		// Set while a message formats into the stream of this thread
+		thread_local bool t_is_thread_stream_in_use = false;
+
+		// Write out everything that was queued so far, the caller has to hold the consumer lock
+		void drain()
+		{
+			const char level_names[][6] = { "ERROR", "WARN ", "INFO ", "DEBUG" };
+
+			bool written = false;
 
-		const char level_names[][6] = { "ERROR", "WARN ", "INFO ", "DEBUG" };
-		assert(static_cast<unsigned int>(level) - 1 < _countof(level_names));
+			for (;; s_queue.dequeue_position++)
+			{
+				queue_entry &entry = s_queue.entries[s_queue.dequeue_position & (QUEUE_SIZE - 1)];
 
-		// Lock the stream until the message is complete
-		s_mutex.lock();
+				if (entry.sequence.load(std::memory_order_acquire) != s_queue.dequeue_position + 1)
+				{
+					break;
+				}
 
-		// Start a new line
-		linestream.str("");
-		linestream.clear();
+				const level message_level = entry.message_level;
+				const DWORD thread_id = entry.thread_id;
+				const uint64_t time = entry.time;
+				std::string text = std::move(entry.text);
 
-		stream << std::right << std::setfill('0')
+				// Hand the entry back to the producers before the slow part
+				entry.sequence.store(s_queue.dequeue_position + QUEUE_SIZE, std::memory_order_release);
+
+				assert(static_cast<unsigned int>(message_level) - 1 < _countof(level_names));
+				const char *const level_name = level_names[static_cast<unsigned int>(message_level) - 1];
+
+				if (s_file.is_open())
+				{
+					FILETIME file_time, local_file_time;
+					file_time.dwLowDateTime = static_cast<DWORD>(time);
+					file_time.dwHighDateTime = static_cast<DWORD>(time >> 32);
+					SYSTEMTIME local_time = { };
+					FileTimeToLocalFileTime(&file_time, &local_file_time);
+					FileTimeToSystemTime(&local_file_time, &local_time);
+
+					s_file << std::right << std::setfill('0')
 #if RESHADE_VERBOSE_LOG
-			<< std::setw(4) << time.wYear << '-'
-			<< std::setw(2) << time.wMonth << '-'
-			<< std::setw(2) << time.wDay << 'T'
+						<< std::setw(4) << local_time.wYear << '-'
+						<< std::setw(2) << local_time.wMonth << '-'
+						<< std::setw(2) << local_time.wDay << 'T'
 #endif
-			<< std::setw(2) << time.wHour << ':'
-			<< std::setw(2) << time.wMinute << ':'
-			<< std::setw(2) << time.wSecond << ':'
-			<< std::setw(3) << time.wMilliseconds << ' '
-			<< '[' << std::setw(5) << GetCurrentThreadId() << ']' << std::setfill(' ')
-			<< " | "
-			<< level_names[static_cast<unsigned int>(level) - 1] << " | " << std::left;
-		linestream
-			<< level_names[static_cast<unsigned int>(level) - 1] << " | ";
+						<< std::setw(2) << local_time.wHour << ':'
+						<< std::setw(2) << local_time.wMinute << ':'
+						<< std::setw(2) << local_time.wSecond << ':'
+						<< std::setw(3) << local_time.wMilliseconds << ' '
+						<< '[' << std::setw(5) << thread_id << ']' << std::setfill(' ')
+						<< " | "
+						<< level_name << " | " << std::left << text << '\n';
+
+					written = true;
+				}
+
+				{ const std::lock_guard<std::mutex> lock(s_history_mutex);
+					if (s_history.size() >= HISTORY_SIZE)
+					{
+						s_history.pop_front();
+					}
+
+					s_history.push_back(std::string(level_name) + " | " + text + '\n');
+					s_history_revision.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+
+			if (written)
+			{
+				s_file.flush();
+			}
+		}
+
+		void push(level level, uint64_t time, std::string &&text)
+		{
+			size_t position = s_queue.enqueue_position.load(std::memory_order_relaxed);
+
+			for (;;)
+			{
+				queue_entry &entry = s_queue.entries[position & (QUEUE_SIZE - 1)];
+				const size_t sequence = entry.sequence.load(std::memory_order_acquire);
+				const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+				if (difference == 0)
+				{
+					if (s_queue.enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						entry.message_level = level;
+						entry.thread_id = GetCurrentThreadId();
+						entry.time = time;
+						entry.text = std::move(text);
+						entry.sequence.store(position + 1, std::memory_order_release);
+						break;
+					}
+				}
+				else if (difference < 0)
+				{
+					// The queue is full, help drain it if the background thread is not already doing so, it may not be running at all before the log was opened
+					if (s_consumer_mutex.try_lock())
+					{
+						const std::lock_guard<std::mutex> lock(s_consumer_mutex, std::adopt_lock);
+						drain();
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+
+					position = s_queue.enqueue_position.load(std::memory_order_relaxed);
+				}
+				else
+				{
+					position = s_queue.enqueue_position.load(std::memory_order_relaxed);
+				}
+			}
+
+			s_signal.notify_one();
+		}
 	}
-	message::~message()
+
+	void set_max_level(level level)
+	{
+		s_max_level.store(static_cast<int>(level), std::memory_order_relaxed);
+	}
+
+	message::message(level level) :
+		_nested_stream(std::exchange(t_is_thread_stream_in_use, true) ? std::make_unique<std::ostringstream>() : nullptr),
+		_stream(_nested_stream != nullptr ? *_nested_stream : thread_stream()),
+		_level(level)
 	{
-		// Finish the line
-		stream << std::endl;
-		linestream << std::endl;
+		FILETIME time;
+		GetSystemTimeAsFileTime(&time);
+		_time = (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
 
-		lines.push_back(linestream.str());
+		// Start a new line, without any formatting state a previous message left behind
+		_stream.str(std::string());
+		_stream.clear();
+		_stream.flags(std::ios_base::dec | std::ios_base::skipws | std::ios_base::showbase);
+		_stream.fill(' ');
+		_stream.precision(6);
+	}
+	message::~message()
+	{
+		push(_level, _time, _stream.str());
 
-		// The message is finished, we can unlock the stream
-		s_mutex.unlock();
+		if (_nested_stream == nullptr)
+		{
+			t_is_thread_stream_in_use = false;
+		}
 	}
 
 	bool open(const filesystem::path &path)
 	{
-		stream.open(path.wstring(), std::ios::out | std::ios::trunc);
+		{ const std::lock_guard<std::mutex> lock(s_consumer_mutex);
+			s_file.open(path.wstring(), std::ios::out | std::ios::trunc);
 
-		if (!stream.is_open())
-		{
-			return false;
+			if (!s_file.is_open())
+			{
+				return false;
+			}
+
+			s_file.flush();
 		}
 
-		stream.setf(std::ios_base::showbase);
+		const std::lock_guard<std::mutex> lock(s_signal_mutex);
+
+		if (!s_is_writer_running)
+		{
+			s_is_writer_running = true;
+			s_stop_writer = false;
+
+			// Joining in 'DllMain' would wait for the thread to exit, which needs the loader lock the caller holds, so the thread is detached and 'close' waits for its loop instead
+			// When the process terminates, the thread is killed before the module is unloaded and anything it did not write yet is flushed at that point
+			std::thread([]() {
+				for (;;)
+				{
+					{ std::unique_lock<std::mutex> lock(s_signal_mutex);
+						if (s_signal.wait_for(lock, std::chrono::milliseconds(100), []() { return s_stop_writer; }))
+						{
+							break;
+						}
+					}
 
-		stream.flush();
+					const std::lock_guard<std::mutex> lock(s_consumer_mutex);
+					drain();
+				}
+
+				const std::lock_guard<std::mutex> lock(s_signal_mutex);
+				s_is_writer_running = false;
+				s_writer_stopped.notify_all();
+			}).detach();
+		}
 
 		return true;
 	}
+	void flush()
+	{
+		// The background thread may have been terminated while holding the lock, in which case nothing can be written anymore
+		if (s_consumer_mutex.try_lock())
+		{
+			const std::lock_guard<std::mutex> lock(s_consumer_mutex, std::adopt_lock);
+			drain();
+		}
+	}
+	void close()
+	{
+		{ std::unique_lock<std::mutex> lock(s_signal_mutex);
+			s_stop_writer = true;
+			s_signal.notify_all();
+			s_writer_stopped.wait(lock, []() { return !s_is_writer_running; });
+		}
+
+		const std::lock_guard<std::mutex> lock(s_consumer_mutex);
+		drain();
+
+		s_file.close();
+	}
+
+	void visit_history(const std::function<void(const std::string &)> &visitor)
+	{
+		const std::lock_guard<std::mutex> lock(s_history_mutex);
+
+		for (const auto &line : s_history)
+		{
+			visitor(line);
+		}
+	}
+	size_t history_revision()
+	{
+		return s_history_revision.load(std::memory_order_relaxed);
+	}
+	void clear_history()
+	{
+		const std::lock_guard<std::mutex> lock(s_history_mutex);
+
+		s_history.clear();
+		s_history_revision.fetch_add(1, std::memory_order_relaxed);
+	}
 }
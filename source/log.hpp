@@ -5,17 +5,22 @@
 
 #pragma once
 
+#include <atomic>
 #include <fstream>
 #include <iomanip>
+#include <memory>
 #include <sstream>
+#include <functional>
 #include <utf8/unchecked.h>
 #include "filesystem.hpp"
 
 #define LOG(LEVEL) LOG_##LEVEL()
-#define LOG_INFO() reshade::log::message(reshade::log::level::info)
-#define LOG_ERROR() reshade::log::message(reshade::log::level::error)
-#define LOG_WARNING() reshade::log::message(reshade::log::level::warning)
-#define LOG_DEBUG() reshade::log::message(reshade::log::level::debug)
+#define LOG_INFO() LOG_AT_LEVEL(reshade::log::level::info)
+#define LOG_ERROR() LOG_AT_LEVEL(reshade::log::level::error)
+#define LOG_WARNING() LOG_AT_LEVEL(reshade::log::level::warning)
+#define LOG_DEBUG() LOG_AT_LEVEL(reshade::log::level::debug)
+// Filtered messages do not even evaluate what is streamed into them, the empty branch keeps an 'else' after the statement bound to the 'if' of the caller
+#define LOG_AT_LEVEL(LEVEL) if (!reshade::log::is_enabled(LEVEL)) { } else reshade::log::message(LEVEL)
 
 namespace reshade::log
 {
@@ -27,20 +32,29 @@ namespace reshade::log
 		debug = 4,
 	};
 
-	extern std::ofstream stream;
-	extern std::ostringstream linestream;
-	extern std::vector<std::string> lines;
+	extern std::atomic<int> s_max_level;
+
+	/// <summary>
+	/// Check whether messages of the specified level are written.
+	/// </summary>
+	inline bool is_enabled(level level) { return static_cast<int>(level) <= s_max_level.load(std::memory_order_relaxed); }
+	/// <summary>
+	/// Only write messages of the specified level and more severe ones from now on.
+	/// </summary>
+	void set_max_level(level level);
 
 	struct message
 	{
 		message(level level);
 		~message();
 
+		message(const message &) = delete;
+		message &operator=(const message &) = delete;
+
 		template <typename T>
 		inline message &operator<<(const T &value)
 		{
-			stream << value;
-			linestream << value;
+			_stream << value;
 			return *this;
 		}
 
@@ -56,8 +70,7 @@ namespace reshade::log
 
 		inline message &operator<<(const char *message)
 		{
-			stream << message;
-			linestream << message;
+			_stream << message;
 			return *this;
 		}
 		inline message &operator<<(const wchar_t *message)
@@ -67,11 +80,41 @@ namespace reshade::log
 			utf8::unchecked::utf16to8(message, message + wcslen(message), std::back_inserter(utf8_message));
 			return operator<<(utf8_message);
 		}
+
+	private:
+		// Formatting happens on a stream of the calling thread, so threads only ever meet at the queue the finished message is pushed to
+		// A message that is created while another one on the same thread is still being formatted, like from a function called in a stream expression, gets a stream of its own instead
+		std::unique_ptr<std::ostringstream> _nested_stream;
+		std::ostringstream &_stream;
+		const level _level;
+		uint64_t _time;
 	};
 
 	/// <summary>
-	/// Open a log file for writing.
+	/// Open a log file for writing and start the background thread that writes queued messages to it.
 	/// </summary>
 	/// <param name="path">The path to the log file.</param>
 	bool open(const filesystem::path &path);
+	/// <summary>
+	/// Write all queued messages to the log file on the calling thread, for when the background thread may no longer run, like during shutdown.
+	/// </summary>
+	void flush();
+	/// <summary>
+	/// Stop the background thread, wait for it to finish what it is writing and then write the remaining queued messages on the calling thread. For when the module is unloaded while the process keeps running.
+	/// </summary>
+	void close();
+
+	/// <summary>
+	/// Call a function for every message in the history, oldest first. The history keeps the most recent messages only.
+	/// </summary>
+	/// <param name="visitor">The function to call with each message, while the history is locked.</param>
+	void visit_history(const std::function<void(const std::string &)> &visitor);
+	/// <summary>
+	/// Get a number that changes whenever messages are added to or removed from the history, so copies of it only have to be updated then.
+	/// </summary>
+	size_t history_revision();
+	/// <summary>
+	/// Remove all messages from the history.
+	/// </summary>
+	void clear_history();
 }
@@ -3,10 +3,13 @@
  * License: https://github.com/crosire/reshade#license
  */
 
+#include "log.hpp"
 #include "opengl_runtime.hpp"
 #include "opengl_effect_compiler.hpp"
+#include "effect_reachability.hpp"
+#include "gpu_marker.hpp"
+#include "shader_cache.hpp"
 #include <assert.h>
-#include <iomanip>
 #include <fstream>
 #include <algorithm>
 
@@ -386,9 +389,9 @@ namespace reshade::opengl
 #endif
 	}
 
-	bool opengl_effect_compiler::run()
+	bool opengl_effect_compiler::compile()
 	{
-		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
+		_is_compiled = true;
 
 		for (auto node : _ast.structs)
 		{
@@ -397,6 +400,8 @@ namespace reshade::opengl
 
 		for (auto uniform : _ast.variables)
 		{
+			const auto code_begin = _global_code.size();
+
 			if (uniform->type.is_texture())
 			{
 				visit_texture(uniform);
@@ -405,6 +410,10 @@ namespace reshade::opengl
 			{
 				visit_sampler(uniform);
 			}
+			else if (uniform->type.is_storage() || uniform->type.has_qualifier(type_node::qualifier_groupshared))
+			{
+				error(uniform->location, "storage objects and 'groupshared' variables are not supported in OpenGL, check '__RENDERER__' to leave them out");
+			}
 			else if (uniform->type.has_qualifier(type_node::qualifier_uniform))
 			{
 				visit_uniform(uniform);
@@ -415,11 +424,13 @@ namespace reshade::opengl
 
 				_global_code << ";\n";
 			}
+
+			_global_declarations.push_back({ uniform, code_begin, _global_code.size() });
 		}
 
 		for (auto function : _ast.functions)
 		{
-			std::stringstream function_code;
+			code_buffer function_code;
 
 			_functions[_current_function = function];
 
@@ -428,6 +439,64 @@ namespace reshade::opengl
 			_functions[function].code = function_code.str();
 		}
 
+		for (auto technique : _ast.techniques)
+		{
+			for (auto pass : technique->pass_list)
+			{
+				compile_pass(pass);
+			}
+		}
+
+		_uniform_data.resize(_uniform_buffer_size);
+
+		return _success;
+	}
+	bool opengl_effect_compiler::run()
+	{
+		if (!_is_compiled)
+		{
+			compile();
+		}
+		if (!_success)
+		{
+			return false;
+		}
+
+		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
+		_sampler_first = _runtime->_effect_samplers.size();
+
+		for (auto variable : _ast.variables)
+		{
+			if (variable->type.is_texture())
+			{
+				create_texture(variable);
+			}
+			else if (variable->type.is_sampler())
+			{
+				create_sampler(variable);
+			}
+		}
+
+		if (!_success)
+		{
+			return false;
+		}
+
+		for (auto &obj : _uniforms)
+		{
+			obj.storage_offset += _uniform_storage_offset;
+
+			_runtime->add_uniform(std::move(obj));
+		}
+
+		if (_uniform_buffer_size != 0)
+		{
+			auto &uniform_storage = _runtime->get_uniform_value_storage();
+			uniform_storage.resize(_uniform_storage_offset + _uniform_buffer_size);
+
+			std::memcpy(uniform_storage.data() + _uniform_storage_offset, _uniform_data.data(), _uniform_buffer_size);
+		}
+
 		for (auto technique : _ast.techniques)
 		{
 			visit_technique(technique);
@@ -442,13 +511,52 @@ namespace reshade::opengl
 			glGetIntegerv(GL_UNIFORM_BUFFER_BINDING, &previous);
 
 			glBindBuffer(GL_UNIFORM_BUFFER, ubo);
-			glBufferData(GL_UNIFORM_BUFFER, _uniform_buffer_size, _runtime->get_uniform_value_storage().data() + _uniform_storage_offset, GL_DYNAMIC_DRAW);
+
+			opengl_uniform_buffer uniform_buffer = { ubo, static_cast<GLsizeiptr>(_uniform_buffer_size), nullptr, 0, 0 };
+
+			if (_runtime->_effect_ubo_persistent)
+			{
+				const GLsizeiptr alignment = std::max<GLsizeiptr>(_runtime->_effect_ubo_alignment, 1);
+				uniform_buffer.region_stride = (uniform_buffer.size + alignment - 1) / alignment * alignment;
+
+				const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glBufferStorage(GL_UNIFORM_BUFFER, uniform_buffer.region_stride * opengl_runtime::UNIFORM_BUFFER_REGIONS, nullptr, flags);
+				uniform_buffer.mapped_data = static_cast<uint8_t *>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, uniform_buffer.region_stride * opengl_runtime::UNIFORM_BUFFER_REGIONS, flags));
+
+				if (uniform_buffer.mapped_data == nullptr)
+				{
+					LOG(ERROR) << "Failed to map uniform buffer persistently. Falling back to uploading it through 'glBufferSubData'.";
+
+					// Storage of a buffer object is immutable once allocated, so start over with a new one
+					glDeleteBuffers(1, &ubo);
+					glGenBuffers(1, &ubo);
+					glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+
+					uniform_buffer.id = ubo;
+				}
+			}
+
+			// The first frame fills the region it uses, the others start out with these values too
+			if (uniform_buffer.mapped_data != nullptr)
+			{
+				for (unsigned int region = 0; region < opengl_runtime::UNIFORM_BUFFER_REGIONS; region++)
+				{
+					std::memcpy(uniform_buffer.mapped_data + region * uniform_buffer.region_stride, _runtime->get_uniform_value_storage().data() + _uniform_storage_offset, _uniform_buffer_size);
+				}
+			}
+			else
+			{
+				glBufferData(GL_UNIFORM_BUFFER, _uniform_buffer_size, _runtime->get_uniform_value_storage().data() + _uniform_storage_offset, GL_DYNAMIC_DRAW);
+			}
 
 			glBindBuffer(GL_UNIFORM_BUFFER, previous);
 
-			_runtime->_effect_ubos.emplace_back(ubo, _uniform_buffer_size);
+			_runtime->_effect_ubos.push_back(uniform_buffer);
 		}
 
+		// The state block saves and restores as many texture units as the largest effect binds
+		_runtime->_effect_sampler_count = std::max(_runtime->_effect_sampler_count, _sampler_count);
+
 		return _success;
 	}
 
@@ -463,7 +571,7 @@ namespace reshade::opengl
 		_errors += location.source + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): warning: " + message + '\n';
 	}
 
-	void opengl_effect_compiler::visit(std::stringstream &output, const statement_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const statement_node *node)
 	{
 		if (node == nullptr)
 		{
@@ -503,7 +611,7 @@ namespace reshade::opengl
 				assert(false);
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const expression_node *node)
 	{
 		assert(node != nullptr);
 
@@ -553,7 +661,7 @@ namespace reshade::opengl
 		}
 	}
 
-	void opengl_effect_compiler::visit(std::stringstream &output, const type_node &type, bool with_qualifiers, bool with_inout)
+	void opengl_effect_compiler::visit(code_buffer &output, const type_node &type, bool with_qualifiers, bool with_inout)
 	{
 		if (with_inout)
 		{
@@ -629,11 +737,11 @@ namespace reshade::opengl
 				break;
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const lvalue_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const lvalue_expression_node *node)
 	{
 		output << escape_name(node->reference->unique_name);
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const literal_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const literal_expression_node *node)
 	{
 		if (!node->type.is_scalar())
 		{
@@ -661,7 +769,7 @@ namespace reshade::opengl
 					output << node->value_uint[i] << 'u';
 					break;
 				case type_node::datatype_float:
-					output << std::setprecision(8) << std::fixed << node->value_float[i];
+					output << node->value_float[i];
 					break;
 			}
 
@@ -681,7 +789,7 @@ namespace reshade::opengl
 			output << ')';
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const expression_sequence_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const expression_sequence_node *node)
 	{
 		output << '(';
 
@@ -697,7 +805,7 @@ namespace reshade::opengl
 
 		output << ')';
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const unary_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const unary_expression_node *node)
 	{
 		switch (node->op)
 		{
@@ -754,7 +862,7 @@ namespace reshade::opengl
 				break;
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const binary_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const binary_expression_node *node)
 	{
 		const auto type1 = node->operands[0]->type;
 		const auto type2 = node->operands[1]->type;
@@ -951,7 +1059,7 @@ namespace reshade::opengl
 		visit(output, node->operands[1]);
 		output << part3;
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const intrinsic_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const intrinsic_expression_node *node)
 	{
 		type_node type1 = { type_node::datatype_void }, type2, type3, type4, type12;
 		std::pair<std::string, std::string> cast1, cast2, cast3, cast4, cast121, cast122;
@@ -1077,6 +1185,10 @@ namespace reshade::opengl
 				visit(output, node->arguments[1]);
 				output << cast2.second << ')';
 				break;
+			case intrinsic_expression_node::barrier:
+			case intrinsic_expression_node::texture_store:
+				error(node->location, "'" + std::string(node->op == intrinsic_expression_node::barrier ? "barrier" : "tex2Dstore") + "' is only supported in compute shaders, which OpenGL does not support");
+				break;
 			case intrinsic_expression_node::ceil:
 				output << "ceil(" << cast1.first;
 				visit(output, node->arguments[0]);
@@ -1547,7 +1659,7 @@ namespace reshade::opengl
 				break;
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const conditional_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const conditional_expression_node *node)
 	{
 		output<< '(';
 
@@ -1577,7 +1689,7 @@ namespace reshade::opengl
 		visit(output, node->expression_when_false);
 		output << cast2.second << ')';
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const swizzle_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const swizzle_expression_node *node)
 	{
 		visit(output, node->operand);
 
@@ -1608,13 +1720,13 @@ namespace reshade::opengl
 			}
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const field_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const field_expression_node *node)
 	{
 		output << '(';
 		visit(output, node->operand);
 		output << '.' << escape_name(node->field_reference->unique_name) << ')';
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const assignment_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const assignment_expression_node *node)
 	{
 		output << '(';
 		visit(output, node->left);
@@ -1663,7 +1775,7 @@ namespace reshade::opengl
 		visit(output, node->right);
 		output << cast.second << ')';
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const call_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const call_expression_node *node)
 	{
 		output << escape_name(node->callee->unique_name) << '(';
 
@@ -1700,7 +1812,7 @@ namespace reshade::opengl
 			info.dependencies.push_back(node->callee);
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const constructor_expression_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const constructor_expression_node *node)
 	{
 		if (node->type.is_matrix())
 		{
@@ -1727,11 +1839,11 @@ namespace reshade::opengl
 			output << ')';
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &, const initializer_list_node *)
+	void opengl_effect_compiler::visit(code_buffer &, const initializer_list_node *)
 	{
 		assert(false);
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const initializer_list_node *node, const type_node &type)
+	void opengl_effect_compiler::visit(code_buffer &output, const initializer_list_node *node, const type_node &type)
 	{
 		visit(output, type, false, false);
 
@@ -1762,7 +1874,7 @@ namespace reshade::opengl
 
 		output << ')';
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const compound_statement_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const compound_statement_node *node)
 	{
 		output << "{\n";
 
@@ -1773,7 +1885,7 @@ namespace reshade::opengl
 
 		output << "}\n";
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const declarator_list_node *node, bool single_statement)
+	void opengl_effect_compiler::visit(code_buffer &output, const declarator_list_node *node, bool single_statement)
 	{
 		bool with_type = true;
 
@@ -1793,13 +1905,13 @@ namespace reshade::opengl
 
 		output << ";\n";
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const expression_statement_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const expression_statement_node *node)
 	{
 		visit(output, node->expression);
 
 		output << ";\n";
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const if_statement_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const if_statement_node *node)
 	{
 		const type_node typeto = { type_node::datatype_bool, 0, 1, 1 };
 		const auto cast = write_cast(node->condition->type, typeto);
@@ -1826,7 +1938,7 @@ namespace reshade::opengl
 			visit(output, node->statement_when_false);
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const switch_statement_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const switch_statement_node *node)
 	{
 		output << "switch (";
 
@@ -1841,7 +1953,7 @@ namespace reshade::opengl
 
 		output << "}\n";
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const case_statement_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const case_statement_node *node)
 	{
 		for (auto label : node->labels)
 		{
@@ -1861,7 +1973,7 @@ namespace reshade::opengl
 
 		visit(output, node->statement_list);
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const for_statement_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const for_statement_node *node)
 	{
 		output << "for (";
 
@@ -1871,7 +1983,7 @@ namespace reshade::opengl
 			{
 				visit(output, static_cast<declarator_list_node *>(node->init_statement), true);
 
-				output.seekp(-2, std::ios_base::end);
+				output.pop_back(2);
 			}
 			else
 			{
@@ -1904,7 +2016,7 @@ namespace reshade::opengl
 			output << "\t;";
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const while_statement_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const while_statement_node *node)
 	{
 		if (node->is_do_while)
 		{
@@ -1939,7 +2051,7 @@ namespace reshade::opengl
 			}
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const return_statement_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const return_statement_node *node)
 	{
 		if (node->is_discard)
 		{
@@ -1963,7 +2075,7 @@ namespace reshade::opengl
 
 		output << ";\n";
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const jump_statement_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const jump_statement_node *node)
 	{
 		if (node->is_break)
 		{
@@ -1974,7 +2086,7 @@ namespace reshade::opengl
 			output << "continue;\n";
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const struct_declaration_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const struct_declaration_node *node)
 	{
 		output << "struct " << escape_name(node->unique_name) << "\n{\n";
 
@@ -1994,7 +2106,7 @@ namespace reshade::opengl
 
 		output << "};\n";
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const variable_declaration_node *node, bool with_type, bool with_qualifiers, bool with_inout)
+	void opengl_effect_compiler::visit(code_buffer &output, const variable_declaration_node *node, bool with_type, bool with_qualifiers, bool with_inout)
 	{
 		if (with_type)
 		{
@@ -2034,7 +2146,7 @@ namespace reshade::opengl
 			}
 		}
 	}
-	void opengl_effect_compiler::visit(std::stringstream &output, const function_declaration_node *node)
+	void opengl_effect_compiler::visit(code_buffer &output, const function_declaration_node *node)
 	{
 		_current_function = node;
 
@@ -2060,6 +2172,16 @@ namespace reshade::opengl
 	}
 
 	void opengl_effect_compiler::visit_texture(const variable_declaration_node *node)
+	{
+		// The texture itself needs the OpenGL context, so it is only added by 'create_texture'
+		if (!node->semantic.empty() &&
+			node->semantic != "COLOR" && node->semantic != "SV_TARGET" &&
+			node->semantic != "DEPTH" && node->semantic != "SV_DEPTH")
+		{
+			error(node->location, "invalid semantic");
+		}
+	}
+	void opengl_effect_compiler::create_texture(const variable_declaration_node *node)
 	{
 		const auto existing_texture = _runtime->find_texture(node->unique_name);
 
@@ -2081,7 +2203,7 @@ namespace reshade::opengl
 		const auto obj_data = obj.impl->as<opengl_tex_data>();
 		obj.name = node->name;
 		obj.unique_name = node->unique_name;
-		obj.annotations = node->annotation_list;
+		copy_annotations(node->annotation_list, obj.annotations);
 		GLuint width = obj.width = node->properties.width;
 		GLuint height = obj.height = node->properties.height;
 		GLuint levels = obj.levels = node->properties.levels;
@@ -2097,11 +2219,6 @@ namespace reshade::opengl
 		{
 			_runtime->update_texture_reference(obj, texture_reference::depth_buffer);
 		}
-		else if (!node->semantic.empty())
-		{
-			error(node->location, "invalid semantic");
-			return;
-		}
 		else
 		{
 			obj_data->should_delete = true;
@@ -2129,6 +2246,11 @@ namespace reshade::opengl
 		_runtime->add_texture(std::move(obj));
 	}
 	void opengl_effect_compiler::visit_sampler(const variable_declaration_node *node)
+	{
+		// The sampler objects are created by 'create_sampler' in the same order, so the binding matches the index in the runtime list minus '_sampler_first'
+		_global_code << "layout(binding = " << _sampler_count++ << ") uniform sampler2D " << escape_name(node->unique_name) << ";\n";
+	}
+	void opengl_effect_compiler::create_sampler(const variable_declaration_node *node)
 	{
 		const auto texture = _runtime->find_texture(node->properties.texture->unique_name);
 
@@ -2157,8 +2279,6 @@ namespace reshade::opengl
 		glSamplerParameterf(sampler.id, GL_TEXTURE_MIN_LOD, node->properties.min_lod);
 		glSamplerParameterf(sampler.id, GL_TEXTURE_MAX_LOD, node->properties.max_lod);
 
-		_global_code << "layout(binding = " << _runtime->_effect_samplers.size() << ") uniform sampler2D " << escape_name(node->unique_name) << ";\n";
-
 		_runtime->_effect_samplers.push_back(std::move(sampler));
 	}
 	void opengl_effect_compiler::visit_uniform(const variable_declaration_node *node)
@@ -2189,7 +2309,7 @@ namespace reshade::opengl
 		obj.columns = node->type.cols;
 		obj.elements = node->type.array_length;
 		obj.storage_size = obj.rows * obj.columns * std::max(1u, obj.elements) * 4;
-		obj.annotations = node->annotation_list;
+		copy_annotations(node->annotation_list, obj.annotations);
 
 		// GLSL specification on std140 layout:
 		// 1. If the member is a scalar consuming N basic machine units, the base alignment is N.
@@ -2201,36 +2321,27 @@ namespace reshade::opengl
 			alignment = alignment * 4 / 3;
 		}
 		_uniform_buffer_size = align(_uniform_buffer_size, alignment);
-		obj.storage_offset = _uniform_storage_offset + _uniform_buffer_size;
+		obj.storage_offset = _uniform_buffer_size;
 		_uniform_buffer_size += obj.storage_size;
 
-		auto &uniform_storage = _runtime->get_uniform_value_storage();
-
-		if (_uniform_storage_offset + _uniform_buffer_size >= static_cast<ptrdiff_t>(uniform_storage.size()))
-		{
-			uniform_storage.resize(uniform_storage.size() + 128);
-		}
+		_uniform_data.resize(_uniform_buffer_size);
 
 		if (node->initializer_expression != nullptr && node->initializer_expression->id == nodeid::literal_expression)
 		{
-			std::memcpy(uniform_storage.data() + obj.storage_offset, &static_cast<const literal_expression_node *>(node->initializer_expression)->value_float, obj.storage_size);
-		}
-		else
-		{
-			std::memset(uniform_storage.data() + obj.storage_offset, 0, obj.storage_size);
+			std::memcpy(_uniform_data.data() + obj.storage_offset, &static_cast<const literal_expression_node *>(node->initializer_expression)->value_float, obj.storage_size);
 		}
 
-		_runtime->add_uniform(std::move(obj));
+		_uniforms.push_back(std::move(obj));
 	}
 	void opengl_effect_compiler::visit_technique(const technique_declaration_node *node)
 	{
 		technique obj;
 		obj.impl = std::make_unique<opengl_technique_data>();
 		obj.name = node->name;
-		obj.annotations = node->annotation_list;
+		copy_annotations(node->annotation_list, obj.annotations);
 
 		const auto obj_data = obj.impl->as<opengl_technique_data>();
-		glGenQueries(1, &obj_data->query);
+		glGenQueries(opengl_technique_data::QUERY_COUNT, obj_data->queries);
 
 		if (_uniform_buffer_size != 0)
 		{
@@ -2238,16 +2349,45 @@ namespace reshade::opengl
 			obj.uniform_storage_offset = _uniform_storage_offset;
 		}
 
+		obj_data->sampler_first = static_cast<GLuint>(_sampler_first);
+		obj_data->sampler_count = static_cast<GLuint>(_sampler_count);
+
 		for (auto pass : node->pass_list)
 		{
 			obj.passes.emplace_back(std::make_unique<opengl_pass_data>());
-			visit_pass(pass, *static_cast<opengl_pass_data *>(obj.passes.back().get()));
+			auto &pass_data = *static_cast<opengl_pass_data *>(obj.passes.back().get());
+			visit_pass(pass, pass_data);
+			name_unnamed_pass(pass_data.name, obj.passes.size() - 1);
+
+			// Pixel shader passes without a render target draw to the back buffer
+			obj.writes_backbuffer |= pass->compute_shader == nullptr && pass->render_targets[0] == nullptr;
 		}
 
 		_runtime->add_technique(std::move(obj));
 	}
+	void opengl_effect_compiler::compile_pass(const pass_declaration_node *node)
+	{
+		if (node->compute_shader != nullptr)
+		{
+			error(node->location, "compute passes are not supported in OpenGL, check '__RENDERER__' to provide a pixel shader pass instead");
+			return;
+		}
+
+		const GLenum shader_types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+		const function_declaration_node *shader_functions[2] = { node->vertex_shader, node->pixel_shader };
+		compiled_pass &compiled = _compiled_passes[node];
+
+		for (unsigned int i = 0; i < 2; i++)
+		{
+			if (shader_functions[i] != nullptr)
+			{
+				visit_pass_shader(shader_functions[i], shader_types[i], compiled.sources[i]);
+			}
+		}
+	}
 	void opengl_effect_compiler::visit_pass(const pass_declaration_node *node, opengl_pass_data &pass)
 	{
+		pass.name = node->name;
 		pass.color_mask[0] = (node->color_write_mask & (1 << 0)) != 0;
 		pass.color_mask[1] = (node->color_write_mask & (1 << 1)) != 0;
 		pass.color_mask[2] = (node->color_write_mask & (1 << 2)) != 0;
@@ -2331,22 +2471,122 @@ namespace reshade::opengl
 
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-		GLuint shaders[2] = { 0, 0 };
-		GLenum shader_types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+		const std::string *const sources = _compiled_passes.at(node).sources;
+
+		// Program binaries are only valid for the driver that created them, and there may not be any binary formats at all
+		GLint binary_format_count = 0;
+
+		if (gl3wProcs.gl.ProgramBinary != nullptr)
+		{
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binary_format_count);
+		}
+
+		if (binary_format_count == 0)
+		{
+			link_pass_program(node, sources, pass);
+			return;
+		}
+
+		const std::string driver =
+			std::string(reinterpret_cast<const char *>(glGetString(GL_VENDOR))) + '\n' +
+			reinterpret_cast<const char *>(glGetString(GL_RENDERER)) + '\n' +
+			reinterpret_cast<const char *>(glGetString(GL_VERSION));
+		const unsigned long long cache_key = shader_cache::compute_program_key(sources, 2, driver);
+
+		// Cached programs start with the binary format they were retrieved in, followed by the binary itself
+		std::vector<char> cached_binary;
+		shader_cache::compile_lock lock;
+
+		if (shader_cache::load(cache_key, cached_binary) || (lock.acquire(cache_key) && shader_cache::load(cache_key, cached_binary)))
+		{
+			if (cached_binary.size() > sizeof(GLenum))
+			{
+				GLenum binary_format;
+				std::memcpy(&binary_format, cached_binary.data(), sizeof(binary_format));
+
+				pass.program = glCreateProgram();
+				glProgramBinary(pass.program, binary_format, cached_binary.data() + sizeof(binary_format), static_cast<GLsizei>(cached_binary.size() - sizeof(binary_format)));
+
+				GLint status = GL_FALSE;
+				glGetProgramiv(pass.program, GL_LINK_STATUS, &status);
+
+				if (status != GL_FALSE)
+				{
+					return;
+				}
+
+				// The driver rejects binaries of other driver versions despite the key, or after it was updated in place, so link from source again like on a cold load
+				glDeleteProgram(pass.program);
+				pass.program = 0;
+			}
+		}
+
+		if (!link_pass_program(node, sources, pass))
+		{
+			return;
+		}
+
+		GLint binary_size = 0;
+		glGetProgramiv(pass.program, GL_PROGRAM_BINARY_LENGTH, &binary_size);
+
+		if (binary_size != 0)
+		{
+			std::vector<char> binary(sizeof(GLenum) + binary_size);
+
+			GLenum binary_format = GL_NONE;
+			glGetProgramBinary(pass.program, binary_size, nullptr, &binary_format, binary.data() + sizeof(binary_format));
+			std::memcpy(binary.data(), &binary_format, sizeof(binary_format));
+
+			if (glGetError() == GL_NO_ERROR)
+			{
+				shader_cache::save(cache_key, binary.data(), binary.size());
+			}
+		}
+	}
+	bool opengl_effect_compiler::link_pass_program(const pass_declaration_node *node, const std::string *sources, opengl_pass_data &pass)
+	{
+		const GLenum shader_types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
 		const function_declaration_node *shader_functions[2] = { node->vertex_shader, node->pixel_shader };
+		GLuint shaders[2] = { 0, 0 };
 
 		pass.program = glCreateProgram();
 
+		// Ask the driver to keep the binary around, so it can be stored in the cache after linking
+		if (gl3wProcs.gl.ProgramParameteri != nullptr)
+		{
+			glProgramParameteri(pass.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+
 		for (unsigned int i = 0; i < 2; i++)
 		{
-			if (shader_functions[i] != nullptr)
+			if (shader_functions[i] == nullptr)
+			{
+				continue;
+			}
+
+			shaders[i] = glCreateShader(shader_types[i]);
+
+			GLint status = GL_FALSE;
+			const GLchar *src = sources[i].c_str();
+			const GLsizei len = static_cast<GLsizei>(sources[i].size());
+
+			glShaderSource(shaders[i], 1, &src, &len);
+			glCompileShader(shaders[i]);
+			glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &status);
+
+			if (status == GL_FALSE)
 			{
-				shaders[i] = glCreateShader(shader_types[i]);
+				GLint logsize = 0;
+				glGetShaderiv(shaders[i], GL_INFO_LOG_LENGTH, &logsize);
 
-				visit_pass_shader(shader_functions[i], shader_types[i], shaders[i]);
+				std::string log(logsize, '\0');
+				glGetShaderInfoLog(shaders[i], logsize, nullptr, &log.front());
 
-				glAttachShader(pass.program, shaders[i]);
+				_errors += log;
+				error(shader_functions[i]->location, "internal shader compilation failed");
 			}
+
+			glAttachShader(pass.program, shaders[i]);
 		}
 
 		glLinkProgram(pass.program);
@@ -2374,12 +2614,14 @@ namespace reshade::opengl
 
 			_errors += log;
 			error(node->location, "program linking failed");
-			return;
+			return false;
 		}
+
+		return true;
 	}
-	void opengl_effect_compiler::visit_pass_shader(const function_declaration_node *node, unsigned int shadertype, unsigned int &shader)
+	void opengl_effect_compiler::visit_pass_shader(const function_declaration_node *node, unsigned int shadertype, std::string &source_str)
 	{
-		std::stringstream source;
+		code_buffer source(_global_code.size() + 16 * 1024);
 
 		source <<
 			"#version 430\n"
@@ -2408,7 +2650,10 @@ namespace reshade::opengl
 			source << "#define discard\n";
 		}
 
-		source << _global_code.str();
+		reachable_declarations reachable;
+		find_reachable_declarations(node, reachable);
+
+		source << reachable_global_code(_global_code.str(), _global_declarations, reachable);
 
 		for (auto dependency : _functions.at(node).dependencies)
 		{
@@ -2642,10 +2887,7 @@ namespace reshade::opengl
 
 		source << "}\n";
 
-		GLint status = GL_FALSE;
-		const std::string source_str = source.str();
-		const GLchar *src = source_str.c_str();
-		const GLsizei len = static_cast<GLsizei>(source_str.size());
+		source_str = source.str();
 
 #if RESHADE_DUMP_NATIVE_SHADERS
 		if (!_dumped_shaders.count(node->unique_name))
@@ -2660,24 +2902,8 @@ namespace reshade::opengl
 			}
 		}
 #endif
-
-		glShaderSource(shader, 1, &src, &len);
-		glCompileShader(shader);
-		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-
-		if (status == GL_FALSE)
-		{
-			GLint logsize = 0;
-			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logsize);
-
-			std::string log(logsize, '\0');
-			glGetShaderInfoLog(shader, logsize, nullptr, &log.front());
-
-			_errors += log;
-			error(node->location, "internal shader compilation failed");
-		}
 	}
-	void opengl_effect_compiler::visit_shader_param(std::stringstream &output, type_node type, unsigned int qualifier, const std::string &name, const std::string &semantic, unsigned int shadertype)
+	void opengl_effect_compiler::visit_shader_param(code_buffer &output, type_node type, unsigned int qualifier, const std::string &name, const std::string &semantic, unsigned int shadertype)
 	{
 		type.qualifiers = static_cast<unsigned int>(qualifier);
 
@@ -6,7 +6,10 @@
 #pragma once
 
 #include "effect_syntax_tree.hpp"
-#include <sstream>
+#include "effect_code_buffer.hpp"
+#include "effect_reachability.hpp"
+#include "runtime_objects.hpp"
+#include <unordered_map>
 #include <unordered_set>
 
 namespace reshade::opengl
@@ -16,55 +19,74 @@ namespace reshade::opengl
 	class opengl_runtime;
 	#pragma endregion
 
-	class opengl_effect_compiler
+	class opengl_effect_compiler : public base_object
 	{
 	public:
 		opengl_effect_compiler(opengl_runtime *runtime, const reshadefx::syntax_tree &ast, std::string &errors);
 
+		/// <summary>
+		/// Generate the GLSL code of the effect. This makes no OpenGL calls, so it can run on a compile worker thread.
+		/// </summary>
+		bool compile();
+		/// <summary>
+		/// Create the textures, samplers, programs and uniform buffer of the effect and add it to the runtime on the thread that owns the OpenGL context. Calls <see cref="compile"/> first if that did not happen yet.
+		/// </summary>
 		bool run();
 
 	private:
+		// GLSL source of the vertex and fragment shader of a pass
+		struct compiled_pass
+		{
+			std::string sources[2];
+		};
+
 		void error(const reshadefx::location &location, const std::string &message);
 		void warning(const reshadefx::location &location, const std::string &message);
 
-		void visit(std::stringstream &output, const reshadefx::nodes::statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::type_node &type, bool with_qualifiers, bool with_inout);
-		void visit(std::stringstream &output, const reshadefx::nodes::lvalue_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::literal_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_sequence_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::unary_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::binary_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::intrinsic_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::conditional_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::swizzle_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::field_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::assignment_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::call_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::constructor_expression_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::initializer_list_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::initializer_list_node *node, const reshadefx::nodes::type_node &type);
-		void visit(std::stringstream &output, const reshadefx::nodes::compound_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::declarator_list_node *node, bool single_statement = false);
-		void visit(std::stringstream &output, const reshadefx::nodes::expression_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::if_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::switch_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::case_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::for_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::while_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::return_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::jump_statement_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::struct_declaration_node *node);
-		void visit(std::stringstream &output, const reshadefx::nodes::variable_declaration_node *node, bool with_type, bool with_qualifiers, bool with_inout);
-		void visit(std::stringstream &output, const reshadefx::nodes::function_declaration_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::type_node &type, bool with_qualifiers, bool with_inout);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::lvalue_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::literal_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_sequence_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::unary_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::binary_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::intrinsic_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::conditional_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::swizzle_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::field_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::assignment_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::call_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::constructor_expression_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::initializer_list_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::initializer_list_node *node, const reshadefx::nodes::type_node &type);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::compound_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::declarator_list_node *node, bool single_statement = false);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::expression_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::if_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::switch_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::case_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::for_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::while_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::return_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::jump_statement_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::struct_declaration_node *node);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::variable_declaration_node *node, bool with_type, bool with_qualifiers, bool with_inout);
+		void visit(reshadefx::code_buffer &output, const reshadefx::nodes::function_declaration_node *node);
 
 		void visit_texture(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_sampler(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_uniform(const reshadefx::nodes::variable_declaration_node *node);
+		void compile_pass(const reshadefx::nodes::pass_declaration_node *node);
+
+		void create_texture(const reshadefx::nodes::variable_declaration_node *node);
+		void create_sampler(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_technique(const reshadefx::nodes::technique_declaration_node *node);
 		void visit_pass(const reshadefx::nodes::pass_declaration_node *node, opengl_pass_data &pass);
-		void visit_pass_shader(const reshadefx::nodes::function_declaration_node *node, unsigned int shadertype, unsigned int &shader);
-		void visit_shader_param(std::stringstream &output, reshadefx::nodes::type_node type, unsigned int qualifier, const std::string &name, const std::string &semantic, unsigned int shadertype);
+		void visit_pass_shader(const reshadefx::nodes::function_declaration_node *node, unsigned int shadertype, std::string &source);
+		bool link_pass_program(const reshadefx::nodes::pass_declaration_node *node, const std::string *sources, opengl_pass_data &pass);
+
+		void visit_shader_param(reshadefx::code_buffer &output, reshadefx::nodes::type_node type, unsigned int qualifier, const std::string &name, const std::string &semantic, unsigned int shadertype);
 
 		struct function
 		{
@@ -73,13 +95,21 @@ namespace reshade::opengl
 		};
 
 		opengl_runtime *_runtime;
-		bool _success;
+		bool _success, _is_compiled = false;
 		const reshadefx::syntax_tree &_ast;
 		std::string &_errors;
-		std::stringstream _global_code, _global_uniforms;
+		reshadefx::code_buffer _global_code, _global_uniforms;
+		// Parts of the global code that belong to a single variable or function, so each shader can leave out those it does not reference
+		std::vector<reshadefx::global_declaration> _global_declarations;
 		const reshadefx::nodes::function_declaration_node *_current_function;
 		std::unordered_map<const reshadefx::nodes::function_declaration_node *, function> _functions;
 		GLintptr _uniform_storage_offset = 0, _uniform_buffer_size = 0;
+		// Texture units are numbered from zero for every effect, the samplers of the effect start at this index in the runtime list
+		size_t _sampler_first = 0, _sampler_count = 0;
+		// Uniforms with offsets relative to the start of the effect, and their initial values, which are added to the runtime storage by <see cref="run"/>
+		std::vector<uniform> _uniforms;
+		std::vector<unsigned char> _uniform_data;
+		std::unordered_map<const reshadefx::nodes::pass_declaration_node *, compiled_pass> _compiled_passes;
 #if RESHADE_DUMP_NATIVE_SHADERS
 		filesystem::path _dump_filename;
 		std::unordered_set<std::string> _dumped_shaders;
@@ -9,9 +9,37 @@
 #include "input.hpp"
 #include <imgui.h>
 #include <assert.h>
+#include <algorithm>
 
 namespace reshade::opengl
 {
+	/// <summary>
+	/// Labels the commands recorded during its lifetime for RenderDoc, Nsight and other GPU debuggers, while GPU markers are enabled.
+	/// </summary>
+	class gpu_marker
+	{
+	public:
+		gpu_marker(bool enabled, const std::string &name) :
+			// Debug groups are core in OpenGL 4.3, older contexts only have them through KHR_debug, if at all
+			_enabled(enabled && gl3wProcs.gl.PushDebugGroup != nullptr && gl3wProcs.gl.PopDebugGroup != nullptr)
+		{
+			if (_enabled)
+			{
+				glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, static_cast<GLsizei>(name.size()), name.c_str());
+			}
+		}
+		~gpu_marker()
+		{
+			if (_enabled)
+			{
+				glPopDebugGroup();
+			}
+		}
+
+	private:
+		const bool _enabled;
+	};
+
 	static GLenum target_to_binding(GLenum target)
 	{
 		switch (target)
@@ -234,6 +262,10 @@ namespace reshade::opengl
 
 		glGenVertexArrays(1, &_default_vao);
 
+		// Buffer storage is core since OpenGL 4.4, older contexts upload uniforms through 'glBufferSubData'
+		_effect_ubo_persistent = gl3wIsSupported(4, 4) != 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &_effect_ubo_alignment);
+
 		return true;
 	}
 	bool opengl_runtime::init_imgui_resources()
@@ -285,6 +317,9 @@ namespace reshade::opengl
 
 		glGenBuffers(2, _imgui_vbo);
 
+		// Buffer storage is core since OpenGL 4.4, older contexts fall back to orphaning the buffers every frame
+		_imgui_persistent_buffers = gl3wIsSupported(4, 4) != 0;
+
 		glGenVertexArrays(1, &_imgui_vao);
 		glBindVertexArray(_imgui_vao);
 		glBindBuffer(GL_ARRAY_BUFFER, _imgui_vbo[0]);
@@ -326,7 +361,11 @@ namespace reshade::opengl
 		_width = width;
 		_height = height;
 
-		_stateblock.capture();
+		// The hooks only see binds from here on, so start off with what is bound right now
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, reinterpret_cast<GLint *>(&_current_draw_fbo));
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, reinterpret_cast<GLint *>(&_current_read_fbo));
+
+		_stateblock.capture(static_cast<GLuint>(_effect_sampler_count));
 
 		// Clear errors
 		glGetError();
@@ -367,6 +406,17 @@ namespace reshade::opengl
 		glDeleteBuffers(2, _imgui_vbo);
 		glDeleteProgram(_imgui_shader_program);
 
+		for (GLsync &fence : _imgui_buffer_fences)
+		{
+			glDeleteSync(fence);
+			fence = 0;
+		}
+		for (GLsync &fence : _effect_ubo_fences)
+		{
+			glDeleteSync(fence);
+			fence = 0;
+		}
+
 		_default_vao = 0;
 		_default_backbuffer_fbo = 0;
 		_depth_source_fbo = 0;
@@ -378,6 +428,9 @@ namespace reshade::opengl
 		_depth_texture = 0;
 		_imgui_shader_program = 0;
 		_imgui_vao = _imgui_vbo[0] = _imgui_vbo[1] = 0;
+		_imgui_buffer_data[0] = _imgui_buffer_data[1] = nullptr;
+		_imgui_vertex_buffer_size = _imgui_index_buffer_size = 0;
+		_imgui_buffer_region = 0;
 
 		_depth_source = 0;
 	}
@@ -391,10 +444,12 @@ namespace reshade::opengl
 		}
 
 		_effect_samplers.clear();
+		_effect_sampler_count = 0;
 
+		// Deleting a mapped buffer unmaps it, and the driver keeps the storage alive while previous draw calls still use it
 		for (auto &uniform_buffer : _effect_ubos)
 		{
-			glDeleteBuffers(1, &uniform_buffer.first);
+			glDeleteBuffers(1, &uniform_buffer.id);
 		}
 
 		_effect_ubos.clear();
@@ -411,18 +466,55 @@ namespace reshade::opengl
 		{
 			opengl_technique_data &technique_data = *technique.impl->as<opengl_technique_data>();
 
-			if (technique.enabled && technique_data.query_in_flight)
+			// Queries complete in the order they were issued, so stop at the first one that is not done yet instead of waiting for it
+			while (technique_data.queries_evaluated != technique_data.queries_issued)
 			{
+				const GLuint query = technique_data.queries[technique_data.queries_evaluated % opengl_technique_data::QUERY_COUNT];
+
+				GLuint available = GL_FALSE;
+				glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+				if (available == GL_FALSE)
+				{
+					break;
+				}
+
 				GLuint64 elapsed_time = 0;
-				glGetQueryObjectui64v(technique_data.query, GL_QUERY_RESULT, &elapsed_time);
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed_time);
+
+				if (technique.timings != nullptr)
+				{
+					technique.timings->average_gpu_duration.append(elapsed_time);
+					technique.timings->gpu_duration_samples.append(elapsed_time * 1e-6f);
+				}
 
-				technique.average_gpu_duration.append(elapsed_time);
-				technique_data.query_in_flight = false;
+				const unsigned int query_index = technique_data.queries_evaluated % opengl_technique_data::QUERY_COUNT;
+
+				// The timestamps were all taken before the end of the elapsed time query, so reading them does not wait, unless a query could not be created for every pass
+				if (_gpu_pass_timing && technique_data.pass_query_counts[query_index] == technique.passes.size() + 1)
+				{
+					const std::vector<GLuint> &timestamps = technique_data.pass_queries[query_index];
+
+					GLuint64 previous_timestamp = 0;
+					glGetQueryObjectui64v(timestamps[0], GL_QUERY_RESULT, &previous_timestamp);
+
+					for (size_t pass_index = 0; pass_index < technique.passes.size(); pass_index++)
+					{
+						GLuint64 timestamp = 0;
+						glGetQueryObjectui64v(timestamps[pass_index + 1], GL_QUERY_RESULT, &timestamp);
+
+						append_pass_gpu_duration(technique, pass_index, technique.passes[pass_index]->as<opengl_pass_data>()->name, timestamp - previous_timestamp);
+
+						previous_timestamp = timestamp;
+					}
+				}
+
+				technique_data.queries_evaluated++;
 			}
 		}
 
 		// Capture states
-		_stateblock.capture();
+		_stateblock.capture(static_cast<GLuint>(_effect_sampler_count));
 
 		// Copy frame buffer
 		glDisable(GL_SCISSOR_TEST);
@@ -454,22 +546,30 @@ namespace reshade::opengl
 			// Setup vertex input
 			glBindVertexArray(_default_vao);
 
-			// Setup shader resources
-			for (GLsizei i = 0; i < static_cast<GLsizei>(_effect_samplers.size()); i++)
-			{
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(GL_TEXTURE_2D, _effect_samplers[i].texture->id[_effect_samplers[i].is_srgb]);
-				glBindSampler(i, _effect_samplers[i].id);
-			}
-
 			// Setup global states
 			glDisable(GL_CULL_FACE);
 			glDisable(GL_DEPTH_TEST);
 			glFrontFace(GL_CCW);
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
+			// Wait until the GPU is done with the frame that used this uniform buffer region before, which usually finished long ago
+			if (GLsync &fence = _effect_ubo_fences[_effect_ubo_region]; fence != 0)
+			{
+				glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+				glDeleteSync(fence);
+				fence = 0;
+			}
+
 			// Apply post processing
 			on_present_effect();
+
+			if (_effect_ubo_persistent)
+			{
+				_effect_ubo_fences[_effect_ubo_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				_effect_ubo_region = (_effect_ubo_region + 1) % UNIFORM_BUFFER_REGIONS;
+			}
+
+			_effect_ubo_frame++;
 		}
 
 		// Reset render target and copy to frame buffer
@@ -487,6 +587,9 @@ namespace reshade::opengl
 		// Apply states
 		_stateblock.apply();
 
+		// Applying the state block bound what was bound for drawing to both targets
+		_current_read_fbo = _current_draw_fbo;
+
 		if (gl3wProcs.gl.ClipControl != nullptr
 			&& (clip_origin != GL_LOWER_LEFT || clip_depthmode != GL_ZERO_TO_ONE))
 		{
@@ -498,24 +601,21 @@ namespace reshade::opengl
 		_vertices += vertices;
 		_drawcalls += 1;
 
-		GLint fbo = 0, object = 0, objecttarget = GL_NONE;
-		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fbo);
+		GLuint id = 0;
 
-		if (fbo != 0)
+		if (_current_draw_fbo != 0)
 		{
-			glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &objecttarget);
+			const auto attachment = _depth_attachment_per_fbo.find(_current_draw_fbo);
 
-			if (objecttarget == GL_NONE)
+			if (attachment == _depth_attachment_per_fbo.end() || attachment->second == 0)
 			{
 				return;
 			}
-			else
-			{
-				glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &object);
-			}
+
+			id = attachment->second;
 		}
 
-		const auto it = _depth_source_table.find(object | (objecttarget == GL_RENDERBUFFER ? 0x80000000 : 0));
+		const auto it = _depth_source_table.find(id);
 
 		if (it != _depth_source_table.end())
 		{
@@ -525,25 +625,24 @@ namespace reshade::opengl
 	}
 	void opengl_runtime::on_fbo_attachment(GLenum target, GLenum attachment, GLenum objecttarget, GLuint object, GLint level)
 	{
-		if (object == 0 || (attachment != GL_DEPTH_ATTACHMENT && attachment != GL_DEPTH_STENCIL_ATTACHMENT))
+		if (attachment != GL_DEPTH_ATTACHMENT && attachment != GL_DEPTH_STENCIL_ATTACHMENT)
 		{
 			return;
 		}
 
 		// Get current frame buffer
-		GLint fbo = 0;
-		glGetIntegerv(target_to_binding(target), &fbo);
-
-		assert(fbo != 0);
+		const GLuint fbo = target == GL_READ_FRAMEBUFFER ? _current_read_fbo : _current_draw_fbo;
 
-		if (static_cast<GLuint>(fbo) == _default_backbuffer_fbo || static_cast<GLuint>(fbo) == _depth_source_fbo || static_cast<GLuint>(fbo) == _blit_fbo)
+		if (fbo == 0 || fbo == _default_backbuffer_fbo || fbo == _depth_source_fbo || fbo == _blit_fbo)
 		{
 			return;
 		}
 
-		const GLuint id = object | (objecttarget == GL_RENDERBUFFER ? 0x80000000 : 0);
-		
-		if (_depth_source_table.find(id) != _depth_source_table.end())
+		const GLuint id = object == 0 ? 0 : object | (objecttarget == GL_RENDERBUFFER ? 0x80000000 : 0);
+
+		_depth_attachment_per_fbo[fbo] = id;
+
+		if (id == 0 || _depth_source_table.find(id) != _depth_source_table.end())
 		{
 			return;
 		}
@@ -586,6 +685,35 @@ namespace reshade::opengl
 		_depth_source_table.emplace(id, info);
 	}
 
+	void opengl_runtime::on_bind_fbo(GLenum target, GLuint fbo)
+	{
+		if (target != GL_READ_FRAMEBUFFER)
+		{
+			_current_draw_fbo = fbo;
+		}
+		if (target != GL_DRAW_FRAMEBUFFER)
+		{
+			_current_read_fbo = fbo;
+		}
+	}
+	void opengl_runtime::on_delete_fbos(GLsizei count, const GLuint *fbos)
+	{
+		for (GLsizei i = 0; i < count; ++i)
+		{
+			_depth_attachment_per_fbo.erase(fbos[i]);
+
+			// Deleting a bound frame buffer reverts the binding to the default one
+			if (fbos[i] == _current_draw_fbo)
+			{
+				_current_draw_fbo = 0;
+			}
+			if (fbos[i] == _current_read_fbo)
+			{
+				_current_read_fbo = 0;
+			}
+		}
+	}
+
 	void opengl_runtime::capture_frame(uint8_t *buffer) const
 	{
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
@@ -612,9 +740,15 @@ namespace reshade::opengl
 			}
 		}
 	}
-	bool opengl_runtime::load_effect(const reshadefx::syntax_tree &ast, std::string &errors)
+	std::unique_ptr<base_object> opengl_runtime::compile_effect(const reshadefx::syntax_tree &ast, std::string &errors, bool)
+	{
+		auto compiler = std::make_unique<opengl_effect_compiler>(this, ast, errors);
+		compiler->compile();
+		return compiler;
+	}
+	bool opengl_runtime::load_effect(base_object &module)
 	{
-		return opengl_effect_compiler(this, ast, errors).run();
+		return module.as<opengl_effect_compiler>()->run();
 	}
 	bool opengl_runtime::update_texture(texture &texture, const uint8_t *data)
 	{
@@ -709,26 +843,80 @@ namespace reshade::opengl
 
 	void opengl_runtime::render_technique(const technique &technique)
 	{
+		const gpu_marker technique_marker(_gpu_markers, technique.name);
+
 		opengl_technique_data &technique_data = *technique.impl->as<opengl_technique_data>();
 
-		if (!technique_data.query_in_flight)
-			glBeginQuery(GL_TIME_ELAPSED, technique_data.query);
+		// Skip timing this frame if all queries are still waiting on the GPU
+		const bool is_query_available = technique_data.queries_issued - technique_data.queries_evaluated < opengl_technique_data::QUERY_COUNT;
+
+		const bool issue_pass_queries = is_query_available && _gpu_pass_timing;
+
+		if (is_query_available)
+		{
+			glBeginQuery(GL_TIME_ELAPSED, technique_data.queries[technique_data.queries_issued % opengl_technique_data::QUERY_COUNT]);
+
+			technique_data.pass_query_counts[technique_data.queries_issued % opengl_technique_data::QUERY_COUNT] = 0;
+		}
+
+		if (issue_pass_queries)
+		{
+			issue_pass_timestamp_query(technique_data);
+		}
 
 		// Clear depth stencil
 		glBindFramebuffer(GL_FRAMEBUFFER, _default_backbuffer_fbo);
 		glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
 
+		// Setup shader resources, the texture units are numbered from zero for every effect
+		for (GLuint i = 0; i < technique_data.sampler_count; i++)
+		{
+			const opengl_sampler &sampler = _effect_samplers[technique_data.sampler_first + i];
+
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, sampler.texture->id[sampler.is_srgb]);
+			glBindSampler(i, sampler.id);
+		}
+
 		// Setup shader constants
 		if (technique.uniform_storage_index >= 0)
 		{
-			glBindBufferBase(GL_UNIFORM_BUFFER, 0, _effect_ubos[technique.uniform_storage_index].first);
-			glBufferSubData(GL_UNIFORM_BUFFER, 0, _effect_ubos[technique.uniform_storage_index].second, get_uniform_value_storage().data() + technique.uniform_storage_offset);
+			opengl_uniform_buffer &uniform_buffer = _effect_ubos[technique.uniform_storage_index];
+
+			// Uniform buffers keep their contents, so only upload the part that changed
+			size_t dirty_offset, dirty_size;
+			const bool is_dirty = consume_uniform_changes(static_cast<size_t>(technique.uniform_storage_offset), static_cast<size_t>(uniform_buffer.size), dirty_offset, dirty_size);
+
+			if (uniform_buffer.mapped_data != nullptr)
+			{
+				const GLintptr region_offset = _effect_ubo_region * uniform_buffer.region_stride;
+
+				// The region was last written some frames ago, so it needs all of the current values and not just the changed ones, which is a plain copy into coherent memory
+				if (uniform_buffer.written_frame != _effect_ubo_frame)
+				{
+					std::memcpy(uniform_buffer.mapped_data + region_offset, get_uniform_value_storage().data() + technique.uniform_storage_offset, uniform_buffer.size);
+					uniform_buffer.written_frame = _effect_ubo_frame;
+				}
+
+				glBindBufferRange(GL_UNIFORM_BUFFER, 0, uniform_buffer.id, region_offset, uniform_buffer.size);
+			}
+			else
+			{
+				glBindBufferBase(GL_UNIFORM_BUFFER, 0, uniform_buffer.id);
+
+				if (is_dirty)
+				{
+					glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(dirty_offset - technique.uniform_storage_offset), static_cast<GLsizeiptr>(dirty_size), get_uniform_value_storage().data() + dirty_offset);
+				}
+			}
 		}
 
 		for (const auto &pass_object : technique.passes)
 		{
 			const opengl_pass_data &pass = *pass_object->as<opengl_pass_data>();
 
+			const gpu_marker pass_marker(_gpu_markers, pass.name);
+
 			// Save frame buffer of previous pass
 			glDisable(GL_FRAMEBUFFER_SRGB);
 			glBindFramebuffer(GL_READ_FRAMEBUFFER, _default_backbuffer_fbo);
@@ -799,24 +987,61 @@ namespace reshade::opengl
 			_drawcalls += 1;
 
 			// Update shader resources
+			bool is_unit_zero_changed = false;
+
 			for (GLuint texture_id : pass.draw_textures)
 			{
-				for (GLsizei i = 0; i < static_cast<GLsizei>(_effect_samplers.size()); i++)
+				// Textures are shared between effects, so the samplers of all of them decide whether a render target needs mipmaps
+				if (texture_id == 0 || std::none_of(_effect_samplers.begin(), _effect_samplers.end(), [texture_id](const opengl_sampler &sampler) {
+						return sampler.has_mipmaps && (sampler.texture->id[0] == texture_id || sampler.texture->id[1] == texture_id);
+					}))
 				{
-					const auto texture = _effect_samplers[i].texture;
-
-					if (_effect_samplers[i].has_mipmaps && (texture->id[0] == texture_id || texture->id[1] == texture_id))
-					{
-						glActiveTexture(GL_TEXTURE0 + i);
-						glGenerateMipmap(GL_TEXTURE_2D);
-					}
+					continue;
 				}
+
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, texture_id);
+				glGenerateMipmap(GL_TEXTURE_2D);
+
+				is_unit_zero_changed = true;
+			}
+
+			// Put back what the next pass of the technique samples from the unit that was borrowed above
+			if (is_unit_zero_changed && technique_data.sampler_count != 0)
+			{
+				const opengl_sampler &sampler = _effect_samplers[technique_data.sampler_first];
+
+				glBindTexture(GL_TEXTURE_2D, sampler.texture->id[sampler.is_srgb]);
+			}
+
+			if (issue_pass_queries)
+			{
+				issue_pass_timestamp_query(technique_data);
 			}
 		}
 
-		if (!technique_data.query_in_flight)
+		if (is_query_available)
+		{
 			glEndQuery(GL_TIME_ELAPSED);
-		technique_data.query_in_flight = true;
+			technique_data.queries_issued++;
+		}
+	}
+	void opengl_runtime::issue_pass_timestamp_query(opengl_technique_data &technique_data)
+	{
+		const unsigned int query_index = technique_data.queries_issued % opengl_technique_data::QUERY_COUNT;
+
+		std::vector<GLuint> &timestamps = technique_data.pass_queries[query_index];
+		size_t &count = technique_data.pass_query_counts[query_index];
+
+		if (count == timestamps.size())
+		{
+			GLuint query = 0;
+			glGenQueries(1, &query);
+
+			timestamps.push_back(query);
+		}
+
+		glQueryCounter(timestamps[count++], GL_TIMESTAMP);
 	}
 	void opengl_runtime::render_imgui_draw_data(ImDrawData *draw_data)
 	{
@@ -842,19 +1067,120 @@ namespace reshade::opengl
 		glUniform1i(_imgui_attribloc_tex, 0);
 		glUniformMatrix4fv(_imgui_attribloc_projmtx, 1, GL_FALSE, ortho_projection);
 
-		// Render command lists
-		for (int n = 0; n < draw_data->CmdListsCount; n++)
+		// Upload all command lists of the frame at once
+		GLint vtx_offset = 0, idx_offset = 0;
+
+		if (_imgui_persistent_buffers)
 		{
-			const ImDrawIdx *idx_buffer_offset = 0;
-			ImDrawList *const cmd_list = draw_data->CmdLists[n];
+			// Create and grow buffers if needed, storage is immutable, so this has to replace the buffer objects and point the vertex array at the new ones
+			if (_imgui_buffer_data[0] == nullptr ||
+				_imgui_vertex_buffer_size < draw_data->TotalVtxCount ||
+				_imgui_index_buffer_size < draw_data->TotalIdxCount)
+			{
+				for (GLsync &fence : _imgui_buffer_fences)
+				{
+					glDeleteSync(fence);
+					fence = 0;
+				}
 
-			glBindBuffer(GL_ARRAY_BUFFER, _imgui_vbo[0]);
-			glBufferData(GL_ARRAY_BUFFER, cmd_list->VtxBuffer.size() * sizeof(ImDrawVert), &cmd_list->VtxBuffer.front(), GL_STREAM_DRAW);
+				// Deleting a mapped buffer unmaps it, and the driver keeps the storage alive while previous draw calls still use it
+				glDeleteBuffers(2, _imgui_vbo);
+				glGenBuffers(2, _imgui_vbo);
+
+				_imgui_vertex_buffer_size = std::max(_imgui_vertex_buffer_size, draw_data->TotalVtxCount + 5000);
+				_imgui_index_buffer_size = std::max(_imgui_index_buffer_size, draw_data->TotalIdxCount + 10000);
+				_imgui_buffer_region = 0;
+
+				const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				const GLsizeiptr vertex_buffer_bytes = _imgui_vertex_buffer_size * IMGUI_BUFFER_REGIONS * sizeof(ImDrawVert);
+				const GLsizeiptr index_buffer_bytes = _imgui_index_buffer_size * IMGUI_BUFFER_REGIONS * sizeof(ImDrawIdx);
+
+				glBindBuffer(GL_ARRAY_BUFFER, _imgui_vbo[0]);
+				glBufferStorage(GL_ARRAY_BUFFER, vertex_buffer_bytes, nullptr, flags);
+				_imgui_buffer_data[0] = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertex_buffer_bytes, flags);
+				glVertexAttribPointer(_imgui_attribloc_pos, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), reinterpret_cast<GLvoid *>(offsetof(ImDrawVert, pos)));
+				glVertexAttribPointer(_imgui_attribloc_uv, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), reinterpret_cast<GLvoid *>(offsetof(ImDrawVert, uv)));
+				glVertexAttribPointer(_imgui_attribloc_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), reinterpret_cast<GLvoid *>(offsetof(ImDrawVert, col)));
+
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _imgui_vbo[1]);
+				glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, index_buffer_bytes, nullptr, flags);
+				_imgui_buffer_data[1] = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, index_buffer_bytes, flags);
+
+				if (_imgui_buffer_data[0] == nullptr || _imgui_buffer_data[1] == nullptr)
+				{
+					LOG(ERROR) << "Failed to map ImGui vertex and index buffers persistently. Falling back to uploading them every frame.";
+
+					glDeleteBuffers(2, _imgui_vbo);
+					glGenBuffers(2, _imgui_vbo);
+					glBindBuffer(GL_ARRAY_BUFFER, _imgui_vbo[0]);
+					glVertexAttribPointer(_imgui_attribloc_pos, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), reinterpret_cast<GLvoid *>(offsetof(ImDrawVert, pos)));
+					glVertexAttribPointer(_imgui_attribloc_uv, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), reinterpret_cast<GLvoid *>(offsetof(ImDrawVert, uv)));
+					glVertexAttribPointer(_imgui_attribloc_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), reinterpret_cast<GLvoid *>(offsetof(ImDrawVert, col)));
+					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _imgui_vbo[1]);
+
+					_imgui_persistent_buffers = false;
+					_imgui_buffer_data[0] = _imgui_buffer_data[1] = nullptr;
+				}
+			}
+		}
+
+		if (_imgui_persistent_buffers)
+		{
+			// Wait until the GPU is done with the frame that used this region before, which usually finished long ago
+			GLsync &fence = _imgui_buffer_fences[_imgui_buffer_region];
+
+			if (fence != 0)
+			{
+				glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+				glDeleteSync(fence);
+				fence = 0;
+			}
+
+			vtx_offset = _imgui_buffer_region * _imgui_vertex_buffer_size;
+			idx_offset = _imgui_buffer_region * _imgui_index_buffer_size;
+
+			auto vtx_dst = static_cast<ImDrawVert *>(_imgui_buffer_data[0]) + vtx_offset;
+			auto idx_dst = static_cast<ImDrawIdx *>(_imgui_buffer_data[1]) + idx_offset;
+
+			for (int n = 0; n < draw_data->CmdListsCount; n++)
+			{
+				const ImDrawList *const cmd_list = draw_data->CmdLists[n];
 
+				std::memcpy(vtx_dst, &cmd_list->VtxBuffer.front(), cmd_list->VtxBuffer.size() * sizeof(ImDrawVert));
+				std::memcpy(idx_dst, &cmd_list->IdxBuffer.front(), cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx));
+
+				vtx_dst += cmd_list->VtxBuffer.size();
+				idx_dst += cmd_list->IdxBuffer.size();
+			}
+		}
+		else
+		{
+			// Orphan the previous storage, so this does not wait for draw calls still reading it
+			glBindBuffer(GL_ARRAY_BUFFER, _imgui_vbo[0]);
+			glBufferData(GL_ARRAY_BUFFER, draw_data->TotalVtxCount * sizeof(ImDrawVert), nullptr, GL_STREAM_DRAW);
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _imgui_vbo[1]);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx), &cmd_list->IdxBuffer.front(), GL_STREAM_DRAW);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, draw_data->TotalIdxCount * sizeof(ImDrawIdx), nullptr, GL_STREAM_DRAW);
 
-			for (ImDrawCmd *cmd = cmd_list->CmdBuffer.begin(); cmd != cmd_list->CmdBuffer.end(); idx_buffer_offset += cmd->ElemCount, cmd++)
+			GLintptr vtx_bytes = 0, idx_bytes = 0;
+
+			for (int n = 0; n < draw_data->CmdListsCount; n++)
+			{
+				const ImDrawList *const cmd_list = draw_data->CmdLists[n];
+
+				glBufferSubData(GL_ARRAY_BUFFER, vtx_bytes, cmd_list->VtxBuffer.size() * sizeof(ImDrawVert), &cmd_list->VtxBuffer.front());
+				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, idx_bytes, cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx), &cmd_list->IdxBuffer.front());
+
+				vtx_bytes += cmd_list->VtxBuffer.size() * sizeof(ImDrawVert);
+				idx_bytes += cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx);
+			}
+		}
+
+		// Render command lists
+		for (int n = 0; n < draw_data->CmdListsCount; n++)
+		{
+			const ImDrawList *const cmd_list = draw_data->CmdLists[n];
+
+			for (const ImDrawCmd *cmd = cmd_list->CmdBuffer.begin(); cmd != cmd_list->CmdBuffer.end(); idx_offset += cmd->ElemCount, cmd++)
 			{
 				glScissor(
 					static_cast<GLint>(cmd->ClipRect.x),
@@ -863,8 +1189,16 @@ namespace reshade::opengl
 					static_cast<GLint>(cmd->ClipRect.w - cmd->ClipRect.y));
 				glBindTexture(GL_TEXTURE_2D, static_cast<const opengl_tex_data *>(cmd->TextureId)->id[0]);
 
-				glDrawElements(GL_TRIANGLES, cmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, idx_buffer_offset);
+				glDrawElementsBaseVertex(GL_TRIANGLES, cmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, reinterpret_cast<const GLvoid *>(idx_offset * sizeof(ImDrawIdx)), vtx_offset);
 			}
+
+			vtx_offset += cmd_list->VtxBuffer.size();
+		}
+
+		if (_imgui_persistent_buffers)
+		{
+			_imgui_buffer_fences[_imgui_buffer_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			_imgui_buffer_region = (_imgui_buffer_region + 1) % IMGUI_BUFFER_REGIONS;
 		}
 	}
 
@@ -32,6 +32,8 @@ namespace reshade::opengl
 			glDeleteFramebuffers(1, &fbo);
 		}
 
+		// Name of the pass in the effect, or its index for passes without one
+		std::string name;
 		GLuint program = 0;
 		GLuint fbo = 0, draw_textures[8] = { };
 		GLint stencil_reference = 0;
@@ -47,11 +49,36 @@ namespace reshade::opengl
 	{
 		~opengl_technique_data()
 		{
-			glDeleteQueries(1, &query);
+			glDeleteQueries(QUERY_COUNT, queries);
+
+			for (const auto &timestamps : pass_queries)
+			{
+				glDeleteQueries(static_cast<GLsizei>(timestamps.size()), timestamps.data());
+			}
 		}
 
-		GLuint query = 0;
-		bool query_in_flight = false;
+		// Results are only read once the GPU made them available, so a few frames worth of queries are in flight at a time
+		static constexpr unsigned int QUERY_COUNT = 4;
+
+		GLuint queries[QUERY_COUNT] = { };
+		// Ever increasing counters, the difference is the number of queries in flight and modulo 'QUERY_COUNT' selects the query
+		unsigned int queries_issued = 0, queries_evaluated = 0;
+		// Timestamps at the start of the technique and at the end of every pass while passes are timed, created the first time they are needed
+		std::vector<GLuint> pass_queries[QUERY_COUNT];
+		size_t pass_query_counts[QUERY_COUNT] = { };
+		// Samplers of the effect in '_effect_samplers', which are bound to the texture units from zero on for every technique
+		GLuint sampler_first = 0, sampler_count = 0;
+	};
+
+	struct opengl_uniform_buffer
+	{
+		GLuint id;
+		GLsizeiptr size;
+		// Persistently mapped storage with a region for every frame in flight, each 'region_stride' bytes apart, or null where the buffer is updated through 'glBufferSubData'
+		uint8_t *mapped_data;
+		GLsizeiptr region_stride;
+		// Frame the current region was last filled in, techniques of the same effect share the buffer and only the first one has to copy
+		unsigned int written_frame;
 	};
 
 	struct opengl_sampler
@@ -73,13 +100,17 @@ namespace reshade::opengl
 		void on_present();
 		void on_draw_call(unsigned int vertices);
 		void on_fbo_attachment(GLenum target, GLenum attachment, GLenum objecttarget, GLuint object, GLint level);
+		void on_bind_fbo(GLenum target, GLuint fbo);
+		void on_delete_fbos(GLsizei count, const GLuint *fbos);
 
 		void capture_frame(uint8_t *buffer) const override;
-		bool load_effect(const reshadefx::syntax_tree &ast, std::string &errors) override;
+		std::unique_ptr<base_object> compile_effect(const reshadefx::syntax_tree &ast, std::string &errors, bool half_precision) override;
+		bool load_effect(base_object &module) override;
 		bool update_texture(texture &texture, const uint8_t *data) override;
 		bool update_texture_reference(texture &texture, texture_reference id);
 
 		void render_technique(const technique &technique) override;
+		void issue_pass_timestamp_query(opengl_technique_data &technique_data);
 		void render_imgui_draw_data(ImDrawData *data) override;
 
 		HDC _hdc;
@@ -88,8 +119,16 @@ namespace reshade::opengl
 		GLuint _default_backbuffer_fbo = 0, _default_backbuffer_rbo[2] = { }, _backbuffer_texture[2] = { };
 		GLuint _depth_source_fbo = 0, _depth_source = 0, _depth_texture = 0, _blit_fbo = 0;
 		std::vector<struct opengl_sampler> _effect_samplers;
+		// Texture units the largest effect binds, which the state block saves and restores
+		size_t _effect_sampler_count = 0;
 		GLuint _default_vao = 0;
-		std::vector<std::pair<GLuint, GLsizeiptr>> _effect_ubos;
+		std::vector<opengl_uniform_buffer> _effect_ubos;
+		// Uniform buffers are persistently mapped where OpenGL 4.4 is available, and split into a region for every frame in flight like the ImGui buffers, guarded by a fence placed behind all effects of a frame
+		static constexpr unsigned int UNIFORM_BUFFER_REGIONS = 3;
+		bool _effect_ubo_persistent = false;
+		GLint _effect_ubo_alignment = 256;
+		unsigned int _effect_ubo_region = 0, _effect_ubo_frame = 1;
+		GLsync _effect_ubo_fences[UNIFORM_BUFFER_REGIONS] = { };
 
 	private:
 		struct depth_source_info
@@ -110,10 +149,20 @@ namespace reshade::opengl
 
 		opengl_stateblock _stateblock;
 		std::unordered_map<GLuint, depth_source_info> _depth_source_table;
+		// Shadow copy of the application's frame buffer bindings and their depth attachments (in the same form as the keys of '_depth_source_table'), kept up to date by the hooks, so draw calls do not have to query any of it
+		GLuint _current_draw_fbo = 0, _current_read_fbo = 0;
+		std::unordered_map<GLuint, GLuint> _depth_attachment_per_fbo;
 
 		GLuint _imgui_shader_program = 0, _imgui_VertHandle = 0, _imgui_FragHandle = 0;
 		int _imgui_attribloc_tex = 0, _imgui_attribloc_projmtx = 0;
 		int _imgui_attribloc_pos = 0, _imgui_attribloc_uv = 0, _imgui_attribloc_color = 0;
 		GLuint _imgui_vbo[2] = { }, _imgui_vao = 0;
+		// Vertex/index buffers are persistently mapped where OpenGL 4.4 is available, and split into a region for every frame in flight, each guarded by a fence placed behind the draw calls reading it
+		static constexpr unsigned int IMGUI_BUFFER_REGIONS = 3;
+		bool _imgui_persistent_buffers = false;
+		void *_imgui_buffer_data[2] = { };
+		int _imgui_vertex_buffer_size = 0, _imgui_index_buffer_size = 0;
+		unsigned int _imgui_buffer_region = 0;
+		GLsync _imgui_buffer_fences[IMGUI_BUFFER_REGIONS] = { };
 	};
 }
\ No newline at end of file
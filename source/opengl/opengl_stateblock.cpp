@@ -4,6 +4,7 @@
  */
 
 #include "opengl_stateblock.hpp"
+#include <algorithm>
 
 namespace reshade::opengl
 {
@@ -12,7 +13,7 @@ namespace reshade::opengl
 		ZeroMemory(this, sizeof(*this));
 	}
 
-	void opengl_stateblock::capture()
+	void opengl_stateblock::capture(GLuint num_texture_units)
 	{
 		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &_vao);
 		glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &_vbo);
@@ -20,7 +21,11 @@ namespace reshade::opengl
 		glGetIntegerv(GL_CURRENT_PROGRAM, &_program);
 		glGetIntegerv(GL_ACTIVE_TEXTURE, &_active_texture);
 
-		for (GLuint i = 0; i < 32; i++)
+		// ImGui uses the first unit even without any effects loaded, and the runtime binds textures to whatever unit is active outside of rendering, so include that one as well
+		const GLuint active_texture_unit = static_cast<GLuint>(_active_texture - GL_TEXTURE0);
+		_num_texture_units = std::min(std::max({ num_texture_units, active_texture_unit + 1, 1u }), static_cast<GLuint>(ARRAYSIZE(_textures2d)));
+
+		for (GLuint i = 0; i < _num_texture_units; i++)
 		{
 			glActiveTexture(GL_TEXTURE0 + i);
 			glGetIntegerv(GL_TEXTURE_BINDING_2D, &_textures2d[i]);
@@ -68,7 +73,7 @@ namespace reshade::opengl
 		glBindBuffer(GL_UNIFORM_BUFFER, _ubo);
 		glUseProgram(_program);
 
-		for (GLuint i = 0; i < 32; i++)
+		for (GLuint i = 0; i < _num_texture_units; i++)
 		{
 			glActiveTexture(GL_TEXTURE0 + i);
 			glBindTexture(GL_TEXTURE_2D, _textures2d[i]);
@@ -14,7 +14,11 @@ namespace reshade::opengl
 	public:
 		opengl_stateblock();
 
-		void capture();
+		/// <summary>
+		/// Save the state the runtime changes while rendering. Texture bindings are only saved for as many units as specified (and the active one), since the runtime binds nothing beyond that and every unit costs a few queries.
+		/// </summary>
+		/// <param name="num_texture_units">The number of texture units the runtime binds.</param>
+		void capture(GLuint num_texture_units);
 		void apply() const;
 
 	private:
@@ -23,6 +27,7 @@ namespace reshade::opengl
 		GLint _ubo;
 		GLint _program;
 		GLint _textures2d[32], _samplers[32];
+		GLuint _num_texture_units;
 		GLint _active_texture;
 		GLint _viewport[4];
 		GLint _scissor_rect[4];
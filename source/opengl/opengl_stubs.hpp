@@ -355,8 +355,6 @@
 #define glEndQueryIndexed(...)                             GLCHECK(gl3wProcs.gl.EndQueryIndexed(__VA_ARGS__))
 #undef glEndTransformFeedback
 #define glEndTransformFeedback(...)                        GLCHECK(gl3wProcs.gl.EndTransformFeedback(__VA_ARGS__))
-#undef glFenceSync
-#define glFenceSync(...)                                   GLCHECK(gl3wProcs.gl.FenceSync(__VA_ARGS__))
 #undef glFinish
 #define glFinish(...)                                      GLCHECK(gl3wProcs.gl.Finish(__VA_ARGS__))
 #undef glFlush
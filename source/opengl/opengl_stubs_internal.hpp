@@ -5,6 +5,9 @@
 
 #include <GL/gl3w.h>
 
+#undef glBindFramebuffer
+extern "C" void WINAPI glBindFramebuffer(GLenum target, GLuint framebuffer);
+extern "C" void WINAPI glBindFramebufferEXT(GLenum target, GLuint framebuffer);
 #undef glBindTexture
 extern "C" void WINAPI glBindTexture(GLenum target, GLuint texture);
 #undef glBlendFunc
@@ -29,6 +32,9 @@ extern "C" void WINAPI glCopyTexSubImage1D(GLenum target, GLint level, GLint xof
 extern "C" void WINAPI glCopyTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width, GLsizei height);
 #undef glCullFace
 extern "C" void WINAPI glCullFace(GLenum mode);
+#undef glDeleteFramebuffers
+extern "C" void WINAPI glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers);
+extern "C" void WINAPI glDeleteFramebuffersEXT(GLsizei n, const GLuint *framebuffers);
 #undef glDeleteTextures
 extern "C" void WINAPI glDeleteTextures(GLsizei n, const GLuint *textures);
 #undef glDepthFunc
@@ -52,6 +52,29 @@ HOOK_EXPORT void WINAPI glBegin(GLenum mode)
 	trampoline(mode);
 }
 
+extern "C"  void WINAPI glBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	static const auto trampoline = reshade::hooks::call(&glBindFramebuffer);
+
+	trampoline(target, framebuffer);
+
+	if (const auto it = g_opengl_runtimes.find(wglGetCurrentDC()); it != g_opengl_runtimes.end())
+	{
+		it->second->on_bind_fbo(target, framebuffer);
+	}
+}
+extern "C"  void WINAPI glBindFramebufferEXT(GLenum target, GLuint framebuffer)
+{
+	static const auto trampoline = reshade::hooks::call(&glBindFramebufferEXT);
+
+	trampoline(target, framebuffer);
+
+	if (const auto it = g_opengl_runtimes.find(wglGetCurrentDC()); it != g_opengl_runtimes.end())
+	{
+		it->second->on_bind_fbo(target, framebuffer);
+	}
+}
+
 HOOK_EXPORT void WINAPI glBindTexture(GLenum target, GLuint texture)
 {
 	static const auto trampoline = reshade::hooks::call(&glBindTexture);
@@ -383,6 +406,29 @@ HOOK_EXPORT void WINAPI glCullFace(GLenum mode)
 	trampoline(mode);
 }
 
+extern "C"  void WINAPI glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers)
+{
+	static const auto trampoline = reshade::hooks::call(&glDeleteFramebuffers);
+
+	trampoline(n, framebuffers);
+
+	if (const auto it = g_opengl_runtimes.find(wglGetCurrentDC()); it != g_opengl_runtimes.end())
+	{
+		it->second->on_delete_fbos(n, framebuffers);
+	}
+}
+extern "C"  void WINAPI glDeleteFramebuffersEXT(GLsizei n, const GLuint *framebuffers)
+{
+	static const auto trampoline = reshade::hooks::call(&glDeleteFramebuffersEXT);
+
+	trampoline(n, framebuffers);
+
+	if (const auto it = g_opengl_runtimes.find(wglGetCurrentDC()); it != g_opengl_runtimes.end())
+	{
+		it->second->on_delete_fbos(n, framebuffers);
+	}
+}
+
 HOOK_EXPORT void WINAPI glDeleteLists(GLuint list, GLsizei range)
 {
 	static const auto trampoline = reshade::hooks::call(&glDeleteLists);
@@ -563,6 +563,12 @@ HOOK_EXPORT BOOL  WINAPI wglMakeCurrent(HDC hdc, HGLRC hglrc)
 
 	LOG(INFO) << "Redirecting '" << "wglMakeCurrent" << "(" << hdc << ", " << hglrc << ")' ...";
 
+	// Nothing can call into OpenGL before a context is current, so this is the latest point to hook the rest of it
+	if (hglrc != nullptr)
+	{
+		reshade::hooks::install_deferred();
+	}
+
 	const HDC hdc_previous = wglGetCurrentDC();
 	const HGLRC hglrc_previous = wglGetCurrentContext();
 
@@ -636,6 +642,7 @@ HOOK_EXPORT BOOL  WINAPI wglMakeCurrent(HDC hdc, HGLRC hglrc)
 		gl3wInit();
 
 		// Fix up gl3w to use the original OpenGL functions and not the hooked ones
+		gl3wProcs.gl.BindFramebuffer = reshade::hooks::call(&glBindFramebuffer);
 		gl3wProcs.gl.BindTexture = reshade::hooks::call(&glBindTexture);
 		gl3wProcs.gl.BlendFunc = reshade::hooks::call(&glBlendFunc);
 		gl3wProcs.gl.Clear = reshade::hooks::call(&glClear);
@@ -648,6 +655,7 @@ HOOK_EXPORT BOOL  WINAPI wglMakeCurrent(HDC hdc, HGLRC hglrc)
 		gl3wProcs.gl.CopyTexSubImage1D = reshade::hooks::call(&glCopyTexSubImage1D);
 		gl3wProcs.gl.CopyTexSubImage2D = reshade::hooks::call(&glCopyTexSubImage2D);
 		gl3wProcs.gl.CullFace = reshade::hooks::call(&glCullFace);
+		gl3wProcs.gl.DeleteFramebuffers = reshade::hooks::call(&glDeleteFramebuffers);
 		gl3wProcs.gl.DeleteTextures = reshade::hooks::call(&glDeleteTextures);
 		gl3wProcs.gl.DepthFunc = reshade::hooks::call(&glDepthFunc);
 		gl3wProcs.gl.DepthMask = reshade::hooks::call(&glDepthMask);
@@ -740,6 +748,18 @@ HOOK_EXPORT BOOL  WINAPI wglMakeCurrent(HDC hdc, HGLRC hglrc)
 
 	return TRUE;
 }
+			BOOL  WINAPI wglMakeContextCurrentARB(HDC hDrawDC, HDC hReadDC, HGLRC hglrc)
+{
+	LOG(INFO) << "Redirecting '" << "wglMakeContextCurrentARB" << "(" << hDrawDC << ", " << hReadDC << ", " << hglrc << ")' ...";
+
+	// Contexts can be made current through this instead of 'wglMakeCurrent', so the rest of OpenGL has to be hooked here as well
+	if (hglrc != nullptr)
+	{
+		reshade::hooks::install_deferred();
+	}
+
+	return reshade::hooks::call(&wglMakeContextCurrentARB)(hDrawDC, hReadDC, hglrc);
+}
 
 HOOK_EXPORT HDC   WINAPI wglGetCurrentDC()
 {
@@ -915,6 +935,13 @@ HOOK_EXPORT BOOL  WINAPI wglSwapBuffers(HDC hdc)
 		}
 
 		it->second->on_present();
+
+		const BOOL result = trampoline(hdc);
+
+		// The overlay may be built on a worker thread while the driver presents, which has to finish before the game continues
+		it->second->wait_for_overlay();
+
+		return result;
 	}
 
 	return trampoline(hdc);
@@ -1105,6 +1132,10 @@ HOOK_EXPORT PROC  WINAPI wglGetProcAddress(LPCSTR lpszProc)
 	else if (static bool s_hooks_not_installed = true; s_hooks_not_installed)
 	{
 		// Install all OpenGL hooks in a single batch job
+		reshade::hooks::install("glBindFramebuffer", reinterpret_cast<reshade::hook::address>(trampoline("glBindFramebuffer")), reinterpret_cast<reshade::hook::address>(&glBindFramebuffer), true);
+		reshade::hooks::install("glBindFramebufferEXT", reinterpret_cast<reshade::hook::address>(trampoline("glBindFramebufferEXT")), reinterpret_cast<reshade::hook::address>(&glBindFramebufferEXT), true);
+		reshade::hooks::install("glDeleteFramebuffers", reinterpret_cast<reshade::hook::address>(trampoline("glDeleteFramebuffers")), reinterpret_cast<reshade::hook::address>(&glDeleteFramebuffers), true);
+		reshade::hooks::install("glDeleteFramebuffersEXT", reinterpret_cast<reshade::hook::address>(trampoline("glDeleteFramebuffersEXT")), reinterpret_cast<reshade::hook::address>(&glDeleteFramebuffersEXT), true);
 		reshade::hooks::install("glDrawArraysIndirect", reinterpret_cast<reshade::hook::address>(trampoline("glDrawArraysIndirect")), reinterpret_cast<reshade::hook::address>(&glDrawArraysIndirect), true);
 		reshade::hooks::install("glDrawArraysInstanced", reinterpret_cast<reshade::hook::address>(trampoline("glDrawArraysInstanced")), reinterpret_cast<reshade::hook::address>(&glDrawArraysInstanced), true);
 		reshade::hooks::install("glDrawArraysInstancedARB", reinterpret_cast<reshade::hook::address>(trampoline("glDrawArraysInstancedARB")), reinterpret_cast<reshade::hook::address>(&glDrawArraysInstancedARB), true);
@@ -1148,6 +1179,7 @@ HOOK_EXPORT PROC  WINAPI wglGetProcAddress(LPCSTR lpszProc)
 		reshade::hooks::install("wglGetPbufferDCARB", reinterpret_cast<reshade::hook::address>(trampoline("wglGetPbufferDCARB")), reinterpret_cast<reshade::hook::address>(&wglGetPbufferDCARB), true);
 		reshade::hooks::install("wglGetPixelFormatAttribivARB", reinterpret_cast<reshade::hook::address>(trampoline("wglGetPixelFormatAttribivARB")), reinterpret_cast<reshade::hook::address>(&wglGetPixelFormatAttribivARB), true);
 		reshade::hooks::install("wglGetPixelFormatAttribfvARB", reinterpret_cast<reshade::hook::address>(trampoline("wglGetPixelFormatAttribfvARB")), reinterpret_cast<reshade::hook::address>(&wglGetPixelFormatAttribfvARB), true);
+		reshade::hooks::install("wglMakeContextCurrentARB", reinterpret_cast<reshade::hook::address>(trampoline("wglMakeContextCurrentARB")), reinterpret_cast<reshade::hook::address>(&wglMakeContextCurrentARB), true);
 		reshade::hooks::install("wglQueryPbufferARB", reinterpret_cast<reshade::hook::address>(trampoline("wglQueryPbufferARB")), reinterpret_cast<reshade::hook::address>(&wglQueryPbufferARB), true);
 		reshade::hooks::install("wglReleasePbufferDCARB", reinterpret_cast<reshade::hook::address>(trampoline("wglReleasePbufferDCARB")), reinterpret_cast<reshade::hook::address>(&wglReleasePbufferDCARB), true);
 		reshade::hooks::install("wglGetSwapIntervalEXT", reinterpret_cast<reshade::hook::address>(trampoline("wglGetSwapIntervalEXT")), reinterpret_cast<reshade::hook::address>(&wglGetSwapIntervalEXT), true);
@@ -0,0 +1,148 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "pixel_conversion.hpp"
+#include <intrin.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+namespace reshade::pixel_conversion
+{
+	// Every pixel is handled as a little-endian 32-bit value, so BGRA is "0xAARRGGBB" and RGBA is "0xAABBGGRR", which turns the swizzle into a rotation of the red and blue bytes
+	static const uint32_t s_alpha_mask = 0xFF000000;
+	static const uint32_t s_green_mask = 0x0000FF00;
+	static const uint32_t s_red_blue_mask = 0x00FF00FF;
+
+	typedef void(*convert_row_func)(uint32_t *destination, const uint32_t *source, size_t count, bool swap_red_blue);
+
+	static void convert_row_scalar(uint32_t *destination, const uint32_t *source, size_t count, bool swap_red_blue)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t pixel = source[i];
+
+			if (swap_red_blue)
+			{
+				const uint32_t red_blue = pixel & s_red_blue_mask;
+				pixel = (pixel & s_green_mask) | (red_blue >> 16) | (red_blue << 16);
+			}
+
+			destination[i] = pixel | s_alpha_mask;
+		}
+	}
+	static void convert_row_sse2(uint32_t *destination, const uint32_t *source, size_t count, bool swap_red_blue)
+	{
+		const __m128i alpha_mask = _mm_set1_epi32(s_alpha_mask);
+		const __m128i green_mask = _mm_set1_epi32(s_green_mask);
+		const __m128i red_blue_mask = _mm_set1_epi32(s_red_blue_mask);
+
+		size_t i = 0;
+
+		// The two branches are kept apart so the loop that only fills in alpha is a plain copy with a single OR
+		if (swap_red_blue)
+		{
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+				const __m128i red_blue = _mm_and_si128(pixels, red_blue_mask);
+				const __m128i swapped = _mm_or_si128(_mm_and_si128(pixels, green_mask), _mm_or_si128(_mm_srli_epi32(red_blue, 16), _mm_slli_epi32(red_blue, 16)));
+
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), _mm_or_si128(swapped, alpha_mask));
+			}
+		}
+		else
+		{
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), _mm_or_si128(pixels, alpha_mask));
+			}
+		}
+
+		convert_row_scalar(destination + i, source + i, count - i, swap_red_blue);
+	}
+	static void convert_row_avx2(uint32_t *destination, const uint32_t *source, size_t count, bool swap_red_blue)
+	{
+		const __m256i alpha_mask = _mm256_set1_epi32(s_alpha_mask);
+
+		size_t i = 0;
+
+		if (swap_red_blue)
+		{
+			// Byte shuffles stay within 128-bit lanes, which is fine here since no pixel crosses one
+			const __m256i shuffle = _mm256_setr_epi8(
+				2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+				2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i));
+
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + i), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha_mask));
+			}
+		}
+		else
+		{
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i));
+
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + i), _mm256_or_si256(pixels, alpha_mask));
+			}
+		}
+
+		// Leave the last few pixels to the SSE2 and scalar paths, so there is no unaligned masked store
+		convert_row_sse2(destination + i, source + i, count - i, swap_red_blue);
+	}
+
+	static bool is_avx2_supported()
+	{
+		int info[4];
+		__cpuid(info, 0);
+
+		if (info[0] < 7)
+		{
+			return false;
+		}
+
+		// Both the processor and the operating system have to support AVX, the latter saving the upper halves of the YMM registers on context switches
+		__cpuid(info, 1);
+
+		const bool has_osxsave = (info[2] & (1 << 27)) != 0;
+		const bool has_avx = (info[2] & (1 << 28)) != 0;
+
+		if (!has_osxsave || !has_avx || (_xgetbv(0) & 0x6) != 0x6)
+		{
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+
+		return (info[1] & (1 << 5)) != 0;
+	}
+
+	void copy_rows_to_rgba(uint8_t *destination, const uint8_t *source, size_t source_pitch, unsigned int width, unsigned int height, bool swap_red_blue)
+	{
+		static const convert_row_func s_convert_row = is_avx2_supported() ? convert_row_avx2 : convert_row_sse2;
+
+		const size_t pitch = width * 4;
+
+		// Without any padding between the rows the whole image can be converted in one go
+		if (source_pitch == pitch)
+		{
+			s_convert_row(reinterpret_cast<uint32_t *>(destination), reinterpret_cast<const uint32_t *>(source), static_cast<size_t>(width) * height, swap_red_blue);
+			return;
+		}
+
+		for (unsigned int y = 0; y < height; y++)
+		{
+			s_convert_row(reinterpret_cast<uint32_t *>(destination), reinterpret_cast<const uint32_t *>(source), width, swap_red_blue);
+
+			destination += pitch;
+			source += source_pitch;
+		}
+	}
+}
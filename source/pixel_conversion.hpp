@@ -0,0 +1,24 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace reshade::pixel_conversion
+{
+	/// <summary>
+	/// Copy the rows of a mapped 32bpp image into a tightly packed RGBA buffer, filling in an opaque alpha channel and optionally swapping the red and blue channels of BGRA formats on the way.
+	/// This uses AVX2 when the processor supports it and SSE2 otherwise, since it runs over every pixel of the back buffer for each screenshot.
+	/// </summary>
+	/// <param name="destination">The buffer to write to. It has to be the size of at least "width * height * 4".</param>
+	/// <param name="source">The first row of the image to read.</param>
+	/// <param name="source_pitch">The distance between two rows of the source image in bytes, which may be larger than "width * 4".</param>
+	/// <param name="width">The width of the image in pixels.</param>
+	/// <param name="height">The height of the image in pixels.</param>
+	/// <param name="swap_red_blue">Set to convert from BGRA to RGBA.</param>
+	void copy_rows_to_rgba(uint8_t *destination, const uint8_t *source, size_t source_pitch, unsigned int width, unsigned int height, bool swap_red_blue);
+}
@@ -0,0 +1,442 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "png_encoder.hpp"
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+namespace reshade::png
+{
+	static const unsigned int HASH_BITS = 15;
+	static const unsigned int WINDOW_SIZE = 32768;
+	static const unsigned int MAX_CHAIN_LENGTH = 8;
+	static const unsigned int MIN_MATCH_LENGTH = 3;
+	static const unsigned int MAX_MATCH_LENGTH = 258;
+	// Strips smaller than this compress noticeably worse, since matches cannot reach across strips
+	static const unsigned int MIN_STRIP_ROWS = 64;
+
+	static const unsigned short s_length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const unsigned char s_length_extra_bits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const unsigned short s_distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const unsigned char s_distance_extra_bits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	class bit_writer
+	{
+	public:
+		explicit bit_writer(std::vector<uint8_t> &output) : _output(output) { }
+
+		void put_bits(uint32_t value, unsigned int count)
+		{
+			_bits |= static_cast<uint64_t>(value) << _count;
+			_count += count;
+
+			while (_count >= 8)
+			{
+				_output.push_back(static_cast<uint8_t>(_bits));
+				_bits >>= 8;
+				_count -= 8;
+			}
+		}
+		void put_code(uint32_t code, unsigned int count)
+		{
+			// Huffman codes are packed starting with their most significant bit
+			uint32_t reversed = 0;
+
+			for (unsigned int i = 0; i < count; i++)
+			{
+				reversed = (reversed << 1) | ((code >> i) & 1);
+			}
+
+			put_bits(reversed, count);
+		}
+		void align()
+		{
+			if (_count > 0)
+			{
+				_output.push_back(static_cast<uint8_t>(_bits));
+				_bits = 0;
+				_count = 0;
+			}
+		}
+
+	private:
+		std::vector<uint8_t> &_output;
+		uint64_t _bits = 0;
+		unsigned int _count = 0;
+	};
+
+	static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size)
+	{
+		static const struct crc_table
+		{
+			crc_table()
+			{
+				for (uint32_t n = 0; n < 256; n++)
+				{
+					uint32_t c = n;
+
+					for (unsigned int k = 0; k < 8; k++)
+					{
+						c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+					}
+
+					values[n] = c;
+				}
+			}
+
+			uint32_t values[256];
+		} s_table;
+
+		crc = ~crc;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			crc = s_table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		}
+
+		return ~crc;
+	}
+	static uint32_t adler32(const uint8_t *data, size_t size)
+	{
+		uint32_t s1 = 1, s2 = 0;
+
+		while (size > 0)
+		{
+			// Largest block for which the sums cannot overflow before the modulo
+			const size_t block_size = std::min(size, static_cast<size_t>(5552));
+
+			for (size_t i = 0; i < block_size; i++)
+			{
+				s1 += data[i];
+				s2 += s1;
+			}
+
+			s1 %= 65521;
+			s2 %= 65521;
+
+			data += block_size;
+			size -= block_size;
+		}
+
+		return (s2 << 16) | s1;
+	}
+	static uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2)
+	{
+		const uint32_t base = 65521;
+		const uint32_t remainder = static_cast<uint32_t>(size2 % base);
+
+		uint32_t s1 = adler1 & 0xFFFF;
+		uint32_t s2 = static_cast<uint32_t>((static_cast<uint64_t>(remainder) * s1) % base);
+		s1 += (adler2 & 0xFFFF) + base - 1;
+		s2 += (adler1 >> 16) + (adler2 >> 16) + base - remainder;
+
+		if (s1 >= base) s1 -= base;
+		if (s1 >= base) s1 -= base;
+		if (s2 >= (base << 1)) s2 -= (base << 1);
+		if (s2 >= base) s2 -= base;
+
+		return (s2 << 16) | s1;
+	}
+
+	static void filter_row(const uint8_t *row, const uint8_t *prev_row, size_t stride, uint8_t *candidates[5], uint8_t *output)
+	{
+		// Choose the filter with the smallest sum of absolute signed residuals, which usually compresses best
+		for (size_t x = 0; x < stride; x++)
+		{
+			const int a = x >= 4 ? row[x - 4] : 0;
+			const int b = prev_row != nullptr ? prev_row[x] : 0;
+			const int c = x >= 4 && prev_row != nullptr ? prev_row[x - 4] : 0;
+
+			const int p = a + b - c;
+			const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+			const int paeth = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+
+			candidates[0][x] = row[x];
+			candidates[1][x] = static_cast<uint8_t>(row[x] - a);
+			candidates[2][x] = static_cast<uint8_t>(row[x] - b);
+			candidates[3][x] = static_cast<uint8_t>(row[x] - ((a + b) >> 1));
+			candidates[4][x] = static_cast<uint8_t>(row[x] - paeth);
+		}
+
+		unsigned int best_filter = 0;
+		size_t best_cost = SIZE_MAX;
+
+		for (unsigned int filter = 0; filter < 5; filter++)
+		{
+			size_t cost = 0;
+
+			for (size_t x = 0; x < stride; x++)
+			{
+				cost += std::abs(static_cast<int8_t>(candidates[filter][x]));
+			}
+
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_filter = filter;
+			}
+		}
+
+		output[0] = static_cast<uint8_t>(best_filter);
+		std::memcpy(output + 1, candidates[best_filter], stride);
+	}
+
+	static void deflate(const uint8_t *data, size_t size, bool final, std::vector<uint8_t> &output)
+	{
+		bit_writer writer(output);
+
+		// Single block with the fixed Huffman codes, which avoids building code tables and is good enough for filtered image data
+		writer.put_bits(final ? 1 : 0, 1);
+		writer.put_bits(1, 2);
+
+		std::vector<int32_t> head(1 << HASH_BITS, -1);
+		std::vector<int32_t> prev(WINDOW_SIZE, -1);
+
+		const auto hash = [data](size_t pos) {
+			return ((data[pos] << 16 | data[pos + 1] << 8 | data[pos + 2]) * 2654435761u) >> (32 - HASH_BITS);
+		};
+		const auto insert = [&](size_t pos) {
+			if (pos + MIN_MATCH_LENGTH <= size)
+			{
+				const uint32_t h = hash(pos);
+				prev[pos & (WINDOW_SIZE - 1)] = head[h];
+				head[h] = static_cast<int32_t>(pos);
+			}
+		};
+
+		for (size_t pos = 0; pos < size;)
+		{
+			size_t best_length = 0, best_distance = 0;
+
+			if (pos + MIN_MATCH_LENGTH <= size)
+			{
+				const size_t max_length = std::min(static_cast<size_t>(MAX_MATCH_LENGTH), size - pos);
+
+				int32_t candidate = head[hash(pos)];
+
+				for (unsigned int chain = 0; candidate >= 0 && pos - candidate <= WINDOW_SIZE && chain < MAX_CHAIN_LENGTH; chain++)
+				{
+					size_t length = 0;
+
+					while (length < max_length && data[candidate + length] == data[pos + length])
+					{
+						length++;
+					}
+
+					if (length > best_length)
+					{
+						best_length = length;
+						best_distance = pos - candidate;
+
+						if (length == max_length)
+						{
+							break;
+						}
+					}
+
+					const int32_t next = prev[candidate & (WINDOW_SIZE - 1)];
+
+					// The window slot may have been reused by a newer position already
+					if (next >= candidate)
+					{
+						break;
+					}
+
+					candidate = next;
+				}
+			}
+
+			if (best_length >= MIN_MATCH_LENGTH)
+			{
+				unsigned int length_code = 28;
+				while (s_length_base[length_code] > best_length)
+				{
+					length_code--;
+				}
+
+				const unsigned int symbol = 257 + length_code;
+				if (symbol < 280)
+				{
+					writer.put_code(symbol - 256, 7);
+				}
+				else
+				{
+					writer.put_code(0xC0 + symbol - 280, 8);
+				}
+
+				writer.put_bits(static_cast<uint32_t>(best_length - s_length_base[length_code]), s_length_extra_bits[length_code]);
+
+				unsigned int distance_code = 29;
+				while (s_distance_base[distance_code] > best_distance)
+				{
+					distance_code--;
+				}
+
+				writer.put_code(distance_code, 5);
+				writer.put_bits(static_cast<uint32_t>(best_distance - s_distance_base[distance_code]), s_distance_extra_bits[distance_code]);
+
+				for (const size_t end = pos + best_length; pos < end; pos++)
+				{
+					insert(pos);
+				}
+			}
+			else
+			{
+				const unsigned int literal = data[pos];
+				if (literal < 144)
+				{
+					writer.put_code(0x30 + literal, 8);
+				}
+				else
+				{
+					writer.put_code(0x190 + literal - 144, 9);
+				}
+
+				insert(pos++);
+			}
+		}
+
+		// End of block
+		writer.put_code(0, 7);
+
+		// Append an empty stored block to end on a byte boundary, so the next strip can simply be concatenated
+		if (!final)
+		{
+			writer.put_bits(0, 3);
+			writer.align();
+			output.insert(output.end(), { 0x00, 0x00, 0xFF, 0xFF });
+		}
+		else
+		{
+			writer.align();
+		}
+	}
+
+	static void append_uint32(std::vector<uint8_t> &output, uint32_t value)
+	{
+		output.insert(output.end(), { static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value) });
+	}
+	static void begin_chunk(std::vector<uint8_t> &output, const char type[4])
+	{
+		// Length is patched in when the chunk is finished
+		append_uint32(output, 0);
+		output.insert(output.end(), type, type + 4);
+	}
+	static void end_chunk(std::vector<uint8_t> &output, size_t chunk_offset)
+	{
+		const size_t data_size = output.size() - chunk_offset - 8;
+
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			output[chunk_offset + i] = static_cast<uint8_t>(data_size >> (24 - i * 8));
+		}
+
+		append_uint32(output, crc32(0, output.data() + chunk_offset + 4, data_size + 4));
+	}
+
+	std::vector<uint8_t> encode_rgba(const uint8_t *data, unsigned int width, unsigned int height, unsigned int max_threads)
+	{
+		struct strip
+		{
+			unsigned int row_begin, row_end;
+			uint32_t adler;
+			size_t filtered_size;
+			// Complete IDAT chunk, so the checksum is computed on the worker too
+			std::vector<uint8_t> chunk;
+		};
+
+		const size_t stride = static_cast<size_t>(width) * 4;
+
+		if (max_threads == 0)
+		{
+			max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		const unsigned int num_strips = std::max(1u, std::min(max_threads, height / MIN_STRIP_ROWS));
+		const unsigned int rows_per_strip = (height + num_strips - 1) / num_strips;
+
+		std::vector<strip> strips(num_strips);
+
+		for (unsigned int i = 0; i < num_strips; i++)
+		{
+			strips[i].row_begin = std::min(height, i * rows_per_strip);
+			strips[i].row_end = std::min(height, (i + 1) * rows_per_strip);
+		}
+
+		const auto encode_strip = [&](strip &strip) {
+			std::vector<uint8_t> filtered((strip.row_end - strip.row_begin) * (stride + 1));
+			std::vector<uint8_t> scratch(stride * 5);
+			uint8_t *candidates[5] = { &scratch[0], &scratch[stride], &scratch[stride * 2], &scratch[stride * 3], &scratch[stride * 4] };
+
+			for (unsigned int y = strip.row_begin; y < strip.row_end; y++)
+			{
+				// Filters reference the unfiltered previous row, so strips do not depend on each other
+				filter_row(data + y * stride, y > 0 ? data + (y - 1) * stride : nullptr, stride, candidates, &filtered[(y - strip.row_begin) * (stride + 1)]);
+			}
+
+			strip.adler = adler32(filtered.data(), filtered.size());
+			strip.filtered_size = filtered.size();
+
+			strip.chunk.reserve(filtered.size() / 2);
+			begin_chunk(strip.chunk, "IDAT");
+
+			if (&strip == &strips.front())
+			{
+				// Zlib header for a 32K window and the fastest compression level
+				strip.chunk.insert(strip.chunk.end(), { 0x78, 0x01 });
+			}
+
+			deflate(filtered.data(), filtered.size(), &strip == &strips.back(), strip.chunk);
+
+			end_chunk(strip.chunk, 0);
+		};
+
+		std::vector<std::thread> workers;
+
+		for (unsigned int i = 1; i < num_strips; i++)
+		{
+			workers.emplace_back(encode_strip, std::ref(strips[i]));
+		}
+
+		encode_strip(strips[0]);
+
+		for (auto &worker : workers)
+		{
+			worker.join();
+		}
+
+		std::vector<uint8_t> output = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+		size_t chunk_offset = output.size();
+		begin_chunk(output, "IHDR");
+		append_uint32(output, width);
+		append_uint32(output, height);
+		output.insert(output.end(), { 8, 6, 0, 0, 0 }); // 8-bit RGBA, deflate, adaptive filtering, no interlacing
+		end_chunk(output, chunk_offset);
+
+		uint32_t adler = 1;
+
+		for (const auto &strip : strips)
+		{
+			output.insert(output.end(), strip.chunk.begin(), strip.chunk.end());
+
+			adler = adler32_combine(adler, strip.adler, strip.filtered_size);
+		}
+
+		// The zlib stream may span multiple IDAT chunks, so the checksum over all strips goes into one of its own
+		chunk_offset = output.size();
+		begin_chunk(output, "IDAT");
+		append_uint32(output, adler);
+		end_chunk(output, chunk_offset);
+
+		chunk_offset = output.size();
+		begin_chunk(output, "IEND");
+		end_chunk(output, chunk_offset);
+
+		return output;
+	}
+}
@@ -0,0 +1,23 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+namespace reshade::png
+{
+	/// <summary>
+	/// Encode a 32bpp RGBA image to PNG.
+	/// The image is split into row strips which are filtered and deflated in parallel, each ending on a byte boundary, so they can be joined into a single zlib stream.
+	/// </summary>
+	/// <param name="data">The image data to encode. It has to be the size of at least "width * height * 4".</param>
+	/// <param name="width">The width of the image in pixels.</param>
+	/// <param name="height">The height of the image in pixels.</param>
+	/// <param name="max_threads">The maximum number of threads to encode strips on, or zero to use all hardware threads.</param>
+	/// <returns>The encoded PNG file contents.</returns>
+	std::vector<uint8_t> encode_rgba(const uint8_t *data, unsigned int width, unsigned int height, unsigned int max_threads = 0);
+}
@@ -0,0 +1,185 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+
+/// <summary>
+/// A hash map from pointers to values for statistics that are collected and thrown away again every frame. Clearing it keeps all memory and only invalidates the hash table by moving on to the next generation, so once it grew to what a frame needs, it never allocates again.
+/// Entries are iterated in the order they were added. The key can be a raw pointer or a smart pointer like 'com_ptr' when the map should keep a reference to the object.
+/// </summary>
+template <typename K, typename T>
+class pointer_map
+{
+public:
+	using pointer = decltype(&*std::declval<K &>());
+
+	struct entry
+	{
+		K key;
+		T value;
+	};
+
+	size_t size() const { return _size; }
+	bool empty() const { return _size == 0; }
+
+	entry *begin() { return _entries.data(); }
+	entry *end() { return _entries.data() + _size; }
+	const entry *begin() const { return _entries.data(); }
+	const entry *end() const { return _entries.data() + _size; }
+
+	T *find(pointer key)
+	{
+		const slot *const slot = find_slot(key);
+
+		return slot->generation == _generation ? &_entries[slot->index].value : nullptr;
+	}
+	const T *find(pointer key) const
+	{
+		return const_cast<pointer_map *>(this)->find(key);
+	}
+
+	T &operator[](pointer key)
+	{
+		if (T *const value = find(key))
+		{
+			return *value;
+		}
+
+		// Keep the table at most half full, so probe sequences stay short
+		if ((_size + 1) * 2 > _slots.size())
+		{
+			grow();
+		}
+
+		slot *const slot = find_slot(key);
+		slot->key = key;
+		slot->index = static_cast<uint32_t>(_size);
+		slot->generation = _generation;
+
+		// Entries of earlier frames are reused, so values that contain containers keep their memory too
+		if (_size == _entries.size())
+		{
+			_entries.emplace_back();
+		}
+
+		entry &entry = _entries[_size++];
+		entry.key = key;
+
+		return entry.value;
+	}
+
+	void clear()
+	{
+		// Release what the keys and values reference right away, instead of whenever an entry is reused
+		for (size_t i = 0; i < _size; i++)
+		{
+			_entries[i].key = K();
+			clear_value(_entries[i].value);
+		}
+
+		_size = 0;
+
+		if (++_generation == 0)
+		{
+			// All slots look occupied again once the generation wrapped around, so they have to be reset for real this one time
+			for (slot &slot : _slots)
+			{
+				slot.generation = 0;
+			}
+
+			_generation = 1;
+		}
+	}
+
+private:
+	struct slot
+	{
+		const void *key;
+		uint32_t index;
+		uint32_t generation;
+	};
+
+	template <typename V, typename = void>
+	struct has_clear : std::false_type { };
+	template <typename V>
+	struct has_clear<V, std::void_t<decltype(std::declval<V &>().clear())>> : std::true_type { };
+
+	static void clear_value(T &value)
+	{
+		if constexpr (has_clear<T>::value)
+		{
+			value.clear();
+		}
+		else
+		{
+			value = T();
+		}
+	}
+
+	static const void *address_of(const K &key)
+	{
+		if constexpr (std::is_pointer<K>::value)
+		{
+			return key;
+		}
+		else
+		{
+			return key.get();
+		}
+	}
+	static size_t hash(const void *key)
+	{
+		// Objects are at least 16 byte aligned, so the lowest bits carry no information
+		return static_cast<size_t>((reinterpret_cast<uintptr_t>(key) >> 4) * 0x9E3779B97F4A7C15ull >> 16);
+	}
+
+	// Returns the slot with the key, or the empty slot it would go into, the table must not be full
+	slot *find_slot(const void *key)
+	{
+		static slot s_empty_slot = { nullptr, 0, 0 };
+
+		if (_slots.empty())
+		{
+			return &s_empty_slot;
+		}
+
+		const size_t mask = _slots.size() - 1;
+
+		for (size_t i = hash(key) & mask;; i = (i + 1) & mask)
+		{
+			slot &slot = _slots[i];
+
+			if (slot.generation != _generation || slot.key == key)
+			{
+				return &slot;
+			}
+		}
+	}
+
+	void grow()
+	{
+		_slots.assign(_slots.empty() ? 64 : _slots.size() * 2, slot { nullptr, 0, 0 });
+
+		for (size_t i = 0; i < _size; i++)
+		{
+			const void *const key = address_of(_entries[i].key);
+
+			slot *const slot = find_slot(key);
+			slot->key = key;
+			slot->index = static_cast<uint32_t>(i);
+			slot->generation = _generation;
+		}
+	}
+
+	std::vector<slot> _slots;
+	std::vector<entry> _entries;
+	size_t _size = 0;
+	uint32_t _generation = 1;
+};
@@ -0,0 +1,216 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "profiler.hpp"
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#if RESHADE_COUNT_ALLOCATIONS
+#include <crtdbg.h>
+#endif
+
+namespace reshade::profiler
+{
+	std::atomic<bool> s_enabled(false);
+
+	namespace
+	{
+		struct record
+		{
+			event data;
+			uint64_t frame;
+		};
+		struct thread_buffer
+		{
+			// Only contended while the overlay copies the last frame out of the buffer
+			std::mutex mutex;
+			unsigned int thread_index = 0;
+			unsigned int depth = 0;
+			bool in_use = false;
+			size_t write_index = 0, count = 0;
+			record records[4096];
+		};
+
+		// Gives the buffer of a thread back for reuse when the thread exits, so threads that come and go do not accumulate buffers
+		struct thread_buffer_owner
+		{
+			thread_buffer *buffer = nullptr;
+
+			~thread_buffer_owner()
+			{
+				if (buffer != nullptr)
+				{
+					const std::lock_guard<std::mutex> lock(buffer->mutex);
+					buffer->in_use = false;
+					buffer->depth = 0;
+				}
+			}
+		};
+
+		std::mutex s_buffers_mutex;
+		std::vector<std::unique_ptr<thread_buffer>> s_buffers;
+		std::atomic<uint64_t> s_frame(0);
+		std::mutex s_frame_mutex;
+		int64_t s_frame_begin = 0, s_last_frame_begin = 0, s_last_frame_end = 0;
+		thread_local thread_buffer_owner s_thread_buffer;
+
+		int64_t now()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+		}
+
+		thread_buffer &current_thread_buffer()
+		{
+			if (s_thread_buffer.buffer == nullptr)
+			{
+				const std::lock_guard<std::mutex> lock(s_buffers_mutex);
+
+				for (const auto &buffer : s_buffers)
+				{
+					const std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+
+					if (!buffer->in_use)
+					{
+						buffer->in_use = true;
+						buffer->count = 0;
+						s_thread_buffer.buffer = buffer.get();
+						break;
+					}
+				}
+
+				if (s_thread_buffer.buffer == nullptr)
+				{
+					auto &buffer = s_buffers.emplace_back(std::make_unique<thread_buffer>());
+					buffer->thread_index = static_cast<unsigned int>(s_buffers.size());
+					buffer->in_use = true;
+					s_thread_buffer.buffer = buffer.get();
+				}
+			}
+
+			return *s_thread_buffer.buffer;
+		}
+
+#if RESHADE_COUNT_ALLOCATIONS
+		// A plain counter, since the hook runs inside the allocator and must not allocate itself
+		thread_local uint64_t s_thread_allocation_count = 0;
+
+		int __cdecl allocation_hook(int type, void *, size_t, int block_type, long, const unsigned char *, int)
+		{
+			// Blocks the CRT allocates for its own bookkeeping are not something the frame path can avoid
+			if ((type == _HOOK_ALLOC || type == _HOOK_REALLOC) && _BLOCK_TYPE(block_type) != _CRT_BLOCK)
+			{
+				s_thread_allocation_count++;
+			}
+
+			return 1;
+		}
+#endif
+	}
+
+#if RESHADE_COUNT_ALLOCATIONS
+	void install_allocation_hook()
+	{
+		_CrtSetAllocHook(&allocation_hook);
+	}
+	uint64_t thread_allocation_count()
+	{
+		return s_thread_allocation_count;
+	}
+#endif
+
+	void set_enabled(bool enabled)
+	{
+		s_enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	void next_frame()
+	{
+		const int64_t time = now();
+
+		const std::lock_guard<std::mutex> lock(s_frame_mutex);
+
+		s_last_frame_begin = s_frame_begin;
+		s_last_frame_end = time;
+		s_frame_begin = time;
+
+		s_frame.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::vector<thread_events> last_frame(int64_t &frame_begin, int64_t &frame_end)
+	{
+		uint64_t frame;
+
+		{ const std::lock_guard<std::mutex> lock(s_frame_mutex);
+			frame = s_frame.load(std::memory_order_relaxed) - 1;
+			frame_begin = s_last_frame_begin;
+			frame_end = s_last_frame_end;
+		}
+
+		std::vector<thread_events> result;
+
+		const std::lock_guard<std::mutex> lock(s_buffers_mutex);
+
+		for (const auto &buffer : s_buffers)
+		{
+			thread_events thread;
+
+			{ const std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+				thread.thread_index = buffer->thread_index;
+
+				// Walk back from the newest record, a frame is contiguous in the buffer unless other frames interleave on long running scopes
+				for (size_t i = 0; i < buffer->count; i++)
+				{
+					const record &entry = buffer->records[(buffer->write_index + std::size(buffer->records) - 1 - i) % std::size(buffer->records)];
+
+					if (entry.frame == frame)
+					{
+						thread.events.push_back(entry.data);
+					}
+					else if (entry.frame < frame && entry.data.end < frame_begin)
+					{
+						break;
+					}
+				}
+			}
+
+			if (thread.events.empty())
+			{
+				continue;
+			}
+
+			// Records are written when a scope ends, so enclosing scopes come after their children
+			std::sort(thread.events.begin(), thread.events.end(), [](const event &lhs, const event &rhs) {
+				return lhs.begin < rhs.begin || (lhs.begin == rhs.begin && lhs.depth < rhs.depth);
+			});
+
+			result.push_back(std::move(thread));
+		}
+
+		return result;
+	}
+
+	void scope::begin()
+	{
+		thread_buffer &buffer = current_thread_buffer();
+
+		_depth = buffer.depth++;
+		_frame = s_frame.load(std::memory_order_relaxed);
+		_begin = now();
+	}
+	void scope::end()
+	{
+		const int64_t end = now();
+
+		thread_buffer &buffer = current_thread_buffer();
+
+		const std::lock_guard<std::mutex> lock(buffer.mutex);
+
+		buffer.depth = _depth;
+		buffer.records[buffer.write_index] = { { _name, _depth, _begin, end }, _frame };
+		buffer.write_index = (buffer.write_index + 1) % std::size(buffer.records);
+		buffer.count = std::min(buffer.count + 1, std::size(buffer.records));
+	}
+}
@@ -0,0 +1,100 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+namespace reshade::profiler
+{
+	struct event
+	{
+		// Name of the scope, this has to be a string literal, since events outlive the code that recorded them
+		const char *name;
+		// Nesting level of the scope on its thread, zero for scopes no other scope encloses
+		unsigned int depth;
+		// Begin and end in nanoseconds of the high resolution clock
+		int64_t begin, end;
+	};
+	struct thread_events
+	{
+		unsigned int thread_index;
+		// Events sorted by their begin time
+		std::vector<event> events;
+	};
+
+	extern std::atomic<bool> s_enabled;
+
+	/// <summary>
+	/// Check whether scopes are recorded currently. This is the only thing a scope does while the profiler is disabled.
+	/// </summary>
+	inline bool is_enabled() { return s_enabled.load(std::memory_order_relaxed); }
+	/// <summary>
+	/// Start or stop recording scopes.
+	/// </summary>
+	void set_enabled(bool enabled);
+
+	/// <summary>
+	/// Finish the current frame. Scopes that begin from now on belong to the next one.
+	/// </summary>
+	void next_frame();
+	/// <summary>
+	/// Copy the events of the last finished frame out of the buffers of every thread that recorded something in it.
+	/// </summary>
+	/// <param name="frame_begin">Set to the time the frame started.</param>
+	/// <param name="frame_end">Set to the time the frame finished.</param>
+	std::vector<thread_events> last_frame(int64_t &frame_begin, int64_t &frame_end);
+
+#if RESHADE_COUNT_ALLOCATIONS
+	/// <summary>
+	/// Start counting heap allocations. This hooks the debug CRT, so it only sees this module and the libraries built into it, not the application.
+	/// </summary>
+	void install_allocation_hook();
+	/// <summary>
+	/// Get the number of heap allocations the calling thread made since the hook was installed.
+	/// </summary>
+	uint64_t thread_allocation_count();
+#endif
+
+	/// <summary>
+	/// Records the time between its construction and destruction into the ring buffer of the current thread.
+	/// </summary>
+	class scope
+	{
+	public:
+		explicit scope(const char *name) : _name(is_enabled() ? name : nullptr)
+		{
+			if (_name != nullptr)
+			{
+				begin();
+			}
+		}
+		~scope()
+		{
+			if (_name != nullptr)
+			{
+				end();
+			}
+		}
+
+		scope(const scope &) = delete;
+		scope &operator=(const scope &) = delete;
+
+	private:
+		void begin();
+		void end();
+
+		const char *const _name;
+		int64_t _begin = 0;
+		uint64_t _frame = 0;
+		unsigned int _depth = 0;
+	};
+}
+
+#define RESHADE_PROFILE_CONCAT_(a, b) a##b
+#define RESHADE_PROFILE_CONCAT(a, b) RESHADE_PROFILE_CONCAT_(a, b)
+#define RESHADE_PROFILE_SCOPE(name) const reshade::profiler::scope RESHADE_PROFILE_CONCAT(profile_scope_, __COUNTER__)(name)
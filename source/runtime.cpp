@@ -10,6 +10,12 @@
 #include "effect_preprocessor.hpp"
 #include "input.hpp"
 #include "ini_file.hpp"
+#include "png_encoder.hpp"
+#include "profiler.hpp"
+#include "font_atlas_cache.hpp"
+#include "shader_cache.hpp"
+#include "texture_preview_cache.hpp"
+#include "xxhash.h"
 #include <algorithm>
 #include <unordered_set>
 #include <stb_image.h>
@@ -39,6 +45,8 @@ namespace reshade
 		_menu_key_data(),
 		_screenshot_key_data(),
 		_effects_key_data(),
+		_replay_capture_key_data(),
+		_frame_recording_key_data(),
 		_screenshot_path(s_gw2hook_wrkdir_path + "Screenshots"),
 		_variable_editor_height(500)
 	{
@@ -91,17 +99,48 @@ namespace reshade
 		else
 			imgui_io.Fonts->AddFontDefault();
 
+		// Rasterizing the fonts is the slowest part of setting up ImGui, so the result is kept on disk for the next start (device resets keep the atlas in memory already)
+		if (const unsigned long long font_atlas_key = font_atlas_cache::compute_key(*imgui_io.Fonts);
+			!font_atlas_cache::load(*imgui_io.Fonts, font_atlas_key) && imgui_io.Fonts->Build())
+		{
+			font_atlas_cache::save(*imgui_io.Fonts, font_atlas_key);
+		}
+
 		load_config();
 
-		subscribe_to_menu("Home", [this]() { draw_overlay_menu_home(); });
-		subscribe_to_menu("Settings", [this]() { draw_overlay_menu_settings(); });
+		subscribe_to_menu("Home", [this]() { draw_overlay_menu_home(); }, true);
+		subscribe_to_menu("Settings", [this]() { draw_overlay_menu_settings(); }, true);
 		subscribe_to_menu("Gw2 Settings", [this]() { draw_overlay_menu_gw2(); });
-		subscribe_to_menu("Statistics", [this]() { draw_overlay_menu_statistics(); });
-		subscribe_to_menu("Log", [this]() { draw_overlay_menu_log(); });
-		subscribe_to_menu("About", [this]() { draw_overlay_menu_about(); });
+		subscribe_to_menu("Statistics", [this]() { draw_overlay_menu_statistics(); }, true);
+		subscribe_to_menu("Log", [this]() { draw_overlay_menu_log(); }, true);
+		subscribe_to_menu("About", [this]() { draw_overlay_menu_about(); }, true);
 	}
 	runtime::~runtime()
 	{
+		// Also destroys effects that were kept across the last reset, but never restored
+		on_reset_effect();
+
+		// Let the worker write out all queued screenshots before exiting
+		if (_screenshot_worker.joinable())
+		{
+			{ const std::lock_guard<std::mutex> lock(_screenshot_mutex);
+				_screenshot_worker_exit = true;
+			}
+
+			_screenshot_signal.notify_all();
+			_screenshot_worker.join();
+		}
+
+		if (_overlay_worker.joinable())
+		{
+			{ const std::lock_guard<std::mutex> lock(_overlay_mutex);
+				_overlay_worker_exit = true;
+			}
+
+			_overlay_signal.notify_all();
+			_overlay_worker.join();
+		}
+
 		ImGui::DestroyContext(_imgui_context);
 
 		assert(!_is_initialized && _techniques.empty());
@@ -120,6 +159,24 @@ namespace reshade
 		_is_initialized = true;
 		_last_reload_time = std::chrono::high_resolution_clock::now();
 
+		if (_is_effect_restore_pending)
+		{
+			_is_effect_restore_pending = false;
+
+			// The frame size is baked into the shaders through the "BUFFER_WIDTH" and "BUFFER_HEIGHT" macros, so they can only be kept if it did not change
+			if (_width == _restore_width && _height == _restore_height && restore_effect_resources())
+			{
+				LOG(INFO) << "Restored " << _technique_count << " techniques without recompiling.";
+
+				// Contents of the recreated textures were lost, so upload their images again
+				load_textures();
+
+				return true;
+			}
+
+			on_reset_effect();
+		}
+
 		if (!_no_reload_on_init)
 		{
 			reload();
@@ -129,13 +186,31 @@ namespace reshade
 	}
 	void runtime::on_reset()
 	{
-		on_reset_effect();
+		// The frame the worker built may reference the font atlas and effect textures that are destroyed below
+		wait_for_overlay();
+		_overlay_frame_pending = false;
+
+		// Keep compiled effects if nothing is still being loaded and the back-end can recreate their resources after the reset, instead of reloading all of them
+		if (_is_initialized && is_effect_loaded())
+		{
+			stop_texture_loading();
+
+			_is_effect_restore_pending = release_effect_resources();
+		}
+
+		if (!_is_effect_restore_pending)
+		{
+			on_reset_effect();
+		}
 
 		if (!_is_initialized)
 		{
 			return;
 		}
 
+		// Read back pending screenshots while the back-end resources still exist
+		update_screenshot_captures(true);
+
 		// Reset ImGui settings
 		auto &imgui_io = _imgui_context->IO;
 		imgui_io.DisplaySize.x = 0;
@@ -146,15 +221,40 @@ namespace reshade
 
 		LOG(INFO) << "Destroyed runtime environment on runtime " << this << ".";
 
+		_restore_width = _width;
+		_restore_height = _height;
 		_width = _height = 0;
 		_is_initialized = false;
 	}
 	void runtime::on_reset_effect()
 	{
+		stop_effect_compilation();
+		stop_texture_loading();
+
+		// The recording has timings for every technique, which do not survive a reload
+		_frame_recorder.stop();
+
+		_reload_remaining_effects = 0;
+		_is_effect_restore_pending = false;
+		_loading_preset.reset();
+		_effect_reload_state.reset();
+		_suspended_techniques.clear();
+		_compiled_effects.clear();
+
+		stop_cost_profile("the effects were unloaded");
+
 		_textures.clear();
 		_uniforms.clear();
 		_techniques.clear();
 		_uniform_data_storage.clear();
+		_uniform_data_dirty.clear();
+		_baked_uniforms.clear();
+		_uniform_updaters.clear();
+		_texture_index.clear();
+		_uniform_index.clear();
+		_technique_index.clear();
+
+		_effects_generation++;
 
 		_texture_count = 0;
 		_uniform_count = 0;
@@ -162,6 +262,34 @@ namespace reshade
 	}
 	void runtime::on_present()
 	{
+		// Everything the runtime and the hooks did since the last present belongs to the frame that ends here
+		profiler::next_frame();
+
+		RESHADE_PROFILE_SCOPE("runtime::on_present");
+
+		// Clients that are not played do not need to render as fast as they can, which matters when several of them share a GPU
+		_is_in_background = _input->is_window_in_background();
+
+		const bool is_frame_limited = _is_in_background && _background_fps > 0;
+
+		if (is_frame_limited)
+		{
+			RESHADE_PROFILE_SCOPE("Background frame limiter");
+
+			std::this_thread::sleep_until(_last_present_time + std::chrono::microseconds(1000000 / _background_fps));
+		}
+
+#if RESHADE_COUNT_ALLOCATIONS
+		const uint64_t allocation_count = profiler::thread_allocation_count();
+		_frame_allocation_count = allocation_count - _last_allocation_count - _overlay_allocation_count;
+		_last_allocation_count = allocation_count;
+#endif
+
+		const auto time_present_started = std::chrono::high_resolution_clock::now();
+
+		// Take the input that was received since the last present, so everything below sees the same state
+		_input->next_frame();
+
 		// Get current time and date
 		time_t t = std::time(nullptr); tm tm;
 		localtime_s(&tm, &t);
@@ -174,6 +302,19 @@ namespace reshade
 		_framecount++;
 		_last_frame_duration = std::chrono::high_resolution_clock::now() - _last_present_time;
 		_last_present_time += _last_frame_duration;
+		_average_frame_duration.append(std::chrono::duration_cast<std::chrono::nanoseconds>(_last_frame_duration).count());
+		_frame_time_samples.append(_last_frame_duration.count() * 1e-6f);
+
+		// The cost profile compares frame times, which the frame budget would distort by disabling techniques in between
+		// Neither looks at frames stretched by the background frame limiter, whose sleep would look like effects got slower
+		if (_cost_profile_running && !is_frame_limited)
+		{
+			update_cost_profile();
+		}
+		else if (!_cost_profile_running && !is_frame_limited && _frame_budget > 0.0f && is_effect_loaded())
+		{
+			update_frame_budget();
+		}
 
 		// Create and save screenshot if associated shortcut is down
 		if (!_screenshot_key_setting_active &&
@@ -182,563 +323,2051 @@ namespace reshade
 			save_screenshot();
 		}
 
+		// The back-end captures the frame the next time effects are applied, before they change it
+		if (!_replay_capture_key_setting_active && _replay_capture_key_data[0] != 0 &&
+			_input->is_key_pressed(_replay_capture_key_data[0], _replay_capture_key_data[1] != 0, _replay_capture_key_data[2] != 0, _replay_capture_key_data[3] != 0))
+		{
+			_replay_capture_requested = true;
+		}
+
+		if (!_frame_recording_key_setting_active && _frame_recording_key_data[0] != 0 &&
+			_input->is_key_pressed(_frame_recording_key_data[0], _frame_recording_key_data[1] != 0, _frame_recording_key_data[2] != 0, _frame_recording_key_data[3] != 0))
+		{
+			toggle_frame_recording();
+		}
+
+		if (_frame_recorder.is_recording())
+		{
+			record_frame();
+		}
+		if (_publish_telemetry)
+		{
+			publish_telemetry();
+		}
+
+		_effect_cpu_duration = { };
+		// Only valid for the frame that rendered them, a frame with effects disabled renders none
+		_rendered_techniques.clear();
+
+		update_screenshot_captures(false);
+
 		// Draw overlay
+#if RESHADE_COUNT_ALLOCATIONS
+		const uint64_t overlay_allocation_count = profiler::thread_allocation_count();
+#endif
+
 		draw_overlay();
 
-		// Reset input status
-		_input->next_frame();
+#if RESHADE_COUNT_ALLOCATIONS
+		_overlay_allocation_count = profiler::thread_allocation_count() - overlay_allocation_count;
+#endif
 
-		// Update and compile next effect queued for reloading
-		if (_reload_remaining_effects != 0 && _framecount > 1)
+		// The watcher collects changes on its own thread, so this only takes what it found since the last frame
+		if (const size_t known_modifications = _pending_effect_modifications.size();
+			_search_path_watcher != nullptr && _search_path_watcher->check(_pending_effect_modifications))
 		{
-			load_effect(_effect_files[_effect_files.size() - _reload_remaining_effects]);
+			bool is_root_modified = false;
 
-			_last_reload_time = std::chrono::high_resolution_clock::now();
-			_reload_remaining_effects--;
-
-			if (_reload_remaining_effects == 0)
+			for (size_t i = known_modifications; i < _pending_effect_modifications.size(); i++)
 			{
-				load_textures();
+				_directory_index.invalidate(_pending_effect_modifications[i]);
 
-				load_current_preset();
+				is_root_modified |= std::find(_directory_index.roots().begin(), _directory_index.roots().end(), _pending_effect_modifications[i]) != _directory_index.roots().end();
 
-				if (_effect_filter_buffer[0] != '\0' && strcmp(_effect_filter_buffer, "Search") != 0)
+				// Presets can be edited outside of the game, which changes the zones they apply to, their directory itself is reported when too much changed in it to tell what
+				for (const auto &preset_file : _preset_files)
 				{
-					filter_techniques(_effect_filter_buffer);
+					if (preset_file == _pending_effect_modifications[i] || preset_file.parent_path() == _pending_effect_modifications[i])
+					{
+						_preset_files_generation++;
+						break;
+					}
 				}
 			}
+
+			// A watched directory itself is reported when its watch overflowed or stopped, so stop indexing those that are not watched anymore, since changes in them would go unnoticed
+			if (is_root_modified)
+			{
+				_directory_index.set_roots(_search_path_watcher->watched_paths());
+			}
+
+			// Performance mode compiles preset values into the shaders, so only compile effects again while editing
+			if (_performance_mode)
+			{
+				_pending_effect_modifications.clear();
+			}
 		}
 
-		_drawcalls = _vertices = 0;
-	}
-	void runtime::on_present_effect()
-	{
-		if (!_toggle_key_setting_active && _input->is_key_pressed(_effects_key_data[0], _effects_key_data[1] != 0, _effects_key_data[2] != 0, _effects_key_data[3] != 0))
+		// Compile effects again when one of their files was modified, but only when no compilation is in progress, so the changes are picked up once it finished
+		if (_reload_remaining_effects == 0 && !_pending_effect_modifications.empty())
 		{
-			_effects_enabled = !_effects_enabled;
-		}
+			const std::vector<filesystem::path> modifications = std::move(_pending_effect_modifications);
+			_pending_effect_modifications.clear();
 
-		if (!_effects_enabled)
+			reload_modified_effects(modifications);
+		}
+		if (_reload_remaining_effects == 0 && !_pending_macro_modifications.empty())
 		{
-			return;
+			const std::unordered_set<std::string> modifications = std::move(_pending_macro_modifications);
+			_pending_macro_modifications.clear();
+
+			reload_modified_macros(modifications);
 		}
 
-		// Update all uniform variables
-		for (auto &variable : _uniforms)
+		// Update and compile next effect queued for reloading
+		// The workers parse and compile the effects, only the creation of the device objects happens here, in order, one effect per frame
+		if (_reload_remaining_effects != 0 && _framecount > 1 &&
+			_compile_jobs[_compile_jobs.size() - _reload_remaining_effects]->finished.load(std::memory_order_acquire))
 		{
-			const auto it = variable.annotations.find("source");
+			finish_effect(*_compile_jobs[_compile_jobs.size() - _reload_remaining_effects]);
 
-			if (it == variable.annotations.end())
-			{
-				continue;
-			}
+			// Free the syntax tree right away, instead of keeping all of them alive until the reload completed, unless the cache keeps it for the next reload
+			auto &job = *_compile_jobs[_compile_jobs.size() - _reload_remaining_effects];
+			job.module.reset();
+			job.ast.reset();
+			std::string().swap(job.errors);
 
-			const auto source = it->second.as<std::string>();
+			_last_reload_time = std::chrono::high_resolution_clock::now();
+			_reload_remaining_effects--;
 
-			if (source == "frametime")
-			{
-				const float value = _last_frame_duration.count() * 1e-6f;
-				set_uniform_value(variable, &value, 1);
-			}
-			else if (source == "framecount")
-			{
-				switch (variable.basetype)
-				{
-					case uniform_datatype::boolean:
-					{
-						const bool even = (_framecount % 2) == 0;
-						set_uniform_value(variable, &even, 1);
-						break;
-					}
-					case uniform_datatype::signed_integer:
-					case uniform_datatype::unsigned_integer:
-					{
-						const unsigned int framecount = static_cast<unsigned int>(_framecount % UINT_MAX);
-						set_uniform_value(variable, &framecount, 1);
-						break;
-					}
-					case uniform_datatype::floating_point:
-					{
-						const float framecount = static_cast<float>(_framecount % 16777216);
-						set_uniform_value(variable, &framecount, 1);
-						break;
-					}
-				}
-			}
-			else if (source == "pingpong")
+			if (_reload_remaining_effects == 0)
 			{
-				float value[2] = { 0, 0 };
-				get_uniform_value(variable, value, 2);
+				stop_effect_compilation();
 
-				const float min = variable.annotations["min"].as<float>(), max = variable.annotations["max"].as<float>();
-				const float step_min = variable.annotations["step"].as<float>(0), step_max = variable.annotations["step"].as<float>(1);
-				float increment = step_max == 0 ? step_min : (step_min + std::fmodf(static_cast<float>(std::rand()), step_max - step_min + 1));
-				const float smoothing = variable.annotations["smoothing"].as<float>();
+				_loading_preset.reset();
 
-				if (value[1] >= 0)
+				if (_effect_reload_state != nullptr)
 				{
-					increment = std::max(increment - std::max(0.0f, smoothing - (max - value[0])), 0.05f);
-					increment *= _last_frame_duration.count() * 1e-9f;
-
-					if ((value[0] += increment) >= max)
-					{
-						value[0] = max;
-						value[1] = -1;
-					}
+					finish_effect_reload();
 				}
 				else
 				{
-					increment = std::max(increment - std::max(0.0f, smoothing - (value[0] - min)), 0.05f);
-					increment *= _last_frame_duration.count() * 1e-9f;
+					load_textures();
 
-					if ((value[0] -= increment) <= min)
-					{
-						value[0] = min;
-						value[1] = +1;
-					}
+					load_current_preset();
 				}
 
-				set_uniform_value(variable, value, 2);
-			}
-			else if (source == "date")
-			{
-				set_uniform_value(variable, _date, 4);
-			}
-			else if (source == "timer")
-			{
-				const unsigned long long timer = std::chrono::duration_cast<std::chrono::nanoseconds>(_last_present_time - _start_time).count();
-
-				switch (variable.basetype)
+				if (_effect_filter_buffer[0] != '\0' && strcmp(_effect_filter_buffer, "Search") != 0)
 				{
-					case uniform_datatype::boolean:
-					{
-						const bool even = (timer % 2) == 0;
-						set_uniform_value(variable, &even, 1);
-						break;
-					}
-					case uniform_datatype::signed_integer:
-					case uniform_datatype::unsigned_integer:
-					{
-						const unsigned int timer_int = static_cast<unsigned int>(timer % UINT_MAX);
-						set_uniform_value(variable, &timer_int, 1);
-						break;
-					}
-					case uniform_datatype::floating_point:
-					{
-						const float timer_float = std::fmod(static_cast<float>(timer * 1e-6f), 16777216.0f);
-						set_uniform_value(variable, &timer_float, 1);
-						break;
-					}
+					filter_techniques(_effect_filter_buffer);
 				}
-			}
-			else if (source == "key")
-			{
-				const int key = variable.annotations["keycode"].as<int>();
 
-				if (key > 7 && key < 256)
-				{
-					const std::string mode = variable.annotations["mode"].as<std::string>();
+				update_memory_usage();
+				log_memory_usage();
+			}
+		}
 
-					if (mode == "toggle" || variable.annotations["toggle"].as<bool>())
-					{
-						bool current = false;
-						get_uniform_value(variable, &current, 1);
+		if (_texture_jobs_remaining != 0)
+		{
+			upload_loaded_textures();
+		}
 
-						if (_input->is_key_pressed(key))
-						{
-							current = !current;
+		_last_drawcalls = _drawcalls;
+		_last_vertices = _vertices;
+		_drawcalls = _vertices = 0;
 
-							set_uniform_value(variable, &current, 1);
-						}
-					}
-					else if (mode == "press")
-					{
-						const bool state = _input->is_key_pressed(key);
+		_last_present_cpu_duration = std::chrono::high_resolution_clock::now() - time_present_started;
 
-						set_uniform_value(variable, &state, 1);
-					}
-					else
-					{
-						const bool state = _input->is_key_down(key);
+		// Reloading had to wait for the render thread, and is done before the next overlay frame is built, so that one already shows the effects loading
+		if (_overlay_reload_requested)
+		{
+			_overlay_reload_requested = false;
 
-						set_uniform_value(variable, &state, 1);
-					}
-				}
-			}
-			else if (source == "mousepoint")
-			{
-				const float values[2] = { static_cast<float>(_input->mouse_position_x()), static_cast<float>(_input->mouse_position_y()) };
+			reload();
+		}
 
-				set_uniform_value(variable, values, 2);
-			}
-			else if (source == "mousedelta")
+		// The runtime is done with the frame, so the worker can build the overlay from here until the back-end waits for it after presenting
+		if (_overlay_frame_pending)
+		{
+			if (!_overlay_worker.joinable())
 			{
-				const float values[2] = { static_cast<float>(_input->mouse_movement_delta_x()), static_cast<float>(_input->mouse_movement_delta_y()) };
-
-				set_uniform_value(variable, values, 2);
+				_overlay_worker = std::thread(&runtime::overlay_worker_loop, this);
 			}
-			else if (source == "mousebutton")
-			{
-				const int index = variable.annotations["keycode"].as<int>();
 
-				if (index >= 0 && index < 5)
-				{
-					const std::string mode = variable.annotations["mode"].as<std::string>();
+			_overlay_frame_effects_generation = _effects_generation;
 
-					if (mode == "toggle" || variable.annotations["toggle"].as<bool>())
-					{
-						bool current = false;
-						get_uniform_value(variable, &current, 1);
+			{ const std::lock_guard<std::mutex> lock(_overlay_mutex);
+				_overlay_frame_requested = true;
+			}
 
-						if (_input->is_mouse_button_pressed(index))
-						{
-							current = !current;
+			_overlay_signal.notify_all();
+		}
+	}
+	void runtime::toggle_frame_recording()
+	{
+		if (_frame_recorder.is_recording())
+		{
+			_frame_recorder.stop();
+			return;
+		}
 
-							set_uniform_value(variable, &current, 1);
-						}
-					}
-					else if (mode == "press")
-					{
-						const bool state = _input->is_mouse_button_pressed(index);
+		const int hour = _date[3] / 3600;
+		const int minute = (_date[3] - hour * 3600) / 60;
+		const int second = _date[3] - hour * 3600 - minute * 60;
 
-						set_uniform_value(variable, &state, 1);
-					}
-					else
-					{
-						const bool state = _input->is_mouse_button_down(index);
+		char filename[40];
+		ImFormatString(filename, sizeof(filename), "FrameTimes %.4d-%.2d-%.2d %.2d-%.2d-%.2d.bin", _date[0], _date[1], _date[2], hour, minute, second);
 
-						set_uniform_value(variable, &state, 1);
-					}
-				}
-			}
-			else if (source == "random")
-			{
-				const int min = variable.annotations["min"].as<int>(), max = variable.annotations["max"].as<int>();
-				const int value = min + (std::rand() % (max - min + 1));
+		std::vector<std::string> technique_names;
+		technique_names.reserve(_techniques.size());
 
-				set_uniform_value(variable, &value, 1);
-			}
+		for (const auto &technique : _techniques)
+		{
+			technique_names.push_back(technique.name);
 		}
 
-		// Render all enabled techniques
-		for (auto &technique : _techniques)
+		_frame_recorder.start(s_gw2hook_wrkdir_path + filename, technique_names);
+	}
+	void runtime::record_frame()
+	{
+		// Techniques were added since the recording started, so its records no longer line up with them
+		if (_techniques.size() != _frame_recorder.technique_count())
 		{
-			if (technique.timeleft > 0)
-			{
-				technique.timeleft -= static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::milliseconds>(_last_frame_duration).count());
+			LOG(WARNING) << "Stopping frame time recording because the loaded techniques changed.";
 
-				if (technique.timeleft <= 0)
-				{
-					technique.enabled = false;
-					technique.timeleft = 0;
-					technique.average_cpu_duration.clear();
-					technique.average_gpu_duration.clear();
-				}
-			}
-			else if (!_toggle_key_setting_active &&
-				_input->is_key_pressed(technique.toggle_key_data[0], technique.toggle_key_data[1] != 0, technique.toggle_key_data[2] != 0, technique.toggle_key_data[3] != 0) ||
-				(technique.toggle_key_data[0] >= 0x01 && technique.toggle_key_data[0] <= 0x06 && _input->is_mouse_button_pressed(technique.toggle_key_data[0] - 1)))
-			{
-				technique.enabled = !technique.enabled;
-				technique.timeleft = technique.enabled ? technique.timeout : 0;
-			}
+			_frame_recorder.stop();
+			return;
+		}
 
-			if (!technique.enabled)
-			{
-				technique.average_cpu_duration.clear();
-				technique.average_gpu_duration.clear();
-				continue;
-			}
+		const auto overhead = _effect_cpu_duration + _last_present_cpu_duration;
 
-			const auto time_technique_started = std::chrono::high_resolution_clock::now();
+		if (!_frame_recorder.begin_frame(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(_last_present_time - _start_time).count(),
+			_last_frame_duration.count() * 1e-6f,
+			std::chrono::duration_cast<std::chrono::nanoseconds>(overhead).count() * 1e-6f))
+		{
+			return;
+		}
 
-			render_technique(technique);
+		for (size_t i = 0; i < _techniques.size(); i++)
+		{
+			const auto &technique = _techniques[i];
 
-			const auto time_technique_finished = std::chrono::high_resolution_clock::now();
+			// Disabled techniques have no timings, so they are recorded as zero
+			const technique_timings *const timings = technique.timings.get();
 
-			technique.average_cpu_duration.append(std::chrono::duration_cast<std::chrono::nanoseconds>(time_technique_finished - time_technique_started).count());
+			_frame_recorder.set_technique(i,
+				timings != nullptr && timings->cpu_duration_samples.size() != 0 ? timings->cpu_duration_samples[timings->cpu_duration_samples.size() - 1] : 0.0f,
+				timings != nullptr && timings->gpu_duration_samples.size() != 0 ? timings->gpu_duration_samples[timings->gpu_duration_samples.size() - 1] : 0.0f);
 		}
-	}
 
-	void runtime::reload()
+		_frame_recorder.end_frame();
+	}
+	void runtime::publish_telemetry()
 	{
-		on_reset_effect();
+		if (!_telemetry.is_open() && !_telemetry.open())
+		{
+			// Do not retry every frame
+			_publish_telemetry = false;
+			return;
+		}
 
-		_effect_files.clear();
+		const auto last_sample = [](const sample_window<float> &samples) {
+			return samples.size() != 0 ? samples[samples.size() - 1] : 0.0f;
+		};
 
-		std::vector<std::string> fastloading_filenames;
+		// Only the techniques rendered this frame, the last samples of those that were skipped or disabled are from an earlier one
+		float gpu_overhead = 0.0f;
 
-		if (_current_preset >= 0 && _performance_mode && !_show_menu)
+		for (const technique *const technique : _rendered_techniques)
 		{
-			const ini_file preset(_preset_files[_current_preset]);
-
-			// Fast loading: Only load effect files that are actually used in the active preset
-			preset.get("", "Effects", fastloading_filenames);
+			if (technique->timings != nullptr)
+			{
+				gpu_overhead += last_sample(technique->timings->gpu_duration_samples);
+			}
 		}
 
-		_is_fast_loading = !fastloading_filenames.empty();
+		const auto overhead = _effect_cpu_duration + _last_present_cpu_duration;
 
-		if (_is_fast_loading)
+		_telemetry.begin_frame(_framecount,
+			std::chrono::duration_cast<std::chrono::nanoseconds>(_last_present_time - _start_time).count(),
+			_last_frame_duration.count() * 1e-6f,
+			std::chrono::duration_cast<std::chrono::nanoseconds>(overhead).count() * 1e-6f,
+			gpu_overhead,
+			_current_preset >= 0 && static_cast<size_t>(_current_preset) < _preset_files.size() ? _preset_files[_current_preset].string() : std::string());
+
+		for (size_t i = 0; i < _rendered_techniques.size(); i++)
 		{
-			LOG(INFO) << "Loading " << fastloading_filenames.size() << " active effect files";
+			const technique &technique = *_rendered_techniques[i];
+			const technique_timings *const timings = technique.timings.get();
 
-			for (const auto &effect : fastloading_filenames)
-			{
-				LOG(INFO) << "Searching for effect file: " << effect;
+			_telemetry.set_technique(i, technique.name, technique.enabled,
+				timings != nullptr ? last_sample(timings->cpu_duration_samples) : 0.0f,
+				timings != nullptr ? last_sample(timings->gpu_duration_samples) : 0.0f);
+		}
 
-				for (const auto &search_path : _effect_search_paths)
-				{
-					auto effect_file = search_path / effect;
+		_telemetry.end_frame(_rendered_techniques.size());
+	}
+	void runtime::update_memory_usage()
+	{
+		_effect_memory_usage.clear();
 
-					if (exists(effect_file))
-					{
-						LOG(INFO) << ">> Found";
-						_effect_files.push_back(std::move(effect_file));
-						break;
-					}
+		const auto usage_of = [this](const std::string &effect_filename) -> effect_memory_usage & {
+			const auto it = std::find_if(_effect_memory_usage.begin(), _effect_memory_usage.end(), [&effect_filename](const auto &usage) { return usage.effect_filename == effect_filename; });
+			return it != _effect_memory_usage.end() ? *it : _effect_memory_usage.emplace_back(effect_memory_usage { effect_filename });
+		};
 
-					LOG(INFO) << ">> Not Found";
-				}
+		// Textures declared by several effects are counted for the one that declared them first, since that is the one that created them
+		for (const auto &texture : _textures)
+		{
+			if (texture.impl_reference != texture_reference::none || texture.impl == nullptr)
+			{
+				continue;
 			}
+
+			usage_of(texture.effect_filename).texture_size += texture_memory_usage(texture);
 		}
-		else
+		for (const auto &variable : _uniforms)
 		{
-			for (const auto &search_path : _effect_search_paths)
-			{
-				const std::vector<filesystem::path> matching_files = filesystem::list_files(search_path, "*.fx");
+			usage_of(variable.effect_filename).uniform_size += variable.storage_size;
+		}
+		for (const auto &technique : _techniques)
+		{
+			size_t gpu_size = 0, cpu_size = 0;
+			technique_memory_usage(technique, gpu_size, cpu_size);
 
-				_effect_files.insert(_effect_files.end(), matching_files.begin(), matching_files.end());
+			auto &usage = usage_of(technique.effect_filename);
+			usage.technique_size += gpu_size;
+			usage.cpu_size += cpu_size;
+		}
+
+		{
+			const std::lock_guard<std::mutex> lock(_effect_module_cache_mutex);
+
+			for (const auto &module : _effect_module_cache)
+			{
+				usage_of(module.effect_filename).compiler_size += module.size;
 			}
 		}
 
-		_reload_remaining_effects = _effect_files.size();
+		std::sort(_effect_memory_usage.begin(), _effect_memory_usage.end(), [](const auto &lhs, const auto &rhs) {
+			return lhs.texture_size + lhs.technique_size > rhs.texture_size + rhs.technique_size;
+		});
 	}
-	void runtime::load_effect(const filesystem::path &path)
+	void runtime::log_memory_usage() const
 	{
-		LOG(INFO) << "Compiling " << path << " ...";
+		size_t total_gpu_size = 0, total_cpu_size = 0;
 
-		reshadefx::preprocessor pp;
+		for (const auto &usage : _effect_memory_usage)
+		{
+			total_gpu_size += usage.texture_size + usage.technique_size;
+			total_cpu_size += usage.uniform_size + usage.cpu_size + usage.compiler_size;
+		}
 
-		if (path.is_absolute())
+		LOG(INFO) << "Estimated memory usage of the loaded effects is " << total_gpu_size / 1024 << " KiB of video memory and " << total_cpu_size / 1024 << " KiB of system memory:";
+
+		for (const auto &usage : _effect_memory_usage)
 		{
-			pp.add_include_path(path.parent_path());
+			LOG(INFO) << "> " << usage.effect_filename << ": " << usage.texture_size / 1024 << " KiB in textures, " << usage.technique_size / 1024 << " KiB in shaders, " << usage.uniform_size << " bytes of uniforms, " << usage.cpu_size / 1024 << " KiB of system memory and " << usage.compiler_size / 1024 << " KiB of cached syntax trees.";
+		}
+	}
+	void runtime::update_frame_budget()
+	{
+		// Give the moving averages time to settle after each change, so a single spike does not disable anything
+		if (_last_present_time - _last_frame_budget_change < FRAME_BUDGET_SETTLE_TIME)
+		{
+			return;
 		}
 
-		for (const auto &include_path : _effect_search_paths)
+		const uint64_t budget = static_cast<uint64_t>(_frame_budget * 1000000.0f);
+		const uint64_t frame_duration = _average_frame_duration;
+
+		if (frame_duration > budget + budget / 20)
 		{
-			if (include_path.empty())
+			// Disable the first optional technique in priority order that is still running
+			for (const auto &name : _optional_techniques)
 			{
-				continue;
-			}
+				technique *const technique = find_technique(name);
 
-			pp.add_include_path(include_path);
-		}
+				if (technique == nullptr || !technique->enabled)
+				{
+					continue;
+				}
 
-		pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
-		pp.add_macro_definition("__RESHADE_PERFORMANCE_MODE__", _performance_mode ? "1" : "0");
-		pp.add_macro_definition("__VENDOR__", std::to_string(_vendor_id));
-		pp.add_macro_definition("__DEVICE__", std::to_string(_device_id));
-		pp.add_macro_definition("__RENDERER__", std::to_string(_renderer_id));
-		pp.add_macro_definition("__APPLICATION__", std::to_string(std::hash<std::string>()(s_target_executable_path.filename_without_extension().string())));
-		pp.add_macro_definition("BUFFER_WIDTH", std::to_string(_width));
-		pp.add_macro_definition("BUFFER_HEIGHT", std::to_string(_height));
-		pp.add_macro_definition("BUFFER_RCP_WIDTH", std::to_string(1.0f / static_cast<float>(_width)));
-		pp.add_macro_definition("BUFFER_RCP_HEIGHT", std::to_string(1.0f / static_cast<float>(_height)));
+				_suspended_techniques.push_back({ name, technique->timings != nullptr ? static_cast<uint64_t>(technique->timings->average_gpu_duration) : 0 });
 
-		for (const auto &definition : _preprocessor_definitions)
+				technique->enabled = false;
+				technique->timeleft = 0;
+				technique->timings.reset();
+
+				_last_frame_budget_change = _last_present_time;
+
+				LOG(INFO) << "Disabled optional technique '" << name << "' to stay within the frame budget of " << _frame_budget << " ms.";
+				break;
+			}
+		}
+		else if (!_suspended_techniques.empty() && frame_duration + _suspended_techniques.back().gpu_duration < budget - budget / 10)
 		{
-			if (definition.empty())
+			// Restore in reverse order, the techniques that were disabled last are the most important ones
+			const suspended_technique suspended = std::move(_suspended_techniques.back());
+			_suspended_techniques.pop_back();
+
+			if (technique *const technique = find_technique(suspended.name); technique != nullptr)
 			{
-				continue;
+				technique->enabled = true;
+				technique->timeleft = technique->timeout;
 			}
 
-			const size_t equals_index = definition.find_first_of('=');
+			_last_frame_budget_change = _last_present_time;
 
-			if (equals_index != std::string::npos)
-			{
-				pp.add_macro_definition(definition.substr(0, equals_index), definition.substr(equals_index + 1));
-			}
-			else
+			LOG(INFO) << "Restored optional technique '" << suspended.name << "' after the frame time went back under budget.";
+		}
+	}
+	bool runtime::is_technique_suspended(const std::string &name) const
+	{
+		return std::find_if(_suspended_techniques.begin(), _suspended_techniques.end(), [&name](const auto &suspended) { return suspended.name == name; }) != _suspended_techniques.end();
+	}
+	void runtime::clear_technique_suspension(const std::string &name)
+	{
+		// Toggling a suspended technique by hand overrides the frame budget, so it is neither restored later nor saved to the preset as enabled
+		_suspended_techniques.erase(std::remove_if(_suspended_techniques.begin(), _suspended_techniques.end(), [&name](const auto &suspended) { return suspended.name == name; }), _suspended_techniques.end());
+	}
+
+	void runtime::start_cost_profile()
+	{
+		_cost_profile_techniques.clear();
+		_cost_profile_results.clear();
+
+		for (const auto &technique : _techniques)
+		{
+			if (technique.enabled)
 			{
-				pp.add_macro_definition(definition);
+				_cost_profile_techniques.push_back(technique.name);
 			}
 		}
 
-		if (!pp.run(path))
+		if (_cost_profile_techniques.empty())
 		{
-			LOG(ERROR) << "Failed to preprocess " << path << ":\n" << pp.errors();
+			_cost_profile_report = "No techniques are enabled.";
 			return;
 		}
 
-		reshadefx::syntax_tree ast;
-		reshadefx::parser parser(ast);
+		_cost_profile_running = true;
+		_cost_profile_index = 0;
+		_cost_profile_report.clear();
+
+		restart_cost_profile_phase();
 
-		if (!parser.run(pp.current_output()))
+		LOG(INFO) << "Profiling the cost of " << _cost_profile_techniques.size() << " techniques over " << _cost_profile_frames << " frames each.";
+	}
+	void runtime::stop_cost_profile(const char *reason)
+	{
+		if (!_cost_profile_running)
 		{
-			LOG(ERROR) << "Failed to compile " << path << ":\n" << parser.errors();
 			return;
 		}
 
-		if (_performance_mode && _current_preset >= 0)
-		{
-			ini_file preset(_preset_files[_current_preset]);
-
-			for (auto variable : ast.variables)
-			{
-				if (!variable->type.has_qualifier(reshadefx::nodes::type_node::qualifier_uniform) ||
-					variable->initializer_expression == nullptr ||
-					variable->initializer_expression->id != reshadefx::nodeid::literal_expression ||
-					variable->annotation_list.count("source"))
-				{
-					continue;
-				}
-
-				const auto initializer = static_cast<reshadefx::nodes::literal_expression_node *>(variable->initializer_expression);
+		_cost_profile_running = false;
+		_cost_profile_is_excluding = false;
+		_cost_profile_report = std::string("Stopped because ") + reason + '.';
 
-				switch (initializer->type.basetype)
-				{
-				case reshadefx::nodes::type_node::datatype_int:
-					preset.get(path.filename().string(), variable->name, initializer->value_int);
-					break;
-				case reshadefx::nodes::type_node::datatype_bool:
-				case reshadefx::nodes::type_node::datatype_uint:
-					preset.get(path.filename().string(), variable->name, initializer->value_uint);
-					break;
-				case reshadefx::nodes::type_node::datatype_float:
-					preset.get(path.filename().string(), variable->name, initializer->value_float);
-					break;
-				}
+		LOG(WARNING) << "Stopped the technique cost profile because " << reason << '.';
+	}
+	void runtime::update_cost_profile()
+	{
+		// Both halves of the measurement of a technique have to see the same view, the camera also counts as moving when the game does not report it
+		// Frames without any effects, like loading screens or while they are toggled off, do not count either
+		if (_camera_static_frames == 0 || !_effects_enabled || is_effect_suspended())
+		{
+			restart_cost_profile_phase();
+			return;
+		}
 
-				variable->type.qualifiers ^= reshadefx::nodes::type_node::qualifier_uniform;
-				variable->type.qualifiers |= reshadefx::nodes::type_node::qualifier_static | reshadefx::nodes::type_node::qualifier_const;
-			}
+		if (_cost_profile_warmup > 0)
+		{
+			_cost_profile_warmup--;
+			return;
 		}
 
-		std::string errors = parser.errors();
+		_cost_profile_samples.push_back(_last_frame_duration.count() * 1e-6f);
 
-		if (!load_effect(ast, errors))
+		if (_cost_profile_samples.size() < _cost_profile_frames)
 		{
-			LOG(ERROR) << "Failed to compile " << path << ":\n" << errors;
-			_textures.erase(_textures.begin() + _texture_count, _textures.end());
-			_uniforms.erase(_uniforms.begin() + _uniform_count, _uniforms.end());
-			_techniques.erase(_techniques.begin() + _technique_count, _techniques.end());
 			return;
 		}
-		else if (errors.empty())
+
+		// The median ignores the occasional hitch while the game streams in data
+		const auto middle = _cost_profile_samples.begin() + _cost_profile_samples.size() / 2;
+		std::nth_element(_cost_profile_samples.begin(), middle, _cost_profile_samples.end());
+		const float frame_time = *middle;
+
+		_cost_profile_samples.clear();
+		_cost_profile_warmup = COST_PROFILE_WARMUP_FRAMES;
+
+		const std::string &name = _cost_profile_techniques[_cost_profile_index];
+
+		if (!_cost_profile_is_excluding)
 		{
-			LOG(INFO) << "> Successfully compiled.";
+			// Techniques that were disabled since the profile started are left out of the report
+			if (const technique *const technique = find_technique(name); technique != nullptr && technique->enabled)
+			{
+				_cost_profile_frame_time_on = frame_time;
+				_cost_profile_is_excluding = true;
+				return;
+			}
 		}
 		else
 		{
-			LOG(WARNING) << "> Successfully compiled with warnings:\n" << errors;
+			_cost_profile_results.push_back({ name, _cost_profile_frame_time_on, frame_time });
+			_cost_profile_is_excluding = false;
 		}
 
-		for (size_t i = _uniform_count, max = _uniform_count = _uniforms.size(); i < max; i++)
-		{
-			auto &variable = _uniforms[i];
-			variable.effect_filename = path.filename().string();
-			variable.hidden = variable.annotations["hidden"].as<bool>();
-		}
-		for (size_t i = _texture_count, max = _texture_count = _textures.size(); i < max; i++)
+		if (++_cost_profile_index < _cost_profile_techniques.size())
 		{
-			auto &texture = _textures[i];
-			texture.effect_filename = path.filename().string();
+			return;
 		}
-		for (size_t i = _technique_count, max = _technique_count = _techniques.size(); i < max; i++)
+
+		_cost_profile_running = false;
+
+		std::sort(_cost_profile_results.begin(), _cost_profile_results.end(),
+			[](const auto &lhs, const auto &rhs) { return lhs.frame_time_on - lhs.frame_time_off > rhs.frame_time_on - rhs.frame_time_off; });
+
+		char line[256];
+		float total_cost = 0.0f;
+		_cost_profile_report = "Marginal cost and frame time with / without each technique in ms:\n";
+
+		for (const auto &result : _cost_profile_results)
 		{
-			auto &technique = _techniques[i];
-			technique.effect_filename = path.filename().string();
-			technique.enabled = technique.annotations["enabled"].as<bool>();
-			technique.hidden = technique.annotations["hidden"].as<bool>();
-			technique.timeleft = technique.timeout = technique.annotations["timeout"].as<int>();
-			technique.toggle_key_data[0] = technique.annotations["toggle"].as<unsigned int>();
-			technique.toggle_key_data[1] = technique.annotations["togglectrl"].as<bool>() ? 1 : 0;
-			technique.toggle_key_data[2] = technique.annotations["toggleshift"].as<bool>() ? 1 : 0;
-			technique.toggle_key_data[3] = technique.annotations["togglealt"].as<bool>() ? 1 : 0;
+			ImFormatString(line, sizeof(line), "%s: %+.3f (%.3f / %.3f)\n", result.name.c_str(), result.frame_time_on - result.frame_time_off, result.frame_time_on, result.frame_time_off);
+			_cost_profile_report += line;
+			total_cost += result.frame_time_on - result.frame_time_off;
 		}
+
+		ImFormatString(line, sizeof(line), "Total: %+.3f", total_cost);
+		_cost_profile_report += line;
+
+		LOG(INFO) << "Technique cost profile results:\n" << _cost_profile_report;
 	}
-	void runtime::load_textures()
+	void runtime::restart_cost_profile_phase()
 	{
-		LOG(INFO) << "Loading image files for textures ...";
+		// A technique is measured from the start again, since the frame time with it was taken at a different view
+		_cost_profile_is_excluding = false;
+		_cost_profile_samples.clear();
+		_cost_profile_warmup = COST_PROFILE_WARMUP_FRAMES;
+	}
+
+	void runtime::on_present_effect()
+	{
+		if (!_toggle_key_setting_active && _input->is_key_pressed(_effects_key_data[0], _effects_key_data[1] != 0, _effects_key_data[2] != 0, _effects_key_data[3] != 0))
+		{
+			_effects_enabled = !_effects_enabled;
+		}
 
-		for (auto &texture : _textures)
+		if (!_effects_enabled)
 		{
-			if (texture.impl_reference != texture_reference::none)
+			return;
+		}
+
+		const auto time_effects_started = std::chrono::high_resolution_clock::now();
+
+		{
+			RESHADE_PROFILE_SCOPE("Update uniforms");
+
+			update_uniform_variables();
+		}
+
+		RESHADE_PROFILE_SCOPE("Render techniques");
+
+		_rendered_techniques.clear();
+
+		// Collect all enabled techniques first, so back-ends can fuse those that follow each other
+		for (auto &technique : _techniques)
+		{
+			if (technique.timeleft > 0)
 			{
-				continue;
+				technique.timeleft -= static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::milliseconds>(_last_frame_duration).count());
+
+				if (technique.timeleft <= 0)
+				{
+					technique.enabled = false;
+					technique.timeleft = 0;
+					technique.timings.reset();
+				}
 			}
+			else if (!_toggle_key_setting_active &&
+				_input->is_key_pressed(technique.toggle_key_data[0], technique.toggle_key_data[1] != 0, technique.toggle_key_data[2] != 0, technique.toggle_key_data[3] != 0) ||
+				(technique.toggle_key_data[0] >= 0x01 && technique.toggle_key_data[0] <= 0x06 && _input->is_mouse_button_pressed(technique.toggle_key_data[0] - 1)))
+			{
+				technique.enabled = !technique.enabled;
+				technique.timeleft = technique.enabled ? technique.timeout : 0;
 
-			const auto it = texture.annotations.find("source");
+				clear_technique_suspension(technique.name);
+			}
 
-			if (it == texture.annotations.end())
+			if (!technique.enabled)
 			{
+				technique.timings.reset();
+
+				// Free what performance mode does not need, only techniques without a toggle key are unloaded, so pressing one never has to wait for a compile
+				if (_performance_mode && !_show_menu && technique.toggle_key_data[0] == 0 &&
+					_last_present_time - technique.last_enabled_time > TECHNIQUE_UNLOAD_DELAY && !is_technique_suspended(technique.name))
+				{
+					unload_technique(technique);
+				}
 				continue;
 			}
 
-			const filesystem::path path = filesystem::resolve(it->second.as<std::string>(), _texture_search_paths);
+			technique.last_enabled_time = _last_present_time;
 
-			if (!filesystem::exists(path))
+			if (!load_technique(technique))
 			{
-				LOG(ERROR) << "> Source " << path << " for texture '" << texture.name << "' could not be found.";
+				technique.enabled = false;
 				continue;
 			}
 
-			FILE *file;
-			unsigned char *filedata = nullptr;
-			int width = 0, height = 0, channels = 0;
-			bool success = false;
+			// Left out by the cost profile, while it stays enabled, so it is neither unloaded nor saved to the preset as disabled
+			if (_cost_profile_is_excluding && technique.name == _cost_profile_techniques[_cost_profile_index])
+			{
+				continue;
+			}
 
-			if (_wfopen_s(&file, path.wstring().c_str(), L"rb") == 0)
+			// The textures of a technique that only depends on the view still hold its result while the camera stands still, timings only exist once it rendered after being enabled
+			if (technique.static_interval > 0 && technique.timings != nullptr &&
+				_camera_static_frames != 0 && _camera_static_frames % technique.static_interval != 0)
 			{
-				if (stbi_dds_test_file(file))
-				{
-					filedata = stbi_dds_load_from_file(file, &width, &height, &channels, STBI_rgb_alpha);
-				}
-				else
-				{
-					filedata = stbi_load_from_file(file, &width, &height, &channels, STBI_rgb_alpha);
-				}
+				continue;
+			}
+
+			_rendered_techniques.push_back(&technique);
+		}
+
+		for (size_t i = 0; i < _rendered_techniques.size();)
+		{
+			const auto time_technique_started = std::chrono::high_resolution_clock::now();
+
+			size_t count = _fuse_techniques == 0 ? render_fused_techniques(_rendered_techniques.data() + i, _rendered_techniques.size() - i) : 0;
 
-				fclose(file);
+			if (count == 0)
+			{
+				render_technique(*_rendered_techniques[i]);
+				count = 1;
 			}
 
-			if (filedata != nullptr)
+			const auto time_technique_finished = std::chrono::high_resolution_clock::now();
+
+			// Fused techniques share the time it took to render them
+			const auto cpu_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(time_technique_finished - time_technique_started).count() / static_cast<long long>(count);
+
+			for (const size_t end = i + count; i < end; i++)
 			{
-				if (texture.width != static_cast<unsigned int>(width) ||
-					texture.height != static_cast<unsigned int>(height))
-				{
-					LOG(INFO) << "> Resizing image data for texture '" << texture.name << "' from " << width << "x" << height << " to " << texture.width << "x" << texture.height << " ...";
+				auto &timings = _rendered_techniques[i]->timings;
 
-					std::vector<uint8_t> resized(texture.width * texture.height * 4);
-					stbir_resize_uint8(filedata, width, height, 0, resized.data(), texture.width, texture.height, 0, 4);
-					success = update_texture(texture, resized.data());
+				if (timings == nullptr)
+				{
+					timings = std::make_unique<technique_timings>(_statistics_window);
 				}
-				else
+				else if (timings->cpu_duration_samples.capacity() != _statistics_window)
 				{
-					success = update_texture(texture, filedata);
+					timings->cpu_duration_samples.resize(_statistics_window);
+					timings->gpu_duration_samples.resize(_statistics_window);
 				}
 
-				stbi_image_free(filedata);
-			}
-
-			if (!success)
-			{
-				LOG(ERROR) << "> Source " << path << " for texture '" << texture.name << "' could not be loaded! Make sure it is of a compatible file format.";
-				continue;
+				timings->average_cpu_duration.append(cpu_duration);
+				timings->cpu_duration_samples.append(cpu_duration * 1e-6f);
 			}
 		}
-	}
 
-	void runtime::load_config()
+		_effect_cpu_duration += std::chrono::high_resolution_clock::now() - time_effects_started;
+	}
+	void runtime::append_pass_gpu_duration(technique &technique, size_t pass_index, const std::string &pass_name, uint64_t duration)
 	{
-		const ini_file config(_configuration_path);
+		if (technique.timings == nullptr)
+		{
+			return;
+		}
 
-		config.get("INPUT", "KeyMenu", _menu_key_data);
-		config.get("INPUT", "KeyScreenshot", _screenshot_key_data);
-		config.get("INPUT", "KeyEffects", _effects_key_data);
-		config.get("INPUT", "InputProcessing", _input_processing_mode);
+		auto &passes = technique.timings->passes;
+
+		if (passes.size() != technique.passes.size())
+		{
+			passes.resize(technique.passes.size());
+		}
+
+		if (pass_index >= passes.size())
+		{
+			return;
+		}
+
+		if (passes[pass_index].name.empty())
+		{
+			passes[pass_index].name = pass_name.empty() ? "Pass " + std::to_string(pass_index) : pass_name;
+		}
+
+		passes[pass_index].average_gpu_duration.append(duration);
+	}
+	void runtime::update_uniform_variables()
+	{
+		// Update all uniform variables that have a source
+		for (const auto &updater : _uniform_updaters)
+		{
+			auto &variable = _uniforms[updater.uniform_index];
+
+			switch (updater.source)
+			{
+				case uniform_source::frametime:
+				{
+					const float value = _last_frame_duration.count() * 1e-6f;
+					set_uniform_value(variable, &value, 1);
+					break;
+				}
+				case uniform_source::framecount:
+				{
+					switch (variable.basetype)
+					{
+						case uniform_datatype::boolean:
+						{
+							const bool even = (_framecount % 2) == 0;
+							set_uniform_value(variable, &even, 1);
+							break;
+						}
+						case uniform_datatype::signed_integer:
+						case uniform_datatype::unsigned_integer:
+						{
+							const unsigned int framecount = static_cast<unsigned int>(_framecount % UINT_MAX);
+							set_uniform_value(variable, &framecount, 1);
+							break;
+						}
+						case uniform_datatype::floating_point:
+						{
+							const float framecount = static_cast<float>(_framecount % 16777216);
+							set_uniform_value(variable, &framecount, 1);
+							break;
+						}
+					}
+					break;
+				}
+				case uniform_source::pingpong:
+				{
+					float value[2] = { 0, 0 };
+					get_uniform_value(variable, value, 2);
+
+					const float min = updater.pingpong_min, max = updater.pingpong_max;
+					const float step_min = updater.pingpong_step_min, step_max = updater.pingpong_step_max;
+					float increment = step_max == 0 ? step_min : (step_min + std::fmodf(static_cast<float>(std::rand()), step_max - step_min + 1));
+					const float smoothing = updater.pingpong_smoothing;
+
+					if (value[1] >= 0)
+					{
+						increment = std::max(increment - std::max(0.0f, smoothing - (max - value[0])), 0.05f);
+						increment *= _last_frame_duration.count() * 1e-9f;
+
+						if ((value[0] += increment) >= max)
+						{
+							value[0] = max;
+							value[1] = -1;
+						}
+					}
+					else
+					{
+						increment = std::max(increment - std::max(0.0f, smoothing - (value[0] - min)), 0.05f);
+						increment *= _last_frame_duration.count() * 1e-9f;
+
+						if ((value[0] -= increment) <= min)
+						{
+							value[0] = min;
+							value[1] = +1;
+						}
+					}
+
+					set_uniform_value(variable, value, 2);
+					break;
+				}
+				case uniform_source::date:
+				{
+					set_uniform_value(variable, _date, 4);
+					break;
+				}
+				case uniform_source::timer:
+				{
+					const unsigned long long timer = std::chrono::duration_cast<std::chrono::nanoseconds>(_last_present_time - _start_time).count();
+
+					switch (variable.basetype)
+					{
+						case uniform_datatype::boolean:
+						{
+							const bool even = (timer % 2) == 0;
+							set_uniform_value(variable, &even, 1);
+							break;
+						}
+						case uniform_datatype::signed_integer:
+						case uniform_datatype::unsigned_integer:
+						{
+							const unsigned int timer_int = static_cast<unsigned int>(timer % UINT_MAX);
+							set_uniform_value(variable, &timer_int, 1);
+							break;
+						}
+						case uniform_datatype::floating_point:
+						{
+							const float timer_float = std::fmod(static_cast<float>(timer * 1e-6f), 16777216.0f);
+							set_uniform_value(variable, &timer_float, 1);
+							break;
+						}
+					}
+					break;
+				}
+				case uniform_source::key:
+				case uniform_source::mousebutton:
+				{
+					const bool is_key = updater.source == uniform_source::key;
+
+					if (updater.key_mode == uniform_key_mode::toggle)
+					{
+						bool current = false;
+						get_uniform_value(variable, &current, 1);
+
+						if (is_key ? _input->is_key_pressed(updater.keycode) : _input->is_mouse_button_pressed(updater.keycode))
+						{
+							current = !current;
+
+							set_uniform_value(variable, &current, 1);
+						}
+					}
+					else if (updater.key_mode == uniform_key_mode::press)
+					{
+						const bool state = is_key ? _input->is_key_pressed(updater.keycode) : _input->is_mouse_button_pressed(updater.keycode);
+
+						set_uniform_value(variable, &state, 1);
+					}
+					else
+					{
+						const bool state = is_key ? _input->is_key_down(updater.keycode) : _input->is_mouse_button_down(updater.keycode);
+
+						set_uniform_value(variable, &state, 1);
+					}
+					break;
+				}
+				case uniform_source::mousepoint:
+				{
+					const float values[2] = { static_cast<float>(_input->mouse_position_x()), static_cast<float>(_input->mouse_position_y()) };
+
+					set_uniform_value(variable, values, 2);
+					break;
+				}
+				case uniform_source::mousedelta:
+				{
+					const float values[2] = { static_cast<float>(_input->mouse_movement_delta_x()), static_cast<float>(_input->mouse_movement_delta_y()) };
+
+					set_uniform_value(variable, values, 2);
+					break;
+				}
+				case uniform_source::random:
+				{
+					const int value = updater.random_min + (std::rand() % (updater.random_max - updater.random_min + 1));
+
+					set_uniform_value(variable, &value, 1);
+					break;
+				}
+				case uniform_source::camerastatic:
+				{
+					set_uniform_value(variable, &_camera_static_frames, 1);
+					break;
+				}
+			}
+		}
+	}
+
+	// Next to the shader folder, so it is distributed together with the effects
+	static filesystem::path effect_package_path()
+	{
+		return runtime::s_gw2hook_wrkdir_path + "Shaders.pack";
+	}
+
+	void runtime::reload()
+	{
+		if (std::this_thread::get_id() == _overlay_worker.get_id())
+		{
+			_overlay_reload_requested = true;
+			return;
+		}
+
+		on_reset_effect();
+
+		// Machines that got the effects together with a package of their compiled shaders do not have to compile them on the first launch
+		if (const uint64_t modified = filesystem::last_write_time(effect_package_path()); modified != 0 && modified != _imported_effect_package_time)
+		{
+			_imported_effect_package_time = modified;
+
+			LOG(INFO) << "Imported " << shader_cache::import_package(effect_package_path()) << " shaders from effect package " << effect_package_path() << ".";
+		}
+
+		// Everything is compiled again, so afterwards the shader cache knows which shaders the current effects use
+		shader_cache::clear_used_keys();
+
+		_effect_files.clear();
+
+		std::vector<std::string> fastloading_filenames;
+
+		if (_current_preset >= 0 && _performance_mode && !_show_menu)
+		{
+			_loading_preset = std::make_unique<ini_file>(_preset_files[_current_preset]);
+
+			// Fast loading: Only load effect files that are actually used in the active preset
+			_loading_preset->get("", "Effects", fastloading_filenames);
+		}
+
+		_is_fast_loading = !fastloading_filenames.empty();
+
+		update_search_path_watchers();
+
+		if (_is_fast_loading)
+		{
+			LOG(INFO) << "Loading " << fastloading_filenames.size() << " active effect files";
+
+			for (const auto &effect : fastloading_filenames)
+			{
+				LOG(INFO) << "Searching for effect file: " << effect;
+
+				for (const auto &search_path : _effect_search_paths)
+				{
+					auto effect_file = search_path / effect;
+
+					if (_directory_index.exists(effect_file))
+					{
+						LOG(INFO) << ">> Found";
+						_effect_files.push_back(std::move(effect_file));
+						break;
+					}
+
+					LOG(INFO) << ">> Not Found";
+				}
+			}
+		}
+		else
+		{
+			for (const auto &search_path : _effect_search_paths)
+			{
+				const std::vector<filesystem::path> matching_files = _directory_index.list_files(search_path, ".fx");
+
+				_effect_files.insert(_effect_files.end(), matching_files.begin(), matching_files.end());
+			}
+		}
+
+		_reload_remaining_effects = _effect_files.size();
+
+		// Everything is compiled from scratch, so modifications from before do not matter anymore
+		_pending_effect_modifications.clear();
+		_pending_macro_modifications.clear();
+
+		start_effect_compilation(_effect_files);
+	}
+	void runtime::update_search_path_watchers()
+	{
+		std::vector<filesystem::path> watched_paths;
+
+		for (const auto *const search_paths : { &_effect_search_paths, &_texture_search_paths })
+		{
+			for (const auto &search_path : *search_paths)
+			{
+				if (!search_path.empty() && filesystem::exists(search_path) &&
+					std::find(watched_paths.begin(), watched_paths.end(), search_path) == watched_paths.end())
+				{
+					watched_paths.push_back(search_path);
+				}
+			}
+		}
+
+		// Watch the directories of the presets as well, so edits made to them outside of the game are noticed without checking every file
+		for (const auto &preset_file : _preset_files)
+		{
+			if (const filesystem::path preset_path = preset_file.parent_path(); !preset_path.empty() && filesystem::exists(preset_path) &&
+				std::find(watched_paths.begin(), watched_paths.end(), preset_path) == watched_paths.end())
+			{
+				watched_paths.push_back(preset_path);
+			}
+		}
+
+		// Keep the watcher and the index when nothing changed, since changes that happen without a watcher would be missed
+		if (watched_paths == _directory_index.roots() && (_search_path_watcher != nullptr || watched_paths.empty()))
+		{
+			return;
+		}
+
+		_search_path_watcher.reset();
+
+		if (!watched_paths.empty())
+		{
+			_search_path_watcher = std::make_unique<filesystem::directory_watcher>(watched_paths);
+		}
+
+		// Start indexing only after the watcher exists, so nothing that is listed from now on can change unnoticed
+		// Directories that failed to get a watch are left out and always listed from disk, the next reload tries to watch them again
+		_directory_index.set_roots(_search_path_watcher != nullptr ? _search_path_watcher->watched_paths() : watched_paths);
+	}
+	void runtime::reload_modified_effects(const std::vector<filesystem::path> &modifications)
+	{
+		// A search path itself is reported when too much changed in it to tell what, so treat that as everything having changed, which includes files being added
+		for (const auto &path : modifications)
+		{
+			if (std::find(_effect_search_paths.begin(), _effect_search_paths.end(), path) != _effect_search_paths.end() ||
+				std::find(_texture_search_paths.begin(), _texture_search_paths.end(), path) != _texture_search_paths.end())
+			{
+				reload();
+				return;
+			}
+		}
+
+		std::vector<filesystem::path> effect_files;
+
+		for (const auto &effect : _compiled_effects)
+		{
+			for (const auto &path : modifications)
+			{
+				if (path == effect.path || std::find(effect.included_files.begin(), effect.included_files.end(), path) != effect.included_files.end())
+				{
+					effect_files.push_back(effect.path);
+					break;
+				}
+			}
+		}
+
+		if (!effect_files.empty())
+		{
+			reload_effects(std::move(effect_files));
+		}
+	}
+	void runtime::reload_modified_macros(const std::unordered_set<std::string> &modifications)
+	{
+		std::vector<filesystem::path> effect_files;
+
+		for (const auto &effect : _compiled_effects)
+		{
+			if (std::any_of(modifications.begin(), modifications.end(), [&effect](const std::string &name) { return effect.used_macros.count(name) != 0; }))
+			{
+				effect_files.push_back(effect.path);
+			}
+		}
+
+		if (!effect_files.empty())
+		{
+			reload_effects(std::move(effect_files));
+		}
+	}
+	void runtime::reload_effects(std::vector<filesystem::path> effect_files)
+	{
+		std::unordered_set<std::string> effect_filenames;
+
+		for (const auto &path : effect_files)
+		{
+			effect_filenames.insert(path.filename().string());
+		}
+
+		// Passes of other effects may reference textures one of these effects declared first, which are destroyed with it, so those effects have to be compiled again as well
+		for (bool added = true; added;)
+		{
+			added = false;
+
+			for (const auto &effect : _compiled_effects)
+			{
+				if (effect_filenames.count(effect.path.filename().string()) != 0)
+				{
+					continue;
+				}
+
+				for (const auto &name : effect.texture_names)
+				{
+					const texture *const texture = find_texture(name);
+
+					if (texture != nullptr && effect_filenames.count(texture->effect_filename) != 0)
+					{
+						effect_files.push_back(effect.path);
+						effect_filenames.insert(effect.path.filename().string());
+						added = true;
+						break;
+					}
+				}
+			}
+		}
+
+		LOG(INFO) << "Recompiling " << effect_files.size() << " effect files affected by modifications ...";
+
+		// Texture jobs refer to textures by index, which changes below
+		stop_texture_loading();
+
+		auto state = std::make_unique<effect_reload_state>();
+
+		for (const auto &technique : _techniques)
+		{
+			state->technique_order.push_back(technique.name);
+		}
+
+		// Destroy the techniques before the textures their passes reference
+		for (auto it = _techniques.begin(); it != _techniques.end();)
+		{
+			if (effect_filenames.count(it->effect_filename) == 0)
+			{
+				++it;
+				continue;
+			}
+
+			it->impl.reset();
+			it->passes.clear();
+
+			state->techniques.push_back(std::move(*it));
+			it = _techniques.erase(it);
+		}
+		for (auto it = _uniforms.begin(); it != _uniforms.end();)
+		{
+			if (effect_filenames.count(it->effect_filename) == 0)
+			{
+				++it;
+				continue;
+			}
+
+			// The uniform storage only grows until the next full reload, so the old values can still be read from it later
+			state->uniforms.push_back(std::move(*it));
+			it = _uniforms.erase(it);
+		}
+
+		_effects_generation++;
+
+		_textures.erase(std::remove_if(_textures.begin(), _textures.end(),
+			[&effect_filenames](const auto &texture) { return effect_filenames.count(texture.effect_filename) != 0; }), _textures.end());
+		_compiled_effects.erase(std::remove_if(_compiled_effects.begin(), _compiled_effects.end(),
+			[&effect_filenames](const auto &effect) { return effect_filenames.count(effect.path.filename().string()) != 0; }), _compiled_effects.end());
+
+		_texture_count = _textures.size();
+		_uniform_count = _uniforms.size();
+		_technique_count = _techniques.size();
+		_selected_technique = -1;
+
+		update_uniform_updaters();
+
+		state->first_texture = _textures.size();
+
+		_effect_reload_state = std::move(state);
+		_reload_remaining_effects = effect_files.size();
+
+		start_effect_compilation(effect_files);
+	}
+	void runtime::finish_effect_reload()
+	{
+		const std::unique_ptr<effect_reload_state> state = std::move(_effect_reload_state);
+
+		// Only the textures of the recompiled effects lost their contents
+		load_textures(state->first_texture);
+
+		for (const auto &old : state->uniforms)
+		{
+			uniform *const variable = find_uniform(old.effect_filename, old.name);
+
+			// Keep the value the uniform had before the modification, unless its type changed
+			if (variable == nullptr || old.basetype != variable->basetype || old.storage_size != variable->storage_size)
+			{
+				continue;
+			}
+
+			std::vector<unsigned char> data(variable->storage_size);
+			get_uniform_value(old, data.data(), data.size());
+			set_uniform_value(*variable, data.data(), data.size());
+		}
+
+		for (const auto &old : state->techniques)
+		{
+			technique *const technique = find_technique(old.name);
+
+			if (technique == nullptr)
+			{
+				continue;
+			}
+
+			technique->enabled = old.enabled;
+			technique->timeleft = old.timeleft;
+			std::copy(std::begin(old.toggle_key_data), std::end(old.toggle_key_data), technique->toggle_key_data);
+		}
+
+		// Techniques that were added by the modification are moved to the end
+		std::unordered_map<std::string, size_t> order;
+		for (size_t i = 0; i < state->technique_order.size(); i++)
+			order.emplace(state->technique_order[i], i);
+
+		const auto position = [&order](const technique &technique) {
+			const auto it = order.find(technique.name);
+			return it != order.end() ? it->second : order.size();
+		};
+
+		std::stable_sort(_techniques.begin(), _techniques.end(),
+			[&position](const auto &lhs, const auto &rhs) { return position(lhs) < position(rhs); });
+
+		on_techniques_reordered();
+	}
+	// Turns "NAME=VALUE" into its name and value, a definition without a value is set to one
+	static std::pair<std::string, std::string> split_preprocessor_definition(const std::string &definition)
+	{
+		const size_t equals_index = definition.find_first_of('=');
+
+		if (equals_index != std::string::npos)
+		{
+			return { definition.substr(0, equals_index), definition.substr(equals_index + 1) };
+		}
+
+		return { definition, "1" };
+	}
+
+	void runtime::start_effect_compilation(const std::vector<filesystem::path> &effect_files)
+	{
+		stop_effect_compilation();
+
+		// Take a snapshot of all settings the front-end needs, since the worker threads must not touch runtime state that the overlay may change meanwhile
+		_compile_settings.include_paths.clear();
+		_compile_settings.macros.clear();
+		_compile_settings.preset_path.clear();
+		_compile_settings.include_cache = std::make_shared<reshadefx::include_cache>();
+		_compile_settings.half_precision_shaders = _half_precision_shaders;
+
+		for (const auto &include_path : _effect_search_paths)
+		{
+			if (include_path.empty())
+			{
+				continue;
+			}
+
+			_compile_settings.include_paths.push_back(include_path);
+		}
+
+		_compile_settings.macros.emplace_back("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
+		_compile_settings.macros.emplace_back("__RESHADE_PERFORMANCE_MODE__", _performance_mode ? "1" : "0");
+		_compile_settings.macros.emplace_back("__VENDOR__", std::to_string(_vendor_id));
+		_compile_settings.macros.emplace_back("__DEVICE__", std::to_string(_device_id));
+		_compile_settings.macros.emplace_back("__RENDERER__", std::to_string(_renderer_id));
+		_compile_settings.macros.emplace_back("__APPLICATION__", std::to_string(std::hash<std::string>()(s_target_executable_path.filename_without_extension().string())));
+		_compile_settings.macros.emplace_back("BUFFER_WIDTH", std::to_string(_width));
+		_compile_settings.macros.emplace_back("BUFFER_HEIGHT", std::to_string(_height));
+		_compile_settings.macros.emplace_back("BUFFER_RCP_WIDTH", std::to_string(1.0f / static_cast<float>(_width)));
+		_compile_settings.macros.emplace_back("BUFFER_RCP_HEIGHT", std::to_string(1.0f / static_cast<float>(_height)));
+
+		for (const auto &definition : _preprocessor_definitions)
+		{
+			if (definition.empty())
+			{
+				continue;
+			}
+
+			_compile_settings.macros.push_back(split_preprocessor_definition(definition));
+		}
+
+		if (_performance_mode && _current_preset >= 0)
+		{
+			_compile_settings.preset_path = _preset_files[_current_preset];
+		}
+
+		for (const auto &path : effect_files)
+		{
+			auto &job = *_compile_jobs.emplace_back(std::make_unique<effect_compile_job>());
+			job.path = path;
+		}
+
+		if (_compile_jobs.empty())
+		{
+			return;
+		}
+
+		// Leave one core to the render thread
+		const unsigned int hardware_threads = std::thread::hardware_concurrency();
+		const size_t num_workers = std::min(_compile_jobs.size(), static_cast<size_t>(hardware_threads > 2 ? hardware_threads - 1 : 1));
+
+		_compile_next_job = 0;
+		_compile_cancelled = false;
+
+		for (size_t i = 0; i < num_workers; i++)
+		{
+			_compile_workers.emplace_back(&runtime::compile_worker_loop, this);
+		}
+	}
+	void runtime::stop_effect_compilation()
+	{
+		_compile_cancelled = true;
+
+		for (auto &worker : _compile_workers)
+		{
+			worker.join();
+		}
+
+		_compile_workers.clear();
+		_compile_jobs.clear();
+
+		// Included files are only read while preprocessing, so do not hold on to their contents until the next reload
+		_compile_settings.include_cache.reset();
+	}
+	void runtime::compile_worker_loop()
+	{
+		while (!_compile_cancelled)
+		{
+			const size_t index = _compile_next_job++;
+
+			if (index >= _compile_jobs.size())
+			{
+				break;
+			}
+
+			auto &job = *_compile_jobs[index];
+
+			parse_effect(job);
+
+			// Generating the shader code and compiling it takes the most time, so the back-end does that here too and leaves only the creation of the device objects to the render thread
+			if (job.ast != nullptr && !_compile_cancelled)
+			{
+				job.module = compile_effect(*job.ast, job.errors, _compile_settings.half_precision_shaders);
+			}
+
+			job.finished.store(true, std::memory_order_release);
+		}
+	}
+	// Enough for every effect of a few presets with different preprocessor definitions, without keeping the syntax trees of effects that were long removed or growing the working set without bounds in long sessions
+	static const size_t s_effect_module_cache_size = 64;
+	static const size_t s_effect_module_cache_budget = 32 * 1024 * 1024;
+
+	static unsigned long long compute_effect_module_key(const std::vector<reshadefx::token> &tokens, bool is_preset_baked)
+	{
+		XXH64_state_t state;
+		XXH64_reset(&state, 0);
+		XXH64_update(&state, &is_preset_baked, sizeof(is_preset_baked));
+
+		const std::string *source = nullptr;
+
+		for (const auto &token : tokens)
+		{
+			// Locations end up in the syntax tree and in warnings, so they have to match too, but the file name only changes at the boundaries of included files
+			if (source == nullptr || token.location.source != *source)
+			{
+				source = &token.location.source;
+				XXH64_update(&state, source->data(), source->size() + 1);
+			}
+
+			XXH64_update(&state, &token.id, sizeof(token.id));
+			XXH64_update(&state, &token.location.line, sizeof(token.location.line));
+			XXH64_update(&state, &token.location.column, sizeof(token.location.column));
+			XXH64_update(&state, token.literal_as_string.data(), token.literal_as_string.size() + 1);
+
+			// The literal value is only set on number tokens
+			switch (token.id)
+			{
+			case reshadefx::tokenid::int_literal:
+			case reshadefx::tokenid::uint_literal:
+			case reshadefx::tokenid::float_literal:
+			case reshadefx::tokenid::double_literal:
+				XXH64_update(&state, &token.literal_as_double, sizeof(token.literal_as_double));
+				break;
+			}
+		}
+
+		return XXH64_digest(&state);
+	}
+
+	void runtime::parse_effect(effect_compile_job &job) const
+	{
+		const filesystem::path &path = job.path;
+
+		LOG(INFO) << "Compiling " << path << " ...";
+
+		reshadefx::preprocessor pp;
+		pp.set_include_cache(_compile_settings.include_cache);
+		pp.set_token_output(true);
+
+		if (path.is_absolute())
+		{
+			pp.add_include_path(path.parent_path());
+		}
+
+		for (const auto &include_path : _compile_settings.include_paths)
+		{
+			pp.add_include_path(include_path);
+		}
+
+		for (const auto &macro : _compile_settings.macros)
+		{
+			pp.add_macro_definition(macro.first, macro.second);
+		}
+
+		const bool preprocessed = pp.run(path, job.included_files);
+
+		// Even an effect that failed may only need a definition to be changed, like one that triggers an '#error'
+		job.used_macros = pp.used_macros();
+
+		if (!preprocessed)
+		{
+			LOG(ERROR) << "Failed to preprocess " << path << ":\n" << pp.errors();
+			return;
+		}
+
+		// Performance mode turns uniforms into constants with the preset values while parsing, so the constant folding already sees them in every expression that follows
+		std::unique_ptr<ini_file> preset;
+
+		if (!_compile_settings.preset_path.empty())
+		{
+			preset = std::make_unique<ini_file>(_compile_settings.preset_path);
+		}
+
+		const unsigned long long key = compute_effect_module_key(pp.current_tokens(), preset != nullptr);
+
+		// Reloading after switching presets or changing unrelated preprocessor definitions mostly yields the same tokens as before, which parse to the same syntax tree again
+		{
+			const std::lock_guard<std::mutex> lock(_effect_module_cache_mutex);
+
+			const auto it = std::find_if(_effect_module_cache.begin(), _effect_module_cache.end(), [key, &preset](const cached_effect_module &module) {
+				return module.key == key && std::all_of(module.baked_uniforms.begin(), module.baked_uniforms.end(), [&preset](const baked_uniform &baked) {
+					std::vector<std::string> preset_value;
+					preset->get(baked.effect_filename, baked.name, preset_value);
+					return preset_value == baked.preset_value;
+				});
+			});
+
+			if (it != _effect_module_cache.end())
+			{
+				_effect_module_cache.splice(_effect_module_cache.begin(), _effect_module_cache, it);
+
+				LOG(INFO) << "> Reusing syntax tree from a previous reload.";
+
+				job.errors = it->errors;
+				job.baked_uniforms = it->baked_uniforms;
+				job.ast = it->ast;
+				return;
+			}
+		}
+
+		auto ast = std::make_unique<reshadefx::syntax_tree>();
+		reshadefx::parser parser(*ast);
+
+		if (preset != nullptr)
+		{
+
+			parser.set_uniform_callback([&job, &preset, &path](reshadefx::nodes::variable_declaration_node *variable) {
+				if (variable->initializer_expression->id != reshadefx::nodeid::literal_expression ||
+					variable->annotation_list.count("source"))
+				{
+					return;
+				}
+
+				const auto initializer = static_cast<reshadefx::nodes::literal_expression_node *>(variable->initializer_expression);
+
+				switch (initializer->type.basetype)
+				{
+				case reshadefx::nodes::type_node::datatype_int:
+					preset->get(path.filename().string(), variable->name, initializer->value_int);
+					break;
+				case reshadefx::nodes::type_node::datatype_bool:
+				case reshadefx::nodes::type_node::datatype_uint:
+					preset->get(path.filename().string(), variable->name, initializer->value_uint);
+					break;
+				case reshadefx::nodes::type_node::datatype_float:
+					preset->get(path.filename().string(), variable->name, initializer->value_float);
+					break;
+				}
+
+				auto &baked = job.baked_uniforms.emplace_back();
+				baked.effect_filename = path.filename().string();
+				baked.name = variable->name;
+				preset->get(baked.effect_filename, baked.name, baked.preset_value);
+
+				variable->type.qualifiers ^= reshadefx::nodes::type_node::qualifier_uniform;
+				variable->type.qualifiers |= reshadefx::nodes::type_node::qualifier_static | reshadefx::nodes::type_node::qualifier_const;
+			});
+		}
+
+		if (!parser.run(pp.current_tokens()))
+		{
+			LOG(ERROR) << "Failed to compile " << path << ":\n" << parser.errors();
+			return;
+		}
+
+		job.errors = parser.errors();
+		job.ast = std::move(ast);
+
+		const size_t size = job.ast->memory_usage();
+
+		LOG(INFO) << "> Syntax tree takes " << size / 1024 << " KiB.";
+
+		const std::lock_guard<std::mutex> lock(_effect_module_cache_mutex);
+
+		_effect_module_cache.push_front({ key, path.filename().string(), size, job.ast, job.errors, job.baked_uniforms });
+
+		size_t cache_size = 0, index = 0;
+
+		for (auto it = _effect_module_cache.begin(); it != _effect_module_cache.end(); ++index)
+		{
+			cache_size += it->size;
+
+			// Always keep the tree that was just added, even if it is larger than the whole budget, the next reload of this effect needs it most
+			if (index != 0 && (index >= s_effect_module_cache_size || cache_size > s_effect_module_cache_budget))
+			{
+				cache_size -= it->size;
+				it = _effect_module_cache.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+	void runtime::finish_effect(effect_compile_job &job)
+	{
+		const filesystem::path &path = job.path;
+
+		// Track effects that failed to compile too, so they are compiled again once the error was fixed
+		auto &effect = _compiled_effects.emplace_back();
+		effect.path = path;
+		effect.included_files = std::move(job.included_files);
+		effect.used_macros = std::move(job.used_macros);
+
+		if (job.ast == nullptr)
+		{
+			return;
+		}
+
+		for (const auto variable : job.ast->variables)
+		{
+			if (variable->type.is_texture())
+			{
+				effect.texture_names.push_back(variable->unique_name);
+			}
+		}
+
+		std::string &errors = job.errors;
+
+		if (job.module == nullptr || !load_effect(*job.module))
+		{
+			LOG(ERROR) << "Failed to compile " << path << ":\n" << errors;
+			_textures.erase(_textures.begin() + _texture_count, _textures.end());
+			_uniforms.erase(_uniforms.begin() + _uniform_count, _uniforms.end());
+			_techniques.erase(_techniques.begin() + _technique_count, _techniques.end());
+			_effects_generation++;
+			return;
+		}
+		else if (errors.empty())
+		{
+			LOG(INFO) << "> Successfully compiled.";
+		}
+		else
+		{
+			LOG(WARNING) << "> Successfully compiled with warnings:\n" << errors;
+		}
+
+		std::move(job.baked_uniforms.begin(), job.baked_uniforms.end(), std::back_inserter(_baked_uniforms));
+
+		for (size_t i = _uniform_count, max = _uniform_count = _uniforms.size(); i < max; i++)
+		{
+			auto &variable = _uniforms[i];
+			variable.effect_filename = path.filename().string();
+			variable.hidden = variable.annotations["hidden"].as<bool>();
+			variable.ui_type = variable.annotations["ui_type"].as<std::string>();
+			variable.ui_label = variable.annotations.count("ui_label") ? variable.annotations.at("ui_label").as<std::string>() : variable.name;
+			variable.ui_tooltip = variable.annotations["ui_tooltip"].as<std::string>();
+			variable.ui_category = variable.annotations["ui_category"].as<std::string>();
+			variable.ui_items = variable.annotations["ui_items"].as<std::string>();
+
+			// Make sure list is terminated with a zero in case user forgot so no invalid memory is read accidentally
+			if (!variable.ui_items.empty() && variable.ui_items.back() != '\0')
+				variable.ui_items.push_back('\0');
+		}
+		for (size_t i = _texture_count, max = _texture_count = _textures.size(); i < max; i++)
+		{
+			auto &texture = _textures[i];
+			texture.effect_filename = path.filename().string();
+		}
+		for (size_t i = _technique_count, max = _technique_count = _techniques.size(); i < max; i++)
+		{
+			auto &technique = _techniques[i];
+			technique.effect_filename = path.filename().string();
+			technique.enabled = technique.annotations["enabled"].as<bool>();
+			technique.hidden = technique.annotations["hidden"].as<bool>();
+			technique.timeleft = technique.timeout = technique.annotations["timeout"].as<int>();
+			technique.static_interval = std::max(technique.annotations["static_interval"].as<int>(), 0);
+
+			// The back buffer holds a new frame every time, so a technique drawing to it would vanish on the frames it skips
+			if (technique.static_interval > 0 && technique.writes_backbuffer)
+			{
+				LOG(WARNING) << "Ignoring 'static_interval' on technique '" << technique.name << "' in " << path << ", because it renders to the back buffer.";
+				technique.static_interval = 0;
+			}
+
+			technique.toggle_key_data[0] = technique.annotations["toggle"].as<unsigned int>();
+			technique.toggle_key_data[1] = technique.annotations["togglectrl"].as<bool>() ? 1 : 0;
+			technique.toggle_key_data[2] = technique.annotations["toggleshift"].as<bool>() ? 1 : 0;
+			technique.toggle_key_data[3] = technique.annotations["togglealt"].as<bool>() ? 1 : 0;
+		}
+
+		update_uniform_updaters();
+	}
+	void runtime::update_uniform_updaters()
+	{
+		_uniform_updaters.clear();
+
+		for (size_t i = 0; i < _uniforms.size(); i++)
+		{
+			auto &variable = _uniforms[i];
+			const auto it = variable.annotations.find("source");
+
+			if (it == variable.annotations.end())
+			{
+				continue;
+			}
+
+			const auto source = it->second.as<std::string>();
+
+			uniform_updater updater = { };
+			updater.uniform_index = i;
+
+			if (source == "frametime")
+			{
+				updater.source = uniform_source::frametime;
+			}
+			else if (source == "framecount")
+			{
+				updater.source = uniform_source::framecount;
+			}
+			else if (source == "pingpong")
+			{
+				updater.source = uniform_source::pingpong;
+				updater.pingpong_min = variable.annotations["min"].as<float>();
+				updater.pingpong_max = variable.annotations["max"].as<float>();
+				updater.pingpong_step_min = variable.annotations["step"].as<float>(0);
+				updater.pingpong_step_max = variable.annotations["step"].as<float>(1);
+				updater.pingpong_smoothing = variable.annotations["smoothing"].as<float>();
+			}
+			else if (source == "date")
+			{
+				updater.source = uniform_source::date;
+			}
+			else if (source == "timer")
+			{
+				updater.source = uniform_source::timer;
+			}
+			else if (source == "key" || source == "mousebutton")
+			{
+				updater.source = source == "key" ? uniform_source::key : uniform_source::mousebutton;
+				updater.keycode = variable.annotations["keycode"].as<int>();
+
+				// Skip variables with invalid key codes entirely, so they are never touched per frame
+				if (updater.source == uniform_source::key ? (updater.keycode <= 7 || updater.keycode >= 256) : (updater.keycode < 0 || updater.keycode >= 5))
+				{
+					continue;
+				}
+
+				const std::string mode = variable.annotations["mode"].as<std::string>();
+
+				if (mode == "toggle" || variable.annotations["toggle"].as<bool>())
+				{
+					updater.key_mode = uniform_key_mode::toggle;
+				}
+				else if (mode == "press")
+				{
+					updater.key_mode = uniform_key_mode::press;
+				}
+				else
+				{
+					updater.key_mode = uniform_key_mode::down;
+				}
+			}
+			else if (source == "mousepoint")
+			{
+				updater.source = uniform_source::mousepoint;
+			}
+			else if (source == "mousedelta")
+			{
+				updater.source = uniform_source::mousedelta;
+			}
+			else if (source == "random")
+			{
+				updater.source = uniform_source::random;
+				updater.random_min = variable.annotations["min"].as<int>();
+				updater.random_max = variable.annotations["max"].as<int>();
+			}
+			else if (source == "camerastatic")
+			{
+				updater.source = uniform_source::camerastatic;
+			}
+			else
+			{
+				continue;
+			}
+
+			_uniform_updaters.push_back(updater);
+		}
+	}
+	static bool read_dds_blocks(FILE *file, texture_format format, unsigned int width, unsigned int height, unsigned int max_levels, std::vector<uint8_t> &data, unsigned int &levels)
+	{
+		const auto fourcc = [](char a, char b, char c, char d) {
+			return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+		};
+
+		// Magic number followed by the 124 byte header
+		uint32_t header[32];
+
+		if (fseek(file, 0, SEEK_SET) != 0 || fread(header, sizeof(header), 1, file) != 1 || header[0] != fourcc('D', 'D', 'S', ' '))
+		{
+			return false;
+		}
+
+		const uint32_t flags = header[2], file_height = header[3], file_width = header[4], mipmap_count = header[7];
+		const uint32_t pixel_format_flags = header[20], pixel_format_fourcc = header[21];
+
+		// Only formats stored as four character code can be block-compressed
+		if ((pixel_format_flags & 0x4) == 0)
+		{
+			return false;
+		}
+
+		texture_format file_format = texture_format::unknown;
+
+		if (pixel_format_fourcc == fourcc('D', 'X', 'T', '1'))
+			file_format = texture_format::dxt1;
+		else if (pixel_format_fourcc == fourcc('D', 'X', 'T', '2') || pixel_format_fourcc == fourcc('D', 'X', 'T', '3'))
+			file_format = texture_format::dxt3;
+		else if (pixel_format_fourcc == fourcc('D', 'X', 'T', '4') || pixel_format_fourcc == fourcc('D', 'X', 'T', '5'))
+			file_format = texture_format::dxt5;
+		else if (pixel_format_fourcc == fourcc('A', 'T', 'I', '1') || pixel_format_fourcc == fourcc('B', 'C', '4', 'U'))
+			file_format = texture_format::latc1;
+		else if (pixel_format_fourcc == fourcc('A', 'T', 'I', '2') || pixel_format_fourcc == fourcc('B', 'C', '5', 'U'))
+			file_format = texture_format::latc2;
+		else if (pixel_format_fourcc == fourcc('D', 'X', '1', '0'))
+		{
+			// Extended header with DXGI format, resource dimension, misc flags, array size and misc flags 2
+			uint32_t header_dx10[5];
+
+			if (fread(header_dx10, sizeof(header_dx10), 1, file) != 1 || header_dx10[1] != 3 || header_dx10[3] > 1)
+			{
+				return false;
+			}
+
+			// Typeless, unorm and sRGB variants of BC1 to BC5, the effect texture formats do not cover BC6H and BC7
+			switch (header_dx10[0])
+			{
+				case 70: case 71: case 72:
+					file_format = texture_format::dxt1;
+					break;
+				case 73: case 74: case 75:
+					file_format = texture_format::dxt3;
+					break;
+				case 76: case 77: case 78:
+					file_format = texture_format::dxt5;
+					break;
+				case 79: case 80:
+					file_format = texture_format::latc1;
+					break;
+				case 82: case 83:
+					file_format = texture_format::latc2;
+					break;
+			}
+		}
+
+		if (file_format != format || file_width != width || file_height != height)
+		{
+			return false;
+		}
+
+		levels = std::min(std::max((flags & 0x20000) != 0 ? mipmap_count : 1u, 1u), std::max(max_levels, 1u));
+
+		const unsigned int block_size = compressed_block_size(format);
+		size_t data_size = 0;
+
+		for (unsigned int level = 0; level < levels; level++)
+		{
+			data_size += std::max(1u, ((width >> level) + 3) / 4) * std::max(1u, ((height >> level) + 3) / 4) * block_size;
+		}
+
+		data.resize(data_size);
+
+		if (fread(data.data(), 1, data_size, file) != data_size)
+		{
+			data.clear();
+			levels = 0;
+			return false;
+		}
+
+		return true;
+	}
+
+	void runtime::load_textures(size_t first_texture)
+	{
+		stop_texture_loading();
+
+		LOG(INFO) << "Loading image files for textures ...";
+
+		for (size_t i = first_texture; i < _textures.size(); i++)
+		{
+			const auto &texture = _textures[i];
+
+			if (texture.impl_reference != texture_reference::none)
+			{
+				continue;
+			}
+
+			const auto it = texture.annotations.find("source");
+
+			if (it == texture.annotations.end())
+			{
+				continue;
+			}
+
+			const filesystem::path path = _directory_index.resolve(it->second.as<std::string>(), _texture_search_paths);
+
+			if (!_directory_index.exists(path))
+			{
+				LOG(ERROR) << "> Source " << path << " for texture '" << texture.name << "' could not be found.";
+				continue;
+			}
+
+			// Effects of a pack often use the same noise or lookup texture, which only has to be decoded and uploaded once
+			const auto existing_job = std::find_if(_texture_jobs.begin(), _texture_jobs.end(), [&texture, &path](const auto &job) {
+				return job->path == path && job->width == texture.width && job->height == texture.height && job->levels == texture.levels && job->format == texture.format;
+			});
+
+			if (existing_job != _texture_jobs.end())
+			{
+				(*existing_job)->texture_indices.push_back(i);
+				continue;
+			}
+
+			auto &job = *_texture_jobs.emplace_back(std::make_unique<texture_load_job>());
+			job.texture_indices.push_back(i);
+			job.width = texture.width;
+			job.height = texture.height;
+			job.levels = texture.levels;
+			job.format = texture.format;
+			job.path = path;
+			job.scale_on_gpu = supports_texture_scaling(texture);
+			// The preview is scaled up on the GPU, so it is only used where the full image would be scaled there as well
+			job.is_progressive = _progressive_texture_loading == 0 && job.scale_on_gpu;
+		}
+
+		if (_texture_jobs.empty())
+		{
+			return;
+		}
+
+		// Leave one core to the render thread
+		const unsigned int hardware_threads = std::thread::hardware_concurrency();
+		const size_t num_workers = std::min(_texture_jobs.size(), static_cast<size_t>(hardware_threads > 2 ? hardware_threads - 1 : 1));
+
+		_texture_next_job = 0;
+		_texture_jobs_remaining = _texture_jobs.size();
+		_texture_loading_cancelled = false;
+
+		for (size_t i = 0; i < num_workers; i++)
+		{
+			_texture_workers.emplace_back(&runtime::texture_worker_loop, this);
+		}
+	}
+	void runtime::stop_texture_loading()
+	{
+		_texture_loading_cancelled = true;
+
+		for (auto &worker : _texture_workers)
+		{
+			worker.join();
+		}
+
+		_texture_workers.clear();
+		_texture_jobs.clear();
+		_texture_jobs_remaining = 0;
+	}
+	void runtime::texture_worker_loop()
+	{
+		while (!_texture_loading_cancelled)
+		{
+			const size_t index = _texture_next_job++;
+
+			if (index >= _texture_jobs.size())
+			{
+				break;
+			}
+
+			auto &job = *_texture_jobs[index];
+
+			decode_texture(job);
+
+			job.finished.store(true, std::memory_order_release);
+		}
+	}
+	// Images with fewer pixels than this decode fast enough that showing a preview first is not worth it
+	static const unsigned int s_progressive_texture_min_pixels = 2048 * 2048;
+
+	void runtime::decode_texture(texture_load_job &job) const
+	{
+		const unsigned long long preview_key = job.is_progressive ? texture_preview_cache::compute_key(job.path) : 0;
+
+		if (job.is_progressive && texture_preview_cache::load(preview_key, job.preview, job.preview_width, job.preview_height))
+		{
+			job.preview_ready.store(true, std::memory_order_release);
+		}
+
+		FILE *file;
+		unsigned char *filedata = nullptr;
+		int width = 0, height = 0, channels = 0;
+
+		if (_wfopen_s(&file, job.path.wstring().c_str(), L"rb") == 0)
+		{
+			if (stbi_dds_test_file(file))
+			{
+				// Upload block-compressed data directly when it matches the texture, instead of expanding it to 32bpp and back
+				if (compressed_block_size(job.format) != 0 && read_dds_blocks(file, job.format, job.width, job.height, job.levels, job.data, job.compressed_levels))
+				{
+					fclose(file);
+
+					job.success = true;
+					return;
+				}
+
+				fseek(file, 0, SEEK_SET);
+
+				filedata = stbi_dds_load_from_file(file, &width, &height, &channels, STBI_rgb_alpha);
+			}
+			else
+			{
+				filedata = stbi_load_from_file(file, &width, &height, &channels, STBI_rgb_alpha);
+			}
+
+			fclose(file);
+		}
+
+		if (filedata == nullptr)
+		{
+			return;
+		}
+
+		// Cache a preview for the next time this image is loaded
+		if (job.is_progressive && !job.preview_ready.load(std::memory_order_relaxed) && static_cast<unsigned int>(width) * static_cast<unsigned int>(height) >= s_progressive_texture_min_pixels)
+		{
+			texture_preview_cache::save(preview_key, filedata, width, height);
+		}
+
+		job.data_width = job.width;
+		job.data_height = job.height;
+
+		if (job.width != static_cast<unsigned int>(width) ||
+			job.height != static_cast<unsigned int>(height))
+		{
+			if (job.scale_on_gpu)
+			{
+				// Resizing is by far the slowest step for large images, so it is left to the GPU, which also generates the mipmaps from the image at full resolution
+				job.data_width = width;
+				job.data_height = height;
+				job.data.assign(filedata, filedata + static_cast<size_t>(width) * height * 4);
+
+				job.success = true;
+			}
+			else
+			{
+				LOG(INFO) << "> Resizing image data for texture " << job.path << " from " << width << "x" << height << " to " << job.width << "x" << job.height << " ...";
+
+				job.data.resize(job.width * job.height * 4);
+
+				job.success = stbir_resize_uint8(filedata, width, height, 0, job.data.data(), job.width, job.height, 0, 4) != 0;
+			}
+		}
+		else
+		{
+			job.data.resize(job.width * job.height * 4);
+
+			std::memcpy(job.data.data(), filedata, job.data.size());
+
+			job.success = true;
+		}
+
+		stbi_image_free(filedata);
+	}
+	bool runtime::upload_texture(texture &texture, const texture_load_job &job)
+	{
+		if (job.compressed_levels != 0)
+		{
+			return update_texture_compressed(texture, job.data.data(), job.compressed_levels);
+		}
+
+		if (job.data_width == texture.width && job.data_height == texture.height)
+		{
+			return update_texture(texture, job.data.data());
+		}
+
+		if (update_texture_scaled(texture, job.data.data(), job.data_width, job.data_height))
+		{
+			return true;
+		}
+
+		// Fall back to resizing on the CPU if the back-end failed to create the resources for scaling
+		LOG(INFO) << "> Resizing image data for texture " << job.path << " from " << job.data_width << "x" << job.data_height << " to " << texture.width << "x" << texture.height << " ...";
+
+		std::vector<uint8_t> resized(texture.width * texture.height * 4);
+
+		return stbir_resize_uint8(job.data.data(), job.data_width, job.data_height, 0, resized.data(), texture.width, texture.height, 0, 4) != 0 &&
+			update_texture(texture, resized.data());
+	}
+	void runtime::upload_loaded_textures()
+	{
+		// Workers finish in any order, so upload whatever is ready instead of waiting on the first job
+		for (auto &job : _texture_jobs)
+		{
+			if (job->uploaded)
+			{
+				continue;
+			}
+
+			if (!job->finished.load(std::memory_order_acquire))
+			{
+				// Show the preview of a large image right away, so techniques using it do not sample an empty texture while the full image is being decoded
+				if (!job->preview_uploaded && job->preview_ready.load(std::memory_order_acquire))
+				{
+					for (const size_t texture_index : job->texture_indices)
+					{
+						update_texture_scaled(_textures[texture_index], job->preview.data(), job->preview_width, job->preview_height);
+					}
+
+					job->preview_uploaded = true;
+				}
+
+				continue;
+			}
+
+			const texture *uploaded_texture = nullptr;
+
+			for (const size_t texture_index : job->texture_indices)
+			{
+				auto &texture = _textures[texture_index];
+
+				if (uploaded_texture != nullptr && share_texture(texture, *uploaded_texture))
+				{
+					continue;
+				}
+
+				if (!job->success || !upload_texture(texture, *job))
+				{
+					LOG(ERROR) << "> Source " << job->path << " for texture '" << texture.name << "' could not be loaded! Make sure it is of a compatible file format.";
+					continue;
+				}
+
+				if (uploaded_texture == nullptr)
+				{
+					uploaded_texture = &texture;
+				}
+			}
+
+			job->uploaded = true;
+			job->data.clear();
+			job->data.shrink_to_fit();
+			job->preview.clear();
+			job->preview.shrink_to_fit();
+
+			_texture_jobs_remaining--;
+		}
+
+		if (_texture_jobs_remaining == 0)
+		{
+			stop_texture_loading();
+		}
+	}
+
+	void runtime::load_config()
+	{
+		const ini_file config(_configuration_path);
+
+		config.get("INPUT", "KeyMenu", _menu_key_data);
+		config.get("INPUT", "KeyScreenshot", _screenshot_key_data);
+		config.get("INPUT", "KeyEffects", _effects_key_data);
+		config.get("INPUT", "KeyReplayCapture", _replay_capture_key_data);
+		config.get("INPUT", "KeyFrameRecording", _frame_recording_key_data);
+		config.get("INPUT", "InputProcessing", _input_processing_mode);
 
 		config.get("GENERAL", "PerformanceMode", _performance_mode);
+		config.get("GENERAL", "FrameBudget", _frame_budget);
+		config.get("GENERAL", "MaxFrameLatency", _max_frame_latency);
 		config.get("GENERAL", "EffectSearchPaths", _effect_search_paths);
 		config.get("GENERAL", "TextureSearchPaths", _texture_search_paths);
 		config.get("GENERAL", "PreprocessorDefinitions", _preprocessor_definitions);
@@ -747,6 +2376,23 @@ namespace reshade
 		config.get("GENERAL", "TutorialProgress", _tutorial_index);
 		config.get("GENERAL", "ScreenshotPath", _screenshot_path);
 		config.get("GENERAL", "ScreenshotFormat", _screenshot_format);
+		config.get("GENERAL", "ReplayBenchmarkIterations", _replay_benchmark_iterations);
+		config.get("GENERAL", "CostProfileFrames", _cost_profile_frames);
+		config.get("GENERAL", "StatisticsWindow", _statistics_window);
+		config.get("GENERAL", "GPUPassTiming", _gpu_pass_timing);
+		config.get("GENERAL", "GPUMarkers", _gpu_markers);
+		config.get("GENERAL", "PublishTelemetry", _publish_telemetry);
+		config.get("GENERAL", "OverlayWorkerThread", _build_overlay_on_worker);
+		config.get("GENERAL", "HalfPrecisionShaders", _half_precision_shaders);
+		config.get("GENERAL", "LogLevel", _log_level);
+
+		_log_level = std::clamp(_log_level, 1, 4);
+		reshade::log::set_max_level(static_cast<reshade::log::level>(_log_level));
+
+		_statistics_window = std::clamp(_statistics_window, 60u, 3600u);
+		_max_frame_latency = std::min(_max_frame_latency, 16u);
+		_frame_time_samples.resize(_statistics_window);
+
 		config.get("GENERAL", "ShowClock", _show_clock);
 		config.get("GENERAL", "ShowFPS", _show_framerate);
 		config.get("GENERAL", "FontGlobalScale", _imgui_context->IO.FontGlobalScale);
@@ -754,1186 +2400,2110 @@ namespace reshade
 		config.get("GENERAL", "NoReloadOnInit", _no_reload_on_init);
 		config.get("GENERAL", "SaveWindowState", _save_imgui_window_state);
 
-		config.get("GENERAL", "FogAmount", _fog_amount);
-		config.get("GENERAL", "NoBloom", _no_bloom);
-		config.get("GENERAL", "InjPS", _inj_ps);
-		config.get("GENERAL", "InjVS", _inj_vs);
-		config.get("GENERAL", "SkipUI", _skip_ui);
-		config.get("GENERAL", "AutoPreset", _auto_preset);
+		config.get("GENERAL", "FogAmount", _fog_amount);
+		config.get("GENERAL", "NoBloom", _no_bloom);
+		// Injection hashes are taken over the shader bytecode, which differs between the DirectX 9 and DirectX 11 client, so each keeps its own
+		if (_is_d3d9)
+		{
+			config.get("GENERAL", "InjPS", _inj_ps);
+			config.get("GENERAL", "InjVS", _inj_vs);
+		}
+		else
+		{
+			_inj_ps = _inj_vs = 0;
+			config.get("GENERAL", "InjPS11", _inj_ps);
+			config.get("GENERAL", "InjVS11", _inj_vs);
+		}
+		config.get("GENERAL", "SkipUI", _skip_ui);
+		config.get("GENERAL", "SkipLoadingScreens", _skip_loading_screens);
+		config.get("GENERAL", "SuspendEffectsInBackground", _suspend_effects_in_background);
+		config.get("GENERAL", "BackgroundFPS", _background_fps);
+		config.get("GENERAL", "FuseTechniques", _fuse_techniques);
+		config.get("GENERAL", "ProgressiveTextureLoading", _progressive_texture_loading);
+		config.get("GENERAL", "AutoPreset", _auto_preset);
+		config.get("GENERAL", "CacheShaderPatches", _cache_shader_patches);
+		config.get("GENERAL", "DiscoverInjection", _discover_injection);
+
+		snprintf(_c_inj_ps, 32, "%#llx", _inj_ps);
+		snprintf(_c_inj_vs, 32, "%#llx", _inj_vs);
+
+		_imgui_context->IO.IniFilename = _save_imgui_window_state ? "ReShadeGUI.ini" : nullptr;
+
+		config.get("STYLE", "Alpha", _imgui_context->Style.Alpha);
+		config.get("STYLE", "ColBackground", _imgui_col_background);
+		config.get("STYLE", "ColItemBackground", _imgui_col_item_background);
+		config.get("STYLE", "ColActive", _imgui_col_active);
+		config.get("STYLE", "ColText", _imgui_col_text);
+		config.get("STYLE", "ColFPSText", _imgui_col_text_fps);
+
+		_imgui_context->Style.Colors[ImGuiCol_Text] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_TextDisabled] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.58f);
+		_imgui_context->Style.Colors[ImGuiCol_WindowBg] = ImVec4(_imgui_col_background[0], _imgui_col_background[1], _imgui_col_background[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_ChildBg] = ImVec4(_imgui_col_item_background[0], _imgui_col_item_background[1], _imgui_col_item_background[2], 0.00f);
+		_imgui_context->Style.Colors[ImGuiCol_Border] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.30f);
+		_imgui_context->Style.Colors[ImGuiCol_FrameBg] = ImVec4(_imgui_col_item_background[0], _imgui_col_item_background[1], _imgui_col_item_background[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_FrameBgHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.68f);
+		_imgui_context->Style.Colors[ImGuiCol_FrameBgActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_TitleBg] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.45f);
+		_imgui_context->Style.Colors[ImGuiCol_TitleBgCollapsed] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.35f);
+		_imgui_context->Style.Colors[ImGuiCol_TitleBgActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.78f);
+		_imgui_context->Style.Colors[ImGuiCol_MenuBarBg] = ImVec4(_imgui_col_item_background[0], _imgui_col_item_background[1], _imgui_col_item_background[2], 0.57f);
+		_imgui_context->Style.Colors[ImGuiCol_ScrollbarBg] = ImVec4(_imgui_col_item_background[0], _imgui_col_item_background[1], _imgui_col_item_background[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_ScrollbarGrab] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.31f);
+		_imgui_context->Style.Colors[ImGuiCol_ScrollbarGrabHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.78f);
+		_imgui_context->Style.Colors[ImGuiCol_ScrollbarGrabActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_PopupBg] = ImVec4(_imgui_col_item_background[0], _imgui_col_item_background[1], _imgui_col_item_background[2], 0.92f);
+		_imgui_context->Style.Colors[ImGuiCol_CheckMark] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.80f);
+		_imgui_context->Style.Colors[ImGuiCol_SliderGrab] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.24f);
+		_imgui_context->Style.Colors[ImGuiCol_SliderGrabActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_Button] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.44f);
+		_imgui_context->Style.Colors[ImGuiCol_ButtonHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.86f);
+		_imgui_context->Style.Colors[ImGuiCol_ButtonActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_Header] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.76f);
+		_imgui_context->Style.Colors[ImGuiCol_HeaderHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.86f);
+		_imgui_context->Style.Colors[ImGuiCol_HeaderActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_Separator] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.32f);
+		_imgui_context->Style.Colors[ImGuiCol_SeparatorHovered] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.78f);
+		_imgui_context->Style.Colors[ImGuiCol_SeparatorActive] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_ResizeGrip] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.20f);
+		_imgui_context->Style.Colors[ImGuiCol_ResizeGripHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.78f);
+		_imgui_context->Style.Colors[ImGuiCol_ResizeGripActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_PlotLines] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.63f);
+		_imgui_context->Style.Colors[ImGuiCol_PlotLinesHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_PlotHistogram] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.63f);
+		_imgui_context->Style.Colors[ImGuiCol_PlotHistogramHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
+		_imgui_context->Style.Colors[ImGuiCol_TextSelectedBg] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.43f);
+
+		if (_current_preset >= static_cast<ptrdiff_t>(_preset_files.size()))
+		{
+			_current_preset = -1;
+		}
+
+		const filesystem::path parent_path = s_gw2hook_wrkdir_path + "Presets";
+		auto preset_files2 = filesystem::list_files(parent_path, "*.ini");
+		auto preset_files3 = filesystem::list_files(parent_path, "*.txt");
+		preset_files2.insert(preset_files2.end(), std::make_move_iterator(preset_files3.begin()), std::make_move_iterator(preset_files3.end()));
+
+		for (const auto &preset_file : preset_files2)
+		{
+			const ini_file preset(preset_file);
+
+			std::vector<std::string> techniques;
+			preset.get("", "Techniques", techniques);
+
+			if (!techniques.empty() && std::find_if(_preset_files.begin(), _preset_files.end(),
+				[&preset_file, &parent_path](const auto &path) {
+					return preset_file.filename() == path.filename() && (path.parent_path() == parent_path || !path.is_absolute());
+				}) == _preset_files.end())
+			{
+				_preset_files.push_back(preset_file);
+			}
+		}
+
+#if 0
+		auto to_absolute = [&parent_path](auto &paths) {
+			for (auto &path : paths)
+				path = filesystem::absolute(path, parent_path);
+		};
+
+		to_absolute(_preset_files);
+		to_absolute(_effect_search_paths);
+		to_absolute(_texture_search_paths);
+#endif
+
+		_preset_files_generation++;
+
+		for (auto &function : _load_config_callables)
+		{
+			function(config);
+		}
+	}
+	void runtime::save_config() const
+	{
+		ini_file config(_configuration_path);
+
+		config.set("INPUT", "KeyMenu", _menu_key_data);
+		config.set("INPUT", "KeyScreenshot", _screenshot_key_data);
+		config.set("INPUT", "KeyEffects", _effects_key_data);
+		config.set("INPUT", "KeyReplayCapture", _replay_capture_key_data);
+		config.set("INPUT", "KeyFrameRecording", _frame_recording_key_data);
+		config.set("INPUT", "InputProcessing", _input_processing_mode);
+
+		config.set("GENERAL", "PerformanceMode", _performance_mode);
+		config.set("GENERAL", "FrameBudget", _frame_budget);
+		config.set("GENERAL", "MaxFrameLatency", _max_frame_latency);
+		config.set("GENERAL", "EffectSearchPaths", _effect_search_paths);
+		config.set("GENERAL", "TextureSearchPaths", _texture_search_paths);
+		config.set("GENERAL", "PreprocessorDefinitions", _preprocessor_definitions);
+		config.set("GENERAL", "PresetFiles", _preset_files);
+		config.set("GENERAL", "CurrentPreset", _current_preset);
+		config.set("GENERAL", "TutorialProgress", _tutorial_index);
+		config.set("GENERAL", "ScreenshotPath", _screenshot_path);
+		config.set("GENERAL", "ScreenshotFormat", _screenshot_format);
+		config.set("GENERAL", "ReplayBenchmarkIterations", _replay_benchmark_iterations);
+		config.set("GENERAL", "CostProfileFrames", _cost_profile_frames);
+		config.set("GENERAL", "StatisticsWindow", _statistics_window);
+		config.set("GENERAL", "GPUPassTiming", _gpu_pass_timing);
+		config.set("GENERAL", "GPUMarkers", _gpu_markers);
+		config.set("GENERAL", "PublishTelemetry", _publish_telemetry);
+		config.set("GENERAL", "OverlayWorkerThread", _build_overlay_on_worker);
+		config.set("GENERAL", "HalfPrecisionShaders", _half_precision_shaders);
+		config.set("GENERAL", "LogLevel", _log_level);
+		config.set("GENERAL", "ShowClock", _show_clock);
+		config.set("GENERAL", "ShowFPS", _show_framerate);
+		config.set("GENERAL", "FontGlobalScale", _imgui_context->IO.FontGlobalScale);
+		config.set("GENERAL", "NoReloadOnInit", _no_reload_on_init);
+		config.set("GENERAL", "SaveWindowState", _save_imgui_window_state);
+
+		config.set("GENERAL", "FogAmount", _fog_amount);
+		config.set("GENERAL", "NoBloom", _no_bloom);
+		config.set("GENERAL", "SkipUI", _skip_ui);
+		config.set("GENERAL", "SkipLoadingScreens", _skip_loading_screens);
+		config.set("GENERAL", "SuspendEffectsInBackground", _suspend_effects_in_background);
+		config.set("GENERAL", "BackgroundFPS", _background_fps);
+		config.set("GENERAL", "FuseTechniques", _fuse_techniques);
+		config.set("GENERAL", "ProgressiveTextureLoading", _progressive_texture_loading);
+		config.set("GENERAL", _is_d3d9 ? "InjPS" : "InjPS11", _inj_ps);
+		config.set("GENERAL", _is_d3d9 ? "InjVS" : "InjVS11", _inj_vs);
+		config.set("GENERAL", "AutoPreset", _auto_preset);
+		config.set("GENERAL", "CacheShaderPatches", _cache_shader_patches);
+		config.set("GENERAL", "DiscoverInjection", _discover_injection);
+
+		config.set("STYLE", "Alpha", _imgui_context->Style.Alpha);
+		config.set("STYLE", "ColBackground", _imgui_col_background);
+		config.set("STYLE", "ColItemBackground", _imgui_col_item_background);
+		config.set("STYLE", "ColActive", _imgui_col_active);
+		config.set("STYLE", "ColText", _imgui_col_text);
+		config.set("STYLE", "ColFPSText", _imgui_col_text_fps);
+
+		for (auto &function : _save_config_callables)
+		{
+			function(config);
+		}
+	}
+
+	void runtime::load_preset(const filesystem::path &path)
+	{
+		ini_file preset(path);
+
+		if (apply_preset_snapshot(path, preset))
+		{
+			return;
+		}
+
+		std::string zone = "";
+		//preset.get("", "Zone", preset_zone);
+		memset(_preset_zone, '\0', sizeof _preset_zone);
+		preset.get("", "Zone", zone);
+		//preset_zone.as<std::string>().copy(_preset_zone, 63, 0);
+		 for (int i = 0; i < zone.size(); i++)
+			 _preset_zone[i] = zone[i];
+			 
+		for (auto &variable : _uniforms)
+		{
+			int values_int[16] = {};
+			unsigned int values_uint[16] = {};
+			float values_float[16] = {};
+
+			switch (variable.basetype)
+			{
+			case uniform_datatype::signed_integer:
+				get_uniform_value(variable, values_int, 16);
+				preset.get(variable.effect_filename, variable.name, values_int);
+				set_uniform_value(variable, values_int, 16);
+				break;
+			case uniform_datatype::boolean:
+			case uniform_datatype::unsigned_integer:
+				get_uniform_value(variable, values_uint, 16);
+				preset.get(variable.effect_filename, variable.name, values_uint);
+				set_uniform_value(variable, values_uint, 16);
+				break;
+			case uniform_datatype::floating_point:
+				get_uniform_value(variable, values_float, 16);
+				preset.get(variable.effect_filename, variable.name, values_float);
+				set_uniform_value(variable, values_float, 16);
+				break;
+			}
+		}
+
+		_optional_techniques.clear();
+		_suspended_techniques.clear();
+		preset.get("", "OptionalTechniques", _optional_techniques);
+
+		// Loading a preset reorders the techniques, which the cost profile keeps a pointer into
+		stop_cost_profile("a different preset was loaded");
+
+		// Reorder techniques
+		std::vector<std::string> technique_list;
+		preset.get("", "Techniques", technique_list);
+		std::vector<std::string> technique_sorting_list;
+		preset.get("", "TechniqueSorting", technique_sorting_list);
+
+		if (technique_sorting_list.empty())
+			technique_sorting_list = technique_list;
+
+		std::unordered_map<std::string, size_t> technique_sorting;
+		for (size_t i = 0; i < technique_sorting_list.size(); i++)
+			technique_sorting.emplace(technique_sorting_list[i], i);
+
+		const auto position = [&technique_sorting](const technique &technique) {
+			const auto it = technique_sorting.find(technique.name);
+			return it != technique_sorting.end() ? it->second : technique_sorting.size();
+		};
+
+		std::sort(_techniques.begin(), _techniques.end(),
+			[&position](const auto &lhs, const auto &rhs) { return position(lhs) < position(rhs); });
+
+		on_techniques_reordered();
+
+		const std::unordered_set<std::string> enabled_techniques(technique_list.begin(), technique_list.end());
+
+		for (auto &technique : _techniques)
+		{
+			// Ignore preset if "enabled" annotation is set
+			technique.enabled = technique.annotations["enabled"].as<bool>() || enabled_techniques.count(technique.name) != 0;
+
+			preset.get("", "Key" + technique.name, technique.toggle_key_data);
+		}
+
+		create_preset_snapshot(path, preset);
+	}
+	bool runtime::apply_preset_snapshot(const filesystem::path &path, const ini_file &preset)
+	{
+		const auto it = _preset_snapshots.find(path.wstring());
+
+		if (it == _preset_snapshots.end())
+		{
+			return false;
+		}
+
+		const preset_snapshot &snapshot = it->second;
+
+		if (snapshot.contents != preset.contents() || snapshot.effects_generation != _effects_generation)
+		{
+			_preset_snapshots.erase(it);
+			return false;
+		}
+
+		// Look up every technique once, which also makes sure the snapshot knows all of them before anything is changed
+		std::vector<std::pair<const preset_snapshot::technique_state *, size_t>> order;
+		order.reserve(_techniques.size());
+
+		for (size_t i = 0; i < _techniques.size(); i++)
+		{
+			const auto state = snapshot.techniques.find(_techniques[i].name);
+
+			if (state == snapshot.techniques.end())
+			{
+				_preset_snapshots.erase(it);
+				return false;
+			}
+
+			order.emplace_back(&state->second, i);
+		}
+
+		memset(_preset_zone, '\0', sizeof _preset_zone);
+		snapshot.zone.copy(_preset_zone, sizeof(_preset_zone) - 1);
+
+		const unsigned char *data = snapshot.uniform_data.data();
+
+		for (const auto &range : snapshot.uniform_ranges)
+		{
+			assert(range.first + range.second <= _uniform_data_storage.size());
+
+			if (std::memcmp(&_uniform_data_storage[range.first], data, range.second) != 0)
+			{
+				std::memcpy(&_uniform_data_storage[range.first], data, range.second);
+
+				mark_uniform_data_dirty(range.first, range.second);
+			}
+
+			data += range.second;
+		}
+
+		_optional_techniques = snapshot.optional_techniques;
+		_suspended_techniques.clear();
+
+		stop_cost_profile("a different preset was loaded");
+
+		std::stable_sort(order.begin(), order.end(),
+			[](const auto &lhs, const auto &rhs) { return lhs.first->position < rhs.first->position; });
+
+		std::vector<technique> techniques(_techniques.size());
+
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			const preset_snapshot::technique_state &state = *order[i].first;
+			technique &technique = techniques[i] = std::move(_techniques[order[i].second]);
+
+			technique.enabled = state.enabled;
+
+			if (state.has_toggle_key)
+			{
+				std::memcpy(technique.toggle_key_data, state.toggle_key_data, sizeof(technique.toggle_key_data));
+			}
+		}
+
+		_techniques = std::move(techniques);
+
+		on_techniques_reordered();
+
+		return true;
+	}
+	void runtime::create_preset_snapshot(const filesystem::path &path, const ini_file &preset)
+	{
+		preset_snapshot snapshot;
+		snapshot.contents = preset.contents();
+		snapshot.effects_generation = _effects_generation;
+		snapshot.zone = _preset_zone;
+		snapshot.optional_techniques = _optional_techniques;
+
+		// Keys missing from the preset keep whatever value the uniform had before, so only the ranges it actually sets are part of the snapshot
+		for (const auto &variable : _uniforms)
+		{
+			if (variable.storage_size == 0 || !preset.has(variable.effect_filename, variable.name))
+			{
+				continue;
+			}
+
+			// Loading a preset sets up to 16 values per uniform, see above
+			const size_t size = std::min(variable.storage_size, 16 * sizeof(uint32_t));
+
+			if (!snapshot.uniform_ranges.empty() && snapshot.uniform_ranges.back().first + snapshot.uniform_ranges.back().second == variable.storage_offset)
+			{
+				snapshot.uniform_ranges.back().second += size;
+			}
+			else
+			{
+				snapshot.uniform_ranges.emplace_back(variable.storage_offset, size);
+			}
+
+			snapshot.uniform_data.insert(snapshot.uniform_data.end(),
+				_uniform_data_storage.begin() + variable.storage_offset,
+				_uniform_data_storage.begin() + variable.storage_offset + size);
+		}
+
+		for (size_t i = 0; i < _techniques.size(); i++)
+		{
+			const technique &technique = _techniques[i];
+			preset_snapshot::technique_state state = { i, technique.enabled, preset.has("", "Key" + technique.name) };
+			std::memcpy(state.toggle_key_data, technique.toggle_key_data, sizeof(state.toggle_key_data));
+
+			// Techniques of different effects can share a name, in which case they get the same state from the preset anyway
+			snapshot.techniques.emplace(technique.name, state);
+		}
+
+		_preset_snapshots[path.wstring()] = std::move(snapshot);
+	}
+	bool runtime::is_preset_compatible(const filesystem::path &path) const
+	{
+		// The effects that are still compiling use the values of the previous preset
+		if (_reload_remaining_effects != 0)
+		{
+			return false;
+		}
+
+		const ini_file preset(path);
+
+		std::vector<std::string> technique_list;
+		preset.get("", "Techniques", technique_list);
+
+		for (const auto &name : technique_list)
+		{
+			if (find_technique(name) == nullptr)
+			{
+				return false;
+			}
+		}
+
+		// Fast loading only loaded the effect files the previous preset used
+		if (_is_fast_loading)
+		{
+			std::vector<std::string> effect_list;
+			preset.get("", "Effects", effect_list);
+
+			for (const auto &effect : effect_list)
+			{
+				if (std::find_if(_effect_files.begin(), _effect_files.end(), [&effect](const auto &effect_file) { return effect_file.filename().string() == effect; }) == _effect_files.end())
+				{
+					return false;
+				}
+			}
+		}
+
+		for (const auto &baked : _baked_uniforms)
+		{
+			std::vector<std::string> preset_value;
+			preset.get(baked.effect_filename, baked.name, preset_value);
+
+			if (preset_value != baked.preset_value)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+	void runtime::load_current_preset()
+	{
+		if (_current_preset >= 0)
+		{
+			load_preset(_preset_files[_current_preset]);
+		}
+	}
+	void runtime::save_preset(const filesystem::path &path) const
+	{
+		ini_file preset(path);
+
+		preset.set("", "Zone", preset_zone);
+
+		_preset_files_generation++;
+
+		std::unordered_set<std::string> active_effect_filenames;
+		for (const auto &technique : _techniques)
+		{
+			if (technique.enabled || is_technique_suspended(technique.name))
+			{
+				active_effect_filenames.insert(technique.effect_filename);
+			}
+		}
+
+		for (const auto &variable : _uniforms)
+		{
+			if (variable.annotations.count("source") || !active_effect_filenames.count(variable.effect_filename))
+			{
+				continue;
+			}
+
+			int values_int[16] = {};
+			unsigned int values_uint[16] = {};
+			float values_float[16] = {};
+
+			assert(variable.rows * variable.columns < 16);
+
+			switch (variable.basetype)
+			{
+			case uniform_datatype::signed_integer:
+				get_uniform_value(variable, values_int, 16);
+				preset.set(variable.effect_filename, variable.name, variant(values_int, variable.rows * variable.columns));
+				break;
+			case uniform_datatype::boolean:
+			case uniform_datatype::unsigned_integer:
+				get_uniform_value(variable, values_uint, 16);
+				preset.set(variable.effect_filename, variable.name, variant(values_uint, variable.rows * variable.columns));
+				break;
+			case uniform_datatype::floating_point:
+				get_uniform_value(variable, values_float, 16);
+				preset.set(variable.effect_filename, variable.name, variant(values_float, variable.rows * variable.columns));
+				break;
+			}
+		}
+
+		std::vector<std::string> technique_list, technique_sorting_list;
+		std::unordered_set<std::string> effects_files;
+
+		for (const auto &technique : _techniques)
+		{
+			// Techniques disabled to stay within the frame budget are still part of the preset
+			if (technique.enabled || is_technique_suspended(technique.name))
+			{
+				effects_files.emplace(technique.effect_filename);
+				technique_list.push_back(technique.name);
+			}
+
+			technique_sorting_list.push_back(technique.name);
+
+			if (technique.toggle_key_data[0] != 0)
+			{
+				// Make sure techniques that are disabled but can be enabled via hotkey are loaded during fast loading too
+				effects_files.emplace(technique.effect_filename);
+
+				preset.set("", "Key" + technique.name, technique.toggle_key_data);
+			}
+			else if (int value = 0; preset.get("", "Key" + technique.name, value), value != 0)
+			{
+				// Clear toggle key data
+				preset.set("", "Key" + technique.name, 0);
+			}
+		}
+
+		preset.set("", "Effects", variant(std::make_move_iterator(effects_files.cbegin()), std::make_move_iterator(effects_files.cend())));
+		preset.set("", "Techniques", std::move(technique_list));
+		preset.set("", "TechniqueSorting", std::move(technique_sorting_list));
+	}
+	void runtime::save_current_preset() const
+	{
+		if (_current_preset >= 0)
+		{
+			save_preset(_preset_files[_current_preset]);
+		}
+	}
+
+	void runtime::save_screenshot()
+	{
+		const int hour = _date[3] / 3600;
+		const int minute = (_date[3] - hour * 3600) / 60;
+		const int second = _date[3] - hour * 3600 - minute * 60;
+
+		char filename[25];
+		ImFormatString(filename, sizeof(filename), " %.4d-%.2d-%.2d %.2d-%.2d-%.2d%s", _date[0], _date[1], _date[2], hour, minute, second, _screenshot_format == 0 ? ".bmp" : ".png");
+		const auto path = _screenshot_path / (s_target_executable_path.filename_without_extension() + filename);
+
+		// Free up the oldest readback slot if all of them are in use
+		if (_screenshot_captures.size() >= MAX_PENDING_SCREENSHOTS)
+		{
+			auto &capture = _screenshot_captures.front();
+
+			std::vector<uint8_t> data(capture.width * capture.height * 4);
+
+			if (finish_frame_capture(capture.slot, data.data(), true))
+			{
+				queue_screenshot(capture.path, capture.width, capture.height, std::move(data));
+			}
+			else
+			{
+				LOG(ERROR) << "Failed to read back screenshot for " << capture.path << "!";
+			}
+
+			_screenshot_captures.erase(_screenshot_captures.begin());
+		}
+
+		unsigned int slot = 0;
+
+		while (std::any_of(_screenshot_captures.begin(), _screenshot_captures.end(), [slot](const auto &capture) { return capture.slot == slot; }))
+		{
+			slot++;
+		}
+
+		if (begin_frame_capture(slot))
+		{
+			_screenshot_captures.push_back({ slot, _framecount, _width, _height, path });
+			return;
+		}
+
+		// Fall back to a synchronous readback on back-ends without deferred capture support
+		std::vector<uint8_t> data(_width * _height * 4);
+		capture_frame(data.data());
+
+		queue_screenshot(path, _width, _height, std::move(data));
+	}
+	void runtime::update_screenshot_captures(bool flush)
+	{
+		while (!_screenshot_captures.empty())
+		{
+			auto &capture = _screenshot_captures.front();
+
+			// Give the GPU a frame or two to finish the copy, but do not wait forever on a copy that keeps failing
+			const uint64_t age = _framecount - capture.framecount;
+
+			if (age < 2 && !flush)
+			{
+				break;
+			}
+
+			const bool wait = flush || age >= 2 + MAX_PENDING_SCREENSHOTS;
+
+			std::vector<uint8_t> data(capture.width * capture.height * 4);
+
+			if (finish_frame_capture(capture.slot, data.data(), wait))
+			{
+				queue_screenshot(capture.path, capture.width, capture.height, std::move(data));
+			}
+			else if (!wait)
+			{
+				break;
+			}
+			else
+			{
+				LOG(ERROR) << "Failed to read back screenshot for " << capture.path << "!";
+			}
+
+			_screenshot_captures.erase(_screenshot_captures.begin());
+		}
+	}
+	void runtime::queue_screenshot(const filesystem::path &path, unsigned int width, unsigned int height, std::vector<uint8_t> &&data)
+	{
+		LOG(INFO) << "Saving screenshot to " << path << " ...";
+
+		if (!_screenshot_worker.joinable())
+		{
+			_screenshot_worker = std::thread(&runtime::screenshot_worker_loop, this);
+		}
+
+		std::unique_lock<std::mutex> lock(_screenshot_mutex);
+
+		// Keep memory bounded when screenshots are taken faster than they can be encoded
+		_screenshot_signal.wait(lock, [this]() { return _screenshot_jobs.size() < 8; });
+
+		_screenshot_jobs.push_back({ path, width, height, _screenshot_format, std::move(data) });
+
+		lock.unlock();
+		_screenshot_signal.notify_all();
+	}
+	void runtime::screenshot_worker_loop()
+	{
+		std::unique_lock<std::mutex> lock(_screenshot_mutex);
+
+		while (true)
+		{
+			_screenshot_signal.wait(lock, [this]() { return _screenshot_worker_exit || !_screenshot_jobs.empty(); });
+
+			if (_screenshot_jobs.empty())
+			{
+				break;
+			}
+
+			const screenshot_job job = std::move(_screenshot_jobs.front());
+			_screenshot_jobs.pop_front();
+
+			lock.unlock();
+			_screenshot_signal.notify_all();
+
+			write_screenshot(job);
+
+			lock.lock();
+		}
+	}
+	void runtime::write_screenshot(const screenshot_job &job)
+	{
+		FILE *file;
+		bool success = false;
+
+		if (_wfopen_s(&file, job.path.wstring().c_str(), L"wb") == 0)
+		{
+			stbi_write_func *const func = [](void *context, void *data, int size) {
+				fwrite(data, 1, size, static_cast<FILE *>(context));
+			};
+
+			switch (job.format)
+			{
+			case 0:
+				success = stbi_write_bmp_to_func(func, file, job.width, job.height, 4, job.data.data()) != 0;
+				break;
+			case 1:
+			{
+				// Deflate row strips on all cores, since the stb encoder takes seconds for large frames
+				const std::vector<uint8_t> png = png::encode_rgba(job.data.data(), job.width, job.height);
+				success = fwrite(png.data(), 1, png.size(), file) == png.size();
+				break;
+			}
+			}
+
+			fclose(file);
+		}
+
+		if (!success)
+		{
+			LOG(ERROR) << "Failed to write screenshot to " << job.path << "!";
+		}
+	}
+
+	static const char keyboard_keys[256][16] = {
+		"", "", "", "Cancel", "", "", "", "", "Backspace", "Tab", "", "", "Clear", "Enter", "", "",
+		"Shift", "Control", "Alt", "Pause", "Caps Lock", "", "", "", "", "", "", "Escape", "", "", "", "",
+		"Space", "Page Up", "Page Down", "End", "Home", "Left Arrow", "Up Arrow", "Right Arrow", "Down Arrow", "Select", "", "", "Print Screen", "Insert", "Delete", "Help",
+		"0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "", "", "", "", "", "",
+		"", "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N", "O",
+		"P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "Left Windows", "Right Windows", "", "", "Sleep",
+		"Numpad 0", "Numpad 1", "Numpad 2", "Numpad 3", "Numpad 4", "Numpad 5", "Numpad 6", "Numpad 7", "Numpad 8", "Numpad 9", "Numpad *", "Numpad +", "", "Numpad -", "Numpad Decimal", "Numpad /",
+		"F1", "F2", "F3", "F4", "F5", "F6", "F7", "F8", "F9", "F10", "F11", "F12", "F13", "F14", "F15", "F16",
+		"F17", "F18", "F19", "F20", "F21", "F22", "F23", "F24", "", "", "", "", "", "", "", "",
+		"Num Lock", "Scroll Lock",
+	};
+
+	static inline std::vector<std::string> split(const std::string &str, char delim)
+	{
+		std::vector<std::string> result;
+
+		for (size_t i = 0, len = str.size(), found; i < len; i = found + 1)
+		{
+			found = str.find_first_of(delim, i);
+
+			if (found == std::string::npos)
+				found = len;
+
+			result.push_back(str.substr(i, found - i));
+		}
 
-		snprintf(_c_inj_ps, 32, "%#llx", _inj_ps);
-		snprintf(_c_inj_vs, 32, "%#llx", _inj_vs);
+		return result;
+	}
 
-		_imgui_context->IO.IniFilename = _save_imgui_window_state ? "ReShadeGUI.ini" : nullptr;
+	void runtime::wait_for_overlay()
+	{
+		if (!_overlay_worker.joinable())
+		{
+			return;
+		}
 
-		config.get("STYLE", "Alpha", _imgui_context->Style.Alpha);
-		config.get("STYLE", "ColBackground", _imgui_col_background);
-		config.get("STYLE", "ColItemBackground", _imgui_col_item_background);
-		config.get("STYLE", "ColActive", _imgui_col_active);
-		config.get("STYLE", "ColText", _imgui_col_text);
-		config.get("STYLE", "ColFPSText", _imgui_col_text_fps);
+		std::unique_lock<std::mutex> lock(_overlay_mutex);
 
-		_imgui_context->Style.Colors[ImGuiCol_Text] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_TextDisabled] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.58f);
-		_imgui_context->Style.Colors[ImGuiCol_WindowBg] = ImVec4(_imgui_col_background[0], _imgui_col_background[1], _imgui_col_background[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_ChildBg] = ImVec4(_imgui_col_item_background[0], _imgui_col_item_background[1], _imgui_col_item_background[2], 0.00f);
-		_imgui_context->Style.Colors[ImGuiCol_Border] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.30f);
-		_imgui_context->Style.Colors[ImGuiCol_FrameBg] = ImVec4(_imgui_col_item_background[0], _imgui_col_item_background[1], _imgui_col_item_background[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_FrameBgHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.68f);
-		_imgui_context->Style.Colors[ImGuiCol_FrameBgActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_TitleBg] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.45f);
-		_imgui_context->Style.Colors[ImGuiCol_TitleBgCollapsed] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.35f);
-		_imgui_context->Style.Colors[ImGuiCol_TitleBgActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.78f);
-		_imgui_context->Style.Colors[ImGuiCol_MenuBarBg] = ImVec4(_imgui_col_item_background[0], _imgui_col_item_background[1], _imgui_col_item_background[2], 0.57f);
-		_imgui_context->Style.Colors[ImGuiCol_ScrollbarBg] = ImVec4(_imgui_col_item_background[0], _imgui_col_item_background[1], _imgui_col_item_background[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_ScrollbarGrab] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.31f);
-		_imgui_context->Style.Colors[ImGuiCol_ScrollbarGrabHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.78f);
-		_imgui_context->Style.Colors[ImGuiCol_ScrollbarGrabActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_PopupBg] = ImVec4(_imgui_col_item_background[0], _imgui_col_item_background[1], _imgui_col_item_background[2], 0.92f);
-		_imgui_context->Style.Colors[ImGuiCol_CheckMark] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.80f);
-		_imgui_context->Style.Colors[ImGuiCol_SliderGrab] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.24f);
-		_imgui_context->Style.Colors[ImGuiCol_SliderGrabActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_Button] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.44f);
-		_imgui_context->Style.Colors[ImGuiCol_ButtonHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.86f);
-		_imgui_context->Style.Colors[ImGuiCol_ButtonActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_Header] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.76f);
-		_imgui_context->Style.Colors[ImGuiCol_HeaderHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.86f);
-		_imgui_context->Style.Colors[ImGuiCol_HeaderActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_Separator] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.32f);
-		_imgui_context->Style.Colors[ImGuiCol_SeparatorHovered] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.78f);
-		_imgui_context->Style.Colors[ImGuiCol_SeparatorActive] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_ResizeGrip] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.20f);
-		_imgui_context->Style.Colors[ImGuiCol_ResizeGripHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.78f);
-		_imgui_context->Style.Colors[ImGuiCol_ResizeGripActive] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_PlotLines] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.63f);
-		_imgui_context->Style.Colors[ImGuiCol_PlotLinesHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_PlotHistogram] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.63f);
-		_imgui_context->Style.Colors[ImGuiCol_PlotHistogramHovered] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 1.00f);
-		_imgui_context->Style.Colors[ImGuiCol_TextSelectedBg] = ImVec4(_imgui_col_active[0], _imgui_col_active[1], _imgui_col_active[2], 0.43f);
+		_overlay_signal.wait(lock, [this]() { return !_overlay_frame_requested; });
+	}
+	void runtime::overlay_worker_loop()
+	{
+		std::unique_lock<std::mutex> lock(_overlay_mutex);
 
-		if (_current_preset >= static_cast<ptrdiff_t>(_preset_files.size()))
+		while (true)
 		{
-			_current_preset = -1;
+			_overlay_signal.wait(lock, [this]() { return _overlay_worker_exit || _overlay_frame_requested; });
+
+			if (_overlay_worker_exit)
+			{
+				break;
+			}
+
+			lock.unlock();
+
+			const bool show_splash = (_last_present_time - _last_reload_time) < std::chrono::seconds(5);
+			const bool show_fps_window = _reload_remaining_effects == 0 && !show_splash && (_show_clock || _show_framerate);
+
+			build_overlay(show_splash, show_fps_window);
+
+			lock.lock();
+
+			_overlay_frame_requested = false;
+			_overlay_signal.notify_all();
 		}
+	}
 
-		const filesystem::path parent_path = s_gw2hook_wrkdir_path + "Presets";
-		auto preset_files2 = filesystem::list_files(parent_path, "*.ini");
-		auto preset_files3 = filesystem::list_files(parent_path, "*.txt");
-		preset_files2.insert(preset_files2.end(), std::make_move_iterator(preset_files3.begin()), std::make_move_iterator(preset_files3.end()));
+	void runtime::draw_overlay()
+	{
+		RESHADE_PROFILE_SCOPE("runtime::draw_overlay");
+
+		// The worker is done already if the back-end waited for it after the last present, in which case this does not block
+		bool has_worker_frame = false;
+
+		if (_overlay_worker.joinable())
+		{
+			wait_for_overlay();
+
+			has_worker_frame = _overlay_frame_pending && _overlay_frame_effects_generation == _effects_generation;
+			_overlay_frame_pending = false;
+		}
+
+		const bool show_splash = (_last_present_time - _last_reload_time) < std::chrono::seconds(5);
+
+		if (!_overlay_key_setting_active &&
+			_input->is_key_pressed(_menu_key_data[0], _menu_key_data[1], _menu_key_data[2], _menu_key_data[3]))
+		{
+			_show_menu = !_show_menu;
+		}
+
+		_effects_expanded_state &= 2;
+
+		const bool show_fps_window = _reload_remaining_effects == 0 && !show_splash && (_show_clock || _show_framerate);
+
+		// Players usually have nothing of the overlay on screen, so do not build, render or upload an ImGui frame at all then
+		// Input is not passed on to ImGui either, so characters and mouse wheel movement do not pile up until the next frame that is built
+		if (!show_splash && !show_fps_window && !_show_menu)
+		{
+			_input->block_mouse_input(false);
+			_input->block_keyboard_input(false);
+			return;
+		}
+
+		// Update ImGui configuration
+		ImGui::SetCurrentContext(_imgui_context);
+		auto &imgui_io = _imgui_context->IO;
+		imgui_io.DeltaTime = _last_frame_duration.count() * 1e-9f;
+		imgui_io.MouseDrawCursor = _show_menu;
+
+		imgui_io.KeyCtrl = _input->is_key_down(0x11); // VK_CONTROL
+		imgui_io.KeyShift = _input->is_key_down(0x10); // VK_SHIFT
+		imgui_io.KeyAlt = _input->is_key_down(0x12); // VK_MENU
+		imgui_io.MousePos.x = static_cast<float>(_input->mouse_position_x());
+		imgui_io.MousePos.y = static_cast<float>(_input->mouse_position_y());
+		imgui_io.MouseWheel += _input->mouse_wheel_delta();
+
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			imgui_io.KeysDown[i] = _input->is_key_down(i);
+
+			if (_input->is_key_pressed(i))
+			{
+				imgui_io.AddInputCharacter(_input->key_to_text(i));
+			}
+		}
+		for (unsigned int i = 0; i < 5; i++)
+		{
+			imgui_io.MouseDown[i] = _input->is_mouse_button_down(i);
+		}
+
+		if (imgui_io.KeyCtrl && !_no_font_scaling)
+		{
+			// Change global font scale if user presses the control key and moves the mouse wheel
+			imgui_io.FontGlobalScale = ImClamp(imgui_io.FontGlobalScale + imgui_io.MouseWheel * 0.10f, 0.2f, 2.50f);
+		}
+
+		// With the input copied to ImGui above, the menus only work with state of the runtime, which nothing changes while the game is in its present call, so the worker builds the next frame then, started at the end of 'on_present'
+		// The frame it built during the last present is drawn now, unless a tab that reaches into the back-end or the game hooks is shown, which is built right here as before
+		if (_build_overlay_on_worker && (!_show_menu || (!_is_fast_loading && _menu_callables[_menu_index].is_worker_safe)))
+		{
+			_overlay_frame_pending = true;
+
+			if (has_worker_frame)
+			{
+				render_overlay();
+			}
+			return;
+		}
+
+		build_overlay(show_splash, show_fps_window);
+		render_overlay();
+	}
+	void runtime::render_overlay()
+	{
+		_input->block_mouse_input(_input_processing_mode != 0 && _show_menu && (_imgui_context->IO.WantCaptureMouse || _input_processing_mode == 2));
+		_input->block_keyboard_input(_input_processing_mode != 0 && _show_menu && (_imgui_context->IO.WantCaptureKeyboard || _input_processing_mode == 2));
+
+		if (const auto draw_data = ImGui::GetDrawData(); draw_data != nullptr && draw_data->CmdListsCount != 0 && draw_data->TotalVtxCount != 0)
+		{
+			RESHADE_PROFILE_SCOPE("render_imgui_draw_data");
+
+			render_imgui_draw_data(draw_data);
+		}
+	}
+	void runtime::build_overlay(bool show_splash, bool show_fps_window)
+	{
+		ImGui::NewFrame();
+
+		// Create ImGui widgets and windows
+		if (show_splash)
+		{
+			ImGui::SetNextWindowPos(ImVec2(0, 100));
+			ImGui::SetNextWindowSize(ImVec2(_width/3.0f - 20.0f, ImGui::GetFrameHeightWithSpacing() * 3), ImGuiCond_Appearing);
+			ImGui::Begin("Splash Screen", nullptr,
+				ImGuiWindowFlags_NoTitleBar |
+				ImGuiWindowFlags_NoScrollbar |
+				ImGuiWindowFlags_NoMove |
+				ImGuiWindowFlags_NoResize |
+				ImGuiWindowFlags_NoSavedSettings |
+				ImGuiWindowFlags_NoInputs |
+				ImGuiWindowFlags_NoFocusOnAppearing);
+
+			ImGui::TextUnformatted("ReShade by crosire (http://reshade.me)");
+			ImGui::TextUnformatted("Gw2 Hook " VERSION_STRING_FILE " by Grenbur (04348.github.io/Gw2Hook/)");
+
+			ImGui::Spacing();
+
+			if (_reload_remaining_effects != 0)
+			{
+				ImGui::Text(
+					"Loading (%u effects remaining) ... ",
+					static_cast<unsigned int>(_reload_remaining_effects));
+			}
+			else
+			{
+				ImGui::Text(
+					"Press '%s%s%s%s' to open the configuration menu.",
+					_menu_key_data[1] ? "Ctrl + " : "",
+					_menu_key_data[2] ? "Shift + " : "",
+					_menu_key_data[3] ? "Alt + " : "",
+					keyboard_keys[_menu_key_data[0]]);
+			}
+
+			ImGui::End();
+		}
+
+		if (_reload_remaining_effects == 0)
+		{
+			if (show_fps_window)
+			{
+				ImGui::SetNextWindowPos(ImVec2(_width - 200.0f, 0));
+				ImGui::SetNextWindowSize(ImVec2(200.0f, 200.0f));
+				ImGui::PushFont(_imgui_context->IO.Fonts->Fonts[1]);
+				ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(_imgui_col_text_fps[0], _imgui_col_text_fps[1], _imgui_col_text_fps[2], 1.0f));
+				ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4());
+				ImGui::Begin("FPS", nullptr,
+					ImGuiWindowFlags_NoTitleBar |
+					ImGuiWindowFlags_NoScrollbar |
+					ImGuiWindowFlags_NoMove |
+					ImGuiWindowFlags_NoResize |
+					ImGuiWindowFlags_NoSavedSettings |
+					ImGuiWindowFlags_NoInputs |
+					ImGuiWindowFlags_NoFocusOnAppearing);
+
+				char temp[512];
+
+				if (_show_clock)
+				{
+					const int hour = _date[3] / 3600;
+					const int minute = (_date[3] - hour * 3600) / 60;
+
+					ImFormatString(temp, sizeof(temp), " %02u:%02u", hour, minute);
+					ImGui::SetCursorPosX(ImGui::GetWindowContentRegionWidth() - ImGui::CalcTextSize(temp).x);
+					ImGui::TextUnformatted(temp);
+				}
+				if (_show_framerate)
+				{
+					ImFormatString(temp, sizeof(temp), "%.0f fps", _imgui_context->IO.Framerate);
+					ImGui::SetCursorPosX(ImGui::GetWindowContentRegionWidth() - ImGui::CalcTextSize(temp).x);
+					ImGui::TextUnformatted(temp);
+
+					ImFormatString(temp, sizeof(temp), "%*lld ms", 3, std::chrono::duration_cast<std::chrono::milliseconds>(_last_frame_duration).count());
+					ImGui::SetCursorPosX(ImGui::GetWindowContentRegionWidth() - ImGui::CalcTextSize(temp).x);
+					ImGui::TextUnformatted(temp);
+				}
+
+				ImGui::End();
+				ImGui::PopStyleColor(2);
+				ImGui::PopFont();
+			}
+
+			if (_show_menu)
+			{
+				if (_is_fast_loading)
+				{
+					// Need to do a full reload since some effects might be missing due to fast loading
+					reload();
+
+					assert(!_is_fast_loading);
+				}
+				else
+				{
+					ImGui::SetNextWindowPos(ImVec2(20, 20), ImGuiCond_FirstUseEver);
+					ImGui::SetNextWindowSize(ImVec2(std::min(730.0f, _width / 3.0f), _height - 40.0f), ImGuiCond_FirstUseEver);
+					ImGui::Begin("ReShade " VERSION_STRING_FILE " by crosire###Main", &_show_menu,
+						ImGuiWindowFlags_MenuBar |
+						ImGuiWindowFlags_NoCollapse);
+
+					draw_overlay_menu();
+
+					ImGui::End();
+				}
+			}
+		}
 
-		for (const auto &preset_file : preset_files2)
+		// Render ImGui widgets and windows
 		{
-			const ini_file preset(preset_file);
+			RESHADE_PROFILE_SCOPE("ImGui::Render");
 
-			std::vector<std::string> techniques;
-			preset.get("", "Techniques", techniques);
+			ImGui::Render();
+		}
+	}
+	void runtime::draw_overlay_menu()
+	{
+		if (ImGui::BeginMenuBar())
+		{
+			ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImGui::GetStyle().ItemSpacing * 2);
 
-			if (!techniques.empty() && std::find_if(_preset_files.begin(), _preset_files.end(),
-				[&preset_file, &parent_path](const auto &path) {
-					return preset_file.filename() == path.filename() && (path.parent_path() == parent_path || !path.is_absolute());
-				}) == _preset_files.end())
+			for (size_t i = 0; i < _menu_callables.size(); ++i)
 			{
-				_preset_files.push_back(preset_file);
-			}
-		}
+				const std::string &label = _menu_callables[i].label;
 
-#if 0
-		auto to_absolute = [&parent_path](auto &paths) {
-			for (auto &path : paths)
-				path = filesystem::absolute(path, parent_path);
-		};
+				if (ImGui::Selectable(label.c_str(), _menu_index == i, 0, ImVec2(ImGui::CalcTextSize(label.c_str()).x, 0)))
+				{
+					_menu_index = i;
+				}
 
-		to_absolute(_preset_files);
-		to_absolute(_effect_search_paths);
-		to_absolute(_texture_search_paths);
-#endif
+				ImGui::SameLine();
+			}
 
-		for (auto &function : _load_config_callables)
-		{
-			function(config);
+			ImGui::PopStyleVar();
+			ImGui::EndMenuBar();
 		}
-	}
-	void runtime::save_config() const
-	{
-		ini_file config(_configuration_path);
 
-		config.set("INPUT", "KeyMenu", _menu_key_data);
-		config.set("INPUT", "KeyScreenshot", _screenshot_key_data);
-		config.set("INPUT", "KeyEffects", _effects_key_data);
-		config.set("INPUT", "InputProcessing", _input_processing_mode);
+		ImGui::PushID(_menu_callables[_menu_index].label.c_str());
 
-		config.set("GENERAL", "PerformanceMode", _performance_mode);
-		config.set("GENERAL", "EffectSearchPaths", _effect_search_paths);
-		config.set("GENERAL", "TextureSearchPaths", _texture_search_paths);
-		config.set("GENERAL", "PreprocessorDefinitions", _preprocessor_definitions);
-		config.set("GENERAL", "PresetFiles", _preset_files);
-		config.set("GENERAL", "CurrentPreset", _current_preset);
-		config.set("GENERAL", "TutorialProgress", _tutorial_index);
-		config.set("GENERAL", "ScreenshotPath", _screenshot_path);
-		config.set("GENERAL", "ScreenshotFormat", _screenshot_format);
-		config.set("GENERAL", "ShowClock", _show_clock);
-		config.set("GENERAL", "ShowFPS", _show_framerate);
-		config.set("GENERAL", "FontGlobalScale", _imgui_context->IO.FontGlobalScale);
-		config.set("GENERAL", "NoReloadOnInit", _no_reload_on_init);
-		config.set("GENERAL", "SaveWindowState", _save_imgui_window_state);
+		_menu_callables[_menu_index].function();
 
-		config.set("GENERAL", "FogAmount", _fog_amount);
-		config.set("GENERAL", "NoBloom", _no_bloom);
-		config.set("GENERAL", "SkipUI", _skip_ui);
-		config.set("GENERAL", "InjPS", _inj_ps);
-		config.set("GENERAL", "InjVS", _inj_vs);
-		config.set("GENERAL", "AutoPreset", _auto_preset);
+		ImGui::PopID();
+	}
+	void runtime::draw_overlay_menu_home()
+	{
+		if (!_effects_enabled)
+		{
+			ImGui::Text("Effects are disabled. Press '%s%s%s%s' to enable them again.",
+				_effects_key_data[1] ? "Ctrl + " : "",
+				_effects_key_data[2] ? "Shift + " : "",
+				_effects_key_data[3] ? "Alt + " : "",
+				keyboard_keys[_effects_key_data[0]]);
+		}
 
-		config.set("STYLE", "Alpha", _imgui_context->Style.Alpha);
-		config.set("STYLE", "ColBackground", _imgui_col_background);
-		config.set("STYLE", "ColItemBackground", _imgui_col_item_background);
-		config.set("STYLE", "ColActive", _imgui_col_active);
-		config.set("STYLE", "ColText", _imgui_col_text);
-		config.set("STYLE", "ColFPSText", _imgui_col_text_fps);
+		bool continue_tutorial = false;
+		const char *tutorial_text =
+			"Welcome! Since this is the first time you start ReShade, we'll go through a quick tutorial covering the most important features.\n\n"
+			"Before we continue: If you have difficulties reading this text, press the 'Ctrl' key and adjust the text size with your mouse wheel. "
+			"The window size is variable as well, just grab the bottom right corner and move it around.\n\n"
+			"Click on the 'Continue' button to continue the tutorial.";
 
-		for (auto &function : _save_config_callables)
+		if (_performance_mode && _tutorial_index <= 3)
 		{
-			function(config);
+			_tutorial_index = 4;
 		}
-	}
 
-	void runtime::load_preset(const filesystem::path &path)
-	{
-		ini_file preset(path);
-		
-		std::string zone = "";
-		//preset.get("", "Zone", preset_zone);
-		memset(_preset_zone, '\0', sizeof _preset_zone);
-		preset.get("", "Zone", zone);
-		//preset_zone.as<std::string>().copy(_preset_zone, 63, 0);
-		 for (int i = 0; i < zone.size(); i++)
-			 _preset_zone[i] = zone[i];
-			 
-		for (auto &variable : _uniforms)
+		if (_tutorial_index > 0)
 		{
-			int values_int[16] = {};
-			unsigned int values_uint[16] = {};
-			float values_float[16] = {};
+			if (_tutorial_index == 1)
+			{
+				tutorial_text =
+					"This is the preset selection. All changes will be saved to the selected file.\n\n"
+					"You can add a new one by clicking on the '+' button. Simply enter a new preset name or the full path to an existing file (*.ini) in the text box that opens.\n"
+					"To delete the currently selected preset file, click on the '-' button.\n"
+					"Make sure a valid file is selected here before starting to tweak any values later, or else your changes won't be saved!\n\n"
+					"Add a new preset by clicking on the '+' button to continue the tutorial.";
 
-			switch (variable.basetype)
+				ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(1, 0, 0, 1));
+				ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(1, 0, 0, 1));
+			}
+
+			const auto get_preset_file = [](void *data, int i, const char **out) {
+				*out = static_cast<runtime *>(data)->_preset_files[i].string().c_str();
+				return true;
+			};
+
+			ImGui::PushItemWidth(-(30 + ImGui::GetStyle().ItemSpacing.x) * 2 - 1);
+
+			//auto preset
+			if (ImGui::Combo("##presets", &_current_preset, get_preset_file, this, static_cast<int>(_preset_files.size())))
 			{
-			case uniform_datatype::signed_integer:
-				get_uniform_value(variable, values_int, 16);
-				preset.get(variable.effect_filename, variable.name, values_int);
-				set_uniform_value(variable, values_int, 16);
-				break;
-			case uniform_datatype::boolean:
-			case uniform_datatype::unsigned_integer:
-				get_uniform_value(variable, values_uint, 16);
-				preset.get(variable.effect_filename, variable.name, values_uint);
-				set_uniform_value(variable, values_uint, 16);
-				break;
-			case uniform_datatype::floating_point:
-				get_uniform_value(variable, values_float, 16);
-				preset.get(variable.effect_filename, variable.name, values_float);
-				set_uniform_value(variable, values_float, 16);
-				break;
+				save_config();
+
+				if (_performance_mode && !is_preset_compatible(_preset_files[_current_preset]))
+				{
+					reload();
+				}
+				else
+				{
+					load_preset(_preset_files[_current_preset]);
+				}
 			}
-		}
 
-		// Reorder techniques
-		std::vector<std::string> technique_list;
-		preset.get("", "Techniques", technique_list);
-		std::vector<std::string> technique_sorting_list;
-		preset.get("", "TechniqueSorting", technique_sorting_list);
+			ImGui::PopItemWidth();
 
-		if (technique_sorting_list.empty())
-			technique_sorting_list = technique_list;
+			ImGui::SameLine();
 
-		std::sort(_techniques.begin(), _techniques.end(),
-			[&technique_sorting_list](const auto &lhs, const auto &rhs) {
-				return (std::find(technique_sorting_list.begin(), technique_sorting_list.end(), lhs.name) - technique_sorting_list.begin()) <
-					   (std::find(technique_sorting_list.begin(), technique_sorting_list.end(), rhs.name) - technique_sorting_list.begin());
-			});
+			if (ImGui::Button("+", ImVec2(30, 0)))
+			{
+				ImGui::OpenPopup("Add Preset");
+			}
 
-		for (auto &technique : _techniques)
-		{
-			// Ignore preset if "enabled" annotation is set
-			technique.enabled = technique.annotations["enabled"].as<bool>() || std::find(technique_list.begin(), technique_list.end(), technique.name) != technique_list.end();
+			if (ImGui::BeginPopup("Add Preset"))
+			{
+				char buf[260] = { };
 
-			preset.get("", "Key" + technique.name, technique.toggle_key_data);
-		}
-	}
-	void runtime::load_current_preset()
-	{
-		if (_current_preset >= 0)
-		{
-			load_preset(_preset_files[_current_preset]);
-		}
-	}
-	void runtime::save_preset(const filesystem::path &path) const
-	{
-		ini_file preset(path);
+				if (ImGui::InputText("Name", buf, sizeof(buf), ImGuiInputTextFlags_EnterReturnsTrue))
+				{
+					auto path = filesystem::absolute(buf, s_gw2hook_wrkdir_path + "Presets");
+					path.replace_extension(".ini");
 
-		preset.set("", "Zone", preset_zone);
+					if (filesystem::exists(path) || filesystem::exists(path.parent_path()))
+					{
+						_preset_files.push_back(path);
+						_preset_files_generation++;
+						update_search_path_watchers();
 
-		std::unordered_set<std::string> active_effect_filenames;
-		for (const auto &technique : _techniques)
-		{
-			if (technique.enabled)
+						_current_preset = static_cast<int>(_preset_files.size()) - 1;
+
+						load_preset(path);
+						save_config();
+
+						ImGui::CloseCurrentPopup();
+
+						if (_tutorial_index == 1)
+						{
+							continue_tutorial = true;
+						}
+					}
+				}
+
+				ImGui::EndPopup();
+			}
+
+			if (_current_preset >= 0)
+			{
+				ImGui::SameLine();
+
+				if (ImGui::Button("-", ImVec2(30, 0)))
+				{
+					ImGui::OpenPopup("Remove Preset");
+				}
+
+				if (ImGui::BeginPopup("Remove Preset"))
+				{
+					ImGui::Text("Do you really want to remove this preset?");
+
+					if (ImGui::Button("Yes", ImVec2(-1, 0)))
+					{
+						_preset_files.erase(_preset_files.begin() + _current_preset);
+						_preset_files_generation++;
+
+						if (_current_preset == static_cast<ptrdiff_t>(_preset_files.size()))
+						{
+							_current_preset -= 1;
+						}
+						if (_current_preset >= 0)
+						{
+							load_preset(_preset_files[_current_preset]);
+						}
+
+						save_config();
+
+						ImGui::CloseCurrentPopup();
+					}
+
+					ImGui::EndPopup();
+				}
+			}
+
+			if (_tutorial_index == 1)
 			{
-				active_effect_filenames.insert(technique.effect_filename);
+				ImGui::PopStyleColor();
+				ImGui::PopStyleColor();
 			}
 		}
 
-		for (const auto &variable : _uniforms)
+		if (_tutorial_index > 1)
 		{
-			if (variable.annotations.count("source") || !active_effect_filenames.count(variable.effect_filename))
+			ImGui::Spacing();
+			ImGui::Separator();
+			ImGui::Spacing();
+
+			ImGui::Text("When using the auto preset selection, use this to limit this preset to a specific zone.");
+			ImGui::Text("More info about this field in the \"Gw2 Settings\" tab.");
+			if (ImGui::InputText("Zone", _preset_zone, sizeof(_preset_zone), ImGuiInputTextFlags_AutoSelectAll)) {
+				preset_zone = _preset_zone;
+				save_preset(_preset_files[_current_preset]);
+				
+			}
+			
+			ImGui::Spacing();
+			ImGui::Separator();
+			ImGui::Spacing();
+			
+			ImGui::PushItemWidth(-130);
+
+			if (ImGui::InputText("##filter", _effect_filter_buffer, sizeof(_effect_filter_buffer), ImGuiInputTextFlags_AutoSelectAll))
 			{
-				continue;
+				filter_techniques(_effect_filter_buffer);
+			}
+			else if (!ImGui::IsItemActive() && _effect_filter_buffer[0] == '\0')
+			{
+				strcpy(_effect_filter_buffer, "Search");
 			}
 
-			int values_int[16] = {};
-			unsigned int values_uint[16] = {};
-			float values_float[16] = {};
+			ImGui::PopItemWidth();
 
-			assert(variable.rows * variable.columns < 16);
+			ImGui::SameLine();
 
-			switch (variable.basetype)
+			if (ImGui::Button(_effects_expanded_state & 2 ? "Collapse All" : "Expand All", ImVec2(130 - ImGui::GetStyle().ItemSpacing.x, 0)))
 			{
-			case uniform_datatype::signed_integer:
-				get_uniform_value(variable, values_int, 16);
-				preset.set(variable.effect_filename, variable.name, variant(values_int, variable.rows * variable.columns));
-				break;
-			case uniform_datatype::boolean:
-			case uniform_datatype::unsigned_integer:
-				get_uniform_value(variable, values_uint, 16);
-				preset.set(variable.effect_filename, variable.name, variant(values_uint, variable.rows * variable.columns));
-				break;
-			case uniform_datatype::floating_point:
-				get_uniform_value(variable, values_float, 16);
-				preset.set(variable.effect_filename, variable.name, variant(values_float, variable.rows * variable.columns));
-				break;
+				_effects_expanded_state = (~_effects_expanded_state & 2) | 1;
 			}
-		}
-
-		std::vector<std::string> technique_list, technique_sorting_list;
-		std::unordered_set<std::string> effects_files;
 
-		for (const auto &technique : _techniques)
-		{
-			if (technique.enabled)
+			if (_tutorial_index == 2)
 			{
-				effects_files.emplace(technique.effect_filename);
-				technique_list.push_back(technique.name);
+				tutorial_text =
+					"This is the list of techniques. It contains all techniques in the effect files (*.fx) that were found in the effect search paths as specified on the 'Settings' tab.\n\n"
+					"Enter text in the box at the top to filter it and search for specific techniques.\n\n"
+					"Click on a technique to enable or disable it or drag it to a new location in the list to change the order in which the effects are applied.";
+
+				ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(1, 0, 0, 1));
 			}
 
-			technique_sorting_list.push_back(technique.name);
+			ImGui::Spacing();
 
-			if (technique.toggle_key_data[0] != 0)
-			{
-				// Make sure techniques that are disabled but can be enabled via hotkey are loaded during fast loading too
-				effects_files.emplace(technique.effect_filename);
+			const float bottom_height = _performance_mode ? ImGui::GetFrameHeightWithSpacing() + ImGui::GetStyle().ItemSpacing.y : _variable_editor_height;
 
-				preset.set("", "Key" + technique.name, technique.toggle_key_data);
+			if (ImGui::BeginChild("##techniques", ImVec2(-1, -bottom_height), true))
+			{
+				draw_overlay_technique_editor();
 			}
-			else if (int value = 0; preset.get("", "Key" + technique.name, value), value != 0)
+
+			ImGui::EndChild();
+
+			if (_tutorial_index == 2)
 			{
-				// Clear toggle key data
-				preset.set("", "Key" + technique.name, 0);
+				ImGui::PopStyleColor();
 			}
 		}
 
-		preset.set("", "Effects", variant(std::make_move_iterator(effects_files.cbegin()), std::make_move_iterator(effects_files.cend())));
-		preset.set("", "Techniques", std::move(technique_list));
-		preset.set("", "TechniqueSorting", std::move(technique_sorting_list));
-	}
-	void runtime::save_current_preset() const
-	{
-		if (_current_preset >= 0)
+		if (_tutorial_index > 2 && !_performance_mode)
 		{
-			save_preset(_preset_files[_current_preset]);
-		}
-	}
+			ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
+			ImGui::ButtonEx("##splitter", ImVec2(-1, 5));
+			ImGui::PopStyleVar();
 
-	void runtime::save_screenshot() const
-	{
-		std::vector<uint8_t> data(_width * _height * 4);
-		capture_frame(data.data());
+			if (ImGui::IsItemHovered())
+			{
+				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeNS);
+			}
+			if (ImGui::IsItemActive())
+			{
+				_variable_editor_height -= _imgui_context->IO.MouseDelta.y;
+			}
 
-		const int hour = _date[3] / 3600;
-		const int minute = (_date[3] - hour * 3600) / 60;
-		const int second = _date[3] - hour * 3600 - minute * 60;
+			if (_tutorial_index == 3)
+			{
+				tutorial_text =
+					"This is the list of variables. It contains all tweakable options the effects expose. All values here apply in real-time. Double click on a widget to manually edit the value.\n\n"
+					"Enter text in the box at the top to filter it and search for specific variables.\n\n"
+					"Once you have finished tweaking your preset, be sure to go to the 'Settings' tab and change the 'Usage Mode' to 'Performance Mode'. "
+					"This will recompile all shaders into a more optimal representation that gives a significant performance boost, but will disable variable tweaking and this list.";
 
-		char filename[25];
-		ImFormatString(filename, sizeof(filename), " %.4d-%.2d-%.2d %.2d-%.2d-%.2d%s", _date[0], _date[1], _date[2], hour, minute, second, _screenshot_format == 0 ? ".bmp" : ".png");
-		const auto path = _screenshot_path / (s_target_executable_path.filename_without_extension() + filename);
+				ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(1, 0, 0, 1));
+			}
 
-		LOG(INFO) << "Saving screenshot to " << path << " ...";
+			const float bottom_height = ImGui::GetFrameHeightWithSpacing() + ImGui::GetStyle().ItemSpacing.y + (_tutorial_index == 3 ? 125 : 0);
 
-		FILE *file;
-		bool success = false;
+			if (ImGui::BeginChild("##variables", ImVec2(-1, -bottom_height), true))
+			{
+				draw_overlay_variable_editor();
+			}
 
-		if (_wfopen_s(&file, path.wstring().c_str(), L"wb") == 0)
-		{
-			stbi_write_func *const func = [](void *context, void *data, int size) {
-				fwrite(data, 1, size, static_cast<FILE *>(context));
-			};
+			ImGui::EndChild();
 
-			switch (_screenshot_format)
+			if (_tutorial_index == 3)
 			{
-			case 0:
-				success = stbi_write_bmp_to_func(func, file, _width, _height, 4, data.data()) != 0;
-				break;
-			case 1:
-				success = stbi_write_png_to_func(func, file, _width, _height, 4, data.data(), 0) != 0;
-				break;
+				ImGui::PopStyleColor();
 			}
-
-			fclose(file);
 		}
 
-		if (!success)
+		if (_tutorial_index > 3)
 		{
-			LOG(ERROR) << "Failed to write screenshot to " << path << "!";
-		}
-	}
-
-	static const char keyboard_keys[256][16] = {
-		"", "", "", "Cancel", "", "", "", "", "Backspace", "Tab", "", "", "Clear", "Enter", "", "",
-		"Shift", "Control", "Alt", "Pause", "Caps Lock", "", "", "", "", "", "", "Escape", "", "", "", "",
-		"Space", "Page Up", "Page Down", "End", "Home", "Left Arrow", "Up Arrow", "Right Arrow", "Down Arrow", "Select", "", "", "Print Screen", "Insert", "Delete", "Help",
-		"0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "", "", "", "", "", "",
-		"", "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N", "O",
-		"P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "Left Windows", "Right Windows", "", "", "Sleep",
-		"Numpad 0", "Numpad 1", "Numpad 2", "Numpad 3", "Numpad 4", "Numpad 5", "Numpad 6", "Numpad 7", "Numpad 8", "Numpad 9", "Numpad *", "Numpad +", "", "Numpad -", "Numpad Decimal", "Numpad /",
-		"F1", "F2", "F3", "F4", "F5", "F6", "F7", "F8", "F9", "F10", "F11", "F12", "F13", "F14", "F15", "F16",
-		"F17", "F18", "F19", "F20", "F21", "F22", "F23", "F24", "", "", "", "", "", "", "", "",
-		"Num Lock", "Scroll Lock",
-	};
+			ImGui::Spacing();
 
-	static inline std::vector<std::string> split(const std::string &str, char delim)
-	{
-		std::vector<std::string> result;
+			if (ImGui::Button("Reload", ImVec2(-1, 0)))
+			{
+				reload();
+			}
 
-		for (size_t i = 0, len = str.size(), found; i < len; i = found + 1)
+			ImGui::SameLine();
+		}
+		else
 		{
-			found = str.find_first_of(delim, i);
+			ImGui::BeginChildFrame(ImGui::GetID("Tutorial Frame"), ImVec2(-1, 125));
+			ImGui::TextWrapped(tutorial_text);
+			ImGui::EndChildFrame();
 
-			if (found == std::string::npos)
-				found = len;
+			if ((_tutorial_index != 1 || _current_preset != -1) &&
+				ImGui::Button(_tutorial_index == 3 ? "Finish" : "Continue", ImVec2(-1, 0)) || continue_tutorial)
+			{
+				_tutorial_index++;
 
-			result.push_back(str.substr(i, found - i));
+				save_config();
+			}
 		}
-
-		return result;
 	}
-
-	void runtime::draw_overlay()
+	void runtime::draw_overlay_menu_settings()
 	{
-		const bool show_splash = (_last_present_time - _last_reload_time) < std::chrono::seconds(5);
-
-		if (!_overlay_key_setting_active &&
-			_input->is_key_pressed(_menu_key_data[0], _menu_key_data[1], _menu_key_data[2], _menu_key_data[3]))
-		{
-			_show_menu = !_show_menu;
-		}
-
-		_effects_expanded_state &= 2;
+		char edit_buffer[2048];
 
-		// Update ImGui configuration
-		ImGui::SetCurrentContext(_imgui_context);
-		auto &imgui_io = _imgui_context->IO;
-		imgui_io.DeltaTime = _last_frame_duration.count() * 1e-9f;
-		imgui_io.MouseDrawCursor = _show_menu;
+		const auto update_key_data = [&](unsigned int key_data[4]) {
+			const unsigned int last_key_pressed = _input->last_key_pressed();
 
-		imgui_io.KeyCtrl = _input->is_key_down(0x11); // VK_CONTROL
-		imgui_io.KeyShift = _input->is_key_down(0x10); // VK_SHIFT
-		imgui_io.KeyAlt = _input->is_key_down(0x12); // VK_MENU
-		imgui_io.MousePos.x = static_cast<float>(_input->mouse_position_x());
-		imgui_io.MousePos.y = static_cast<float>(_input->mouse_position_y());
-		imgui_io.MouseWheel += _input->mouse_wheel_delta();
+			if (last_key_pressed != 0)
+			{
+				if (last_key_pressed == 0x08) // Backspace
+				{
+					key_data[0] = 0;
+					key_data[1] = 0;
+					key_data[2] = 0;
+					key_data[3] = 0;
+				}
+				else if (last_key_pressed < 0x10 || last_key_pressed > 0x12)
+				{
+					key_data[0] = last_key_pressed;
+					key_data[1] = _input->is_key_down(0x11);
+					key_data[2] = _input->is_key_down(0x10);
+					key_data[3] = _input->is_key_down(0x12);
+				}
 
-		for (unsigned int i = 0; i < 256; i++)
-		{
-			imgui_io.KeysDown[i] = _input->is_key_down(i);
+				save_config();
+			}
+		};
 
-			if (_input->is_key_pressed(i))
+		const auto copy_key_shortcut_to_edit_buffer = [&edit_buffer](const unsigned int shortcut[4]) {
+			size_t offset = 0;
+			if (shortcut[1]) memcpy(edit_buffer, "Ctrl + ", 8), offset += 7;
+			if (shortcut[2]) memcpy(edit_buffer + offset, "Shift + ", 9), offset += 8;
+			if (shortcut[3]) memcpy(edit_buffer + offset, "Alt + ", 7), offset += 6;
+			memcpy(edit_buffer + offset, keyboard_keys[shortcut[0]], sizeof(*keyboard_keys));
+		};
+		const auto copy_vector_to_edit_buffer = [&edit_buffer](const std::vector<std::string> &data) {
+			size_t offset = 0;
+			edit_buffer[0] = '\0';
+			for (const auto &line : data)
 			{
-				imgui_io.AddInputCharacter(_input->key_to_text(i));
+				memcpy(edit_buffer + offset, line.c_str(), line.size());
+				offset += line.size();
+				edit_buffer[offset++] = '\n';
+				edit_buffer[offset] = '\0';
 			}
-		}
-		for (unsigned int i = 0; i < 5; i++)
-		{
-			imgui_io.MouseDown[i] = _input->is_mouse_button_down(i);
-		}
+		};
+		const auto copy_search_paths_to_edit_buffer = [&edit_buffer](const std::vector<filesystem::path> &search_paths) {
+			size_t offset = 0;
+			edit_buffer[0] = '\0';
+			for (const auto &search_path : search_paths)
+			{
+				memcpy(edit_buffer + offset, search_path.string().c_str(), search_path.string().length());
+				offset += search_path.string().length();
+				edit_buffer[offset++] = '\n';
+				edit_buffer[offset] = '\0';
+			}
+		};
 
-		if (imgui_io.KeyCtrl && !_no_font_scaling)
+		if (ImGui::CollapsingHeader("General", ImGuiTreeNodeFlags_DefaultOpen))
 		{
-			// Change global font scale if user presses the control key and moves the mouse wheel
-			imgui_io.FontGlobalScale = ImClamp(imgui_io.FontGlobalScale + imgui_io.MouseWheel * 0.10f, 0.2f, 2.50f);
-		}
-
-		ImGui::NewFrame();
+			assert(_menu_key_data[0] < 256);
 
-		// Create ImGui widgets and windows
-		if (show_splash)
-		{
-			ImGui::SetNextWindowPos(ImVec2(0, 100));
-			ImGui::SetNextWindowSize(ImVec2(_width/3.0f - 20.0f, ImGui::GetFrameHeightWithSpacing() * 3), ImGuiCond_Appearing);
-			ImGui::Begin("Splash Screen", nullptr,
-				ImGuiWindowFlags_NoTitleBar |
-				ImGuiWindowFlags_NoScrollbar |
-				ImGuiWindowFlags_NoMove |
-				ImGuiWindowFlags_NoResize |
-				ImGuiWindowFlags_NoSavedSettings |
-				ImGuiWindowFlags_NoInputs |
-				ImGuiWindowFlags_NoFocusOnAppearing);
+			copy_key_shortcut_to_edit_buffer(_menu_key_data);
 
-			ImGui::TextUnformatted("ReShade by crosire (http://reshade.me)");
-			ImGui::TextUnformatted("Gw2 Hook " VERSION_STRING_FILE " by Grenbur (04348.github.io/Gw2Hook/)");
+			ImGui::InputText("Overlay Key", edit_buffer, sizeof(edit_buffer), ImGuiInputTextFlags_ReadOnly);
 
-			ImGui::Spacing();
+			_overlay_key_setting_active = false;
 
-			if (_reload_remaining_effects != 0)
+			if (ImGui::IsItemActive())
 			{
-				ImGui::Text(
-					"Loading (%u effects remaining) ... ",
-					static_cast<unsigned int>(_reload_remaining_effects));
+				_overlay_key_setting_active = true;
+
+				update_key_data(_menu_key_data);
 			}
-			else
+			else if (ImGui::IsItemHovered())
 			{
-				ImGui::Text(
-					"Press '%s%s%s%s' to open the configuration menu.",
-					_menu_key_data[1] ? "Ctrl + " : "",
-					_menu_key_data[2] ? "Shift + " : "",
-					_menu_key_data[3] ? "Alt + " : "",
-					keyboard_keys[_menu_key_data[0]]);
+				ImGui::SetTooltip("Click in the field and press any key to change the shortcut to that key.");
 			}
 
-			ImGui::End();
-		}
-
-		if (_reload_remaining_effects == 0)
-		{
-			if (!show_splash)
-			{
-				ImGui::SetNextWindowPos(ImVec2(_width - 200.0f, 0));
-				ImGui::SetNextWindowSize(ImVec2(200.0f, 200.0f));
-				ImGui::PushFont(_imgui_context->IO.Fonts->Fonts[1]);
-				ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(_imgui_col_text_fps[0], _imgui_col_text_fps[1], _imgui_col_text_fps[2], 1.0f));
-				ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4());
-				ImGui::Begin("FPS", nullptr,
-					ImGuiWindowFlags_NoTitleBar |
-					ImGuiWindowFlags_NoScrollbar |
-					ImGuiWindowFlags_NoMove |
-					ImGuiWindowFlags_NoResize |
-					ImGuiWindowFlags_NoSavedSettings |
-					ImGuiWindowFlags_NoInputs |
-					ImGuiWindowFlags_NoFocusOnAppearing);
+			assert(_effects_key_data[0] < 256);
 
-				char temp[512];
+			copy_key_shortcut_to_edit_buffer(_effects_key_data);
 
-				if (_show_clock)
-				{
-					const int hour = _date[3] / 3600;
-					const int minute = (_date[3] - hour * 3600) / 60;
+			ImGui::InputText("Effects Toggle Key", edit_buffer, sizeof(edit_buffer), ImGuiInputTextFlags_ReadOnly);
 
-					ImFormatString(temp, sizeof(temp), " %02u:%02u", hour, minute);
-					ImGui::SetCursorPosX(ImGui::GetWindowContentRegionWidth() - ImGui::CalcTextSize(temp).x);
-					ImGui::TextUnformatted(temp);
-				}
-				if (_show_framerate)
-				{
-					ImFormatString(temp, sizeof(temp), "%.0f fps", _imgui_context->IO.Framerate);
-					ImGui::SetCursorPosX(ImGui::GetWindowContentRegionWidth() - ImGui::CalcTextSize(temp).x);
-					ImGui::TextUnformatted(temp);
+			_toggle_key_setting_active = false;
 
-					ImFormatString(temp, sizeof(temp), "%*lld ms", 3, std::chrono::duration_cast<std::chrono::milliseconds>(_last_frame_duration).count());
-					ImGui::SetCursorPosX(ImGui::GetWindowContentRegionWidth() - ImGui::CalcTextSize(temp).x);
-					ImGui::TextUnformatted(temp);
-				}
+			if (ImGui::IsItemActive())
+			{
+				_toggle_key_setting_active = true;
 
-				ImGui::End();
-				ImGui::PopStyleColor(2);
-				ImGui::PopFont();
+				update_key_data(_effects_key_data);
 			}
-
-			if (_show_menu)
+			else if (ImGui::IsItemHovered())
 			{
-				if (_is_fast_loading)
-				{
-					// Need to do a full reload since some effects might be missing due to fast loading
-					reload();
+				ImGui::SetTooltip("Click in the field and press any key to change the shortcut to that key.");
+			}
 
-					assert(!_is_fast_loading);
-				}
-				else
-				{
-					ImGui::SetNextWindowPos(ImVec2(20, 20), ImGuiCond_FirstUseEver);
-					ImGui::SetNextWindowSize(ImVec2(std::min(730.0f, _width / 3.0f), _height - 40.0f), ImGuiCond_FirstUseEver);
-					ImGui::Begin("ReShade " VERSION_STRING_FILE " by crosire###Main", &_show_menu,
-						ImGuiWindowFlags_MenuBar |
-						ImGuiWindowFlags_NoCollapse);
+			int usage_mode_index = _performance_mode ? 0 : 1;
 
-					draw_overlay_menu();
+			if (ImGui::Combo("Usage Mode", &usage_mode_index, "Performance Mode\0Configuration Mode\0"))
+			{
+				_performance_mode = usage_mode_index == 0;
 
-					ImGui::End();
-				}
+				save_config();
+				reload();
 			}
-		}
-
-		// Render ImGui widgets and windows
-		ImGui::Render();
-
-		_input->block_mouse_input(_input_processing_mode != 0 && _show_menu && (_imgui_context->IO.WantCaptureMouse || _input_processing_mode == 2));
-		_input->block_keyboard_input(_input_processing_mode != 0 && _show_menu && (_imgui_context->IO.WantCaptureKeyboard || _input_processing_mode == 2));
 
-		if (const auto draw_data = ImGui::GetDrawData(); draw_data != nullptr && draw_data->CmdListsCount != 0 && draw_data->TotalVtxCount != 0)
-		{
-			render_imgui_draw_data(draw_data);
-		}
-	}
-	void runtime::draw_overlay_menu()
-	{
-		if (ImGui::BeginMenuBar())
-		{
-			ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImGui::GetStyle().ItemSpacing * 2);
+			if (ImGui::Combo("Input Processing", &_input_processing_mode, "Pass on all input\0Block input when cursor is on overlay\0Block all input when overlay is visible\0"))
+			{
+				save_config();
+			}
 
-			for (size_t i = 0; i < _menu_callables.size(); ++i)
+			if (ImGui::Checkbox("Build overlay on a worker thread", &_build_overlay_on_worker))
+			{
+				save_config();
+			}
+			if (ImGui::IsItemHovered())
 			{
-				const std::string &label = _menu_callables[i].first;
+				ImGui::SetTooltip("Builds the menus while the game presents, so tuning effects costs less frame time. The overlay is shown one frame later then.\nTabs of the graphics API and Gw2 Settings are still built on the render thread.");
+			}
 
-				if (ImGui::Selectable(label.c_str(), _menu_index == i, 0, ImVec2(ImGui::CalcTextSize(label.c_str()).x, 0)))
-				{
-					_menu_index = i;
-				}
+			if (ImGui::Checkbox("Half precision shaders", &_half_precision_shaders))
+			{
+				save_config();
+				reload();
+			}
+			if (ImGui::IsItemHovered())
+			{
+				ImGui::SetTooltip("Computes values in pixel and compute shaders at 16-bit precision where that does not affect texture coordinates, depth, uniforms or high precision render targets, which is faster on GPUs that support it.\nOnly applies to Direct3D 11. Techniques can opt in or out themselves with a 'half_precision' annotation.");
+			}
 
-				ImGui::SameLine();
+			if (ImGui::Checkbox("GPU debug markers", &_gpu_markers))
+			{
+				save_config();
+			}
+			if (ImGui::IsItemHovered())
+			{
+				ImGui::SetTooltip("Labels every technique and pass with its name for PIX, RenderDoc and Nsight.\nDirect3D 11 renders techniques without command lists while this is enabled, which costs some CPU time.");
 			}
 
-			ImGui::PopStyleVar();
-			ImGui::EndMenuBar();
-		}
+			copy_search_paths_to_edit_buffer(_effect_search_paths);
+
+			if (ImGui::InputTextMultiline("Effect Search Paths", edit_buffer, sizeof(edit_buffer), ImVec2(0, 60)))
+			{
+				const auto effect_search_paths = split(edit_buffer, '\n');
+				_effect_search_paths.assign(effect_search_paths.begin(), effect_search_paths.end());
 
-		ImGui::PushID(_menu_callables[_menu_index].first.c_str());
+				save_config();
+			}
 
-		_menu_callables[_menu_index].second();
+			copy_search_paths_to_edit_buffer(_texture_search_paths);
 
-		ImGui::PopID();
-	}
-	void runtime::draw_overlay_menu_home()
-	{
-		if (!_effects_enabled)
-		{
-			ImGui::Text("Effects are disabled. Press '%s%s%s%s' to enable them again.",
-				_effects_key_data[1] ? "Ctrl + " : "",
-				_effects_key_data[2] ? "Shift + " : "",
-				_effects_key_data[3] ? "Alt + " : "",
-				keyboard_keys[_effects_key_data[0]]);
-		}
+			if (ImGui::InputTextMultiline("Texture Search Paths", edit_buffer, sizeof(edit_buffer), ImVec2(0, 60)))
+			{
+				const auto texture_search_paths = split(edit_buffer, '\n');
+				_texture_search_paths.assign(texture_search_paths.begin(), texture_search_paths.end());
 
-		bool continue_tutorial = false;
-		const char *tutorial_text =
-			"Welcome! Since this is the first time you start ReShade, we'll go through a quick tutorial covering the most important features.\n\n"
-			"Before we continue: If you have difficulties reading this text, press the 'Ctrl' key and adjust the text size with your mouse wheel. "
-			"The window size is variable as well, just grab the bottom right corner and move it around.\n\n"
-			"Click on the 'Continue' button to continue the tutorial.";
+				save_config();
+			}
 
-		if (_performance_mode && _tutorial_index <= 3)
-		{
-			_tutorial_index = 4;
-		}
+			copy_vector_to_edit_buffer(_preprocessor_definitions);
 
-		if (_tutorial_index > 0)
-		{
-			if (_tutorial_index == 1)
+			if (ImGui::InputTextMultiline("Preprocessor Definitions", edit_buffer, sizeof(edit_buffer), ImVec2(0, 100)))
 			{
-				tutorial_text =
-					"This is the preset selection. All changes will be saved to the selected file.\n\n"
-					"You can add a new one by clicking on the '+' button. Simply enter a new preset name or the full path to an existing file (*.ini) in the text box that opens.\n"
-					"To delete the currently selected preset file, click on the '-' button.\n"
-					"Make sure a valid file is selected here before starting to tweak any values later, or else your changes won't be saved!\n\n"
-					"Add a new preset by clicking on the '+' button to continue the tutorial.";
+				// Remember what the effects were compiled with when editing starts
+				if (!_is_editing_preprocessor_definitions)
+				{
+					_preprocessor_definitions_before_edit = _preprocessor_definitions;
+					_is_editing_preprocessor_definitions = true;
+				}
 
-				ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(1, 0, 0, 1));
-				ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(1, 0, 0, 1));
+				_preprocessor_definitions = split(edit_buffer, '\n');
+
+				save_config();
 			}
 
-			const auto get_preset_file = [](void *data, int i, const char **out) {
-				*out = static_cast<runtime *>(data)->_preset_files[i].string().c_str();
-				return true;
-			};
+			// Changes are applied once the field loses focus, so typing a definition does not compile effects again on every key press
+			if (_is_editing_preprocessor_definitions && !ImGui::IsItemActive())
+			{
+				_is_editing_preprocessor_definitions = false;
 
-			ImGui::PushItemWidth(-(30 + ImGui::GetStyle().ItemSpacing.x) * 2 - 1);
+				// Only effects that looked up one of the macros whose value differs now have to be compiled again
+				std::unordered_map<std::string, std::string> previous_values;
+				for (const auto &definition : _preprocessor_definitions_before_edit)
+					if (!definition.empty())
+						previous_values.insert(split_preprocessor_definition(definition));
 
-			//auto preset
-			if (ImGui::Combo("##presets", &_current_preset, get_preset_file, this, static_cast<int>(_preset_files.size())))
-			{
-				save_config();
+				for (const auto &definition : _preprocessor_definitions)
+				{
+					if (definition.empty())
+					{
+						continue;
+					}
 
-				if (_performance_mode)
-				{
-					reload();
+					auto macro = split_preprocessor_definition(definition);
+					const auto it = previous_values.find(macro.first);
+
+					if (it == previous_values.end() || it->second != macro.second)
+					{
+						_pending_macro_modifications.insert(macro.first);
+					}
+
+					if (it != previous_values.end())
+					{
+						previous_values.erase(it);
+					}
 				}
-				else
+
+				for (const auto &removed : previous_values)
 				{
-					load_preset(_preset_files[_current_preset]);
+					_pending_macro_modifications.insert(removed.first);
 				}
+
+				_preprocessor_definitions_before_edit.clear();
 			}
 
-			ImGui::PopItemWidth();
+			if (ImGui::Button("Export Effect Package", ImVec2(ImGui::CalcItemWidth(), 0)))
+			{
+				const size_t count = shader_cache::export_package(effect_package_path(), shader_cache::used_keys());
 
-			ImGui::SameLine();
+				if (count != 0)
+				{
+					LOG(INFO) << "Exported " << count << " shaders to effect package " << effect_package_path() << ".";
+				}
+			}
 
-			if (ImGui::Button("+", ImVec2(30, 0)))
+			if (ImGui::IsItemHovered())
 			{
-				ImGui::OpenPopup("Add Preset");
+				ImGui::SetTooltip("Write the compiled shaders of all loaded effects into a single file next to the shader folder.\nOther machines with the same effects, settings and resolution then find them there instead of compiling them again.");
 			}
 
-			if (ImGui::BeginPopup("Add Preset"))
+			if (ImGui::Button("Restart Tutorial", ImVec2(ImGui::CalcItemWidth(), 0)))
 			{
-				char buf[260] = { };
-
-				if (ImGui::InputText("Name", buf, sizeof(buf), ImGuiInputTextFlags_EnterReturnsTrue))
-				{
-					auto path = filesystem::absolute(buf, s_gw2hook_wrkdir_path + "Presets");
-					path.replace_extension(".ini");
+				_tutorial_index = 0;
+			}
+		}
 
-					if (filesystem::exists(path) || filesystem::exists(path.parent_path()))
-					{
-						_preset_files.push_back(path);
+		if (ImGui::CollapsingHeader("Screenshots", ImGuiTreeNodeFlags_DefaultOpen))
+		{
+			assert(_screenshot_key_data[0] < 256);
 
-						_current_preset = static_cast<int>(_preset_files.size()) - 1;
+			copy_key_shortcut_to_edit_buffer(_screenshot_key_data);
 
-						load_preset(path);
-						save_config();
+			ImGui::InputText("Screenshot Key", edit_buffer, sizeof(edit_buffer), ImGuiInputTextFlags_ReadOnly);
 
-						ImGui::CloseCurrentPopup();
+			_screenshot_key_setting_active = false;
 
-						if (_tutorial_index == 1)
-						{
-							continue_tutorial = true;
-						}
-					}
-				}
+			if (ImGui::IsItemActive())
+			{
+				_screenshot_key_setting_active = true;
 
-				ImGui::EndPopup();
+				update_key_data(_screenshot_key_data);
+			}
+			else if (ImGui::IsItemHovered())
+			{
+				ImGui::SetTooltip("Click in the field and press any key to change the shortcut to that key.");
 			}
 
-			if (_current_preset >= 0)
+			memcpy(edit_buffer, _screenshot_path.string().c_str(), _screenshot_path.string().length() + 1);
+
+			if (ImGui::InputText("Screenshot Path", edit_buffer, sizeof(edit_buffer)))
 			{
-				ImGui::SameLine();
+				_screenshot_path = edit_buffer;
 
-				if (ImGui::Button("-", ImVec2(30, 0)))
-				{
-					ImGui::OpenPopup("Remove Preset");
-				}
+				save_config();
+			}
 
-				if (ImGui::BeginPopup("Remove Preset"))
-				{
-					ImGui::Text("Do you really want to remove this preset?");
+			if (ImGui::Combo("Screenshot Format", &_screenshot_format, "Bitmap (*.bmp)\0Portable Network Graphics (*.png)\0"))
+			{
+				save_config();
+			}
 
-					if (ImGui::Button("Yes", ImVec2(-1, 0)))
-					{
-						_preset_files.erase(_preset_files.begin() + _current_preset);
+			copy_key_shortcut_to_edit_buffer(_replay_capture_key_data);
 
-						if (_current_preset == static_cast<ptrdiff_t>(_preset_files.size()))
-						{
-							_current_preset -= 1;
-						}
-						if (_current_preset >= 0)
-						{
-							load_preset(_preset_files[_current_preset]);
-						}
+			ImGui::InputText("Replay Capture Key", edit_buffer, sizeof(edit_buffer), ImGuiInputTextFlags_ReadOnly);
 
-						save_config();
+			_replay_capture_key_setting_active = false;
 
-						ImGui::CloseCurrentPopup();
-					}
+			if (ImGui::IsItemActive())
+			{
+				_replay_capture_key_setting_active = true;
 
-					ImGui::EndPopup();
-				}
+				update_key_data(_replay_capture_key_data);
+			}
+			else if (ImGui::IsItemHovered())
+			{
+				ImGui::SetTooltip("Saves color and depth of the current frame to the screenshot path, for the replay benchmark in the statistics.");
 			}
 
-			if (_tutorial_index == 1)
+			copy_key_shortcut_to_edit_buffer(_frame_recording_key_data);
+
+			ImGui::InputText("Frame Recording Key", edit_buffer, sizeof(edit_buffer), ImGuiInputTextFlags_ReadOnly);
+
+			_frame_recording_key_setting_active = false;
+
+			if (ImGui::IsItemActive())
 			{
-				ImGui::PopStyleColor();
-				ImGui::PopStyleColor();
+				_frame_recording_key_setting_active = true;
+
+				update_key_data(_frame_recording_key_data);
+			}
+			else if (ImGui::IsItemHovered())
+			{
+				ImGui::SetTooltip("Starts or stops recording the time of every frame and technique to a file in the Gw2Hook folder, a summary is written to the log when it stops.");
 			}
 		}
 
-		if (_tutorial_index > 1)
+		if (ImGui::CollapsingHeader("User Interface", ImGuiTreeNodeFlags_DefaultOpen))
 		{
-			ImGui::Spacing();
-			ImGui::Separator();
-			ImGui::Spacing();
+			bool modified = false;
+			modified |= ImGui::Checkbox("Show Clock", &_show_clock);
+			ImGui::SameLine(0, 10);
+			modified |= ImGui::Checkbox("Show FPS", &_show_framerate);
 
-			ImGui::Text("When using the auto preset selection, use this to limit this preset to a specific zone.");
-			ImGui::Text("More info about this field in the \"Gw2 Settings\" tab.");
-			if (ImGui::InputText("Zone", _preset_zone, sizeof(_preset_zone), ImGuiInputTextFlags_AutoSelectAll)) {
-				preset_zone = _preset_zone;
-				save_preset(_preset_files[_current_preset]);
-				
+			modified |= ImGui::DragFloat("Alpha", &ImGui::GetStyle().Alpha, 0.005f, 0.20f, 1.0f, "%.2f");
+			modified |= ImGui::ColorEdit3("Background Color", _imgui_col_background);
+			modified |= ImGui::ColorEdit3("Item Background Color", _imgui_col_item_background);
+			modified |= ImGui::ColorEdit3("Active Item Color", _imgui_col_active);
+			modified |= ImGui::ColorEdit3("Text Color", _imgui_col_text);
+			modified |= ImGui::ColorEdit3("FPS Text Color", _imgui_col_text_fps);
+
+			if (modified)
+			{
+				save_config();
+				// Style is applied in "load_config()".
+				load_config();
 			}
+		}
+	}
+	void runtime::draw_overlay_menu_gw2()
+	{
+		if (ImGui::CollapsingHeader("General", ImGuiTreeNodeFlags_DefaultOpen))
+		{
+			if (ImGui::Combo("Auto preset selection", &_auto_preset, "Yes\0No\0")) {
+				save_config();
+			}
+
 			
-			ImGui::Spacing();
-			ImGui::Separator();
-			ImGui::Spacing();
-			
-			ImGui::PushItemWidth(-130);
+			if (ImGui::DragFloat("Fog amount", &_fog_amount, 0.005f, 0.0f, 1.0f, "%.2f")) {
+				save_config();
+			}
 
-			if (ImGui::InputText("##filter", _effect_filter_buffer, sizeof(_effect_filter_buffer), ImGuiInputTextFlags_AutoSelectAll))
-			{
-				filter_techniques(_effect_filter_buffer);
+			// Optional techniques are listed in the "OptionalTechniques" key of the preset
+			if (ImGui::DragFloat("Frame budget (ms)", &_frame_budget, 0.1f, 0.0f, 100.0f, _frame_budget > 0.0f ? "%.1f" : "Off")) {
+				save_config();
 			}
-			else if (!ImGui::IsItemActive() && _effect_filter_buffer[0] == '\0')
-			{
-				strcpy(_effect_filter_buffer, "Search");
+
+			if (ImGui::Combo("Skip UI", &_skip_ui, "Yes\0No\0")) {
+				save_config();
 			}
 
-			ImGui::PopItemWidth();
+			if (ImGui::Combo("Skip loading screens and map", &_skip_loading_screens, "Yes\0No\0")) {
+				save_config();
+			}
 
-			ImGui::SameLine();
+			if (ImGui::Combo("Suspend effects in background", &_suspend_effects_in_background, "Yes\0No\0")) {
+				save_config();
+			}
 
-			if (ImGui::Button(_effects_expanded_state & 2 ? "Collapse All" : "Expand All", ImVec2(130 - ImGui::GetStyle().ItemSpacing.x, 0)))
-			{
-				_effects_expanded_state = (~_effects_expanded_state & 2) | 1;
+			if (ImGui::SliderInt("Background frame rate", &_background_fps, 0, 60, _background_fps > 0 ? "%d" : "Unlimited")) {
+				save_config();
 			}
 
-			if (_tutorial_index == 2)
-			{
-				tutorial_text =
-					"This is the list of techniques. It contains all techniques in the effect files (*.fx) that were found in the effect search paths as specified on the 'Settings' tab.\n\n"
-					"Enter text in the box at the top to filter it and search for specific techniques.\n\n"
-					"Click on a technique to enable or disable it or drag it to a new location in the list to change the order in which the effects are applied.";
+			// Saves a full-screen copy, read and write per technique that is fused into the one before it
+			if (ImGui::Combo("Fuse color techniques", &_fuse_techniques, "Yes\0No\0")) {
+				save_config();
+			}
 
-				ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(1, 0, 0, 1));
+			// Large texture images show a low resolution preview from the cache while they are still being loaded
+			if (ImGui::Combo("Progressive texture loading", &_progressive_texture_loading, "Yes\0No\0")) {
+				save_config();
 			}
 
+			ImGui::Spacing();
+			ImGui::Separator();
 			ImGui::Spacing();
 
-			const float bottom_height = _performance_mode ? ImGui::GetFrameHeightWithSpacing() + ImGui::GetStyle().ItemSpacing.y : _variable_editor_height;
+			ImGui::Text("Following options need a restart to take effect.");
+			ImGui::Spacing();
 
-			if (ImGui::BeginChild("##techniques", ImVec2(-1, -bottom_height), true))
+			if (ImGui::InputText("Injection PS", _c_inj_ps, sizeof(_c_inj_ps), ImGuiInputTextFlags_EnterReturnsTrue))
 			{
-				draw_overlay_technique_editor();
+				try {
+					_inj_ps = std::stoull(_c_inj_ps, nullptr, 16);
+				}
+				catch (...) {
+					_inj_ps = -1;
+				}
+				save_config();
 			}
 
-			ImGui::EndChild();
-
-			if (_tutorial_index == 2)
+			if (ImGui::InputText("Injection VS", _c_inj_vs, sizeof(_c_inj_ps), ImGuiInputTextFlags_EnterReturnsTrue))
 			{
-				ImGui::PopStyleColor();
+				try {
+					_inj_vs = std::stoull(_c_inj_vs, nullptr, 16);
+				}
+				catch (...) {
+					_inj_vs = -1;
+				}
+				save_config();
 			}
-		}
 
-		if (_tutorial_index > 2 && !_performance_mode)
-		{
-			ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
-			ImGui::ButtonEx("##splitter", ImVec2(-1, 5));
-			ImGui::PopStyleVar();
+			if (ImGui::Combo("Allow Gw2 bloom", &_no_bloom, "Yes\0No\0")) {
+				save_config();
+			}
 
-			if (ImGui::IsItemHovered())
-			{
-				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeNS);
+			if (ImGui::Combo("Cache patched shaders", &_cache_shader_patches, "Yes\0No\0")) {
+				save_config();
 			}
-			if (ImGui::IsItemActive())
-			{
-				_variable_editor_height -= _imgui_context->IO.MouseDelta.y;
+
+			if (ImGui::Combo("Discover injection point", &_discover_injection, "Yes\0No\0")) {
+				save_config();
+			}
+
+			int max_frame_latency = static_cast<int>(_max_frame_latency);
+			if (ImGui::SliderInt("Maximum frame latency", &max_frame_latency, 0, 16, max_frame_latency > 0 ? "%d" : "Default")) {
+				_max_frame_latency = static_cast<unsigned int>(max_frame_latency);
+				save_config();
 			}
 
-			if (_tutorial_index == 3)
-			{
-				tutorial_text =
-					"This is the list of variables. It contains all tweakable options the effects expose. All values here apply in real-time. Double click on a widget to manually edit the value.\n\n"
-					"Enter text in the box at the top to filter it and search for specific variables.\n\n"
-					"Once you have finished tweaking your preset, be sure to go to the 'Settings' tab and change the 'Usage Mode' to 'Performance Mode'. "
-					"This will recompile all shaders into a more optimal representation that gives a significant performance boost, but will disable variable tweaking and this list.";
+			ImGui::Spacing();
+
+		}
+
+		if (ImGui::CollapsingHeader("Auto preset selection", ImGuiTreeNodeFlags_DefaultOpen))
+		{
+
+			ImGui::Text("Usage of auto preset selection :\n");
+			ImGui::Spacing(); ImGui::Spacing(); ImGui::Spacing();
+			ImGui::Text("The Zone field in first tab is used to limit a preset to a specific zone.");
+			ImGui::Text("It will then be loaded automatically when switching map.");
+			ImGui::Spacing(); ImGui::Spacing();
+			ImGui::Text("This field can be :");
+			ImGui::Text("\t\tA map ID (\"15\", \"899\", etc...)");
+			ImGui::Text("\t\tA list of map ID (\"15-24-899\")");
+			ImGui::Text("\t\tA region (\"Ascalon\", \"World vs. World\", etc...)");
+			ImGui::Text("\t\t\"global\" (used as fallback)");
+			ImGui::Text("You should have a global preset to handle unspecified maps.");
+			ImGui::Spacing(); ImGui::Spacing();
+			ImGui::Text("Informations about this map :");
+			ImGui::Text("\t\tMap ID : %d", _map_id);
+			ImGui::Text("\t\tRegion : %s", map_region.c_str());
+
+			ImGui::Spacing();
+		}
 
-				ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(1, 0, 0, 1));
-			}
+	}
+	void runtime::draw_overlay_menu_statistics()
+	{
+		if (ImGui::CollapsingHeader("General", ImGuiTreeNodeFlags_DefaultOpen))
+		{
+			ImGui::PushItemWidth(-1);
+			ImGui::PlotLines("##framerate",
+				_imgui_context->FramerateSecPerFrame, 120,
+				_imgui_context->FramerateSecPerFrameIdx,
+				nullptr,
+				_imgui_context->FramerateSecPerFrameAccum / 120 * 0.5f,
+				_imgui_context->FramerateSecPerFrameAccum / 120 * 1.5f,
+				ImVec2(0, 50));
+			ImGui::PopItemWidth();
 
-			const float bottom_height = ImGui::GetFrameHeightWithSpacing() + ImGui::GetStyle().ItemSpacing.y + (_tutorial_index == 3 ? 125 : 0);
+			uint64_t post_processing_time_cpu = 0;
+			uint64_t post_processing_time_gpu = 0;
 
-			if (ImGui::BeginChild("##variables", ImVec2(-1, -bottom_height), true))
+			for (const auto &technique : _techniques)
 			{
-				draw_overlay_variable_editor();
+				if (technique.timings != nullptr)
+				{
+					post_processing_time_cpu += technique.timings->average_cpu_duration;
+					post_processing_time_gpu += technique.timings->average_gpu_duration;
+				}
 			}
 
-			ImGui::EndChild();
+			ImGui::BeginGroup();
+			ImGui::TextUnformatted("Application:");
+			ImGui::TextUnformatted("Date:");
+			ImGui::TextUnformatted("Device:");
+			ImGui::TextUnformatted("FPS:");
+			ImGui::TextUnformatted("Post-Processing:");
+			ImGui::TextUnformatted("Draw Calls:");
+			ImGui::Text("Frame %llu:", _framecount + 1);
+			ImGui::TextUnformatted("Timer:");
+#if RESHADE_COUNT_ALLOCATIONS
+			ImGui::TextUnformatted("Allocations:");
+#endif
+			ImGui::EndGroup();
 
-			if (_tutorial_index == 3)
-			{
-				ImGui::PopStyleColor();
-			}
-		}
+			ImGui::SameLine(ImGui::GetWindowWidth() * 0.333f);
 
-		if (_tutorial_index > 3)
-		{
-			ImGui::Spacing();
+			ImGui::BeginGroup();
+			ImGui::Text("%X", std::hash<std::string>()(s_target_executable_path.filename_without_extension().string()));
+			ImGui::Text("%d-%d-%d %d", _date[0], _date[1], _date[2], _date[3]);
+			ImGui::Text("%X %d", _vendor_id, _device_id);
+			ImGui::Text("%.2f", _imgui_context->IO.Framerate);
+			ImGui::Text("%f ms (CPU)", (post_processing_time_cpu * 1e-6f));
+			ImGui::Text("%u (%u vertices)", _last_drawcalls, _last_vertices);
+			ImGui::Text("%f ms", _last_frame_duration.count() * 1e-6f);
+			ImGui::Text("%f ms", std::fmod(std::chrono::duration_cast<std::chrono::nanoseconds>(_last_present_time - _start_time).count() * 1e-6f, 16777216.0f));
+#if RESHADE_COUNT_ALLOCATIONS
+			ImGui::Text("%llu per frame (%llu more in the overlay)", _frame_allocation_count, _overlay_allocation_count);
+#endif
+			ImGui::EndGroup();
 
-			if (ImGui::Button("Reload", ImVec2(-1, 0)))
+			ImGui::SameLine(ImGui::GetWindowWidth() * 0.666f);
+
+			ImGui::BeginGroup();
+			ImGui::NewLine();
+			ImGui::NewLine();
+			ImGui::NewLine();
+			ImGui::NewLine();
+
+			if (post_processing_time_gpu != 0)
 			{
-				reload();
+				ImGui::Text("%f ms (GPU)", (post_processing_time_gpu * 1e-6f));
 			}
 
-			ImGui::SameLine();
+			ImGui::EndGroup();
 		}
-		else
+
+		if (ImGui::CollapsingHeader("Frame Times", ImGuiTreeNodeFlags_DefaultOpen))
 		{
-			ImGui::BeginChildFrame(ImGui::GetID("Tutorial Frame"), ImVec2(-1, 125));
-			ImGui::TextWrapped(tutorial_text);
-			ImGui::EndChildFrame();
+			int window = static_cast<int>(_statistics_window);
 
-			if ((_tutorial_index != 1 || _current_preset != -1) &&
-				ImGui::Button(_tutorial_index == 3 ? "Finish" : "Continue", ImVec2(-1, 0)) || continue_tutorial)
+			if (ImGui::SliderInt("Window (frames)", &window, 60, 3600))
 			{
-				_tutorial_index++;
+				_statistics_window = static_cast<unsigned int>(window);
+				_frame_time_samples.resize(_statistics_window);
 
 				save_config();
 			}
-		}
-	}
-	void runtime::draw_overlay_menu_settings()
-	{
-		char edit_buffer[2048];
 
-		const auto update_key_data = [&](unsigned int key_data[4]) {
-			const unsigned int last_key_pressed = _input->last_key_pressed();
-
-			if (last_key_pressed != 0)
+			if (ImGui::Checkbox("Publish to shared memory", &_publish_telemetry))
 			{
-				if (last_key_pressed == 0x08) // Backspace
-				{
-					key_data[0] = 0;
-					key_data[1] = 0;
-					key_data[2] = 0;
-					key_data[3] = 0;
-				}
-				else if (last_key_pressed < 0x10 || last_key_pressed > 0x12)
+				if (!_publish_telemetry)
 				{
-					key_data[0] = last_key_pressed;
-					key_data[1] = _input->is_key_down(0x11);
-					key_data[2] = _input->is_key_down(0x10);
-					key_data[3] = _input->is_key_down(0x12);
+					_telemetry.close();
 				}
 
 				save_config();
 			}
-		};
 
-		const auto copy_key_shortcut_to_edit_buffer = [&edit_buffer](const unsigned int shortcut[4]) {
-			size_t offset = 0;
-			if (shortcut[1]) memcpy(edit_buffer, "Ctrl + ", 8), offset += 7;
-			if (shortcut[2]) memcpy(edit_buffer + offset, "Shift + ", 9), offset += 8;
-			if (shortcut[3]) memcpy(edit_buffer + offset, "Alt + ", 7), offset += 6;
-			memcpy(edit_buffer + offset, keyboard_keys[shortcut[0]], sizeof(*keyboard_keys));
-		};
-		const auto copy_vector_to_edit_buffer = [&edit_buffer](const std::vector<std::string> &data) {
-			size_t offset = 0;
-			edit_buffer[0] = '\0';
-			for (const auto &line : data)
+			if (ImGui::IsItemHovered())
 			{
-				memcpy(edit_buffer + offset, line.c_str(), line.size());
-				offset += line.size();
-				edit_buffer[offset++] = '\n';
-				edit_buffer[offset] = '\0';
+				ImGui::SetTooltip("Publishes the timings of every frame, the enabled techniques and the active preset for external tools, through the shared memory object \"Local\\ReShadeTelemetry.<process id>\".");
 			}
-		};
-		const auto copy_search_paths_to_edit_buffer = [&edit_buffer](const std::vector<filesystem::path> &search_paths) {
-			size_t offset = 0;
-			edit_buffer[0] = '\0';
-			for (const auto &search_path : search_paths)
+
+			if (_frame_recorder.is_recording())
 			{
-				memcpy(edit_buffer + offset, search_path.string().c_str(), search_path.string().length());
-				offset += search_path.string().length();
-				edit_buffer[offset++] = '\n';
-				edit_buffer[offset] = '\0';
+				ImGui::TextColored(ImVec4(1.0f, 0.2f, 0.2f, 1.0f), "Recording frame times ...");
 			}
-		};
 
-		if (ImGui::CollapsingHeader("General", ImGuiTreeNodeFlags_DefaultOpen))
-		{
-			assert(_menu_key_data[0] < 256);
-
-			copy_key_shortcut_to_edit_buffer(_menu_key_data);
-
-			ImGui::InputText("Overlay Key", edit_buffer, sizeof(edit_buffer), ImGuiInputTextFlags_ReadOnly);
+			const auto frame_time = _frame_time_samples.compute();
+			const float graph_max = std::max(frame_time.max * 1.1f, 1.0f);
 
-			_overlay_key_setting_active = false;
+			ImGui::PushItemWidth(-1);
+			ImGui::PlotLines("##frametime",
+				[](void *data, int index) { return (*static_cast<const sample_window<float> *>(data))[index]; },
+				&_frame_time_samples, static_cast<int>(_frame_time_samples.size()), 0,
+				nullptr, 0.0f, graph_max, ImVec2(0, 80));
 
-			if (ImGui::IsItemActive())
-			{
-				_overlay_key_setting_active = true;
+			// Distribution of the frame times in the window, long frames show up as a tail to the right
+			float histogram[48] = { };
+			const float bucket_size = graph_max / _countof(histogram);
 
-				update_key_data(_menu_key_data);
-			}
-			else if (ImGui::IsItemHovered())
+			for (size_t i = 0; i < _frame_time_samples.size(); i++)
 			{
-				ImGui::SetTooltip("Click in the field and press any key to change the shortcut to that key.");
+				histogram[std::min(static_cast<size_t>(_frame_time_samples[i] / bucket_size), _countof(histogram) - 1)] += 1.0f;
 			}
 
-			assert(_effects_key_data[0] < 256);
-
-			copy_key_shortcut_to_edit_buffer(_effects_key_data);
-
-			ImGui::InputText("Effects Toggle Key", edit_buffer, sizeof(edit_buffer), ImGuiInputTextFlags_ReadOnly);
-
-			_toggle_key_setting_active = false;
+			char histogram_label[64];
+			snprintf(histogram_label, sizeof(histogram_label), "0 to %.1f ms", graph_max);
 
-			if (ImGui::IsItemActive())
-			{
-				_toggle_key_setting_active = true;
+			ImGui::PlotHistogram("##frametime_histogram", histogram, static_cast<int>(_countof(histogram)), 0, histogram_label, 0.0f, FLT_MAX, ImVec2(0, 80));
+			ImGui::PopItemWidth();
 
-				update_key_data(_effects_key_data);
-			}
-			else if (ImGui::IsItemHovered())
+			if (frame_time.worst_1_percent > 0.0f)
 			{
-				ImGui::SetTooltip("Click in the field and press any key to change the shortcut to that key.");
+				ImGui::Text("Frame rate: %.1f median, %.1f 1%% low", 1000.0f / frame_time.p50, 1000.0f / frame_time.worst_1_percent);
 			}
 
-			int usage_mode_index = _performance_mode ? 0 : 1;
-
-			if (ImGui::Combo("Usage Mode", &usage_mode_index, "Performance Mode\0Configuration Mode\0"))
+			struct statistics_row
 			{
-				_performance_mode = usage_mode_index == 0;
+				std::string label;
+				sample_window<float>::summary summary;
+			};
 
-				save_config();
-				reload();
-			}
+			std::vector<statistics_row> rows;
+			rows.push_back({ "Frame", frame_time });
 
-			if (ImGui::Combo("Input Processing", &_input_processing_mode, "Pass on all input\0Block input when cursor is on overlay\0Block all input when overlay is visible\0"))
+			for (const auto &technique : _techniques)
 			{
-				save_config();
-			}
-
-			copy_search_paths_to_edit_buffer(_effect_search_paths);
+				if (!technique.enabled || technique.timings == nullptr)
+				{
+					continue;
+				}
 
-			if (ImGui::InputTextMultiline("Effect Search Paths", edit_buffer, sizeof(edit_buffer), ImVec2(0, 60)))
-			{
-				const auto effect_search_paths = split(edit_buffer, '\n');
-				_effect_search_paths.assign(effect_search_paths.begin(), effect_search_paths.end());
+				rows.push_back({ technique.name + " (CPU)", technique.timings->cpu_duration_samples.compute() });
 
-				save_config();
+				if (technique.timings->gpu_duration_samples.size() != 0)
+				{
+					rows.push_back({ technique.name + " (GPU)", technique.timings->gpu_duration_samples.compute() });
+				}
 			}
 
-			copy_search_paths_to_edit_buffer(_texture_search_paths);
+			const char *const column_names[] = { "Min", "P50", "P95", "P99", "Max", "1% Low" };
+			const float column_width = ImGui::GetWindowWidth() * 0.1f;
 
-			if (ImGui::InputTextMultiline("Texture Search Paths", edit_buffer, sizeof(edit_buffer), ImVec2(0, 60)))
-			{
-				const auto texture_search_paths = split(edit_buffer, '\n');
-				_texture_search_paths.assign(texture_search_paths.begin(), texture_search_paths.end());
+			ImGui::BeginGroup();
+			ImGui::TextUnformatted("ms");
 
-				save_config();
+			for (const auto &row : rows)
+			{
+				ImGui::TextUnformatted(row.label.c_str());
 			}
 
-			copy_vector_to_edit_buffer(_preprocessor_definitions);
+			ImGui::EndGroup();
 
-			if (ImGui::InputTextMultiline("Preprocessor Definitions", edit_buffer, sizeof(edit_buffer), ImVec2(0, 100)))
+			for (size_t column = 0; column < _countof(column_names); column++)
 			{
-				_preprocessor_definitions = split(edit_buffer, '\n');
+				ImGui::SameLine(ImGui::GetWindowWidth() * 0.4f + column * column_width);
+				ImGui::BeginGroup();
+				ImGui::TextUnformatted(column_names[column]);
 
-				save_config();
-			}
+				for (const auto &row : rows)
+				{
+					const float values[] = { row.summary.min, row.summary.p50, row.summary.p95, row.summary.p99, row.summary.max, row.summary.worst_1_percent };
 
-			if (ImGui::Button("Restart Tutorial", ImVec2(ImGui::CalcItemWidth(), 0)))
-			{
-				_tutorial_index = 0;
+					ImGui::Text("%.3f", values[column]);
+				}
+
+				ImGui::EndGroup();
 			}
 		}
 
-		if (ImGui::CollapsingHeader("Screenshots", ImGuiTreeNodeFlags_DefaultOpen))
+		if (ImGui::CollapsingHeader("CPU Profiler"))
 		{
-			assert(_screenshot_key_data[0] < 256);
+			bool is_profiler_enabled = profiler::is_enabled();
 
-			copy_key_shortcut_to_edit_buffer(_screenshot_key_data);
+			if (ImGui::Checkbox("Record", &is_profiler_enabled))
+			{
+				profiler::set_enabled(is_profiler_enabled);
 
-			ImGui::InputText("Screenshot Key", edit_buffer, sizeof(edit_buffer), ImGuiInputTextFlags_ReadOnly);
+				_profiler_frame.clear();
+			}
 
-			_screenshot_key_setting_active = false;
+			ImGui::SameLine();
+			ImGui::Checkbox("Pause", &_profiler_paused);
 
-			if (ImGui::IsItemActive())
+			if (is_profiler_enabled && !_profiler_paused && _last_present_time - _last_profiler_update > std::chrono::milliseconds(500))
 			{
-				_screenshot_key_setting_active = true;
+				_last_profiler_update = _last_present_time;
+				_profiler_frame = profiler::last_frame(_profiler_frame_begin, _profiler_frame_end);
+			}
 
-				update_key_data(_screenshot_key_data);
+			if (!is_profiler_enabled)
+			{
+				ImGui::TextWrapped("Records how long the hooks and the runtime take on the CPU every frame. Recording costs a little time itself, so leave it off when not looking at the results.");
 			}
-			else if (ImGui::IsItemHovered())
+			else if (_profiler_frame.empty() || _profiler_frame_end <= _profiler_frame_begin)
 			{
-				ImGui::SetTooltip("Click in the field and press any key to change the shortcut to that key.");
+				ImGui::TextUnformatted("Waiting for a frame ...");
 			}
+			else
+			{
+				int64_t total_duration = 0;
 
-			memcpy(edit_buffer, _screenshot_path.string().c_str(), _screenshot_path.string().length() + 1);
+				for (const auto &thread : _profiler_frame)
+				{
+					for (const auto &event : thread.events)
+					{
+						if (event.depth == 0)
+						{
+							total_duration += event.end - event.begin;
+						}
+					}
+				}
 
-			if (ImGui::InputText("Screenshot Path", edit_buffer, sizeof(edit_buffer)))
-			{
-				_screenshot_path = edit_buffer;
+				const int64_t frame_duration = _profiler_frame_end - _profiler_frame_begin;
 
-				save_config();
-			}
+				ImGui::Text("ReShade took %.3f ms of the %.3f ms frame (%.1f%%).", total_duration * 1e-6f, frame_duration * 1e-6f, 100.0f * total_duration / frame_duration);
 
-			if (ImGui::Combo("Screenshot Format", &_screenshot_format, "Bitmap (*.bmp)\0Portable Network Graphics (*.png)\0"))
-			{
-				save_config();
-			}
-		}
+				ImDrawList *const draw_list = ImGui::GetWindowDrawList();
+				const float row_height = ImGui::GetTextLineHeightWithSpacing();
 
-		if (ImGui::CollapsingHeader("User Interface", ImGuiTreeNodeFlags_DefaultOpen))
-		{
-			bool modified = false;
-			modified |= ImGui::Checkbox("Show Clock", &_show_clock);
-			ImGui::SameLine(0, 10);
-			modified |= ImGui::Checkbox("Show FPS", &_show_framerate);
+				for (const auto &thread : _profiler_frame)
+				{
+					unsigned int max_depth = 0;
+					int64_t thread_duration = 0;
+
+					for (const auto &event : thread.events)
+					{
+						max_depth = std::max(max_depth, event.depth);
+
+						if (event.depth == 0)
+						{
+							thread_duration += event.end - event.begin;
+						}
+					}
 
-			modified |= ImGui::DragFloat("Alpha", &ImGui::GetStyle().Alpha, 0.005f, 0.20f, 1.0f, "%.2f");
-			modified |= ImGui::ColorEdit3("Background Color", _imgui_col_background);
-			modified |= ImGui::ColorEdit3("Item Background Color", _imgui_col_item_background);
-			modified |= ImGui::ColorEdit3("Active Item Color", _imgui_col_active);
-			modified |= ImGui::ColorEdit3("Text Color", _imgui_col_text);
-			modified |= ImGui::ColorEdit3("FPS Text Color", _imgui_col_text_fps);
+					ImGui::Text("Thread %u: %.3f ms", thread.thread_index, thread_duration * 1e-6f);
 
-			if (modified)
-			{
-				save_config();
-				// Style is applied in "load_config()".
-				load_config();
-			}
-		}
-	}
-	void runtime::draw_overlay_menu_gw2()
-	{
-		if (ImGui::CollapsingHeader("General", ImGuiTreeNodeFlags_DefaultOpen))
-		{
-			if (ImGui::Combo("Auto preset selection", &_auto_preset, "Yes\0No\0")) {
-				save_config();
-			}
+					// Top level scopes are laid out next to each other without the gaps between them, their children at their actual offset within them
+					const ImVec2 origin = ImGui::GetCursorScreenPos();
+					const float width = ImGui::GetContentRegionAvail().x;
+					const double scale = thread_duration > 0 ? width / static_cast<double>(thread_duration) : 0.0;
+					int64_t offset = 0, top_level_begin = 0, top_level_end = 0;
 
-			
-			if (ImGui::DragFloat("Fog amount", &_fog_amount, 0.005f, 0.0f, 1.0f, "%.2f")) {
-				save_config();
-			}
+					for (const auto &event : thread.events)
+					{
+						if (event.depth == 0)
+						{
+							offset += top_level_end - top_level_begin;
+							top_level_begin = event.begin;
+							top_level_end = event.end;
+						}
+						else if (top_level_end == 0)
+						{
+							continue; // Enclosing scope started in a previous frame
+						}
 
-			if (ImGui::Combo("Skip UI", &_skip_ui, "Yes\0No\0")) {
-				save_config();
-			}
+						const float x = origin.x + static_cast<float>((offset + event.begin - top_level_begin) * scale);
+						const float y = origin.y + event.depth * row_height;
+						const ImVec2 min(x, y), max(x + std::max(1.0f, static_cast<float>((event.end - event.begin) * scale)), y + row_height - 1);
+						const bool is_hovered = ImGui::IsMouseHoveringRect(min, max);
 
-			ImGui::Spacing();
-			ImGui::Separator();
-			ImGui::Spacing();
+						draw_list->AddRectFilled(min, max, ImGui::GetColorU32(is_hovered ? ImGuiCol_PlotHistogramHovered : ImGuiCol_PlotHistogram));
+						draw_list->AddRect(min, max, ImGui::GetColorU32(ImGuiCol_Border));
+						draw_list->PushClipRect(min, max, true);
+						draw_list->AddText(ImVec2(x + 2, y), ImGui::GetColorU32(ImGuiCol_Text), event.name);
+						draw_list->PopClipRect();
 
-			ImGui::Text("Following options need a restart to take effect.");
-			ImGui::Spacing();
+						if (is_hovered)
+						{
+							ImGui::SetTooltip("%s\n%.3f ms", event.name, (event.end - event.begin) * 1e-6f);
+						}
+					}
 
-			if (ImGui::InputText("Injection PS", _c_inj_ps, sizeof(_c_inj_ps), ImGuiInputTextFlags_EnterReturnsTrue))
-			{
-				try {
-					_inj_ps = std::stoull(_c_inj_ps, nullptr, 16);
-				}
-				catch (...) {
-					_inj_ps = -1;
+					ImGui::Dummy(ImVec2(width, (max_depth + 1) * row_height));
 				}
-				save_config();
-			}
 
-			if (ImGui::InputText("Injection VS", _c_inj_vs, sizeof(_c_inj_ps), ImGuiInputTextFlags_EnterReturnsTrue))
-			{
-				try {
-					_inj_vs = std::stoull(_c_inj_vs, nullptr, 16);
-				}
-				catch (...) {
-					_inj_vs = -1;
+				ImGui::BeginGroup();
+
+				for (const auto &thread : _profiler_frame)
+				{
+					for (const auto &event : thread.events)
+					{
+						ImGui::Text("%*s%s", event.depth * 2, "", event.name);
+					}
 				}
-				save_config();
-			}
 
-			if (ImGui::Combo("Allow Gw2 bloom", &_no_bloom, "Yes\0No\0")) {
-				save_config();
-			}
+				ImGui::EndGroup();
+				ImGui::SameLine(ImGui::GetWindowWidth() * 0.666f);
+				ImGui::BeginGroup();
 
-			ImGui::Spacing();
+				for (const auto &thread : _profiler_frame)
+				{
+					for (const auto &event : thread.events)
+					{
+						ImGui::Text("%f ms", (event.end - event.begin) * 1e-6f);
+					}
+				}
 
+				ImGui::EndGroup();
+			}
 		}
 
-		if (ImGui::CollapsingHeader("Auto preset selection", ImGuiTreeNodeFlags_DefaultOpen))
+		if (ImGui::CollapsingHeader("Memory"))
 		{
+			// Textures and techniques come and go with performance mode and texture aliasing, so keep the estimates current while they are shown
+			update_memory_usage();
 
-			ImGui::Text("Usage of auto preset selection :\n");
-			ImGui::Spacing(); ImGui::Spacing(); ImGui::Spacing();
-			ImGui::Text("The Zone field in first tab is used to limit a preset to a specific zone.");
-			ImGui::Text("It will then be loaded automatically when switching map.");
-			ImGui::Spacing(); ImGui::Spacing();
-			ImGui::Text("This field can be :");
-			ImGui::Text("\t\tA map ID (\"15\", \"899\", etc...)");
-			ImGui::Text("\t\tA list of map ID (\"15-24-899\")");
-			ImGui::Text("\t\tA region (\"Ascalon\", \"World vs. World\", etc...)");
-			ImGui::Text("\t\t\"global\" (used as fallback)");
-			ImGui::Text("You should have a global preset to handle unspecified maps.");
-			ImGui::Spacing(); ImGui::Spacing();
-			ImGui::Text("Informations about this map :");
-			ImGui::Text("\t\tMap ID : %d", _map_id);
-			ImGui::Text("\t\tRegion : %s", map_region.c_str());
+			effect_memory_usage total = { "Total" };
 
-			ImGui::Spacing();
-		}
+			for (const auto &usage : _effect_memory_usage)
+			{
+				total.texture_size += usage.texture_size;
+				total.technique_size += usage.technique_size;
+				total.uniform_size += usage.uniform_size;
+				total.cpu_size += usage.cpu_size;
+				total.compiler_size += usage.compiler_size;
+			}
 
-	}
-	void runtime::draw_overlay_menu_statistics()
-	{
-		if (ImGui::CollapsingHeader("General", ImGuiTreeNodeFlags_DefaultOpen))
-		{
-			ImGui::PushItemWidth(-1);
-			ImGui::PlotLines("##framerate",
-				_imgui_context->FramerateSecPerFrame, 120,
-				_imgui_context->FramerateSecPerFrameIdx,
-				nullptr,
-				_imgui_context->FramerateSecPerFrameAccum / 120 * 0.5f,
-				_imgui_context->FramerateSecPerFrameAccum / 120 * 1.5f,
-				ImVec2(0, 50));
-			ImGui::PopItemWidth();
+			const char *const column_names[] = { "Textures", "Shaders", "Uniforms", "System", "Compiler" };
+			const float column_width = ImGui::GetWindowWidth() * 0.13f;
 
-			uint64_t post_processing_time_cpu = 0;
-			uint64_t post_processing_time_gpu = 0;
+			ImGui::BeginGroup();
+			ImGui::TextUnformatted("KiB");
 
-			for (const auto &technique : _techniques)
+			for (const auto &usage : _effect_memory_usage)
 			{
-				post_processing_time_cpu += technique.average_cpu_duration;
-				post_processing_time_gpu += technique.average_gpu_duration;
+				ImGui::TextUnformatted(usage.effect_filename.c_str());
 			}
 
-			ImGui::BeginGroup();
-			ImGui::TextUnformatted("Application:");
-			ImGui::TextUnformatted("Date:");
-			ImGui::TextUnformatted("Device:");
-			ImGui::TextUnformatted("FPS:");
-			ImGui::TextUnformatted("Post-Processing:");
-			ImGui::TextUnformatted("Draw Calls:");
-			ImGui::Text("Frame %llu:", _framecount + 1);
-			ImGui::TextUnformatted("Timer:");
+			ImGui::TextUnformatted(total.effect_filename.c_str());
 			ImGui::EndGroup();
 
-			ImGui::SameLine(ImGui::GetWindowWidth() * 0.333f);
+			for (size_t column = 0; column < _countof(column_names); column++)
+			{
+				ImGui::SameLine(ImGui::GetWindowWidth() * 0.333f + column * column_width);
+				ImGui::BeginGroup();
+				ImGui::TextUnformatted(column_names[column]);
 
-			ImGui::BeginGroup();
-			ImGui::Text("%X", std::hash<std::string>()(s_target_executable_path.filename_without_extension().string()));
-			ImGui::Text("%d-%d-%d %d", _date[0], _date[1], _date[2], _date[3]);
-			ImGui::Text("%X %d", _vendor_id, _device_id);
-			ImGui::Text("%.2f", _imgui_context->IO.Framerate);
-			ImGui::Text("%f ms (CPU)", (post_processing_time_cpu * 1e-6f));
-			ImGui::Text("%u (%u vertices)", _drawcalls, _vertices);
-			ImGui::Text("%f ms", _last_frame_duration.count() * 1e-6f);
-			ImGui::Text("%f ms", std::fmod(std::chrono::duration_cast<std::chrono::nanoseconds>(_last_present_time - _start_time).count() * 1e-6f, 16777216.0f));
-			ImGui::EndGroup();
+				// The row after the last effect is the total
+				for (size_t i = 0; i <= _effect_memory_usage.size(); i++)
+				{
+					const effect_memory_usage &row = i < _effect_memory_usage.size() ? _effect_memory_usage[i] : total;
+					const size_t values[] = { row.texture_size, row.technique_size, row.uniform_size, row.cpu_size, row.compiler_size };
 
-			ImGui::SameLine(ImGui::GetWindowWidth() * 0.666f);
+					ImGui::Text("%.1f", values[column] / 1024.0f);
+				}
 
-			ImGui::BeginGroup();
-			ImGui::NewLine();
-			ImGui::NewLine();
-			ImGui::NewLine();
-			ImGui::NewLine();
+				ImGui::EndGroup();
+			}
 
-			if (post_processing_time_gpu != 0)
+			if (ImGui::IsItemHovered())
 			{
-				ImGui::Text("%f ms (GPU)", (post_processing_time_gpu * 1e-6f));
+				ImGui::SetTooltip("Estimates without driver padding. Textures shared between effects count for the effect that declared them first.\nCompiler is the syntax trees kept so reloading an unchanged effect skips parsing it.");
 			}
-
-			ImGui::EndGroup();
 		}
 
 		if (ImGui::CollapsingHeader("Textures", ImGuiTreeNodeFlags_DefaultOpen))
@@ -1969,6 +4539,33 @@ namespace reshade
 
 		if (ImGui::CollapsingHeader("Techniques", ImGuiTreeNodeFlags_DefaultOpen))
 		{
+			if (ImGui::Checkbox("Time every pass on the GPU", &_gpu_pass_timing))
+			{
+				// Drop the breakdown right away, instead of showing values that are no longer updated
+				if (!_gpu_pass_timing)
+				{
+					for (auto &technique : _techniques)
+					{
+						if (technique.timings != nullptr)
+						{
+							technique.timings->passes.clear();
+						}
+					}
+				}
+
+				save_config();
+			}
+
+			if (ImGui::IsItemHovered())
+			{
+				ImGui::SetTooltip("Shows how long each pass of a technique takes, which adds a timestamp query per pass and renders Direct3D 11 techniques without their recorded command lists.");
+			}
+
+			// Passes are listed below the technique they belong to, with a blank line in the columns that have no value for them
+			const auto has_pass_timings = [this](const technique &technique) {
+				return _gpu_pass_timing && technique.enabled && technique.timings != nullptr;
+			};
+
 			ImGui::BeginGroup();
 
 			for (const auto &technique : _techniques)
@@ -1995,6 +4592,14 @@ namespace reshade
 						ImGui::TextDisabled("%s", technique.name.c_str());
 					}
 				}
+
+				if (has_pass_timings(technique))
+				{
+					for (const auto &pass : technique.timings->passes)
+					{
+						ImGui::Text("  %s", pass.name.c_str());
+					}
+				}
 			}
 
 			ImGui::EndGroup();
@@ -2003,14 +4608,22 @@ namespace reshade
 
 			for (const auto &technique : _techniques)
 			{
-				if (technique.enabled)
+				if (technique.enabled && technique.timings != nullptr)
 				{
-					ImGui::Text("%f ms (CPU)", (technique.average_cpu_duration * 1e-6f));
+					ImGui::Text("%f ms (CPU)", (technique.timings->average_cpu_duration * 1e-6f));
 				}
 				else
 				{
 					ImGui::NewLine();
 				}
+
+				if (has_pass_timings(technique))
+				{
+					for (size_t i = 0; i < technique.timings->passes.size(); i++)
+					{
+						ImGui::NewLine();
+					}
+				}
 			}
 
 			ImGui::EndGroup();
@@ -2019,37 +4632,139 @@ namespace reshade
 
 			for (const auto &technique : _techniques)
 			{
-				if (technique.enabled && technique.average_gpu_duration != 0)
+				if (technique.enabled && technique.timings != nullptr && technique.timings->average_gpu_duration != 0)
 				{
-					ImGui::Text("%f ms (GPU)", (technique.average_gpu_duration * 1e-6f));
+					ImGui::Text("%f ms (GPU)", (technique.timings->average_gpu_duration * 1e-6f));
 				}
 				else
 				{
 					ImGui::NewLine();
 				}
+
+				if (has_pass_timings(technique))
+				{
+					for (const auto &pass : technique.timings->passes)
+					{
+						ImGui::Text("%f ms (GPU)", (pass.average_gpu_duration * 1e-6f));
+					}
+				}
 			}
 
 			ImGui::EndGroup();
 		}
+
+		if (ImGui::CollapsingHeader("Replay Benchmark"))
+		{
+			ImGui::TextWrapped("Renders the enabled techniques on the frame last saved with the replay capture key, so presets can be compared on identical input and without the game drawing in between.");
+
+			int iterations = static_cast<int>(_replay_benchmark_iterations);
+
+			if (ImGui::SliderInt("Iterations", &iterations, 1, 1000))
+			{
+				_replay_benchmark_iterations = static_cast<unsigned int>(iterations);
+
+				save_config();
+			}
+
+			// Only the Direct3D 9 runtime implements the replay so far
+			if (!_is_d3d9)
+			{
+				ImGui::TextDisabled("Not supported by this renderer.");
+			}
+			else if (ImGui::Button("Run Benchmark", ImVec2(ImGui::CalcItemWidth(), 0)))
+			{
+				_replay_benchmark_requested = true;
+			}
+
+			if (!_replay_benchmark_report.empty())
+			{
+				ImGui::TextUnformatted(_replay_benchmark_report.c_str(), _replay_benchmark_report.c_str() + _replay_benchmark_report.size());
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Technique Cost Profile"))
+		{
+			ImGui::TextWrapped("Measures what each enabled technique adds to the frame time, by comparing the frames with it to those without it. Unlike the timings above, this includes what techniques cost each other through shared caches and bandwidth. Keep the camera still and the frame rate unlimited while it runs.");
+
+			int frames = static_cast<int>(_cost_profile_frames);
+
+			if (ImGui::SliderInt("Frames", &frames, 30, 1000))
+			{
+				_cost_profile_frames = static_cast<unsigned int>(frames);
+
+				save_config();
+			}
+
+			if (_cost_profile_running)
+			{
+				ImGui::Text("Measuring '%s' %s (%u of %u) ...", _cost_profile_techniques[_cost_profile_index].c_str(), _cost_profile_is_excluding ? "off" : "on",
+					static_cast<unsigned int>(_cost_profile_index + 1), static_cast<unsigned int>(_cost_profile_techniques.size()));
+
+				if (_camera_static_frames == 0)
+				{
+					ImGui::TextDisabled("Waiting for the camera to stand still ...");
+				}
+
+				if (ImGui::Button("Cancel", ImVec2(ImGui::CalcItemWidth(), 0)))
+				{
+					stop_cost_profile("it was canceled");
+				}
+			}
+			else if (ImGui::Button("Run Profile", ImVec2(ImGui::CalcItemWidth(), 0)))
+			{
+				start_cost_profile();
+			}
+
+			if (!_cost_profile_report.empty())
+			{
+				ImGui::TextUnformatted(_cost_profile_report.c_str(), _cost_profile_report.c_str() + _cost_profile_report.size());
+			}
+		}
 	}
 	void runtime::draw_overlay_menu_log()
 	{
 		if (ImGui::Button("Clear Log"))
 		{
-			reshade::log::lines.clear();
+			reshade::log::clear_history();
 		}
 
 		ImGui::SameLine();
 		ImGui::Checkbox("Word Wrap", &_log_wordwrap);
 		ImGui::SameLine();
 
+		ImGui::PushItemWidth(100);
+
+		// Levels start at one for errors, so the index of the combo box is one less
+		if (int level_index = _log_level - 1; ImGui::Combo("Level", &level_index, "Error\0Warning\0Info\0Debug\0"))
+		{
+			_log_level = level_index + 1;
+			reshade::log::set_max_level(static_cast<reshade::log::level>(_log_level));
+
+			save_config();
+		}
+
+		ImGui::PopItemWidth();
+		ImGui::SameLine();
+
 		static ImGuiTextFilter filter; // TODO: Better make this a member of the runtime class, in case there are multiple instances.
-		filter.Draw("Filter (inc, -exc)", -150);
+		if (filter.Draw("Filter (inc, -exc)", -150))
+		{
+			_log_lines_dirty = true;
+		}
+
+		if (const size_t revision = reshade::log::history_revision(); _log_lines_dirty || revision != _log_lines_revision)
+		{
+			_log_lines.clear();
+			_log_lines_revision = revision;
+			_log_lines_dirty = false;
+
+			reshade::log::visit_history([this](const std::string &line) {
+				if (filter.PassFilter(line.c_str()))
+					_log_lines.push_back(line);
+			});
+		}
 
-		std::vector<std::string> lines;
-		for (auto &line : reshade::log::lines)
-			if (filter.PassFilter(line.c_str()))
-				lines.push_back(line);
+		const std::vector<std::string> &lines = _log_lines;
 
 		ImGui::BeginChild("log");
 
@@ -2187,10 +4902,10 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 			}
 
 			bool modified = false;
-			const auto ui_type = variable.annotations["ui_type"].as<std::string>();
-			const auto ui_label = variable.annotations.count("ui_label") ? variable.annotations.at("ui_label").as<std::string>() : variable.name;
-			const auto ui_tooltip = variable.annotations["ui_tooltip"].as<std::string>();
-			const auto ui_category = variable.annotations["ui_category"].as<std::string>();
+			const std::string &ui_type = variable.ui_type;
+			const std::string &ui_label = variable.ui_label;
+			const std::string &ui_tooltip = variable.ui_tooltip;
+			const std::string &ui_category = variable.ui_category;
 
 			if (current_category != ui_category)
 			{
@@ -2215,6 +4930,19 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 				continue;
 			}
 
+			// Rows scrolled out of view are replaced by empty space of the height they took when they were last built, since rows without a widget take none and widgets differ from labels
+			const float row_height = variable.ui_row_height >= 0.0f ? variable.ui_row_height : ImGui::GetFrameHeightWithSpacing();
+
+			if (!ImGui::IsRectVisible(ImVec2(ImGui::CalcItemWidth(), std::max(row_height, 1.0f))))
+			{
+				// Dummies add the item spacing themselves
+				if (row_height > 0.0f)
+					ImGui::Dummy(ImVec2(0.0f, row_height - ImGui::GetStyle().ItemSpacing.y));
+				continue;
+			}
+
+			const float row_begin = ImGui::GetCursorPosY();
+
 			ImGui::PushID(id);
 
 			switch (variable.displaytype)
@@ -2248,13 +4976,7 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 					}
 					else if (ui_type == "combo")
 					{
-						std::string items = variable.annotations["ui_items"].as<std::string>();
-
-						// Make sure list is terminated with a zero in case user forgot so no invalid memory is read accidentally
-						if (!items.empty() && items.back() != '\0')
-							items.push_back('\0');
-
-						modified = ImGui::Combo(ui_label.c_str(), data, items.c_str());
+						modified = ImGui::Combo(ui_label.c_str(), data, variable.ui_items.c_str());
 					}
 					else
 					{
@@ -2308,6 +5030,8 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 
 			ImGui::PopID();
 
+			variable.ui_row_height = ImGui::GetCursorPosY() - row_begin;
+
 			if (modified)
 			{
 				save_current_preset();
@@ -2361,14 +5085,24 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 
 		_toggle_key_setting_active = false;
 
-		for (int id = 0, i = 0; id < static_cast<int>(_technique_count); id++, i++)
-		{
-			auto &technique = _techniques[id];
+		// Only build the rows that are scrolled into view, which all have the same height
+		std::vector<int> visible_techniques;
+		visible_techniques.reserve(_technique_count);
 
-			if (technique.hidden)
+		for (int id = 0; id < static_cast<int>(_technique_count); id++)
+		{
+			if (!_techniques[id].hidden)
 			{
-				continue;
+				visible_techniques.push_back(id);
 			}
+		}
+
+		ImGuiListClipper clipper(static_cast<int>(visible_techniques.size()), ImGui::GetFrameHeightWithSpacing());
+
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+		{
+			const int id = visible_techniques[i];
+			auto &technique = _techniques[id];
 
 			ImGui::PushID(id);
 
@@ -2376,6 +5110,8 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 
 			if (ImGui::Checkbox(label.c_str(), &technique.enabled))
 			{
+				clear_technique_suspension(technique.name);
+
 				save_current_preset();
 			}
 
@@ -2440,6 +5176,8 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 			ImGui::PopID();
 		}
 
+		clipper.End();
+
 		if (!current_tree_is_closed)
 		{
 			ImGui::TreePop();
@@ -2454,6 +5192,8 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 				std::swap(_techniques[hovered_technique_index], _techniques[_selected_technique]);
 				_selected_technique = hovered_technique_index;
 
+				on_techniques_reordered();
+
 				save_current_preset();
 			}
 		}
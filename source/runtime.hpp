@@ -5,10 +5,22 @@
 
 #pragma once
 
+#include <list>
+#include <deque>
+#include <mutex>
+#include <atomic>
 #include <chrono>
+#include <thread>
 #include <functional>
+#include <unordered_set>
+#include <condition_variable>
 #include "filesystem.hpp"
+#include "directory_index.hpp"
+#include "directory_watcher.hpp"
 #include "ini_file.hpp"
+#include "profiler.hpp"
+#include "frame_recorder.hpp"
+#include "telemetry.hpp"
 #include "runtime_objects.hpp"
 
 #pragma region Forward Declarations
@@ -23,6 +35,7 @@ namespace reshade
 namespace reshadefx
 {
 	class syntax_tree;
+	class include_cache;
 }
 
 #pragma endregion
@@ -62,6 +75,20 @@ namespace reshade
 		/// </summary>
 		/// <param name="buffer">The buffer to save the copy to. It has to be the size of at least "frame_width() * frame_height() * 4".</param>
 		virtual void capture_frame(uint8_t *buffer) const = 0;
+		/// <summary>
+		/// Copy the current frame into a readback slot, so it can be read back a few frames later without stalling the pipeline.
+		/// </summary>
+		/// <param name="slot">The readback slot to copy to, less than "MAX_PENDING_SCREENSHOTS".</param>
+		/// <returns>Returns false if deferred readback is not supported, in which case <see cref="capture_frame"/> is used instead.</returns>
+		virtual bool begin_frame_capture(unsigned int) { return false; }
+		/// <summary>
+		/// Read back a frame previously copied with <see cref="begin_frame_capture"/>.
+		/// </summary>
+		/// <param name="slot">The readback slot to read from.</param>
+		/// <param name="buffer">The buffer to save the copy to. It has to be the size of at least "frame_width() * frame_height() * 4".</param>
+		/// <param name="wait">Set to true to block until the copy finished instead of failing.</param>
+		/// <returns>Returns false if the copy did not finish yet or could not be read back.</returns>
+		virtual bool finish_frame_capture(unsigned int, uint8_t *, bool) { return false; }
 
 		/// <summary>
 		/// Returns the initialization status.
@@ -92,6 +119,24 @@ namespace reshade
 		/// </summary>
 		/// <param name="unique_name">The name of the texture.</param>
 		texture *find_texture(const std::string &unique_name);
+		/// <summary>
+		/// Find the uniform with the specified name in an effect file.
+		/// </summary>
+		/// <param name="effect_filename">The file name of the effect that declares the uniform.</param>
+		/// <param name="name">The name of the uniform.</param>
+		uniform *find_uniform(const std::string &effect_filename, const std::string &name);
+		/// <summary>
+		/// Find the technique with the specified name.
+		/// </summary>
+		/// <param name="name">The name of the technique.</param>
+		technique *find_technique(const std::string &name);
+		const technique *find_technique(const std::string &name) const;
+		/// <summary>
+		/// Check whether a technique may be loaded without compiling its passes, because performance mode is loading a preset that neither enables it nor binds a toggle key to it.
+		/// </summary>
+		/// <param name="name">The name of the technique.</param>
+		/// <param name="annotations">The annotations of the technique.</param>
+		bool is_technique_deferrable(const std::string &name, const std::unordered_map<std::string, variant> &annotations) const;
 
 		/// <summary>
 		/// Return a reference to the internal uniform storage buffer.
@@ -119,17 +164,63 @@ namespace reshade
 		void set_uniform_value(uniform &variable, const int *values, size_t count);
 		void set_uniform_value(uniform &variable, const unsigned int *values, size_t count);
 		void set_uniform_value(uniform &variable, const float *values, size_t count);
+		/// <summary>
+		/// Check whether any uniform in a range of the storage changed since the last check of that range, and mark the range as uploaded.
+		/// </summary>
+		/// <param name="offset">The offset of the range in the storage, in bytes.</param>
+		/// <param name="size">The size of the range, in bytes.</param>
+		/// <param name="dirty_offset">Receives the offset of the first changed byte in the storage, rounded down to a register boundary.</param>
+		/// <param name="dirty_size">Receives the size of the changed part of the range, rounded up to a register boundary.</param>
+		bool consume_uniform_changes(size_t offset, size_t size, size_t &dirty_offset, size_t &dirty_size);
 
 		void load_preset(const filesystem::path &path);
+		/// <summary>
+		/// Check whether a preset can be applied to the loaded effects with <see cref="load_preset"/> alone, because it uses no effects or techniques that are not loaded and matches all uniform values compiled into the shaders in performance mode.
+		/// </summary>
+		/// <param name="path">The preset file to check.</param>
+		bool is_preset_compatible(const filesystem::path &path) const;
 		void reload();
+		/// <summary>
+		/// Wait for the overlay worker thread to finish building the ImGui frame it was given during <see cref="on_present"/>.
+		/// Back-ends call this right after the present call of the driver returned, which is as long as the worker may run, since the game may change state the menus read as soon as it continues.
+		/// </summary>
+		void wait_for_overlay();
 
 		std::vector<filesystem::path> _preset_files;
+		/// <summary>
+		/// Incremented whenever the preset list or the zone of a preset changes, so cached per-zone lookups know when to rebuild.
+		/// </summary>
+		mutable unsigned int _preset_files_generation = 0;
 		bool _performance_mode = false;
+		/// <summary>
+		/// Let the D3D11 back-end compute local variables of pixel and compute shaders that tolerate it at 16-bit precision, techniques override this with a 'half_precision' annotation.
+		/// </summary>
+		bool _half_precision_shaders = false;
 		int _current_preset = -1;
 		float _fog_amount = 0;
 		int _no_bloom = 1;
 		int _skip_ui = 0;
+		int _skip_loading_screens = 0;
+		/// <summary>
+		/// Set by the map tracker while the game shows a loading screen, character select or the full-screen map, where effects are not applied.
+		/// </summary>
+		bool _skip_effects = false;
+		/// <summary>
+		/// Set by the map tracker to the number of game frames the camera has not moved for, zero while it moves or when the game does not report it.
+		/// </summary>
+		unsigned int _camera_static_frames = 0;
+		int _suspend_effects_in_background = 1;
+		int _background_fps = 0;
+		int _fuse_techniques = 1;
+		int _progressive_texture_loading = 0;
+		bool _is_in_background = false;
+		/// <summary>
+		/// Check whether effects are not applied this frame, because nothing worth post processing is on screen or the game is in the background.
+		/// </summary>
+		bool is_effect_suspended() const { return _skip_effects || (_is_in_background && _suspend_effects_in_background == 0); }
 		int _auto_preset = 1;
+		int _cache_shader_patches = 0;
+		int _discover_injection = 0;
 		int _map_id = -1;
 		std::string map_region;
 		variant preset_zone = (std::string)"global";
@@ -143,9 +234,10 @@ namespace reshade
 		/// </summary>
 		/// <param name="label">Name of the tab in the menu bar.</param>
 		/// <param name="function">The callback function.</param>
-		void subscribe_to_menu(std::string label, std::function<void()> function)
+		/// <param name="is_worker_safe">Set when the tab only reads and changes state of the runtime itself, so the overlay can be built on its worker thread while it is shown, see <see cref="wait_for_overlay"/>.</param>
+		void subscribe_to_menu(std::string label, std::function<void()> function, bool is_worker_safe = false)
 		{
-			_menu_callables.push_back({ label, function });
+			_menu_callables.push_back({ std::move(label), std::move(function), is_worker_safe });
 		}
 		/// <summary>
 		/// Register a function to be called when user configuration is loaded.
@@ -171,6 +263,12 @@ namespace reshade
 		}
 
 	protected:
+		static constexpr unsigned int MAX_PENDING_SCREENSHOTS = 3;
+		static constexpr std::chrono::seconds TECHNIQUE_UNLOAD_DELAY = std::chrono::seconds(30);
+		static constexpr std::chrono::seconds FRAME_BUDGET_SETTLE_TIME = std::chrono::seconds(2);
+		// Frames the GPU may still be working on when the cost profile changes which techniques render, which are not measured
+		static constexpr unsigned int COST_PROFILE_WARMUP_FRAMES = 10;
+
 		/// <summary>
 		/// Callback function called when the runtime is initialized.
 		/// </summary>
@@ -192,30 +290,112 @@ namespace reshade
 		/// Callback function called to apply the post-processing effects to the screen.
 		/// </summary>
 		void on_present_effect();
+		/// <summary>
+		/// Update the values of all uniform variables that have a source annotation.
+		/// </summary>
+		void update_uniform_variables();
 
 		/// <summary>
-		/// Compile effect from the specified source file and initialize textures, constants and techniques.
+		/// Start (or restart) the background compilation of the specified effect files.
 		/// </summary>
-		/// <param name="path">The path to an effect source code file.</param>
-		void load_effect(const filesystem::path &path);
+		/// <param name="effect_files">The effect files to compile, in the order they are loaded.</param>
+		void start_effect_compilation(const std::vector<filesystem::path> &effect_files);
 		/// <summary>
-		/// Compile effect from the specified abstract syntax tree and initialize textures, constants and techniques.
+		/// Cancel any pending background compilation and wait for all worker threads to exit.
 		/// </summary>
-		/// <param name="ast">The abstract syntax tree of the effect to compile.</param>
-		/// <param name="pragmas">A list of additional commands to the compiler.</param>
-		/// <param name="errors">A reference to a buffer to store errors which occur during compilation.</param>
-		virtual bool load_effect(const reshadefx::syntax_tree &ast, std::string &errors) = 0;
+		void stop_effect_compilation();
+		/// <summary>
+		/// Generate the shader code of an effect from the specified abstract syntax tree and compile it. This runs on the compile worker threads, so it must not create any device objects or touch runtime state other than what stays the same until the compilation was stopped.
+		/// </summary>
+		/// <param name="ast">The abstract syntax tree of the effect to compile, which has to outlive the returned object.</param>
+		/// <param name="errors">A reference to a buffer to store errors which occur during compilation, which has to outlive the returned object.</param>
+		/// <param name="half_precision">Whether half precision shaders were enabled when the compilation started.</param>
+		/// <returns>The compiled effect, which is passed to <see cref="load_effect"/> on the render thread afterwards.</returns>
+		virtual std::unique_ptr<base_object> compile_effect(const reshadefx::syntax_tree &ast, std::string &errors, bool half_precision) = 0;
+		/// <summary>
+		/// Initialize textures, constants and techniques of an effect that <see cref="compile_effect"/> compiled.
+		/// </summary>
+		/// <param name="module">The compiled effect.</param>
+		virtual bool load_effect(base_object &module) = 0;
 
 		/// <summary>
-		/// Loads image files and updates all textures with image data.
+		/// Start decoding the image files of all textures on background threads. Textures are updated with the image data as it becomes available.
+		/// </summary>
+		/// <param name="first_texture">The index of the first texture to load, so textures that kept their contents are skipped.</param>
+		void load_textures(size_t first_texture = 0);
+		/// <summary>
+		/// Cancel any pending background texture loading and wait for all worker threads to exit.
 		/// </summary>
-		void load_textures();
+		void stop_texture_loading();
 		/// <summary>
 		/// Update the image data of a texture.
 		/// </summary>
 		/// <param name="texture">The texture to update.</param>
 		/// <param name="data">The 32bpp RGBA image data to update the texture to.</param>
 		virtual bool update_texture(texture &texture, const uint8_t *data) = 0;
+		/// <summary>
+		/// Update the image data of a block-compressed texture with data that is already compressed in the texture format.
+		/// </summary>
+		/// <param name="texture">The texture to update.</param>
+		/// <param name="data">The block data of all mipmap levels, packed one after another starting with the largest.</param>
+		/// <param name="levels">The number of mipmap levels in the data.</param>
+		virtual bool update_texture_compressed(texture &, const uint8_t *, unsigned int) { return false; }
+		/// <summary>
+		/// Check whether <see cref="update_texture_scaled"/> is supported for a texture.
+		/// </summary>
+		/// <param name="texture">The texture to check.</param>
+		virtual bool supports_texture_scaling(const texture &) const { return false; }
+		/// <summary>
+		/// Update the image data of a texture from an image of a different size, which is scaled to the size of the texture and has its mipmaps generated on the GPU.
+		/// </summary>
+		/// <param name="texture">The texture to update.</param>
+		/// <param name="data">The 32bpp RGBA image data to update the texture to.</param>
+		/// <param name="width">The width of the image data in pixels.</param>
+		/// <param name="height">The height of the image data in pixels.</param>
+		virtual bool update_texture_scaled(texture &, const uint8_t *, unsigned int, unsigned int) { return false; }
+		/// <summary>
+		/// Make a texture use the GPU resource of another one that was loaded from the same image file, instead of uploading the image a second time.
+		/// </summary>
+		/// <param name="texture">The texture to update.</param>
+		/// <param name="source">The texture that was already updated with the image data.</param>
+		/// <returns>Returns false if the back-end cannot share the texture, in which case it is updated with the image data separately.</returns>
+		virtual bool share_texture(texture &, const texture &) { return false; }
+		/// <summary>
+		/// Release the device resources of all loaded effects that do not survive a device reset, while keeping their compiled shaders and uniforms.
+		/// </summary>
+		/// <returns>Returns false if the back-end cannot restore effects afterwards, in which case they are destroyed and reloaded instead.</returns>
+		virtual bool release_effect_resources() { return false; }
+		/// <summary>
+		/// Recreate the device resources released by <see cref="release_effect_resources"/>, after the runtime was initialized again.
+		/// </summary>
+		virtual bool restore_effect_resources() { return false; }
+		/// <summary>
+		/// Compile the passes and create the render targets of a technique that was loaded without them, right before it is rendered.
+		/// </summary>
+		/// <param name="technique">The technique to load.</param>
+		/// <returns>Returns false if the technique cannot be rendered.</returns>
+		virtual bool load_technique(technique &) { return true; }
+		/// <summary>
+		/// Release the passes and render targets of a technique that stayed disabled for a while, so they are created again the next time it is enabled.
+		/// </summary>
+		/// <param name="technique">The technique to unload.</param>
+		virtual void unload_technique(technique &) { }
+		/// <summary>
+		/// Estimate the GPU memory allocated for a texture in bytes. Back-ends that share allocations between textures report each allocation only once.
+		/// </summary>
+		/// <param name="texture">The texture to estimate the memory of.</param>
+		virtual size_t texture_memory_usage(const texture &texture) const { return texture_memory_size(texture.width, texture.height, texture.levels, texture.format); }
+		/// <summary>
+		/// Estimate the memory the back-end objects of the passes of a technique take in bytes, like compiled shaders and the sources kept to compile them again.
+		/// </summary>
+		/// <param name="technique">The technique to estimate the memory of.</param>
+		/// <param name="gpu_size">Set to the size of the objects the driver holds.</param>
+		/// <param name="cpu_size">Set to the size of what the back-end keeps in system memory.</param>
+		virtual void technique_memory_usage(const technique &, size_t &gpu_size, size_t &cpu_size) const { gpu_size = cpu_size = 0; }
+		/// <summary>
+		/// Called after the order techniques are rendered in changed, so back-ends that plan resources around that order can update them.
+		/// </summary>
+		virtual void on_techniques_reordered() { }
 
 		/// <summary>
 		/// Load user configuration from disk.
@@ -232,31 +412,295 @@ namespace reshade
 		/// <param name="technique">The technique to render.</param>
 		virtual void render_technique(const technique &technique) = 0;
 		/// <summary>
+		/// Render techniques that follow each other this frame in a single pass, if the back-end is able to fuse their shaders.
+		/// </summary>
+		/// <param name="techniques">The techniques that are rendered next this frame, in order.</param>
+		/// <param name="count">The number of techniques in the list.</param>
+		/// <returns>The number of techniques from the start of the list that were rendered, or zero if the first one has to be rendered on its own.</returns>
+		virtual size_t render_fused_techniques(const technique *const *, size_t) { return 0; }
+		/// <summary>
+		/// Add the time a pass took on the GPU to the per-pass breakdown of a technique in the statistics, back-ends only measure this while <see cref="_gpu_pass_timing"/> is set.
+		/// </summary>
+		/// <param name="technique">The technique the pass belongs to.</param>
+		/// <param name="pass_index">The index of the pass in the technique.</param>
+		/// <param name="pass_name">The name of the pass, which may be empty.</param>
+		/// <param name="duration">The time from the end of the previous pass (or the start of the technique) to the end of this pass, in nanoseconds.</param>
+		void append_pass_gpu_duration(technique &technique, size_t pass_index, const std::string &pass_name, uint64_t duration);
+		/// <summary>
 		/// Render command lists obtained from ImGui.
 		/// </summary>
 		/// <param name="data">The draw data to render.</param>
 		virtual void render_imgui_draw_data(ImDrawData *draw_data) = 0;
 
+		/// <summary>
+		/// Return the preprocessor definitions effects are compiled with, as "NAME=VALUE" strings.
+		/// </summary>
+		const std::vector<std::string> &preprocessor_definitions() const { return _preprocessor_definitions; }
+		/// <summary>
+		/// Return the path of the file the replay benchmark stores the captured frame in.
+		/// </summary>
+		filesystem::path replay_frame_path() const { return _screenshot_path / "ReplayFrame.bin"; }
+
 		unsigned int _width = 0, _height = 0;
 		unsigned int _vendor_id = 0, _device_id = 0;
 		uint64_t _framecount = 0;
 		unsigned int _drawcalls = 0, _vertices = 0;
+		// Counts of the previous frame for the statistics, since the counters above start over at the end of every present
+		unsigned int _last_drawcalls = 0, _last_vertices = 0;
 		std::shared_ptr<input> _input;
 		ImGuiContext *_imgui_context = nullptr;
 		std::unique_ptr<base_object> _imgui_font_atlas_texture;
 		std::vector<texture> _textures;
 		std::vector<uniform> _uniforms;
 		std::vector<technique> _techniques;
+		// Techniques rendered this frame, in order, kept around so collecting them does not allocate every frame
+		std::vector<technique *> _rendered_techniques;
+		// Set when the frame should be captured for the replay benchmark or the benchmark should run on it, back-ends that support it clear them once done
+		bool _replay_capture_requested = false, _replay_benchmark_requested = false;
+		unsigned int _replay_benchmark_iterations = 100;
+		// Per-technique and per-pass results of the last replay benchmark, shown in the statistics
+		std::string _replay_benchmark_report;
+		// The cost profile measures what each enabled technique adds to the frame time, by alternately rendering it and leaving it out while the camera stands still
+		bool _cost_profile_running = false;
+		unsigned int _cost_profile_frames = 120;
+		std::vector<std::string> _cost_profile_techniques;
+		size_t _cost_profile_index = 0;
+		// Set while the technique that is measured is left out of rendering during the second half of its measurement, without changing whether it is enabled
+		// It is found by name, since reloading and reordering techniques moves them around in memory
+		bool _cost_profile_is_excluding = false;
+		unsigned int _cost_profile_warmup = 0;
+		float _cost_profile_frame_time_on = 0.0f;
+		std::vector<float> _cost_profile_samples;
+		std::vector<technique_cost> _cost_profile_results;
+		// Ranked results of the last cost profile, shown in the statistics
+		std::string _cost_profile_report;
+		// Set when back-ends should time every pass on the GPU as well, which costs a timestamp query per pass, so it is off by default
+		bool _gpu_pass_timing = false;
+		// Set when back-ends should label techniques and passes for GPU debuggers like PIX, RenderDoc and Nsight, builds with RESHADE_GPU_MARKERS turn this on by default
+#if RESHADE_GPU_MARKERS
+		bool _gpu_markers = true;
+#else
+		bool _gpu_markers = false;
+#endif
+		// Number of frames the CPU may queue up ahead of the GPU, zero keeps what the driver and game chose, back-ends apply it when they are initialized
+		unsigned int _max_frame_latency = 0;
+		// Direct3D 10 and 11 devices of feature level 9_3 report the same renderer ID as Direct3D 9, so the Direct3D 9 runtime sets this to tell itself apart
+		bool _is_d3d9 = false;
 
 	private:
+		enum class uniform_source
+		{
+			frametime,
+			framecount,
+			pingpong,
+			date,
+			timer,
+			key,
+			mousepoint,
+			mousedelta,
+			mousebutton,
+			random,
+			camerastatic
+		};
+		enum class uniform_key_mode
+		{
+			down,
+			press,
+			toggle
+		};
+		struct baked_uniform
+		{
+			std::string effect_filename, name;
+			// Preset value the uniform was replaced with, or empty if the preset had none and the initializer was kept
+			std::vector<std::string> preset_value;
+		};
+		struct effect_compile_job
+		{
+			filesystem::path path;
+			std::shared_ptr<const reshadefx::syntax_tree> ast;
+			std::string errors;
+			std::vector<baked_uniform> baked_uniforms;
+			std::vector<filesystem::path> included_files;
+			std::unordered_set<std::string> used_macros;
+			// Compiled by the back-end on the worker too, it references the syntax tree and the errors above, so it is declared after them to be destroyed first
+			std::unique_ptr<base_object> module;
+			std::atomic<bool> finished = false;
+		};
+		struct cached_effect_module
+		{
+			// Hash of the preprocessed tokens, so any change to the effect, its includes or the macros it uses is a miss
+			unsigned long long key;
+			std::string effect_filename;
+			// Bytes the syntax tree occupies, so the cache stays within its budget
+			size_t size;
+			std::shared_ptr<const reshadefx::syntax_tree> ast;
+			std::string errors;
+			std::vector<baked_uniform> baked_uniforms;
+		};
+		struct compiled_effect
+		{
+			filesystem::path path;
+			// Files the effect included, so it is compiled again when one of them is modified
+			std::vector<filesystem::path> included_files;
+			// Names of all macros the preprocessor looked up, so it is compiled again when the definition of one of them is changed
+			std::unordered_set<std::string> used_macros;
+			// Unique names of all textures the effect declares, including those another effect declared first
+			std::vector<std::string> texture_names;
+		};
+		struct effect_reload_state
+		{
+			// Names of all techniques in the order they were in before, so the recompiled ones take the place of the old ones
+			std::vector<std::string> technique_order;
+			// Objects of the recompiled effects, kept to restore their values and technique states
+			std::vector<uniform> uniforms;
+			std::vector<technique> techniques;
+			size_t first_texture = 0;
+		};
+		struct texture_load_job
+		{
+			// Textures that use the same image file at the same size and format share a job, the image is only decoded once for all of them
+			std::vector<size_t> texture_indices;
+			unsigned int width, height, levels;
+			texture_format format;
+			filesystem::path path;
+			std::vector<uint8_t> data;
+			// Size of the decoded image data, which is only different from the texture size if it is left to the back-end to scale it
+			unsigned int data_width = 0, data_height = 0;
+			// Set when the back-end can scale the image data to the texture size on the GPU, so the worker does not resize it
+			bool scale_on_gpu = false;
+			// Set when a low resolution version of the image from the texture preview cache is shown until the full image is decoded
+			bool is_progressive = false;
+			std::vector<uint8_t> preview;
+			unsigned int preview_width = 0, preview_height = 0;
+			bool preview_uploaded = false;
+			std::atomic<bool> preview_ready = false;
+			// Number of mipmap levels in the data if it was read as is from a block-compressed file, zero if it was decoded to 32bpp RGBA
+			unsigned int compressed_levels = 0;
+			bool success = false;
+			bool uploaded = false;
+			std::atomic<bool> finished = false;
+		};
+		struct effect_compile_settings
+		{
+			std::vector<filesystem::path> include_paths;
+			std::vector<std::pair<std::string, std::string>> macros;
+			filesystem::path preset_path;
+			// Included files read by any of the effects compiled in this reload
+			std::shared_ptr<reshadefx::include_cache> include_cache;
+			bool half_precision_shaders;
+		};
+		struct uniform_updater
+		{
+			size_t uniform_index;
+			uniform_source source;
+			uniform_key_mode key_mode;
+			int keycode;
+			int random_min, random_max;
+			float pingpong_min, pingpong_max, pingpong_step_min, pingpong_step_max, pingpong_smoothing;
+		};
+		struct screenshot_capture
+		{
+			unsigned int slot;
+			uint64_t framecount;
+			unsigned int width, height;
+			filesystem::path path;
+		};
+		struct technique_cost
+		{
+			std::string name;
+			// Median frame times in milliseconds with the technique rendered and with it left out
+			float frame_time_on, frame_time_off;
+		};
+		struct suspended_technique
+		{
+			std::string name;
+			// GPU time the technique took before it was disabled, so it is only restored once there is room for it again
+			uint64_t gpu_duration;
+		};
+		struct effect_memory_usage
+		{
+			std::string effect_filename;
+			// Estimated sizes in bytes: Textures and pass objects on the GPU, the uniform storage, everything else the effect keeps in system memory and the syntax trees kept to reload it faster
+			size_t texture_size = 0, technique_size = 0, uniform_size = 0, cpu_size = 0, compiler_size = 0;
+		};
+		struct screenshot_job
+		{
+			filesystem::path path;
+			unsigned int width, height;
+			int format;
+			std::vector<uint8_t> data;
+		};
+		struct preset_snapshot
+		{
+			struct technique_state
+			{
+				size_t position;
+				bool enabled;
+				bool has_toggle_key;
+				uint32_t toggle_key_data[4];
+			};
+
+			// Parsed contents of the preset file this was built from, kept alive so a new version of the file can never end up at the same address
+			std::shared_ptr<const void> contents;
+			unsigned int effects_generation;
+			std::string zone;
+			// Ranges of the uniform storage the preset has values for, their contents are stored one after another in 'uniform_data'
+			std::vector<std::pair<size_t, size_t>> uniform_ranges;
+			std::vector<unsigned char> uniform_data;
+			std::vector<std::string> optional_techniques;
+			std::unordered_map<std::string, technique_state> techniques;
+		};
+
+		/// <summary>
+		/// Query the latest released version. This blocks on the network for several seconds, so never call it on the render or window thread.
+		/// </summary>
+		/// <param name="latest_version">Set to the latest version, or zero if it could not be retrieved.</param>
+		/// <returns>Returns whether the latest version is newer than this one.</returns>
 		static bool check_for_update(unsigned long latest_version[3]);
 
 		void load_current_preset();
+		void mark_uniform_data_dirty(size_t offset, size_t size);
+		bool apply_preset_snapshot(const filesystem::path &path, const ini_file &preset);
+		void create_preset_snapshot(const filesystem::path &path, const ini_file &preset);
 		void save_preset(const filesystem::path &path) const;
 		void save_current_preset() const;
-		void save_screenshot() const;
+		void save_screenshot();
+		void update_screenshot_captures(bool flush);
+		void queue_screenshot(const filesystem::path &path, unsigned int width, unsigned int height, std::vector<uint8_t> &&data);
+		void screenshot_worker_loop();
+		static void write_screenshot(const screenshot_job &job);
+		void update_uniform_updaters();
+		void update_frame_budget();
+		void toggle_frame_recording();
+		void update_memory_usage();
+		void log_memory_usage() const;
+		void record_frame();
+		void publish_telemetry();
+		bool is_technique_suspended(const std::string &name) const;
+		void clear_technique_suspension(const std::string &name);
+		void start_cost_profile();
+		void stop_cost_profile(const char *reason);
+		void update_cost_profile();
+		void restart_cost_profile_phase();
+
+		void update_search_path_watchers();
+		void reload_modified_effects(const std::vector<filesystem::path> &modifications);
+		void reload_modified_macros(const std::unordered_set<std::string> &modifications);
+		void reload_effects(std::vector<filesystem::path> effect_files);
+		void finish_effect_reload();
+		void parse_effect(effect_compile_job &job) const;
+		void finish_effect(effect_compile_job &job);
+		void compile_worker_loop();
+
+		void decode_texture(texture_load_job &job) const;
+		void upload_loaded_textures();
+		bool upload_texture(texture &texture, const texture_load_job &job);
+		void texture_worker_loop();
 
 		void draw_overlay();
+		void build_overlay(bool show_splash, bool show_fps_window);
+		void render_overlay();
+		void overlay_worker_loop();
 		void draw_overlay_menu();
 		void draw_overlay_menu_home();
 		void draw_overlay_menu_gw2();
@@ -272,16 +716,116 @@ namespace reshade
 		const unsigned int _renderer_id;
 		bool _is_initialized = false;
 		std::vector<filesystem::path> _effect_files;
+		// Every effect file of the last reload and the files it depends on, whether it compiled or not
+		std::vector<compiled_effect> _compiled_effects;
+		// Watches the effect and texture search paths and the directories of the presets, which keeps the directory index up to date, triggers compiling modified effects again outside of performance mode and notices presets edited outside of the game
+		std::unique_ptr<filesystem::directory_watcher> _search_path_watcher;
+		// Modifications that arrived while effects were compiling, which are handled once that finished
+		std::vector<filesystem::path> _pending_effect_modifications;
+		// Names of preprocessor definitions that were added, removed or changed in the settings, which are handled the same way
+		std::unordered_set<std::string> _pending_macro_modifications;
+		// Modification time of the effect package whose shaders were last added to the shader cache
+		uint64_t _imported_effect_package_time = 0;
+		filesystem::directory_index _directory_index;
+		// Set while only some of the effects are compiled again after one of their files was modified
+		std::unique_ptr<effect_reload_state> _effect_reload_state;
+		effect_compile_settings _compile_settings;
+		std::vector<std::unique_ptr<effect_compile_job>> _compile_jobs;
+		std::vector<std::thread> _compile_workers;
+		std::atomic<size_t> _compile_next_job = 0;
+		std::atomic<bool> _compile_cancelled = false;
+		// Parsed effects of previous reloads, most recently used first, which the compile workers reuse when the preprocessed source did not change
+		mutable std::list<cached_effect_module> _effect_module_cache;
+		mutable std::mutex _effect_module_cache_mutex;
+		std::vector<std::unique_ptr<texture_load_job>> _texture_jobs;
+		std::vector<std::thread> _texture_workers;
+		std::atomic<size_t> _texture_next_job = 0;
+		std::atomic<bool> _texture_loading_cancelled = false;
+		size_t _texture_jobs_remaining = 0;
+		// Captures waiting for the GPU copy to finish, oldest first
+		std::vector<screenshot_capture> _screenshot_captures;
+		// Read back frames waiting to be encoded and written to disk on the worker thread
+		std::deque<screenshot_job> _screenshot_jobs;
+		std::thread _screenshot_worker;
+		std::mutex _screenshot_mutex;
+		std::condition_variable _screenshot_signal;
+		bool _screenshot_worker_exit = false;
+		// Builds the ImGui frame while the game is in its present call, so the menus do not take time from the frame, which then draws what was built during the previous present
+		bool _build_overlay_on_worker = false;
+		std::thread _overlay_worker;
+		std::mutex _overlay_mutex;
+		std::condition_variable _overlay_signal;
+		bool _overlay_worker_exit = false, _overlay_frame_requested = false;
+		// Set while the draw data of a frame built on the worker still has to be drawn, which is skipped if effects changed since, because it may show their textures
+		bool _overlay_frame_pending = false;
+		unsigned int _overlay_frame_effects_generation = 0;
+		// Menus on the worker cannot reset back-end resources, so they only request a reload, which happens on the next present
+		bool _overlay_reload_requested = false;
 		std::vector<filesystem::path> _effect_search_paths;
 		std::vector<filesystem::path> _texture_search_paths;
 		std::chrono::high_resolution_clock::time_point _start_time;
 		std::chrono::high_resolution_clock::time_point _last_reload_time;
 		std::chrono::high_resolution_clock::time_point _last_present_time;
 		std::chrono::high_resolution_clock::duration _last_frame_duration;
+		moving_average<uint64_t, 60> _average_frame_duration;
+		// Frame times in milliseconds over the last '_statistics_window' frames
+		sample_window<float> _frame_time_samples;
+		unsigned int _statistics_window = 600;
+		// Frame time to stay within in milliseconds, optional techniques of the preset are disabled while it is exceeded, zero to never disable any
+		float _frame_budget = 0.0f;
+		std::chrono::high_resolution_clock::time_point _last_frame_budget_change;
+		// Techniques the preset marks as optional, in the order they are disabled when over the frame budget
+		std::vector<std::string> _optional_techniques;
+		// Optional techniques that were disabled to stay within the frame budget, the most recent last
+		std::vector<suspended_technique> _suspended_techniques;
+		// Profiler events of one frame shown in the statistics, only refreshed a few times per second so they stay readable
+		std::vector<profiler::thread_events> _profiler_frame;
+		int64_t _profiler_frame_begin = 0, _profiler_frame_end = 0;
+		std::chrono::high_resolution_clock::time_point _last_profiler_update;
+		bool _profiler_paused = false;
+#if RESHADE_COUNT_ALLOCATIONS
+		// Heap allocations on the present thread during the last frame, with those of the overlay counted separately, since it allocates while the menu is open
+		uint64_t _last_allocation_count = 0, _frame_allocation_count = 0, _overlay_allocation_count = 0;
+#endif
+		// Memory estimates per effect file shown in the statistics, updated after each reload and while the statistics show them
+		std::vector<effect_memory_usage> _effect_memory_usage;
+		// Per-frame timings written to a file while recording, toggled with the frame recording key
+		frame_recorder _frame_recorder;
+		// Timings of the last frame for external tools, only published while enabled, since it creates a named shared memory object in the game process
+		telemetry_publisher _telemetry;
+		bool _publish_telemetry = false;
+		// CPU time spent applying effects since the last present and in the last present itself, together the overhead that is recorded per frame
+		std::chrono::high_resolution_clock::duration _effect_cpu_duration = { };
+		std::chrono::high_resolution_clock::duration _last_present_cpu_duration = { };
 		std::vector<unsigned char> _uniform_data_storage;
+		// Preset that is being loaded in performance mode, used to decide which techniques to compile only once they are enabled
+		std::unique_ptr<ini_file> _loading_preset;
+		// Uniforms of the loaded effects that performance mode turned into constants
+		std::vector<baked_uniform> _baked_uniforms;
+		// One entry per register sized chunk of the storage, set when a uniform in it changed since the backend last uploaded it
+		std::vector<bool> _uniform_data_dirty;
+		// Positions of objects by name, see 'find_texture', 'find_uniform' and 'find_technique'
+		std::unordered_map<std::string, size_t> _texture_index;
+		std::unordered_map<std::string, size_t> _uniform_index;
+		std::unordered_map<std::string, size_t> _technique_index;
+		// Incremented whenever uniforms or techniques are added or removed, which changes the layout preset snapshots were built for
+		unsigned int _effects_generation = 0;
+		// Presets resolved against the loaded effects, so loading them again only has to copy the results back
+		std::unordered_map<std::wstring, preset_snapshot> _preset_snapshots;
+		std::vector<uniform_updater> _uniform_updaters;
 		int _date[4] = { };
 		std::vector<std::string> _preprocessor_definitions;
-		std::vector<std::pair<std::string, std::function<void()>>> _menu_callables;
+		// The definitions from before the settings field was edited, which are compared to the new ones when it loses focus
+		std::vector<std::string> _preprocessor_definitions_before_edit;
+		bool _is_editing_preprocessor_definitions = false;
+		struct menu_callable
+		{
+			std::string label;
+			std::function<void()> function;
+			bool is_worker_safe;
+		};
+
+		std::vector<menu_callable> _menu_callables;
 		std::vector<std::function<void(const ini_file &)>> _load_config_callables;
 		std::vector<std::function<void(ini_file &)>> _save_config_callables;
 		size_t _menu_index = 0;
@@ -291,6 +835,8 @@ namespace reshade
 		unsigned int _menu_key_data[4];
 		unsigned int _screenshot_key_data[4];
 		unsigned int _effects_key_data[4];
+		unsigned int _replay_capture_key_data[4];
+		unsigned int _frame_recording_key_data[4];
 		filesystem::path _configuration_path;
 		filesystem::path _screenshot_path;
 		std::string _focus_effect;
@@ -305,8 +851,16 @@ namespace reshade
 		bool _save_imgui_window_state = false;
 		bool _overlay_key_setting_active = false;
 		bool _screenshot_key_setting_active = false;
+		bool _replay_capture_key_setting_active = false;
+		bool _frame_recording_key_setting_active = false;
 		bool _toggle_key_setting_active = false;
 		bool _log_wordwrap = false;
+		// Log lines that passed the filter, only collected again when the history or the filter changed
+		std::vector<std::string> _log_lines;
+		size_t _log_lines_revision = 0;
+		bool _log_lines_dirty = true;
+		// Most verbose level of messages that are logged, see 'log::level'
+		int _log_level = 4;
 		float _imgui_col_background[3] = { 0.275f, 0.275f, 0.275f };
 		float _imgui_col_item_background[3] = { 0.447f, 0.447f, 0.447f };
 		float _imgui_col_active[3] = { 0.2f, 0.2f, 1.0f };
@@ -317,6 +871,9 @@ namespace reshade
 		unsigned int _effects_expanded_state = 2;
 		char _effect_filter_buffer[64] = { };
 		char _preset_zone[64] = { '\0' };
+		// Set while effects are kept across a reset, together with the frame size their shaders were compiled for
+		bool _is_effect_restore_pending = false;
+		unsigned int _restore_width = 0, _restore_height = 0;
 		size_t _reload_remaining_effects = 0;
 		size_t _texture_count = 0;
 		size_t _uniform_count = 0;
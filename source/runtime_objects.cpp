@@ -10,27 +10,101 @@
 
 namespace reshade
 {
+	static inline std::string uniform_key(const std::string &effect_filename, const std::string &name)
+	{
+		// File names cannot contain a '|', so this never joins two different pairs to the same key
+		return effect_filename + '|' + name;
+	}
+
+	// Indices are only added to when objects are added, everything else that moves objects around is caught on lookup, by checking that the object at the index still has the name it was found with
+	template <typename T, typename F>
+	static T *find_in_index(std::vector<T> &objects, std::unordered_map<std::string, size_t> &index, const std::string &key, F key_of)
+	{
+		auto it = index.find(key);
+
+		if (it == index.end())
+		{
+			return nullptr;
+		}
+
+		if (it->second < objects.size() && key_of(objects[it->second]) == key)
+		{
+			return &objects[it->second];
+		}
+
+		index.clear();
+
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			index.emplace(key_of(objects[i]), i);
+		}
+
+		it = index.find(key);
+
+		return it != index.end() ? &objects[it->second] : nullptr;
+	}
+
 	void runtime::add_texture(texture &&texture)
 	{
+		_texture_index.emplace(texture.unique_name, _textures.size());
 		_textures.push_back(std::move(texture));
 	}
 	void runtime::add_uniform(uniform &&uniform)
 	{
+		_uniform_index.emplace(uniform_key(uniform.effect_filename, uniform.name), _uniforms.size());
 		_uniforms.push_back(std::move(uniform));
+		_effects_generation++;
 	}
 	void runtime::add_technique(technique &&technique)
 	{
+		_technique_index.emplace(technique.name, _techniques.size());
 		_techniques.push_back(std::move(technique));
+		_effects_generation++;
 	}
 	texture *runtime::find_texture(const std::string &unique_name)
 	{
-		const auto it = std::find_if(_textures.begin(), _textures.end(),
-			[unique_name](const auto &item)
+		return find_in_index(_textures, _texture_index, unique_name, [](const texture &texture) -> const std::string & { return texture.unique_name; });
+	}
+	uniform *runtime::find_uniform(const std::string &effect_filename, const std::string &name)
+	{
+		return find_in_index(_uniforms, _uniform_index, uniform_key(effect_filename, name), [](const uniform &uniform) { return uniform_key(uniform.effect_filename, uniform.name); });
+	}
+	technique *runtime::find_technique(const std::string &name)
+	{
+		return find_in_index(_techniques, _technique_index, name, [](const technique &technique) -> const std::string & { return technique.name; });
+	}
+	const technique *runtime::find_technique(const std::string &name) const
+	{
+		return const_cast<runtime *>(this)->find_technique(name);
+	}
+	bool runtime::is_technique_deferrable(const std::string &name, const std::unordered_map<std::string, variant> &annotations) const
+	{
+		if (_loading_preset == nullptr)
+		{
+			return false;
+		}
+
+		// Techniques that are enabled, bound to a key or time out on their own through annotations are always needed
+		for (const char *const annotation : { "enabled", "toggle", "timeout" })
+		{
+			if (const auto it = annotations.find(annotation); it != annotations.end() && it->second.as<bool>())
 			{
-				return item.unique_name == unique_name;
-			});
+				return false;
+			}
+		}
+
+		std::vector<std::string> technique_list;
+		_loading_preset->get("", "Techniques", technique_list);
+
+		if (std::find(technique_list.begin(), technique_list.end(), name) != technique_list.end())
+		{
+			return false;
+		}
 
-		return it != _textures.end() ? &(*it) : nullptr;
+		uint32_t toggle_key_data[4] = { };
+		_loading_preset->get("", "Key" + name, toggle_key_data);
+
+		return toggle_key_data[0] == 0;
 	}
 
 	void runtime::get_uniform_value(const uniform &variable, unsigned char *data, size_t size) const
@@ -134,7 +208,73 @@ namespace reshade
 
 		assert(variable.storage_offset + size <= _uniform_data_storage.size());
 
+		// Most uniforms keep their value from frame to frame, nothing needs to be uploaded for those
+		if (std::memcmp(&_uniform_data_storage[variable.storage_offset], data, size) == 0)
+		{
+			return;
+		}
+
 		std::memcpy(&_uniform_data_storage[variable.storage_offset], data, size);
+
+		mark_uniform_data_dirty(variable.storage_offset, size);
+	}
+	void runtime::mark_uniform_data_dirty(size_t offset, size_t size)
+	{
+		const size_t chunk_end = (offset + size + 15) / 16;
+
+		if (_uniform_data_dirty.size() < chunk_end)
+		{
+			_uniform_data_dirty.resize(chunk_end, true);
+		}
+
+		for (size_t chunk = offset / 16; chunk < chunk_end; chunk++)
+		{
+			_uniform_data_dirty[chunk] = true;
+		}
+	}
+	bool runtime::consume_uniform_changes(size_t offset, size_t size, size_t &dirty_offset, size_t &dirty_size)
+	{
+		// Storage added by effects loaded since the last check has never been uploaded
+		const size_t storage_chunks = (_uniform_data_storage.size() + 15) / 16;
+
+		if (_uniform_data_dirty.size() < storage_chunks)
+		{
+			_uniform_data_dirty.resize(storage_chunks, true);
+		}
+
+		const size_t chunk_begin = offset / 16, chunk_end = std::min((offset + size + 15) / 16, _uniform_data_dirty.size());
+		size_t first_dirty = chunk_end, last_dirty = chunk_end;
+
+		for (size_t chunk = chunk_begin; chunk < chunk_end; chunk++)
+		{
+			if (!_uniform_data_dirty[chunk])
+			{
+				continue;
+			}
+
+			if (first_dirty == chunk_end)
+			{
+				first_dirty = chunk;
+			}
+
+			last_dirty = chunk;
+
+			// Chunks shared with a neighboring range stay dirty, so that range still sees the change
+			if (chunk * 16 >= offset && (chunk + 1) * 16 <= offset + size)
+			{
+				_uniform_data_dirty[chunk] = false;
+			}
+		}
+
+		if (first_dirty == chunk_end)
+		{
+			return false;
+		}
+
+		dirty_offset = std::max(first_dirty * 16, offset);
+		dirty_size = std::min((last_dirty + 1) * 16, offset + size) - dirty_offset;
+
+		return true;
 	}
 	void runtime::set_uniform_value(uniform &variable, const bool *values, size_t count)
 	{
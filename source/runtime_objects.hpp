@@ -6,11 +6,14 @@
 #pragma once
 
 #include <memory>
+#include <chrono>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <unordered_map>
 #include "variant.hpp"
 #include "moving_average.hpp"
+#include "sample_window.hpp"
 
 namespace reshade
 {
@@ -58,8 +61,81 @@ namespace reshade
 	{
 		none,
 		back_buffer,
-		depth_buffer
+		depth_buffer,
+		// Computed by the runtime at most once per frame and shared by all effects
+		linear_depth_buffer,
+		back_buffer_mipmaps
 	};
+	/// <summary>
+	/// Returns the size in bytes of a 4x4 pixel block of a block-compressed texture format, or zero for uncompressed formats.
+	/// </summary>
+	inline unsigned int compressed_block_size(texture_format format)
+	{
+		switch (format)
+		{
+			case texture_format::dxt1:
+			case texture_format::latc1:
+				return 8;
+			case texture_format::dxt3:
+			case texture_format::dxt5:
+			case texture_format::latc2:
+				return 16;
+			default:
+				return 0;
+		}
+	}
+	/// <summary>
+	/// Returns the size in bytes of a pixel of an uncompressed texture format, or zero for block-compressed formats.
+	/// </summary>
+	inline unsigned int pixel_size(texture_format format)
+	{
+		switch (format)
+		{
+			case texture_format::r8:
+				return 1;
+			case texture_format::r16f:
+			case texture_format::rg8:
+				return 2;
+			case texture_format::r32f:
+			case texture_format::rg16:
+			case texture_format::rg16f:
+			case texture_format::rgba8:
+				return 4;
+			case texture_format::rg32f:
+			case texture_format::rgba16:
+			case texture_format::rgba16f:
+				return 8;
+			case texture_format::rgba32f:
+				return 16;
+			default:
+				return 0;
+		}
+	}
+	/// <summary>
+	/// Estimates the size in bytes of a texture with all of its mipmap levels. Drivers add padding and alignment on top, so this is a lower bound.
+	/// </summary>
+	inline size_t texture_memory_size(unsigned int width, unsigned int height, unsigned int levels, texture_format format)
+	{
+		const unsigned int block_size = compressed_block_size(format);
+		size_t size = 0;
+
+		for (unsigned int level = 0; level < std::max(levels, 1u); level++)
+		{
+			const unsigned int level_width = std::max(width >> level, 1u), level_height = std::max(height >> level, 1u);
+
+			if (block_size != 0)
+			{
+				size += static_cast<size_t>((level_width + 3) / 4) * ((level_height + 3) / 4) * block_size;
+			}
+			else
+			{
+				size += static_cast<size_t>(level_width) * level_height * pixel_size(format);
+			}
+		}
+
+		return size;
+	}
+
 	enum class uniform_datatype
 	{
 		boolean,
@@ -114,8 +190,31 @@ namespace reshade
 		unsigned int rows = 0, columns = 0, elements = 0;
 		size_t storage_offset = 0, storage_size = 0;
 		std::unordered_map<std::string, variant> annotations;
+		// Annotations the variable editor shows, converted once when the effect is loaded instead of every frame the editor is open
+		std::string ui_type, ui_label, ui_tooltip, ui_category, ui_items;
+		// The height the row of the variable took in the editor when it was last built, or negative if it was not built yet
+		float ui_row_height = -1.0f;
 		bool hidden = false;
 	};
+	struct technique_timings final
+	{
+		explicit technique_timings(size_t statistics_window) : cpu_duration_samples(statistics_window), gpu_duration_samples(statistics_window) { }
+
+		moving_average<uint64_t, 60> average_cpu_duration;
+		moving_average<uint64_t, 60> average_gpu_duration;
+		// Durations in milliseconds over the statistics window, for the percentiles in the statistics
+		sample_window<float> cpu_duration_samples, gpu_duration_samples;
+
+		struct pass_timings
+		{
+			std::string name;
+			moving_average<uint64_t, 60> average_gpu_duration;
+		};
+
+		// Only filled while passes are timed on the GPU, in the order of the passes of the technique
+		std::vector<pass_timings> passes;
+	};
+
 	struct technique final
 	{
 		#pragma region Constructors and Assignment Operators
@@ -127,17 +226,23 @@ namespace reshade
 		technique &operator=(const technique &) = delete;
 		#pragma endregion
 
-		std::string name, effect_filename;
-		std::vector<std::unique_ptr<base_object>> passes;
-		std::unordered_map<std::string, variant> annotations;
-		bool hidden = false;
+		// Everything the per-frame loops over all techniques touch comes first, so it shares a cache line instead of being spread over the whole object
 		bool enabled = false;
+		bool hidden = false;
 		int32_t timeout = 0;
 		int32_t timeleft = 0;
+		// Only render every this many frames while the camera stands still, for techniques that depend on the view alone and only write to their own textures, zero to render every frame
+		int32_t static_interval = 0;
+		bool writes_backbuffer = false;
 		uint32_t toggle_key_data[4];
-		moving_average<uint64_t, 60> average_cpu_duration;
-		moving_average<uint64_t, 60> average_gpu_duration;
+		std::chrono::high_resolution_clock::time_point last_enabled_time;
 		ptrdiff_t uniform_storage_offset = 0, uniform_storage_index = -1;
 		std::unique_ptr<base_object> impl;
+		// Only allocated while the technique runs, disabled techniques have no timings
+		std::unique_ptr<technique_timings> timings;
+
+		std::string name, effect_filename;
+		std::vector<std::unique_ptr<base_object>> passes;
+		std::unordered_map<std::string, variant> annotations;
 	};
 }
@@ -0,0 +1,135 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+/// <summary>
+/// Keeps the most recent samples of a value, so the distribution over them can be looked at instead of only the mean like <see cref="moving_average"/> has.
+/// </summary>
+template <typename T>
+class sample_window
+{
+public:
+	struct summary
+	{
+		T min, max, mean, p50, p95, p99;
+		// Mean of the largest percent of the samples, for frame times this is what the "1% low" frame rate is computed from
+		T worst_1_percent;
+	};
+
+	explicit sample_window(size_t capacity = 600) : _samples(std::max<size_t>(capacity, 1)) { }
+
+	/// <summary>
+	/// Get the number of samples that were appended so far, up to the capacity.
+	/// </summary>
+	size_t size() const { return _count; }
+	/// <summary>
+	/// Get the maximum number of samples that are kept.
+	/// </summary>
+	size_t capacity() const { return _samples.size(); }
+
+	/// <summary>
+	/// Get a sample, with the oldest one at index zero.
+	/// </summary>
+	T operator[](size_t index) const
+	{
+		return _samples[(_index + _samples.size() - _count + index) % _samples.size()];
+	}
+
+	void clear()
+	{
+		_index = 0;
+		_count = 0;
+	}
+	void append(T value)
+	{
+		_samples[_index] = value;
+		_index = (_index + 1) % _samples.size();
+		_count = std::min(_count + 1, _samples.size());
+	}
+
+	/// <summary>
+	/// Change the number of samples that are kept, this keeps the most recent ones.
+	/// </summary>
+	void resize(size_t capacity)
+	{
+		capacity = std::max<size_t>(capacity, 1);
+
+		if (capacity == _samples.size())
+		{
+			return;
+		}
+
+		std::vector<T> samples(capacity);
+		const size_t count = std::min(_count, capacity);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			samples[i] = (*this)[_count - count + i];
+		}
+
+		_samples = std::move(samples);
+		_count = count;
+		_index = count % capacity;
+	}
+
+	/// <summary>
+	/// Compute statistics over all samples in the window. This sorts a copy of them, so call it when the results are shown and not for every sample.
+	/// </summary>
+	summary compute() const
+	{
+		summary result = { };
+
+		if (_count == 0)
+		{
+			return result;
+		}
+
+		std::vector<T> sorted(_count);
+
+		for (size_t i = 0; i < _count; i++)
+		{
+			sorted[i] = (*this)[i];
+		}
+
+		std::sort(sorted.begin(), sorted.end());
+
+		const auto percentile = [&sorted](size_t percent) {
+			return sorted[std::min(sorted.size() - 1, sorted.size() * percent / 100)];
+		};
+
+		T sum = T();
+
+		for (const T value : sorted)
+		{
+			sum += value;
+		}
+
+		const size_t worst_count = std::max<size_t>(1, sorted.size() / 100);
+		T worst_sum = T();
+
+		for (size_t i = sorted.size() - worst_count; i < sorted.size(); i++)
+		{
+			worst_sum += sorted[i];
+		}
+
+		result.min = sorted.front();
+		result.max = sorted.back();
+		result.mean = sum / static_cast<T>(sorted.size());
+		result.p50 = percentile(50);
+		result.p95 = percentile(95);
+		result.p99 = percentile(99);
+		result.worst_1_percent = worst_sum / static_cast<T>(worst_count);
+
+		return result;
+	}
+
+private:
+	std::vector<T> _samples;
+	size_t _index = 0, _count = 0;
+};
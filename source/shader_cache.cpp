@@ -0,0 +1,421 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "log.hpp"
+#include "runtime.hpp"
+#include "shader_cache.hpp"
+#include "xxhash.h"
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+#include <unordered_set>
+#include <Windows.h>
+
+namespace reshade::shader_cache
+{
+	struct cache_file_header
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long key;
+		unsigned long long size;
+	};
+
+	// Package layout: Header, then an entry header followed by the bytecode for every shader
+	struct package_file_header
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long entry_count;
+	};
+	struct package_entry_header
+	{
+		unsigned long long key;
+		unsigned long long size;
+	};
+
+	static const unsigned int s_cache_magic = 0x43425352; // 'RSBC'
+	static const unsigned int s_cache_version = 1;
+	static const unsigned int s_package_magic = 0x4b505352; // 'RSPK'
+	static const unsigned int s_package_version = 1;
+
+	static std::atomic<bool> s_enabled(true);
+	static std::mutex s_used_keys_mutex;
+	static std::unordered_set<unsigned long long> s_used_keys;
+
+	static void mark_used(unsigned long long key)
+	{
+		const std::lock_guard<std::mutex> lock(s_used_keys_mutex);
+
+		s_used_keys.insert(key);
+	}
+
+	static filesystem::path cache_file_path(unsigned long long key)
+	{
+		char filename[32];
+		sprintf_s(filename, "%016llx.cso", key);
+
+		return cache_directory() / filename;
+	}
+
+	static void write_cache_file(unsigned long long key, const void *data, size_t size)
+	{
+		const filesystem::path directory = cache_directory();
+
+		if (!CreateDirectoryW(directory.wstring().c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+		{
+			LOG(WARNING) << "Failed to create shader cache directory " << directory << ".";
+			return;
+		}
+
+		const filesystem::path path = cache_file_path(key);
+		const filesystem::path temp_path = path + ".tmp";
+
+		// Write to a temporary file first and rename it afterwards, so a crash never leaves a truncated cache entry behind
+		{
+			std::ofstream file(temp_path.wstring(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+			if (!file.is_open())
+			{
+				return;
+			}
+
+			const cache_file_header header = { s_cache_magic, s_cache_version, key, size };
+
+			file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			file.write(static_cast<const char *>(data), size);
+
+			if (!file)
+			{
+				file.close();
+				DeleteFileW(temp_path.wstring().c_str());
+				return;
+			}
+		}
+
+		if (!MoveFileExW(temp_path.wstring().c_str(), path.wstring().c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			DeleteFileW(temp_path.wstring().c_str());
+		}
+	}
+
+	static unsigned long long module_version(const void *module)
+	{
+		// Read the version resource of the loaded module directly, which avoids having to link against the version library
+		const HMODULE handle = static_cast<HMODULE>(const_cast<void *>(module));
+		const HRSRC resource = handle != nullptr ? FindResourceW(handle, MAKEINTRESOURCEW(VS_VERSION_INFO), RT_VERSION) : nullptr;
+
+		if (resource == nullptr)
+		{
+			return 0;
+		}
+
+		const auto data = static_cast<const unsigned char *>(LockResource(LoadResource(handle, resource)));
+		const DWORD size = SizeofResource(handle, resource);
+
+		// The fixed file information follows the header of the resource and starts with a signature, so it is simply searched for
+		for (DWORD offset = 0; data != nullptr && offset + sizeof(VS_FIXEDFILEINFO) <= size; offset += sizeof(DWORD))
+		{
+			const auto info = reinterpret_cast<const VS_FIXEDFILEINFO *>(data + offset);
+
+			if (info->dwSignature == VS_FFI_SIGNATURE)
+			{
+				return (static_cast<unsigned long long>(info->dwFileVersionMS) << 32) | info->dwFileVersionLS;
+			}
+		}
+
+		return 0;
+	}
+
+	unsigned long long compute_key(const std::string &source, const std::string &entry_point, const std::string &profile, unsigned int flags, const void *compiler)
+	{
+		const unsigned long long version = module_version(compiler);
+
+		XXH64_state_t state;
+		XXH64_reset(&state, 0);
+		XXH64_update(&state, source.data(), source.size());
+		XXH64_update(&state, entry_point.c_str(), entry_point.size() + 1);
+		XXH64_update(&state, profile.c_str(), profile.size() + 1);
+		XXH64_update(&state, &flags, sizeof(flags));
+		XXH64_update(&state, &version, sizeof(version));
+
+		return XXH64_digest(&state);
+	}
+	unsigned long long compute_program_key(const std::string *sources, size_t source_count, const std::string &driver)
+	{
+		XXH64_state_t state;
+		XXH64_reset(&state, 0);
+
+		for (size_t i = 0; i < source_count; i++)
+		{
+			XXH64_update(&state, sources[i].c_str(), sources[i].size() + 1);
+		}
+
+		XXH64_update(&state, driver.c_str(), driver.size() + 1);
+
+		return XXH64_digest(&state);
+	}
+
+	bool load(unsigned long long key, std::vector<char> &bytecode)
+	{
+		if (!s_enabled.load(std::memory_order_relaxed))
+		{
+			return false;
+		}
+
+		std::ifstream file(cache_file_path(key).wstring(), std::ios::in | std::ios::binary);
+
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		cache_file_header header = { };
+
+		if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+			header.magic != s_cache_magic || header.version != s_cache_version || header.key != key || header.size == 0)
+		{
+			return false;
+		}
+
+		bytecode.resize(static_cast<size_t>(header.size));
+
+		if (!file.read(bytecode.data(), bytecode.size()))
+		{
+			bytecode.clear();
+			return false;
+		}
+
+		mark_used(key);
+
+		return true;
+	}
+	void save(unsigned long long key, const void *data, size_t size)
+	{
+		if (!s_enabled.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+
+		mark_used(key);
+
+		write_cache_file(key, data, size);
+	}
+
+	bool compile_lock::acquire(unsigned long long key)
+	{
+		release();
+
+		// Named mutexes are shared by all processes in the session, which are all game clients that compile into the same cache directory
+		wchar_t name[64];
+		swprintf_s(name, L"Local\\ReShadeShaderCompile.%016llx", key);
+
+		const HANDLE mutex = CreateMutexW(nullptr, FALSE, name);
+
+		if (mutex == nullptr)
+		{
+			return false;
+		}
+
+		DWORD result = WaitForSingleObject(mutex, 0);
+		const bool is_contended = result == WAIT_TIMEOUT;
+
+		if (is_contended)
+		{
+			result = WaitForSingleObject(mutex, 60000);
+		}
+
+		// An abandoned mutex belonged to a process that exited while compiling, which means the lock is taken over as usual
+		if (result != WAIT_OBJECT_0 && result != WAIT_ABANDONED)
+		{
+			LOG(WARNING) << "Timed out waiting for another process to compile shader " << std::hex << key << std::dec << ".";
+
+			CloseHandle(mutex);
+			return is_contended;
+		}
+
+		_mutex = mutex;
+
+		return is_contended;
+	}
+	void compile_lock::release()
+	{
+		if (_mutex == nullptr)
+		{
+			return;
+		}
+
+		ReleaseMutex(static_cast<HANDLE>(_mutex));
+		CloseHandle(static_cast<HANDLE>(_mutex));
+
+		_mutex = nullptr;
+	}
+
+	std::vector<unsigned long long> used_keys()
+	{
+		const std::lock_guard<std::mutex> lock(s_used_keys_mutex);
+
+		std::vector<unsigned long long> keys(s_used_keys.begin(), s_used_keys.end());
+
+		// Sorted, so exporting the same effects again produces the same package
+		std::sort(keys.begin(), keys.end());
+
+		return keys;
+	}
+	void clear_used_keys()
+	{
+		const std::lock_guard<std::mutex> lock(s_used_keys_mutex);
+
+		s_used_keys.clear();
+	}
+
+	size_t export_package(const filesystem::path &path, const std::vector<unsigned long long> &keys)
+	{
+		std::vector<std::pair<unsigned long long, std::vector<char>>> entries;
+
+		for (const unsigned long long key : keys)
+		{
+			std::vector<char> bytecode;
+
+			if (load(key, bytecode))
+			{
+				entries.emplace_back(key, std::move(bytecode));
+			}
+		}
+
+		if (entries.empty())
+		{
+			return 0;
+		}
+
+		const filesystem::path temp_path = path + ".tmp";
+
+		{
+			std::ofstream file(temp_path.wstring(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+			if (!file.is_open())
+			{
+				LOG(ERROR) << "Failed to create effect package " << path << ".";
+				return 0;
+			}
+
+			const package_file_header header = { s_package_magic, s_package_version, entries.size() };
+
+			file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+			for (const auto &entry : entries)
+			{
+				const package_entry_header entry_header = { entry.first, entry.second.size() };
+
+				file.write(reinterpret_cast<const char *>(&entry_header), sizeof(entry_header));
+				file.write(entry.second.data(), entry.second.size());
+			}
+
+			if (!file)
+			{
+				file.close();
+				DeleteFileW(temp_path.wstring().c_str());
+				LOG(ERROR) << "Failed to write effect package " << path << ".";
+				return 0;
+			}
+		}
+
+		if (!MoveFileExW(temp_path.wstring().c_str(), path.wstring().c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			DeleteFileW(temp_path.wstring().c_str());
+			LOG(ERROR) << "Failed to write effect package " << path << ".";
+			return 0;
+		}
+
+		return entries.size();
+	}
+	size_t import_package(const filesystem::path &path)
+	{
+		std::ifstream file(path.wstring(), std::ios::in | std::ios::binary);
+
+		if (!file.is_open())
+		{
+			return 0;
+		}
+
+		file.seekg(0, std::ios::end);
+		unsigned long long remaining = static_cast<unsigned long long>(file.tellg());
+		file.seekg(0, std::ios::beg);
+
+		package_file_header header = { };
+
+		if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+			header.magic != s_package_magic || header.version != s_package_version)
+		{
+			LOG(WARNING) << "Effect package " << path << " has an unsupported format.";
+			return 0;
+		}
+
+		remaining -= sizeof(header);
+
+		// Sizes are checked against what is left of the file before anything is allocated for them, so a damaged package cannot make this allocate huge amounts of memory
+		if (header.entry_count > remaining / sizeof(package_entry_header))
+		{
+			LOG(WARNING) << "Effect package " << path << " is truncated.";
+			return 0;
+		}
+
+		size_t imported = 0;
+		std::vector<char> bytecode;
+
+		// A package that cannot be imported is skipped, effects are compiled as if there was none
+		try
+		{
+			for (unsigned long long i = 0; i < header.entry_count; i++)
+			{
+				package_entry_header entry_header = { };
+
+				if (!file.read(reinterpret_cast<char *>(&entry_header), sizeof(entry_header)) ||
+					entry_header.size == 0 || entry_header.size > remaining - sizeof(entry_header))
+				{
+					LOG(WARNING) << "Effect package " << path << " is truncated.";
+					break;
+				}
+
+				remaining -= sizeof(entry_header) + entry_header.size;
+
+				// Shaders compiled on this machine before are left alone, they are the same anyway
+				if (filesystem::exists(cache_file_path(entry_header.key)))
+				{
+					file.seekg(static_cast<std::streamoff>(entry_header.size), std::ios::cur);
+					continue;
+				}
+
+				bytecode.resize(static_cast<size_t>(entry_header.size));
+
+				if (!file.read(bytecode.data(), bytecode.size()))
+				{
+					LOG(WARNING) << "Effect package " << path << " is truncated.";
+					break;
+				}
+
+				write_cache_file(entry_header.key, bytecode.data(), bytecode.size());
+				imported++;
+			}
+		}
+		catch (const std::exception &ex)
+		{
+			LOG(WARNING) << "Failed to import effect package " << path << ": " << ex.what();
+		}
+
+		return imported;
+	}
+
+	filesystem::path cache_directory()
+	{
+		return runtime::s_gw2hook_wrkdir_path + "Cache";
+	}
+
+	void set_enabled(bool enabled)
+	{
+		s_enabled.store(enabled, std::memory_order_relaxed);
+	}
+}
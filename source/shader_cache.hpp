@@ -0,0 +1,105 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "filesystem.hpp"
+
+namespace reshade::shader_cache
+{
+	/// <summary>
+	/// Compute the cache key for a shader compilation, which covers everything that influences the resulting bytecode.
+	/// </summary>
+	/// <param name="source">The generated shader source code.</param>
+	/// <param name="entry_point">The name of the entry point function.</param>
+	/// <param name="profile">The target shader profile (e.g. "ps_3_0").</param>
+	/// <param name="flags">The D3DCOMPILE flags passed to the compiler.</param>
+	/// <param name="compiler">The handle of the loaded D3DCompiler module, whose file version is part of the key, since different versions of the compiler produce different bytecode.</param>
+	unsigned long long compute_key(const std::string &source, const std::string &entry_point, const std::string &profile, unsigned int flags, const void *compiler);
+	/// <summary>
+	/// Compute the cache key for a linked program binary, which covers the source of all its shaders and the driver, since program binaries are only valid for the driver that created them.
+	/// </summary>
+	/// <param name="sources">The generated source code of the shaders in the program.</param>
+	/// <param name="source_count">The number of shaders in the program.</param>
+	/// <param name="driver">A description of the driver, like the vendor, renderer and version string in OpenGL.</param>
+	unsigned long long compute_program_key(const std::string *sources, size_t source_count, const std::string &driver);
+
+	/// <summary>
+	/// Look up compiled bytecode for the specified key in the on-disk cache.
+	/// </summary>
+	/// <param name="key">The cache key returned by <see cref="compute_key"/>.</param>
+	/// <param name="bytecode">The buffer to store the cached bytecode in.</param>
+	bool load(unsigned long long key, std::vector<char> &bytecode);
+	/// <summary>
+	/// Store compiled bytecode for the specified key in the on-disk cache.
+	/// </summary>
+	/// <param name="key">The cache key returned by <see cref="compute_key"/>.</param>
+	/// <param name="data">The compiled bytecode.</param>
+	/// <param name="size">The size of the compiled bytecode in bytes.</param>
+	void save(unsigned long long key, const void *data, size_t size);
+
+	/// <summary>
+	/// A lock on compiling one shader that is shared by all processes using the cache, so when several game clients start at once, only the first compiles a shader and the others load its result from the cache.
+	/// </summary>
+	class compile_lock
+	{
+	public:
+		compile_lock() = default;
+		~compile_lock() { release(); }
+
+		compile_lock(const compile_lock &) = delete;
+		compile_lock &operator=(const compile_lock &) = delete;
+
+		/// <summary>
+		/// Wait until no other thread or process compiles the shader with the specified key and take over the lock, which is held until <see cref="release"/> is called or the lock is destroyed.
+		/// Gives up waiting after a while, so a hung process does not block compiling, in which case the shader is compiled without holding the lock.
+		/// </summary>
+		/// <param name="key">The cache key returned by <see cref="compute_key"/>.</param>
+		/// <returns><c>true</c> if someone else held the lock, so the shader may be in the cache now and it is worth to look it up again.</returns>
+		bool acquire(unsigned long long key);
+		/// <summary>
+		/// Release the lock, after the compiled shader was stored in the cache.
+		/// </summary>
+		void release();
+
+	private:
+		void *_mutex = nullptr;
+	};
+
+	/// <summary>
+	/// Get the keys of all shaders that were loaded from or stored in the cache since the last call to <see cref="clear_used_keys"/>.
+	/// </summary>
+	std::vector<unsigned long long> used_keys();
+	/// <summary>
+	/// Forget the keys of the shaders used so far, which is done before all effects are compiled again.
+	/// </summary>
+	void clear_used_keys();
+
+	/// <summary>
+	/// Write the cached bytecode of the specified shaders into a single package file, which can be distributed together with the effects.
+	/// </summary>
+	/// <param name="path">The path of the package file to write.</param>
+	/// <param name="keys">The cache keys of the shaders to include, entries that are not in the cache are skipped.</param>
+	/// <returns>The number of shaders written to the package, or zero if writing it failed.</returns>
+	size_t export_package(const filesystem::path &path, const std::vector<unsigned long long> &keys);
+	/// <summary>
+	/// Add all shaders of a package file to the cache that are not in it yet, so compiling effects finds their bytecode there.
+	/// </summary>
+	/// <param name="path">The path of the package file to read.</param>
+	/// <returns>The number of shaders added to the cache.</returns>
+	size_t import_package(const filesystem::path &path);
+
+	/// <summary>
+	/// Get the directory the cache files are stored in.
+	/// </summary>
+	filesystem::path cache_directory();
+
+	/// <summary>
+	/// Turn looking up and storing bytecode on or off. While it is off, every shader is compiled, which the benchmark tool uses to measure the compiler.
+	/// </summary>
+	void set_enabled(bool enabled);
+}
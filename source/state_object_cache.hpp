@@ -0,0 +1,69 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include "com_ptr.hpp"
+#include <string>
+#include <unordered_map>
+#include <Windows.h>
+
+/// <summary>
+/// A cache of immutable state objects keyed by the bytes of the description they were created from, so all effects share the objects for identical descriptions and reloading them creates none again.
+/// Descriptions are compared byte by byte, so they have to be zeroed before they are filled in, including padding and unused members.
+/// </summary>
+template <typename T>
+class state_object_cache
+{
+public:
+	size_t size() const { return _objects.size(); }
+
+	/// <summary>
+	/// Get the object created for a description earlier, or create it now.
+	/// </summary>
+	/// <param name="desc">The description of the state.</param>
+	/// <param name="size">The size of the description in bytes.</param>
+	/// <param name="object">The pointer to store the object in.</param>
+	/// <param name="create">The function that creates the object if there is none yet, with the signature 'HRESULT(T **)'.</param>
+	/// <returns>The result of the creation, or 'S_OK' if the object was in the cache.</returns>
+	template <typename F>
+	HRESULT get(const void *desc, size_t size, com_ptr<T> &object, F create)
+	{
+		std::string key(static_cast<const char *>(desc), size);
+
+		if (const auto it = _objects.find(key); it != _objects.end())
+		{
+			object = it->second;
+			return S_OK;
+		}
+
+		com_ptr<T> created;
+
+		if (const HRESULT hr = create(&created); FAILED(hr))
+		{
+			return hr;
+		}
+
+		object = _objects.emplace(std::move(key), std::move(created)).first->second;
+
+		return S_OK;
+	}
+	template <typename DESC, typename F>
+	HRESULT get(const DESC &desc, com_ptr<T> &object, F create)
+	{
+		return get(&desc, sizeof(desc), object, create);
+	}
+
+	/// <summary>
+	/// Release all objects, which only stay alive while something else still references them.
+	/// </summary>
+	void clear()
+	{
+		_objects.clear();
+	}
+
+private:
+	std::unordered_map<std::string, com_ptr<T>> _objects;
+};
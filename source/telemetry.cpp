@@ -0,0 +1,128 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "log.hpp"
+#include "telemetry.hpp"
+#include <cstring>
+#include <algorithm>
+#include <Windows.h>
+
+namespace reshade
+{
+	static const uint32_t TELEMETRY_MAGIC = 'R' | ('S' << 8) | ('T' << 16) | ('M' << 24);
+
+	static void copy_string(char *destination, size_t size, const std::string &source)
+	{
+		const size_t length = std::min(source.size(), size - 1);
+
+		std::memcpy(destination, source.data(), length);
+		destination[length] = '\0';
+	}
+
+	telemetry_publisher::~telemetry_publisher()
+	{
+		close();
+	}
+
+	bool telemetry_publisher::open()
+	{
+		if (is_open())
+		{
+			return true;
+		}
+
+		const DWORD size = sizeof(telemetry_header) + TECHNIQUE_CAPACITY * sizeof(telemetry_technique);
+
+		// Named after the process, so several instances of the game do not overwrite each other
+		wchar_t name[64];
+		swprintf_s(name, L"Local\\ReShadeTelemetry.%lu", GetCurrentProcessId());
+
+		const HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, size, name);
+
+		if (mapping == nullptr)
+		{
+			LOG(WARNING) << "Failed to create telemetry shared memory with error code " << GetLastError() << ".";
+			return false;
+		}
+
+		void *const view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+
+		if (view == nullptr)
+		{
+			LOG(WARNING) << "Failed to map telemetry shared memory with error code " << GetLastError() << ".";
+
+			CloseHandle(mapping);
+			return false;
+		}
+
+		_mapping = mapping;
+		_header = static_cast<telemetry_header *>(view);
+		_techniques = reinterpret_cast<telemetry_technique *>(_header + 1);
+
+		// The mapping may still exist from an earlier open, in which case readers see the sequence continue
+		const uint32_t sequence = _header->magic == TELEMETRY_MAGIC ? _header->sequence : 0;
+
+		std::memset(view, 0, size);
+
+		_header->magic = TELEMETRY_MAGIC;
+		_header->version = VERSION;
+		_header->size = size;
+		_header->sequence = sequence + (sequence & 1);
+		_header->technique_capacity = TECHNIQUE_CAPACITY;
+
+		LOG(INFO) << "Publishing telemetry through shared memory \"Local\\ReShadeTelemetry." << GetCurrentProcessId() << "\".";
+
+		return true;
+	}
+	void telemetry_publisher::close()
+	{
+		if (!is_open())
+		{
+			return;
+		}
+
+		UnmapViewOfFile(_header);
+		CloseHandle(static_cast<HANDLE>(_mapping));
+
+		_mapping = nullptr;
+		_header = nullptr;
+		_techniques = nullptr;
+	}
+
+	void telemetry_publisher::begin_frame(uint64_t frame_count, int64_t timestamp, float frame_time, float cpu_overhead, float gpu_overhead, const std::string &preset)
+	{
+		// Odd while writing, the interlocked operation also keeps the writes below from being moved in front of it
+		InterlockedIncrement(reinterpret_cast<volatile LONG *>(&_header->sequence));
+
+		_header->frame_count = frame_count;
+		_header->timestamp = timestamp;
+		_header->frame_time = frame_time;
+		_header->cpu_overhead = cpu_overhead;
+		_header->gpu_overhead = gpu_overhead;
+
+		copy_string(_header->preset, sizeof(_header->preset), preset);
+	}
+	void telemetry_publisher::set_technique(size_t index, const std::string &name, bool enabled, float cpu_time, float gpu_time)
+	{
+		if (index >= TECHNIQUE_CAPACITY)
+		{
+			return;
+		}
+
+		telemetry_technique &technique = _techniques[index];
+
+		copy_string(technique.name, sizeof(technique.name), name);
+		technique.enabled = enabled;
+		technique.cpu_time = cpu_time;
+		technique.gpu_time = gpu_time;
+	}
+	void telemetry_publisher::end_frame(size_t technique_count)
+	{
+		_header->technique_count = static_cast<uint32_t>(std::min<size_t>(technique_count, TECHNIQUE_CAPACITY));
+
+		// Even again, the interlocked operation makes all writes of the frame visible before it
+		InterlockedIncrement(reinterpret_cast<volatile LONG *>(&_header->sequence));
+	}
+}
@@ -0,0 +1,91 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace reshade
+{
+	// Layout of the shared memory, which external tools open as "Local\ReShadeTelemetry.<process id>": The header, followed by 'technique_capacity' technique entries
+	// The writer makes 'sequence' odd before it changes anything and even again afterwards, so readers copy the data, and retry when the sequence was odd or changed in between
+	struct telemetry_header
+	{
+		uint32_t magic, version, size;
+		volatile uint32_t sequence;
+		uint32_t technique_capacity, technique_count;
+		uint64_t frame_count;
+		// Time the frame was presented in nanoseconds since the runtime started
+		int64_t timestamp;
+		// Milliseconds, the overheads of the frame are the CPU time ReShade took and the GPU time its techniques took
+		float frame_time, cpu_overhead, gpu_overhead;
+		// UTF-8 path of the active preset, empty without one
+		char preset[260];
+	};
+	struct telemetry_technique
+	{
+		char name[64];
+		uint32_t enabled;
+		// Milliseconds in the frame, zero for techniques that did not render
+		float cpu_time, gpu_time;
+	};
+
+	/// <summary>
+	/// Publishes the timings of every frame through a named file mapping, so monitoring tools and benchmark scripts can read them without parsing log files.
+	/// </summary>
+	class telemetry_publisher
+	{
+	public:
+		static constexpr uint32_t VERSION = 1;
+		static constexpr uint32_t TECHNIQUE_CAPACITY = 512;
+
+		telemetry_publisher() = default;
+		~telemetry_publisher();
+
+		telemetry_publisher(const telemetry_publisher &) = delete;
+		telemetry_publisher &operator=(const telemetry_publisher &) = delete;
+
+		/// <summary>
+		/// Check whether the shared memory is mapped.
+		/// </summary>
+		bool is_open() const { return _header != nullptr; }
+
+		/// <summary>
+		/// Create the shared memory for this process.
+		/// </summary>
+		/// <returns><c>true</c> if it was mapped successfully.</returns>
+		bool open();
+		/// <summary>
+		/// Unmap the shared memory, readers keep what they mapped until they close it too.
+		/// </summary>
+		void close();
+
+		/// <summary>
+		/// Begin publishing a frame. Fill in the techniques with <see cref="set_technique"/> and finish it with <see cref="end_frame"/>.
+		/// </summary>
+		/// <param name="frame_count">The number of the frame.</param>
+		/// <param name="timestamp">The time the frame was presented in nanoseconds.</param>
+		/// <param name="frame_time">The time since the previous frame in milliseconds.</param>
+		/// <param name="cpu_overhead">The CPU time ReShade took during the frame in milliseconds.</param>
+		/// <param name="gpu_overhead">The GPU time the techniques took during the frame in milliseconds.</param>
+		/// <param name="preset">The path of the active preset.</param>
+		void begin_frame(uint64_t frame_count, int64_t timestamp, float frame_time, float cpu_overhead, float gpu_overhead, const std::string &preset);
+		/// <summary>
+		/// Set a technique of the frame begun last, techniques beyond <see cref="TECHNIQUE_CAPACITY"/> are left out.
+		/// </summary>
+		void set_technique(size_t index, const std::string &name, bool enabled, float cpu_time, float gpu_time);
+		/// <summary>
+		/// Finish the frame begun last, which makes it visible to readers.
+		/// </summary>
+		/// <param name="technique_count">The number of techniques that were set.</param>
+		void end_frame(size_t technique_count);
+
+	private:
+		void *_mapping = nullptr;
+		telemetry_header *_header = nullptr;
+		telemetry_technique *_techniques = nullptr;
+	};
+}
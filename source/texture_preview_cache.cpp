@@ -0,0 +1,133 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "log.hpp"
+#include "shader_cache.hpp"
+#include "texture_preview_cache.hpp"
+#include "xxhash.h"
+#include <fstream>
+#include <algorithm>
+#include <stb_image_resize.h>
+#include <Windows.h>
+
+namespace reshade::texture_preview_cache
+{
+	struct cache_file_header
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long key;
+		unsigned int width, height;
+	};
+
+	static const unsigned int s_cache_magic = 0x50545352; // 'RSTP'
+	static const unsigned int s_cache_version = 1;
+
+	static filesystem::path cache_file_path(unsigned long long key)
+	{
+		char filename[32];
+		sprintf_s(filename, "%016llx.preview", key);
+
+		return shader_cache::cache_directory() / filename;
+	}
+
+	unsigned long long compute_key(const filesystem::path &path)
+	{
+		const std::string filename = path.string();
+		const uint64_t modified = filesystem::last_write_time(path);
+
+		XXH64_state_t state;
+		XXH64_reset(&state, 0);
+		XXH64_update(&state, filename.c_str(), filename.size() + 1);
+		XXH64_update(&state, &modified, sizeof(modified));
+		XXH64_update(&state, &MAX_PREVIEW_SIZE, sizeof(MAX_PREVIEW_SIZE));
+
+		return XXH64_digest(&state);
+	}
+
+	bool load(unsigned long long key, std::vector<uint8_t> &data, unsigned int &width, unsigned int &height)
+	{
+		std::ifstream file(cache_file_path(key).wstring(), std::ios::in | std::ios::binary);
+
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		cache_file_header header = { };
+
+		if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+			header.magic != s_cache_magic || header.version != s_cache_version || header.key != key ||
+			header.width == 0 || header.height == 0 || header.width > MAX_PREVIEW_SIZE || header.height > MAX_PREVIEW_SIZE)
+		{
+			return false;
+		}
+
+		data.resize(header.width * header.height * 4);
+
+		if (!file.read(reinterpret_cast<char *>(data.data()), data.size()))
+		{
+			data.clear();
+			return false;
+		}
+
+		width = header.width;
+		height = header.height;
+
+		return true;
+	}
+	void save(unsigned long long key, const uint8_t *data, unsigned int width, unsigned int height)
+	{
+		const filesystem::path directory = shader_cache::cache_directory();
+
+		if (!CreateDirectoryW(directory.wstring().c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+		{
+			LOG(WARNING) << "Failed to create texture preview cache directory " << directory << ".";
+			return;
+		}
+
+		// Keep the aspect ratio, so the preview scales back up to the texture without distortion
+		const unsigned int largest = std::max(width, height);
+		const unsigned int preview_width = std::max(1u, static_cast<unsigned int>(static_cast<unsigned long long>(width) * MAX_PREVIEW_SIZE / largest));
+		const unsigned int preview_height = std::max(1u, static_cast<unsigned int>(static_cast<unsigned long long>(height) * MAX_PREVIEW_SIZE / largest));
+
+		std::vector<uint8_t> preview(preview_width * preview_height * 4);
+
+		if (stbir_resize_uint8(data, width, height, 0, preview.data(), preview_width, preview_height, 0, 4) == 0)
+		{
+			return;
+		}
+
+		const filesystem::path path = cache_file_path(key);
+		const filesystem::path temp_path = path + ".tmp";
+
+		// Write to a temporary file first and rename it afterwards, so a crash never leaves a truncated cache entry behind
+		{
+			std::ofstream file(temp_path.wstring(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+			if (!file.is_open())
+			{
+				return;
+			}
+
+			const cache_file_header header = { s_cache_magic, s_cache_version, key, preview_width, preview_height };
+
+			file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char *>(preview.data()), preview.size());
+
+			if (!file)
+			{
+				file.close();
+				DeleteFileW(temp_path.wstring().c_str());
+				return;
+			}
+		}
+
+		if (!MoveFileExW(temp_path.wstring().c_str(), path.wstring().c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			DeleteFileW(temp_path.wstring().c_str());
+		}
+	}
+}
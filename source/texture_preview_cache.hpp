@@ -0,0 +1,41 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "filesystem.hpp"
+
+namespace reshade::texture_preview_cache
+{
+	/// <summary>
+	/// The maximum width and height of a preview image.
+	/// </summary>
+	const unsigned int MAX_PREVIEW_SIZE = 256;
+
+	/// <summary>
+	/// Compute the cache key for the preview of an image file, which changes whenever the file is modified.
+	/// </summary>
+	/// <param name="path">The full path to the image file.</param>
+	unsigned long long compute_key(const filesystem::path &path);
+
+	/// <summary>
+	/// Look up the low resolution preview of an image file in the on-disk cache.
+	/// </summary>
+	/// <param name="key">The cache key returned by <see cref="compute_key"/>.</param>
+	/// <param name="data">The buffer to store the 32bpp RGBA image data of the preview in.</param>
+	/// <param name="width">The width of the preview in pixels.</param>
+	/// <param name="height">The height of the preview in pixels.</param>
+	bool load(unsigned long long key, std::vector<uint8_t> &data, unsigned int &width, unsigned int &height);
+	/// <summary>
+	/// Scale an image down to a low resolution preview and store it in the on-disk cache.
+	/// </summary>
+	/// <param name="key">The cache key returned by <see cref="compute_key"/>.</param>
+	/// <param name="data">The 32bpp RGBA image data at full resolution.</param>
+	/// <param name="width">The width of the image in pixels.</param>
+	/// <param name="height">The height of the image in pixels.</param>
+	void save(unsigned long long key, const uint8_t *data, unsigned int width, unsigned int height);
+}
@@ -25,6 +25,12 @@ bool reshade::runtime::check_for_update(unsigned long latest_version[3])
 		return false;
 	}
 
+	// WinINet waits up to a minute per step by default, which is far too long on networks that silently drop the connection
+	DWORD timeout = 5000;
+	InternetSetOption(handle, INTERNET_OPTION_CONNECT_TIMEOUT, &timeout, sizeof(timeout));
+	InternetSetOption(handle, INTERNET_OPTION_SEND_TIMEOUT, &timeout, sizeof(timeout));
+	InternetSetOption(handle, INTERNET_OPTION_RECEIVE_TIMEOUT, &timeout, sizeof(timeout));
+
 	constexpr auto api_url = TEXT("https://api.github.com/repos/crosire/reshade/tags");
 
 	const scoped_handle request = InternetOpenUrl(handle, api_url, nullptr, 0, INTERNET_FLAG_RELOAD | INTERNET_FLAG_PRAGMA_NOCACHE | INTERNET_FLAG_NO_CACHE_WRITE, 0);
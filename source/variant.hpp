@@ -7,58 +7,93 @@
 
 #include <string>
 #include <vector>
+#include <type_traits>
 #include "filesystem.hpp"
 
 namespace reshade
 {
+	/// <summary>
+	/// A list of values of one type, like annotation values or the items of an INI entry. Numbers are kept as numbers, so reading them back does not parse anything, and only strings (e.g. read from an INI file) are parsed on access.
+	/// </summary>
 	class variant
 	{
 	public:
 		variant() { }
-		variant(const char *value) : _values(1, value) { }
-		template <typename T>
-		variant(const T &value) : variant(std::to_string(value)) { }
-		template <>
-		variant(const bool &value) : variant(value ? "1" : "0") { }
-		template <>
-		variant(const std::string &value) : _values(1, value) { }
-		template <>
-		variant(const std::vector<std::string> &values) : _values(values) { }
-		variant(const std::vector<std::string> &&values) : _values(std::move(values)) { }
-		template<class InputIt>
-		variant(InputIt first, InputIt last) : _values(first, last) { }
-		template <>
+		variant(const char *value) : _type(value_type::string), _count(1), _strings(1, value) { }
+		variant(const std::string &value) : _type(value_type::string), _count(1), _strings(1, value) { }
+		variant(const std::vector<std::string> &values) : _type(value_type::string), _count(values.size()), _strings(values) { }
+		variant(std::vector<std::string> &&values) : _type(value_type::string), _count(values.size()), _strings(std::move(values)) { }
+		template <class InputIt>
+		variant(InputIt first, InputIt last) : _type(value_type::string), _strings(first, last) { _count = _strings.size(); }
 		variant(const filesystem::path &value) : variant(value.string()) { }
-		template <>
-		variant(const std::vector<filesystem::path> &values) : _values(values.size())
+		variant(const std::vector<filesystem::path> &values) : _type(value_type::string), _count(values.size()), _strings(values.size())
 		{
 			for (size_t i = 0; i < values.size(); i++)
-				_values[i] = values[i].string();
+				_strings[i] = values[i].string();
 		}
 		template <typename T>
-		variant(const T *values, size_t count) : _values(count)
-		{
-			for (size_t i = 0; i < count; i++)
-				_values[i] = std::to_string(values[i]);
-		}
-		template <>
-		variant(const bool *values, size_t count) : _values(count)
+		variant(const T &value) : variant(&value, 1) { }
+		template <typename T>
+		variant(const T *values, size_t count)
 		{
+			static_assert(std::is_arithmetic<T>::value, "variant can only store numbers and strings");
+
+			_type = std::is_same<T, bool>::value || std::is_unsigned<T>::value ? value_type::unsigned_integer : std::is_floating_point<T>::value ? value_type::floating_point : value_type::signed_integer;
+			_count = count;
+
+			if (count > INLINE_CAPACITY)
+			{
+				_heap_numbers.resize(count);
+			}
+
+			number *const numbers = this->numbers();
+
 			for (size_t i = 0; i < count; i++)
-				_values[i] = values[i] ? "1" : "0";
+			{
+				switch (_type)
+				{
+					case value_type::signed_integer:
+						numbers[i].i = static_cast<long long>(values[i]);
+						break;
+					case value_type::unsigned_integer:
+						numbers[i].u = static_cast<unsigned long long>(values[i]);
+						break;
+					case value_type::floating_point:
+						numbers[i].f = static_cast<double>(values[i]);
+						break;
+					default:
+						break;
+				}
+			}
 		}
 		template <typename T, size_t COUNT>
 		variant(const T(&values)[COUNT]) : variant(values, COUNT) { }
 		template <typename T>
 		variant(std::initializer_list<T> values) : variant(values.begin(), values.size()) { }
 
-		std::vector<std::string> &data()
-		{
-			return _values;
-		}
-		const std::vector<std::string> &data() const
+		/// <summary>
+		/// Get the number of values.
+		/// </summary>
+		size_t size() const { return _count; }
+		/// <summary>
+		/// Get the number of bytes the values occupy on the heap, which is none for numbers that are stored inline.
+		/// </summary>
+		size_t heap_size() const
 		{
-			return _values;
+			// Strings that fit into the buffer of an empty one do not allocate
+			static const size_t inline_string_capacity = std::string().capacity();
+
+			size_t size = _heap_numbers.capacity() * sizeof(number) + _strings.capacity() * sizeof(std::string);
+
+			for (const auto &string : _strings)
+			{
+				if (string.capacity() > inline_string_capacity)
+				{
+					size += string.capacity() + 1;
+				}
+			}
+
+			return size;
 		}
 
 		template <typename T>
@@ -66,7 +101,12 @@ namespace reshade
 		template <>
 		const bool as(size_t i) const
 		{
-			return as<int>(i) != 0 || i < _values.size() && (_values[i] == "true" || _values[i] == "True" || _values[i] == "TRUE");
+			if (_type == value_type::string)
+			{
+				return as<int>(i) != 0 || i < _count && (_strings[i] == "true" || _strings[i] == "True" || _strings[i] == "TRUE");
+			}
+
+			return as<long long>(i) != 0;
 		}
 		template <>
 		const int as(size_t i) const
@@ -81,32 +121,62 @@ namespace reshade
 		template <>
 		const long as(size_t i) const
 		{
-			if (i >= _values.size())
+			if (_type == value_type::string)
 			{
-				return 0l;
+				return i < _count ? std::strtol(_strings[i].c_str(), nullptr, 10) : 0l;
 			}
 
-			return std::strtol(_values[i].c_str(), nullptr, 10);
+			return static_cast<long>(as<long long>(i));
 		}
 		template <>
 		const unsigned long as(size_t i) const
 		{
-			if (i >= _values.size())
+			if (_type == value_type::string)
+			{
+				return i < _count ? std::strtoul(_strings[i].c_str(), nullptr, 10) : 0ul;
+			}
+
+			return static_cast<unsigned long>(as<unsigned long long>(i));
+		}
+		template <>
+		const long long as(size_t i) const
+		{
+			if (i >= _count)
 			{
-				return 0ul;
+				return 0ll;
 			}
 
-			return std::strtoul(_values[i].c_str(), nullptr, 10);
+			switch (_type)
+			{
+				case value_type::signed_integer:
+					return numbers()[i].i;
+				case value_type::unsigned_integer:
+					return static_cast<long long>(numbers()[i].u);
+				case value_type::floating_point:
+					return static_cast<long long>(numbers()[i].f);
+				default:
+					return std::strtoll(_strings[i].c_str(), nullptr, 10);
+			}
 		}
 		template <>
 		const unsigned long long as(size_t i) const
 		{
-			if (i >= _values.size())
+			if (i >= _count)
 			{
-				return 0ul;
+				return 0ull;
 			}
 
-			return std::strtoull(_values[i].c_str(), nullptr, 10);
+			switch (_type)
+			{
+				case value_type::signed_integer:
+					return static_cast<unsigned long long>(numbers()[i].i);
+				case value_type::unsigned_integer:
+					return numbers()[i].u;
+				case value_type::floating_point:
+					return static_cast<unsigned long long>(numbers()[i].f);
+				default:
+					return std::strtoull(_strings[i].c_str(), nullptr, 10);
+			}
 		}
 		template <>
 		const float as(size_t i) const
@@ -116,22 +186,43 @@ namespace reshade
 		template <>
 		const double as(size_t i) const
 		{
-			if (i >= _values.size())
+			if (i >= _count)
 			{
 				return 0.0;
 			}
 
-			return std::strtod(_values[i].c_str(), nullptr);
+			switch (_type)
+			{
+				case value_type::signed_integer:
+					return static_cast<double>(numbers()[i].i);
+				case value_type::unsigned_integer:
+					return static_cast<double>(numbers()[i].u);
+				case value_type::floating_point:
+					return numbers()[i].f;
+				default:
+					return std::strtod(_strings[i].c_str(), nullptr);
+			}
 		}
 		template <>
 		const std::string as(size_t i) const
 		{
-			if (i >= _values.size())
+			if (i >= _count)
 			{
 				return std::string();
 			}
 
-			return _values[i];
+			// Formatted the same way values were stored as strings before, so INI files keep their look
+			switch (_type)
+			{
+				case value_type::signed_integer:
+					return std::to_string(numbers()[i].i);
+				case value_type::unsigned_integer:
+					return std::to_string(numbers()[i].u);
+				case value_type::floating_point:
+					return std::to_string(numbers()[i].f);
+				default:
+					return _strings[i];
+			}
 		}
 		template <>
 		const filesystem::path as(size_t i) const
@@ -140,6 +231,30 @@ namespace reshade
 		}
 
 	private:
-		std::vector<std::string> _values;
+		enum class value_type : unsigned char
+		{
+			string,
+			signed_integer,
+			unsigned_integer,
+			floating_point
+		};
+		union number
+		{
+			long long i;
+			unsigned long long u;
+			double f;
+		};
+
+		// Single values and small vectors, which is what nearly all annotations and INI entries are, are stored without allocating
+		static constexpr size_t INLINE_CAPACITY = 4;
+
+		number *numbers() { return _count > INLINE_CAPACITY ? _heap_numbers.data() : _inline_numbers; }
+		const number *numbers() const { return _count > INLINE_CAPACITY ? _heap_numbers.data() : _inline_numbers; }
+
+		value_type _type = value_type::string;
+		size_t _count = 0;
+		number _inline_numbers[INLINE_CAPACITY] = { };
+		std::vector<number> _heap_numbers;
+		std::vector<std::string> _strings;
 	};
 }
@@ -0,0 +1,125 @@
+/**
+ * Separable gaussian blur with a bloom style threshold, in the shape most blur and bloom effects share.
+ */
+
+#include "ReShade.fxh"
+
+#ifndef BLUR_SAMPLES
+	#define BLUR_SAMPLES 11
+#endif
+
+uniform float BlurRadius <
+	ui_type = "drag";
+	ui_min = 0.0; ui_max = 4.0;
+	ui_label = "Radius";
+	ui_tooltip = "Distance between two blur samples, in pixels.";
+> = 1.0;
+
+uniform float BloomThreshold <
+	ui_type = "drag";
+	ui_min = 0.0; ui_max = 1.0;
+	ui_label = "Threshold";
+> = 0.8;
+
+uniform float3 BloomTint <
+	ui_type = "color";
+	ui_label = "Tint";
+> = float3(1.0, 0.95, 0.9);
+
+uniform int BlendMode <
+	ui_type = "combo";
+	ui_items = "Add\0Screen\0Lighten\0";
+> = 1;
+
+texture BlurTexH { Width = BUFFER_WIDTH / 2; Height = BUFFER_HEIGHT / 2; Format = RGBA16F; };
+texture BlurTexV { Width = BUFFER_WIDTH / 2; Height = BUFFER_HEIGHT / 2; Format = RGBA16F; };
+
+sampler BlurSamplerH { Texture = BlurTexH; MinFilter = LINEAR; MagFilter = LINEAR; AddressU = CLAMP; AddressV = CLAMP; };
+sampler BlurSamplerV { Texture = BlurTexV; MinFilter = LINEAR; MagFilter = LINEAR; AddressU = CLAMP; AddressV = CLAMP; };
+
+static const float Sigma = BLUR_SAMPLES / 4.0;
+
+float Luminance(float3 color)
+{
+	return dot(color, float3(0.2126, 0.7152, 0.0722));
+}
+
+float3 Threshold(float3 color)
+{
+	const float luma = Luminance(color);
+	return color * saturate((luma - BloomThreshold) / max(1.0 - BloomThreshold, 1e-3));
+}
+
+float4 Blur(sampler source, float2 texcoord, float2 direction)
+{
+	float4 color = 0.0;
+	float weight_sum = 0.0;
+
+	[unroll]
+	for (int i = 0; i < BLUR_SAMPLES; i++)
+	{
+		const float x = float(i - BLUR_SAMPLES / 2);
+		const float weight = exp(-0.5 * x * x / (Sigma * Sigma));
+		color += tex2D(source, texcoord + direction * x * BlurRadius * ReShade::PixelSize * 2.0) * weight;
+		weight_sum += weight;
+	}
+
+	return color / weight_sum;
+}
+
+float4 PS_Threshold(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	return float4(Threshold(tex2D(ReShade::BackBuffer, texcoord).rgb), 1.0);
+}
+float4 PS_BlurH(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	return Blur(BlurSamplerV, texcoord, float2(1.0, 0.0));
+}
+float4 PS_BlurV(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	return Blur(BlurSamplerH, texcoord, float2(0.0, 1.0));
+}
+float4 PS_Combine(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	const float3 color = tex2D(ReShade::BackBuffer, texcoord).rgb;
+	const float3 bloom = tex2D(BlurSamplerV, texcoord).rgb * BloomTint;
+
+	switch (BlendMode)
+	{
+	case 0:
+		return float4(color + bloom, 1.0);
+	case 1:
+		return float4(1.0 - (1.0 - color) * (1.0 - bloom), 1.0);
+	default:
+		return float4(max(color, bloom), 1.0);
+	}
+}
+
+technique Bloom < ui_tooltip = "Blurs the bright parts of the image and blends them back on top."; >
+{
+	pass Threshold
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = PS_Threshold;
+		RenderTarget = BlurTexV;
+	}
+	pass BlurHorizontal
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = PS_BlurH;
+		RenderTarget = BlurTexH;
+	}
+	pass BlurVertical
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = PS_BlurV;
+		RenderTarget = BlurTexV;
+	}
+	pass Combine
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = PS_Combine;
+		BlendEnable = false;
+		SRGBWriteEnable = false;
+	}
+}
@@ -0,0 +1,89 @@
+/**
+ * Color grading in the style of effects that precompute most of their math from constants, which the front end folds away while parsing.
+ * The parenthesized casts and constructors make the parser back up and try again, as they do in most hand written color math.
+ */
+
+#include "ReShade.fxh"
+
+static const float PI = 3.14159265;
+static const float TAU = PI * 2.0;
+static const float INV_GAMMA = 1.0 / 2.2;
+static const float3 LUMA_COEFFICIENTS = float3(0.2126, 0.7152, 0.0722);
+static const float3x3 RGB_TO_XYZ = float3x3(
+	0.4124564, 0.3575761, 0.1804375,
+	0.2126729, 0.7151522, 0.0721750,
+	0.0193339, 0.1191920, 0.9503041);
+static const float3x3 XYZ_TO_RGB = float3x3(
+	 3.2404542, -1.5371385, -0.4985314,
+	-0.9692660,  1.8760108,  0.0415560,
+	 0.0556434, -0.2040259,  1.0572252);
+static const int STEPS = (int)(64 / 4) + 2 * 3 - (1 << 2);
+static const float STEP_SIZE = 1.0 / (float)STEPS;
+static const float4 LIFT = float4(0.02, 0.01, -0.01, 0.0) * (1.0 + 0.5 * 0.25);
+static const float4 GAMMA = (float4)1.0 + float4(-0.05, 0.0, 0.05, 0.0) * 0.5;
+static const float4 GAIN = float4((float3)(1.0 + 0.1 * 0.5), 1.0);
+static const bool USE_ACES = (STEPS > 8) && !(STEPS & 1);
+
+uniform float Exposure < ui_type = "drag"; ui_min = -4.0; ui_max = 4.0; > = 0.0;
+uniform float Temperature < ui_type = "drag"; ui_min = -1.0; ui_max = 1.0; > = 0.0;
+uniform float Vibrance < ui_type = "drag"; ui_min = -1.0; ui_max = 1.0; > = 0.15;
+
+float3 Aces(float3 x)
+{
+	const float a = 2.51, b = 0.03, c = 2.43, d = 0.59, e = 0.14;
+	return saturate((x * (a * x + b)) / (x * (c * x + d) + e));
+}
+
+float3 Uncharted(float3 x)
+{
+	const float A = 0.15, B = 0.50, C = 0.10, D = 0.20, E = 0.02, F = 0.30;
+	return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+}
+
+float3 WhiteBalance(float3 color)
+{
+	const float3 warm = float3(1.0 + 0.1 * 0.5, 1.0, 1.0 - 0.1 * 0.5);
+	const float3 cool = float3(1.0 - 0.1 * 0.5, 1.0, 1.0 + 0.1 * 0.5);
+	float3 xyz = mul(RGB_TO_XYZ, color);
+	xyz *= lerp(cool, warm, (Temperature + 1.0) * 0.5);
+	return mul(XYZ_TO_RGB, xyz);
+}
+
+float3 LiftGammaGain(float3 color)
+{
+	color = color * (GAIN.rgb - LIFT.rgb) + LIFT.rgb;
+	return pow(max(color, 0.0), (float3)1.0 / GAMMA.rgb);
+}
+
+float4 PS_Grade(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	float3 color = pow(tex2D(ReShade::BackBuffer, texcoord).rgb, (float3)(2.2));
+	color *= exp2(Exposure);
+	color = WhiteBalance(color);
+
+	const float luma = dot(color, LUMA_COEFFICIENTS);
+	const float saturation = max(color.r, max(color.g, color.b)) - min(color.r, min(color.g, color.b));
+	color = lerp((float3)luma, color, 1.0 + Vibrance * (1.0 - (float)(saturation)));
+
+	color = USE_ACES ? Aces(color) : Uncharted(color * 2.0) / Uncharted((float3)(11.2));
+	color = LiftGammaGain(color);
+
+	float dither = 0.0;
+	[unroll]
+	for (int i = 0; i < STEPS / 4; i++)
+	{
+		dither += frac(sin(dot(texcoord + (float)i * STEP_SIZE, float2(12.9898, 78.233))) * 43758.5453) * ((float)1 / (float)(STEPS / 4));
+	}
+
+	return float4(pow(saturate(color), (float3)INV_GAMMA) + (dither - 0.5) / 255.0, 1.0);
+}
+
+technique Grade
+{
+	pass
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = PS_Grade;
+		SRGBWriteEnable = false;
+	}
+}
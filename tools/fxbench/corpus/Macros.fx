@@ -0,0 +1,111 @@
+/**
+ * Configuration heavy effect in the style of large shader packs, which generate most of their code with macros and select features with nested conditionals.
+ */
+
+#include "ReShade.fxh"
+
+#define QUALITY_LOW 0
+#define QUALITY_MEDIUM 1
+#define QUALITY_HIGH 2
+
+#ifndef QUALITY
+	#define QUALITY QUALITY_HIGH
+#endif
+
+#if QUALITY >= QUALITY_HIGH && (BUFFER_WIDTH * BUFFER_HEIGHT) > (1280 * 720) || defined(FORCE_HIGH_QUALITY)
+	#define TAP_COUNT 16
+#elif QUALITY == QUALITY_MEDIUM || (BUFFER_WIDTH >= 1920 && !defined(LOW_MEMORY))
+	#define TAP_COUNT 8
+#else
+	#define TAP_COUNT 4
+#endif
+
+#if (TAP_COUNT & (TAP_COUNT - 1)) != 0
+	#error "TAP_COUNT has to be a power of two"
+#endif
+
+#define STRINGIFY(x) #x
+#define CONCAT(a, b) a##b
+#define CONCAT3(a, b, c) CONCAT(CONCAT(a, b), c)
+#define SQUARE(x) ((x) * (x))
+#define LERP3(a, b, c, t) lerp(lerp(a, b, saturate((t) * 2.0)), c, saturate((t) * 2.0 - 1.0))
+#define PIXEL_OFFSET(x, y) (float2(x, y) * ReShade::PixelSize)
+#define SAMPLE(s, uv, x, y) tex2D(s, (uv) + PIXEL_OFFSET(x, y))
+
+#define DECLARE_UNIFORM(type, name, label, minimum, maximum, value) \
+	uniform type name < ui_type = "drag"; ui_label = label; ui_min = minimum; ui_max = maximum; ui_tooltip = STRINGIFY(name) " (" #minimum " - " #maximum ")"; > = value;
+
+#define DECLARE_TARGET(name, scale, format) \
+	texture CONCAT(name, Tex) { Width = BUFFER_WIDTH / (scale); Height = BUFFER_HEIGHT / (scale); Format = format; }; \
+	sampler CONCAT(name, Sampler) { Texture = CONCAT(name, Tex); AddressU = CLAMP; AddressV = CLAMP; };
+
+#define DECLARE_PASS(name, ps, target) \
+	pass name { VertexShader = PostProcessVS; PixelShader = ps; RenderTarget = CONCAT(target, Tex); }
+
+DECLARE_UNIFORM(float, Strength, "Strength", 0.0, 2.0, 1.0)
+DECLARE_UNIFORM(float, Radius, "Radius", 0.5, 8.0, 2.0)
+DECLARE_UNIFORM(float, Falloff, "Falloff", 0.0, 1.0, 0.5)
+DECLARE_UNIFORM(float, Saturation, "Saturation", 0.0, 2.0, 1.0)
+
+DECLARE_TARGET(Quarter, 4, RGBA8)
+DECLARE_TARGET(Half, 2, RGBA16F)
+DECLARE_TARGET(Full, 1, RGBA16)
+
+float4 CONCAT3(Sample, Taps, TAP_COUNT)(sampler s, float2 texcoord)
+{
+	float4 color = 0.0;
+#if TAP_COUNT >= 4
+	color += SAMPLE(s, texcoord, -Radius, -Radius);
+	color += SAMPLE(s, texcoord,  Radius, -Radius);
+	color += SAMPLE(s, texcoord, -Radius,  Radius);
+	color += SAMPLE(s, texcoord,  Radius,  Radius);
+#endif
+#if TAP_COUNT >= 8
+	color += SAMPLE(s, texcoord, -SQUARE(Radius) * 0.5, 0.0);
+	color += SAMPLE(s, texcoord,  SQUARE(Radius) * 0.5, 0.0);
+	color += SAMPLE(s, texcoord, 0.0, -SQUARE(Radius) * 0.5);
+	color += SAMPLE(s, texcoord, 0.0,  SQUARE(Radius) * 0.5);
+#endif
+#if TAP_COUNT >= 16
+	[unroll]
+	for (int i = 0; i < 8; i++)
+	{
+		const float angle = i * (6.2831853 / 8.0);
+		color += SAMPLE(s, texcoord, cos(angle) * Radius * 2.0, sin(angle) * Radius * 2.0);
+	}
+#endif
+	return color / TAP_COUNT;
+}
+
+float4 PS_Downsample(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	return CONCAT3(Sample, Taps, TAP_COUNT)(ReShade::BackBuffer, texcoord);
+}
+float4 PS_Filter(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	return CONCAT3(Sample, Taps, TAP_COUNT)(QuarterSampler, texcoord) * Falloff;
+}
+float4 PS_Resolve(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	const float4 color = tex2D(ReShade::BackBuffer, texcoord);
+	const float4 filtered = tex2D(HalfSampler, texcoord);
+	const float luma = dot(color.rgb, float3(0.299, 0.587, 0.114));
+
+	return float4(LERP3(luma.xxx, color.rgb, filtered.rgb, Saturation * 0.5) * Strength, color.a);
+}
+float4 PS_Output(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	return tex2D(FullSampler, texcoord);
+}
+
+technique CONCAT(Macro, Effect)
+{
+	DECLARE_PASS(Downsample, PS_Downsample, Quarter)
+	DECLARE_PASS(Filter, PS_Filter, Half)
+	DECLARE_PASS(Resolve, PS_Resolve, Full)
+	pass Output
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = PS_Output;
+	}
+}
@@ -0,0 +1,553 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "version.h"
+#include "ini_file.hpp"
+#include "effect_parser.hpp"
+#include "effect_preprocessor.hpp"
+#include "effect_reachability.hpp"
+#include "shader_cache.hpp"
+#include "d3d11/d3d11_runtime.hpp"
+#include "d3d11/d3d11_effect_compiler.hpp"
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+using namespace reshade;
+
+// The resources the runtime loads its own shaders from are linked into this executable
+HMODULE g_module_handle = nullptr;
+
+struct stage_timings
+{
+	std::vector<double> samples;
+
+	double min() const
+	{
+		return samples.empty() ? 0.0 : *std::min_element(samples.begin(), samples.end());
+	}
+	double median() const
+	{
+		if (samples.empty())
+		{
+			return 0.0;
+		}
+
+		std::vector<double> sorted(samples);
+		std::sort(sorted.begin(), sorted.end());
+
+		const size_t middle = sorted.size() / 2;
+
+		return sorted.size() % 2 != 0 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) * 0.5;
+	}
+};
+struct effect_report
+{
+	filesystem::path path;
+	bool success = true;
+	std::string errors;
+	size_t tokens = 0, techniques = 0, passes = 0;
+	stage_timings preprocess, parse, analysis, codegen, compile, total;
+};
+struct compile_settings
+{
+	std::vector<filesystem::path> include_paths;
+	std::vector<std::pair<std::string, std::string>> macros;
+};
+
+/// <summary>
+/// A Direct3D 11 device on a hidden window, with a runtime for the effect compiler to create the effect resources on, so code generation and 'D3DCompile' run exactly like in the game.
+/// </summary>
+struct d3d11_backend
+{
+	HWND window = nullptr;
+	com_ptr<ID3D11Device> device;
+	com_ptr<IDXGISwapChain> swapchain;
+	std::unique_ptr<d3d11::d3d11_runtime> runtime;
+
+	~d3d11_backend()
+	{
+		if (runtime != nullptr)
+		{
+			runtime->on_reset();
+			runtime.reset();
+		}
+
+		swapchain.reset();
+		device.reset();
+
+		if (window != nullptr)
+		{
+			DestroyWindow(window);
+		}
+	}
+
+	bool init(unsigned int width, unsigned int height)
+	{
+		WNDCLASSW wc = { };
+		wc.hInstance = GetModuleHandleW(nullptr);
+		wc.lpszClassName = L"fxbench";
+		wc.lpfnWndProc = &DefWindowProcW;
+
+		RegisterClassW(&wc);
+
+		// The window is never shown, it only has to exist for the swap chain
+		window = CreateWindowW(wc.lpszClassName, L"fxbench", WS_OVERLAPPEDWINDOW, 0, 0, width, height, nullptr, nullptr, wc.hInstance, nullptr);
+
+		if (window == nullptr)
+		{
+			return false;
+		}
+
+		DXGI_SWAP_CHAIN_DESC desc = { };
+		desc.BufferCount = 1;
+		desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+		desc.BufferDesc.Width = width;
+		desc.BufferDesc.Height = height;
+		desc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc = { 1, 0 };
+		desc.Windowed = true;
+		desc.OutputWindow = window;
+
+		if (FAILED(D3D11CreateDeviceAndSwapChain(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &desc, &swapchain, &device, nullptr, nullptr)) &&
+			FAILED(D3D11CreateDeviceAndSwapChain(nullptr, D3D_DRIVER_TYPE_WARP, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &desc, &swapchain, &device, nullptr, nullptr)))
+		{
+			return false;
+		}
+
+		// Keep the configuration and caches of the runtime away from any real installation
+		wchar_t temp_path[MAX_PATH] = L"";
+		GetTempPathW(MAX_PATH, temp_path);
+		g_module_handle = GetModuleHandleW(nullptr);
+		reshade::runtime::s_reshade_dll_path = filesystem::get_module_path(nullptr);
+		reshade::runtime::s_target_executable_path = filesystem::get_module_path(nullptr);
+		reshade::runtime::s_gw2hook_wrkdir_path = filesystem::path(temp_path) + "fxbench\\";
+		CreateDirectoryW(reshade::runtime::s_gw2hook_wrkdir_path.wstring().c_str(), nullptr);
+
+		// Every shader is compiled, since the cache would hide the compiler from every iteration but the first
+		shader_cache::set_enabled(false);
+
+		runtime = std::make_unique<d3d11::d3d11_runtime>(device.get(), swapchain.get());
+
+		if (!runtime->on_init(desc))
+		{
+			runtime.reset();
+			return false;
+		}
+
+		return true;
+	}
+};
+
+static void add_definition(compile_settings &settings, const std::string &definition)
+{
+	if (definition.empty())
+	{
+		return;
+	}
+
+	const size_t equals_index = definition.find_first_of('=');
+
+	if (equals_index != std::string::npos)
+	{
+		settings.macros.emplace_back(definition.substr(0, equals_index), definition.substr(equals_index + 1));
+	}
+	else
+	{
+		settings.macros.emplace_back(definition, "1");
+	}
+}
+
+static double elapsed_milliseconds(std::chrono::high_resolution_clock::time_point begin)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+/// <summary>
+/// Run the same stages the runtime runs on an effect file, measuring each of them.
+/// </summary>
+/// <param name="backend">The runtime to generate and compile code with, or <c>nullptr</c> to only run the front end.</param>
+static void compile_effect(const compile_settings &settings, const std::shared_ptr<reshadefx::include_cache> &include_cache, d3d11::d3d11_runtime *backend, effect_report &report)
+{
+	const auto begin = std::chrono::high_resolution_clock::now();
+
+	reshadefx::preprocessor pp;
+	pp.set_include_cache(include_cache);
+	pp.set_token_output(true);
+	pp.add_include_path(report.path.parent_path());
+
+	for (const auto &include_path : settings.include_paths)
+	{
+		pp.add_include_path(include_path);
+	}
+
+	for (const auto &macro : settings.macros)
+	{
+		pp.add_macro_definition(macro.first, macro.second);
+	}
+
+	if (!pp.run(report.path))
+	{
+		report.success = false;
+		report.errors = pp.errors();
+		return;
+	}
+
+	report.preprocess.samples.push_back(elapsed_milliseconds(begin));
+	report.tokens = pp.current_tokens().size();
+
+	auto stage_begin = std::chrono::high_resolution_clock::now();
+
+	reshadefx::syntax_tree ast;
+	reshadefx::parser parser(ast);
+
+	if (!parser.run(pp.current_tokens()))
+	{
+		report.success = false;
+		report.errors = parser.errors();
+		return;
+	}
+
+	report.parse.samples.push_back(elapsed_milliseconds(stage_begin));
+
+	// The device independent analysis code generation starts with, measured on its own to tell it apart from the back-end
+	stage_begin = std::chrono::high_resolution_clock::now();
+
+	report.techniques = ast.techniques.size();
+	report.passes = 0;
+
+	for (const auto technique : ast.techniques)
+	{
+		for (const auto pass : technique->pass_list)
+		{
+			reshadefx::reachable_declarations reachable;
+
+			if (pass->vertex_shader != nullptr)
+			{
+				reshadefx::find_reachable_declarations(pass->vertex_shader, reachable);
+			}
+			if (pass->pixel_shader != nullptr)
+			{
+				reshadefx::find_reachable_declarations(pass->pixel_shader, reachable);
+			}
+
+			report.passes++;
+		}
+	}
+
+	report.analysis.samples.push_back(elapsed_milliseconds(stage_begin));
+
+	if (backend != nullptr)
+	{
+		stage_begin = std::chrono::high_resolution_clock::now();
+
+		std::string errors;
+		d3d11::d3d11_effect_compiler compiler(backend, ast, errors);
+		const bool success = compiler.run();
+
+		// Code generation includes creating the effect resources, which the compiler does while it visits the declarations
+		const double backend_duration = elapsed_milliseconds(stage_begin);
+		const double compile_duration = std::chrono::duration<double, std::milli>(compiler.compile_duration()).count();
+
+		// Release the resources again, so every effect is compiled on the same clean runtime
+		backend->on_reset_effect();
+
+		if (!success)
+		{
+			report.success = false;
+			report.errors = errors;
+			return;
+		}
+
+		report.codegen.samples.push_back(backend_duration - compile_duration);
+		report.compile.samples.push_back(compile_duration);
+	}
+
+	report.total.samples.push_back(elapsed_milliseconds(begin));
+}
+
+static void write_csv(std::ostream &stream, const std::vector<effect_report> &reports)
+{
+	stream << std::fixed << std::setprecision(3);
+	stream << "file,status,tokens,techniques,passes,preprocess_min_ms,preprocess_median_ms,parse_min_ms,parse_median_ms,analysis_min_ms,analysis_median_ms,codegen_min_ms,codegen_median_ms,compile_min_ms,compile_median_ms,total_min_ms,total_median_ms\n";
+
+	for (const auto &report : reports)
+	{
+		stream << '\"' << report.path.filename().string() << "\"," << (report.success ? "ok" : "failed") << ',' << report.tokens << ',' << report.techniques << ',' << report.passes;
+
+		for (const auto stage : { &report.preprocess, &report.parse, &report.analysis, &report.codegen, &report.compile, &report.total })
+		{
+			stream << ',' << stage->min() << ',' << stage->median();
+		}
+
+		stream << '\n';
+	}
+}
+static void write_json(std::ostream &stream, const std::vector<effect_report> &reports)
+{
+	const auto escape = [](const std::string &value) {
+		std::string result;
+
+		for (const char c : value)
+		{
+			switch (c)
+			{
+			case '\"':
+				result += "\\\"";
+				break;
+			case '\\':
+				result += "\\\\";
+				break;
+			case '\n':
+				result += "\\n";
+				break;
+			case '\r':
+			case '\t':
+				result += ' ';
+				break;
+			default:
+				result += c;
+				break;
+			}
+		}
+
+		return result;
+	};
+
+	stream << std::fixed << std::setprecision(3);
+	stream << "[\n";
+
+	for (size_t i = 0; i < reports.size(); i++)
+	{
+		const auto &report = reports[i];
+
+		stream << "  {\n";
+		stream << "    \"file\": \"" << escape(report.path.filename().string()) << "\",\n";
+		stream << "    \"status\": \"" << (report.success ? "ok" : "failed") << "\",\n";
+
+		if (!report.success)
+		{
+			stream << "    \"errors\": \"" << escape(report.errors) << "\",\n";
+		}
+
+		stream << "    \"tokens\": " << report.tokens << ",\n";
+		stream << "    \"techniques\": " << report.techniques << ",\n";
+		stream << "    \"passes\": " << report.passes << ",\n";
+
+		const std::pair<const char *, const stage_timings *> stages[] = {
+			{ "preprocess", &report.preprocess },
+			{ "parse", &report.parse },
+			{ "analysis", &report.analysis },
+			{ "codegen", &report.codegen },
+			{ "compile", &report.compile },
+			{ "total", &report.total },
+		};
+
+		for (size_t k = 0; k < std::size(stages); k++)
+		{
+			stream << "    \"" << stages[k].first << "\": { \"min_ms\": " << stages[k].second->min() << ", \"median_ms\": " << stages[k].second->median() << " }" << (k + 1 < std::size(stages) ? ",\n" : "\n");
+		}
+
+		stream << "  }" << (i + 1 < reports.size() ? ",\n" : "\n");
+	}
+
+	stream << "]\n";
+}
+
+static void print_usage()
+{
+	std::cerr <<
+		"usage: fxbench <effect directory> [options]\n"
+		"\n"
+		"  -p <file>    Load include paths and preprocessor definitions from a ReShade preset or configuration file\n"
+		"  -D <name>[=<value>]\n"
+		"               Add a preprocessor definition\n"
+		"  -I <path>    Add an include path\n"
+		"  -n <count>   Compile every effect this many times and report the minimum and median (default 5)\n"
+		"  -w <width>   Value of BUFFER_WIDTH (default 1920)\n"
+		"  -h <height>  Value of BUFFER_HEIGHT (default 1080)\n"
+		"  -o <file>    Write the report to a file instead of the standard output\n"
+		"  --json       Write the report as JSON instead of CSV\n"
+		"  --no-codegen Only run the front end, without creating a Direct3D 11 device for code generation and D3DCompile\n";
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		print_usage();
+		return 1;
+	}
+
+	const filesystem::path effect_directory = argv[1];
+	compile_settings settings;
+	std::vector<std::string> definitions;
+	filesystem::path output_path;
+	unsigned int iterations = 5, width = 1920, height = 1080;
+	bool json = false, codegen = true;
+
+	for (int i = 2; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+
+		if (arg == "--json")
+		{
+			json = true;
+			continue;
+		}
+		if (arg == "--no-codegen")
+		{
+			codegen = false;
+			continue;
+		}
+
+		if (arg.size() != 2 || arg[0] != '-' || i + 1 >= argc)
+		{
+			print_usage();
+			return 1;
+		}
+
+		const std::string value = argv[++i];
+
+		switch (arg[1])
+		{
+		case 'p':
+		{
+			const ini_file preset(value);
+			std::vector<std::string> preset_include_paths, preset_definitions;
+			preset.get("GENERAL", "EffectSearchPaths", preset_include_paths);
+			preset.get("GENERAL", "PreprocessorDefinitions", preset_definitions);
+
+			for (const auto &include_path : preset_include_paths)
+			{
+				if (!include_path.empty())
+				{
+					settings.include_paths.push_back(include_path);
+				}
+			}
+
+			definitions.insert(definitions.end(), preset_definitions.begin(), preset_definitions.end());
+			break;
+		}
+		case 'D':
+			definitions.push_back(value);
+			break;
+		case 'I':
+			settings.include_paths.push_back(value);
+			break;
+		case 'n':
+			iterations = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+			break;
+		case 'w':
+			width = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+			break;
+		case 'h':
+			height = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+			break;
+		case 'o':
+			output_path = value;
+			break;
+		default:
+			print_usage();
+			return 1;
+		}
+	}
+
+	d3d11_backend backend;
+
+	if (codegen && !backend.init(width, height))
+	{
+		std::cerr << "Failed to create a Direct3D 11 device, use --no-codegen to only run the front end.\n";
+		return 1;
+	}
+
+	// Match the definitions the runtime adds, so effects take the same code paths as in the game
+	settings.macros.emplace_back("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
+	settings.macros.emplace_back("__RESHADE_PERFORMANCE_MODE__", "0");
+	settings.macros.emplace_back("__VENDOR__", "0");
+	settings.macros.emplace_back("__DEVICE__", "0");
+	settings.macros.emplace_back("__RENDERER__", std::to_string(backend.device != nullptr ? static_cast<unsigned int>(backend.device->GetFeatureLevel()) : 0x9300u));
+	settings.macros.emplace_back("__APPLICATION__", "0");
+	settings.macros.emplace_back("BUFFER_WIDTH", std::to_string(width));
+	settings.macros.emplace_back("BUFFER_HEIGHT", std::to_string(height));
+	settings.macros.emplace_back("BUFFER_RCP_WIDTH", std::to_string(1.0f / static_cast<float>(width)));
+	settings.macros.emplace_back("BUFFER_RCP_HEIGHT", std::to_string(1.0f / static_cast<float>(height)));
+
+	for (const auto &definition : definitions)
+	{
+		add_definition(settings, definition);
+	}
+
+	std::vector<effect_report> reports;
+
+	for (const auto &path : filesystem::list_files(effect_directory, "*.fx"))
+	{
+		reports.emplace_back().path = path;
+	}
+
+	if (reports.empty())
+	{
+		std::cerr << "No effect files found in " << effect_directory << ".\n";
+		return 1;
+	}
+
+	std::sort(reports.begin(), reports.end(), [](const effect_report &lhs, const effect_report &rhs) { return lhs.path.string() < rhs.path.string(); });
+
+	for (unsigned int iteration = 0; iteration < iterations; iteration++)
+	{
+		// Every iteration reads the files from disk again, like a reload in the game does
+		const auto include_cache = std::make_shared<reshadefx::include_cache>();
+
+		for (auto &report : reports)
+		{
+			if (report.success)
+			{
+				compile_effect(settings, include_cache, backend.runtime.get(), report);
+			}
+		}
+	}
+
+	size_t failed = 0;
+
+	for (const auto &report : reports)
+	{
+		if (!report.success)
+		{
+			std::cerr << "Failed to compile " << report.path << ":\n" << report.errors << '\n';
+			failed++;
+		}
+	}
+
+	std::ofstream file;
+
+	if (!output_path.string().empty())
+	{
+		file.open(output_path.wstring());
+
+		if (!file.is_open())
+		{
+			std::cerr << "Failed to open " << output_path << " for writing.\n";
+			return 1;
+		}
+	}
+
+	std::ostream &stream = file.is_open() ? file : std::cout;
+
+	if (json)
+	{
+		write_json(stream, reports);
+	}
+	else
+	{
+		write_csv(stream, reports);
+	}
+
+	return failed != 0 ? 2 : 0;
+}
@@ -0,0 +1,342 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "version.h"
+#include "effect_lexer.hpp"
+#include "effect_parser.hpp"
+#include "effect_preprocessor.hpp"
+#include "effect_symbol_table.hpp"
+#include "effect_syntax_tree_nodes.hpp"
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+using namespace reshade;
+
+struct benchmark_result
+{
+	std::string name;
+	// Number of units (tokens, lookups, ...) one run of the benchmark processes
+	size_t units = 0;
+	std::vector<double> samples;
+};
+
+/// <summary>
+/// Time a benchmark with a fixed number of samples, each running it a fixed number of times, so results of two builds compare directly.
+/// </summary>
+/// <param name="run">The function to benchmark. It returns the number of units it processed.</param>
+static benchmark_result run_benchmark(const std::string &name, unsigned int samples, unsigned int repetitions, const std::function<size_t()> &run)
+{
+	benchmark_result result;
+	result.name = name;
+
+	// Warm up caches and the allocator once before measuring anything
+	result.units = run();
+
+	for (unsigned int sample = 0; sample < samples; sample++)
+	{
+		const auto begin = std::chrono::high_resolution_clock::now();
+
+		for (unsigned int i = 0; i < repetitions; i++)
+		{
+			run();
+		}
+
+		result.samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - begin).count() / repetitions);
+	}
+
+	std::sort(result.samples.begin(), result.samples.end());
+
+	return result;
+}
+
+static bool read_file(const filesystem::path &path, std::string &data)
+{
+	std::ifstream file(path.wstring(), std::ios::in | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+	return true;
+}
+
+static void add_default_macros(reshadefx::preprocessor &pp)
+{
+	pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
+	pp.add_macro_definition("__RESHADE_PERFORMANCE_MODE__", "0");
+	pp.add_macro_definition("__VENDOR__", "0");
+	pp.add_macro_definition("__DEVICE__", "0");
+	pp.add_macro_definition("__RENDERER__", std::to_string(0x9300));
+	pp.add_macro_definition("__APPLICATION__", "0");
+	pp.add_macro_definition("BUFFER_WIDTH", "1920");
+	pp.add_macro_definition("BUFFER_HEIGHT", "1080");
+	pp.add_macro_definition("BUFFER_RCP_WIDTH", std::to_string(1.0f / 1920));
+	pp.add_macro_definition("BUFFER_RCP_HEIGHT", std::to_string(1.0f / 1080));
+}
+
+/// <summary>
+/// Look up names the way the parser does while parsing function bodies: Many globals, a few nested scopes with locals and lookups that mostly hit a local or a global.
+/// </summary>
+static size_t benchmark_symbol_table(const std::vector<reshadefx::nodes::variable_declaration_node *> &globals, const std::vector<reshadefx::nodes::variable_declaration_node *> &locals)
+{
+	reshadefx::symbol_table symbols;
+
+	for (const auto variable : globals)
+	{
+		symbols.insert(variable, true);
+	}
+
+	size_t lookups = 0;
+	const size_t locals_per_scope = locals.size() / 4;
+
+	for (size_t level = 0; level < 4; level++)
+	{
+		symbols.enter_scope();
+
+		for (size_t i = 0; i < locals_per_scope; i++)
+		{
+			symbols.insert(locals[level * locals_per_scope + i]);
+		}
+
+		for (size_t i = 0; i < globals.size(); i++, lookups += 2)
+		{
+			if (symbols.find(globals[i]->name) == nullptr || symbols.find(locals[(i % ((level + 1) * locals_per_scope))]->name) == nullptr)
+			{
+				std::abort();
+			}
+		}
+	}
+
+	for (size_t level = 0; level < 4; level++)
+	{
+		symbols.leave_scope();
+	}
+
+	return lookups;
+}
+
+static void print_usage()
+{
+	std::cerr <<
+		"usage: fxmicrobench <corpus directory> [options]\n"
+		"\n"
+		"  -n <count>   Number of samples to take of every benchmark (default 30)\n"
+		"  -r <count>   Number of times to run a benchmark per sample (default 10)\n"
+		"  -f <filter>  Only run benchmarks whose name contains this text\n"
+		"  --csv        Write the results as CSV instead of a table\n";
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		print_usage();
+		return 1;
+	}
+
+	const filesystem::path corpus_directory = argv[1];
+	unsigned int samples = 30, repetitions = 10;
+	std::string filter;
+	bool csv = false;
+
+	for (int i = 2; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+
+		if (arg == "--csv")
+		{
+			csv = true;
+			continue;
+		}
+
+		if (arg.size() != 2 || arg[0] != '-' || i + 1 >= argc)
+		{
+			print_usage();
+			return 1;
+		}
+
+		const std::string value = argv[++i];
+
+		switch (arg[1])
+		{
+		case 'n':
+			samples = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+			break;
+		case 'r':
+			repetitions = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+			break;
+		case 'f':
+			filter = value;
+			break;
+		default:
+			print_usage();
+			return 1;
+		}
+	}
+
+	auto effect_files = filesystem::list_files(corpus_directory, "*.fx");
+	auto header_files = filesystem::list_files(corpus_directory, "*.fxh");
+
+	if (effect_files.empty())
+	{
+		std::cerr << "No effect files found in " << corpus_directory << ".\n";
+		return 1;
+	}
+
+	const auto sort_by_name = [](const filesystem::path &lhs, const filesystem::path &rhs) { return lhs.string() < rhs.string(); };
+	std::sort(effect_files.begin(), effect_files.end(), sort_by_name);
+	std::sort(header_files.begin(), header_files.end(), sort_by_name);
+
+	std::vector<benchmark_result> results;
+
+	const auto add_benchmark = [&](const std::string &name, const std::function<size_t()> &run) {
+		if (name.find(filter) != std::string::npos)
+		{
+			results.push_back(run_benchmark(name, samples, repetitions, run));
+		}
+	};
+
+	// Lexer token throughput, with the settings the parser uses and with the ones the preprocessor uses
+	std::vector<filesystem::path> source_files(header_files);
+	source_files.insert(source_files.end(), effect_files.begin(), effect_files.end());
+
+	for (const auto &path : source_files)
+	{
+		std::string data;
+
+		if (!read_file(path, data))
+		{
+			std::cerr << "Failed to read " << path << ".\n";
+			return 1;
+		}
+
+		const auto source = std::make_shared<const std::string>(std::move(data));
+
+		add_benchmark("lexer/" + path.filename().string(), [source]() {
+			size_t count = 0;
+			reshadefx::lexer lexer(source);
+
+			while (lexer.lex().id != reshadefx::tokenid::end_of_file)
+			{
+				count++;
+			}
+
+			return count;
+		});
+		add_benchmark("lexer_pp/" + path.filename().string(), [source]() {
+			size_t count = 0;
+			reshadefx::lexer lexer(source, false, false, true, false);
+
+			while (lexer.lex().id != reshadefx::tokenid::end_of_file)
+			{
+				count++;
+			}
+
+			return count;
+		});
+	}
+
+	for (const auto &path : effect_files)
+	{
+		// Macro expansion and conditional expression evaluation, including the includes the effect pulls in
+		add_benchmark("preprocessor/" + path.filename().string(), [&path, &corpus_directory]() {
+			reshadefx::preprocessor pp;
+			pp.set_token_output(true);
+			pp.add_include_path(corpus_directory);
+			add_default_macros(pp);
+
+			if (!pp.run(path))
+			{
+				std::cerr << "Failed to preprocess " << path << ":\n" << pp.errors();
+				std::exit(2);
+			}
+
+			return pp.current_tokens().size();
+		});
+
+		// Parsing with symbol table lookups, constant folding and the backtracking on parentheses and sampler states
+		const auto pp = std::make_shared<reshadefx::preprocessor>();
+		pp->set_token_output(true);
+		pp->add_include_path(corpus_directory);
+		add_default_macros(*pp);
+
+		if (!pp->run(path))
+		{
+			std::cerr << "Failed to preprocess " << path << ":\n" << pp->errors();
+			return 2;
+		}
+
+		add_benchmark("parser/" + path.filename().string(), [pp, &path]() {
+			reshadefx::syntax_tree ast;
+			reshadefx::parser parser(ast);
+
+			if (!parser.run(pp->current_tokens()))
+			{
+				std::cerr << "Failed to parse " << path << ":\n" << parser.errors();
+				std::exit(2);
+			}
+
+			return pp->current_tokens().size();
+		});
+	}
+
+	reshadefx::syntax_tree symbol_ast;
+	std::vector<reshadefx::nodes::variable_declaration_node *> globals, locals;
+
+	for (size_t i = 0; i < 1024; i++)
+	{
+		const auto variable = symbol_ast.make_node<reshadefx::nodes::variable_declaration_node>(reshadefx::location());
+		variable->name = symbol_ast.make_string("Global" + std::to_string(i));
+		globals.push_back(variable);
+	}
+	for (size_t i = 0; i < 64; i++)
+	{
+		const auto variable = symbol_ast.make_node<reshadefx::nodes::variable_declaration_node>(reshadefx::location());
+		variable->name = symbol_ast.make_string("local" + std::to_string(i));
+		locals.push_back(variable);
+	}
+
+	add_benchmark("symbol_table/lookup", [&globals, &locals]() { return benchmark_symbol_table(globals, locals); });
+
+	if (csv)
+	{
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "benchmark,units,min_us,median_us,median_units_per_us\n";
+	}
+	else
+	{
+		std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(10) << "units" << std::setw(14) << "min us" << std::setw(14) << "median us" << std::setw(14) << "units/us" << '\n';
+		std::cout << std::fixed << std::setprecision(3);
+	}
+
+	for (const auto &result : results)
+	{
+		const double min = result.samples.front();
+		const size_t middle = result.samples.size() / 2;
+		const double median = result.samples.size() % 2 != 0 ? result.samples[middle] : (result.samples[middle - 1] + result.samples[middle]) * 0.5;
+		const double throughput = median > 0.0 ? result.units / median : 0.0;
+
+		if (csv)
+		{
+			std::cout << result.name << ',' << result.units << ',' << min << ',' << median << ',' << throughput << '\n';
+		}
+		else
+		{
+			std::cout << std::left << std::setw(40) << result.name << std::right << std::setw(10) << result.units << std::setw(14) << min << std::setw(14) << median << std::setw(14) << throughput << '\n';
+		}
+	}
+
+	return 0;
+}